@@ -249,6 +249,39 @@ CoFileFoundCallback(
     return TRUE;
 }
 
+/**
+ Compare the names of two found files whose sort keys are identical.
+
+ @param Left Pointer to the first found file.
+
+ @param Right Pointer to the second found file.
+
+ @param Context Unused.
+
+ @return YORI_LIB_LESS_THAN if the first file should be displayed before the
+         second, YORI_LIB_GREATER_THAN if the first file should be displayed
+         after the second, or YORI_LIB_EQUAL if the names are the same.
+ */
+DWORD
+CoCompareFoundFileNames(
+    __in PVOID Left,
+    __in PVOID Right,
+    __in PVOID Context
+    )
+{
+    int Result;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    Result = YoriLibCompareStringInsensitive(&((PCO_FOUND_FILE)Left)->DisplayName, &((PCO_FOUND_FILE)Right)->DisplayName);
+    if (Result < 0) {
+        return YORI_LIB_LESS_THAN;
+    } else if (Result > 0) {
+        return YORI_LIB_GREATER_THAN;
+    }
+    return YORI_LIB_EQUAL;
+}
+
 /**
  Populate in memory structures and the UI list with found files.
 
@@ -264,12 +297,10 @@ CoPopulateList(
     YORI_STRING FileSpec;
     PYORI_STRING DisplayArray;
     DWORD Index;
-    DWORD SubIndex;
-    DWORD BestIndex;
     PYORI_LIST_ENTRY ListEntry;
     PCO_FOUND_FILE FoundFile;
-    PCO_FOUND_FILE CompareFile;
-    PCO_FOUND_FILE BestFile;
+    PYORI_LIB_SORT_ENTRY SortEntries;
+    PYORI_LIB_SORT_COMPARE_FN CompareFn;
 
     YoriLibConstantString(&FileSpec, _T("*"));
     YoriLibForEachFile(&FileSpec, YORILIB_FILEENUM_BASIC_EXPANSION | YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_RETURN_DIRECTORIES | YORILIB_FILEENUM_INCLUDE_DOTFILES, 0, CoFileFoundCallback, NULL, CoContext);
@@ -289,51 +320,46 @@ CoPopulateList(
         return FALSE;
     }
 
+    SortEntries = YoriLibMalloc(sizeof(YORI_LIB_SORT_ENTRY) * CoContext->FilesFoundCount);
+    if (SortEntries == NULL) {
+        YoriLibFree(DisplayArray);
+        return FALSE;
+    }
+
     //
-    //  Arrange the files into a flat array
+    //  Arrange the files into a flat array with a key for the selected sort
+    //  criteria
     //
 
+    CompareFn = NULL;
     ListEntry = NULL;
     for (Index = 0; Index < CoContext->FilesFoundCount; Index++) {
         ListEntry = YoriLibGetNextListEntry(&CoContext->FilesFound, ListEntry);
         FoundFile = CONTAINING_RECORD(ListEntry, CO_FOUND_FILE, ListEntry);
-        CoContext->FileArray[Index] = FoundFile;
+        SortEntries[Index].Item = FoundFile;
+        if (CoContext->SortType == CoSortByName) {
+            SortEntries[Index].Key = YoriLibSortKeyFromStringPrefix(&FoundFile->DisplayName);
+            CompareFn = CoCompareFoundFileNames;
+        } else if (CoContext->SortType == CoSortBySize) {
+            SortEntries[Index].Key = (ULONGLONG)FoundFile->FileSize.QuadPart;
+        } else {
+            SortEntries[Index].Key = (ULONGLONG)FoundFile->WriteTime.QuadPart;
+        }
     }
 
     //
-    //  Sort the array based on the selected sort criteria
+    //  Sort the array based on the selected sort criteria.  If this fails,
+    //  display the files in the order they were found.
     //
 
-    for (Index = 0; Index < CoContext->FilesFoundCount; Index++) {
-        FoundFile = CoContext->FileArray[Index];
-        BestFile = FoundFile;
-        BestIndex = Index;
-        for (SubIndex = Index + 1; SubIndex < CoContext->FilesFoundCount; SubIndex++) {
-            CompareFile = CoContext->FileArray[SubIndex];
-            if (CoContext->SortType == CoSortByName) {
-                if (YoriLibCompareStringInsensitive(&CompareFile->DisplayName, &BestFile->DisplayName) < 0) {
-                    BestFile = CompareFile;
-                    BestIndex = SubIndex;
-                }
-            } else if (CoContext->SortType == CoSortBySize) {
-                if (CompareFile->FileSize.QuadPart < BestFile->FileSize.QuadPart) {
-                    BestFile = CompareFile;
-                    BestIndex = SubIndex;
-                }
-            } else if (CoContext->SortType == CoSortByDate) {
-                if (CompareFile->WriteTime.QuadPart < BestFile->WriteTime.QuadPart) {
-                    BestFile = CompareFile;
-                    BestIndex = SubIndex;
-                }
-            }
-        }
+    YoriLibSortEntries(SortEntries, CoContext->FilesFoundCount, CompareFn, NULL);
 
-        if (BestIndex != Index) {
-            CoContext->FileArray[BestIndex] = CoContext->FileArray[Index];
-            CoContext->FileArray[Index] = BestFile;
-        }
+    for (Index = 0; Index < CoContext->FilesFoundCount; Index++) {
+        CoContext->FileArray[Index] = SortEntries[Index].Item;
     }
 
+    YoriLibFree(SortEntries);
+
     //
     //  Generate the display array string based on the result of the sort
     //
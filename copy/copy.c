@@ -51,14 +51,20 @@ CHAR strCopyHelpText[] =
         "\n"
         "Copies one or more files.\n"
         "\n"
-        "COPY [-license] [-b] [-c:algorithm] [-l] [-n|-nt|-p] [-s] [-t] [-v] [-x exclude]\n"
-        "      <src>\n"
-        "COPY [-license] [-b] [-c:algorithm] [-l] [-n|-nt|-p] [-s] [-t] [-v] [-x exclude]\n"
-        "      <src> [<src> ...] <dest>\n"
+        "COPY [-license] [-b] [-bs size] [-c:algorithm] [-i|-ih] [-j n] [-l]\n"
+        "      [-n|-nt|-p] [-s] [-t] [-v] [-x exclude] <src>\n"
+        "COPY [-license] [-b] [-bs size] [-c:algorithm] [-i|-ih] [-j n] [-l]\n"
+        "      [-n|-nt|-p] [-s] [-t] [-v] [-x exclude] <src> [<src> ...] <dest>\n"
         "\n"
         "   -b             Use basic search criteria for files only\n"
+        "   -bs            Block size to use when copying devices, default 1Mb\n"
         "   -c             Compress targets with specified algorithm.  Options are:\n"
         "                    lzx, ntfs, xp4k, xp8k, xp16k\n"
+        "   -i             Incremental copy, skipping files unchanged since the last\n"
+        "                    incremental copy to the destination\n"
+        "   -ih            Incremental copy, also skipping files whose contents are\n"
+        "                    unchanged if their timestamp has changed\n"
+        "   -j             Copy up to n files concurrently\n"
         "   -l             Copy links as links rather than contents\n"
         "   -n             Copy new or files whose size have changed only\n"
         "   -nt            Copy new or files whose size or timestamps have changed only\n"
@@ -99,6 +105,401 @@ typedef struct _COPY_EXCLUDE_ITEM {
     YORI_STRING ExcludeCriteria;
 } COPY_EXCLUDE_ITEM, *PCOPY_EXCLUDE_ITEM;
 
+/**
+ The default number of bytes in each block when copying data without
+ CopyFile.
+ */
+#define COPY_DEFAULT_BLOCK_SIZE (1024 * 1024)
+
+/**
+ The number of blocks which can be read ahead of the data written when
+ copying data without CopyFile.
+ */
+#define COPY_PIPELINE_BUFFER_COUNT (4)
+
+/**
+ The smallest block size which can be requested when copying data without
+ CopyFile.
+ */
+#define COPY_MINIMUM_BLOCK_SIZE (4 * 1024)
+
+/**
+ The largest block size which can be requested when copying data without
+ CopyFile.
+ */
+#define COPY_MAXIMUM_BLOCK_SIZE (64 * 1024 * 1024)
+
+/**
+ The maximum number of threads to use when copying files concurrently.
+ */
+#define COPY_MAXIMUM_WORKERS (64)
+
+/**
+ The number of files per worker thread which can be found but not yet
+ copied before enumeration waits for earlier files to complete.
+ */
+#define COPY_MAXIMUM_QUEUED_PER_WORKER (64)
+
+/**
+ State shared between a thread reading data and a thread writing data when
+ copying data without CopyFile.  The reader fills buffers in order and the
+ writer empties them in the same order.
+ */
+typedef struct _COPY_PIPELINE {
+
+    /**
+     Handle to the source of the data.
+     */
+    HANDLE SourceHandle;
+
+    /**
+     The number of bytes in each buffer.
+     */
+    DWORD BlockSize;
+
+    /**
+     Semaphore counting the buffers which the reader can fill.
+     */
+    HANDLE EmptyBuffers;
+
+    /**
+     Semaphore counting the buffers which the writer can empty.
+     */
+    HANDLE FullBuffers;
+
+    /**
+     If the reader failed, the Win32 error describing why.
+     */
+    DWORD ReadError;
+
+    /**
+     Set to TRUE by the writer if writing failed, which indicates to the
+     reader that it should stop.
+     */
+    BOOLEAN Abort;
+
+    /**
+     The number of bytes of data in each buffer.  A buffer containing zero
+     bytes indicates the end of the data.
+     */
+    DWORD BytesInBuffer[COPY_PIPELINE_BUFFER_COUNT];
+
+    /**
+     Pointer to a single allocation containing all of the buffers.
+     */
+    PUCHAR Buffer;
+
+} COPY_PIPELINE, *PCOPY_PIPELINE;
+
+/**
+ A directory whose timestamps should be applied once all of its contents
+ have been copied, since copying the contents updates them.
+ */
+typedef struct _COPY_DEFERRED_TIMESTAMP {
+
+    /**
+     The entry for this directory on the list of deferred timestamps.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The creation time to apply.
+     */
+    FILETIME CreationTime;
+
+    /**
+     The last access time to apply.
+     */
+    FILETIME LastAccessTime;
+
+    /**
+     The last write time to apply.
+     */
+    FILETIME LastWriteTime;
+
+    /**
+     The full path to the destination directory.  This is allocated as part
+     of this structure.
+     */
+    YORI_STRING DestPath;
+
+} COPY_DEFERRED_TIMESTAMP, *PCOPY_DEFERRED_TIMESTAMP;
+
+/**
+ A single object to be copied by a worker thread.
+ */
+typedef struct _COPY_WORK_ITEM {
+
+    /**
+     The entry for this object on the queue of objects to copy.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The full path to the source.  This is allocated as part of this
+     structure.
+     */
+    YORI_STRING SourcePath;
+
+    /**
+     The path to the source relative to the source root.  This points
+     within SourcePath.
+     */
+    YORI_STRING RelativePath;
+
+    /**
+     The full path to the destination.  This is allocated as part of this
+     structure.
+     */
+    YORI_STRING DestPath;
+
+    /**
+     TRUE if FindData contains information about the source from
+     enumeration.
+     */
+    BOOLEAN HaveFindData;
+
+    /**
+     Information about the source from enumeration.
+     */
+    WIN32_FIND_DATA FindData;
+
+} COPY_WORK_ITEM, *PCOPY_WORK_ITEM;
+
+/**
+ A set of threads copying files concurrently.
+ */
+typedef struct _COPY_POOL {
+
+    /**
+     Mutex synchronizing access to the queue and counts in this structure.
+     */
+    HANDLE Mutex;
+
+    /**
+     Semaphore signalled once for each item added to the queue, and once for
+     each worker when the pool is terminating.
+     */
+    HANDLE WorkAvailable;
+
+    /**
+     Event signalled when a worker completes an item.
+     */
+    HANDLE ItemComplete;
+
+    /**
+     List of items which are waiting for a worker.
+     */
+    YORI_LIST_ENTRY Queue;
+
+    /**
+     The number of items which have been queued and not completed.
+     */
+    DWORD ItemsOutstanding;
+
+    /**
+     The number of items which can be outstanding before enumeration waits
+     for items to complete.
+     */
+    DWORD MaximumItemsOutstanding;
+
+    /**
+     Set to TRUE to indicate workers should exit once the queue is empty.
+     */
+    BOOLEAN Terminate;
+
+    /**
+     The number of threads in the Threads array.
+     */
+    DWORD WorkerCount;
+
+    /**
+     Handles to each worker thread.
+     */
+    HANDLE Threads[COPY_MAXIMUM_WORKERS];
+
+} COPY_POOL, *PCOPY_POOL;
+
+/**
+ The name of the manifest recording the state of files copied by an
+ incremental copy.  This is created in the root of the destination
+ directory.
+ */
+#define COPY_MANIFEST_FILE_NAME _T("yoricopy.manifest")
+
+/**
+ The signature at the start of a manifest file, 'YCMF'.
+ */
+#define COPY_MANIFEST_SIGNATURE (0x464D4359)
+
+/**
+ The version of the manifest file format.
+ */
+#define COPY_MANIFEST_VERSION (1)
+
+/**
+ The algorithm used to generate content hashes in the manifest.
+ */
+#define COPY_MANIFEST_HASH_ALGORITHM YoriLibDigestSha1
+
+/**
+ The number of bytes in a content hash in the manifest.
+ */
+#define COPY_MANIFEST_HASH_LENGTH (20)
+
+/**
+ A flag on a manifest record indicating that a content hash follows the
+ record.
+ */
+#define COPY_MANIFEST_RECORD_HAS_HASH (0x00000001)
+
+/**
+ The number of bytes to accumulate before writing to the manifest file.
+ */
+#define COPY_MANIFEST_WRITE_BUFFER_LENGTH (64 * 1024)
+
+/**
+ The header at the start of a manifest file.
+ */
+typedef struct _COPY_MANIFEST_HEADER {
+
+    /**
+     Must be COPY_MANIFEST_SIGNATURE.
+     */
+    DWORD Signature;
+
+    /**
+     Must be COPY_MANIFEST_VERSION.
+     */
+    DWORD Version;
+
+    /**
+     The number of records following the header.
+     */
+    DWORD EntryCount;
+
+    /**
+     Reserved for future use, currently zero.
+     */
+    DWORD Reserved;
+
+} COPY_MANIFEST_HEADER, *PCOPY_MANIFEST_HEADER;
+
+/**
+ A single record in a manifest file.  This is followed by a content hash of
+ COPY_MANIFEST_HASH_LENGTH bytes if COPY_MANIFEST_RECORD_HAS_HASH is set,
+ and then by the path relative to the destination root.  Since paths are
+ variable length, records are not aligned in the file.
+ */
+typedef struct _COPY_MANIFEST_RECORD {
+
+    /**
+     The size of the source file when it was copied.
+     */
+    DWORDLONG FileSize;
+
+    /**
+     The last write time of the source file when it was copied.
+     */
+    DWORDLONG LastWriteTime;
+
+    /**
+     The number of characters in the relative path following this record.
+     */
+    DWORD PathLengthInChars;
+
+    /**
+     Flags describing the record, including COPY_MANIFEST_RECORD_HAS_HASH.
+     */
+    DWORD Flags;
+
+} COPY_MANIFEST_RECORD, *PCOPY_MANIFEST_RECORD;
+
+/**
+ In memory information about a single file in the manifest.
+ */
+typedef struct _COPY_MANIFEST_ENTRY {
+
+    /**
+     The entry for this file on the list of all files in the manifest.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry for this file in the hash table of files, keyed by relative
+     path.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The size of the source file when it was copied.
+     */
+    DWORDLONG FileSize;
+
+    /**
+     The last write time of the source file when it was copied.
+     */
+    DWORDLONG LastWriteTime;
+
+    /**
+     TRUE if Hash contains a content hash of the source file.
+     */
+    BOOLEAN HashValid;
+
+    /**
+     TRUE if the file has been found in the source during this copy.  Files
+     which are not found are not written to the new manifest.
+     */
+    BOOLEAN Seen;
+
+    /**
+     The content hash of the source file when it was copied.
+     */
+    UCHAR Hash[COPY_MANIFEST_HASH_LENGTH];
+
+    /**
+     The path to the file relative to the destination root.  This is
+     allocated as part of this structure.
+     */
+    YORI_STRING RelativePath;
+
+} COPY_MANIFEST_ENTRY, *PCOPY_MANIFEST_ENTRY;
+
+/**
+ The manifest used by an incremental copy to determine which files have
+ not changed since the previous copy without opening them.
+ */
+typedef struct _COPY_MANIFEST {
+
+    /**
+     The full path to the manifest file.
+     */
+    YORI_STRING FileName;
+
+    /**
+     Mutex synchronizing access to the manifest from worker threads.
+     */
+    HANDLE Mutex;
+
+    /**
+     Hash table of files in the manifest, keyed by relative path.
+     */
+    PYORI_HASH_TABLE Table;
+
+    /**
+     List of all files in the manifest.
+     */
+    YORI_LIST_ENTRY EntryList;
+
+    /**
+     If TRUE, a content hash is generated for each file copied, and files
+     whose timestamp has changed but whose contents have not are not copied
+     again.
+     */
+    BOOLEAN RecordHashes;
+
+} COPY_MANIFEST, *PCOPY_MANIFEST;
+
 /**
  A context passed between each source file match when copying multiple
  files.
@@ -119,6 +520,26 @@ typedef struct _COPY_CONTEXT {
      */
     YORILIB_COMPRESS_CONTEXT CompressContext;
 
+    /**
+     Directories whose timestamps should be applied once all objects have
+     been copied.
+     */
+    YORI_LIST_ENTRY DeferredTimestampList;
+
+    /**
+     If files are being copied concurrently, pointer to the set of worker
+     threads performing the copies.  NULL if files are copied as they are
+     found.
+     */
+    PCOPY_POOL Pool;
+
+    /**
+     If performing an incremental copy, pointer to the manifest describing
+     files copied previously.  NULL if every file is compared against the
+     destination.
+     */
+    PCOPY_MANIFEST Manifest;
+
     /**
      The file system attributes of the destination.  Used to determine if
      the destination exists and is a directory.
@@ -139,6 +560,19 @@ typedef struct _COPY_CONTEXT {
      */
     DWORD FilesFoundThisArg;
 
+    /**
+     The number of files that were not copied because the manifest indicates
+     the destination already matches the source.  These are considered
+     processed when determining whether any files were found.
+     */
+    DWORD FilesUnchanged;
+
+    /**
+     The number of bytes to read or write in each operation when copying
+     data without CopyFile.
+     */
+    DWORD BlockSize;
+
     /**
      If TRUE, targets should be compressed.
      */
@@ -309,398 +743,1667 @@ CopyBuildDestinationPath(
 }
 
 /**
- Returns TRUE to indicate that an object should be excluded based on the
- exclude criteria, or FALSE if it should be included.
-
- @param CopyContext Pointer to the copy context to check the new object
-        against.
+ Apply the timestamps from the source enumeration to the target file.  This
+ can be done as a standalone operation or as part of updating files to
+ newer contents, where it is important that the timestamps of the target are
+ updated.
 
- @param RelativeSourcePath Pointer to a string describing the file relative
-        to the root of the source of the copy operation.
+ @param SourceFindData Pointer to the enumeration from the source specifying
+        file times to apply.
 
- @param SourceFindData Pointer to information about the source as returned
-        from directory enumeration.  This can be NULL if the source was not
-        found from directory enumeration.
+ @param DestFile Points to the fully qualified pathname to the target to
+        apply timestamps to.
 
- @return TRUE to exclude the file, FALSE to include it.
+ @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
-CopyShouldExclude(
-    __in PCOPY_CONTEXT CopyContext,
-    __in PYORI_STRING RelativeSourcePath,
-    __in_opt PWIN32_FIND_DATA SourceFindData
+CopyTimestamps(
+    __in PWIN32_FIND_DATA SourceFindData,
+    __in PYORI_STRING DestFile
     )
 {
-    PCOPY_EXCLUDE_ITEM ExcludeItem;
-    PYORI_LIST_ENTRY ListEntry;
+    HANDLE DestFileHandle;
 
-    ListEntry = YoriLibGetNextListEntry(&CopyContext->ExcludeList, NULL);
-    while (ListEntry != NULL) {
-        ExcludeItem = CONTAINING_RECORD(ListEntry, COPY_EXCLUDE_ITEM, ExcludeList);
-        if (YoriLibDoesFileMatchExpression(RelativeSourcePath, &ExcludeItem->ExcludeCriteria)) {
-            return TRUE;
-        }
-        ListEntry = YoriLibGetNextListEntry(&CopyContext->ExcludeList, ListEntry);
-    }
+    DestFileHandle = CreateFile(DestFile->StartOfString,
+                                FILE_WRITE_ATTRIBUTES,
+                                FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                                NULL,
+                                OPEN_EXISTING,
+                                FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
+                                NULL);
 
-    if (CopyContext->CopyNewOnly || CopyContext->PreserveExisting) {
-        YORI_STRING FullDest;
-        BY_HANDLE_FILE_INFORMATION DestFileInfo;
-        LARGE_INTEGER DestWriteTime;
-        LARGE_INTEGER SourceWriteTime;
-        HANDLE DestFileHandle;
+    if (DestFileHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
 
-        YoriLibInitEmptyString(&FullDest);
+    if (!SetFileTime(DestFileHandle, &SourceFindData->ftCreationTime, &SourceFindData->ftLastAccessTime, &SourceFindData->ftLastWriteTime)) {
+        CloseHandle(DestFileHandle);
+        return FALSE;
+    }
 
-        if (!CopyBuildDestinationPath(CopyContext, RelativeSourcePath, &FullDest)) {
-            return FALSE;
-        }
+    CloseHandle(DestFileHandle);
+    return TRUE;
+}
 
-        DestFileHandle = CreateFile(FullDest.StartOfString,
-                                    FILE_READ_ATTRIBUTES,
-                                    FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                                    NULL,
-                                    OPEN_EXISTING,
-                                    FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
-                                    NULL);
+/**
+ Generate a content hash of a file for recording in the manifest.  Since
+ the hash is recorded alongside the size and last write time that were
+ found when the file was enumerated, this fails if the file no longer has
+ that size and last write time once it has been read, indicating that the
+ hash may not describe that version of the file.
 
-        YoriLibFreeStringContents(&FullDest);
+ @param FilePath Pointer to the full path to the file.
 
-        if (DestFileHandle == INVALID_HANDLE_VALUE) {
-            return FALSE;
-        }
+ @param BlockSize The number of bytes to read in each operation.
 
-        if (CopyContext->PreserveExisting) {
-            CloseHandle(DestFileHandle);
-            return TRUE;
-        }
+ @param ExpectedFindData Pointer to information about the file when it was
+        enumerated.
 
-        if (!GetFileInformationByHandle(DestFileHandle, &DestFileInfo)) {
-            CloseHandle(DestFileHandle);
-            return FALSE;
-        }
+ @param Hash On successful completion, populated with the content hash of
+        the file.
 
-        if (SourceFindData == NULL) {
-            CloseHandle(DestFileHandle);
-            return TRUE;
-        }
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+CopyHashFile(
+    __in PYORI_STRING FilePath,
+    __in DWORD BlockSize,
+    __in PWIN32_FIND_DATA ExpectedFindData,
+    __out_ecount(COPY_MANIFEST_HASH_LENGTH) PUCHAR Hash
+    )
+{
+    YORI_LIB_DIGEST_CONTEXT Digest;
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+    HANDLE FileHandle;
+    PUCHAR Buffer;
+    DWORD BytesRead;
+    BOOL Result;
+
+    FileHandle = CreateFile(FilePath->StartOfString,
+                            GENERIC_READ,
+                            FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
 
-        if (DestFileInfo.nFileSizeHigh != SourceFindData->nFileSizeHigh ||
-            DestFileInfo.nFileSizeLow != SourceFindData->nFileSizeLow) {
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
 
-            CloseHandle(DestFileHandle);
-            return FALSE;
-        }
+    Buffer = YoriLibMalloc(BlockSize);
+    if (Buffer == NULL) {
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
 
-        if (CopyContext->CopyChangedTimestamps) {
+    YoriLibDigestInitialize(&Digest, COPY_MANIFEST_HASH_ALGORITHM);
 
-            DestWriteTime.HighPart = DestFileInfo.ftLastWriteTime.dwHighDateTime;
-            DestWriteTime.LowPart = DestFileInfo.ftLastWriteTime.dwLowDateTime;
-            SourceWriteTime.HighPart = SourceFindData->ftLastWriteTime.dwHighDateTime;
-            SourceWriteTime.LowPart = SourceFindData->ftLastWriteTime.dwLowDateTime;
+    Result = FALSE;
+    while (ReadFile(FileHandle, Buffer, BlockSize, &BytesRead, NULL)) {
+        if (BytesRead == 0) {
+            Result = TRUE;
+            break;
+        }
+        YoriLibDigestUpdate(&Digest, Buffer, BytesRead);
+    }
 
-            //
-            //  Due to file system timing granularity, if the source was written
-            //  to more than 5 seconds before or after the target, consider it
-            //  a timestamp change.
-            //
+    //
+    //  Check that the file was not modified since it was enumerated,
+    //  including while it was being copied or hashed.
+    //
 
-            if (SourceWriteTime.QuadPart < DestWriteTime.QuadPart - 10 * 1000 * 1000 * 5 ||
-                SourceWriteTime.QuadPart > DestWriteTime.QuadPart + 10 * 1000 * 1000 * 5) {
+    if (Result) {
+        if (!GetFileInformationByHandle(FileHandle, &FileInfo) ||
+            FileInfo.nFileSizeHigh != ExpectedFindData->nFileSizeHigh ||
+            FileInfo.nFileSizeLow != ExpectedFindData->nFileSizeLow ||
+            FileInfo.ftLastWriteTime.dwHighDateTime != ExpectedFindData->ftLastWriteTime.dwHighDateTime ||
+            FileInfo.ftLastWriteTime.dwLowDateTime != ExpectedFindData->ftLastWriteTime.dwLowDateTime) {
 
-                CloseHandle(DestFileHandle);
-                return FALSE;
-            }
+            Result = FALSE;
         }
+    }
 
-        CloseHandle(DestFileHandle);
-        return TRUE;
+    YoriLibFree(Buffer);
+    CloseHandle(FileHandle);
+
+    if (!Result) {
+        return FALSE;
     }
-    return FALSE;
+
+    return YoriLibDigestFinish(&Digest, Hash, COPY_MANIFEST_HASH_LENGTH);
 }
 
 /**
- Copy a single file from the source to the target by preserving its link
- contents.
+ Allocate a new entry in the manifest for a relative path.  The caller must
+ hold the manifest's mutex if worker threads may be using the manifest.
 
- @param SourceFileName A NULL terminated string specifying the source file.
+ @param Manifest Pointer to the manifest.
 
- @param DestFileName A NULL terminated string specifying the destination file.
+ @param RelativePath Pointer to the path relative to the destination root.
 
- @param IsDirectory TRUE if the object being copied is a directory, FALSE if
-        it is not.
+ @return Pointer to the new entry, or NULL on allocation failure.
+ */
+PCOPY_MANIFEST_ENTRY
+CopyManifestAllocateEntry(
+    __in PCOPY_MANIFEST Manifest,
+    __in PYORI_STRING RelativePath
+    )
+{
+    PCOPY_MANIFEST_ENTRY Entry;
+
+    Entry = YoriLibMalloc(sizeof(COPY_MANIFEST_ENTRY) + (RelativePath->LengthInChars + 1) * sizeof(TCHAR));
+    if (Entry == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Entry, sizeof(COPY_MANIFEST_ENTRY));
+    YoriLibInitEmptyString(&Entry->RelativePath);
+    Entry->RelativePath.StartOfString = (LPTSTR)(Entry + 1);
+    memcpy(Entry->RelativePath.StartOfString, RelativePath->StartOfString, RelativePath->LengthInChars * sizeof(TCHAR));
+    Entry->RelativePath.StartOfString[RelativePath->LengthInChars] = '\0';
+    Entry->RelativePath.LengthInChars = RelativePath->LengthInChars;
+    Entry->RelativePath.LengthAllocated = RelativePath->LengthInChars + 1;
+
+    YoriLibAppendList(&Manifest->EntryList, &Entry->ListEntry);
+    YoriLibHashInsertByKey(Manifest->Table, &Entry->RelativePath, Entry, &Entry->HashEntry);
+    return Entry;
+}
+
+/**
+ Load the records from an existing manifest file.  If the file does not
+ exist, the manifest is empty and every file is compared against the
+ destination as usual.
+
+ @param Manifest Pointer to the manifest, with FileName populated.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
-CopyAsLink(
-    __in LPTSTR SourceFileName,
-    __in LPTSTR DestFileName,
-    __in BOOL IsDirectory
+CopyManifestLoad(
+    __in PCOPY_MANIFEST Manifest
     )
 {
-    PVOID ReparseData;
-    HANDLE SourceFileHandle;
-    HANDLE DestFileHandle;
+    HANDLE FileHandle;
+    PUCHAR Buffer;
+    DWORD FileSizeHigh;
+    DWORD FileSize;
+    DWORD BytesRead;
+    DWORD Offset;
+    DWORD Index;
     DWORD LastError;
-    DWORD BytesReturned;
     LPTSTR ErrText;
+    COPY_MANIFEST_HEADER Header;
+    COPY_MANIFEST_RECORD Record;
+    PCOPY_MANIFEST_ENTRY Entry;
+    YORI_STRING RelativePath;
+    PUCHAR Hash;
+
+    FileHandle = CreateFile(Manifest->FileName.StartOfString,
+                            GENERIC_READ,
+                            FILE_SHARE_READ|FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
 
-    SourceFileHandle = CreateFile(SourceFileName,
-                                  GENERIC_READ,
-                                  FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                                  NULL,
-                                  OPEN_EXISTING,
-                                  FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
-                                  NULL);
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        LastError = GetLastError();
+        if (LastError == ERROR_FILE_NOT_FOUND || LastError == ERROR_PATH_NOT_FOUND) {
+            return TRUE;
+        }
+        ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("copy: open of manifest failed: %y: %s"), &Manifest->FileName, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        return FALSE;
+    }
 
-    if (SourceFileHandle == INVALID_HANDLE_VALUE) {
+    FileSize = GetFileSize(FileHandle, &FileSizeHigh);
+    if (FileSizeHigh != 0 || FileSize < sizeof(COPY_MANIFEST_HEADER)) {
+        CloseHandle(FileHandle);
+        return TRUE;
+    }
+
+    Buffer = YoriLibMalloc(FileSize);
+    if (Buffer == NULL) {
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
+
+    if (!ReadFile(FileHandle, Buffer, FileSize, &BytesRead, NULL) || BytesRead != FileSize) {
         LastError = GetLastError();
         ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of source failed: %s: %s"), SourceFileName, ErrText);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("copy: read of manifest failed: %y: %s"), &Manifest->FileName, ErrText);
         YoriLibFreeWinErrorText(ErrText);
+        YoriLibFree(Buffer);
+        CloseHandle(FileHandle);
         return FALSE;
     }
 
-    if (IsDirectory) {
-        if (!CreateDirectory(DestFileName, NULL)) {
-            LastError = GetLastError();
-            if (LastError != ERROR_ALREADY_EXISTS) {
-                ErrText = YoriLibGetWinErrorText(LastError);
-                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Create of destination failed: %s: %s"), DestFileName, ErrText);
-                YoriLibFreeWinErrorText(ErrText);
-                CloseHandle(SourceFileHandle);
-                return FALSE;
+    CloseHandle(FileHandle);
+
+    //
+    //  A manifest that is not understood is discarded, which means every
+    //  file is compared against the destination and a new manifest is
+    //  written.
+    //
+
+    memcpy(&Header, Buffer, sizeof(Header));
+    if (Header.Signature != COPY_MANIFEST_SIGNATURE ||
+        Header.Version != COPY_MANIFEST_VERSION) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("copy: manifest not recognized, ignored: %y\n"), &Manifest->FileName);
+        YoriLibFree(Buffer);
+        return TRUE;
+    }
+
+    Offset = sizeof(Header);
+    YoriLibInitEmptyString(&RelativePath);
+    for (Index = 0; Index < Header.EntryCount; Index++) {
+        if (FileSize - Offset < sizeof(Record)) {
+            break;
+        }
+        memcpy(&Record, &Buffer[Offset], sizeof(Record));
+        Offset += sizeof(Record);
+
+        Hash = NULL;
+        if (Record.Flags & COPY_MANIFEST_RECORD_HAS_HASH) {
+            if (FileSize - Offset < COPY_MANIFEST_HASH_LENGTH) {
+                break;
             }
+            Hash = &Buffer[Offset];
+            Offset += COPY_MANIFEST_HASH_LENGTH;
         }
 
-        DestFileHandle = CreateFile(DestFileName,
-                                    GENERIC_WRITE,
-                                    FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                                    NULL,
-                                    OPEN_EXISTING,
-                                    FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
-                                    NULL);
+        if (Record.PathLengthInChars == 0 ||
+            Record.PathLengthInChars > (FileSize - Offset) / sizeof(TCHAR)) {
+            break;
+        }
 
-        if (DestFileHandle == INVALID_HANDLE_VALUE) {
-            LastError = GetLastError();
-            ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of destination failed: %s: %s"), DestFileName, ErrText);
-            YoriLibFreeWinErrorText(ErrText);
-            CloseHandle(SourceFileHandle);
-            RemoveDirectory(DestFileName);
+        //
+        //  The path may not be aligned in the buffer.  It is only accessed
+        //  with memcpy to copy it into the new entry.
+        //
+
+        RelativePath.StartOfString = (LPTSTR)&Buffer[Offset];
+        RelativePath.LengthInChars = Record.PathLengthInChars;
+        Offset += Record.PathLengthInChars * sizeof(TCHAR);
+
+        Entry = CopyManifestAllocateEntry(Manifest, &RelativePath);
+        if (Entry == NULL) {
+            break;
+        }
+
+        Entry->FileSize = Record.FileSize;
+        Entry->LastWriteTime = Record.LastWriteTime;
+        if (Hash != NULL) {
+            memcpy(Entry->Hash, Hash, COPY_MANIFEST_HASH_LENGTH);
+            Entry->HashValid = TRUE;
+        }
+    }
+
+    YoriLibFree(Buffer);
+    return TRUE;
+}
+
+/**
+ Record the state of a source file in the manifest, indicating that the
+ destination contains the same data.  This can be called from worker
+ threads.
+
+ @param Manifest Pointer to the manifest.
+
+ @param RelativePath Pointer to the path relative to the destination root.
+
+ @param SourceFindData Pointer to information about the source file.
+
+ @param Hash Optionally points to a content hash of the source file.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyManifestRecord(
+    __in PCOPY_MANIFEST Manifest,
+    __in PYORI_STRING RelativePath,
+    __in PWIN32_FIND_DATA SourceFindData,
+    __in_opt PUCHAR Hash
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PCOPY_MANIFEST_ENTRY Entry;
+
+    WaitForSingleObject(Manifest->Mutex, INFINITE);
+    HashEntry = YoriLibHashLookupByKey(Manifest->Table, RelativePath);
+    if (HashEntry != NULL) {
+        Entry = (PCOPY_MANIFEST_ENTRY)HashEntry->Context;
+    } else {
+        Entry = CopyManifestAllocateEntry(Manifest, RelativePath);
+        if (Entry == NULL) {
+            ReleaseMutex(Manifest->Mutex);
             return FALSE;
         }
+    }
+
+    Entry->FileSize = (((DWORDLONG)SourceFindData->nFileSizeHigh) << 32) | SourceFindData->nFileSizeLow;
+    Entry->LastWriteTime = (((DWORDLONG)SourceFindData->ftLastWriteTime.dwHighDateTime) << 32) | SourceFindData->ftLastWriteTime.dwLowDateTime;
+    if (Hash != NULL) {
+        memcpy(Entry->Hash, Hash, COPY_MANIFEST_HASH_LENGTH);
+        Entry->HashValid = TRUE;
     } else {
-        DestFileHandle = CreateFile(DestFileName,
-                                    GENERIC_WRITE,
-                                    FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                                    NULL,
-                                    CREATE_ALWAYS,
-                                    FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
-                                    NULL);
+        Entry->HashValid = FALSE;
+    }
+    Entry->Seen = TRUE;
+    ReleaseMutex(Manifest->Mutex);
+    return TRUE;
+}
+
+/**
+ Determine whether a source file is unchanged since the manifest was
+ written, without opening the destination.  If the size matches but the
+ timestamp does not, and content hashes are being recorded, the source is
+ hashed and compared to the hash in the manifest; if the contents are
+ unchanged, the new timestamps are applied to the destination.
+
+ @param CopyContext Pointer to the copy context containing the manifest.
+
+ @param SourcePath Pointer to the full path to the source file.
+
+ @param RelativeSourcePath Pointer to the path relative to the source root,
+        which is also the path relative to the destination root.
+
+ @param SourceFindData Pointer to information about the source file.
+
+ @return TRUE if the file is unchanged and does not need to be copied,
+         FALSE if it should be copied.
+ */
+BOOL
+CopyManifestIsUnchanged(
+    __in PCOPY_CONTEXT CopyContext,
+    __in PYORI_STRING SourcePath,
+    __in PYORI_STRING RelativeSourcePath,
+    __in PWIN32_FIND_DATA SourceFindData
+    )
+{
+    PCOPY_MANIFEST Manifest = CopyContext->Manifest;
+    PYORI_HASH_ENTRY HashEntry;
+    PCOPY_MANIFEST_ENTRY Entry;
+    DWORDLONG FileSize;
+    DWORDLONG LastWriteTime;
+    UCHAR PreviousHash[COPY_MANIFEST_HASH_LENGTH];
+    UCHAR CurrentHash[COPY_MANIFEST_HASH_LENGTH];
+    YORI_STRING FullDest;
+
+    FileSize = (((DWORDLONG)SourceFindData->nFileSizeHigh) << 32) | SourceFindData->nFileSizeLow;
+    LastWriteTime = (((DWORDLONG)SourceFindData->ftLastWriteTime.dwHighDateTime) << 32) | SourceFindData->ftLastWriteTime.dwLowDateTime;
+
+    WaitForSingleObject(Manifest->Mutex, INFINITE);
+    HashEntry = YoriLibHashLookupByKey(Manifest->Table, RelativeSourcePath);
+    if (HashEntry == NULL) {
+        ReleaseMutex(Manifest->Mutex);
+        return FALSE;
+    }
+
+    Entry = (PCOPY_MANIFEST_ENTRY)HashEntry->Context;
+    if (Entry->FileSize != FileSize) {
+        ReleaseMutex(Manifest->Mutex);
+        return FALSE;
+    }
+
+    if (Entry->LastWriteTime == LastWriteTime) {
+        Entry->Seen = TRUE;
+        ReleaseMutex(Manifest->Mutex);
+        return TRUE;
+    }
+
+    if (!Entry->HashValid || !Manifest->RecordHashes) {
+        ReleaseMutex(Manifest->Mutex);
+        return FALSE;
+    }
+
+    memcpy(PreviousHash, Entry->Hash, COPY_MANIFEST_HASH_LENGTH);
+    ReleaseMutex(Manifest->Mutex);
+
+    if (!CopyHashFile(SourcePath, CopyContext->BlockSize, SourceFindData, CurrentHash)) {
+        return FALSE;
+    }
+
+    if (memcmp(PreviousHash, CurrentHash, COPY_MANIFEST_HASH_LENGTH) != 0) {
+        return FALSE;
+    }
+
+    //
+    //  The contents are the same but the timestamp has moved.  Update the
+    //  destination so it continues to mirror the source.
+    //
+
+    YoriLibInitEmptyString(&FullDest);
+    if (CopyBuildDestinationPath(CopyContext, RelativeSourcePath, &FullDest)) {
+        CopyTimestamps(SourceFindData, &FullDest);
+        YoriLibFreeStringContents(&FullDest);
+    }
+
+    CopyManifestRecord(Manifest, RelativeSourcePath, SourceFindData, CurrentHash);
+    return TRUE;
+}
+
+/**
+ Add data to the manifest file being written, writing buffered data to the
+ file when the buffer is full.
+
+ @param FileHandle Handle to the manifest file being written.
+
+ @param Buffer Pointer to a buffer of COPY_MANIFEST_WRITE_BUFFER_LENGTH bytes.
+
+ @param BufferUsed On input, the number of bytes in Buffer.  On output,
+        updated to the number of bytes in Buffer after the data is added.
+
+ @param Data Pointer to the data to add.
+
+ @param Length The number of bytes of data to add.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyManifestAppend(
+    __in HANDLE FileHandle,
+    __in PUCHAR Buffer,
+    __inout PDWORD BufferUsed,
+    __in PVOID Data,
+    __in DWORD Length
+    )
+{
+    DWORD BytesWritten;
+
+    if (*BufferUsed + Length > COPY_MANIFEST_WRITE_BUFFER_LENGTH) {
+        if (*BufferUsed > 0) {
+            if (!WriteFile(FileHandle, Buffer, *BufferUsed, &BytesWritten, NULL)) {
+                return FALSE;
+            }
+            *BufferUsed = 0;
+        }
+
+        if (Length > COPY_MANIFEST_WRITE_BUFFER_LENGTH) {
+            return WriteFile(FileHandle, Data, Length, &BytesWritten, NULL);
+        }
+    }
+
+    memcpy(&Buffer[*BufferUsed], Data, Length);
+    *BufferUsed += Length;
+    return TRUE;
+}
+
+/**
+ Write the manifest to a temporary file and replace the previous manifest
+ with it.
+
+ @param Manifest Pointer to the manifest.
+
+ @param IncludeUnseen If TRUE, files which were not found during this copy
+        are retained in the manifest.  This is used if the copy was
+        cancelled, so files which were not yet found do not need to be
+        copied again.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyManifestWrite(
+    __in PCOPY_MANIFEST Manifest,
+    __in BOOL IncludeUnseen
+    )
+{
+    YORI_STRING TempFileName;
+    COPY_MANIFEST_HEADER Header;
+    COPY_MANIFEST_RECORD Record;
+    PCOPY_MANIFEST_ENTRY Entry;
+    PYORI_LIST_ENTRY ListEntry;
+    HANDLE FileHandle;
+    PUCHAR Buffer;
+    DWORD BufferUsed;
+    DWORD BytesWritten;
+    DWORD LastError;
+    LPTSTR ErrText;
+    BOOL Result;
+
+    if (!YoriLibAllocateString(&TempFileName, Manifest->FileName.LengthInChars + sizeof(".tmp"))) {
+        return FALSE;
+    }
+    TempFileName.LengthInChars = YoriLibSPrintf(TempFileName.StartOfString, _T("%y.tmp"), &Manifest->FileName);
+
+    Buffer = YoriLibMalloc(COPY_MANIFEST_WRITE_BUFFER_LENGTH);
+    if (Buffer == NULL) {
+        YoriLibFreeStringContents(&TempFileName);
+        return FALSE;
+    }
+
+    FileHandle = CreateFile(TempFileName.StartOfString,
+                            GENERIC_WRITE,
+                            0,
+                            NULL,
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        LastError = GetLastError();
+        ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("copy: create of manifest failed: %y: %s"), &TempFileName, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        YoriLibFree(Buffer);
+        YoriLibFreeStringContents(&TempFileName);
+        return FALSE;
+    }
+
+    ZeroMemory(&Header, sizeof(Header));
+    Header.Signature = COPY_MANIFEST_SIGNATURE;
+    Header.Version = COPY_MANIFEST_VERSION;
+    ListEntry = YoriLibGetNextListEntry(&Manifest->EntryList, NULL);
+    while (ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, COPY_MANIFEST_ENTRY, ListEntry);
+        if (Entry->Seen || IncludeUnseen) {
+            Header.EntryCount++;
+        }
+        ListEntry = YoriLibGetNextListEntry(&Manifest->EntryList, ListEntry);
+    }
+
+    BufferUsed = 0;
+    Result = CopyManifestAppend(FileHandle, Buffer, &BufferUsed, &Header, sizeof(Header));
+
+    ListEntry = YoriLibGetNextListEntry(&Manifest->EntryList, NULL);
+    while (Result && ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, COPY_MANIFEST_ENTRY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&Manifest->EntryList, ListEntry);
+        if (!Entry->Seen && !IncludeUnseen) {
+            continue;
+        }
+
+        Record.FileSize = Entry->FileSize;
+        Record.LastWriteTime = Entry->LastWriteTime;
+        Record.PathLengthInChars = Entry->RelativePath.LengthInChars;
+        Record.Flags = 0;
+        if (Entry->HashValid) {
+            Record.Flags |= COPY_MANIFEST_RECORD_HAS_HASH;
+        }
+
+        Result = CopyManifestAppend(FileHandle, Buffer, &BufferUsed, &Record, sizeof(Record));
+        if (Result && Entry->HashValid) {
+            Result = CopyManifestAppend(FileHandle, Buffer, &BufferUsed, Entry->Hash, COPY_MANIFEST_HASH_LENGTH);
+        }
+        if (Result) {
+            Result = CopyManifestAppend(FileHandle, Buffer, &BufferUsed, Entry->RelativePath.StartOfString, Entry->RelativePath.LengthInChars * sizeof(TCHAR));
+        }
+    }
+
+    if (Result && BufferUsed > 0) {
+        Result = WriteFile(FileHandle, Buffer, BufferUsed, &BytesWritten, NULL);
+    }
+
+    LastError = GetLastError();
+    CloseHandle(FileHandle);
+    YoriLibFree(Buffer);
+
+    if (Result) {
+        if (!MoveFileEx(TempFileName.StartOfString, Manifest->FileName.StartOfString, MOVEFILE_REPLACE_EXISTING)) {
+            LastError = GetLastError();
+            Result = FALSE;
+        }
+    }
+
+    if (!Result) {
+        ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("copy: write of manifest failed: %y: %s"), &Manifest->FileName, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        DeleteFile(TempFileName.StartOfString);
+    }
+
+    YoriLibFreeStringContents(&TempFileName);
+    return Result;
+}
+
+/**
+ Free a manifest and all of its entries.
+
+ @param CopyContext Pointer to the copy context containing the manifest.
+ */
+VOID
+CopyManifestFree(
+    __in PCOPY_CONTEXT CopyContext
+    )
+{
+    PCOPY_MANIFEST Manifest = CopyContext->Manifest;
+    PCOPY_MANIFEST_ENTRY Entry;
+    PYORI_LIST_ENTRY ListEntry;
+
+    if (Manifest == NULL) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&Manifest->EntryList, NULL);
+    while (ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, COPY_MANIFEST_ENTRY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&Manifest->EntryList, ListEntry);
+        YoriLibHashRemoveByEntry(&Entry->HashEntry);
+        YoriLibRemoveListItem(&Entry->ListEntry);
+        YoriLibFree(Entry);
+    }
+
+    if (Manifest->Table != NULL) {
+        YoriLibFreeEmptyHashTable(Manifest->Table);
+    }
+    if (Manifest->Mutex != NULL) {
+        CloseHandle(Manifest->Mutex);
+    }
+    YoriLibFreeStringContents(&Manifest->FileName);
+    YoriLibFree(Manifest);
+    CopyContext->Manifest = NULL;
+}
+
+/**
+ Create a manifest for an incremental copy and load any manifest written by
+ a previous copy to the same destination.  The destination must be a
+ directory.
+
+ @param CopyContext Pointer to the copy context, with the destination
+        populated.
+
+ @param RecordHashes If TRUE, content hashes are generated for files as they
+        are copied.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyManifestInitialize(
+    __in PCOPY_CONTEXT CopyContext,
+    __in BOOL RecordHashes
+    )
+{
+    PCOPY_MANIFEST Manifest;
+    YORI_STRING ManifestName;
+
+    Manifest = YoriLibMalloc(sizeof(COPY_MANIFEST));
+    if (Manifest == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Manifest, sizeof(COPY_MANIFEST));
+    YoriLibInitializeListHead(&Manifest->EntryList);
+    Manifest->RecordHashes = (BOOLEAN)RecordHashes;
+    CopyContext->Manifest = Manifest;
+
+    YoriLibConstantString(&ManifestName, COPY_MANIFEST_FILE_NAME);
+    if (!CopyBuildDestinationPath(CopyContext, &ManifestName, &Manifest->FileName)) {
+        CopyManifestFree(CopyContext);
+        return FALSE;
+    }
+
+    Manifest->Mutex = CreateMutex(NULL, FALSE, NULL);
+    Manifest->Table = YoriLibAllocateHashTable(1024);
+    if (Manifest->Mutex == NULL || Manifest->Table == NULL) {
+        CopyManifestFree(CopyContext);
+        return FALSE;
+    }
+
+    if (!CopyManifestLoad(Manifest)) {
+        CopyManifestFree(CopyContext);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Returns TRUE to indicate that an object should be excluded based on the
+ exclude criteria, or FALSE if it should be included.
+
+ @param CopyContext Pointer to the copy context to check the new object
+        against.
+
+ @param SourcePath Pointer to the full path to the source.
+
+ @param RelativeSourcePath Pointer to a string describing the file relative
+        to the root of the source of the copy operation.
+
+ @param SourceFindData Pointer to information about the source as returned
+        from directory enumeration.  This can be NULL if the source was not
+        found from directory enumeration.
+
+ @return TRUE to exclude the file, FALSE to include it.
+ */
+BOOL
+CopyShouldExclude(
+    __in PCOPY_CONTEXT CopyContext,
+    __in PYORI_STRING SourcePath,
+    __in PYORI_STRING RelativeSourcePath,
+    __in_opt PWIN32_FIND_DATA SourceFindData
+    )
+{
+    PCOPY_EXCLUDE_ITEM ExcludeItem;
+    PYORI_LIST_ENTRY ListEntry;
+
+    ListEntry = YoriLibGetNextListEntry(&CopyContext->ExcludeList, NULL);
+    while (ListEntry != NULL) {
+        ExcludeItem = CONTAINING_RECORD(ListEntry, COPY_EXCLUDE_ITEM, ExcludeList);
+        if (YoriLibDoesFileMatchExpression(RelativeSourcePath, &ExcludeItem->ExcludeCriteria)) {
+            return TRUE;
+        }
+        ListEntry = YoriLibGetNextListEntry(&CopyContext->ExcludeList, ListEntry);
+    }
+
+    //
+    //  For an incremental copy, check if the file is known to be unchanged
+    //  before looking at the destination.
+    //
+
+    if (CopyContext->Manifest != NULL &&
+        SourceFindData != NULL &&
+        (SourceFindData->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+
+        if (CopyManifestIsUnchanged(CopyContext, SourcePath, RelativeSourcePath, SourceFindData)) {
+            CopyContext->FilesUnchanged++;
+            return TRUE;
+        }
+    }
+
+    if (CopyContext->CopyNewOnly || CopyContext->PreserveExisting) {
+        YORI_STRING FullDest;
+        BY_HANDLE_FILE_INFORMATION DestFileInfo;
+        LARGE_INTEGER DestWriteTime;
+        LARGE_INTEGER SourceWriteTime;
+        HANDLE DestFileHandle;
+
+        YoriLibInitEmptyString(&FullDest);
+
+        if (!CopyBuildDestinationPath(CopyContext, RelativeSourcePath, &FullDest)) {
+            return FALSE;
+        }
+
+        DestFileHandle = CreateFile(FullDest.StartOfString,
+                                    FILE_READ_ATTRIBUTES,
+                                    FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                                    NULL,
+                                    OPEN_EXISTING,
+                                    FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
+                                    NULL);
+
+        YoriLibFreeStringContents(&FullDest);
+
+        if (DestFileHandle == INVALID_HANDLE_VALUE) {
+            return FALSE;
+        }
+
+        //
+        //  The existing destination is preserved without checking whether
+        //  it matches the source, so it is not recorded in the manifest.
+        //
+
+        if (CopyContext->PreserveExisting) {
+            CloseHandle(DestFileHandle);
+            return TRUE;
+        }
+
+        if (!GetFileInformationByHandle(DestFileHandle, &DestFileInfo)) {
+            CloseHandle(DestFileHandle);
+            return FALSE;
+        }
+
+        if (SourceFindData == NULL) {
+            CloseHandle(DestFileHandle);
+            return TRUE;
+        }
+
+        if (DestFileInfo.nFileSizeHigh != SourceFindData->nFileSizeHigh ||
+            DestFileInfo.nFileSizeLow != SourceFindData->nFileSizeLow) {
+
+            CloseHandle(DestFileHandle);
+            return FALSE;
+        }
+
+        if (CopyContext->CopyChangedTimestamps) {
+
+            DestWriteTime.HighPart = DestFileInfo.ftLastWriteTime.dwHighDateTime;
+            DestWriteTime.LowPart = DestFileInfo.ftLastWriteTime.dwLowDateTime;
+            SourceWriteTime.HighPart = SourceFindData->ftLastWriteTime.dwHighDateTime;
+            SourceWriteTime.LowPart = SourceFindData->ftLastWriteTime.dwLowDateTime;
+
+            //
+            //  Due to file system timing granularity, if the source was written
+            //  to more than 5 seconds before or after the target, consider it
+            //  a timestamp change.
+            //
+
+            if (SourceWriteTime.QuadPart < DestWriteTime.QuadPart - 10 * 1000 * 1000 * 5 ||
+                SourceWriteTime.QuadPart > DestWriteTime.QuadPart + 10 * 1000 * 1000 * 5) {
+
+                CloseHandle(DestFileHandle);
+                return FALSE;
+            }
+        }
+
+        CloseHandle(DestFileHandle);
+        if (CopyContext->Manifest != NULL) {
+            CopyManifestRecord(CopyContext->Manifest, RelativeSourcePath, SourceFindData, NULL);
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ Copy a single file from the source to the target by preserving its link
+ contents.
+
+ @param SourceFileName A NULL terminated string specifying the source file.
+
+ @param DestFileName A NULL terminated string specifying the destination file.
+
+ @param IsDirectory TRUE if the object being copied is a directory, FALSE if
+        it is not.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyAsLink(
+    __in LPTSTR SourceFileName,
+    __in LPTSTR DestFileName,
+    __in BOOL IsDirectory
+    )
+{
+    PVOID ReparseData;
+    HANDLE SourceFileHandle;
+    HANDLE DestFileHandle;
+    DWORD LastError;
+    DWORD BytesReturned;
+    LPTSTR ErrText;
+
+    SourceFileHandle = CreateFile(SourceFileName,
+                                  GENERIC_READ,
+                                  FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                                  NULL,
+                                  OPEN_EXISTING,
+                                  FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
+                                  NULL);
+
+    if (SourceFileHandle == INVALID_HANDLE_VALUE) {
+        LastError = GetLastError();
+        ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of source failed: %s: %s"), SourceFileName, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        return FALSE;
+    }
+
+    if (IsDirectory) {
+        if (!CreateDirectory(DestFileName, NULL)) {
+            LastError = GetLastError();
+            if (LastError != ERROR_ALREADY_EXISTS) {
+                ErrText = YoriLibGetWinErrorText(LastError);
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Create of destination failed: %s: %s"), DestFileName, ErrText);
+                YoriLibFreeWinErrorText(ErrText);
+                CloseHandle(SourceFileHandle);
+                return FALSE;
+            }
+        }
+
+        DestFileHandle = CreateFile(DestFileName,
+                                    GENERIC_WRITE,
+                                    FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                                    NULL,
+                                    OPEN_EXISTING,
+                                    FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
+                                    NULL);
+
+        if (DestFileHandle == INVALID_HANDLE_VALUE) {
+            LastError = GetLastError();
+            ErrText = YoriLibGetWinErrorText(LastError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of destination failed: %s: %s"), DestFileName, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+            CloseHandle(SourceFileHandle);
+            RemoveDirectory(DestFileName);
+            return FALSE;
+        }
+    } else {
+        DestFileHandle = CreateFile(DestFileName,
+                                    GENERIC_WRITE,
+                                    FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                                    NULL,
+                                    CREATE_ALWAYS,
+                                    FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
+                                    NULL);
+
+        if (DestFileHandle == INVALID_HANDLE_VALUE) {
+            LastError = GetLastError();
+            ErrText = YoriLibGetWinErrorText(LastError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of destination failed: %s: %s"), DestFileName, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+            CloseHandle(SourceFileHandle);
+            return FALSE;
+        }
+    }
+
+    ReparseData = YoriLibMalloc(64 * 1024);
+    if (ReparseData == NULL) {
+        CloseHandle(DestFileHandle);
+        CloseHandle(SourceFileHandle);
+        if (IsDirectory) {
+            RemoveDirectory(DestFileName);
+        } else {
+            DeleteFile(DestFileName);
+        }
+        return FALSE;
+    }
+
+    if (!DeviceIoControl(SourceFileHandle, FSCTL_GET_REPARSE_POINT, NULL, 0, ReparseData, 64 * 1024, &BytesReturned, NULL)) {
+        LastError = GetLastError();
+        ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Querying reparse data of source failed: %s: %s"), SourceFileName, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        CloseHandle(SourceFileHandle);
+        CloseHandle(DestFileHandle);
+        YoriLibFree(ReparseData);
+        if (IsDirectory) {
+            RemoveDirectory(DestFileName);
+        } else {
+            DeleteFile(DestFileName);
+        }
+        return FALSE;
+    }
+
+    if (!DeviceIoControl(DestFileHandle, FSCTL_SET_REPARSE_POINT, ReparseData, BytesReturned, NULL, 0, &BytesReturned, NULL)) {
+        LastError = GetLastError();
+        ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Setting reparse data on dest failed: %s: %s"), DestFileName, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        CloseHandle(SourceFileHandle);
+        CloseHandle(DestFileHandle);
+        YoriLibFree(ReparseData);
+        if (IsDirectory) {
+            RemoveDirectory(DestFileName);
+        } else {
+            DeleteFile(DestFileName);
+        }
+        return FALSE;
+    }
+
+    CloseHandle(SourceFileHandle);
+    CloseHandle(DestFileHandle);
+    YoriLibFree(ReparseData);
+    return TRUE;
+}
+
+/**
+ A thread which reads data from the source of a pipelined copy into each
+ buffer in turn, waiting for the writer to empty buffers as needed.
+
+ @param Context Pointer to the COPY_PIPELINE describing the copy.
+
+ @return Thread exit code, currently zero.
+ */
+DWORD WINAPI
+CopyPipelineReader(
+    __in LPVOID Context
+    )
+{
+    PCOPY_PIPELINE Pipeline = (PCOPY_PIPELINE)Context;
+    DWORD Index;
+    DWORD BytesRead;
+
+    Index = 0;
+    while (TRUE) {
+        WaitForSingleObject(Pipeline->EmptyBuffers, INFINITE);
+        if (Pipeline->Abort) {
+            break;
+        }
+
+        //
+        //  A failure to read is treated as the end of the data, which is
+        //  what happens when a pipe is closed by the writer.
+        //
+
+        if (!ReadFile(Pipeline->SourceHandle, &Pipeline->Buffer[Index * Pipeline->BlockSize], Pipeline->BlockSize, &BytesRead, NULL)) {
+            BytesRead = 0;
+        }
+
+        Pipeline->BytesInBuffer[Index] = BytesRead;
+        ReleaseSemaphore(Pipeline->FullBuffers, 1, NULL);
+        if (BytesRead == 0) {
+            break;
+        }
+
+        Index = (Index + 1) % COPY_PIPELINE_BUFFER_COUNT;
+    }
+
+    return 0;
+}
+
+/**
+ For objects that are not really files, copy can't use CopyFile, and instead
+ falls back to this stupid thing of reading and writing.  Note this path
+ should not be used for files since it makes no attempt to preserve any kind
+ of file metadata, but for devices file metadata is meaningless anyway.
+
+ Reads are performed on a separate thread so that the next blocks can be
+ read while earlier blocks are being written.  If that thread cannot be
+ created, the data is copied synchronously.
+
+ @param SourceFile Pointer to the source file/device name.
+
+ @param DestFile Pointer to the destination file/device name.
+
+ @param BlockSize The number of bytes to read or write in each operation.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyAsDumbDataMove(
+    __in PYORI_STRING SourceFile,
+    __in PYORI_STRING DestFile,
+    __in DWORD BlockSize
+    )
+{
+    COPY_PIPELINE Pipeline;
+    HANDLE ReaderThread;
+    HANDLE DestHandle;
+    DWORD BytesCopied;
+    DWORD BytesWritten;
+    DWORD Index;
+    DWORD ThreadId;
+    DWORD LastError;
+    LPTSTR ErrText;
+    BOOL Result;
+
+    ZeroMemory(&Pipeline, sizeof(Pipeline));
+    Pipeline.BlockSize = BlockSize;
+
+    Pipeline.SourceHandle = CreateFile(SourceFile->StartOfString,
+                                       GENERIC_READ,
+                                       FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                                       NULL,
+                                       OPEN_EXISTING,
+                                       FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_SEQUENTIAL_SCAN,
+                                       NULL);
+
+    if (Pipeline.SourceHandle == INVALID_HANDLE_VALUE) {
+        LastError = GetLastError();
+        ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of source failed: %y: %s"), SourceFile, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        return FALSE;
+    }
+
+    DestHandle = CreateFile(DestFile->StartOfString,
+                            GENERIC_WRITE,
+                            FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                            NULL,
+                            CREATE_ALWAYS,
+                            FILE_FLAG_BACKUP_SEMANTICS,
+                            NULL);
+
+    LastError = GetLastError();
+
+    if (LastError == ERROR_INVALID_PARAMETER) {
+        DestHandle = CreateFile(DestFile->StartOfString,
+                                GENERIC_WRITE,
+                                FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                                NULL,
+                                OPEN_EXISTING,
+                                FILE_FLAG_BACKUP_SEMANTICS,
+                                NULL);
+    }
+
+    if (DestHandle == INVALID_HANDLE_VALUE) {
+        ErrText = YoriLibGetWinErrorText(LastError);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of destination failed: %y: %s"), DestFile, ErrText);
+        YoriLibFreeWinErrorText(ErrText);
+        CloseHandle(Pipeline.SourceHandle);
+        return FALSE;
+    }
+
+    Pipeline.Buffer = YoriLibMalloc(BlockSize * COPY_PIPELINE_BUFFER_COUNT);
+    if (Pipeline.Buffer == NULL) {
+        CloseHandle(Pipeline.SourceHandle);
+        CloseHandle(DestHandle);
+        return FALSE;
+    }
+
+    Result = TRUE;
+    ReaderThread = NULL;
+    Pipeline.EmptyBuffers = CreateSemaphore(NULL, COPY_PIPELINE_BUFFER_COUNT, 0x7FFFFFFF, NULL);
+    Pipeline.FullBuffers = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+    if (Pipeline.EmptyBuffers != NULL && Pipeline.FullBuffers != NULL) {
+        ReaderThread = CreateThread(NULL, 0, CopyPipelineReader, &Pipeline, 0, &ThreadId);
+    }
+
+    if (ReaderThread != NULL) {
+
+        //
+        //  Write each buffer in the order the reader filled them.  If a
+        //  write fails, indicate to the reader that it should stop and
+        //  give it a buffer so it can observe that request.
+        //
+
+        Index = 0;
+        while (TRUE) {
+            WaitForSingleObject(Pipeline.FullBuffers, INFINITE);
+            BytesCopied = Pipeline.BytesInBuffer[Index];
+            if (BytesCopied == 0) {
+                break;
+            }
+
+            if (!WriteFile(DestHandle, &Pipeline.Buffer[Index * BlockSize], BytesCopied, &BytesWritten, NULL)) {
+                LastError = GetLastError();
+                ErrText = YoriLibGetWinErrorText(LastError);
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Write to destination failed: %y: %s"), DestFile, ErrText);
+                YoriLibFreeWinErrorText(ErrText);
+                Pipeline.Abort = TRUE;
+                ReleaseSemaphore(Pipeline.EmptyBuffers, 1, NULL);
+                Result = FALSE;
+                break;
+            }
+
+            ReleaseSemaphore(Pipeline.EmptyBuffers, 1, NULL);
+            Index = (Index + 1) % COPY_PIPELINE_BUFFER_COUNT;
+        }
+
+        WaitForSingleObject(ReaderThread, INFINITE);
+        CloseHandle(ReaderThread);
+    } else {
+        while (ReadFile(Pipeline.SourceHandle, Pipeline.Buffer, BlockSize, &BytesCopied, NULL)) {
+            if (BytesCopied == 0) {
+                break;
+            }
+
+            if (!WriteFile(DestHandle, Pipeline.Buffer, BytesCopied, &BytesWritten, NULL)) {
+                LastError = GetLastError();
+                ErrText = YoriLibGetWinErrorText(LastError);
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Write to destination failed: %y: %s"), DestFile, ErrText);
+                YoriLibFreeWinErrorText(ErrText);
+                Result = FALSE;
+                break;
+            }
+        }
+    }
+
+    if (Pipeline.EmptyBuffers != NULL) {
+        CloseHandle(Pipeline.EmptyBuffers);
+    }
+    if (Pipeline.FullBuffers != NULL) {
+        CloseHandle(Pipeline.FullBuffers);
+    }
+    YoriLibFree(Pipeline.Buffer);
+    CloseHandle(Pipeline.SourceHandle);
+    CloseHandle(DestHandle);
+    return Result;
+}
+
+/**
+ Returns TRUE if an object found from enumeration should be copied by
+ duplicating its link rather than its contents.
+
+ @param CopyContext Pointer to the copy context indicating whether links
+        should be copied as links.
+
+ @param FileInfo Information about the source object.  This can be NULL if
+        the object was not found from enumeration.
+
+ @return TRUE to copy the object as a link, FALSE to copy its contents.
+ */
+BOOL
+CopyShouldCopyAsLink(
+    __in PCOPY_CONTEXT CopyContext,
+    __in_opt PWIN32_FIND_DATA FileInfo
+    )
+{
+    if (FileInfo != NULL &&
+        FileInfo->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT &&
+        CopyContext->CopyAsLinks &&
+        (FileInfo->dwReserved0 == IO_REPARSE_TAG_MOUNT_POINT || FileInfo->dwReserved0 == IO_REPARSE_TAG_SYMLINK)) {
+
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ Record the timestamps to apply to a destination directory once all of the
+ objects within it have been copied.  Creating objects within a directory
+ updates its timestamps, so these cannot be applied when the directory is
+ created.
+
+ @param CopyContext Pointer to the copy context to record the timestamps in.
+
+ @param SourceFindData Pointer to the enumeration from the source specifying
+        file times to apply.
+
+ @param DestFile Points to the fully qualified pathname to the target to
+        apply timestamps to.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyDeferTimestamps(
+    __in PCOPY_CONTEXT CopyContext,
+    __in PWIN32_FIND_DATA SourceFindData,
+    __in PYORI_STRING DestFile
+    )
+{
+    PCOPY_DEFERRED_TIMESTAMP Deferred;
+
+    Deferred = YoriLibMalloc(sizeof(COPY_DEFERRED_TIMESTAMP) + (DestFile->LengthInChars + 1) * sizeof(TCHAR));
+    if (Deferred == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Deferred, sizeof(COPY_DEFERRED_TIMESTAMP));
+    Deferred->CreationTime = SourceFindData->ftCreationTime;
+    Deferred->LastAccessTime = SourceFindData->ftLastAccessTime;
+    Deferred->LastWriteTime = SourceFindData->ftLastWriteTime;
+
+    YoriLibInitEmptyString(&Deferred->DestPath);
+    Deferred->DestPath.StartOfString = (LPTSTR)(Deferred + 1);
+    memcpy(Deferred->DestPath.StartOfString, DestFile->StartOfString, DestFile->LengthInChars * sizeof(TCHAR));
+    Deferred->DestPath.StartOfString[DestFile->LengthInChars] = '\0';
+    Deferred->DestPath.LengthInChars = DestFile->LengthInChars;
+    Deferred->DestPath.LengthAllocated = DestFile->LengthInChars + 1;
+
+    YoriLibAppendList(&CopyContext->DeferredTimestampList, &Deferred->ListEntry);
+    return TRUE;
+}
+
+/**
+ Apply and free all timestamps recorded by CopyDeferTimestamps.  This must
+ only be called once all objects have been copied.
+
+ @param CopyContext Pointer to the copy context containing the recorded
+        timestamps.
+
+ @param Apply TRUE if the timestamps should be applied to the destination,
+        FALSE if they should only be freed.
+ */
+VOID
+CopyApplyDeferredTimestamps(
+    __in PCOPY_CONTEXT CopyContext,
+    __in BOOL Apply
+    )
+{
+    PCOPY_DEFERRED_TIMESTAMP Deferred;
+    PYORI_LIST_ENTRY ListEntry;
+    WIN32_FIND_DATA FindData;
+
+    ZeroMemory(&FindData, sizeof(FindData));
+    ListEntry = YoriLibGetNextListEntry(&CopyContext->DeferredTimestampList, NULL);
+    while (ListEntry != NULL) {
+        Deferred = CONTAINING_RECORD(ListEntry, COPY_DEFERRED_TIMESTAMP, ListEntry);
+        YoriLibRemoveListItem(&Deferred->ListEntry);
+        if (Apply) {
+            FindData.ftCreationTime = Deferred->CreationTime;
+            FindData.ftLastAccessTime = Deferred->LastAccessTime;
+            FindData.ftLastWriteTime = Deferred->LastWriteTime;
+            CopyTimestamps(&FindData, &Deferred->DestPath);
+        }
+        YoriLibFree(Deferred);
+        ListEntry = YoriLibGetNextListEntry(&CopyContext->DeferredTimestampList, NULL);
+    }
+}
+
+/**
+ Copy a single object which is not a directory to its destination, and
+ apply timestamps if requested.  This can be called on worker threads, so
+ it must not update state in the copy context.
+
+ @param CopyContext Pointer to the copy context indicating parameters to the
+        copy operation.
+
+ @param FilePath Pointer to the full path to the source.
+
+ @param RelativePath Pointer to the path to the source relative to the
+        source root.
+
+ @param FullDest Pointer to the full path to the destination.
+
+ @param FileInfo Information about the source.  This can be NULL if the
+        source was not found from enumeration.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+CopyObject(
+    __in PCOPY_CONTEXT CopyContext,
+    __in PYORI_STRING FilePath,
+    __in PYORI_STRING RelativePath,
+    __in PYORI_STRING FullDest,
+    __in_opt PWIN32_FIND_DATA FileInfo
+    )
+{
+    YORI_STRING HumanSourcePath;
+    YORI_STRING HumanDestPath;
+    PYORI_STRING SourceNameToDisplay;
+    PYORI_STRING DestNameToDisplay;
+    UCHAR Hash[COPY_MANIFEST_HASH_LENGTH];
+    PUCHAR HashToRecord;
+    BOOL Result;
+
+    Result = TRUE;
+
+    if (!CopyContext->SkipDataCopy) {
+        if (CopyShouldCopyAsLink(CopyContext, FileInfo)) {
+
+            Result = CopyAsLink(FilePath->StartOfString, FullDest->StartOfString, (FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY));
+
+        } else if (CopyContext->DestinationIsDevice || YoriLibIsFileNameDeviceName(FilePath)) {
+            Result = CopyAsDumbDataMove(FilePath, FullDest, CopyContext->BlockSize);
+        } else {
+            if (!CopyFile(FilePath->StartOfString, FullDest->StartOfString, FALSE)) {
+                DWORD LastError = GetLastError();
+
+                //
+                //  If it failed with an error indicating CopyFile couldn't
+                //  handle it, fall back to dumb data copy.  Note that this
+                //  function will output its own errors, so from this point,
+                //  error handling is over.
+                //
+
+                if (LastError == ERROR_INVALID_PARAMETER) {
+                    Result = CopyAsDumbDataMove(FilePath, FullDest, CopyContext->BlockSize);
+                } else {
+                    LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+                    YoriLibInitEmptyString(&HumanSourcePath);
+                    YoriLibInitEmptyString(&HumanDestPath);
+                    SourceNameToDisplay = FilePath;
+                    DestNameToDisplay = FullDest;
+                    if (YoriLibUnescapePath(FilePath, &HumanSourcePath)) {
+                        SourceNameToDisplay = &HumanSourcePath;
+                    }
+                    if (YoriLibUnescapePath(FullDest, &HumanDestPath)) {
+                        DestNameToDisplay = &HumanDestPath;
+                    }
+                    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("CopyFile failed: %y to %y: %s"), SourceNameToDisplay, DestNameToDisplay, ErrText);
+                    YoriLibFreeWinErrorText(ErrText);
+                    YoriLibFreeStringContents(&HumanSourcePath);
+                    YoriLibFreeStringContents(&HumanDestPath);
+                    Result = FALSE;
+                }
+            }
+
+            if (CopyContext->CompressDest) {
 
-        if (DestFileHandle == INVALID_HANDLE_VALUE) {
-            LastError = GetLastError();
-            ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of destination failed: %s: %s"), DestFileName, ErrText);
-            YoriLibFreeWinErrorText(ErrText);
-            CloseHandle(SourceFileHandle);
-            return FALSE;
+                YoriLibCompressFileInBackground(&CopyContext->CompressContext, FullDest);
+            }
         }
     }
 
-    ReparseData = YoriLibMalloc(64 * 1024);
-    if (ReparseData == NULL) {
-        CloseHandle(DestFileHandle);
-        CloseHandle(SourceFileHandle);
-        if (IsDirectory) {
-            RemoveDirectory(DestFileName);
-        } else {
-            DeleteFile(DestFileName);
-        }
-        return FALSE;
+    if (CopyContext->CopyTimestamps && FileInfo != NULL) {
+        CopyTimestamps(FileInfo, FullDest);
     }
 
-    if (!DeviceIoControl(SourceFileHandle, FSCTL_GET_REPARSE_POINT, NULL, 0, ReparseData, 64 * 1024, &BytesReturned, NULL)) {
-        LastError = GetLastError();
-        ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Querying reparse data of source failed: %s: %s"), SourceFileName, ErrText);
-        YoriLibFreeWinErrorText(ErrText);
-        CloseHandle(SourceFileHandle);
-        CloseHandle(DestFileHandle);
-        YoriLibFree(ReparseData);
-        if (IsDirectory) {
-            RemoveDirectory(DestFileName);
-        } else {
-            DeleteFile(DestFileName);
+    //
+    //  If the data was copied, record the state of the source in the
+    //  manifest so it will not be copied again unless it changes.  The
+    //  source was just read so hashing it is expected to be satisfied
+    //  from cache.  If the source changed since it was enumerated, the
+    //  hash may not describe the data that was copied, so no hash is
+    //  recorded, and the recorded size and timestamp will not match the
+    //  source when it is next enumerated.
+    //
+
+    if (CopyContext->Manifest != NULL &&
+        Result &&
+        FileInfo != NULL &&
+        !CopyContext->SkipDataCopy) {
+
+        HashToRecord = NULL;
+        if (CopyContext->Manifest->RecordHashes &&
+            !CopyShouldCopyAsLink(CopyContext, FileInfo) &&
+            CopyHashFile(FilePath, CopyContext->BlockSize, FileInfo, Hash)) {
+
+            HashToRecord = Hash;
         }
-        return FALSE;
+        CopyManifestRecord(CopyContext->Manifest, RelativePath, FileInfo, HashToRecord);
     }
 
-    if (!DeviceIoControl(DestFileHandle, FSCTL_SET_REPARSE_POINT, ReparseData, BytesReturned, NULL, 0, &BytesReturned, NULL)) {
-        LastError = GetLastError();
-        ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Setting reparse data on dest failed: %s: %s"), DestFileName, ErrText);
-        YoriLibFreeWinErrorText(ErrText);
-        CloseHandle(SourceFileHandle);
-        CloseHandle(DestFileHandle);
-        YoriLibFree(ReparseData);
-        if (IsDirectory) {
-            RemoveDirectory(DestFileName);
-        } else {
-            DeleteFile(DestFileName);
+    return Result;
+}
+
+/**
+ A worker thread which copies objects from the pool's queue until the pool
+ is terminated.
+
+ @param Context Pointer to the copy context.
+
+ @return Thread exit code, currently zero.
+ */
+DWORD WINAPI
+CopyWorker(
+    __in LPVOID Context
+    )
+{
+    PCOPY_CONTEXT CopyContext = (PCOPY_CONTEXT)Context;
+    PCOPY_POOL Pool = CopyContext->Pool;
+    PYORI_LIST_ENTRY ListEntry;
+    PCOPY_WORK_ITEM Item;
+
+    while (TRUE) {
+        WaitForSingleObject(Pool->WorkAvailable, INFINITE);
+
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        ListEntry = YoriLibGetNextListEntry(&Pool->Queue, NULL);
+        if (ListEntry == NULL) {
+            ASSERT(Pool->Terminate);
+            ReleaseMutex(Pool->Mutex);
+            break;
         }
-        return FALSE;
+        YoriLibRemoveListItem(ListEntry);
+        ReleaseMutex(Pool->Mutex);
+
+        Item = CONTAINING_RECORD(ListEntry, COPY_WORK_ITEM, ListEntry);
+        CopyObject(CopyContext, &Item->SourcePath, &Item->RelativePath, &Item->DestPath, Item->HaveFindData ? &Item->FindData : NULL);
+        YoriLibFree(Item);
+
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        Pool->ItemsOutstanding--;
+        ReleaseMutex(Pool->Mutex);
+        SetEvent(Pool->ItemComplete);
     }
 
-    CloseHandle(SourceFileHandle);
-    CloseHandle(DestFileHandle);
-    YoriLibFree(ReparseData);
-    return TRUE;
+    return 0;
 }
 
 /**
- For objects that are not really files, copy can't use CopyFile, and instead
- falls back to this stupid thing of reading and writing.  Note this path
- should not be used for files since it makes no attempt to preserve any kind
- of file metadata, but for devices file metadata is meaningless anyway.
+ Wait until the number of objects which have been queued but not copied is
+ no more than a specified limit.
 
- @param SourceFile Pointer to the source file/device name.
+ @param CopyContext Pointer to the copy context containing the pool.
 
- @param DestFile Pointer to the destination file/device name.
+ @param MaximumItemsOutstanding The number of objects which can remain
+        uncopied.  Specify zero to wait for all objects to be copied.
+ */
+VOID
+CopyWaitForPool(
+    __in PCOPY_CONTEXT CopyContext,
+    __in DWORD MaximumItemsOutstanding
+    )
+{
+    PCOPY_POOL Pool = CopyContext->Pool;
+
+    while (TRUE) {
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        if (Pool->ItemsOutstanding <= MaximumItemsOutstanding) {
+            ReleaseMutex(Pool->Mutex);
+            break;
+        }
+        ReleaseMutex(Pool->Mutex);
+
+        WaitForSingleObject(Pool->ItemComplete, INFINITE);
+    }
+}
+
+/**
+ Add an object to the queue of objects to be copied by worker threads.  If
+ too many objects are outstanding, this waits for earlier objects to be
+ copied.
+
+ @param CopyContext Pointer to the copy context containing the pool.
+
+ @param FilePath Pointer to the full path to the source.
+
+ @param RelativePath Pointer to the path to the source relative to the
+        source root.  This must point within FilePath.
+
+ @param FullDest Pointer to the full path to the destination.
+
+ @param FileInfo Information about the source.  This can be NULL if the
+        source was not found from enumeration.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
-CopyAsDumbDataMove(
-    __in PYORI_STRING SourceFile,
-    __in PYORI_STRING DestFile
+CopyQueueObject(
+    __in PCOPY_CONTEXT CopyContext,
+    __in PYORI_STRING FilePath,
+    __in PYORI_STRING RelativePath,
+    __in PYORI_STRING FullDest,
+    __in_opt PWIN32_FIND_DATA FileInfo
     )
 {
-    PVOID Buffer;
-    DWORD BytesCopied;
-    DWORD BufferSize;
-    HANDLE SourceHandle;
-    HANDLE DestHandle;
-    DWORD LastError;
-    LPTSTR ErrText;
-
-    SourceHandle = CreateFile(SourceFile->StartOfString,
-                              GENERIC_READ,
-                              FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                              NULL,
-                              OPEN_EXISTING,
-                              FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
-                              NULL);
+    PCOPY_POOL Pool = CopyContext->Pool;
+    PCOPY_WORK_ITEM Item;
 
-    if (SourceHandle == INVALID_HANDLE_VALUE) {
-        LastError = GetLastError();
-        ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of source failed: %y: %s"), SourceFile, ErrText);
-        YoriLibFreeWinErrorText(ErrText);
+    Item = YoriLibMalloc(sizeof(COPY_WORK_ITEM) + (FilePath->LengthInChars + 1 + FullDest->LengthInChars + 1) * sizeof(TCHAR));
+    if (Item == NULL) {
         return FALSE;
     }
 
-    DestHandle = CreateFile(DestFile->StartOfString,
-                            GENERIC_WRITE,
-                            FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                            NULL,
-                            CREATE_ALWAYS,
-                            FILE_FLAG_BACKUP_SEMANTICS,
-                            NULL);
+    ZeroMemory(Item, sizeof(COPY_WORK_ITEM));
+    YoriLibInitEmptyString(&Item->SourcePath);
+    Item->SourcePath.StartOfString = (LPTSTR)(Item + 1);
+    memcpy(Item->SourcePath.StartOfString, FilePath->StartOfString, FilePath->LengthInChars * sizeof(TCHAR));
+    Item->SourcePath.StartOfString[FilePath->LengthInChars] = '\0';
+    Item->SourcePath.LengthInChars = FilePath->LengthInChars;
+    Item->SourcePath.LengthAllocated = FilePath->LengthInChars + 1;
+
+    YoriLibInitEmptyString(&Item->RelativePath);
+    Item->RelativePath.StartOfString = Item->SourcePath.StartOfString + (RelativePath->StartOfString - FilePath->StartOfString);
+    Item->RelativePath.LengthInChars = RelativePath->LengthInChars;
+
+    YoriLibInitEmptyString(&Item->DestPath);
+    Item->DestPath.StartOfString = Item->SourcePath.StartOfString + Item->SourcePath.LengthAllocated;
+    memcpy(Item->DestPath.StartOfString, FullDest->StartOfString, FullDest->LengthInChars * sizeof(TCHAR));
+    Item->DestPath.StartOfString[FullDest->LengthInChars] = '\0';
+    Item->DestPath.LengthInChars = FullDest->LengthInChars;
+    Item->DestPath.LengthAllocated = FullDest->LengthInChars + 1;
+
+    if (FileInfo != NULL) {
+        Item->HaveFindData = TRUE;
+        memcpy(&Item->FindData, FileInfo, sizeof(WIN32_FIND_DATA));
+    }
 
-    LastError = GetLastError();
+    WaitForSingleObject(Pool->Mutex, INFINITE);
+    YoriLibAppendList(&Pool->Queue, &Item->ListEntry);
+    Pool->ItemsOutstanding++;
+    ReleaseMutex(Pool->Mutex);
+    ReleaseSemaphore(Pool->WorkAvailable, 1, NULL);
 
-    if (LastError == ERROR_INVALID_PARAMETER) {
-        DestHandle = CreateFile(DestFile->StartOfString,
-                                GENERIC_WRITE,
-                                FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                                NULL,
-                                OPEN_EXISTING,
-                                FILE_FLAG_BACKUP_SEMANTICS,
-                                NULL);
-    }
+    CopyWaitForPool(CopyContext, Pool->MaximumItemsOutstanding);
+    return TRUE;
+}
 
-    if (DestHandle == INVALID_HANDLE_VALUE) {
-        ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Open of destination failed: %y: %s"), DestFile, ErrText);
-        YoriLibFreeWinErrorText(ErrText);
-        CloseHandle(SourceHandle);
-        return FALSE;
+/**
+ Wait for all queued objects to be copied, stop all worker threads, and
+ free the pool.
+
+ @param CopyContext Pointer to the copy context containing the pool.
+ */
+VOID
+CopyTerminatePool(
+    __in PCOPY_CONTEXT CopyContext
+    )
+{
+    PCOPY_POOL Pool = CopyContext->Pool;
+    DWORD Index;
+
+    if (Pool == NULL) {
+        return;
     }
 
-    BufferSize = 64 * 1024;
-    Buffer = YoriLibMalloc(BufferSize);
-    if (Buffer == NULL) {
-        CloseHandle(SourceHandle);
-        CloseHandle(DestHandle);
-        return FALSE;
+    if (Pool->WorkerCount > 0) {
+        CopyWaitForPool(CopyContext, 0);
+
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        Pool->Terminate = TRUE;
+        ReleaseMutex(Pool->Mutex);
+        ReleaseSemaphore(Pool->WorkAvailable, Pool->WorkerCount, NULL);
     }
 
-    while (ReadFile(SourceHandle, Buffer, BufferSize, &BytesCopied, NULL)) {
-        if (BytesCopied == 0) {
-            break;
-        }
+    for (Index = 0; Index < Pool->WorkerCount; Index++) {
+        WaitForSingleObject(Pool->Threads[Index], INFINITE);
+        CloseHandle(Pool->Threads[Index]);
+    }
 
-        if (!WriteFile(DestHandle, Buffer, BytesCopied, &BytesCopied, NULL)) {
-            LastError = GetLastError();
-            ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Write to destination failed: %y: %s"), DestFile, ErrText);
-            YoriLibFreeWinErrorText(ErrText);
-            YoriLibFree(Buffer);
-            CloseHandle(SourceHandle);
-            CloseHandle(DestHandle);
-            return FALSE;
-        }
+    if (Pool->Mutex != NULL) {
+        CloseHandle(Pool->Mutex);
+    }
+    if (Pool->WorkAvailable != NULL) {
+        CloseHandle(Pool->WorkAvailable);
+    }
+    if (Pool->ItemComplete != NULL) {
+        CloseHandle(Pool->ItemComplete);
     }
 
-    YoriLibFree(Buffer);
-    CloseHandle(SourceHandle);
-    CloseHandle(DestHandle);
-    return TRUE;
+    YoriLibFree(Pool);
+    CopyContext->Pool = NULL;
 }
 
 /**
- Apply the timestamps from the source enumeration to the target file.  This
- can be done as a standalone operation or as part of updating files to
- newer contents, where it is important that the timestamps of the target are
- updated.
+ Create a set of worker threads to copy objects concurrently.
 
- @param SourceFindData Pointer to the enumeration from the source specifying
-        file times to apply.
+ @param CopyContext Pointer to the copy context, which must be fully
+        initialized before calling this function.
 
- @param DestFile Points to the fully qualified pathname to the target to
-        apply timestamps to.
+ @param WorkerCount The number of worker threads to create.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
-CopyTimestamps(
-    __in PWIN32_FIND_DATA SourceFindData,
-    __in PYORI_STRING DestFile
+CopyCreatePool(
+    __in PCOPY_CONTEXT CopyContext,
+    __in DWORD WorkerCount
     )
 {
-    HANDLE DestFileHandle;
+    PCOPY_POOL Pool;
+    HANDLE hThread;
+    DWORD ThreadId;
 
-    DestFileHandle = CreateFile(DestFile->StartOfString,
-                                FILE_WRITE_ATTRIBUTES,
-                                FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
-                                NULL,
-                                OPEN_EXISTING,
-                                FILE_FLAG_OPEN_REPARSE_POINT|FILE_FLAG_OPEN_NO_RECALL|FILE_FLAG_BACKUP_SEMANTICS,
-                                NULL);
+    ASSERT(WorkerCount <= COPY_MAXIMUM_WORKERS);
 
-    if (DestFileHandle == INVALID_HANDLE_VALUE) {
+    Pool = YoriLibMalloc(sizeof(COPY_POOL));
+    if (Pool == NULL) {
         return FALSE;
     }
 
-    if (!SetFileTime(DestFileHandle, &SourceFindData->ftCreationTime, &SourceFindData->ftLastAccessTime, &SourceFindData->ftLastWriteTime)) {
-        CloseHandle(DestFileHandle);
+    ZeroMemory(Pool, sizeof(COPY_POOL));
+    Pool->MaximumItemsOutstanding = WorkerCount * COPY_MAXIMUM_QUEUED_PER_WORKER;
+    YoriLibInitializeListHead(&Pool->Queue);
+    CopyContext->Pool = Pool;
+
+    Pool->Mutex = CreateMutex(NULL, FALSE, NULL);
+    Pool->WorkAvailable = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+    Pool->ItemComplete = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (Pool->Mutex == NULL ||
+        Pool->WorkAvailable == NULL ||
+        Pool->ItemComplete == NULL) {
+
+        CopyTerminatePool(CopyContext);
         return FALSE;
     }
 
-    CloseHandle(DestFileHandle);
+    while (Pool->WorkerCount < WorkerCount) {
+        hThread = CreateThread(NULL, 0, CopyWorker, CopyContext, 0, &ThreadId);
+        if (hThread == NULL) {
+            CopyTerminatePool(CopyContext);
+            return FALSE;
+        }
+        Pool->Threads[Pool->WorkerCount] = hThread;
+        Pool->WorkerCount++;
+    }
+
     return TRUE;
 }
 
@@ -769,7 +2472,7 @@ CopyFileFoundCallback(
     //  Check if the user wanted to exclude this file
     //
 
-    if (CopyShouldExclude(CopyContext, &RelativePathFromSource, FileInfo)) {
+    if (CopyShouldExclude(CopyContext, FilePath, &RelativePathFromSource, FileInfo)) {
         CopyContext->FilesFoundThisArg++;
 
         if (CopyContext->Verbose) {
@@ -801,16 +2504,18 @@ CopyFileFoundCallback(
     }
 
 
-    if (!CopyContext->SkipDataCopy) {
-        if (FileInfo != NULL &&
-            FileInfo->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT &&
-            CopyContext->CopyAsLinks &&
-            (FileInfo->dwReserved0 == IO_REPARSE_TAG_MOUNT_POINT || FileInfo->dwReserved0 == IO_REPARSE_TAG_SYMLINK)) {
+    //
+    //  Directories are created here, before any objects within them are
+    //  found, so that any worker copying those objects can assume the
+    //  directory exists.  Timestamps on directories are applied after all
+    //  objects have been copied.
+    //
 
-            CopyAsLink(FilePath->StartOfString, FullDest.StartOfString, (FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY));
+    if (FileInfo != NULL &&
+        FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY &&
+        !CopyShouldCopyAsLink(CopyContext, FileInfo)) {
 
-        } else if (FileInfo != NULL &&
-                   FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+        if (!CopyContext->SkipDataCopy) {
             if (!CreateDirectory(FullDest.StartOfString, NULL)) {
                 DWORD LastError = GetLastError();
                 if (LastError != ERROR_ALREADY_EXISTS) {
@@ -819,47 +2524,16 @@ CopyFileFoundCallback(
                     YoriLibFreeWinErrorText(ErrText);
                 }
             }
-        } else if (CopyContext->DestinationIsDevice || YoriLibIsFileNameDeviceName(FilePath)) {
-            CopyAsDumbDataMove(FilePath, &FullDest);
-        } else {
-            if (!CopyFile(FilePath->StartOfString, FullDest.StartOfString, FALSE)) {
-                DWORD LastError = GetLastError();
-
-                //
-                //  If it failed with an error indicating CopyFile couldn't
-                //  handle it, fall back to dumb data copy.  Note that this
-                //  function will output its own errors, so from this point,
-                //  error handling is over.
-                //
-
-                if (LastError == ERROR_INVALID_PARAMETER) {
-                    CopyAsDumbDataMove(FilePath, &FullDest);
-                } else {
-                    LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-                    if (SourceNameToDisplay != &HumanSourcePath) {
-                        if (YoriLibUnescapePath(FilePath, &HumanSourcePath)) {
-                            SourceNameToDisplay = &HumanSourcePath;
-                        }
-                    }
-                    if (DestNameToDisplay != &HumanDestPath) {
-                        if (YoriLibUnescapePath(&FullDest, &HumanDestPath)) {
-                            DestNameToDisplay = &HumanDestPath;
-                        }
-                    }
-                    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("CopyFile failed: %y to %y: %s"), SourceNameToDisplay, DestNameToDisplay, ErrText);
-                    YoriLibFreeWinErrorText(ErrText);
-                }
-            }
-
-            if (CopyContext->CompressDest) {
+        }
 
-                YoriLibCompressFileInBackground(&CopyContext->CompressContext, &FullDest);
+        if (CopyContext->CopyTimestamps) {
+            if (!CopyDeferTimestamps(CopyContext, FileInfo, &FullDest)) {
+                CopyTimestamps(FileInfo, &FullDest);
             }
         }
-    }
-
-    if (CopyContext->CopyTimestamps && FileInfo != NULL) {
-        CopyTimestamps(FileInfo, &FullDest);
+    } else if (CopyContext->Pool == NULL ||
+               !CopyQueueObject(CopyContext, FilePath, &RelativePathFromSource, &FullDest, FileInfo)) {
+        CopyObject(CopyContext, FilePath, &RelativePathFromSource, &FullDest, FileInfo);
     }
 
     CopyContext->FilesFoundThisArg++;
@@ -923,6 +2597,9 @@ CopyFreeCopyContext(
     __in PCOPY_CONTEXT CopyContext
     )
 {
+    CopyTerminatePool(CopyContext);
+    CopyApplyDeferredTimestamps(CopyContext, FALSE);
+    CopyManifestFree(CopyContext);
     YoriLibFreeCompressContext(&CopyContext->CompressContext);
     YoriLibFreeStringContents(&CopyContext->Dest);
     CopyFreeExcludes(CopyContext);
@@ -966,6 +2643,9 @@ ENTRYPOINT(
     BOOL Recursive;
     DWORD i;
     DWORD Result;
+    DWORD WorkerCount;
+    BOOL Incremental;
+    BOOL IncrementalHash;
     COPY_CONTEXT CopyContext;
     YORILIB_COMPRESS_ALGORITHM CompressionAlgorithm;
     YORI_STRING Arg;
@@ -973,10 +2653,15 @@ ENTRYPOINT(
     FileCount = 0;
     Recursive = FALSE;
     BasicEnumeration = FALSE;
+    WorkerCount = 0;
+    Incremental = FALSE;
+    IncrementalHash = FALSE;
     ZeroMemory(&CopyContext, sizeof(CopyContext));
+    CopyContext.BlockSize = COPY_DEFAULT_BLOCK_SIZE;
     CompressionAlgorithm.EntireAlgorithm = 0;
 
     YoriLibInitializeListHead(&CopyContext.ExcludeList);
+    YoriLibInitializeListHead(&CopyContext.DeferredTimestampList);
 
     for (i = 1; i < ArgC; i++) {
 
@@ -994,6 +2679,20 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("b")) == 0) {
                 BasicEnumeration = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("bs")) == 0) {
+                if (i + 1 < ArgC) {
+                    LARGE_INTEGER BlockSize;
+                    BlockSize = YoriLibStringToFileSize(&ArgV[i + 1]);
+                    if (BlockSize.HighPart != 0 || BlockSize.LowPart > COPY_MAXIMUM_BLOCK_SIZE) {
+                        CopyContext.BlockSize = COPY_MAXIMUM_BLOCK_SIZE;
+                    } else if (BlockSize.LowPart < COPY_MINIMUM_BLOCK_SIZE) {
+                        CopyContext.BlockSize = COPY_MINIMUM_BLOCK_SIZE;
+                    } else {
+                        CopyContext.BlockSize = BlockSize.LowPart;
+                    }
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("c:lzx")) == 0) {
 
                 CompressionAlgorithm.EntireAlgorithm = 0;
@@ -1021,6 +2720,27 @@ ENTRYPOINT(
                 CompressionAlgorithm.WofAlgorithm = FILE_PROVIDER_COMPRESSION_XPRESS16K;
                 CopyContext.CompressDest = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("i")) == 0) {
+                Incremental = TRUE;
+                ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("ih")) == 0) {
+                Incremental = TRUE;
+                IncrementalHash = TRUE;
+                ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("j")) == 0) {
+                if (i + 1 < ArgC) {
+                    LONGLONG LlWorkerCount = 0;
+                    DWORD CharsConsumed = 0;
+                    YoriLibStringToNumber(&ArgV[i + 1], TRUE, &LlWorkerCount, &CharsConsumed);
+                    if (LlWorkerCount < 1) {
+                        LlWorkerCount = 1;
+                    } else if (LlWorkerCount > COPY_MAXIMUM_WORKERS) {
+                        LlWorkerCount = COPY_MAXIMUM_WORKERS;
+                    }
+                    WorkerCount = (DWORD)LlWorkerCount;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("l")) == 0) {
                 CopyContext.CopyAsLinks = TRUE;
                 ArgumentUnderstood = TRUE;
@@ -1129,11 +2849,35 @@ ENTRYPOINT(
         }
     }
 
+    if (Incremental) {
+        if ((CopyContext.DestAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("copy: incremental copy requires a destination directory\n"));
+            CopyFreeCopyContext(&CopyContext);
+            return EXIT_FAILURE;
+        }
+        if (!CopyManifestInitialize(&CopyContext, IncrementalHash)) {
+            CopyFreeCopyContext(&CopyContext);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //
+    //  Copying to a single file or device can't benefit from concurrency,
+    //  so only create workers if the destination is a directory.
+    //
+
+    if (WorkerCount > 1 && (CopyContext.DestAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        if (!CopyCreatePool(&CopyContext, WorkerCount)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("copy: could not create worker threads, copying serially\n"));
+        }
+    }
+
 #if YORI_BUILTIN
     YoriLibCancelEnable();
 #endif
 
     CopyContext.FilesCopied = 0;
+    CopyContext.FilesUnchanged = 0;
     FilesProcessed = 0;
 
     for (i = FirstFileArg; i <= LastFileArg; i++) {
@@ -1187,9 +2931,28 @@ ENTRYPOINT(
         }
     }
 
+    //
+    //  Wait for all objects to be copied before applying timestamps to
+    //  the directories containing them.
+    //
+
+    if (CopyContext.Pool != NULL) {
+        CopyWaitForPool(&CopyContext, 0);
+    }
+    CopyApplyDeferredTimestamps(&CopyContext, TRUE);
+
+    //
+    //  If the copy was cancelled, files which were not yet found are kept
+    //  in the manifest since their destination is as it was before.
+    //
+
+    if (CopyContext.Manifest != NULL) {
+        CopyManifestWrite(CopyContext.Manifest, YoriLibIsOperationCancelled());
+    }
+
     Result = EXIT_SUCCESS;
 
-    if (CopyContext.FilesCopied == 0) {
+    if (CopyContext.FilesCopied == 0 && CopyContext.FilesUnchanged == 0) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("copy: no matching files found\n"));
         Result = EXIT_FAILURE;
     }
@@ -0,0 +1,545 @@
+/**
+ * @file crt/crtbench.c
+ *
+ * Benchmark comparing mini CRT memory and string routines to byte loops
+ *
+ * Copyright (c) 2026 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+
+/**
+ The number of bytes processed by each measurement.  Smaller buffers are
+ processed repeatedly until this many bytes have been processed.
+ */
+#define CRTBENCH_BYTES_PER_TEST (256 * 1024 * 1024)
+
+/**
+ The largest buffer size that is measured.
+ */
+#define CRTBENCH_MAXIMUM_SIZE (1024 * 1024)
+
+/**
+ The number of bytes by which the destination of a memmove overlaps the
+ source.  This is a multiple of the word size so that the word at a time
+ implementation can be used.
+ */
+#define CRTBENCH_MOVE_OFFSET (16)
+
+/**
+ The buffer sizes, in bytes, to measure.
+ */
+CONST DWORD CrtBenchSizes[] = {16, 256, 4096, CRTBENCH_MAXIMUM_SIZE};
+
+/**
+ A prototype for a function which copies memory.
+ */
+typedef void * MCRT_FN CRTBENCH_COPY_FN(void * dest, const void * src, unsigned int len);
+
+/**
+ A prototype for a pointer to a function which copies memory.
+ */
+typedef CRTBENCH_COPY_FN *PCRTBENCH_COPY_FN;
+
+/**
+ A prototype for a function which scans a NULL terminated string, returning
+ a value derived from its result so the scan is not optimized away.
+ */
+typedef DWORD_PTR CRTBENCH_SCAN_FN(const TCHAR * str, TCHAR * search);
+
+/**
+ A prototype for a pointer to a function which scans a string.
+ */
+typedef CRTBENCH_SCAN_FN *PCRTBENCH_SCAN_FN;
+
+/**
+ Accumulates results from each operation so the compiler cannot discard
+ them.
+ */
+volatile DWORD_PTR CrtBenchSink;
+
+/**
+ Copy memory a byte at a time, as the mini CRT previously did.
+
+ @param dest Pointer to the memory block to write to.
+
+ @param src Pointer to the memory block to read from.
+
+ @param len The number of bytes to copy.
+
+ @return Pointer to the destination memory block.
+ */
+void *
+MCRT_FN
+CrtBenchByteMemcpy(void * dest, const void * src, unsigned int len)
+{
+    unsigned int i;
+    char * char_src = (char *)src;
+    char * char_dest = (char *)dest;
+    for (i = 0; i < len; i++) {
+        char_dest[i] = char_src[i];
+    }
+    return dest;
+}
+
+/**
+ Copy overlapping memory a byte at a time, as the mini CRT previously did.
+
+ @param dest Pointer to the memory block to write to.
+
+ @param src Pointer to the memory block to read from.
+
+ @param len The number of bytes to copy.
+
+ @return Pointer to the destination memory block.
+ */
+void *
+MCRT_FN
+CrtBenchByteMemmove(void * dest, const void * src, unsigned int len)
+{
+    unsigned int i;
+    char * char_src = (char *)src;
+    char * char_dest = (char *)dest;
+    if (char_dest > char_src) {
+        if (len == 0) {
+            return dest;
+        }
+        for (i = len - 1; ; i--) {
+            char_dest[i] = char_src[i];
+            if (i==0) break;
+        }
+    } else {
+        for (i = 0; i < len; i++) {
+            char_dest[i] = char_src[i];
+        }
+    }
+    return dest;
+}
+
+/**
+ Copy memory using the mini CRT.
+
+ @param dest Pointer to the memory block to write to.
+
+ @param src Pointer to the memory block to read from.
+
+ @param len The number of bytes to copy.
+
+ @return Pointer to the destination memory block.
+ */
+void *
+MCRT_FN
+CrtBenchCrtMemcpy(void * dest, const void * src, unsigned int len)
+{
+    return memcpy(dest, src, len);
+}
+
+/**
+ Copy overlapping memory using the mini CRT.
+
+ @param dest Pointer to the memory block to write to.
+
+ @param src Pointer to the memory block to read from.
+
+ @param len The number of bytes to copy.
+
+ @return Pointer to the destination memory block.
+ */
+void *
+MCRT_FN
+CrtBenchCrtMemmove(void * dest, const void * src, unsigned int len)
+{
+    return memmove(dest, src, len);
+}
+
+/**
+ Count the characters in a string a character at a time, as the mini CRT
+ previously did.
+
+ @param str The string to count characters in.
+
+ @param search Unused.
+
+ @return The number of characters in the string.
+ */
+DWORD_PTR
+CrtBenchByteStrlen(const TCHAR * str, TCHAR * search)
+{
+    int i = 0;
+    UNREFERENCED_PARAMETER(search);
+    while (str[i] != '\0') {
+        i++;
+    }
+    return (DWORD_PTR)i;
+}
+
+/**
+ Find a character in a string a character at a time, as the mini CRT
+ previously did.
+
+ @param str The string to search through.
+
+ @param search Pointer to the character to look for.
+
+ @return Pointer to the first occurrence of the character, or NULL.
+ */
+DWORD_PTR
+CrtBenchByteStrchr(const TCHAR * str, TCHAR * search)
+{
+    const TCHAR * ptr = str;
+    while (*ptr != '\0' && *ptr != search[0]) ptr++;
+    if (*ptr == search[0]) return (DWORD_PTR)ptr;
+    return 0;
+}
+
+/**
+ Find a string within a string by comparing at each character, as the mini
+ CRT previously did.
+
+ @param str The string to search through.
+
+ @param search The string to search for.
+
+ @return Pointer to the first occurrence of the search string, or NULL.
+ */
+DWORD_PTR
+CrtBenchByteStrstr(const TCHAR * str, TCHAR * search)
+{
+    const TCHAR * ptr = str;
+    int i;
+    while (*ptr != '\0') {
+        for (i=0;ptr[i]==search[i]&&search[i]!='\0'&&ptr[i]!='\0';i++);
+        if (search[i]=='\0') return (DWORD_PTR)ptr;
+        ptr++;
+    }
+    return 0;
+}
+
+/**
+ Count the characters in a string using the mini CRT.
+
+ @param str The string to count characters in.
+
+ @param search Unused.
+
+ @return The number of characters in the string.
+ */
+DWORD_PTR
+CrtBenchCrtStrlen(const TCHAR * str, TCHAR * search)
+{
+    UNREFERENCED_PARAMETER(search);
+    return (DWORD_PTR)_tcslen(str);
+}
+
+/**
+ Find a character in a string using the mini CRT.
+
+ @param str The string to search through.
+
+ @param search Pointer to the character to look for.
+
+ @return Pointer to the first occurrence of the character, or NULL.
+ */
+DWORD_PTR
+CrtBenchCrtStrchr(const TCHAR * str, TCHAR * search)
+{
+    return (DWORD_PTR)_tcschr(str, search[0]);
+}
+
+/**
+ Find a string within a string using the mini CRT.
+
+ @param str The string to search through.
+
+ @param search The string to search for.
+
+ @return Pointer to the first occurrence of the search string, or NULL.
+ */
+DWORD_PTR
+CrtBenchCrtStrstr(const TCHAR * str, TCHAR * search)
+{
+    return (DWORD_PTR)_tcsstr(str, search);
+}
+
+/**
+ Convert a number of bytes processed in an amount of time to megabytes per
+ second.
+
+ @param Bytes The number of bytes processed.
+
+ @param Ticks The number of performance counter ticks taken.
+
+ @param Frequency The number of performance counter ticks per second.
+
+ @return The number of megabytes processed per second.
+ */
+DWORDLONG
+CrtBenchRate(
+    __in DWORDLONG Bytes,
+    __in DWORDLONG Ticks,
+    __in DWORDLONG Frequency
+    )
+{
+    if (Ticks == 0) {
+        Ticks = 1;
+    }
+    return Bytes * Frequency / Ticks / (1024 * 1024);
+}
+
+/**
+ Measure the rate of a memory copy function.
+
+ @param CopyFn The function to measure.
+
+ @param Dest Pointer to the destination buffer.
+
+ @param Src Pointer to the source buffer.
+
+ @param Size The number of bytes to copy in each call.
+
+ @param Frequency The number of performance counter ticks per second.
+
+ @return The number of megabytes copied per second.
+ */
+DWORDLONG
+CrtBenchMeasureCopy(
+    __in PCRTBENCH_COPY_FN CopyFn,
+    __in PUCHAR Dest,
+    __in PUCHAR Src,
+    __in DWORD Size,
+    __in DWORDLONG Frequency
+    )
+{
+    LARGE_INTEGER Start;
+    LARGE_INTEGER End;
+    DWORD Iterations;
+    DWORD Index;
+
+    Iterations = CRTBENCH_BYTES_PER_TEST / Size;
+    QueryPerformanceCounter(&Start);
+    for (Index = 0; Index < Iterations; Index++) {
+        CrtBenchSink = CrtBenchSink + (DWORD_PTR)CopyFn(Dest, Src, Size);
+    }
+    QueryPerformanceCounter(&End);
+
+    return CrtBenchRate((DWORDLONG)Iterations * Size, End.QuadPart - Start.QuadPart, Frequency);
+}
+
+/**
+ Measure the rate of a string scanning function.
+
+ @param ScanFn The function to measure.
+
+ @param String Pointer to a buffer of Size bytes to populate with a string
+        and scan.
+
+ @param Search The string to search for.
+
+ @param Size The number of bytes in the string, including its terminator.
+
+ @param Frequency The number of performance counter ticks per second.
+
+ @return The number of megabytes scanned per second.
+ */
+DWORDLONG
+CrtBenchMeasureScan(
+    __in PCRTBENCH_SCAN_FN ScanFn,
+    __in LPTSTR String,
+    __in LPTSTR Search,
+    __in DWORD Size,
+    __in DWORDLONG Frequency
+    )
+{
+    LARGE_INTEGER Start;
+    LARGE_INTEGER End;
+    DWORD Iterations;
+    DWORD Index;
+    DWORD CharCount;
+
+    //
+    //  Fill the string with a character which starts the search string but
+    //  never completes it, so every position is examined.
+    //
+
+    CharCount = Size / sizeof(TCHAR);
+    for (Index = 0; Index < CharCount - 1; Index++) {
+        String[Index] = 'a';
+    }
+    String[CharCount - 1] = '\0';
+
+    Iterations = CRTBENCH_BYTES_PER_TEST / Size;
+    QueryPerformanceCounter(&Start);
+    for (Index = 0; Index < Iterations; Index++) {
+        CrtBenchSink = CrtBenchSink + ScanFn(String, Search);
+    }
+    QueryPerformanceCounter(&End);
+
+    return CrtBenchRate((DWORDLONG)Iterations * Size, End.QuadPart - Start.QuadPart, Frequency);
+}
+
+/**
+ Measure a mini CRT function against a byte loop at each buffer size, and
+ output the results.  If SSE2 is in use, the mini CRT function is measured
+ both with and without it.
+
+ @param Name The name of the operation being measured.
+
+ @param ByteCopyFn If measuring a copy, the byte loop implementation.
+
+ @param CrtCopyFn If measuring a copy, the mini CRT implementation.
+
+ @param ByteScanFn If measuring a scan, the byte loop implementation.
+
+ @param CrtScanFn If measuring a scan, the mini CRT implementation.
+
+ @param Search If measuring a scan, the string to search for.
+
+ @param Buffer Pointer to a buffer of twice CRTBENCH_MAXIMUM_SIZE bytes.
+
+ @param Frequency The number of performance counter ticks per second.
+ */
+VOID
+CrtBenchCompare(
+    __in LPCTSTR Name,
+    __in_opt PCRTBENCH_COPY_FN ByteCopyFn,
+    __in_opt PCRTBENCH_COPY_FN CrtCopyFn,
+    __in_opt PCRTBENCH_SCAN_FN ByteScanFn,
+    __in_opt PCRTBENCH_SCAN_FN CrtScanFn,
+    __in_opt LPTSTR Search,
+    __in PUCHAR Buffer,
+    __in DWORDLONG Frequency
+    )
+{
+    DWORD Index;
+    DWORD Size;
+    PUCHAR Dest;
+    PUCHAR Src;
+    DWORDLONG ByteRate;
+    DWORDLONG WordRate;
+    DWORDLONG Sse2Rate;
+
+    for (Index = 0; Index < sizeof(CrtBenchSizes)/sizeof(CrtBenchSizes[0]); Index++) {
+        Size = CrtBenchSizes[Index];
+
+        //
+        //  memmove is measured with a destination that overlaps the end of
+        //  the source, which requires copying backwards.  Other copies are
+        //  disjoint.
+        //
+
+        Src = Buffer;
+        if (CrtCopyFn == CrtBenchCrtMemmove) {
+            Dest = Buffer + CRTBENCH_MOVE_OFFSET;
+        } else {
+            Dest = Buffer + CRTBENCH_MAXIMUM_SIZE;
+        }
+
+        Sse2Rate = 0;
+        if (CrtCopyFn != NULL) {
+            ByteRate = CrtBenchMeasureCopy(ByteCopyFn, Dest, Src, Size, Frequency);
+#if MCRT_SSE2
+            if (mini_sse2_available()) {
+                Sse2Rate = CrtBenchMeasureCopy(CrtCopyFn, Dest, Src, Size, Frequency);
+            }
+            mini_sse2_state = 0;
+#endif
+            WordRate = CrtBenchMeasureCopy(CrtCopyFn, Dest, Src, Size, Frequency);
+        } else {
+            ByteRate = CrtBenchMeasureScan(ByteScanFn, (LPTSTR)Buffer, Search, Size, Frequency);
+#if MCRT_SSE2
+            if (mini_sse2_available()) {
+                Sse2Rate = CrtBenchMeasureScan(CrtScanFn, (LPTSTR)Buffer, Search, Size, Frequency);
+            }
+            mini_sse2_state = 0;
+#endif
+            WordRate = CrtBenchMeasureScan(CrtScanFn, (LPTSTR)Buffer, Search, Size, Frequency);
+        }
+
+#if MCRT_SSE2
+        //
+        //  Determine SSE2 support again for the next measurement.
+        //
+
+        mini_sse2_state = -1;
+#endif
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%-8s %8i bytes: byte %6lli MB/s, word %6lli MB/s"), Name, Size, ByteRate, WordRate);
+        if (Sse2Rate != 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T(", sse2 %6lli MB/s"), Sse2Rate);
+        }
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("\n"));
+    }
+}
+
+/**
+ The main entrypoint for the mini CRT benchmark.
+
+ @param ArgC The number of arguments.
+
+ @param ArgV An array of arguments.
+
+ @return Exit code of zero to indicate success, nonzero to indicate failure.
+ */
+DWORD
+ymain(
+    __in DWORD ArgC,
+    __in YORI_STRING ArgV[]
+    )
+{
+    LARGE_INTEGER Frequency;
+    PUCHAR Buffer;
+    TCHAR CharSearch[2];
+    TCHAR StringSearch[3];
+
+    UNREFERENCED_PARAMETER(ArgC);
+    UNREFERENCED_PARAMETER(ArgV);
+
+    if (!QueryPerformanceFrequency(&Frequency) || Frequency.QuadPart == 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("crtbench: no performance counter\n"));
+        return EXIT_FAILURE;
+    }
+
+    Buffer = YoriLibMalloc(2 * CRTBENCH_MAXIMUM_SIZE);
+    if (Buffer == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("crtbench: out of memory\n"));
+        return EXIT_FAILURE;
+    }
+
+    ZeroMemory(Buffer, 2 * CRTBENCH_MAXIMUM_SIZE);
+
+    CharSearch[0] = 'b';
+    CharSearch[1] = '\0';
+    StringSearch[0] = 'a';
+    StringSearch[1] = 'b';
+    StringSearch[2] = '\0';
+
+    CrtBenchCompare(_T("memcpy"), CrtBenchByteMemcpy, CrtBenchCrtMemcpy, NULL, NULL, NULL, Buffer, Frequency.QuadPart);
+    CrtBenchCompare(_T("memmove"), CrtBenchByteMemmove, CrtBenchCrtMemmove, NULL, NULL, NULL, Buffer, Frequency.QuadPart);
+    CrtBenchCompare(_T("strlen"), NULL, NULL, CrtBenchByteStrlen, CrtBenchCrtStrlen, CharSearch, Buffer, Frequency.QuadPart);
+    CrtBenchCompare(_T("strchr"), NULL, NULL, CrtBenchByteStrchr, CrtBenchCrtStrchr, CharSearch, Buffer, Frequency.QuadPart);
+    CrtBenchCompare(_T("strstr"), NULL, NULL, CrtBenchByteStrstr, CrtBenchCrtStrstr, StringSearch, Buffer, Frequency.QuadPart);
+
+    YoriLibFree(Buffer);
+    return EXIT_SUCCESS;
+}
+
+// vim:sw=4:ts=4:et:
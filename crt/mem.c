@@ -46,6 +46,75 @@
 #define MINICRT_BUILD
 #include "yoricrt.h"
 
+#if MCRT_SSE2
+
+#ifndef PF_XMMI64_INSTRUCTIONS_AVAILABLE
+/**
+ The processor feature indicating SSE2 support, for compilers that don't
+ define it.
+ */
+#define PF_XMMI64_INSTRUCTIONS_AVAILABLE 10
+#endif
+
+/**
+ A prototype for the IsProcessorFeaturePresent function, which is resolved
+ dynamically since older systems do not have it.
+ */
+typedef BOOL WINAPI IS_PROCESSOR_FEATURE_PRESENT(DWORD);
+
+/**
+ Set to 1 if SSE2 can be used, 0 if it cannot, or -1 if this has not been
+ determined yet.
+ */
+int mini_sse2_state = -1;
+
+/**
+ Determine whether SSE2 instructions can be used.  On AMD64 they always can,
+ unless a benchmark has disabled them.  On x86 this requires both processor
+ support and an operating system that preserves the XMM registers, which
+ IsProcessorFeaturePresent reports.
+
+ @return Nonzero if SSE2 instructions can be used, zero if they cannot.
+ */
+int
+MCRT_FN
+mini_sse2_available(void)
+{
+#if defined(_M_AMD64)
+    return (mini_sse2_state != 0);
+#else
+    IS_PROCESSOR_FEATURE_PRESENT * pIsProcessorFeaturePresent;
+    HMODULE hKernel;
+    int state;
+
+    state = mini_sse2_state;
+    if (state >= 0) {
+        return state;
+    }
+
+    state = 0;
+    hKernel = GetModuleHandleA("KERNEL32");
+    if (hKernel != NULL) {
+        pIsProcessorFeaturePresent = (IS_PROCESSOR_FEATURE_PRESENT *)GetProcAddress(hKernel, "IsProcessorFeaturePresent");
+        if (pIsProcessorFeaturePresent != NULL &&
+            pIsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE)) {
+
+            state = 1;
+        }
+    }
+
+    mini_sse2_state = state;
+    return state;
+#endif
+}
+#endif
+
+/**
+ The number of bytes that need to be copied before SSE2 copies are used.
+ Below this, aligning the buffer costs more than it saves.
+ */
+#define MCRT_SSE2_COPY_THRESHOLD 64
+
 /**
  Copy the contents of one memory block into another memory block where the
  two memory blocks must be disjoint so no consideration is made for writing
@@ -66,7 +135,40 @@ mini_memcpy(void * dest, const void * src, unsigned int len)
     unsigned int i;
     char * char_src = (char *)src;
     char * char_dest = (char *)dest;
-    for (i = 0; i < len; i++) {
+
+    i = 0;
+
+#if MCRT_SSE2
+    //
+    //  Align the destination to 16 bytes, then copy 16 bytes at a time
+    //  with unaligned loads and aligned stores.
+    //
+
+    if (len >= MCRT_SSE2_COPY_THRESHOLD && mini_sse2_available()) {
+        for (; (((MCRT_UINTPTR)&char_dest[i]) & 15) != 0; i++) {
+            char_dest[i] = char_src[i];
+        }
+        for (; i + 16 <= len; i += 16) {
+            _mm_store_si128((__m128i *)&char_dest[i], _mm_loadu_si128((const __m128i *)&char_src[i]));
+        }
+    }
+#endif
+
+    //
+    //  If both buffers have the same alignment, copy whole words once the
+    //  destination is aligned.
+    //
+
+    if ((((MCRT_UINTPTR)char_dest ^ (MCRT_UINTPTR)char_src) & (sizeof(MCRT_UINTPTR) - 1)) == 0) {
+        for (; i < len && (((MCRT_UINTPTR)&char_dest[i]) & (sizeof(MCRT_UINTPTR) - 1)) != 0; i++) {
+            char_dest[i] = char_src[i];
+        }
+        for (; i + sizeof(MCRT_UINTPTR) <= len; i += sizeof(MCRT_UINTPTR)) {
+            *(MCRT_UINTPTR *)&char_dest[i] = *(MCRT_UINTPTR *)&char_src[i];
+        }
+    }
+
+    for (; i < len; i++) {
         char_dest[i] = char_src[i];
     }
     return dest;
@@ -92,19 +194,46 @@ mini_memmove(void * dest, const void * src, unsigned int len)
     unsigned int i;
     char * char_src = (char *)src;
     char * char_dest = (char *)dest;
-    if (char_dest > char_src) {
-        if (len == 0) {
-            return dest;
+
+    //
+    //  A forward copy is safe if the destination is before the source, since
+    //  each chunk is read before any write could reach it, or if the two
+    //  don't overlap at all.
+    //
+
+    if (char_dest <= char_src || char_dest >= char_src + len) {
+        return mini_memcpy(dest, src, len);
+    }
+
+    //
+    //  Copy backwards.  Here i is the number of bytes remaining to copy.
+    //
+
+    i = len;
+
+#if MCRT_SSE2
+    if (len >= MCRT_SSE2_COPY_THRESHOLD && mini_sse2_available()) {
+        for (; (((MCRT_UINTPTR)&char_dest[i]) & 15) != 0; i--) {
+            char_dest[i - 1] = char_src[i - 1];
         }
-        for (i = len - 1; ; i--) {
-            char_dest[i] = char_src[i];
-            if (i==0) break;
+        for (; i >= 16; i -= 16) {
+            _mm_store_si128((__m128i *)&char_dest[i - 16], _mm_loadu_si128((const __m128i *)&char_src[i - 16]));
         }
-    } else {
-        for (i = 0; i < len; i++) {
-            char_dest[i] = char_src[i];
+    }
+#endif
+
+    if ((((MCRT_UINTPTR)char_dest ^ (MCRT_UINTPTR)char_src) & (sizeof(MCRT_UINTPTR) - 1)) == 0) {
+        for (; i > 0 && (((MCRT_UINTPTR)&char_dest[i]) & (sizeof(MCRT_UINTPTR) - 1)) != 0; i--) {
+            char_dest[i - 1] = char_src[i - 1];
+        }
+        for (; i >= sizeof(MCRT_UINTPTR); i -= sizeof(MCRT_UINTPTR)) {
+            *(MCRT_UINTPTR *)&char_dest[i - sizeof(MCRT_UINTPTR)] = *(MCRT_UINTPTR *)&char_src[i - sizeof(MCRT_UINTPTR)];
         }
     }
+
+    for (; i > 0; i--) {
+        char_dest[i - 1] = char_src[i - 1];
+    }
     return dest;
 }
 
@@ -164,6 +164,127 @@ mini_tcsncat(TCHAR * dest, const TCHAR * src, unsigned int len)
     return dest;
 }
 
+#ifdef UNICODE
+/**
+ Indicate this compilation should generate the unicode form of @ref mini_tcsfind.
+ */
+#define mini_tcsfind mini_wcsfind
+#else
+/**
+ Indicate this compilation should generate the ansi form of @ref mini_tcsfind.
+ */
+#define mini_tcsfind mini_strfind
+#endif
+
+/**
+ Find the leftmost character within a NULL terminated string which is either
+ the specified character or the NULL terminator.  This is the common scan
+ underneath the string search functions, and it examines 16 bytes at a time
+ with SSE2 where available, or a pointer sized word at a time otherwise.
+ Reads are always aligned to the size being read, so they never cross into a
+ page that the string does not occupy.
+
+ @param str Pointer to the string to search through.
+
+ @param ch The character to look for.
+
+ @return Pointer to the first occurrence of the character or the NULL
+         terminator, whichever comes first.
+ */
+const TCHAR *
+MCRT_FN
+mini_tcsfind(const TCHAR * str, TCHAR ch)
+{
+    const TCHAR * ptr = str;
+    MCRT_UINTPTR CharMask;
+    MCRT_UINTPTR Ones;
+    MCRT_UINTPTR Highs;
+    MCRT_UINTPTR Pattern;
+    MCRT_UINTPTR Word;
+
+#if MCRT_SSE2
+    if (mini_sse2_available() && (((MCRT_UINTPTR)ptr) & (sizeof(TCHAR) - 1)) == 0) {
+        __m128i Zero;
+        __m128i Target;
+        __m128i Block;
+        const char * Aligned;
+        unsigned int Mask;
+        unsigned int Bit;
+
+        Zero = _mm_setzero_si128();
+#ifdef UNICODE
+        Target = _mm_set1_epi16((short)ch);
+#else
+        Target = _mm_set1_epi8((char)ch);
+#endif
+
+        //
+        //  Start from the aligned block containing the string and discard
+        //  any matches that precede it.
+        //
+
+        Aligned = (const char *)((MCRT_UINTPTR)ptr & ~((MCRT_UINTPTR)15));
+        Bit = (unsigned int)((const char *)ptr - Aligned);
+        while (TRUE) {
+            Block = _mm_load_si128((const __m128i *)Aligned);
+#ifdef UNICODE
+            Mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(Block, Zero), _mm_cmpeq_epi16(Block, Target)));
+#else
+            Mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(Block, Zero), _mm_cmpeq_epi8(Block, Target)));
+#endif
+            Mask = Mask & ~((1 << Bit) - 1);
+            if (Mask != 0) {
+                for (Bit = 0; (Mask & (1 << Bit)) == 0; Bit++);
+                return (const TCHAR *)(Aligned + Bit);
+            }
+            Aligned = Aligned + 16;
+            Bit = 0;
+        }
+    }
+#endif
+
+    //
+    //  Walk characters until the pointer is word aligned.
+    //
+
+    while ((((MCRT_UINTPTR)ptr) & (sizeof(MCRT_UINTPTR) - 1)) != 0) {
+        if (*ptr == '\0' || *ptr == ch) {
+            return ptr;
+        }
+        ptr++;
+    }
+
+    //
+    //  Ones has the lowest bit of each character set, Highs has the highest
+    //  bit of each character set.  A word contains a zero character if
+    //  subtracting Ones borrows into a high bit which was not already set.
+    //  XORing with Pattern turns a match for ch into a zero character.
+    //
+
+    CharMask = (((MCRT_UINTPTR)1) << (sizeof(TCHAR) * 8)) - 1;
+    Ones = ((MCRT_UINTPTR)-1) / CharMask;
+    Highs = Ones << (sizeof(TCHAR) * 8 - 1);
+    Pattern = Ones * (((MCRT_UINTPTR)ch) & CharMask);
+
+    while (TRUE) {
+        Word = *(const MCRT_UINTPTR *)ptr;
+        if (((Word - Ones) & ~Word & Highs) != 0) {
+            break;
+        }
+        Word = Word ^ Pattern;
+        if (((Word - Ones) & ~Word & Highs) != 0) {
+            break;
+        }
+        ptr = ptr + sizeof(MCRT_UINTPTR) / sizeof(TCHAR);
+    }
+
+    while (*ptr != '\0' && *ptr != ch) {
+        ptr++;
+    }
+
+    return ptr;
+}
+
 #ifdef UNICODE
 /**
  Indicate this compilation should generate the unicode form of @ref mini_tcschr.
@@ -190,8 +311,7 @@ TCHAR *
 MCRT_FN
 mini_tcschr(const TCHAR * str, TCHAR ch)
 {
-    const TCHAR * ptr = str;
-    while (*ptr != '\0' && *ptr != ch) ptr++;
+    const TCHAR * ptr = mini_tcsfind(str, ch);
     if (*ptr == ch) return (TCHAR *)ptr;
     return NULL;
 }
@@ -253,11 +373,7 @@ int
 MCRT_FN
 mini_tcslen(const TCHAR * str)
 {
-    int i = 0;
-    while (str[i] != '\0') {
-        i++;
-    }
-    return i;
+    return (int)(mini_tcsfind(str, '\0') - str);
 }
 
 #ifdef UNICODE
@@ -288,12 +404,24 @@ mini_tcsstr(const TCHAR * str, TCHAR * search)
 {
     const TCHAR * ptr = str;
     int i;
-    while (*ptr != '\0') {
-        for (i=0;ptr[i]==search[i]&&search[i]!='\0'&&ptr[i]!='\0';i++);
+
+    if (search[0] == '\0') {
+        if (*ptr == '\0') return NULL;
+        return (TCHAR*)ptr;
+    }
+
+    //
+    //  Skip to each occurrence of the first search character, then compare
+    //  the remainder.
+    //
+
+    while (TRUE) {
+        ptr = mini_tcsfind(ptr, search[0]);
+        if (*ptr == '\0') return NULL;
+        for (i=1;ptr[i]==search[i]&&search[i]!='\0';i++);
         if (search[i]=='\0') return (TCHAR*)ptr;
         ptr++;
     }
-    return NULL;
 }
 
 #ifdef UNICODE
@@ -381,6 +381,52 @@ int        MCRT_FN mini_wcslen(const wchar_t * str);
 #define    mini_tcslen          mini_strlen
 #endif
 
+#if defined(_MSC_VER) && (_MSC_VER >= 1400) && (defined(_M_AMD64) || defined(_M_IX86))
+/**
+ Indicate that SSE2 implementations of memory and string routines should be
+ compiled.  On x86 these are only used if the processor and operating system
+ support them.
+ */
+#define MCRT_SSE2 1
+
+int MCRT_FN mini_sse2_available(void);
+
+/**
+ Set to 1 if SSE2 can be used, 0 if it cannot, or -1 if this has not been
+ determined yet.  Setting this to 0 forces the word at a time
+ implementations to be used, which allows them to be benchmarked.
+ */
+extern int mini_sse2_state;
+#else
+/**
+ Indicate that SSE2 implementations of memory and string routines should not
+ be compiled.
+ */
+#define MCRT_SSE2 0
+#endif
+
+#ifdef MINICRT_BUILD
+
+#ifdef _WIN64
+/**
+ An unsigned integer which is the same size as a pointer.  Memory and string
+ routines operate on this size where the buffer alignment allows it.
+ */
+typedef unsigned __int64 MCRT_UINTPTR;
+#else
+/**
+ An unsigned integer which is the same size as a pointer.  Memory and string
+ routines operate on this size where the buffer alignment allows it.
+ */
+typedef unsigned long MCRT_UINTPTR;
+#endif
+
+#if MCRT_SSE2
+#include <emmintrin.h>
+#endif
+
+#endif // MINICRT_BUILD
+
 #ifndef MINICRT_BUILD
 
 //
@@ -987,6 +987,8 @@ ENTRYPOINT(
 
     YoriLibEnableBackupPrivilege();
 
+    YoriLibOutputBufferEnable(YORI_LIB_OUTPUT_STDOUT);
+
     //
     //  If no file name is specified, use *
     //
@@ -998,7 +1000,7 @@ ENTRYPOINT(
         MatchFlags |= YORILIB_FILEENUM_INCLUDE_DOTFILES;
     }
     if (DirContext.Recursive) {
-        MatchFlags |= YORILIB_FILEENUM_RECURSE_BEFORE_RETURN | YORILIB_FILEENUM_RECURSE_PRESERVE_WILD;
+        MatchFlags |= YORILIB_FILEENUM_RECURSE_BEFORE_RETURN | YORILIB_FILEENUM_RECURSE_PRESERVE_WILD | YORILIB_FILEENUM_PARALLEL_ORDERED;
     }
     if (BasicEnumeration) {
         MatchFlags |= YORILIB_FILEENUM_BASIC_EXPANSION;
@@ -1035,12 +1037,14 @@ ENTRYPOINT(
     }
 
     if (DirContext.FilesFound == 0 && DirContext.DirsFound == 0) {
+        YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("dir: no matching files found\n"));
         return EXIT_FAILURE;
     } else if (DirContext.Recursive) {
         DirOutputEndOfRecursiveSummary(&DirContext);
     }
 
+    YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
     return EXIT_SUCCESS;
 }
 
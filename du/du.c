@@ -35,8 +35,8 @@ CHAR strDuHelpText[] =
         "\n"
         "Display disk space used within directories.\n"
         "\n"
-        "DU [-license] [-a] [-b] [-c] [-color] [-d] [-h] [-r <num>] [-s <size>]\n"
-        "   [-w] [<spec>...]\n"
+        "DU [-license] [-a] [-b] [-c] [-color] [-d] [-h] [-l] [-r <num>]\n"
+        "   [-s <size>] [-u] [-w] [<spec>...]\n"
         "\n"
         "   -a             Enable all features for maximum accuracy\n"
         "   -b             Use basic search criteria for files only\n"
@@ -44,6 +44,7 @@ CHAR strDuHelpText[] =
         "   -color         Use file color highlighting\n"
         "   -d             Include space used by alternate data streams\n"
         "   -h             Average space used across multiple hard links\n"
+        "   -l             Count space used by multiple hard links once\n"
         "   -r <num>       The maximum recursion depth to display\n"
         "   -s <size>      Only display directories containing at least size bytes\n"
         "   -u             Round space up to file allocation unit or cluster size\n"
@@ -86,17 +87,47 @@ typedef struct _DU_WIN32_FIND_STREAM_DATA {
 } DU_WIN32_FIND_STREAM_DATA, *PDU_WIN32_FIND_STREAM_DATA;
 
 /**
- A structure describing a particular directory.  When traversing through
- files to calculate space, there will be one of these structures for each
- parent component of the file.
+ The number of independently locked portions of the set of hard linked
+ files.
  */
-typedef struct _DU_DIRECTORY_STACK {
+#define DU_HARDLINK_STRIPES         (64)
+
+/**
+ The number of slots initially allocated for each portion of the set of
+ hard linked files.
+ */
+#define DU_HARDLINK_INITIAL_SLOTS   (64)
+
+/**
+ A structure describing a particular directory.  Each thread accumulates
+ the space used by the files it finds into its own set of these structures,
+ and once enumeration is complete, the structures from each thread are
+ merged.
+ */
+typedef struct _DU_DIRECTORY {
+
+    /**
+     The entry for this directory on the list of directories found by a
+     thread, or on the list of merged directories.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry for this directory in the hash table of directories found by
+     a thread, or in the hash table of merged directories.
+     */
+    YORI_HASH_ENTRY HashEntry;
 
     /**
      The name of this directory, in escaped form.
      */
     YORI_STRING DirectoryName;
 
+    /**
+     The recursion depth of objects within this directory.
+     */
+    DWORD Depth;
+
     /**
      The number of files or directories encountered within this directory.
      */
@@ -109,8 +140,7 @@ typedef struct _DU_DIRECTORY_STACK {
 
     /**
      The amount of bytes consumed by subdirectories within this directory.
-     Note this is populated only when the subdirectories have completed
-     their enumerations.
+     Note this is populated only when all directories have been merged.
      */
     LONGLONG SpaceConsumedInChildren;
 
@@ -120,7 +150,90 @@ typedef struct _DU_DIRECTORY_STACK {
      enabled.
      */
     LONGLONG AllocationSize;
-} DU_DIRECTORY_STACK, *PDU_DIRECTORY_STACK;
+} DU_DIRECTORY, *PDU_DIRECTORY;
+
+/**
+ The directories found by a single thread.  This is only accessed by its
+ thread until enumeration is complete, so it requires no synchronization.
+ */
+typedef struct _DU_THREAD_STATE {
+
+    /**
+     The next thread state on the list of thread states.
+     */
+    struct _DU_THREAD_STATE *Next;
+
+    /**
+     The identifier of the thread which owns this state.
+     */
+    DWORD ThreadId;
+
+    /**
+     A hash table of directories found by this thread, keyed by name.
+     */
+    PYORI_HASH_TABLE Directories;
+
+    /**
+     A list of directories found by this thread.
+     */
+    YORI_LIST_ENTRY DirectoryList;
+
+    /**
+     The directory which most recently had a file added to it.  Since each
+     directory is enumerated by a single thread, consecutive files are
+     generally in the same directory, so this avoids a hash lookup.
+     */
+    PDU_DIRECTORY LastDirectory;
+} DU_THREAD_STATE, *PDU_THREAD_STATE;
+
+/**
+ A file which has been counted and which has more than one hard link.
+ */
+typedef struct _DU_HARDLINK_SLOT {
+
+    /**
+     The file index of the file within its volume.
+     */
+    DWORDLONG FileIndex;
+
+    /**
+     The serial number of the volume containing the file.
+     */
+    DWORD VolumeSerialNumber;
+
+    /**
+     TRUE if this slot is in use.
+     */
+    DWORD InUse;
+} DU_HARDLINK_SLOT, *PDU_HARDLINK_SLOT;
+
+/**
+ A portion of the set of hard linked files which have been counted.  Files
+ are assigned to a portion by their hash, and each portion has its own lock
+ so that threads rarely wait for each other.
+ */
+typedef struct _DU_HARDLINK_STRIPE {
+
+    /**
+     A mutex synchronizing access to this portion of the set.
+     */
+    HANDLE Mutex;
+
+    /**
+     The number of slots in use.
+     */
+    DWORD SlotsUsed;
+
+    /**
+     The number of slots allocated.  This is always a power of two.
+     */
+    DWORD SlotsAllocated;
+
+    /**
+     An open addressed array of slots.
+     */
+    PDU_HARDLINK_SLOT Slots;
+} DU_HARDLINK_STRIPE, *PDU_HARDLINK_STRIPE;
 
 /**
  Context passed to the callback which is invoked for each file found.
@@ -128,25 +241,33 @@ typedef struct _DU_DIRECTORY_STACK {
 typedef struct _DU_CONTEXT {
 
     /**
-     An array of directory components corresponding to the components within
-     the path currently being parsed.  File sizes are added to the leafmost
-     element (ie., StackIndex) and when a change to a parent component is
-     detected, size from the child component is propagated to the parent and
-     the child component is prepared for reuse by the next child directory.
+     A list of the state for each thread which has found files.  An
+     enumeration can use any number of threads, since each expansion of
+     an argument may use its own set.  Entries are fully populated under
+     ThreadStateMutex and then published by updating the head of the
+     list, so each thread can locate its own state without acquiring the
+     mutex.  Entries are only removed once enumeration is complete.
+     */
+    PDU_THREAD_STATE volatile ThreadStates;
+
+    /**
+     A mutex synchronizing the creation of new thread states.
      */
-    PDU_DIRECTORY_STACK DirStack;
+    HANDLE ThreadStateMutex;
 
     /**
-     Index of the last element in the directory stack that has been operated
-     on.
+     Set to TRUE if a thread could not record a file it found, which
+     terminates the enumeration, or if the results could not be reported.
+     The results are incomplete, so no further results are displayed and
+     the command fails.
      */
-    DWORD StackIndex;
+    volatile LONG RecordFailed;
 
     /**
-     The number of allocated elements in the DirStack array.  Will be zero
-     if the array has not been allocated yet.
+     The set of files with multiple hard links which have already been
+     counted.  Only used if CountHardLinksOnce is TRUE.
      */
-    DWORD StackAllocated;
+    DU_HARDLINK_STRIPE HardLinks[DU_HARDLINK_STRIPES];
 
     /**
      The maximum depth to display.  This is a user specified value allowing
@@ -170,6 +291,12 @@ typedef struct _DU_CONTEXT {
      */
     BOOL AverageHardLinkSize;
 
+    /**
+     Count the space used by a file with multiple hard links once, in the
+     first directory it is found in.
+     */
+    BOOL CountHardLinksOnce;
+
     /**
      Count space used by alternate data streams on the file.
      */
@@ -208,6 +335,72 @@ typedef struct _DU_CONTEXT {
 
 } DU_CONTEXT, *PDU_CONTEXT;
 
+/**
+ Free a directory structure.  The directory must not be in a hash table.
+
+ @param Directory Pointer to the directory to free.
+ */
+VOID
+DuFreeDirectory(
+    __in PDU_DIRECTORY Directory
+    )
+{
+    YoriLibFreeStringContents(&Directory->DirectoryName);
+    YoriLibFree(Directory);
+}
+
+/**
+ Free all directories in a list and the hash table containing them.
+
+ @param DirectoryList Pointer to the list of directories.
+
+ @param Directories Pointer to the hash table containing the directories.
+ */
+VOID
+DuFreeDirectories(
+    __in PYORI_LIST_ENTRY DirectoryList,
+    __in PYORI_HASH_TABLE Directories
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PDU_DIRECTORY Directory;
+
+    ListEntry = YoriLibGetNextListEntry(DirectoryList, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, DU_DIRECTORY, ListEntry);
+        YoriLibRemoveListItem(&Directory->ListEntry);
+        YoriLibHashRemoveByEntry(&Directory->HashEntry);
+        DuFreeDirectory(Directory);
+        ListEntry = YoriLibGetNextListEntry(DirectoryList, NULL);
+    }
+
+    YoriLibFreeEmptyHashTable(Directories);
+}
+
+/**
+ Free the directories found by every thread, and the thread states, so that
+ a subsequent enumeration starts with no thread states.
+
+ @param DuContext Pointer to the DuContext containing the thread states.
+ */
+VOID
+DuFreeThreadStates(
+    __in PDU_CONTEXT DuContext
+    )
+{
+    PDU_THREAD_STATE ThreadState;
+    PDU_THREAD_STATE NextThreadState;
+
+    ThreadState = DuContext->ThreadStates;
+    DuContext->ThreadStates = NULL;
+    while (ThreadState != NULL) {
+        NextThreadState = ThreadState->Next;
+        DuFreeDirectories(&ThreadState->DirectoryList, ThreadState->Directories);
+        YoriLibFree(ThreadState);
+        ThreadState = NextThreadState;
+    }
+}
+
 /**
  Deallocate all child allocations within a DU_CONTEXT structure.  The
  structure itself is typically stack allocated and will not be freed.
@@ -221,56 +414,264 @@ DuCleanupContext(
 {
     DWORD Index;
 
-    for (Index = 0; Index < DuContext->StackAllocated; Index++) {
-        YoriLibFreeStringContents(&DuContext->DirStack[Index].DirectoryName);
+    DuFreeThreadStates(DuContext);
+
+    for (Index = 0; Index < DU_HARDLINK_STRIPES; Index++) {
+        if (DuContext->HardLinks[Index].Slots != NULL) {
+            YoriLibFree(DuContext->HardLinks[Index].Slots);
+            DuContext->HardLinks[Index].Slots = NULL;
+        }
+        if (DuContext->HardLinks[Index].Mutex != NULL) {
+            CloseHandle(DuContext->HardLinks[Index].Mutex);
+            DuContext->HardLinks[Index].Mutex = NULL;
+        }
     }
 
-    if (DuContext->DirStack != NULL) {
-        YoriLibFree(DuContext->DirStack);
-        DuContext->DirStack = NULL;
+    if (DuContext->ThreadStateMutex != NULL) {
+        CloseHandle(DuContext->ThreadStateMutex);
+        DuContext->ThreadStateMutex = NULL;
     }
 
-    DuContext->StackAllocated = 0;
-    DuContext->StackIndex = 0;
     YoriLibFileFiltFreeFilter(&DuContext->ColorRules);
 }
 
 /**
- Clear the contents of a directory frame so it can be reused.
+ Prepare the synchronization objects within a DU_CONTEXT structure.
+
+ @param DuContext Pointer to the DuContext to initialize.
 
- @param DirStack Pointer to the directory frame to clear.
+ @return TRUE to indicate success, FALSE to indicate failure.
  */
-VOID
-DuCloseStack(
-    __in PDU_DIRECTORY_STACK DirStack
+BOOL
+DuInitializeContext(
+    __in PDU_CONTEXT DuContext
+    )
+{
+    DWORD Index;
+
+    DuContext->ThreadStateMutex = CreateMutex(NULL, FALSE, NULL);
+    if (DuContext->ThreadStateMutex == NULL) {
+        return FALSE;
+    }
+
+    if (DuContext->CountHardLinksOnce) {
+        for (Index = 0; Index < DU_HARDLINK_STRIPES; Index++) {
+            DuContext->HardLinks[Index].Mutex = CreateMutex(NULL, FALSE, NULL);
+            if (DuContext->HardLinks[Index].Mutex == NULL) {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Add a file to the set of hard linked files which have been counted.
+
+ @param DuContext Pointer to the DuContext containing the set.
+
+ @param HandleFileInfo Pointer to information about the file, including its
+        volume serial number and file index.
+
+ @return TRUE if the file was added, FALSE if the file had already been
+         counted.  If memory cannot be allocated, this function returns TRUE
+         so that the file is counted.
+ */
+BOOL
+DuAddHardLink(
+    __in PDU_CONTEXT DuContext,
+    __in PBY_HANDLE_FILE_INFORMATION HandleFileInfo
+    )
+{
+    PDU_HARDLINK_STRIPE Stripe;
+    PDU_HARDLINK_SLOT NewSlots;
+    PDU_HARDLINK_SLOT Slot;
+    DWORDLONG FileIndex;
+    DWORD Hash;
+    DWORD Index;
+    DWORD NewSlotsAllocated;
+
+    FileIndex = (((DWORDLONG)HandleFileInfo->nFileIndexHigh) << 32) | HandleFileInfo->nFileIndexLow;
+
+    Hash = HandleFileInfo->nFileIndexLow * 0x9E3779B1;
+    Hash = Hash ^ (HandleFileInfo->nFileIndexHigh * 0x85EBCA6B);
+    Hash = Hash ^ (HandleFileInfo->dwVolumeSerialNumber * 0xC2B2AE35);
+    Hash = Hash ^ (Hash >> 15);
+
+    Stripe = &DuContext->HardLinks[Hash % DU_HARDLINK_STRIPES];
+    Hash = Hash / DU_HARDLINK_STRIPES;
+
+    WaitForSingleObject(Stripe->Mutex, INFINITE);
+
+    //
+    //  Keep the table no more than half full.  When growing, move every
+    //  existing entry to its position in the new table.
+    //
+
+    if ((Stripe->SlotsUsed + 1) * 2 > Stripe->SlotsAllocated) {
+        NewSlotsAllocated = Stripe->SlotsAllocated * 2;
+        if (NewSlotsAllocated == 0) {
+            NewSlotsAllocated = DU_HARDLINK_INITIAL_SLOTS;
+        }
+        NewSlots = YoriLibMalloc(NewSlotsAllocated * sizeof(DU_HARDLINK_SLOT));
+        if (NewSlots == NULL) {
+            ReleaseMutex(Stripe->Mutex);
+            return TRUE;
+        }
+        ZeroMemory(NewSlots, NewSlotsAllocated * sizeof(DU_HARDLINK_SLOT));
+
+        for (Index = 0; Index < Stripe->SlotsAllocated; Index++) {
+            DWORD NewIndex;
+            DWORD ExistingHash;
+            Slot = &Stripe->Slots[Index];
+            if (!Slot->InUse) {
+                continue;
+            }
+            ExistingHash = ((DWORD)Slot->FileIndex) * 0x9E3779B1;
+            ExistingHash = ExistingHash ^ ((DWORD)(Slot->FileIndex >> 32) * 0x85EBCA6B);
+            ExistingHash = ExistingHash ^ (Slot->VolumeSerialNumber * 0xC2B2AE35);
+            ExistingHash = ExistingHash ^ (ExistingHash >> 15);
+            ExistingHash = ExistingHash / DU_HARDLINK_STRIPES;
+            NewIndex = ExistingHash & (NewSlotsAllocated - 1);
+            while (NewSlots[NewIndex].InUse) {
+                NewIndex = (NewIndex + 1) & (NewSlotsAllocated - 1);
+            }
+            NewSlots[NewIndex] = *Slot;
+        }
+
+        if (Stripe->Slots != NULL) {
+            YoriLibFree(Stripe->Slots);
+        }
+        Stripe->Slots = NewSlots;
+        Stripe->SlotsAllocated = NewSlotsAllocated;
+    }
+
+    Index = Hash & (Stripe->SlotsAllocated - 1);
+    while (TRUE) {
+        Slot = &Stripe->Slots[Index];
+        if (!Slot->InUse) {
+            Slot->FileIndex = FileIndex;
+            Slot->VolumeSerialNumber = HandleFileInfo->dwVolumeSerialNumber;
+            Slot->InUse = TRUE;
+            Stripe->SlotsUsed++;
+            ReleaseMutex(Stripe->Mutex);
+            return TRUE;
+        }
+        if (Slot->FileIndex == FileIndex &&
+            Slot->VolumeSerialNumber == HandleFileInfo->dwVolumeSerialNumber) {
+
+            ReleaseMutex(Stripe->Mutex);
+            return FALSE;
+        }
+        Index = (Index + 1) & (Stripe->SlotsAllocated - 1);
+    }
+}
+
+/**
+ Find the state for the calling thread, creating it if this is the first
+ file found by the thread.
+
+ @param DuContext Pointer to the DuContext containing thread states.
+
+ @return Pointer to the thread's state, or NULL on failure.
+ */
+PDU_THREAD_STATE
+DuGetThreadState(
+    __in PDU_CONTEXT DuContext
     )
 {
+    PDU_THREAD_STATE ThreadState;
+    DWORD ThreadId;
+
     //
-    //  Note the DirectoryName string remains allocated in the hope that the
-    //  next directory can use it.
+    //  A thread identifier can be reused once its thread has terminated.
+    //  If that happens, the new thread continues to use the state of the
+    //  earlier one, which is harmless since they can't run concurrently.
     //
 
-    DirStack->DirectoryName.LengthInChars = 0;
-    DirStack->ObjectsFoundThisDirectory = 0;
-    DirStack->SpaceConsumedThisDirectory = 0;
-    DirStack->SpaceConsumedInChildren = 0;
+    ThreadId = GetCurrentThreadId();
+    ThreadState = DuContext->ThreadStates;
+    while (ThreadState != NULL) {
+        if (ThreadState->ThreadId == ThreadId) {
+            return ThreadState;
+        }
+        ThreadState = ThreadState->Next;
+    }
+
+    ThreadState = YoriLibMalloc(sizeof(DU_THREAD_STATE));
+    if (ThreadState == NULL) {
+        return NULL;
+    }
+
+    ThreadState->Directories = YoriLibAllocateHashTable(256);
+    if (ThreadState->Directories == NULL) {
+        YoriLibFree(ThreadState);
+        return NULL;
+    }
+    ThreadState->ThreadId = ThreadId;
+    ThreadState->LastDirectory = NULL;
+    YoriLibInitializeListHead(&ThreadState->DirectoryList);
+
+    WaitForSingleObject(DuContext->ThreadStateMutex, INFINITE);
+    ThreadState->Next = DuContext->ThreadStates;
+    DuContext->ThreadStates = ThreadState;
+    ReleaseMutex(DuContext->ThreadStateMutex);
+
+    return ThreadState;
 }
 
 /**
- Print the space consumed by a particular directory, and close out the
- directory's stack frame so it can be reused by the next directory.
+ Find the parent directory of a path.  The parent of a file in the root of
+ a drive retains the trailing seperator.
+
+ @param Path Pointer to the path.
 
- @param DuContext Pointer to the DuContext which contains the directory to
-        display and close.
+ @param Parent On successful completion, updated to point to the parent
+        portion of Path.  This is not a new allocation.
+
+ @return TRUE to indicate success, FALSE if the path has no parent.
+ */
+__success(return)
+BOOL
+DuGetParentDirectoryName(
+    __in PYORI_STRING Path,
+    __out PYORI_STRING Parent
+    )
+{
+    LPTSTR FilePart;
 
- @param Depth Specifies the array index of the directory to display and close.
+    FilePart = YoriLibFindRightMostCharacter(Path, '\\');
+    if (FilePart == NULL) {
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(Parent);
+    Parent->StartOfString = Path->StartOfString;
+    Parent->LengthInChars = (DWORD)(FilePart - Path->StartOfString);
+    if (Parent->LengthInChars == 6) {
+        Parent->LengthInChars++;
+        if (!YoriLibIsPrefixedDriveLetterWithColonAndSlash(Parent)) {
+            Parent->LengthInChars--;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Print the space consumed by a particular directory.
+
+ @param DuContext Pointer to the DuContext specifying display options.
+
+ @param Directory Pointer to the directory to display.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
-DuReportAndCloseStack(
+DuReportDirectory(
     __in PDU_CONTEXT DuContext,
-    __in DWORD Depth
+    __in PDU_DIRECTORY Directory
     )
 {
     YORI_STRING UnescapedPath;
@@ -282,14 +683,10 @@ DuReportAndCloseStack(
     TCHAR VtAttributeBuffer[YORI_MAX_INTERNAL_VT_ESCAPE_CHARS];
     YORILIB_COLOR_ATTRIBUTES Attribute;
 
-    PDU_DIRECTORY_STACK DirStack;
-
-    DirStack = &DuContext->DirStack[Depth];
-
     if (DuContext->MaximumDepthToDisplay == 0 ||
-        Depth <= DuContext->MaximumDepthToDisplay) {
+        Directory->Depth <= DuContext->MaximumDepthToDisplay) {
 
-        SizeToDisplay.QuadPart = DirStack->SpaceConsumedInChildren + DirStack->SpaceConsumedThisDirectory;
+        SizeToDisplay.QuadPart = Directory->SpaceConsumedInChildren + Directory->SpaceConsumedThisDirectory;
 
         if (DuContext->MinimumDirectorySizeToDisplay.QuadPart == 0 ||
             SizeToDisplay.QuadPart >= DuContext->MinimumDirectorySizeToDisplay.QuadPart) {
@@ -299,10 +696,10 @@ DuReportAndCloseStack(
             //
 
             YoriLibInitEmptyString(&UnescapedPath);
-            if (YoriLibUnescapePath(&DirStack->DirectoryName, &UnescapedPath)) {
+            if (YoriLibUnescapePath(&Directory->DirectoryName, &UnescapedPath)) {
                 StringToDisplay = &UnescapedPath;
             } else {
-                StringToDisplay = &DirStack->DirectoryName;
+                StringToDisplay = &Directory->DirectoryName;
             }
 
             //
@@ -326,9 +723,9 @@ DuReportAndCloseStack(
                 VtAttribute.StartOfString = VtAttributeBuffer;
                 VtAttribute.LengthAllocated = sizeof(VtAttributeBuffer)/sizeof(VtAttributeBuffer[0]);
         
-                YoriLibUpdateFindDataFromFileInformation(&FileInfo, DirStack->DirectoryName.StartOfString, TRUE);
+                YoriLibUpdateFindDataFromFileInformation(&FileInfo, Directory->DirectoryName.StartOfString, TRUE);
         
-                if (!YoriLibFileFiltCheckColorMatch(&DuContext->ColorRules, &DirStack->DirectoryName, &FileInfo, &Attribute)) {
+                if (!YoriLibFileFiltCheckColorMatch(&DuContext->ColorRules, &Directory->DirectoryName, &FileInfo, &Attribute)) {
                     Attribute.Ctrl = YORILIB_ATTRCTRL_WINDOW_BG | YORILIB_ATTRCTRL_WINDOW_FG;
                     Attribute.Win32Attr = (UCHAR)YoriLibVtGetDefaultColor();
                 }
@@ -353,87 +750,233 @@ DuReportAndCloseStack(
         }
     }
 
-    DuCloseStack(DirStack);
     return TRUE;
 }
 
 /**
- Display all directory frames which have not been otherwise displayed because
- no object has been found in a subsequent directory.
+ Compare two directories to determine the order they should be displayed
+ in.  A directory is displayed after all of its subdirectories, which is
+ achieved by treating the end of a path as greater than any character and
+ a seperator as less than any other character.
+
+ @param Left Pointer to the first directory to compare.
+
+ @param Right Pointer to the second directory to compare.
 
- @param DuContext Pointer to the DuContext which may contain active directory
-        frames.
+ @param Context Unused.
+
+ @return YORI_LIB_LESS_THAN, YORI_LIB_EQUAL or YORI_LIB_GREATER_THAN.
+ */
+DWORD
+DuCompareDirectoriesForDisplay(
+    __in PVOID Left,
+    __in PVOID Right,
+    __in PVOID Context
+    )
+{
+    PYORI_STRING LeftName = &((PDU_DIRECTORY)Left)->DirectoryName;
+    PYORI_STRING RightName = &((PDU_DIRECTORY)Right)->DirectoryName;
+    TCHAR LeftChar;
+    TCHAR RightChar;
+    DWORD Index;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    for (Index = 0; TRUE; Index++) {
+        if (Index == LeftName->LengthInChars) {
+            if (Index == RightName->LengthInChars) {
+                return YORI_LIB_EQUAL;
+            }
+            return YORI_LIB_GREATER_THAN;
+        }
+        if (Index == RightName->LengthInChars) {
+            return YORI_LIB_LESS_THAN;
+        }
+
+        LeftChar = YoriLibUpcaseChar(LeftName->StartOfString[Index]);
+        RightChar = YoriLibUpcaseChar(RightName->StartOfString[Index]);
+        if (LeftChar == RightChar) {
+            continue;
+        }
+        if (LeftChar == '\\') {
+            return YORI_LIB_LESS_THAN;
+        }
+        if (RightChar == '\\') {
+            return YORI_LIB_GREATER_THAN;
+        }
+        if (LeftChar < RightChar) {
+            return YORI_LIB_LESS_THAN;
+        }
+        return YORI_LIB_GREATER_THAN;
+    }
+}
+
+/**
+ Merge the directories found by each thread, add the space used by each
+ directory to its parent, and display each directory.  Directories at a
+ depth less than MinDepthToDisplay are not displayed.
+
+ @param DuContext Pointer to the DuContext containing the directories found
+        by each thread.
 
  @param MinDepthToDisplay Indicates the minimum depth number that should be
-        displayed to the user.  Frames below this are cleared for reuse but
-        not displayed.
+        displayed to the user.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
-DuReportAndCloseAllActiveStacks(
+DuReportAllDirectories(
     __in PDU_CONTEXT DuContext,
     __in DWORD MinDepthToDisplay
     )
 {
+    PYORI_HASH_TABLE Merged;
+    YORI_LIST_ENTRY MergedList;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_HASH_ENTRY HashEntry;
+    PDU_THREAD_STATE ThreadState;
+    PDU_DIRECTORY Directory;
+    PDU_DIRECTORY Existing;
+    PYORI_LIB_SORT_ENTRY SortEntries;
+    YORI_STRING ParentName;
+    DWORD DirectoryCount;
     DWORD Index;
-    Index = DuContext->StackIndex;
-    if (Index >= DuContext->StackAllocated) {
-        ASSERT(Index == 0);
-        ASSERT(DuContext->DirStack == NULL);
-        return TRUE;
+    BOOL Result;
+
+    Merged = YoriLibAllocateHashTable(1024);
+    if (Merged == NULL) {
+        DuFreeThreadStates(DuContext);
+        return FALSE;
     }
-    while (TRUE) {
-        if (Index > 0) {
-            DuContext->DirStack[Index - 1].SpaceConsumedInChildren += DuContext->DirStack[Index].SpaceConsumedInChildren + DuContext->DirStack[Index].SpaceConsumedThisDirectory;
-        }
-        if (Index >= MinDepthToDisplay) {
-            DuReportAndCloseStack(DuContext, Index);
-        } else {
-            DuCloseStack(&DuContext->DirStack[Index]);
+
+    //
+    //  Move each directory from the thread which found it into a single
+    //  table.  A directory found by more than one thread has its totals
+    //  added together.
+    //
+
+    YoriLibInitializeListHead(&MergedList);
+    DirectoryCount = 0;
+    for (ThreadState = DuContext->ThreadStates; ThreadState != NULL; ThreadState = ThreadState->Next) {
+        ListEntry = YoriLibGetNextListEntry(&ThreadState->DirectoryList, NULL);
+        while (ListEntry != NULL) {
+            Directory = CONTAINING_RECORD(ListEntry, DU_DIRECTORY, ListEntry);
+            YoriLibRemoveListItem(&Directory->ListEntry);
+            YoriLibHashRemoveByEntry(&Directory->HashEntry);
+
+            HashEntry = YoriLibHashLookupByKey(Merged, &Directory->DirectoryName);
+            if (HashEntry != NULL) {
+                Existing = (PDU_DIRECTORY)HashEntry->Context;
+                Existing->ObjectsFoundThisDirectory += Directory->ObjectsFoundThisDirectory;
+                Existing->SpaceConsumedThisDirectory += Directory->SpaceConsumedThisDirectory;
+                DuFreeDirectory(Directory);
+            } else {
+                YoriLibHashInsertByKey(Merged, &Directory->DirectoryName, Directory, &Directory->HashEntry);
+                YoriLibAppendList(&MergedList, &Directory->ListEntry);
+                DirectoryCount++;
+            }
+            ListEntry = YoriLibGetNextListEntry(&ThreadState->DirectoryList, NULL);
         }
-        if (Index == 0) {
-            break;
+    }
+
+    DuFreeThreadStates(DuContext);
+
+    if (DirectoryCount == 0) {
+        YoriLibFreeEmptyHashTable(Merged);
+        return TRUE;
+    }
+
+    SortEntries = YoriLibMalloc(DirectoryCount * sizeof(YORI_LIB_SORT_ENTRY));
+    if (SortEntries == NULL) {
+        DuFreeDirectories(&MergedList, Merged);
+        return FALSE;
+    }
+
+    Index = 0;
+    ListEntry = YoriLibGetNextListEntry(&MergedList, NULL);
+    while (ListEntry != NULL) {
+        SortEntries[Index].Key = 0;
+        SortEntries[Index].Item = CONTAINING_RECORD(ListEntry, DU_DIRECTORY, ListEntry);
+        Index++;
+        ListEntry = YoriLibGetNextListEntry(&MergedList, ListEntry);
+    }
+
+    Result = YoriLibSortEntries(SortEntries, DirectoryCount, DuCompareDirectoriesForDisplay, NULL);
+
+    //
+    //  Since every subdirectory is sorted before its parent, by the time a
+    //  directory is reached its total is complete, so it can be displayed
+    //  and added to its parent.
+    //
+
+    if (Result) {
+        for (Index = 0; Index < DirectoryCount; Index++) {
+            Directory = (PDU_DIRECTORY)SortEntries[Index].Item;
+            if (Directory->Depth > 0 &&
+                DuGetParentDirectoryName(&Directory->DirectoryName, &ParentName) &&
+                ParentName.LengthInChars < Directory->DirectoryName.LengthInChars) {
+
+                HashEntry = YoriLibHashLookupByKey(Merged, &ParentName);
+                if (HashEntry != NULL) {
+                    Existing = (PDU_DIRECTORY)HashEntry->Context;
+                    Existing->SpaceConsumedInChildren += Directory->SpaceConsumedInChildren + Directory->SpaceConsumedThisDirectory;
+                }
+            }
+
+            if (Directory->Depth >= MinDepthToDisplay) {
+                DuReportDirectory(DuContext, Directory);
+            }
         }
-        Index--;
-        DuContext->StackIndex--;
     }
-    return TRUE;
+
+    YoriLibFree(SortEntries);
+    DuFreeDirectories(&MergedList, Merged);
+    return Result;
 }
 
 /**
- Initialize a single directory stack location.
+ Allocate a structure describing a directory found by a thread.
 
  @param DuContext Pointer to the DU context specifying the options to apply.
 
- @param DirStack Pointer to the directory stack location to initialize.
+ @param ThreadState Pointer to the state of the thread which found the
+        directory.
 
- @param DirName Pointer to the directory name to initialize in the stack.
+ @param DirName Pointer to the directory name.
 
- @return TRUE to indicate success, FALSE to indicate failure.
+ @param Depth The recursion depth of objects within the directory.
+
+ @return Pointer to the new directory, or NULL on failure.
  */
-BOOL
-DuInitializeDirectoryStack(
+PDU_DIRECTORY
+DuAllocateDirectory(
     __in PDU_CONTEXT DuContext,
-    __in PDU_DIRECTORY_STACK DirStack,
-    __in PYORI_STRING DirName
+    __in PDU_THREAD_STATE ThreadState,
+    __in PYORI_STRING DirName,
+    __in DWORD Depth
     )
 {
+    PDU_DIRECTORY Directory;
     DWORD SectorsPerCluster;
     DWORD BytesPerSector;
     DWORD NumberOfFreeClusters;
     DWORD TotalNumberOfClusters;
 
-    if (DirStack->DirectoryName.LengthAllocated <= DirName->LengthInChars) {
-        YoriLibFreeStringContents(&DirStack->DirectoryName);
-        if (!YoriLibAllocateString(&DirStack->DirectoryName, DirName->LengthInChars + 80)) {
-            return FALSE;
-        }
+    Directory = YoriLibMalloc(sizeof(DU_DIRECTORY));
+    if (Directory == NULL) {
+        return NULL;
     }
 
-    memcpy(DirStack->DirectoryName.StartOfString, DirName->StartOfString, DirName->LengthInChars * sizeof(TCHAR));
-    DirStack->DirectoryName.StartOfString[DirName->LengthInChars] = '\0';
-    DirStack->DirectoryName.LengthInChars = DirName->LengthInChars;
+    ZeroMemory(Directory, sizeof(DU_DIRECTORY));
+    if (!YoriLibAllocateString(&Directory->DirectoryName, DirName->LengthInChars + 1)) {
+        YoriLibFree(Directory);
+        return NULL;
+    }
+
+    memcpy(Directory->DirectoryName.StartOfString, DirName->StartOfString, DirName->LengthInChars * sizeof(TCHAR));
+    Directory->DirectoryName.StartOfString[DirName->LengthInChars] = '\0';
+    Directory->DirectoryName.LengthInChars = DirName->LengthInChars;
+    Directory->Depth = Depth;
 
     //
     //  If GetDiskFreeSpace fails, see if it works on the effective root.
@@ -442,31 +985,34 @@ DuInitializeDirectoryStack(
     //
 
     if (DuContext->AllocationSize) {
-        if (!GetDiskFreeSpace(DirStack->DirectoryName.StartOfString, &SectorsPerCluster, &BytesPerSector, &NumberOfFreeClusters, &TotalNumberOfClusters)) {
+        if (!GetDiskFreeSpace(Directory->DirectoryName.StartOfString, &SectorsPerCluster, &BytesPerSector, &NumberOfFreeClusters, &TotalNumberOfClusters)) {
             YORI_STRING EffectiveRoot;
 
-            DirStack->AllocationSize = 4096;
+            Directory->AllocationSize = 4096;
 
-            if (YoriLibFindEffectiveRoot(&DirStack->DirectoryName, &EffectiveRoot) &&
-                EffectiveRoot.LengthInChars < DirStack->DirectoryName.LengthInChars) {
+            if (YoriLibFindEffectiveRoot(&Directory->DirectoryName, &EffectiveRoot) &&
+                EffectiveRoot.LengthInChars < Directory->DirectoryName.LengthInChars) {
 
                 TCHAR SavedChar;
                 SavedChar = EffectiveRoot.StartOfString[EffectiveRoot.LengthInChars];
                 EffectiveRoot.StartOfString[EffectiveRoot.LengthInChars] = '\0';
 
                 if (GetDiskFreeSpace(EffectiveRoot.StartOfString, &SectorsPerCluster, &BytesPerSector, &NumberOfFreeClusters, &TotalNumberOfClusters)) {
-                    DirStack->AllocationSize = SectorsPerCluster * BytesPerSector;
+                    Directory->AllocationSize = SectorsPerCluster * BytesPerSector;
                 }
 
                 EffectiveRoot.StartOfString[EffectiveRoot.LengthInChars] = SavedChar;
             }
 
         } else {
-            DirStack->AllocationSize = SectorsPerCluster * BytesPerSector;
+            Directory->AllocationSize = SectorsPerCluster * BytesPerSector;
         }
     }
 
-    return TRUE;
+    YoriLibHashInsertByKey(ThreadState->Directories, &Directory->DirectoryName, Directory, &Directory->HashEntry);
+    YoriLibAppendList(&ThreadState->DirectoryList, &Directory->ListEntry);
+
+    return Directory;
 }
 
 /**
@@ -475,7 +1021,7 @@ DuInitializeDirectoryStack(
 
  @param DuContext Context specifying the accounting options to apply.
 
- @param DirStack Pointer to the directory stack indicating the allocation size
+ @param Directory Pointer to the directory indicating the allocation size
         used for the directory.
 
  @param FilePath Pointer to a fully specified path to the file.
@@ -488,7 +1034,7 @@ DuInitializeDirectoryStack(
 LARGE_INTEGER
 DuCalculateSpaceUsedByFile(
     __in PDU_CONTEXT DuContext,
-    __in PDU_DIRECTORY_STACK DirStack,
+    __in PDU_DIRECTORY Directory,
     __in PYORI_STRING FilePath,
     __in PWIN32_FIND_DATA FileInfo
     )
@@ -500,7 +1046,9 @@ DuCalculateSpaceUsedByFile(
 
     FileSize.QuadPart = 0;
 
-    if (DuContext->AverageHardLinkSize || DuContext->WimBackedFilesAsZero) {
+    if (DuContext->AverageHardLinkSize ||
+        DuContext->CountHardLinksOnce ||
+        DuContext->WimBackedFilesAsZero) {
 
         FileHandle = CreateFile(FilePath->StartOfString,
                                 FILE_READ_ATTRIBUTES|SYNCHRONIZE,
@@ -518,6 +1066,23 @@ DuCalculateSpaceUsedByFile(
         }
     }
 
+    //
+    //  If each hard linked file should only be counted once, check whether
+    //  it has been counted already.  If so, it consumes no additional space.
+    //
+
+    if (DuContext->CountHardLinksOnce && FileHandle != INVALID_HANDLE_VALUE) {
+        BY_HANDLE_FILE_INFORMATION HandleFileInfo;
+
+        if (GetFileInformationByHandle(FileHandle, &HandleFileInfo) &&
+            HandleFileInfo.nNumberOfLinks > 1 &&
+            !DuAddHardLink(DuContext, &HandleFileInfo)) {
+
+            CloseHandle(FileHandle);
+            return FileSize;
+        }
+    }
+
     //
     //  If the file is WIM backed and the user requested it, count the default
     //  stream size as zero.
@@ -567,7 +1132,7 @@ DuCalculateSpaceUsedByFile(
     //
 
     if (DuContext->AllocationSize) {
-        FileSize.QuadPart = (FileSize.QuadPart + DirStack->AllocationSize - 1) & (~(DirStack->AllocationSize - 1));
+        FileSize.QuadPart = (FileSize.QuadPart + Directory->AllocationSize - 1) & (~(Directory->AllocationSize - 1));
     }
 
     //
@@ -596,7 +1161,7 @@ DuCalculateSpaceUsedByFile(
                 if (_tcscmp(FindStreamData.cStreamName, L"::$DATA") != 0) {
                     FileSize.QuadPart += FindStreamData.StreamSize.QuadPart;
                     if (DuContext->AllocationSize) {
-                        FileSize.QuadPart = (FileSize.QuadPart + DirStack->AllocationSize - 1) & (~(DirStack->AllocationSize - 1));
+                        FileSize.QuadPart = (FileSize.QuadPart + Directory->AllocationSize - 1) & (~(Directory->AllocationSize - 1));
                     }
                 }
             } while (DllKernel32.pFindNextStreamW(hFind, &FindStreamData));
@@ -606,10 +1171,14 @@ DuCalculateSpaceUsedByFile(
 
     //
     //  If the file has a size and hardlink averaging is reuqested, divide the
-    //  size found by the number of hard links.
+    //  size found by the number of hard links.  This is not needed if each
+    //  hard linked file is only counted once.
     //
 
-    if (DuContext->AverageHardLinkSize && FileHandle != INVALID_HANDLE_VALUE && FileSize.QuadPart != 0) {
+    if (DuContext->AverageHardLinkSize &&
+        !DuContext->CountHardLinksOnce &&
+        FileHandle != INVALID_HANDLE_VALUE &&
+        FileSize.QuadPart != 0) {
         BY_HANDLE_FILE_INFORMATION HandleFileInfo;
 
         if (GetFileInformationByHandle(FileHandle, &HandleFileInfo)) {
@@ -628,16 +1197,17 @@ DuCalculateSpaceUsedByFile(
 }
 
 
-
 /**
  A callback that is invoked when a file is found that matches a search criteria
- specified in the set of strings to enumerate.
+ specified in the set of strings to enumerate.  This is invoked concurrently
+ from multiple threads, and the space used by the file is added to the
+ calling thread's total for the directory containing it.
 
  @param FilePath Pointer to the file path that was found.
 
  @param FileInfo Information about the file.
 
- @param Depth Recursion depth, ignored in this application.
+ @param Depth Recursion depth.
 
  @param Context Pointer to the du context structure indicating the
         action to perform and populated with the number of objects found.
@@ -653,115 +1223,45 @@ DuFileFoundCallback(
     )
 {
     PDU_CONTEXT DuContext = (PDU_CONTEXT)Context;
-    LPTSTR FilePart;
-    DWORD Index;
-
-    if (Depth >= DuContext->StackAllocated) {
-        PDU_DIRECTORY_STACK NewStack;
-        NewStack = YoriLibMalloc((Depth + 8) * sizeof(DU_DIRECTORY_STACK));
-        if (NewStack == NULL) {
-            return FALSE;
-        }
-
-        if (DuContext->StackAllocated > 0) {
-            memcpy(NewStack, DuContext->DirStack, DuContext->StackAllocated * sizeof(DU_DIRECTORY_STACK));
-            YoriLibFree(DuContext->DirStack);
-        }
-
-        for (Index = DuContext->StackAllocated; Index < Depth + 8; Index++) {
-            YoriLibInitEmptyString(&NewStack[Index].DirectoryName);
-            NewStack[Index].ObjectsFoundThisDirectory = 0;
-            NewStack[Index].SpaceConsumedThisDirectory = 0;
-            NewStack[Index].SpaceConsumedInChildren = 0;
-        }
-
-        DuContext->DirStack = NewStack;
-        DuContext->StackAllocated = Depth + 8;
+    PDU_THREAD_STATE ThreadState;
+    PDU_DIRECTORY Directory;
+    PYORI_HASH_ENTRY HashEntry;
+    YORI_STRING ThisDirName;
+
+    ThreadState = DuGetThreadState(DuContext);
+    if (ThreadState == NULL) {
+        InterlockedExchange(&DuContext->RecordFailed, TRUE);
+        return FALSE;
     }
 
-    //
-    //  StackIndex would normally be populated except for the first item at
-    //  Depth == 0
-    //
-
-    if (DuContext->StackIndex > 0 || DuContext->DirStack[0].DirectoryName.LengthInChars > 0) {
-        Index = DuContext->StackIndex;
-        while (TRUE) {
-            DWORD StackDirLength;
-            StackDirLength = DuContext->DirStack[Index].DirectoryName.LengthInChars;
-            if (Depth >= Index &&
-                YoriLibCompareStringCount(FilePath, &DuContext->DirStack[Index].DirectoryName, StackDirLength) == 0 &&
-                (FilePath->LengthInChars == StackDirLength ||
-                 YoriLibIsSep(FilePath->StartOfString[StackDirLength]) ||
-                 YoriLibIsSep(DuContext->DirStack[Index].DirectoryName.StartOfString[StackDirLength - 1]))) {
-
-                break;
-            }
-
-            // YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("Reporting because file %y (depth %i) not in directory %y (depth %i)\n"), FilePath, Depth, &DuContext->DirStack[Index].DirectoryName, Index);
-            if (Index > 0) {
-                DuContext->DirStack[Index - 1].SpaceConsumedInChildren += DuContext->DirStack[Index].SpaceConsumedInChildren + DuContext->DirStack[Index].SpaceConsumedThisDirectory;
-            }
-            DuReportAndCloseStack(DuContext, Index);
-            if (Index == 0) {
-                break;
-            }
-            Index--;
-            DuContext->StackIndex--;
-        }
-    }
-
-    FilePart = YoriLibFindRightMostCharacter(FilePath, '\\');
-    ASSERT(FilePart != NULL);
-    if (FilePart != NULL) {
-        YORI_STRING ThisDirName;
-        YoriLibInitEmptyString(&ThisDirName);
-        ThisDirName.StartOfString = FilePath->StartOfString;
-        ThisDirName.LengthInChars = (DWORD)(FilePart - FilePath->StartOfString);
-        if (ThisDirName.LengthInChars == 6) {
-            ThisDirName.LengthInChars++;
-            if (!YoriLibIsPrefixedDriveLetterWithColonAndSlash(&ThisDirName)) {
-                ThisDirName.LengthInChars--;
-            }
-        }
+    if (!DuGetParentDirectoryName(FilePath, &ThisDirName)) {
+        ASSERT(FALSE);
+        return TRUE;
+    }
 
-        Index = Depth;
-        while (TRUE) {
-            if (DuContext->DirStack[Index].DirectoryName.LengthInChars > 0) {
+    Directory = ThreadState->LastDirectory;
+    if (Directory == NULL ||
+        YoriLibCompareString(&Directory->DirectoryName, &ThisDirName) != 0) {
 
-                ASSERT(Index == DuContext->StackIndex);
-                ASSERT(YoriLibCompareString(&DuContext->DirStack[Index].DirectoryName, &ThisDirName) == 0);
-                break;
-            }
-            if (!DuInitializeDirectoryStack(DuContext, &DuContext->DirStack[Index], &ThisDirName)) {
+        HashEntry = YoriLibHashLookupByKey(ThreadState->Directories, &ThisDirName);
+        if (HashEntry != NULL) {
+            Directory = (PDU_DIRECTORY)HashEntry->Context;
+        } else {
+            Directory = DuAllocateDirectory(DuContext, ThreadState, &ThisDirName, Depth);
+            if (Directory == NULL) {
+                InterlockedExchange(&DuContext->RecordFailed, TRUE);
                 return FALSE;
             }
-            ASSERT(DuContext->DirStack[Index].ObjectsFoundThisDirectory == 0);
-            ASSERT(DuContext->DirStack[Index].SpaceConsumedThisDirectory == 0);
-            ASSERT(DuContext->DirStack[Index].SpaceConsumedInChildren == 0);
-            if (Index == 0) {
-                break;
-            }
-            Index--;
-            FilePart = YoriLibFindRightMostCharacter(&ThisDirName, '\\');
-            ASSERT(FilePart != NULL);
-            ThisDirName.LengthInChars = (DWORD)(FilePart - ThisDirName.StartOfString);
-            if (ThisDirName.LengthInChars == 6) {
-                ThisDirName.LengthInChars++;
-                if (!YoriLibIsPrefixedDriveLetterWithColonAndSlash(&ThisDirName)) {
-                    ThisDirName.LengthInChars--;
-                }
-            }
         }
+        ThreadState->LastDirectory = Directory;
     }
 
-    DuContext->StackIndex = Depth;
-    DuContext->DirStack[Depth].ObjectsFoundThisDirectory++;
+    Directory->ObjectsFoundThisDirectory++;
 
     if ((FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
         LARGE_INTEGER FileSize;
-        FileSize = DuCalculateSpaceUsedByFile(DuContext, &DuContext->DirStack[Depth], FilePath, FileInfo);
-        DuContext->DirStack[Depth].SpaceConsumedThisDirectory += FileSize.QuadPart;
+        FileSize = DuCalculateSpaceUsedByFile(DuContext, Directory, FilePath, FileInfo);
+        Directory->SpaceConsumedThisDirectory += FileSize.QuadPart;
     }
 
     return TRUE;
@@ -868,6 +1368,9 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("h")) == 0) {
                 DuContext.AverageHardLinkSize = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("l")) == 0) {
+                DuContext.CountHardLinksOnce = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("r")) == 0) {
                 if (i + 1 < ArgC) {
                     LONGLONG Depth;
@@ -926,16 +1429,25 @@ ENTRYPOINT(
 
     YoriLibVtStringForTextAttribute(&DuContext.FileSizeColorString, DuContext.FileSizeColor.Ctrl, DuContext.FileSizeColor.Win32Attr);
 
+    if (!DuInitializeContext(&DuContext)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("du: out of memory\n"));
+        DuCleanupContext(&DuContext);
+        return EXIT_FAILURE;
+    }
+
     YoriLibEnableBackupPrivilege();
 
 #if YORI_BUILTIN
     YoriLibCancelEnable();
 #endif
 
+    YoriLibOutputBufferEnable(YORI_LIB_OUTPUT_STDOUT);
+
     MatchFlags = YORILIB_FILEENUM_RETURN_FILES |
                  YORILIB_FILEENUM_RETURN_DIRECTORIES |
                  YORILIB_FILEENUM_RECURSE_BEFORE_RETURN |
-                 YORILIB_FILEENUM_NO_LINK_TRAVERSE;
+                 YORILIB_FILEENUM_NO_LINK_TRAVERSE |
+                 YORILIB_FILEENUM_PARALLEL;
     if (BasicEnumeration) {
         MatchFlags |= YORILIB_FILEENUM_BASIC_EXPANSION;
     }
@@ -948,14 +1460,31 @@ ENTRYPOINT(
         YORI_STRING FilesInDirectorySpec;
         YoriLibConstantString(&FilesInDirectorySpec, _T("."));
         YoriLibForEachFile(&FilesInDirectorySpec, MatchFlags, 0, DuFileFoundCallback, NULL, &DuContext);
-        DuReportAndCloseAllActiveStacks(&DuContext, 1);
+        if (!DuContext.RecordFailed &&
+            !DuReportAllDirectories(&DuContext, 1)) {
+
+            DuContext.RecordFailed = TRUE;
+        }
     } else {
         for (i = StartArg; i < ArgC; i++) {
             YoriLibForEachFile(&ArgV[i], MatchFlags, 0, DuFileFoundCallback, DuFileEnumerateErrorCallback, &DuContext);
-            DuReportAndCloseAllActiveStacks(&DuContext, 1);
+            if (DuContext.RecordFailed ||
+                !DuReportAllDirectories(&DuContext, 1)) {
+
+                DuContext.RecordFailed = TRUE;
+                break;
+            }
         }
     }
 
+    YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
+
+    if (DuContext.RecordFailed) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("du: out of memory, results incomplete\n"));
+        DuCleanupContext(&DuContext);
+        return EXIT_FAILURE;
+    }
+
     DuCleanupContext(&DuContext);
 
     return EXIT_SUCCESS;
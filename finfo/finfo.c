@@ -1571,6 +1571,8 @@ ENTRYPOINT(
         if (BasicEnumeration) {
             MatchFlags |= YORILIB_FILEENUM_BASIC_EXPANSION;
         }
+
+        YoriLibOutputBufferEnable(YORI_LIB_OUTPUT_STDOUT);
     
         for (i = StartArg; i < ArgC; i++) {
 
@@ -1587,6 +1589,8 @@ ENTRYPOINT(
         }
     }
 
+    YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
+
     if (FInfoContext.FilesFound == 0) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("finfo: no matching files found\n"));
         return EXIT_FAILURE;
@@ -37,15 +37,19 @@ const
 CHAR strForHelpText[] =
         "Enumerates through a list of strings or files.\n"
         "\n"
-        "FOR [-license] [-b] [-c] [-d] [-i <criteria>] [-p n] [-r] <var> in (<list>)\n"
-        "    do <cmd>\n"
+        "FOR [-license] [-b] [-c] [-d] [-i <criteria>] [-l] [-oc|-ol] [-p n] [-pc n]\n"
+        "    [-pm n] [-r] <var> in (<list>) do <cmd>\n"
         "\n"
         "   -b             Use basic search criteria for files only\n"
         "   -c             Use cmd as a subshell rather than Yori\n"
         "   -d             Match directories rather than files\n"
         "   -i <criteria>  Only treat match files if they meet criteria, see below\n"
         "   -l             Use (start,step,end) notation for the list\n"
+        "   -oc            Buffer output per process, display in completion order\n"
+        "   -ol            Buffer output per process, display in list order\n"
         "   -p <n>         Execute with <n> concurrent processes\n"
+        "   -pc <n>        Only start processes while CPU usage is below <n> percent\n"
+        "   -pm <n>        Only start processes while memory usage is below <n> percent\n"
         "   -r             Look for matches in subdirectories under the current directory\n"
         "\n"
         " The -i option will match files only if they meet criteria.  This is a\n"
@@ -74,98 +78,1186 @@ ForHelp()
     return TRUE;
 }
 
+/**
+ The number of milliseconds to wait between samples of system load when
+ deciding whether to launch another process.
+ */
+#define FOR_LOAD_SAMPLE_INTERVAL (100)
+
+/**
+ The number of milliseconds to wait for a process exit notification before
+ checking each running process directly.  Notifications from a job object
+ are not guaranteed to be delivered, so this ensures a missed notification
+ only delays, rather than prevents, further processes being launched.
+ */
+#define FOR_SWEEP_INTERVAL (1000)
+
+/**
+ The number of bytes to read from a child process output pipe at a time.
+ */
+#define FOR_OUTPUT_READ_SIZE (64 * 1024)
+
+/**
+ The maximum number of bytes of child process output to hold in memory
+ across all child processes.  Output beyond this is written to temporary
+ files.
+ */
+#define FOR_OUTPUT_MEMORY_LIMIT (64 * 1024 * 1024)
+
+/**
+ Child processes inherit the standard output of this process.
+ */
+#define FOR_OUTPUT_INHERIT    (0)
+
+/**
+ The output of each child process is captured and displayed once the child
+ completes, in the order that children complete.
+ */
+#define FOR_OUTPUT_COMPLETION_ORDER (1)
+
+/**
+ The output of each child process is captured and displayed once the child
+ completes, in the order that children were launched.
+ */
+#define FOR_OUTPUT_LIST_ORDER (2)
+
+/**
+ The captured output of a single child process.
+ */
+typedef struct _FOR_CHILD_OUTPUT {
+
+    /**
+     The entry for this output on the list of outputs which have completed
+     but cannot be displayed until earlier outputs are displayed.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     Pointer to the for exec context, used to account for memory consumed
+     by all child processes.
+     */
+    struct _FOR_EXEC_CONTEXT *ExecContext;
+
+    /**
+     The order in which this child process was launched.
+     */
+    DWORD Sequence;
+
+    /**
+     The read end of a pipe connected to the child's standard output.
+     */
+    HANDLE Pipe;
+
+    /**
+     A thread which reads from Pipe until the child closes it.
+     */
+    HANDLE hReaderThread;
+
+    /**
+     A temporary file containing output which could not be held in memory,
+     or NULL if all output is in memory.  Once a file is in use, all further
+     output is written to it.
+     */
+    HANDLE hSpillFile;
+
+    /**
+     The number of bytes written to hSpillFile.
+     */
+    DWORDLONG BytesSpilled;
+
+    /**
+     A buffer of output held in memory.
+     */
+    PUCHAR Buffer;
+
+    /**
+     The number of bytes of output in Buffer.
+     */
+    DWORD BytesInBuffer;
+
+    /**
+     The number of bytes allocated in Buffer.
+     */
+    DWORD BufferSize;
+} FOR_CHILD_OUTPUT, *PFOR_CHILD_OUTPUT;
+
 /**
  State about the currently running processes as well as information required
  to launch any new processes from this program.
  */
-typedef struct _FOR_EXEC_CONTEXT {
+typedef struct _FOR_EXEC_CONTEXT {
+
+    /**
+     If TRUE, use CMD as a subshell.  If FALSE, use Yori.
+     */
+    BOOL InvokeCmd;
+
+    /**
+     The string that might be found in ArgV which should be changed to contain
+     the value of any match.
+     */
+    PYORI_STRING SubstituteVariable;
+
+    /**
+     The number of elements in ArgV.
+     */
+    DWORD ArgC;
+
+    /**
+     The template form of an argv style argument array, before any
+     substitution has taken place.
+     */
+    PYORI_STRING ArgV;
+
+    /**
+     The number of processes that this program would like to have concurrently
+     running.  If zero, there is no fixed limit, and processes are launched
+     as long as system load is below the targets below.
+     */
+    DWORD TargetConcurrentCount;
+
+    /**
+     If nonzero, new processes are only launched while the percentage of
+     processor time in use by the system is below this value.
+     */
+    DWORD CpuLoadTarget;
+
+    /**
+     If nonzero, new processes are only launched while the percentage of
+     physical memory in use by the system is below this value.
+     */
+    DWORD MemoryLoadTarget;
+
+    /**
+     The number of processes that are currently running as a result of this
+     program.
+     */
+    DWORD CurrentConcurrentCount;
+
+    /**
+     The number of elements allocated in HandleArray, OutputArray and
+     ProcessIdArray.
+     */
+    DWORD ProcessesAllocated;
+
+    /**
+     An array of handles with CurrentConcurrentCount number of valid
+     elements.  These correspond to processes that are currently running.
+     */
+    PHANDLE HandleArray;
+
+    /**
+     An array of captured output with CurrentConcurrentCount number of valid
+     elements, in the same order as HandleArray.  Elements are NULL if
+     output is not being captured.
+     */
+    PFOR_CHILD_OUTPUT *OutputArray;
+
+    /**
+     An array of process identifiers with CurrentConcurrentCount number of
+     valid elements, in the same order as HandleArray.
+     */
+    PDWORD ProcessIdArray;
+
+    /**
+     Indicates whether child process output is inherited or captured, and
+     the order to display captured output.  One of the FOR_OUTPUT_
+     definitions.
+     */
+    DWORD OutputMode;
+
+    /**
+     The sequence number to assign to the next child process launched.
+     */
+    DWORD NextSequenceToLaunch;
+
+    /**
+     The sequence number of the next child process whose output should be
+     displayed.  Only used when displaying output in list order.
+     */
+    DWORD NextSequenceToDisplay;
+
+    /**
+     A list of child process outputs which have completed but are waiting
+     for earlier outputs, sorted by sequence number.
+     */
+    YORI_LIST_ENTRY PendingOutputList;
+
+    /**
+     A mutex synchronizing BytesBuffered.
+     */
+    HANDLE OutputMutex;
+
+    /**
+     The number of bytes of child process output held in memory.
+     */
+    DWORD BytesBuffered;
+
+    /**
+     A job object containing each child process, or NULL if process exit
+     should be detected by waiting on process handles.
+     */
+    HANDLE Job;
+
+    /**
+     A completion port which receives notifications when processes within
+     Job exit.
+     */
+    HANDLE CompletionPort;
+
+    /**
+     The tick count when system load was last sampled.
+     */
+    DWORD LastSampleTick;
+
+    /**
+     The amount of time the system had spent idle when load was last sampled.
+     */
+    DWORDLONG LastIdleTime;
+
+    /**
+     The amount of time the system had spent executing, including idle time,
+     when load was last sampled.
+     */
+    DWORDLONG LastTotalTime;
+
+    /**
+     TRUE if the most recent sample of system load indicated that more
+     processes can be launched.
+     */
+    BOOL LastSampleBelowTarget;
+
+    /**
+     TRUE if a process has been launched since system load was last sampled.
+     The effect of that process is not yet known, so no more processes should
+     be launched until load is sampled again.
+     */
+    BOOL LaunchedSinceSample;
+
+    /**
+     A list of criteria to filter matches against.
+     */
+    YORI_LIB_FILE_FILTER Filter;
+
+} FOR_EXEC_CONTEXT, *PFOR_EXEC_CONTEXT;
+
+/**
+ Create a temporary file to hold child process output which cannot be held
+ in memory.  The file is deleted when its handle is closed.
+
+ @return Handle to the temporary file, or NULL on failure.
+ */
+HANDLE
+ForCreateOutputSpillFile()
+{
+    YORI_STRING TempPath;
+    TCHAR TempFileName[MAX_PATH];
+    HANDLE hFile;
+
+    TempPath.LengthAllocated = GetTempPath(0, NULL);
+    if (!YoriLibAllocateString(&TempPath, TempPath.LengthAllocated)) {
+        return NULL;
+    }
+    TempPath.LengthInChars = GetTempPath(TempPath.LengthAllocated, TempPath.StartOfString);
+    if (TempPath.LengthInChars == 0 || TempPath.LengthInChars >= TempPath.LengthAllocated) {
+        YoriLibFreeStringContents(&TempPath);
+        return NULL;
+    }
+
+    if (GetTempFileName(TempPath.StartOfString, _T("yfr"), 0, TempFileName) == 0) {
+        YoriLibFreeStringContents(&TempPath);
+        return NULL;
+    }
+    YoriLibFreeStringContents(&TempPath);
+
+    hFile = CreateFile(TempFileName,
+                       GENERIC_READ | GENERIC_WRITE,
+                       0,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE | FILE_FLAG_SEQUENTIAL_SCAN,
+                       NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        DeleteFile(TempFileName);
+        return NULL;
+    }
+
+    return hFile;
+}
+
+/**
+ Write a buffer in its entirety to a handle.
+
+ @param hFile The handle to write to.
+
+ @param Buffer Pointer to the data to write.
+
+ @param Length The number of bytes to write.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+ForWriteBuffer(
+    __in HANDLE hFile,
+    __in_ecount(Length) PUCHAR Buffer,
+    __in DWORD Length
+    )
+{
+    DWORD BytesWritten;
+    DWORD Offset;
+
+    Offset = 0;
+    while (Offset < Length) {
+        if (!WriteFile(hFile, Buffer + Offset, Length - Offset, &BytesWritten, NULL) ||
+            BytesWritten == 0) {
+
+            return FALSE;
+        }
+        Offset += BytesWritten;
+    }
+
+    return TRUE;
+}
+
+/**
+ Move the output held in memory for a child process into a temporary file,
+ so that all further output is written to the file.  The memory buffer is
+ reduced to the size of a single read.
+
+ @param Output Pointer to the child process output.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  On failure
+         the output remains in memory.
+ */
+BOOL
+ForSpillChildOutput(
+    __in PFOR_CHILD_OUTPUT Output
+    )
+{
+    PFOR_EXEC_CONTEXT ExecContext = Output->ExecContext;
+    PUCHAR NewBuffer;
+
+    if (Output->Buffer == NULL) {
+        return FALSE;
+    }
+
+    Output->hSpillFile = ForCreateOutputSpillFile();
+    if (Output->hSpillFile == NULL) {
+        return FALSE;
+    }
+
+    if (!ForWriteBuffer(Output->hSpillFile, Output->Buffer, Output->BytesInBuffer)) {
+        CloseHandle(Output->hSpillFile);
+        Output->hSpillFile = NULL;
+        return FALSE;
+    }
+
+    Output->BytesSpilled = Output->BytesInBuffer;
+
+    WaitForSingleObject(ExecContext->OutputMutex, INFINITE);
+    ExecContext->BytesBuffered -= Output->BytesInBuffer;
+    ReleaseMutex(ExecContext->OutputMutex);
+    Output->BytesInBuffer = 0;
+
+    if (Output->BufferSize > FOR_OUTPUT_READ_SIZE) {
+        NewBuffer = YoriLibMalloc(FOR_OUTPUT_READ_SIZE);
+        if (NewBuffer != NULL) {
+            YoriLibFree(Output->Buffer);
+            Output->Buffer = NewBuffer;
+            Output->BufferSize = FOR_OUTPUT_READ_SIZE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ A thread which reads the output of a child process until the child closes
+ its end of the pipe.  Output is held in memory until the memory limit for
+ all children is reached, after which it is written to a temporary file.
+
+ @param Context Pointer to the child process output.
+
+ @return Exit code for the thread.
+ */
+DWORD WINAPI
+ForOutputReader(
+    __in LPVOID Context
+    )
+{
+    PFOR_CHILD_OUTPUT Output = (PFOR_CHILD_OUTPUT)Context;
+    PFOR_EXEC_CONTEXT ExecContext = Output->ExecContext;
+    PUCHAR NewBuffer;
+    DWORD NewBufferSize;
+    DWORD BytesRead;
+    BOOL LimitExceeded;
+    UCHAR DiscardBuffer[256];
+
+    while (TRUE) {
+        if (Output->hSpillFile != NULL) {
+            if (!ReadFile(Output->Pipe, Output->Buffer, Output->BufferSize, &BytesRead, NULL) ||
+                BytesRead == 0) {
+
+                return 0;
+            }
+
+            if (!ForWriteBuffer(Output->hSpillFile, Output->Buffer, BytesRead)) {
+                break;
+            }
+            Output->BytesSpilled += BytesRead;
+            continue;
+        }
+
+        if (Output->BufferSize - Output->BytesInBuffer < FOR_OUTPUT_READ_SIZE) {
+            NewBufferSize = Output->BufferSize * 2;
+            if (NewBufferSize < FOR_OUTPUT_READ_SIZE) {
+                NewBufferSize = FOR_OUTPUT_READ_SIZE;
+            }
+            NewBuffer = YoriLibMalloc(NewBufferSize);
+            if (NewBuffer == NULL) {
+                if (!ForSpillChildOutput(Output)) {
+                    break;
+                }
+                continue;
+            }
+            if (Output->Buffer != NULL) {
+                memcpy(NewBuffer, Output->Buffer, Output->BytesInBuffer);
+                YoriLibFree(Output->Buffer);
+            }
+            Output->Buffer = NewBuffer;
+            Output->BufferSize = NewBufferSize;
+        }
+
+        if (!ReadFile(Output->Pipe, Output->Buffer + Output->BytesInBuffer, FOR_OUTPUT_READ_SIZE, &BytesRead, NULL) ||
+            BytesRead == 0) {
+
+            return 0;
+        }
+
+        Output->BytesInBuffer += BytesRead;
+
+        WaitForSingleObject(ExecContext->OutputMutex, INFINITE);
+        ExecContext->BytesBuffered += BytesRead;
+        LimitExceeded = FALSE;
+        if (ExecContext->BytesBuffered > FOR_OUTPUT_MEMORY_LIMIT) {
+            LimitExceeded = TRUE;
+        }
+        ReleaseMutex(ExecContext->OutputMutex);
+
+        //
+        //  If the output can't be written to a file, keep it in memory
+        //  anyway, since the only alternative is to lose it.
+        //
+
+        if (LimitExceeded) {
+            ForSpillChildOutput(Output);
+        }
+    }
+
+    //
+    //  If output can no longer be saved, keep reading it so that the child
+    //  process does not wait forever for space in the pipe.
+    //
+
+    while (ReadFile(Output->Pipe, DiscardBuffer, sizeof(DiscardBuffer), &BytesRead, NULL) &&
+           BytesRead > 0);
+
+    return 0;
+}
+
+/**
+ Prepare to capture the output of a child process.  This creates a pipe
+ and a thread to read from it.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @param WritePipe On successful completion, updated to contain an inheritable
+        handle to the write end of the pipe, to be used as the standard
+        output of the child process.  The caller should close this once the
+        child process has been launched.
+
+ @return Pointer to the child process output, or NULL on failure.
+ */
+PFOR_CHILD_OUTPUT
+ForCreateChildOutput(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __out PHANDLE WritePipe
+    )
+{
+    PFOR_CHILD_OUTPUT Output;
+    SECURITY_ATTRIBUTES SecurityAttributes;
+    HANDLE ReadPipe;
+    DWORD ThreadId;
+
+    Output = YoriLibMalloc(sizeof(FOR_CHILD_OUTPUT));
+    if (Output == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Output, sizeof(FOR_CHILD_OUTPUT));
+    Output->ExecContext = ExecContext;
+
+    ZeroMemory(&SecurityAttributes, sizeof(SecurityAttributes));
+    SecurityAttributes.nLength = sizeof(SecurityAttributes);
+    SecurityAttributes.bInheritHandle = TRUE;
+
+    if (!CreatePipe(&ReadPipe, WritePipe, &SecurityAttributes, 0)) {
+        YoriLibFree(Output);
+        return NULL;
+    }
+
+    //
+    //  The read end should not be inherited by this or any later child
+    //  process.
+    //
+
+    if (!DuplicateHandle(GetCurrentProcess(), ReadPipe, GetCurrentProcess(), &Output->Pipe, 0, FALSE, DUPLICATE_SAME_ACCESS | DUPLICATE_CLOSE_SOURCE)) {
+        CloseHandle(ReadPipe);
+        CloseHandle(*WritePipe);
+        YoriLibFree(Output);
+        return NULL;
+    }
+
+    Output->hReaderThread = CreateThread(NULL, 0, ForOutputReader, Output, 0, &ThreadId);
+    if (Output->hReaderThread == NULL) {
+        CloseHandle(Output->Pipe);
+        CloseHandle(*WritePipe);
+        YoriLibFree(Output);
+        return NULL;
+    }
+
+    return Output;
+}
+
+/**
+ Free the captured output of a child process.  This waits for the thread
+ reading the output to complete, which occurs once the child process and
+ anything else holding the write end of the pipe have closed it.
+
+ @param Output Pointer to the child process output.
+ */
+VOID
+ForFreeChildOutput(
+    __in PFOR_CHILD_OUTPUT Output
+    )
+{
+    PFOR_EXEC_CONTEXT ExecContext = Output->ExecContext;
+
+    if (Output->hReaderThread != NULL) {
+        WaitForSingleObject(Output->hReaderThread, INFINITE);
+        CloseHandle(Output->hReaderThread);
+    }
+
+    WaitForSingleObject(ExecContext->OutputMutex, INFINITE);
+    ExecContext->BytesBuffered -= Output->BytesInBuffer;
+    ReleaseMutex(ExecContext->OutputMutex);
+
+    if (Output->hSpillFile != NULL) {
+        CloseHandle(Output->hSpillFile);
+    }
+    if (Output->Pipe != NULL) {
+        CloseHandle(Output->Pipe);
+    }
+    if (Output->Buffer != NULL) {
+        YoriLibFree(Output->Buffer);
+    }
+    YoriLibFree(Output);
+}
+
+/**
+ Write the captured output of a child process to standard output.  The
+ thread reading the output must have completed.
+
+ @param Output Pointer to the child process output.
+ */
+VOID
+ForDisplayChildOutput(
+    __in PFOR_CHILD_OUTPUT Output
+    )
+{
+    HANDLE hOutput;
+    DWORDLONG BytesRemaining;
+    DWORD BytesToRead;
+    DWORD BytesRead;
+
+    hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    if (Output->hSpillFile != NULL) {
+        SetFilePointer(Output->hSpillFile, 0, NULL, FILE_BEGIN);
+        BytesRemaining = Output->BytesSpilled;
+        while (BytesRemaining > 0) {
+            BytesToRead = Output->BufferSize;
+            if (BytesToRead > BytesRemaining) {
+                BytesToRead = (DWORD)BytesRemaining;
+            }
+            if (!ReadFile(Output->hSpillFile, Output->Buffer, BytesToRead, &BytesRead, NULL) ||
+                BytesRead == 0) {
+
+                break;
+            }
+            if (!ForWriteBuffer(hOutput, Output->Buffer, BytesRead)) {
+                return;
+            }
+            BytesRemaining -= BytesRead;
+        }
+    }
+
+    if (Output->BytesInBuffer > 0) {
+        ForWriteBuffer(hOutput, Output->Buffer, Output->BytesInBuffer);
+    }
+}
+
+/**
+ Indicate that a child process has completed, and display its output once
+ all output that should precede it has been displayed.
+
+ @param ExecContext Pointer to the for exec context.
+
+ @param Output Pointer to the output of the child process which completed.
+ */
+VOID
+ForCompleteChildOutput(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __in PFOR_CHILD_OUTPUT Output
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PFOR_CHILD_OUTPUT Existing;
+
+    WaitForSingleObject(Output->hReaderThread, INFINITE);
+    CloseHandle(Output->hReaderThread);
+    Output->hReaderThread = NULL;
+
+    if (ExecContext->OutputMode == FOR_OUTPUT_COMPLETION_ORDER) {
+        ForDisplayChildOutput(Output);
+        ForFreeChildOutput(Output);
+        return;
+    }
+
+    //
+    //  Insert the output into the pending list in sequence order.
+    //
+
+    ListEntry = YoriLibGetNextListEntry(&ExecContext->PendingOutputList, NULL);
+    while (ListEntry != NULL) {
+        Existing = CONTAINING_RECORD(ListEntry, FOR_CHILD_OUTPUT, ListEntry);
+        if (Existing->Sequence > Output->Sequence) {
+            break;
+        }
+        ListEntry = YoriLibGetNextListEntry(&ExecContext->PendingOutputList, ListEntry);
+    }
+
+    //
+    //  Appending to an entry within the list inserts before that entry.
+    //
+
+    if (ListEntry != NULL) {
+        YoriLibAppendList(ListEntry, &Output->ListEntry);
+    } else {
+        YoriLibAppendList(&ExecContext->PendingOutputList, &Output->ListEntry);
+    }
+
+    //
+    //  Display everything that is now ready.
+    //
+
+    ListEntry = YoriLibGetNextListEntry(&ExecContext->PendingOutputList, NULL);
+    while (ListEntry != NULL) {
+        Existing = CONTAINING_RECORD(ListEntry, FOR_CHILD_OUTPUT, ListEntry);
+        if (Existing->Sequence != ExecContext->NextSequenceToDisplay) {
+            break;
+        }
+        YoriLibRemoveListItem(&Existing->ListEntry);
+        ForDisplayChildOutput(Existing);
+        ForFreeChildOutput(Existing);
+        ExecContext->NextSequenceToDisplay++;
+        ListEntry = YoriLibGetNextListEntry(&ExecContext->PendingOutputList, NULL);
+    }
+}
+
+/**
+ Prepare to monitor child processes.  Where the host OS supports it, each
+ child is placed in a job object whose exit notifications are delivered to
+ a completion port, so any number of children can be waited for at once.
+ If this is not supported, exit is detected by waiting on process handles.
+
+ @param ExecContext Pointer to the for exec context to initialize.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+ForInitializeScheduler(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    DWORD InitialCount;
+
+    InitialCount = ExecContext->TargetConcurrentCount;
+    if (InitialCount == 0) {
+        InitialCount = MAXIMUM_WAIT_OBJECTS;
+    }
+
+    ExecContext->HandleArray = YoriLibMalloc(InitialCount * (sizeof(HANDLE) + sizeof(PFOR_CHILD_OUTPUT) + sizeof(DWORD)));
+    if (ExecContext->HandleArray == NULL) {
+        return FALSE;
+    }
+    ExecContext->OutputArray = (PFOR_CHILD_OUTPUT *)(ExecContext->HandleArray + InitialCount);
+    ExecContext->ProcessIdArray = (PDWORD)(ExecContext->OutputArray + InitialCount);
+    ExecContext->ProcessesAllocated = InitialCount;
+
+    YoriLibInitializeListHead(&ExecContext->PendingOutputList);
+    if (ExecContext->OutputMode != FOR_OUTPUT_INHERIT) {
+        ExecContext->OutputMutex = CreateMutex(NULL, FALSE, NULL);
+        if (ExecContext->OutputMutex == NULL) {
+            return FALSE;
+        }
+    }
+
+    if (ExecContext->TargetConcurrentCount == 1 &&
+        ExecContext->CpuLoadTarget == 0 &&
+        ExecContext->MemoryLoadTarget == 0) {
+
+        return TRUE;
+    }
+
+    if (DllKernel32.pCreateIoCompletionPort != NULL &&
+        DllKernel32.pGetQueuedCompletionStatus != NULL) {
+
+        ExecContext->Job = YoriLibCreateJobObject();
+        if (ExecContext->Job != NULL) {
+            ExecContext->CompletionPort = DllKernel32.pCreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+            if (ExecContext->CompletionPort == NULL ||
+                !YoriLibAssociateJobObjectWithCompletionPort(ExecContext->Job, ExecContext->CompletionPort, ExecContext)) {
+
+                if (ExecContext->CompletionPort != NULL) {
+                    CloseHandle(ExecContext->CompletionPort);
+                    ExecContext->CompletionPort = NULL;
+                }
+                CloseHandle(ExecContext->Job);
+                ExecContext->Job = NULL;
+            }
+        }
+    }
+
+    ExecContext->LastSampleTick = GetTickCount();
+    ExecContext->LastSampleBelowTarget = TRUE;
+    if (DllKernel32.pGetSystemTimes != NULL) {
+        FILETIME IdleTime;
+        FILETIME KernelTime;
+        FILETIME UserTime;
+
+        if (DllKernel32.pGetSystemTimes(&IdleTime, &KernelTime, &UserTime)) {
+            ExecContext->LastIdleTime = (((DWORDLONG)IdleTime.dwHighDateTime) << 32) | IdleTime.dwLowDateTime;
+            ExecContext->LastTotalTime = ((((DWORDLONG)KernelTime.dwHighDateTime) << 32) | KernelTime.dwLowDateTime) +
+                                         ((((DWORDLONG)UserTime.dwHighDateTime) << 32) | UserTime.dwLowDateTime);
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Stop monitoring child processes and free any state used to monitor them.
+ This does not wait for any running process to complete, although if its
+ output is being captured, this waits for it to close its output.
+
+ @param ExecContext Pointer to the for exec context to clean up.
+ */
+VOID
+ForCleanupScheduler(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    DWORD Index;
+    PYORI_LIST_ENTRY ListEntry;
+    PFOR_CHILD_OUTPUT Output;
 
-    /**
-     If TRUE, use CMD as a subshell.  If FALSE, use Yori.
-     */
-    BOOL InvokeCmd;
+    for (Index = 0; Index < ExecContext->CurrentConcurrentCount; Index++) {
+        CloseHandle(ExecContext->HandleArray[Index]);
+        if (ExecContext->OutputArray[Index] != NULL) {
+            ForFreeChildOutput(ExecContext->OutputArray[Index]);
+        }
+    }
+    ExecContext->CurrentConcurrentCount = 0;
+
+    if (ExecContext->HandleArray != NULL) {
+        ListEntry = YoriLibGetNextListEntry(&ExecContext->PendingOutputList, NULL);
+        while (ListEntry != NULL) {
+            Output = CONTAINING_RECORD(ListEntry, FOR_CHILD_OUTPUT, ListEntry);
+            YoriLibRemoveListItem(&Output->ListEntry);
+            ForFreeChildOutput(Output);
+            ListEntry = YoriLibGetNextListEntry(&ExecContext->PendingOutputList, NULL);
+        }
 
-    /**
-     The string that might be found in ArgV which should be changed to contain
-     the value of any match.
-     */
-    PYORI_STRING SubstituteVariable;
+        YoriLibFree(ExecContext->HandleArray);
+        ExecContext->HandleArray = NULL;
+        ExecContext->OutputArray = NULL;
+        ExecContext->ProcessIdArray = NULL;
+    }
 
-    /**
-     The number of elements in ArgV.
-     */
-    DWORD ArgC;
+    if (ExecContext->OutputMutex != NULL) {
+        CloseHandle(ExecContext->OutputMutex);
+        ExecContext->OutputMutex = NULL;
+    }
 
-    /**
-     The template form of an argv style argument array, before any
-     substitution has taken place.
-     */
-    PYORI_STRING ArgV;
+    if (ExecContext->CompletionPort != NULL) {
+        CloseHandle(ExecContext->CompletionPort);
+        ExecContext->CompletionPort = NULL;
+    }
 
-    /**
-     The number of processes that this program would like to have concurrently
-     running.
-     */
-    DWORD TargetConcurrentCount;
+    if (ExecContext->Job != NULL) {
+        CloseHandle(ExecContext->Job);
+        ExecContext->Job = NULL;
+    }
+}
 
-    /**
-     The number of processes that are currently running as a result of this
-     program.
-     */
-    DWORD CurrentConcurrentCount;
+/**
+ Record a newly launched process as running.
 
-    /**
-     An array of handles with CurrentConcurrentCount number of valid
-     elements.  These correspond to processes that are currently running.
-     */
-    PHANDLE HandleArray;
+ @param ExecContext Pointer to the for exec context containing information
+        about currently running processes.
 
-    /**
-     A list of criteria to filter matches against.
-     */
-    YORI_LIB_FILE_FILTER Filter;
+ @param ProcessInfo Pointer to information about the new process.  On success
+        the process handle is owned by ExecContext.
 
-} FOR_EXEC_CONTEXT, *PFOR_EXEC_CONTEXT;
+ @param Output Optionally points to the captured output of the process.  On
+        success this is owned by ExecContext.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+ForAddProcess(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __in PPROCESS_INFORMATION ProcessInfo,
+    __in_opt PFOR_CHILD_OUTPUT Output
+    )
+{
+    if (ExecContext->CurrentConcurrentCount >= ExecContext->ProcessesAllocated) {
+        PHANDLE NewHandleArray;
+        PFOR_CHILD_OUTPUT *NewOutputArray;
+        PDWORD NewProcessIdArray;
+        DWORD NewAllocated;
+
+        NewAllocated = ExecContext->ProcessesAllocated * 2;
+        NewHandleArray = YoriLibMalloc(NewAllocated * (sizeof(HANDLE) + sizeof(PFOR_CHILD_OUTPUT) + sizeof(DWORD)));
+        if (NewHandleArray == NULL) {
+            return FALSE;
+        }
+        NewOutputArray = (PFOR_CHILD_OUTPUT *)(NewHandleArray + NewAllocated);
+        NewProcessIdArray = (PDWORD)(NewOutputArray + NewAllocated);
+
+        memcpy(NewHandleArray, ExecContext->HandleArray, ExecContext->CurrentConcurrentCount * sizeof(HANDLE));
+        memcpy(NewOutputArray, ExecContext->OutputArray, ExecContext->CurrentConcurrentCount * sizeof(PFOR_CHILD_OUTPUT));
+        memcpy(NewProcessIdArray, ExecContext->ProcessIdArray, ExecContext->CurrentConcurrentCount * sizeof(DWORD));
+        YoriLibFree(ExecContext->HandleArray);
+        ExecContext->HandleArray = NewHandleArray;
+        ExecContext->OutputArray = NewOutputArray;
+        ExecContext->ProcessIdArray = NewProcessIdArray;
+        ExecContext->ProcessesAllocated = NewAllocated;
+    }
+
+    ExecContext->HandleArray[ExecContext->CurrentConcurrentCount] = ProcessInfo->hProcess;
+    ExecContext->OutputArray[ExecContext->CurrentConcurrentCount] = Output;
+    ExecContext->ProcessIdArray[ExecContext->CurrentConcurrentCount] = ProcessInfo->dwProcessId;
+    ExecContext->CurrentConcurrentCount++;
+    ExecContext->LaunchedSinceSample = TRUE;
+    return TRUE;
+}
 
 /**
- Wait for any single process to complete.
+ Indicate that a process has completed.  The final process in the array is
+ moved into its slot, so the order of the array is not preserved.  If the
+ process output is being captured, it is displayed once it can be.
 
  @param ExecContext Pointer to the for exec context containing information
         about currently running processes.
+
+ @param Index The index of the process which has completed.
  */
 VOID
-ForWaitForProcessToComplete(
-    __in PFOR_EXEC_CONTEXT ExecContext
+ForRemoveProcess(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __in DWORD Index
+    )
+{
+    DWORD LastIndex;
+    PFOR_CHILD_OUTPUT Output;
+
+    ASSERT(Index < ExecContext->CurrentConcurrentCount);
+
+    CloseHandle(ExecContext->HandleArray[Index]);
+    Output = ExecContext->OutputArray[Index];
+    LastIndex = ExecContext->CurrentConcurrentCount - 1;
+    if (Index != LastIndex) {
+        ExecContext->HandleArray[Index] = ExecContext->HandleArray[LastIndex];
+        ExecContext->OutputArray[Index] = ExecContext->OutputArray[LastIndex];
+        ExecContext->ProcessIdArray[Index] = ExecContext->ProcessIdArray[LastIndex];
+    }
+    ExecContext->CurrentConcurrentCount--;
+
+    if (Output != NULL) {
+        ForCompleteChildOutput(ExecContext, Output);
+    }
+}
+
+/**
+ Check each running process directly and remove any which have completed.
+
+ @param ExecContext Pointer to the for exec context containing information
+        about currently running processes.
+
+ @param Timeout The number of milliseconds to wait for a process to complete
+        if none have completed already.  This is only honored when there are
+        few enough processes to wait for all of them at once.
+
+ @return TRUE if any process completed, FALSE if not.
+ */
+BOOL
+ForRemoveCompletedProcesses(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __in DWORD Timeout
     )
 {
     DWORD Result;
     DWORD Index;
     DWORD Count;
+    BOOL Found;
+
+    Found = FALSE;
+    if (ExecContext->CurrentConcurrentCount <= MAXIMUM_WAIT_OBJECTS) {
+        Result = WaitForMultipleObjects(ExecContext->CurrentConcurrentCount, ExecContext->HandleArray, FALSE, Timeout);
+        if (Result >= WAIT_OBJECT_0 && Result < (WAIT_OBJECT_0 + ExecContext->CurrentConcurrentCount)) {
+            ForRemoveProcess(ExecContext, Result - WAIT_OBJECT_0);
+            Found = TRUE;
+        }
+        return Found;
+    }
 
-    Result = WaitForMultipleObjects(ExecContext->CurrentConcurrentCount, ExecContext->HandleArray, FALSE, INFINITE);
+    //
+    //  Check each group of processes that can be waited on at once.  Since
+    //  removing a process moves the final process into its slot, the same
+    //  group is checked again after a completion.
+    //
+
+    Index = 0;
+    while (Index < ExecContext->CurrentConcurrentCount) {
+        Count = ExecContext->CurrentConcurrentCount - Index;
+        if (Count > MAXIMUM_WAIT_OBJECTS) {
+            Count = MAXIMUM_WAIT_OBJECTS;
+        }
+        Result = WaitForMultipleObjects(Count, &ExecContext->HandleArray[Index], FALSE, 0);
+        if (Result >= WAIT_OBJECT_0 && Result < (WAIT_OBJECT_0 + Count)) {
+            ForRemoveProcess(ExecContext, Index + Result - WAIT_OBJECT_0);
+            Found = TRUE;
+        } else {
+            Index += Count;
+        }
+    }
 
-    ASSERT(Result >= WAIT_OBJECT_0 && Result < (WAIT_OBJECT_0 + ExecContext->CurrentConcurrentCount));
+    if (!Found && Timeout > 0) {
+        if (Timeout > FOR_LOAD_SAMPLE_INTERVAL) {
+            Timeout = FOR_LOAD_SAMPLE_INTERVAL;
+        }
+        Sleep(Timeout);
+    }
 
-    Index = Result - WAIT_OBJECT_0;
+    return Found;
+}
 
-    CloseHandle(ExecContext->HandleArray[Index]);
+/**
+ Wait for any single process to complete.
 
-    for (Count = Index; Count < ExecContext->CurrentConcurrentCount - 1; Count++) {
+ @param ExecContext Pointer to the for exec context containing information
+        about currently running processes.
+
+ @param Timeout The maximum number of milliseconds to wait, or INFINITE to
+        wait until a process completes.
+
+ @return TRUE if a process completed, FALSE if the timeout elapsed.
+ */
+BOOL
+ForWaitForProcessToComplete(
+    __in PFOR_EXEC_CONTEXT ExecContext,
+    __in DWORD Timeout
+    )
+{
+    DWORD Message;
+    ULONG_PTR Key;
+    LPOVERLAPPED Overlapped;
+    DWORD ProcessId;
+    DWORD Index;
+    DWORD ThisTimeout;
+
+    ASSERT(ExecContext->CurrentConcurrentCount > 0);
+
+    while (TRUE) {
+        ThisTimeout = Timeout;
+        if (ThisTimeout > FOR_SWEEP_INTERVAL) {
+            ThisTimeout = FOR_SWEEP_INTERVAL;
+        }
+
+        if (ExecContext->CompletionPort == NULL) {
+            if (ForRemoveCompletedProcesses(ExecContext, ThisTimeout)) {
+                return TRUE;
+            }
+        } else {
+
+            //
+            //  The job also contains any processes launched by the child
+            //  processes, so notifications for processes that aren't being
+            //  tracked here are ignored.
+            //
+
+            while (DllKernel32.pGetQueuedCompletionStatus(ExecContext->CompletionPort, &Message, &Key, &Overlapped, ThisTimeout)) {
+                if (Message == JOB_OBJECT_MSG_EXIT_PROCESS ||
+                    Message == JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS) {
+
+                    ProcessId = (DWORD)(DWORD_PTR)Overlapped;
+                    for (Index = 0; Index < ExecContext->CurrentConcurrentCount; Index++) {
+                        //
+                        //  Process IDs can be reused once a process has
+                        //  exited, so only remove the entry if its handle
+                        //  confirms that the process has exited.
+                        //
+
+                        if (ExecContext->ProcessIdArray[Index] == ProcessId &&
+                            WaitForSingleObject(ExecContext->HandleArray[Index], 0) == WAIT_OBJECT_0) {
+
+                            ForRemoveProcess(ExecContext, Index);
+                            return TRUE;
+                        }
+                    }
+                }
+            }
+
+            if (ForRemoveCompletedProcesses(ExecContext, 0)) {
+                return TRUE;
+            }
+        }
+
+        if (Timeout != INFINITE) {
+            return FALSE;
+        }
+    }
+}
+
+/**
+ Determine whether system load is low enough to launch another process.
+ Load is sampled at most once per FOR_LOAD_SAMPLE_INTERVAL, and after a
+ process is launched, no further process is launched until the next sample
+ can observe its effect.
+
+ @param ExecContext Pointer to the for exec context specifying the load
+        targets.
+
+ @return TRUE if another process can be launched, FALSE if not.
+ */
+BOOL
+ForIsLoadBelowTarget(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    DWORD CurrentTick;
+    BOOL BelowTarget;
+
+    if (ExecContext->CpuLoadTarget == 0 && ExecContext->MemoryLoadTarget == 0) {
+        return TRUE;
+    }
+
+    CurrentTick = GetTickCount();
+    if (CurrentTick - ExecContext->LastSampleTick < FOR_LOAD_SAMPLE_INTERVAL) {
+        if (ExecContext->LaunchedSinceSample) {
+            return FALSE;
+        }
+        return ExecContext->LastSampleBelowTarget;
+    }
+
+    BelowTarget = TRUE;
+
+    if (ExecContext->CpuLoadTarget != 0 && DllKernel32.pGetSystemTimes != NULL) {
+        FILETIME IdleTime;
+        FILETIME KernelTime;
+        FILETIME UserTime;
+        DWORDLONG CurrentIdleTime;
+        DWORDLONG CurrentTotalTime;
+        DWORDLONG BusyTime;
 
-#if defined(_MSC_VER) && (_MSC_VER >= 1700)
         //
-        //  The "correct" annotation here would describe that HandleArray is
-        //  of TargetConcurrentCount elements, CurrentConcurrentCount of which
-        //  are readable, and CurrentConcurrentCount needs to be less than or
-        //  equal to TargetConcurrentCount.  This is something that I don't
-        //  see a way to express as of this writing.
+        //  Kernel time as returned by GetSystemTimes includes idle time.
         //
-#pragma warning(suppress: 6001)
+
+        if (DllKernel32.pGetSystemTimes(&IdleTime, &KernelTime, &UserTime)) {
+            CurrentIdleTime = (((DWORDLONG)IdleTime.dwHighDateTime) << 32) | IdleTime.dwLowDateTime;
+            CurrentTotalTime = ((((DWORDLONG)KernelTime.dwHighDateTime) << 32) | KernelTime.dwLowDateTime) +
+                               ((((DWORDLONG)UserTime.dwHighDateTime) << 32) | UserTime.dwLowDateTime);
+
+            if (CurrentTotalTime > ExecContext->LastTotalTime) {
+                BusyTime = (CurrentTotalTime - ExecContext->LastTotalTime) - (CurrentIdleTime - ExecContext->LastIdleTime);
+                if (BusyTime * 100 / (CurrentTotalTime - ExecContext->LastTotalTime) >= ExecContext->CpuLoadTarget) {
+                    BelowTarget = FALSE;
+                }
+            }
+
+            ExecContext->LastIdleTime = CurrentIdleTime;
+            ExecContext->LastTotalTime = CurrentTotalTime;
+        }
+    }
+
+    if (ExecContext->MemoryLoadTarget != 0) {
+        DWORD MemoryLoad;
+
+        if (DllKernel32.pGlobalMemoryStatusEx) {
+            YORI_MEMORYSTATUSEX MemStatusEx;
+            MemStatusEx.dwLength = sizeof(MemStatusEx);
+            MemoryLoad = 0;
+            if (DllKernel32.pGlobalMemoryStatusEx(&MemStatusEx)) {
+                MemoryLoad = MemStatusEx.dwMemoryLoad;
+            }
+        } else {
+            MEMORYSTATUS MemStatus;
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159)
 #endif
-        ExecContext->HandleArray[Count] = ExecContext->HandleArray[Count + 1];
+            GlobalMemoryStatus(&MemStatus);
+            MemoryLoad = MemStatus.dwMemoryLoad;
+        }
+
+        if (MemoryLoad >= ExecContext->MemoryLoadTarget) {
+            BelowTarget = FALSE;
+        }
     }
 
-    ExecContext->CurrentConcurrentCount--;
+    ExecContext->LastSampleTick = CurrentTick;
+    ExecContext->LastSampleBelowTarget = BelowTarget;
+    ExecContext->LaunchedSinceSample = FALSE;
+    return BelowTarget;
+}
+
+/**
+ Wait until another process can be launched.  This occurs when fewer than
+ the target number of processes are running and system load is below any
+ target.  If no processes are running, another can always be launched.
+
+ @param ExecContext Pointer to the for exec context containing information
+        about currently running processes.
+ */
+VOID
+ForWaitForCapacity(
+    __in PFOR_EXEC_CONTEXT ExecContext
+    )
+{
+    while (ExecContext->CurrentConcurrentCount > 0) {
+        if (ExecContext->TargetConcurrentCount != 0 &&
+            ExecContext->CurrentConcurrentCount >= ExecContext->TargetConcurrentCount) {
+
+            ForWaitForProcessToComplete(ExecContext, INFINITE);
+        } else if (ForIsLoadBelowTarget(ExecContext)) {
+            break;
+        } else {
+            ForWaitForProcessToComplete(ExecContext, FOR_LOAD_SAMPLE_INTERVAL);
+        }
+    }
 }
 
 /**
@@ -194,12 +1286,19 @@ ForExecuteCommand(
     YORI_STRING CmdLine;
     PROCESS_INFORMATION ProcessInfo;
     STARTUPINFO StartupInfo;
+    DWORD CreationFlags;
+    PFOR_CHILD_OUTPUT Output;
+    HANDLE WritePipe;
 
     YoriLibInitEmptyString(&CmdLine);
+    Output = NULL;
 
 #ifdef YORI_BUILTIN
     if (!ExecContext->InvokeCmd &&
-        ExecContext->TargetConcurrentCount == 1) {
+        ExecContext->TargetConcurrentCount == 1 &&
+        ExecContext->CpuLoadTarget == 0 &&
+        ExecContext->MemoryLoadTarget == 0 &&
+        ExecContext->OutputMode == FOR_OUTPUT_INHERIT) {
         PrefixArgCount = 0;
     } else {
         PrefixArgCount = 2;
@@ -314,24 +1413,76 @@ ForExecuteCommand(
     }
 #endif
 
+    ForWaitForCapacity(ExecContext);
+
     memset(&StartupInfo, 0, sizeof(StartupInfo));
     StartupInfo.cb = sizeof(StartupInfo);
 
-    if (!CreateProcess(NULL, CmdLine.StartOfString, NULL, NULL, TRUE, 0, NULL, NULL, &StartupInfo, &ProcessInfo)) {
+    if (ExecContext->OutputMode != FOR_OUTPUT_INHERIT) {
+        Output = ForCreateChildOutput(ExecContext, &WritePipe);
+        if (Output == NULL) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("for: could not capture output\n"));
+            goto Cleanup;
+        }
+
+        StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+        StartupInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+        StartupInfo.hStdOutput = WritePipe;
+        StartupInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    }
+
+    //
+    //  If processes are being monitored via a job object, start the process
+    //  suspended so that it is in the job before it can exit.
+    //
+
+    CreationFlags = 0;
+    if (ExecContext->Job != NULL) {
+        CreationFlags = CREATE_SUSPENDED;
+    }
+
+    if (!CreateProcess(NULL, CmdLine.StartOfString, NULL, NULL, TRUE, CreationFlags, NULL, NULL, &StartupInfo, &ProcessInfo)) {
         DWORD LastError = GetLastError();
         LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("for: execution failed: %s"), ErrText);
         YoriLibFreeWinErrorText(ErrText);
+        if (Output != NULL) {
+            CloseHandle(WritePipe);
+            ForFreeChildOutput(Output);
+        }
         goto Cleanup;
     }
 
-    CloseHandle(ProcessInfo.hThread);
+    if (Output != NULL) {
+        CloseHandle(WritePipe);
+        Output->Sequence = ExecContext->NextSequenceToLaunch;
+    }
+    ExecContext->NextSequenceToLaunch++;
 
-    ExecContext->HandleArray[ExecContext->CurrentConcurrentCount] = ProcessInfo.hProcess;
-    ExecContext->CurrentConcurrentCount++;
+    //
+    //  If the process cannot be placed in the job, which can occur if this
+    //  program is itself in a job on older versions of Windows, stop using
+    //  the job and wait on process handles instead.
+    //
+
+    if (ExecContext->Job != NULL) {
+        if (!YoriLibAssignProcessToJobObject(ExecContext->Job, ProcessInfo.hProcess)) {
+            CloseHandle(ExecContext->CompletionPort);
+            ExecContext->CompletionPort = NULL;
+            CloseHandle(ExecContext->Job);
+            ExecContext->Job = NULL;
+        }
+        ResumeThread(ProcessInfo.hThread);
+    }
+
+    CloseHandle(ProcessInfo.hThread);
 
-    if (ExecContext->CurrentConcurrentCount == ExecContext->TargetConcurrentCount) {
-        ForWaitForProcessToComplete(ExecContext);
+    if (!ForAddProcess(ExecContext, &ProcessInfo, Output)) {
+        WaitForSingleObject(ProcessInfo.hProcess, INFINITE);
+        CloseHandle(ProcessInfo.hProcess);
+        if (Output != NULL) {
+            ForCompleteChildOutput(ExecContext, Output);
+        }
     }
 
 Cleanup:
@@ -431,7 +1582,7 @@ ENTRYPOINT(
 
     ZeroMemory(&ExecContext, sizeof(ExecContext));
 
-    ExecContext.TargetConcurrentCount = 1;
+    ExecContext.TargetConcurrentCount = 0;
     ExecContext.CurrentConcurrentCount = 0;
     MatchDirectories = FALSE;
     Recurse = FALSE;
@@ -479,6 +1630,12 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("l")) == 0) {
                 StepMode = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("oc")) == 0) {
+                ExecContext.OutputMode = FOR_OUTPUT_COMPLETION_ORDER;
+                ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("ol")) == 0) {
+                ExecContext.OutputMode = FOR_OUTPUT_LIST_ORDER;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("p")) == 0) {
                 if (i + 1 < ArgC) {
                     LONGLONG LlNumberProcesses = 0;
@@ -491,6 +1648,38 @@ ENTRYPOINT(
                     }
                     i++;
                 }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("pc")) == 0) {
+                if (i + 1 < ArgC) {
+                    LONGLONG LlPercent = 0;
+                    DWORD CharsConsumed = 0;
+                    if (!YoriLibStringToNumber(&ArgV[i + 1], TRUE, &LlPercent, &CharsConsumed) ||
+                        CharsConsumed != ArgV[i + 1].LengthInChars ||
+                        LlPercent <= 0 ||
+                        LlPercent > 100) {
+
+                        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("for: invalid load target '%y', must be between 1 and 100\n"), &ArgV[i + 1]);
+                        goto cleanup_and_exit;
+                    }
+                    ExecContext.CpuLoadTarget = (DWORD)LlPercent;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("pm")) == 0) {
+                if (i + 1 < ArgC) {
+                    LONGLONG LlPercent = 0;
+                    DWORD CharsConsumed = 0;
+                    if (!YoriLibStringToNumber(&ArgV[i + 1], TRUE, &LlPercent, &CharsConsumed) ||
+                        CharsConsumed != ArgV[i + 1].LengthInChars ||
+                        LlPercent <= 0 ||
+                        LlPercent > 100) {
+
+                        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("for: invalid load target '%y', must be between 1 and 100\n"), &ArgV[i + 1]);
+                        goto cleanup_and_exit;
+                    }
+                    ExecContext.MemoryLoadTarget = (DWORD)LlPercent;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("r")) == 0) {
                 Recurse = TRUE;
                 ArgumentUnderstood = TRUE;
@@ -515,6 +1704,18 @@ ENTRYPOINT(
         goto cleanup_and_exit;
     }
 
+    //
+    //  If no concurrency was specified, execute one process at a time unless
+    //  processes should be launched based on system load.
+    //
+
+    if (ExecContext.TargetConcurrentCount == 0 &&
+        ExecContext.CpuLoadTarget == 0 &&
+        ExecContext.MemoryLoadTarget == 0) {
+
+        ExecContext.TargetConcurrentCount = 1;
+    }
+
     ExecContext.SubstituteVariable = &ArgV[StartArg];
 
     //
@@ -575,8 +1776,7 @@ ENTRYPOINT(
 
     ExecContext.ArgC = ArgC - CmdArg;
     ExecContext.ArgV = &ArgV[CmdArg];
-    ExecContext.HandleArray = YoriLibMalloc(ExecContext.TargetConcurrentCount * sizeof(HANDLE));
-    if (ExecContext.HandleArray == NULL) {
+    if (!ForInitializeScheduler(&ExecContext)) {
         goto cleanup_and_exit;
     }
 
@@ -772,17 +1972,18 @@ ENTRYPOINT(
     }
 
     while (ExecContext.CurrentConcurrentCount > 0) {
-        ForWaitForProcessToComplete(&ExecContext);
+        ForWaitForProcessToComplete(&ExecContext, INFINITE);
     }
 
     YoriLibFileFiltFreeFilter(&ExecContext.Filter);
-    YoriLibFree(ExecContext.HandleArray);
+    ForCleanupScheduler(&ExecContext);
 
     return EXIT_SUCCESS;
 
 cleanup_and_exit:
 
     YoriLibFileFiltFreeFilter(&ExecContext.Filter);
+    ForCleanupScheduler(&ExecContext);
 
     return EXIT_FAILURE;
 }
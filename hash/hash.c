@@ -45,12 +45,17 @@ CHAR strHashHelpText[] =
         "\n"
         "Hash a file.\n"
         "\n"
-        "HASH [-license] [-a <algorithm>] [-b] [-s] [<file>]\n"
+        "HASH [-license] [-a <algorithm>] [-b] [-p <n>] [-s] [-t [-l]] [<file>]\n"
         "\n"
         "   -a <algorithm> Specify the hash algorithm. Supported algorithms:\n"
-        "                    MD4, MD5, SHA1, SHA256, SHA384, or SHA512\n"
+        "                    MD4, MD5, SHA1, SHA256, SHA384, SHA512, or XXH64\n"
         "   -b             Use basic search criteria for files only\n"
-        "   -s             Hash files in subdirectories\n";
+        "   -l             Output the hash of each part of a file with -t\n"
+        "   -p <n>         Hash up to <n> files concurrently, or <n> parts of a file\n"
+        "                    with -t\n"
+        "   -s             Hash files in subdirectories\n"
+        "   -t             Hash parts of each file concurrently and combine them\n"
+        "                    into a tree hash\n";
 
 /**
  Display usage text to the user.
@@ -66,144 +71,1437 @@ HashHelp()
     return TRUE;
 }
 
+/**
+ The number of bytes to read from a file at a time.
+ */
+#define HASH_READ_BUFFER_LENGTH (1024 * 1024)
+
+/**
+ The number of bytes in each leaf when generating a tree hash.  Each leaf is
+ read with a single read, so this is the same as the read buffer length.
+ */
+#define HASH_TREE_LEAF_SIZE HASH_READ_BUFFER_LENGTH
+
+/**
+ The maximum number of threads to use when hashing files concurrently.
+ */
+#define HASH_MAXIMUM_WORKERS (64)
+
+/**
+ The number of files per worker thread which can be found but not yet
+ output before enumeration waits for earlier files to complete.
+ */
+#define HASH_MAXIMUM_QUEUED_PER_WORKER (64)
+
+/**
+ Buffers used to hash a single stream.  One of these exists for the main
+ thread, and one for each worker thread when hashing files concurrently.
+ */
+typedef struct _HASH_STREAM_BUFFERS {
+
+    /**
+     Pointer to an opaque blob of memory which is used by BCrypt to generate
+     the hash.  This is not allocated if a built in digest is being used.
+     */
+    PVOID ScratchBuffer;
+
+    /**
+     The state of a built in digest.  This is only used if the context is
+     not using BCrypt.
+     */
+    YORI_LIB_DIGEST_CONTEXT Digest;
+
+    /**
+     Pointer to a blob of memory containing the result of the hash calculation
+     for each file.
+     */
+    PUCHAR HashBuffer;
+
+    /**
+     Pointers to buffers to read data from the file into.  While one buffer
+     is being hashed, the next read is being performed into the other.
+     */
+    PVOID ReadBuffer[2];
+
+    /**
+     Overlapped structures describing reads into each ReadBuffer.
+     */
+    OVERLAPPED Overlapped[2];
+
+    /**
+     TRUE if a read has been issued into the corresponding ReadBuffer and
+     has not yet been waited for.
+     */
+    BOOLEAN ReadPending[2];
+
+    /**
+     A string which contains enough characters to contain the hex
+     representation of HashBuffer plus a NULL terminator.
+     */
+    YORI_STRING HashString;
+
+} HASH_STREAM_BUFFERS, *PHASH_STREAM_BUFFERS;
+
+/**
+ A single file found by enumeration which is being hashed by a worker
+ thread.
+ */
+typedef struct _HASH_ITEM {
+
+    /**
+     The entry for this file on the list of files in enumeration order.
+     */
+    YORI_LIST_ENTRY OrderedListEntry;
+
+    /**
+     The entry for this file on the list of files waiting for a worker.
+     */
+    YORI_LIST_ENTRY QueueListEntry;
+
+    /**
+     The full path to the file.  This is allocated as part of the item.
+     */
+    YORI_STRING FilePath;
+
+    /**
+     The part of FilePath to display, relative to the enumeration root.
+     */
+    YORI_STRING RelativePath;
+
+    /**
+     The hex representation of the hash.  This is allocated as part of the
+     item.
+     */
+    YORI_STRING HashString;
+
+    /**
+     If the file could not be opened, the Win32 error describing why.
+     */
+    DWORD OpenError;
+
+    /**
+     TRUE if a failure to open the file should be reported.
+     */
+    BOOLEAN ReportOpenError;
+
+    /**
+     TRUE if the file was opened.
+     */
+    BOOLEAN Opened;
+
+    /**
+     TRUE if the hash was successfully generated into HashString.
+     */
+    BOOLEAN Hashed;
+
+    /**
+     TRUE once a worker has finished processing this file.
+     */
+    BOOLEAN Complete;
+
+} HASH_ITEM, *PHASH_ITEM;
+
+/**
+ Forward declaration of the context used to hash files.
+ */
+typedef struct _HASH_CONTEXT *PHASH_CONTEXT;
+
+/**
+ State for a single worker thread.
+ */
+typedef struct _HASH_WORKER {
+
+    /**
+     Handle to the worker thread.
+     */
+    HANDLE hThread;
+
+    /**
+     Pointer to the context describing the hash to generate.
+     */
+    PHASH_CONTEXT HashContext;
+
+    /**
+     Buffers used by this worker to hash each file.
+     */
+    HASH_STREAM_BUFFERS Buffers;
+
+    /**
+     When generating a tree hash, points to the file whose leaves this
+     worker is hashing.
+     */
+    struct _HASH_TREE_JOB *TreeJob;
+
+} HASH_WORKER, *PHASH_WORKER;
+
+/**
+ A set of threads hashing files concurrently.  Files are output in the order
+ they were found regardless of the order in which they complete.
+ */
+typedef struct _HASH_POOL {
+
+    /**
+     Mutex synchronizing access to the lists and counts in this structure
+     and the state of each item.
+     */
+    HANDLE Mutex;
+
+    /**
+     Semaphore signalled once for each item added to the queue, and once for
+     each worker when the pool is terminating.
+     */
+    HANDLE WorkAvailable;
+
+    /**
+     Event signalled when a worker completes an item.
+     */
+    HANDLE ItemComplete;
+
+    /**
+     List of items in the order they were found, which is the order they are
+     output.
+     */
+    YORI_LIST_ENTRY OrderedList;
+
+    /**
+     List of items which are waiting for a worker.
+     */
+    YORI_LIST_ENTRY Queue;
+
+    /**
+     The number of items on OrderedList.
+     */
+    DWORD ItemsOutstanding;
+
+    /**
+     The number of items on OrderedList before enumeration waits for items
+     to be output.
+     */
+    DWORD MaximumItemsOutstanding;
+
+    /**
+     Set to TRUE to indicate workers should exit once the queue is empty.
+     */
+    BOOLEAN Terminate;
+
+    /**
+     The number of elements in the Workers array.
+     */
+    DWORD WorkerCount;
+
+    /**
+     An array of worker threads.
+     */
+    PHASH_WORKER Workers;
+
+} HASH_POOL, *PHASH_POOL;
+
 /**
  Context passed to the callback which is invoked for each file found.
  */
-typedef struct _HASH_CONTEXT {
+typedef struct _HASH_CONTEXT {
+
+    /**
+     TRUE if file enumeration is being performed recursively; FALSE if it is
+     in one directory only.
+     */
+    BOOLEAN Recursive;
+
+    /**
+     TRUE if the hash is generated by a digest algorithm implemented in
+     YoriLib; FALSE if it is generated by BCrypt.
+     */
+    BOOLEAN UseBuiltinDigest;
+
+    /**
+     If UseBuiltinDigest is TRUE, the digest algorithm to use.
+     */
+    YORI_LIB_DIGEST_ALGORITHM DigestAlgorithm;
+
+    /**
+     BCrypt handle to the algorithm provider.  If NULL, the algorithm provider
+     has not been initialized.
+     */
+    PVOID Algorithm;
+
+    /**
+     The first error encountered when enumerating objects from a single arg.
+     This is used to preserve file not found/path not found errors so that
+     when the program falls back to interpreting the argument as a literal,
+     if that still doesn't work, this is the error code that is displayed.
+     */
+    DWORD SavedErrorThisArg;
+
+    /**
+     Specifies the number of bytes in each ScratchBuffer.
+     */
+    DWORD ScratchBufferLength;
+
+    /**
+     Specifies the number of bytes in each HashBuffer.
+     */
+    DWORD HashLength;
+
+    /**
+     Specifies the number of bytes in each ReadBuffer.
+     */
+    DWORD ReadBufferLength;
+
+    /**
+     Buffers used to hash streams on the main thread.
+     */
+    HASH_STREAM_BUFFERS Buffers;
+
+    /**
+     If files are being hashed concurrently, points to the pool of threads
+     hashing them.  If NULL, files are hashed on the main thread.
+     */
+    PHASH_POOL Pool;
+
+    /**
+     TRUE if each file should be hashed as a tree of fixed size leaves.
+     */
+    BOOLEAN TreeHash;
+
+    /**
+     TRUE if the hash of each leaf should be output when generating a tree
+     hash.
+     */
+    BOOLEAN OutputLeaves;
+
+    /**
+     The number of elements in TreeWorkers.
+     */
+    DWORD TreeWorkerCount;
+
+    /**
+     An array of workers which hash leaves of a file alongside the main
+     thread when generating a tree hash.
+     */
+    PHASH_WORKER TreeWorkers;
+
+    /**
+     Records the total number of files processed.
+     */
+    LONGLONG FilesFound;
+
+    /**
+     Records the total number of files processed within a single command line
+     argument.
+     */
+    LONGLONG FilesFoundThisArg;
+
+} HASH_CONTEXT;
+
+/**
+ Begin generating a hash for a new stream.
+
+ @param HashContext Pointer to a context describing the hash to generate.
+
+ @param Buffers Pointer to the buffers to use to generate the hash.
+
+ @param hHash On successful completion, updated to contain a BCrypt hash
+        handle, or NULL if a built in digest is being used.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+HashStartStream(
+    __in PHASH_CONTEXT HashContext,
+    __in PHASH_STREAM_BUFFERS Buffers,
+    __out PVOID * hHash
+    )
+{
+    LONG Status;
+
+    if (HashContext->UseBuiltinDigest) {
+        YoriLibDigestInitialize(&Buffers->Digest, HashContext->DigestAlgorithm);
+        *hHash = NULL;
+        return TRUE;
+    }
+
+    Status = DllBCrypt.pBCryptCreateHash(HashContext->Algorithm, hHash, Buffers->ScratchBuffer, HashContext->ScratchBufferLength, NULL, 0, 0);
+    if (Status != STATUS_SUCCESS) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Add data to the hash of a stream.
+
+ @param Buffers Pointer to the buffers being used to generate the hash.
+
+ @param hHash The BCrypt hash handle returned from HashStartStream.
+
+ @param Data Pointer to the data to add.
+
+ @param Length The number of bytes in Data.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashStreamData(
+    __in PHASH_STREAM_BUFFERS Buffers,
+    __in_opt PVOID hHash,
+    __in PVOID Data,
+    __in DWORD Length
+    )
+{
+    if (hHash == NULL) {
+        YoriLibDigestUpdate(&Buffers->Digest, Data, Length);
+        return TRUE;
+    }
+
+    if (DllBCrypt.pBCryptHashData(hHash, Data, Length, 0) != STATUS_SUCCESS) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Complete the hash of a stream.  If the stream was hashed successfully, the
+ HashString member of the buffers is updated to contain the hash.
+
+ @param HashContext Pointer to a context describing the hash to generate.
+
+ @param Buffers Pointer to the buffers being used to generate the hash.
+
+ @param hHash The BCrypt hash handle returned from HashStartStream.  This is
+        closed by this function.
+
+ @param Success TRUE if all data was added successfully and the hash should
+        be generated, FALSE if the hash should be abandoned.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashFinishStream(
+    __in PHASH_CONTEXT HashContext,
+    __in PHASH_STREAM_BUFFERS Buffers,
+    __in_opt PVOID hHash,
+    __in BOOL Success
+    )
+{
+    if (Success) {
+        if (hHash == NULL) {
+            Success = YoriLibDigestFinish(&Buffers->Digest, Buffers->HashBuffer, HashContext->HashLength);
+        } else if (DllBCrypt.pBCryptFinishHash(hHash, Buffers->HashBuffer, HashContext->HashLength, 0) != STATUS_SUCCESS) {
+            Success = FALSE;
+        }
+    }
+
+    if (Success) {
+        if (!YoriLibHexBufferToString(Buffers->HashBuffer, HashContext->HashLength, &Buffers->HashString)) {
+            Success = FALSE;
+        }
+    }
+
+    if (hHash != NULL) {
+        DllBCrypt.pBCryptDestroyHash(hHash);
+    }
+
+    return Success;
+}
+
+/**
+ Take a single incoming stream and generate its hash.  This is used for
+ streams which may be pipes and are read synchronously.
+
+ @param hSource A handle to the incoming stream, which may be a file or a
+        pipe.
+ 
+ @param HashContext Pointer to a context describing the actions to perform.
+
+ @param Buffers Pointer to the buffers to use to generate the hash.  On
+        success, the HashString member contains the hash.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashProcessStream(
+    __in HANDLE hSource,
+    __in PHASH_CONTEXT HashContext,
+    __in PHASH_STREAM_BUFFERS Buffers
+    )
+{
+    PVOID hHash;
+    DWORD BytesRead;
+    BOOL Success;
+
+    if (!HashStartStream(HashContext, Buffers, &hHash)) {
+        return FALSE;
+    }
+
+    Success = TRUE;
+
+    while (TRUE) {
+        if (!ReadFile(hSource, Buffers->ReadBuffer[0], HashContext->ReadBufferLength, &BytesRead, NULL)) {
+            break;
+        }
+
+        if (BytesRead == 0) {
+            break;
+        }
+
+        if (!HashStreamData(Buffers, hHash, Buffers->ReadBuffer[0], BytesRead)) {
+            Success = FALSE;
+            break;
+        }
+
+    }
+
+    return HashFinishStream(HashContext, Buffers, hHash, Success);
+}
+
+/**
+ Issue an asynchronous read from a file into one of the read buffers.
+
+ @param hSource A handle to a file opened for overlapped IO.
+
+ @param HashContext Pointer to a context describing the actions to perform.
+
+ @param Buffers Pointer to the buffers to read into.
+
+ @param Index Specifies which of the read buffers to read into.
+
+ @param FileOffset Specifies the offset within the file to read from.
+ */
+VOID
+HashIssueRead(
+    __in HANDLE hSource,
+    __in PHASH_CONTEXT HashContext,
+    __in PHASH_STREAM_BUFFERS Buffers,
+    __in DWORD Index,
+    __in DWORDLONG FileOffset
+    )
+{
+    LPOVERLAPPED Overlapped;
+    DWORD BytesRead;
+
+    Overlapped = &Buffers->Overlapped[Index];
+    Overlapped->Offset = (DWORD)FileOffset;
+    Overlapped->OffsetHigh = (DWORD)(FileOffset >> 32);
+
+    Buffers->ReadPending[Index] = FALSE;
+    if (ReadFile(hSource, Buffers->ReadBuffer[Index], HashContext->ReadBufferLength, &BytesRead, Overlapped) ||
+        GetLastError() == ERROR_IO_PENDING) {
+
+        Buffers->ReadPending[Index] = TRUE;
+    }
+}
+
+/**
+ Wait for a read issued by HashIssueRead to complete.
+
+ @param hSource A handle to a file opened for overlapped IO.
+
+ @param Buffers Pointer to the buffers being read into.
+
+ @param Index Specifies which of the read buffers to wait for.
+
+ @return The number of bytes read.  Zero indicates the end of the file, or
+         that the read failed.
+ */
+DWORD
+HashCompleteRead(
+    __in HANDLE hSource,
+    __in PHASH_STREAM_BUFFERS Buffers,
+    __in DWORD Index
+    )
+{
+    DWORD BytesRead;
+
+    if (!Buffers->ReadPending[Index]) {
+        return 0;
+    }
+
+    Buffers->ReadPending[Index] = FALSE;
+    if (!GetOverlappedResult(hSource, &Buffers->Overlapped[Index], &BytesRead, TRUE)) {
+        return 0;
+    }
+
+    return BytesRead;
+}
+
+/**
+ Generate the hash of a file opened for overlapped IO.  While one buffer is
+ being hashed, the next part of the file is read into the other buffer, so
+ the disk and processor are both kept busy.
+
+ @param hSource A handle to a file opened for overlapped IO.
+
+ @param HashContext Pointer to a context describing the actions to perform.
+
+ @param Buffers Pointer to the buffers to use to generate the hash.  On
+        success, the HashString member contains the hash.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashProcessFile(
+    __in HANDLE hSource,
+    __in PHASH_CONTEXT HashContext,
+    __in PHASH_STREAM_BUFFERS Buffers
+    )
+{
+    PVOID hHash;
+    DWORD BytesRead;
+    DWORD Current;
+    DWORDLONG FileOffset;
+    BOOL Success;
+
+    if (!HashStartStream(HashContext, Buffers, &hHash)) {
+        return FALSE;
+    }
+
+    Success = TRUE;
+    Current = 0;
+    FileOffset = 0;
+    HashIssueRead(hSource, HashContext, Buffers, Current, FileOffset);
+
+    while (TRUE) {
+        BytesRead = HashCompleteRead(hSource, Buffers, Current);
+        if (BytesRead == 0) {
+            break;
+        }
+
+        FileOffset += BytesRead;
+        HashIssueRead(hSource, HashContext, Buffers, 1 - Current, FileOffset);
+
+        if (!HashStreamData(Buffers, hHash, Buffers->ReadBuffer[Current], BytesRead)) {
+            Success = FALSE;
+            break;
+        }
+
+        Current = 1 - Current;
+    }
+
+    //
+    //  If hashing failed, a read may still be outstanding into the other
+    //  buffer.  Wait for it before the buffer can be reused.
+    //
+
+    HashCompleteRead(hSource, Buffers, 1 - Current);
+
+    return HashFinishStream(HashContext, Buffers, hHash, Success);
+}
+
+/**
+ Open a file for hashing.
+
+ @param FilePath Pointer to the full path to the file.
+
+ @return Handle to the file opened for overlapped IO, or INVALID_HANDLE_VALUE
+         on failure.
+ */
+HANDLE
+HashOpenFile(
+    __in PYORI_STRING FilePath
+    )
+{
+    return CreateFile(FilePath->StartOfString,
+                      GENERIC_READ,
+                      FILE_SHARE_READ | FILE_SHARE_DELETE,
+                      NULL,
+                      OPEN_EXISTING,
+                      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN,
+                      NULL);
+}
+
+/**
+ Free the buffers used to hash a single stream.
+
+ @param Buffers Pointer to the buffers to free.
+ */
+VOID
+HashFreeStreamBuffers(
+    __in PHASH_STREAM_BUFFERS Buffers
+    )
+{
+    DWORD Index;
+
+    if (Buffers->ScratchBuffer != NULL) {
+        YoriLibFree(Buffers->ScratchBuffer);
+        Buffers->ScratchBuffer = NULL;
+    }
+
+    if (Buffers->HashBuffer != NULL) {
+        YoriLibFree(Buffers->HashBuffer);
+        Buffers->HashBuffer = NULL;
+    }
+
+    for (Index = 0; Index < sizeof(Buffers->ReadBuffer)/sizeof(Buffers->ReadBuffer[0]); Index++) {
+        if (Buffers->ReadBuffer[Index] != NULL) {
+            YoriLibFree(Buffers->ReadBuffer[Index]);
+            Buffers->ReadBuffer[Index] = NULL;
+        }
+
+        if (Buffers->Overlapped[Index].hEvent != NULL) {
+            CloseHandle(Buffers->Overlapped[Index].hEvent);
+            Buffers->Overlapped[Index].hEvent = NULL;
+        }
+    }
+
+    YoriLibFreeStringContents(&Buffers->HashString);
+}
+
+/**
+ Allocate the buffers used to hash a single stream.  The hash context must
+ have been initialized with the sizes of each buffer.
+
+ @param HashContext Pointer to the hash context describing the buffer sizes.
+
+ @param Buffers Pointer to the buffers to allocate.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashAllocateStreamBuffers(
+    __in PHASH_CONTEXT HashContext,
+    __out PHASH_STREAM_BUFFERS Buffers
+    )
+{
+    DWORD Index;
+
+    ZeroMemory(Buffers, sizeof(HASH_STREAM_BUFFERS));
+
+    Buffers->HashBuffer = YoriLibMalloc(HashContext->HashLength);
+    if (Buffers->HashBuffer == NULL) {
+        HashFreeStreamBuffers(Buffers);
+        return FALSE;
+    }
+
+    if (HashContext->ScratchBufferLength > 0) {
+        Buffers->ScratchBuffer = YoriLibMalloc(HashContext->ScratchBufferLength);
+        if (Buffers->ScratchBuffer == NULL) {
+            HashFreeStreamBuffers(Buffers);
+            return FALSE;
+        }
+    }
+
+    if (!YoriLibAllocateString(&Buffers->HashString, HashContext->HashLength * 2 + 1)) {
+        HashFreeStreamBuffers(Buffers);
+        return FALSE;
+    }
+
+    for (Index = 0; Index < sizeof(Buffers->ReadBuffer)/sizeof(Buffers->ReadBuffer[0]); Index++) {
+        Buffers->ReadBuffer[Index] = YoriLibMalloc(HashContext->ReadBufferLength);
+        if (Buffers->ReadBuffer[Index] == NULL) {
+            HashFreeStreamBuffers(Buffers);
+            return FALSE;
+        }
+
+        Buffers->Overlapped[Index].hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (Buffers->Overlapped[Index].hEvent == NULL) {
+            HashFreeStreamBuffers(Buffers);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Display an error indicating a file could not be opened.
+
+ @param FilePath Pointer to the file that could not be opened.
+
+ @param LastError The Win32 error describing the failure.
+ */
+VOID
+HashReportOpenError(
+    __in PYORI_STRING FilePath,
+    __in DWORD LastError
+    )
+{
+    LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: open of %y failed: %s"), FilePath, ErrText);
+    YoriLibFreeWinErrorText(ErrText);
+}
+
+/**
+ A worker thread which hashes files found by enumeration until the pool is
+ terminated.
+
+ @param Context Pointer to the HASH_WORKER for this thread.
+
+ @return Thread exit code, ignored.
+ */
+DWORD WINAPI
+HashWorker(
+    __in LPVOID Context
+    )
+{
+    PHASH_WORKER Worker = (PHASH_WORKER)Context;
+    PHASH_CONTEXT HashContext = Worker->HashContext;
+    PHASH_POOL Pool = HashContext->Pool;
+    PYORI_LIST_ENTRY ListEntry;
+    PHASH_ITEM Item;
+    HANDLE FileHandle;
+
+    while (TRUE) {
+        WaitForSingleObject(Pool->WorkAvailable, INFINITE);
+
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        ListEntry = YoriLibGetNextListEntry(&Pool->Queue, NULL);
+        if (ListEntry == NULL) {
+            ASSERT(Pool->Terminate);
+            ReleaseMutex(Pool->Mutex);
+            break;
+        }
+        YoriLibRemoveListItem(ListEntry);
+        ReleaseMutex(Pool->Mutex);
+
+        Item = CONTAINING_RECORD(ListEntry, HASH_ITEM, QueueListEntry);
+
+        FileHandle = HashOpenFile(&Item->FilePath);
+        if (FileHandle == INVALID_HANDLE_VALUE) {
+            Item->OpenError = GetLastError();
+        } else {
+            Item->Opened = TRUE;
+            if (HashProcessFile(FileHandle, HashContext, &Worker->Buffers)) {
+                ASSERT(Worker->Buffers.HashString.LengthInChars < Item->HashString.LengthAllocated);
+                memcpy(Item->HashString.StartOfString, Worker->Buffers.HashString.StartOfString, Worker->Buffers.HashString.LengthInChars * sizeof(TCHAR));
+                Item->HashString.LengthInChars = Worker->Buffers.HashString.LengthInChars;
+                Item->Hashed = TRUE;
+            }
+            CloseHandle(FileHandle);
+        }
+
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        Item->Complete = TRUE;
+        ReleaseMutex(Pool->Mutex);
+        SetEvent(Pool->ItemComplete);
+    }
+
+    return 0;
+}
+
+/**
+ Output the result of each completed file at the front of the list of found
+ files, in the order they were found, until the number of files that have
+ not been output is no more than a specified limit.
+
+ @param HashContext Pointer to the hash context.
+
+ @param MaximumItemsOutstanding The number of files which can remain
+        without being output.  Specify zero to wait for all files to be
+        output.
+ */
+VOID
+HashDrainPool(
+    __in PHASH_CONTEXT HashContext,
+    __in DWORD MaximumItemsOutstanding
+    )
+{
+    PHASH_POOL Pool = HashContext->Pool;
+    PYORI_LIST_ENTRY ListEntry;
+    PHASH_ITEM Item;
+
+    while (TRUE) {
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        ListEntry = YoriLibGetNextListEntry(&Pool->OrderedList, NULL);
+        if (ListEntry != NULL) {
+            Item = CONTAINING_RECORD(ListEntry, HASH_ITEM, OrderedListEntry);
+            if (Item->Complete) {
+                YoriLibRemoveListItem(ListEntry);
+                Pool->ItemsOutstanding--;
+                ReleaseMutex(Pool->Mutex);
+
+                if (Item->Opened) {
+                    HashContext->FilesFound++;
+                    HashContext->FilesFoundThisArg++;
+                    HashContext->SavedErrorThisArg = ERROR_SUCCESS;
+                    if (Item->Hashed) {
+                        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y %y\n"), &Item->HashString, &Item->RelativePath);
+                    }
+                } else if (Item->ReportOpenError) {
+                    HashReportOpenError(&Item->FilePath, Item->OpenError);
+                }
+
+                YoriLibFree(Item);
+                continue;
+            }
+        }
+
+        if (Pool->ItemsOutstanding <= MaximumItemsOutstanding) {
+            ReleaseMutex(Pool->Mutex);
+            break;
+        }
+        ReleaseMutex(Pool->Mutex);
+
+        WaitForSingleObject(Pool->ItemComplete, INFINITE);
+    }
+}
+
+/**
+ Add a file to the list of files to be hashed by worker threads.  If too
+ many files are outstanding, this waits for earlier files to be output.
+
+ @param HashContext Pointer to the hash context.
+
+ @param FilePath Pointer to the full path of the file.
+
+ @param RelativePathFrom Pointer to the part of FilePath to display.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashQueueFile(
+    __in PHASH_CONTEXT HashContext,
+    __in PYORI_STRING FilePath,
+    __in PYORI_STRING RelativePathFrom
+    )
+{
+    PHASH_POOL Pool = HashContext->Pool;
+    PHASH_ITEM Item;
+    DWORD HashChars;
+
+    HashChars = HashContext->HashLength * 2 + 1;
+    Item = YoriLibMalloc(sizeof(HASH_ITEM) + (FilePath->LengthInChars + 1 + HashChars) * sizeof(TCHAR));
+    if (Item == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Item, sizeof(HASH_ITEM));
+    YoriLibInitEmptyString(&Item->FilePath);
+    Item->FilePath.StartOfString = (LPTSTR)(Item + 1);
+    memcpy(Item->FilePath.StartOfString, FilePath->StartOfString, FilePath->LengthInChars * sizeof(TCHAR));
+    Item->FilePath.StartOfString[FilePath->LengthInChars] = '\0';
+    Item->FilePath.LengthInChars = FilePath->LengthInChars;
+    Item->FilePath.LengthAllocated = FilePath->LengthInChars + 1;
+
+    YoriLibInitEmptyString(&Item->RelativePath);
+    Item->RelativePath.StartOfString = Item->FilePath.StartOfString + (RelativePathFrom->StartOfString - FilePath->StartOfString);
+    Item->RelativePath.LengthInChars = RelativePathFrom->LengthInChars;
+
+    YoriLibInitEmptyString(&Item->HashString);
+    Item->HashString.StartOfString = Item->FilePath.StartOfString + Item->FilePath.LengthAllocated;
+    Item->HashString.LengthAllocated = HashChars;
+
+    if (HashContext->SavedErrorThisArg == ERROR_SUCCESS) {
+        Item->ReportOpenError = TRUE;
+    }
+
+    WaitForSingleObject(Pool->Mutex, INFINITE);
+    YoriLibAppendList(&Pool->OrderedList, &Item->OrderedListEntry);
+    YoriLibAppendList(&Pool->Queue, &Item->QueueListEntry);
+    Pool->ItemsOutstanding++;
+    ReleaseMutex(Pool->Mutex);
+    ReleaseSemaphore(Pool->WorkAvailable, 1, NULL);
+
+    HashDrainPool(HashContext, Pool->MaximumItemsOutstanding);
+    return TRUE;
+}
+
+/**
+ Wait for all outstanding files to be output, stop all worker threads, and
+ free the pool.
+
+ @param HashContext Pointer to the hash context containing the pool.
+ */
+VOID
+HashTerminatePool(
+    __in PHASH_CONTEXT HashContext
+    )
+{
+    PHASH_POOL Pool = HashContext->Pool;
+    DWORD Index;
+    DWORD ThreadCount;
+
+    if (Pool == NULL) {
+        return;
+    }
+
+    ThreadCount = 0;
+    for (Index = 0; Index < Pool->WorkerCount; Index++) {
+        if (Pool->Workers[Index].hThread != NULL) {
+            ThreadCount++;
+        }
+    }
+
+    if (ThreadCount > 0) {
+        HashDrainPool(HashContext, 0);
+
+        WaitForSingleObject(Pool->Mutex, INFINITE);
+        Pool->Terminate = TRUE;
+        ReleaseMutex(Pool->Mutex);
+        ReleaseSemaphore(Pool->WorkAvailable, ThreadCount, NULL);
+    }
+
+    for (Index = 0; Index < Pool->WorkerCount; Index++) {
+        if (Pool->Workers[Index].hThread != NULL) {
+            WaitForSingleObject(Pool->Workers[Index].hThread, INFINITE);
+            CloseHandle(Pool->Workers[Index].hThread);
+        }
+        HashFreeStreamBuffers(&Pool->Workers[Index].Buffers);
+    }
+
+    if (Pool->Mutex != NULL) {
+        CloseHandle(Pool->Mutex);
+    }
+    if (Pool->WorkAvailable != NULL) {
+        CloseHandle(Pool->WorkAvailable);
+    }
+    if (Pool->ItemComplete != NULL) {
+        CloseHandle(Pool->ItemComplete);
+    }
+
+    YoriLibFree(Pool);
+    HashContext->Pool = NULL;
+}
+
+/**
+ Create a set of worker threads to hash files concurrently.
+
+ @param HashContext Pointer to the hash context, which must already be
+        initialized for the requested algorithm.
+
+ @param WorkerCount The number of worker threads to create.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashCreatePool(
+    __in PHASH_CONTEXT HashContext,
+    __in DWORD WorkerCount
+    )
+{
+    PHASH_POOL Pool;
+    PHASH_WORKER Worker;
+    DWORD Index;
+    DWORD ThreadId;
 
-    /**
-     TRUE if file enumeration is being performed recursively; FALSE if it is
-     in one directory only.
-     */
-    BOOLEAN Recursive;
+    Pool = YoriLibMalloc(sizeof(HASH_POOL) + WorkerCount * sizeof(HASH_WORKER));
+    if (Pool == NULL) {
+        return FALSE;
+    }
 
-    /**
-     BCrypt handle to the algorithm provider.  If NULL, the algorithm provider
-     has not been initialized.
-     */
-    PVOID Algorithm;
+    ZeroMemory(Pool, sizeof(HASH_POOL) + WorkerCount * sizeof(HASH_WORKER));
+    Pool->Workers = (PHASH_WORKER)(Pool + 1);
+    Pool->WorkerCount = WorkerCount;
+    Pool->MaximumItemsOutstanding = WorkerCount * HASH_MAXIMUM_QUEUED_PER_WORKER;
+    YoriLibInitializeListHead(&Pool->OrderedList);
+    YoriLibInitializeListHead(&Pool->Queue);
+    HashContext->Pool = Pool;
+
+    Pool->Mutex = CreateMutex(NULL, FALSE, NULL);
+    Pool->WorkAvailable = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+    Pool->ItemComplete = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (Pool->Mutex == NULL ||
+        Pool->WorkAvailable == NULL ||
+        Pool->ItemComplete == NULL) {
+
+        HashTerminatePool(HashContext);
+        return FALSE;
+    }
 
-    /**
-     Pointer to an opaque blob of memory which is used by BCrypt to generate
-     the hash.
-     */
-    PVOID ScratchBuffer;
+    for (Index = 0; Index < WorkerCount; Index++) {
+        Worker = &Pool->Workers[Index];
+        Worker->HashContext = HashContext;
+        if (!HashAllocateStreamBuffers(HashContext, &Worker->Buffers)) {
+            HashTerminatePool(HashContext);
+            return FALSE;
+        }
 
-    /**
-     The first error encountered when enumerating objects from a single arg.
-     This is used to preserve file not found/path not found errors so that
-     when the program falls back to interpreting the argument as a literal,
-     if that still doesn't work, this is the error code that is displayed.
-     */
-    DWORD SavedErrorThisArg;
+        Worker->hThread = CreateThread(NULL, 0, HashWorker, Worker, 0, &ThreadId);
+        if (Worker->hThread == NULL) {
+            HashTerminatePool(HashContext);
+            return FALSE;
+        }
+    }
 
-    /**
-     Specifies the number of bytes in ScratchBuffer.
-     */
-    DWORD ScratchBufferLength;
+    return TRUE;
+}
+
+/**
+ Describes a single file being hashed as a tree of fixed size leaves.
+ */
+typedef struct _HASH_TREE_JOB {
 
     /**
-     Pointer to a blob of memory containing the result of the hash calculation
-     for each file.
+     Handle to the file, opened for overlapped IO.
      */
-    PUCHAR HashBuffer;
+    HANDLE hSource;
 
     /**
-     Specifies the number of bytes in HashBuffer.
+     Pointer to the context describing the hash to generate.
      */
-    DWORD HashLength;
+    PHASH_CONTEXT HashContext;
 
     /**
-     Pointer to a buffer to read data from the file into.
+     The number of bytes in the file.
      */
-    PVOID ReadBuffer;
+    DWORDLONG FileSize;
 
     /**
-     Specifies the number of bytes in ReadBuffer.
+     The number of leaves in the file.  This is at least one, so an empty
+     file has a single empty leaf.
      */
-    DWORD ReadBufferLength;
+    DWORD LeafCount;
 
     /**
-     A string which contains enough characters to contain the hex
-     representation of HashBuffer plus a NULL terminator.
+     The index of the next leaf to hash.  Threads take leaves by
+     incrementing this value.
      */
-    YORI_STRING HashString;
+    LONG NextLeaf;
 
     /**
-     Records the total number of files processed.
+     Set to nonzero if any leaf could not be hashed.
      */
-    LONGLONG FilesFound;
+    LONG Failed;
 
     /**
-     Records the total number of files processed within a single command line
-     argument.
+     An array of LeafCount hashes, each HashLength bytes long.
      */
-    LONGLONG FilesFoundThisArg;
+    PUCHAR LeafHashes;
 
-} HASH_CONTEXT, *PHASH_CONTEXT;
+} HASH_TREE_JOB, *PHASH_TREE_JOB;
 
 /**
- Take a single incoming stream and break it into pieces.
+ Hash a single leaf of a file in tree hash mode.  The leaf hash is the hash
+ of a zero byte followed by the leaf data, so a leaf can't be confused with
+ an interior node.
 
- @param hSource A handle to the incoming stream, which may be a file or a
-        pipe.
- 
- @param HashContext Pointer to a context describing the actions to perform.
+ @param Job Pointer to the file being hashed.
+
+ @param Buffers Pointer to the buffers to use to hash the leaf.
+
+ @param LeafIndex The index of the leaf to hash.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
-HashProcessStream(
-    __in HANDLE hSource,
-    __in PHASH_CONTEXT HashContext
+HashTreeHashLeaf(
+    __in PHASH_TREE_JOB Job,
+    __in PHASH_STREAM_BUFFERS Buffers,
+    __in DWORD LeafIndex
     )
 {
-    LONG Status;
-    PVOID hHash;
+    PHASH_CONTEXT HashContext = Job->HashContext;
+    DWORDLONG FileOffset;
+    DWORDLONG LeafLength;
     DWORD BytesRead;
+    PVOID hHash;
+    UCHAR Prefix;
+    BOOL Success;
 
-    HashContext->FilesFound++;
-    HashContext->FilesFoundThisArg++;
+    FileOffset = (DWORDLONG)LeafIndex * HASH_TREE_LEAF_SIZE;
+    LeafLength = Job->FileSize - FileOffset;
+    if (LeafLength > HASH_TREE_LEAF_SIZE) {
+        LeafLength = HASH_TREE_LEAF_SIZE;
+    }
 
-    Status = DllBCrypt.pBCryptCreateHash(HashContext->Algorithm, &hHash, HashContext->ScratchBuffer, HashContext->ScratchBufferLength, NULL, 0, 0);
+    BytesRead = 0;
+    if (LeafLength > 0) {
+        HashIssueRead(Job->hSource, HashContext, Buffers, 0, FileOffset);
+        BytesRead = HashCompleteRead(Job->hSource, Buffers, 0);
+        if (BytesRead != (DWORD)LeafLength) {
+            return FALSE;
+        }
+    }
 
-    if (Status != STATUS_SUCCESS) {
+    if (!HashStartStream(HashContext, Buffers, &hHash)) {
         return FALSE;
     }
 
-    Status = STATUS_SUCCESS;
+    Prefix = 0;
+    Success = HashStreamData(Buffers, hHash, &Prefix, sizeof(Prefix));
+    if (Success && BytesRead > 0) {
+        Success = HashStreamData(Buffers, hHash, Buffers->ReadBuffer[0], BytesRead);
+    }
 
-    while (TRUE) {
-        if (!ReadFile(hSource, HashContext->ReadBuffer, HashContext->ReadBufferLength, &BytesRead, NULL)) {
+    if (!HashFinishStream(HashContext, Buffers, hHash, Success)) {
+        return FALSE;
+    }
+
+    memcpy(&Job->LeafHashes[LeafIndex * HashContext->HashLength], Buffers->HashBuffer, HashContext->HashLength);
+    return TRUE;
+}
+
+/**
+ Hash leaves of a file until all leaves have been taken by a thread or a
+ leaf could not be hashed.  This is run by the main thread and each worker
+ thread.
+
+ @param Job Pointer to the file being hashed.
+
+ @param Buffers Pointer to the buffers for this thread to use.
+ */
+VOID
+HashTreeHashLeaves(
+    __in PHASH_TREE_JOB Job,
+    __in PHASH_STREAM_BUFFERS Buffers
+    )
+{
+    DWORD LeafIndex;
+
+    while (Job->Failed == 0) {
+        LeafIndex = (DWORD)(InterlockedIncrement(&Job->NextLeaf) - 1);
+        if (LeafIndex >= Job->LeafCount) {
             break;
         }
 
-        if (BytesRead == 0) {
+        if (!HashTreeHashLeaf(Job, Buffers, LeafIndex)) {
+            InterlockedExchange(&Job->Failed, 1);
             break;
         }
+    }
+}
+
+/**
+ A worker thread which hashes leaves of a file in tree hash mode.
+
+ @param Context Pointer to the HASH_WORKER for this thread.
+
+ @return Thread exit code, ignored.
+ */
+DWORD WINAPI
+HashTreeWorker(
+    __in LPVOID Context
+    )
+{
+    PHASH_WORKER Worker = (PHASH_WORKER)Context;
+
+    HashTreeHashLeaves(Worker->TreeJob, &Worker->Buffers);
+    return 0;
+}
+
+/**
+ Combine an array of leaf hashes into a single root hash.  Each pair of
+ hashes is combined by hashing a one byte followed by both hashes, and a
+ hash without a pair moves to the next level unchanged.  The array is
+ overwritten as each level is calculated.
+
+ @param HashContext Pointer to a context describing the hash to generate.
+
+ @param Buffers Pointer to the buffers to use.  On success, the HashString
+        member contains the root hash.
+
+ @param Hashes Pointer to the array of leaf hashes.
+
+ @param Count The number of hashes in the array.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashTreeCombine(
+    __in PHASH_CONTEXT HashContext,
+    __in PHASH_STREAM_BUFFERS Buffers,
+    __inout PUCHAR Hashes,
+    __in DWORD Count
+    )
+{
+    DWORD HashLength = HashContext->HashLength;
+    DWORD Index;
+    PVOID hHash;
+    UCHAR Prefix;
+    BOOL Success;
+
+    Prefix = 1;
+    while (Count > 1) {
+        for (Index = 0; Index < Count / 2; Index++) {
+            if (!HashStartStream(HashContext, Buffers, &hHash)) {
+                return FALSE;
+            }
+            Success = HashStreamData(Buffers, hHash, &Prefix, sizeof(Prefix));
+            if (Success) {
+                Success = HashStreamData(Buffers, hHash, &Hashes[Index * 2 * HashLength], HashLength * 2);
+            }
+            if (!HashFinishStream(HashContext, Buffers, hHash, Success)) {
+                return FALSE;
+            }
+            memcpy(&Hashes[Index * HashLength], Buffers->HashBuffer, HashLength);
+        }
+
+        if ((Count % 2) != 0) {
+            memcpy(&Hashes[Index * HashLength], &Hashes[(Count - 1) * HashLength], HashLength);
+        }
+
+        Count = (Count + 1) / 2;
+    }
+
+    return YoriLibHexBufferToString(Hashes, HashLength, &Buffers->HashString);
+}
+
+/**
+ Generate a tree hash for a file.  The file is divided into fixed size
+ leaves which are hashed concurrently by the main thread and any tree
+ worker threads, and the leaf hashes are combined into a root hash.  The
+ root hash, and optionally each leaf hash, is output.
+
+ @param hSource A handle to a file opened for overlapped IO.
+
+ @param HashContext Pointer to a context describing the hash to generate.
+
+ @param RelativePath Pointer to the name of the file to display.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashProcessTree(
+    __in HANDLE hSource,
+    __in PHASH_CONTEXT HashContext,
+    __in PYORI_STRING RelativePath
+    )
+{
+    HASH_TREE_JOB Job;
+    DWORD FileSizeHigh;
+    DWORD FileSizeLow;
+    DWORDLONG LeafCount;
+    DWORD Index;
+    DWORD ThreadsStarted;
+    DWORD ThreadId;
+    PHASH_WORKER Worker;
+    BOOL Result;
+
+    ZeroMemory(&Job, sizeof(Job));
+    Job.hSource = hSource;
+    Job.HashContext = HashContext;
 
-        Status = DllBCrypt.pBCryptHashData(hHash, HashContext->ReadBuffer, BytesRead, 0);
-        if (Status != STATUS_SUCCESS) {
+    FileSizeLow = GetFileSize(hSource, &FileSizeHigh);
+    if (FileSizeLow == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        return FALSE;
+    }
+    Job.FileSize = ((DWORDLONG)FileSizeHigh << 32) | FileSizeLow;
+
+    LeafCount = (Job.FileSize + HASH_TREE_LEAF_SIZE - 1) / HASH_TREE_LEAF_SIZE;
+    if (LeafCount == 0) {
+        LeafCount = 1;
+    }
+    if (LeafCount > (DWORD)-1 / HashContext->HashLength) {
+        return FALSE;
+    }
+    Job.LeafCount = (DWORD)LeafCount;
+
+    Job.LeafHashes = YoriLibMalloc(Job.LeafCount * HashContext->HashLength);
+    if (Job.LeafHashes == NULL) {
+        return FALSE;
+    }
+
+    //
+    //  Start worker threads for large files, then hash leaves on this
+    //  thread too.  If a thread cannot be started, the remaining threads,
+    //  including this one, hash its leaves instead.
+    //
+
+    ThreadsStarted = 0;
+    for (Index = 0; Index < HashContext->TreeWorkerCount && Index + 1 < Job.LeafCount; Index++) {
+        Worker = &HashContext->TreeWorkers[Index];
+        Worker->TreeJob = &Job;
+        Worker->hThread = CreateThread(NULL, 0, HashTreeWorker, Worker, 0, &ThreadId);
+        if (Worker->hThread == NULL) {
             break;
         }
+        ThreadsStarted++;
+    }
 
+    HashTreeHashLeaves(&Job, &HashContext->Buffers);
+
+    for (Index = 0; Index < ThreadsStarted; Index++) {
+        Worker = &HashContext->TreeWorkers[Index];
+        WaitForSingleObject(Worker->hThread, INFINITE);
+        CloseHandle(Worker->hThread);
+        Worker->hThread = NULL;
+        Worker->TreeJob = NULL;
     }
 
-    if (Status == STATUS_SUCCESS) {
-        Status = DllBCrypt.pBCryptFinishHash(hHash, HashContext->HashBuffer, HashContext->HashLength, 0);
-        if (Status == STATUS_SUCCESS) {
-            if (!YoriLibHexBufferToString(HashContext->HashBuffer, HashContext->HashLength, &HashContext->HashString)) {
-                Status = !(STATUS_SUCCESS);
+    Result = FALSE;
+    if (Job.Failed == 0) {
+
+        //
+        //  Output leaf hashes before combining, since combining overwrites
+        //  the array.
+        //
+
+        if (HashContext->OutputLeaves) {
+            for (Index = 0; Index < Job.LeafCount; Index++) {
+                if (YoriLibHexBufferToString(&Job.LeafHashes[Index * HashContext->HashLength], HashContext->HashLength, &HashContext->Buffers.HashString)) {
+                    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y %y @%016llx\n"), &HashContext->Buffers.HashString, RelativePath, (DWORDLONG)Index * HASH_TREE_LEAF_SIZE);
+                }
             }
         }
+
+        if (HashTreeCombine(HashContext, &HashContext->Buffers, Job.LeafHashes, Job.LeafCount)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y %y\n"), &HashContext->Buffers.HashString, RelativePath);
+            Result = TRUE;
+        }
     }
 
-    DllBCrypt.pBCryptDestroyHash(hHash);
+    YoriLibFree(Job.LeafHashes);
+    return Result;
+}
 
-    if (Status != STATUS_SUCCESS) {
+/**
+ Free the buffers used by tree hash worker threads.
+
+ @param HashContext Pointer to the hash context.
+ */
+VOID
+HashFreeTreeWorkers(
+    __in PHASH_CONTEXT HashContext
+    )
+{
+    DWORD Index;
+
+    if (HashContext->TreeWorkers == NULL) {
+        return;
+    }
+
+    for (Index = 0; Index < HashContext->TreeWorkerCount; Index++) {
+        ASSERT(HashContext->TreeWorkers[Index].hThread == NULL);
+        HashFreeStreamBuffers(&HashContext->TreeWorkers[Index].Buffers);
+    }
+
+    YoriLibFree(HashContext->TreeWorkers);
+    HashContext->TreeWorkers = NULL;
+    HashContext->TreeWorkerCount = 0;
+}
+
+/**
+ Allocate buffers for threads to hash leaves of a file in tree hash mode.
+ The threads themselves are created for each file.
+
+ @param HashContext Pointer to the hash context, which must already be
+        initialized for the requested algorithm.
+
+ @param WorkerCount The number of threads to hash each file with, including
+        the main thread.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HashCreateTreeWorkers(
+    __in PHASH_CONTEXT HashContext,
+    __in DWORD WorkerCount
+    )
+{
+    DWORD Index;
+
+    if (WorkerCount <= 1) {
+        return TRUE;
+    }
+
+    HashContext->TreeWorkers = YoriLibMalloc((WorkerCount - 1) * sizeof(HASH_WORKER));
+    if (HashContext->TreeWorkers == NULL) {
         return FALSE;
     }
 
+    ZeroMemory(HashContext->TreeWorkers, (WorkerCount - 1) * sizeof(HASH_WORKER));
+    for (Index = 0; Index < WorkerCount - 1; Index++) {
+        HashContext->TreeWorkers[Index].HashContext = HashContext;
+        if (!HashAllocateStreamBuffers(HashContext, &HashContext->TreeWorkers[Index].Buffers)) {
+            HashContext->TreeWorkerCount = Index;
+            HashFreeTreeWorkers(HashContext);
+            return FALSE;
+        }
+    }
+
+    HashContext->TreeWorkerCount = WorkerCount - 1;
     return TRUE;
 }
 
@@ -258,28 +1556,32 @@ HashFileFoundCallback(
     RelativePathFrom.StartOfString = &FilePath->StartOfString[Index];
     RelativePathFrom.LengthInChars = FilePath->LengthInChars - Index;
 
-    FileHandle = CreateFile(FilePath->StartOfString,
-                            GENERIC_READ,
-                            FILE_SHARE_READ | FILE_SHARE_DELETE,
-                            NULL,
-                            OPEN_EXISTING,
-                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
-                            NULL);
+    //
+    //  If files are being hashed concurrently, hand the file to a worker.
+    //  The result is output once all earlier files have been output.
+    //
+
+    if (HashContext->Pool != NULL) {
+        return HashQueueFile(HashContext, FilePath, &RelativePathFrom);
+    }
+
+    FileHandle = HashOpenFile(FilePath);
 
     if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
         if (HashContext->SavedErrorThisArg == ERROR_SUCCESS) {
-            DWORD LastError = GetLastError();
-            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: open of %y failed: %s"), FilePath, ErrText);
-            YoriLibFreeWinErrorText(ErrText);
+            HashReportOpenError(FilePath, GetLastError());
         }
         return TRUE;
     }
 
     HashContext->SavedErrorThisArg = ERROR_SUCCESS;
+    HashContext->FilesFound++;
+    HashContext->FilesFoundThisArg++;
 
-    if (HashProcessStream(FileHandle, HashContext)) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y %y\n"), &HashContext->HashString, &RelativePathFrom);
+    if (HashContext->TreeHash) {
+        HashProcessTree(FileHandle, HashContext, &RelativePathFrom);
+    } else if (HashProcessFile(FileHandle, HashContext, &HashContext->Buffers)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y %y\n"), &HashContext->Buffers.HashString, &RelativePathFrom);
     }
 
     CloseHandle(FileHandle);
@@ -300,22 +1602,9 @@ HashCleanupContext(
 {
     LONG Status;
 
-    if (HashContext->ScratchBuffer != NULL) {
-        YoriLibFree(HashContext->ScratchBuffer);
-        HashContext->ScratchBuffer = NULL;
-    }
-
-    if (HashContext->HashBuffer != NULL) {
-        YoriLibFree(HashContext->HashBuffer);
-        HashContext->HashBuffer = NULL;
-    }
-
-    if (HashContext->ReadBuffer != NULL) {
-        YoriLibFree(HashContext->ReadBuffer);
-        HashContext->ReadBuffer = NULL;
-    }
-
-    YoriLibFreeStringContents(&HashContext->HashString);
+    HashTerminatePool(HashContext);
+    HashFreeTreeWorkers(HashContext);
+    HashFreeStreamBuffers(&HashContext->Buffers);
 
     if (HashContext->Algorithm != NULL) {
         Status = DllBCrypt.pBCryptCloseAlgorithmProvider(HashContext->Algorithm, 0);
@@ -331,7 +1620,8 @@ HashCleanupContext(
  @param HashContext Pointer to the hash context to initialize.
 
  @param Algorithm Specifies a NULL terminated string indicating the BCrypt
-        hash algorithm to initialize.
+        hash algorithm to initialize.  This is ignored if the context is
+        using a built in digest algorithm.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
@@ -344,6 +1634,18 @@ HashInitializeContext(
     LONG Status;
     DWORD BytesReturned;
 
+    HashContext->ReadBufferLength = HASH_READ_BUFFER_LENGTH;
+
+    if (HashContext->UseBuiltinDigest) {
+        HashContext->HashLength = YoriLibDigestGetLength(HashContext->DigestAlgorithm);
+        HashContext->ScratchBufferLength = 0;
+        if (!HashAllocateStreamBuffers(HashContext, &HashContext->Buffers)) {
+            HashCleanupContext(HashContext);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
     Status = DllBCrypt.pBCryptOpenAlgorithmProvider(&HashContext->Algorithm, Algorithm, MS_PRIMITIVE_PROVIDER, 0);
     if (Status != STATUS_SUCCESS) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: algorithm provider not functional, status 0x%08x\n"), Status);
@@ -358,12 +1660,6 @@ HashInitializeContext(
         return FALSE;
     }
 
-    HashContext->HashBuffer = YoriLibMalloc(HashContext->HashLength);
-    if (HashContext->HashBuffer == NULL) {
-        HashCleanupContext(HashContext);
-        return FALSE;
-    }
-
     Status = DllBCrypt.pBCryptGetProperty(HashContext->Algorithm, L"ObjectLength", &HashContext->ScratchBufferLength, sizeof(HashContext->ScratchBufferLength), &BytesReturned, 0);
     if (Status != STATUS_SUCCESS) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: algorithm provider did not return required scratch space, status 0x%08x\n"), Status);
@@ -371,21 +1667,7 @@ HashInitializeContext(
         return FALSE;
     }
 
-    HashContext->ScratchBuffer = YoriLibMalloc(HashContext->ScratchBufferLength);
-    if (HashContext->ScratchBuffer == NULL) {
-        HashCleanupContext(HashContext);
-        return FALSE;
-    }
-
-    if (!YoriLibAllocateString(&HashContext->HashString, HashContext->HashLength * 2 + 1)) {
-        HashCleanupContext(HashContext);
-        return FALSE;
-    }
-
-    HashContext->ReadBufferLength = 1024 * 1024;
-
-    HashContext->ReadBuffer = YoriLibMalloc(HashContext->ReadBufferLength);
-    if (HashContext->ReadBuffer == NULL) {
+    if (!HashAllocateStreamBuffers(HashContext, &HashContext->Buffers)) {
         HashCleanupContext(HashContext);
         return FALSE;
     }
@@ -489,7 +1771,8 @@ ENTRYPOINT(
     BOOL BasicEnumeration = FALSE;
     HASH_CONTEXT HashContext;
     YORI_STRING Arg;
-    LPTSTR Algorithm = L"SHA1";
+    LPTSTR Algorithm = NULL;
+    DWORD WorkerCount = 0;
 
     ZeroMemory(&HashContext, sizeof(HashContext));
 
@@ -508,7 +1791,11 @@ ENTRYPOINT(
                 return EXIT_SUCCESS;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("a")) == 0) {
                 if (i + 1 < ArgC) {
-                    if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("MD4")) == 0) {
+                    if (YoriLibDigestAlgorithmFromString(&ArgV[i + 1], &HashContext.DigestAlgorithm)) {
+                        ArgumentUnderstood = TRUE;
+                        i++;
+                        Algorithm = NULL;
+                    } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("MD4")) == 0) {
                         ArgumentUnderstood = TRUE;
                         i++;
                         Algorithm = _T("MD4");
@@ -516,14 +1803,6 @@ ENTRYPOINT(
                         ArgumentUnderstood = TRUE;
                         i++;
                         Algorithm = _T("MD5");
-                    } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("SHA1")) == 0) {
-                        ArgumentUnderstood = TRUE;
-                        i++;
-                        Algorithm = _T("SHA1");
-                    } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("SHA256")) == 0) {
-                        ArgumentUnderstood = TRUE;
-                        i++;
-                        Algorithm = _T("SHA256");
                     } else if (YoriLibCompareStringWithLiteralInsensitive(&ArgV[i + 1], _T("SHA384")) == 0) {
                         ArgumentUnderstood = TRUE;
                         i++;
@@ -533,16 +1812,36 @@ ENTRYPOINT(
                         i++;
                         Algorithm = _T("SHA512");
                     } else {
-                        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: algorithm not recognized.  Supported algorithms are MD4, MD5, SHA1, SHA256, SHA384, and SHA512\n"));
+                        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: algorithm not recognized.  Supported algorithms are MD4, MD5, SHA1, SHA256, SHA384, SHA512, and XXH64\n"));
                         return EXIT_FAILURE;
                     }
                 }
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("b")) == 0) {
                 BasicEnumeration = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("l")) == 0) {
+                HashContext.OutputLeaves = TRUE;
+                ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("p")) == 0) {
+                if (i + 1 < ArgC) {
+                    LONGLONG LlWorkerCount = 0;
+                    DWORD CharsConsumed = 0;
+                    YoriLibStringToNumber(&ArgV[i + 1], TRUE, &LlWorkerCount, &CharsConsumed);
+                    if (LlWorkerCount < 1) {
+                        LlWorkerCount = 1;
+                    } else if (LlWorkerCount > HASH_MAXIMUM_WORKERS) {
+                        LlWorkerCount = HASH_MAXIMUM_WORKERS;
+                    }
+                    WorkerCount = (DWORD)LlWorkerCount;
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("s")) == 0) {
                 HashContext.Recursive = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("t")) == 0) {
+                HashContext.TreeHash = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("-")) == 0) {
                 StartArg = i + 1;
                 ArgumentUnderstood = TRUE;
@@ -559,14 +1858,22 @@ ENTRYPOINT(
         }
     }
 
-    YoriLibLoadBCryptFunctions();
-    if (DllBCrypt.pBCryptCloseAlgorithmProvider == NULL ||
-        DllBCrypt.pBCryptCreateHash == NULL ||
-        DllBCrypt.pBCryptDestroyHash == NULL ||
-        DllBCrypt.pBCryptFinishHash == NULL ||
-        DllBCrypt.pBCryptGetProperty == NULL ||
-        DllBCrypt.pBCryptHashData == NULL ||
-        DllBCrypt.pBCryptOpenAlgorithmProvider == NULL) {
+    //
+    //  SHA1, SHA256 and XXH64 are implemented in YoriLib, which avoids the
+    //  per call cost of BCrypt and works where BCrypt is not present.  Other
+    //  algorithms use BCrypt.
+    //
+
+    if (Algorithm == NULL) {
+        HashContext.UseBuiltinDigest = TRUE;
+    } else if (!YoriLibLoadBCryptFunctions() ||
+               DllBCrypt.pBCryptCloseAlgorithmProvider == NULL ||
+               DllBCrypt.pBCryptCreateHash == NULL ||
+               DllBCrypt.pBCryptDestroyHash == NULL ||
+               DllBCrypt.pBCryptFinishHash == NULL ||
+               DllBCrypt.pBCryptGetProperty == NULL ||
+               DllBCrypt.pBCryptHashData == NULL ||
+               DllBCrypt.pBCryptOpenAlgorithmProvider == NULL) {
 
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: operating system support not present\n"));
         return EXIT_FAILURE;
@@ -599,11 +1906,18 @@ ENTRYPOINT(
             return EXIT_FAILURE;
         }
 
-        if (!HashProcessStream(GetStdHandle(STD_INPUT_HANDLE), &HashContext)) {
+        if (HashContext.TreeHash) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hash: tree hashing requires a file\n"));
+            HashCleanupContext(&HashContext);
+            return EXIT_FAILURE;
+        }
+
+        HashContext.FilesFound++;
+        if (!HashProcessStream(GetStdHandle(STD_INPUT_HANDLE), &HashContext, &HashContext.Buffers)) {
             HashCleanupContext(&HashContext);
             return EXIT_FAILURE;
         }
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &HashContext.HashString);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &HashContext.Buffers.HashString);
     } else {
         MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_DIRECTORY_CONTENTS;
         if (BasicEnumeration) {
@@ -613,6 +1927,28 @@ ENTRYPOINT(
             MatchFlags |= YORILIB_FILEENUM_RECURSE_AFTER_RETURN | YORILIB_FILEENUM_RECURSE_PRESERVE_WILD;
         }
 
+        //
+        //  In tree mode, each file is hashed by several threads, using the
+        //  number of processors unless a count was specified.  Otherwise,
+        //  if concurrent hashing was requested, each file is hashed by a
+        //  worker.  If the threads could not be created, hash on this
+        //  thread.
+        //
+
+        if (HashContext.TreeHash) {
+            if (WorkerCount == 0) {
+                SYSTEM_INFO SystemInfo;
+                GetSystemInfo(&SystemInfo);
+                WorkerCount = SystemInfo.dwNumberOfProcessors;
+                if (WorkerCount > HASH_MAXIMUM_WORKERS) {
+                    WorkerCount = HASH_MAXIMUM_WORKERS;
+                }
+            }
+            HashCreateTreeWorkers(&HashContext, WorkerCount);
+        } else if (WorkerCount > 1) {
+            HashCreatePool(&HashContext, WorkerCount);
+        }
+
         for (i = StartArg; i < ArgC; i++) {
 
             HashContext.FilesFoundThisArg = 0;
@@ -625,11 +1961,18 @@ ENTRYPOINT(
                                  HashFileEnumerateErrorCallback,
                                  &HashContext);
 
+            if (HashContext.Pool != NULL) {
+                HashDrainPool(&HashContext, 0);
+            }
+
             if (HashContext.FilesFoundThisArg == 0) {
                 YORI_STRING FullPath;
                 YoriLibInitEmptyString(&FullPath);
                 if (YoriLibUserStringToSingleFilePath(&ArgV[i], TRUE, &FullPath)) {
                     HashFileFoundCallback(&FullPath, NULL, 0, &HashContext);
+                    if (HashContext.Pool != NULL) {
+                        HashDrainPool(&HashContext, 0);
+                    }
                     YoriLibFreeStringContents(&FullPath);
                 }
                 if (HashContext.SavedErrorThisArg != ERROR_SUCCESS) {
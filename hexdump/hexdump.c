@@ -600,6 +600,7 @@ HexDumpReverseProcessStream(
     )
 {
     PVOID LineContext = NULL;
+    YORI_LIB_LINE_VIEW LineView;
     YORI_STRING LineString;
     HANDLE OutputHandle;
     DWORD BytesWritten;
@@ -609,12 +610,20 @@ HexDumpReverseProcessStream(
     HexDumpContext->FilesFound++;
     HexDumpContext->FilesFoundThisArg++;
 
-    if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+    if (!YoriLibLineViewOpen(hSource, &LineContext)) {
+        return FALSE;
+    }
+
+    if (!YoriLibLineViewNext(LineContext, &LineView) ||
+        !YoriLibLineViewToString(&LineView, &LineString)) {
+
+        YoriLibLineViewClose(LineContext);
+        YoriLibFreeStringContents(&LineString);
         return TRUE;
     }
 
     if (!HexDumpDetectReverseFormatFromLine(&LineString, &ReverseContext)) {
-        YoriLibLineReadClose(LineContext);
+        YoriLibLineViewClose(LineContext);
         YoriLibFreeStringContents(&LineString);
         return FALSE;
     }
@@ -629,12 +638,14 @@ HexDumpReverseProcessStream(
 
         WriteFile(OutputHandle, ReverseContext.OutputBuffer, ReverseContext.BytesThisLine, &BytesWritten, NULL);
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibLineViewNext(LineContext, &LineView) ||
+            !YoriLibLineViewToString(&LineView, &LineString)) {
+
             break;
         }
     }
 
-    YoriLibLineReadClose(LineContext);
+    YoriLibLineViewClose(LineContext);
     YoriLibFreeStringContents(&LineString);
 
     return TRUE;
@@ -1310,15 +1321,27 @@ ENTRYPOINT(
 
     YoriLibEnableBackupPrivilege();
 
+    //
+    //  Reverse mode writes binary data directly to the output handle, so
+    //  only buffer output when generating text.
+    //
+
+    if (!Reverse) {
+        YoriLibOutputBufferEnable(YORI_LIB_OUTPUT_STDOUT);
+    }
+
     if (DiffMode) {
         if (StartArg == 0 || StartArg + 2 > ArgC) {
+            YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
             YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hexdump: insufficient arguments\n"));
             return EXIT_FAILURE;
         }
 
         if (!HexDumpDisplayDiff(&ArgV[StartArg], &ArgV[StartArg + 1], &HexDumpContext)) {
+            YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
             return EXIT_FAILURE;
         }
+        YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
         return EXIT_SUCCESS;
     }
 
@@ -1329,6 +1352,7 @@ ENTRYPOINT(
 
     if (StartArg == 0 || StartArg == ArgC) {
         if (YoriLibIsStdInConsole()) {
+            YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
             YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("No file or pipe for input\n"));
             return EXIT_FAILURE;
         }
@@ -1386,6 +1410,8 @@ ENTRYPOINT(
         }
     }
 
+    YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
+
     if (HexDumpContext.FilesFound == 0) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("hexdump: no matching files found\n"));
         return EXIT_FAILURE;
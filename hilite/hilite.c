@@ -90,6 +90,12 @@ typedef struct _HILITE_MATCH_CRITERIA {
      */
     YORI_STRING MatchString;
 
+    /**
+     For a contains match, the index of this criteria within the array of
+     strings used to build the contains matcher.
+     */
+    DWORD ContainsIndex;
+
     /**
      The color to apply to the line, in event of a match.
      */
@@ -128,8 +134,74 @@ typedef struct _HILITE_CONTEXT {
      */
     YORI_LIST_ENTRY Matches;
 
+    /**
+     An array of the strings from all contains criteria, in the order the
+     criteria are applied.
+     */
+    PYORI_STRING ContainsStrings;
+
+    /**
+     A matcher built from ContainsStrings, so that a line only needs to be
+     searched once regardless of the number of contains criteria.  If NULL,
+     each contains criteria is searched for individually.
+     */
+    PVOID ContainsMatcher;
+
 } HILITE_CONTEXT, *PHILITE_CONTEXT;
 
+/**
+ Compile the strings from all contains criteria into a single matcher.  If
+ this fails, the criteria are searched for individually.
+
+ @param HiliteContext Pointer to the context containing the criteria.
+ */
+VOID
+HiliteBuildContainsMatcher(
+    __in PHILITE_CONTEXT HiliteContext
+    )
+{
+    PHILITE_MATCH_CRITERIA MatchCriteria;
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD ContainsCount;
+
+    ContainsCount = 0;
+    ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, NULL);
+    while (ListEntry != NULL) {
+        MatchCriteria = CONTAINING_RECORD(ListEntry, HILITE_MATCH_CRITERIA, ListEntry);
+        if (MatchCriteria->MatchType == HiliteMatchTypeContains) {
+            ContainsCount++;
+        }
+        ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, ListEntry);
+    }
+
+    if (ContainsCount == 0) {
+        return;
+    }
+
+    HiliteContext->ContainsStrings = YoriLibMalloc(ContainsCount * sizeof(YORI_STRING));
+    if (HiliteContext->ContainsStrings == NULL) {
+        return;
+    }
+
+    ContainsCount = 0;
+    ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, NULL);
+    while (ListEntry != NULL) {
+        MatchCriteria = CONTAINING_RECORD(ListEntry, HILITE_MATCH_CRITERIA, ListEntry);
+        if (MatchCriteria->MatchType == HiliteMatchTypeContains) {
+            MatchCriteria->ContainsIndex = ContainsCount;
+            YoriLibInitEmptyString(&HiliteContext->ContainsStrings[ContainsCount]);
+            HiliteContext->ContainsStrings[ContainsCount].StartOfString = MatchCriteria->MatchString.StartOfString;
+            HiliteContext->ContainsStrings[ContainsCount].LengthInChars = MatchCriteria->MatchString.LengthInChars;
+            ContainsCount++;
+        }
+        ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, ListEntry);
+    }
+
+    if (!YoriLibSubstringMatcherCreate(ContainsCount, HiliteContext->ContainsStrings, HiliteContext->Insensitive, &HiliteContext->ContainsMatcher)) {
+        HiliteContext->ContainsMatcher = NULL;
+    }
+}
+
 /**
  Process a stream and apply the hilite criteria before outputting to standard
  output.
@@ -153,6 +225,8 @@ HiliteProcessStream(
     PHILITE_MATCH_CRITERIA MatchCriteria;
     YORILIB_COLOR_ATTRIBUTES ColorToUse;
     PYORI_LIST_ENTRY ListEntry;
+    PYORI_STRING FoundMatch;
+    DWORD LowestContainsIndex;
 
     YoriLibInitEmptyString(&LineString);
 
@@ -167,6 +241,20 @@ HiliteProcessStream(
         ColorToUse.Ctrl = HiliteContext->DefaultColor.Ctrl;
         ColorToUse.Win32Attr = HiliteContext->DefaultColor.Win32Attr;
 
+        //
+        //  Find the first contains criteria that matches anywhere in the
+        //  line with a single pass.  Any earlier contains criteria cannot
+        //  match, and later ones don't matter.
+        //
+
+        LowestContainsIndex = (DWORD)-1;
+        if (HiliteContext->ContainsMatcher != NULL) {
+            FoundMatch = YoriLibSubstringMatcherFindLowestPattern(HiliteContext->ContainsMatcher, &LineString);
+            if (FoundMatch != NULL) {
+                LowestContainsIndex = (DWORD)(FoundMatch - HiliteContext->ContainsStrings);
+            }
+        }
+
         //
         //  Enumerate through the matches and see if there is anything to
         //  apply.
@@ -216,7 +304,13 @@ HiliteProcessStream(
                     }
                 }
             } else if (MatchCriteria->MatchType == HiliteMatchTypeContains) {
-                if (HiliteContext->Insensitive) {
+                if (HiliteContext->ContainsMatcher != NULL) {
+                    if (MatchCriteria->ContainsIndex == LowestContainsIndex) {
+                        ColorToUse.Ctrl = MatchCriteria->Color.Ctrl;
+                        ColorToUse.Win32Attr = MatchCriteria->Color.Win32Attr;
+                        break;
+                    }
+                } else if (HiliteContext->Insensitive) {
                     if (YoriLibFindFirstMatchingSubstringInsensitive(&LineString, 1, &MatchCriteria->MatchString, NULL)) {
                         ColorToUse.Ctrl = MatchCriteria->Color.Ctrl;
                         ColorToUse.Win32Attr = MatchCriteria->Color.Win32Attr;
@@ -387,6 +481,16 @@ HiliteCleanupContext(
         YoriLibFree(MatchCriteria);
         ListEntry = YoriLibGetNextListEntry(&HiliteContext->Matches, NULL);
     }
+
+    if (HiliteContext->ContainsMatcher != NULL) {
+        YoriLibSubstringMatcherFree(HiliteContext->ContainsMatcher);
+        HiliteContext->ContainsMatcher = NULL;
+    }
+
+    if (HiliteContext->ContainsStrings != NULL) {
+        YoriLibFree(HiliteContext->ContainsStrings);
+        HiliteContext->ContainsStrings = NULL;
+    }
 }
 
 
@@ -538,6 +642,8 @@ ENTRYPOINT(
 
     YoriLibEnableBackupPrivilege();
 
+    HiliteBuildContainsMatcher(&HiliteContext);
+
     //
     //  If no file name is specified, use stdin; otherwise open
     //  the file and use that
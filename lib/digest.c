@@ -0,0 +1,928 @@
+/**
+ * @file lib/digest.c
+ *
+ * Yori portable message digest routines
+ *
+ * Copyright (c) 2019 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yoripch.h"
+#include "yorilib.h"
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1900) && defined(_M_AMD64)
+/**
+ Indicate that implementations using the SHA instruction set extensions
+ should be compiled.  These are only used if the processor supports them.
+ */
+#define YORI_DIGEST_SHA_EXTENSIONS 1
+#include <intrin.h>
+#include <immintrin.h>
+#else
+/**
+ Indicate that implementations using the SHA instruction set extensions
+ should not be compiled.
+ */
+#define YORI_DIGEST_SHA_EXTENSIONS 0
+#endif
+
+/**
+ Rotate a 32 bit value left by a number of bits.
+ */
+#define YORI_DIGEST_ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+ Rotate a 32 bit value right by a number of bits.
+ */
+#define YORI_DIGEST_ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ Rotate a 64 bit value left by a number of bits.
+ */
+#define YORI_DIGEST_ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+/**
+ Load a 32 bit big endian value from a byte buffer.
+ */
+#define YORI_DIGEST_LOAD32BE(p) \
+    (((DWORD)(p)[0] << 24) | ((DWORD)(p)[1] << 16) | ((DWORD)(p)[2] << 8) | (DWORD)(p)[3])
+
+/**
+ Load a 32 bit little endian value from a byte buffer.
+ */
+#define YORI_DIGEST_LOAD32LE(p) \
+    (((DWORD)(p)[3] << 24) | ((DWORD)(p)[2] << 16) | ((DWORD)(p)[1] << 8) | (DWORD)(p)[0])
+
+/**
+ Load a 64 bit little endian value from a byte buffer.
+ */
+#define YORI_DIGEST_LOAD64LE(p) \
+    (((DWORDLONG)YORI_DIGEST_LOAD32LE((p) + 4) << 32) | (DWORDLONG)YORI_DIGEST_LOAD32LE(p))
+
+/**
+ The number of bytes processed by each SHA1 or SHA256 compression.
+ */
+#define YORI_DIGEST_SHA_BLOCK_SIZE (64)
+
+/**
+ The number of bytes processed by each XXH64 stripe.
+ */
+#define YORI_DIGEST_XXH64_STRIPE_SIZE (32)
+
+/**
+ XXH64 prime constants.  These are composed from 32 bit halves since older
+ compilers do not support 64 bit literals.
+ */
+#define YORI_DIGEST_XXH64_PRIME1 (((DWORDLONG)0x9E3779B1 << 32) | 0x85EBCA87)
+
+/**
+ XXH64 prime constants.
+ */
+#define YORI_DIGEST_XXH64_PRIME2 (((DWORDLONG)0xC2B2AE3D << 32) | 0x27D4EB4F)
+
+/**
+ XXH64 prime constants.
+ */
+#define YORI_DIGEST_XXH64_PRIME3 (((DWORDLONG)0x165667B1 << 32) | 0x9E3779F9)
+
+/**
+ XXH64 prime constants.
+ */
+#define YORI_DIGEST_XXH64_PRIME4 (((DWORDLONG)0x85EBCA77 << 32) | 0xC2B2AE63)
+
+/**
+ XXH64 prime constants.
+ */
+#define YORI_DIGEST_XXH64_PRIME5 (((DWORDLONG)0x27D4EB2F << 32) | 0x165667C5)
+
+/**
+ The SHA256 round constants.
+ */
+CONST DWORD YoriLibDigestSha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/**
+ Set to 1 if the processor supports the SHA instruction set extensions, 0 if
+ it does not, or -1 if this has not been determined yet.
+ */
+LONG YoriLibDigestShaExtensionsState = -1;
+
+/**
+ Determine whether the SHA instruction set extensions can be used.  These
+ require SSSE3 and SSE4.1 as well as the SHA extensions themselves.
+
+ @return TRUE if the SHA extensions can be used, FALSE if they cannot.
+ */
+BOOL
+YoriLibDigestShaExtensionsAvailable()
+{
+#if YORI_DIGEST_SHA_EXTENSIONS
+    int CpuInfo[4];
+    LONG State;
+
+    State = YoriLibDigestShaExtensionsState;
+    if (State >= 0) {
+        return (BOOL)State;
+    }
+
+    State = 0;
+    __cpuid(CpuInfo, 0);
+    if (CpuInfo[0] >= 7) {
+        __cpuid(CpuInfo, 1);
+        if ((CpuInfo[2] & (1 << 9)) != 0 &&
+            (CpuInfo[2] & (1 << 19)) != 0) {
+
+            __cpuidex(CpuInfo, 7, 0);
+            if ((CpuInfo[1] & (1 << 29)) != 0) {
+                State = 1;
+            }
+        }
+    }
+
+    YoriLibDigestShaExtensionsState = State;
+    return (BOOL)State;
+#else
+    return FALSE;
+#endif
+}
+
+/**
+ Process blocks of input into a SHA1 state using portable code.
+
+ @param State Pointer to the five word SHA1 state.
+
+ @param Data Pointer to the input, which must be a multiple of the block
+        size.
+
+ @param BlockCount The number of blocks to process.
+ */
+VOID
+YoriLibDigestSha1Blocks(
+    __inout PDWORD State,
+    __in CONST UCHAR * Data,
+    __in DWORD BlockCount
+    )
+{
+    DWORD W[80];
+    DWORD A, B, C, D, E;
+    DWORD Temp;
+    DWORD Index;
+
+    while (BlockCount > 0) {
+        for (Index = 0; Index < 16; Index++) {
+            W[Index] = YORI_DIGEST_LOAD32BE(&Data[Index * 4]);
+        }
+        for (Index = 16; Index < 80; Index++) {
+            Temp = W[Index - 3] ^ W[Index - 8] ^ W[Index - 14] ^ W[Index - 16];
+            W[Index] = YORI_DIGEST_ROTL32(Temp, 1);
+        }
+
+        A = State[0];
+        B = State[1];
+        C = State[2];
+        D = State[3];
+        E = State[4];
+
+        for (Index = 0; Index < 80; Index++) {
+            if (Index < 20) {
+                Temp = ((B & C) | (~B & D)) + 0x5A827999;
+            } else if (Index < 40) {
+                Temp = (B ^ C ^ D) + 0x6ED9EBA1;
+            } else if (Index < 60) {
+                Temp = ((B & C) | (B & D) | (C & D)) + 0x8F1BBCDC;
+            } else {
+                Temp = (B ^ C ^ D) + 0xCA62C1D6;
+            }
+            Temp = Temp + YORI_DIGEST_ROTL32(A, 5) + E + W[Index];
+            E = D;
+            D = C;
+            C = YORI_DIGEST_ROTL32(B, 30);
+            B = A;
+            A = Temp;
+        }
+
+        State[0] += A;
+        State[1] += B;
+        State[2] += C;
+        State[3] += D;
+        State[4] += E;
+
+        Data += YORI_DIGEST_SHA_BLOCK_SIZE;
+        BlockCount--;
+    }
+}
+
+/**
+ Process blocks of input into a SHA256 state using portable code.
+
+ @param State Pointer to the eight word SHA256 state.
+
+ @param Data Pointer to the input, which must be a multiple of the block
+        size.
+
+ @param BlockCount The number of blocks to process.
+ */
+VOID
+YoriLibDigestSha256Blocks(
+    __inout PDWORD State,
+    __in CONST UCHAR * Data,
+    __in DWORD BlockCount
+    )
+{
+    DWORD W[64];
+    DWORD V[8];
+    DWORD Temp1;
+    DWORD Temp2;
+    DWORD Index;
+
+    while (BlockCount > 0) {
+        for (Index = 0; Index < 16; Index++) {
+            W[Index] = YORI_DIGEST_LOAD32BE(&Data[Index * 4]);
+        }
+        for (Index = 16; Index < 64; Index++) {
+            Temp1 = YORI_DIGEST_ROTR32(W[Index - 2], 17) ^ YORI_DIGEST_ROTR32(W[Index - 2], 19) ^ (W[Index - 2] >> 10);
+            Temp2 = YORI_DIGEST_ROTR32(W[Index - 15], 7) ^ YORI_DIGEST_ROTR32(W[Index - 15], 18) ^ (W[Index - 15] >> 3);
+            W[Index] = Temp1 + W[Index - 7] + Temp2 + W[Index - 16];
+        }
+
+        for (Index = 0; Index < 8; Index++) {
+            V[Index] = State[Index];
+        }
+
+        for (Index = 0; Index < 64; Index++) {
+            Temp1 = V[7] +
+                    (YORI_DIGEST_ROTR32(V[4], 6) ^ YORI_DIGEST_ROTR32(V[4], 11) ^ YORI_DIGEST_ROTR32(V[4], 25)) +
+                    ((V[4] & V[5]) ^ (~V[4] & V[6])) +
+                    YoriLibDigestSha256K[Index] +
+                    W[Index];
+            Temp2 = (YORI_DIGEST_ROTR32(V[0], 2) ^ YORI_DIGEST_ROTR32(V[0], 13) ^ YORI_DIGEST_ROTR32(V[0], 22)) +
+                    ((V[0] & V[1]) ^ (V[0] & V[2]) ^ (V[1] & V[2]));
+            V[7] = V[6];
+            V[6] = V[5];
+            V[5] = V[4];
+            V[4] = V[3] + Temp1;
+            V[3] = V[2];
+            V[2] = V[1];
+            V[1] = V[0];
+            V[0] = Temp1 + Temp2;
+        }
+
+        for (Index = 0; Index < 8; Index++) {
+            State[Index] += V[Index];
+        }
+
+        Data += YORI_DIGEST_SHA_BLOCK_SIZE;
+        BlockCount--;
+    }
+}
+
+#if YORI_DIGEST_SHA_EXTENSIONS
+
+/**
+ Process blocks of input into a SHA1 state using the SHA instruction set
+ extensions.
+
+ @param State Pointer to the five word SHA1 state.
+
+ @param Data Pointer to the input, which must be a multiple of the block
+        size.
+
+ @param BlockCount The number of blocks to process.
+ */
+VOID
+YoriLibDigestSha1BlocksShaExt(
+    __inout PDWORD State,
+    __in CONST UCHAR * Data,
+    __in DWORD BlockCount
+    )
+{
+    __m128i Abcd;
+    __m128i AbcdSave;
+    __m128i E;
+    __m128i ESave;
+    __m128i EPrevious;
+    __m128i ENext;
+    __m128i Mask;
+    __m128i Msg[4];
+    DWORD Group;
+
+    Abcd = _mm_loadu_si128((const __m128i *)State);
+    Abcd = _mm_shuffle_epi32(Abcd, 0x1B);
+    E = _mm_set_epi32((int)State[4], 0, 0, 0);
+    Mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    while (BlockCount > 0) {
+        AbcdSave = Abcd;
+        ESave = E;
+        EPrevious = E;
+
+        //
+        //  Each group performs four rounds.  The first four groups load the
+        //  message, and later groups expand it from the previous four.
+        //
+
+        for (Group = 0; Group < 20; Group++) {
+            if (Group < 4) {
+                Msg[Group] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(Data + Group * 16)), Mask);
+            } else {
+                Msg[Group & 3] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(Msg[Group & 3], Msg[(Group + 1) & 3]),
+                                                                  Msg[(Group + 2) & 3]),
+                                                    Msg[(Group + 3) & 3]);
+            }
+
+            if (Group == 0) {
+                ENext = _mm_add_epi32(E, Msg[0]);
+            } else {
+                ENext = _mm_sha1nexte_epu32(EPrevious, Msg[Group & 3]);
+            }
+            EPrevious = Abcd;
+
+            switch(Group / 5) {
+                case 0:
+                    Abcd = _mm_sha1rnds4_epu32(Abcd, ENext, 0);
+                    break;
+                case 1:
+                    Abcd = _mm_sha1rnds4_epu32(Abcd, ENext, 1);
+                    break;
+                case 2:
+                    Abcd = _mm_sha1rnds4_epu32(Abcd, ENext, 2);
+                    break;
+                default:
+                    Abcd = _mm_sha1rnds4_epu32(Abcd, ENext, 3);
+                    break;
+            }
+        }
+
+        E = _mm_sha1nexte_epu32(EPrevious, ESave);
+        Abcd = _mm_add_epi32(Abcd, AbcdSave);
+
+        Data += YORI_DIGEST_SHA_BLOCK_SIZE;
+        BlockCount--;
+    }
+
+    Abcd = _mm_shuffle_epi32(Abcd, 0x1B);
+    _mm_storeu_si128((__m128i *)State, Abcd);
+    State[4] = (DWORD)_mm_extract_epi32(E, 3);
+}
+
+/**
+ Process blocks of input into a SHA256 state using the SHA instruction set
+ extensions.
+
+ @param State Pointer to the eight word SHA256 state.
+
+ @param Data Pointer to the input, which must be a multiple of the block
+        size.
+
+ @param BlockCount The number of blocks to process.
+ */
+VOID
+YoriLibDigestSha256BlocksShaExt(
+    __inout PDWORD State,
+    __in CONST UCHAR * Data,
+    __in DWORD BlockCount
+    )
+{
+    __m128i State0;
+    __m128i State1;
+    __m128i State0Save;
+    __m128i State1Save;
+    __m128i Temp;
+    __m128i Mask;
+    __m128i Msg[4];
+    __m128i Rounds;
+    DWORD Group;
+
+    Temp = _mm_loadu_si128((const __m128i *)&State[0]);
+    State1 = _mm_loadu_si128((const __m128i *)&State[4]);
+    Temp = _mm_shuffle_epi32(Temp, 0xB1);
+    State1 = _mm_shuffle_epi32(State1, 0x1B);
+    State0 = _mm_alignr_epi8(Temp, State1, 8);
+    State1 = _mm_blend_epi16(State1, Temp, 0xF0);
+    Mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    while (BlockCount > 0) {
+        State0Save = State0;
+        State1Save = State1;
+
+        //
+        //  Each group performs four rounds.  The first four groups load the
+        //  message, and later groups expand it from the previous four.
+        //
+
+        for (Group = 0; Group < 16; Group++) {
+            if (Group < 4) {
+                Msg[Group] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(Data + Group * 16)), Mask);
+            } else {
+                Temp = _mm_sha256msg1_epu32(Msg[Group & 3], Msg[(Group + 1) & 3]);
+                Temp = _mm_add_epi32(Temp, _mm_alignr_epi8(Msg[(Group + 3) & 3], Msg[(Group + 2) & 3], 4));
+                Msg[Group & 3] = _mm_sha256msg2_epu32(Temp, Msg[(Group + 3) & 3]);
+            }
+
+            Rounds = _mm_add_epi32(Msg[Group & 3], _mm_loadu_si128((const __m128i *)&YoriLibDigestSha256K[Group * 4]));
+            State1 = _mm_sha256rnds2_epu32(State1, State0, Rounds);
+            Rounds = _mm_shuffle_epi32(Rounds, 0x0E);
+            State0 = _mm_sha256rnds2_epu32(State0, State1, Rounds);
+        }
+
+        State0 = _mm_add_epi32(State0, State0Save);
+        State1 = _mm_add_epi32(State1, State1Save);
+
+        Data += YORI_DIGEST_SHA_BLOCK_SIZE;
+        BlockCount--;
+    }
+
+    Temp = _mm_shuffle_epi32(State0, 0x1B);
+    State1 = _mm_shuffle_epi32(State1, 0xB1);
+    State0 = _mm_blend_epi16(Temp, State1, 0xF0);
+    State1 = _mm_alignr_epi8(State1, Temp, 8);
+    _mm_storeu_si128((__m128i *)&State[0], State0);
+    _mm_storeu_si128((__m128i *)&State[4], State1);
+}
+
+#endif
+
+/**
+ Apply one XXH64 round to an accumulator.
+
+ @param Accumulator The current accumulator value.
+
+ @param Input The next 64 bits of input.
+
+ @return The updated accumulator value.
+ */
+DWORDLONG
+YoriLibDigestXxh64Round(
+    __in DWORDLONG Accumulator,
+    __in DWORDLONG Input
+    )
+{
+    Accumulator = Accumulator + Input * YORI_DIGEST_XXH64_PRIME2;
+    Accumulator = YORI_DIGEST_ROTL64(Accumulator, 31);
+    return Accumulator * YORI_DIGEST_XXH64_PRIME1;
+}
+
+/**
+ Merge one XXH64 lane accumulator into the final hash value.
+
+ @param Hash The hash value being constructed.
+
+ @param Lane The accumulator of one lane.
+
+ @return The updated hash value.
+ */
+DWORDLONG
+YoriLibDigestXxh64MergeRound(
+    __in DWORDLONG Hash,
+    __in DWORDLONG Lane
+    )
+{
+    Hash = Hash ^ YoriLibDigestXxh64Round(0, Lane);
+    return Hash * YORI_DIGEST_XXH64_PRIME1 + YORI_DIGEST_XXH64_PRIME4;
+}
+
+/**
+ Process stripes of input into an XXH64 state.
+
+ @param State Pointer to the four lane XXH64 state.
+
+ @param Data Pointer to the input, which must be a multiple of the stripe
+        size.
+
+ @param StripeCount The number of stripes to process.
+ */
+VOID
+YoriLibDigestXxh64Stripes(
+    __inout PDWORDLONG State,
+    __in CONST UCHAR * Data,
+    __in DWORD StripeCount
+    )
+{
+    DWORDLONG V1;
+    DWORDLONG V2;
+    DWORDLONG V3;
+    DWORDLONG V4;
+
+    V1 = State[0];
+    V2 = State[1];
+    V3 = State[2];
+    V4 = State[3];
+
+    while (StripeCount > 0) {
+        V1 = YoriLibDigestXxh64Round(V1, YORI_DIGEST_LOAD64LE(Data));
+        V2 = YoriLibDigestXxh64Round(V2, YORI_DIGEST_LOAD64LE(Data + 8));
+        V3 = YoriLibDigestXxh64Round(V3, YORI_DIGEST_LOAD64LE(Data + 16));
+        V4 = YoriLibDigestXxh64Round(V4, YORI_DIGEST_LOAD64LE(Data + 24));
+        Data += YORI_DIGEST_XXH64_STRIPE_SIZE;
+        StripeCount--;
+    }
+
+    State[0] = V1;
+    State[1] = V2;
+    State[2] = V3;
+    State[3] = V4;
+}
+
+/**
+ Process complete blocks of input for the algorithm in a digest context.
+
+ @param Context Pointer to the digest context.
+
+ @param Data Pointer to the input, which must be a multiple of the block
+        size for the algorithm.
+
+ @param BlockCount The number of blocks to process.
+ */
+VOID
+YoriLibDigestProcessBlocks(
+    __inout PYORI_LIB_DIGEST_CONTEXT Context,
+    __in CONST UCHAR * Data,
+    __in DWORD BlockCount
+    )
+{
+    switch(Context->Algorithm) {
+        case YoriLibDigestSha1:
+#if YORI_DIGEST_SHA_EXTENSIONS
+            if (Context->UseShaExtensions) {
+                YoriLibDigestSha1BlocksShaExt(Context->State.Sha, Data, BlockCount);
+                break;
+            }
+#endif
+            YoriLibDigestSha1Blocks(Context->State.Sha, Data, BlockCount);
+            break;
+        case YoriLibDigestSha256:
+#if YORI_DIGEST_SHA_EXTENSIONS
+            if (Context->UseShaExtensions) {
+                YoriLibDigestSha256BlocksShaExt(Context->State.Sha, Data, BlockCount);
+                break;
+            }
+#endif
+            YoriLibDigestSha256Blocks(Context->State.Sha, Data, BlockCount);
+            break;
+        case YoriLibDigestXxh64:
+            YoriLibDigestXxh64Stripes(Context->State.Xxh64, Data, BlockCount);
+            break;
+    }
+}
+
+/**
+ Return the number of bytes processed at a time by a digest algorithm.
+
+ @param Algorithm The digest algorithm.
+
+ @return The number of bytes in each block.
+ */
+DWORD
+YoriLibDigestGetBlockSize(
+    __in YORI_LIB_DIGEST_ALGORITHM Algorithm
+    )
+{
+    if (Algorithm == YoriLibDigestXxh64) {
+        return YORI_DIGEST_XXH64_STRIPE_SIZE;
+    }
+    return YORI_DIGEST_SHA_BLOCK_SIZE;
+}
+
+/**
+ Return the number of bytes in the result of a digest algorithm.
+
+ @param Algorithm The digest algorithm.
+
+ @return The number of bytes in the digest.
+ */
+DWORD
+YoriLibDigestGetLength(
+    __in YORI_LIB_DIGEST_ALGORITHM Algorithm
+    )
+{
+    switch(Algorithm) {
+        case YoriLibDigestSha1:
+            return 20;
+        case YoriLibDigestSha256:
+            return 32;
+        case YoriLibDigestXxh64:
+            return 8;
+    }
+    return 0;
+}
+
+/**
+ Find a digest algorithm from its name.
+
+ @param Name Pointer to the name of the algorithm, such as SHA1, SHA256 or
+        XXH64.
+
+ @param Algorithm On successful completion, updated to contain the
+        algorithm.
+
+ @return TRUE if the name refers to a digest algorithm implemented here,
+         FALSE if it does not.
+ */
+__success(return)
+BOOL
+YoriLibDigestAlgorithmFromString(
+    __in PYORI_STRING Name,
+    __out PYORI_LIB_DIGEST_ALGORITHM Algorithm
+    )
+{
+    if (YoriLibCompareStringWithLiteralInsensitive(Name, _T("SHA1")) == 0) {
+        *Algorithm = YoriLibDigestSha1;
+    } else if (YoriLibCompareStringWithLiteralInsensitive(Name, _T("SHA256")) == 0) {
+        *Algorithm = YoriLibDigestSha256;
+    } else if (YoriLibCompareStringWithLiteralInsensitive(Name, _T("XXH64")) == 0) {
+        *Algorithm = YoriLibDigestXxh64;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ Prepare a digest context to generate a digest with a specified algorithm.
+
+ @param Context Pointer to the digest context to initialize.
+
+ @param Algorithm The digest algorithm to use.
+ */
+VOID
+YoriLibDigestInitialize(
+    __out PYORI_LIB_DIGEST_CONTEXT Context,
+    __in YORI_LIB_DIGEST_ALGORITHM Algorithm
+    )
+{
+    ZeroMemory(Context, sizeof(YORI_LIB_DIGEST_CONTEXT));
+    Context->Algorithm = Algorithm;
+    Context->UseShaExtensions = (BOOLEAN)YoriLibDigestShaExtensionsAvailable();
+
+    switch(Algorithm) {
+        case YoriLibDigestSha1:
+            Context->State.Sha[0] = 0x67452301;
+            Context->State.Sha[1] = 0xEFCDAB89;
+            Context->State.Sha[2] = 0x98BADCFE;
+            Context->State.Sha[3] = 0x10325476;
+            Context->State.Sha[4] = 0xC3D2E1F0;
+            break;
+        case YoriLibDigestSha256:
+            Context->State.Sha[0] = 0x6a09e667;
+            Context->State.Sha[1] = 0xbb67ae85;
+            Context->State.Sha[2] = 0x3c6ef372;
+            Context->State.Sha[3] = 0xa54ff53a;
+            Context->State.Sha[4] = 0x510e527f;
+            Context->State.Sha[5] = 0x9b05688c;
+            Context->State.Sha[6] = 0x1f83d9ab;
+            Context->State.Sha[7] = 0x5be0cd19;
+            break;
+        case YoriLibDigestXxh64:
+            Context->State.Xxh64[0] = YORI_DIGEST_XXH64_PRIME1 + YORI_DIGEST_XXH64_PRIME2;
+            Context->State.Xxh64[1] = YORI_DIGEST_XXH64_PRIME2;
+            Context->State.Xxh64[2] = 0;
+            Context->State.Xxh64[3] = 0 - YORI_DIGEST_XXH64_PRIME1;
+            break;
+    }
+}
+
+/**
+ Add data to a digest.  This can be called any number of times with
+ buffers of any size.
+
+ @param Context Pointer to the digest context.
+
+ @param Buffer Pointer to the data to add.
+
+ @param Length The number of bytes in Buffer.
+ */
+VOID
+YoriLibDigestUpdate(
+    __inout PYORI_LIB_DIGEST_CONTEXT Context,
+    __in PVOID Buffer,
+    __in DWORD Length
+    )
+{
+    CONST UCHAR * Data = (CONST UCHAR *)Buffer;
+    DWORD BlockSize;
+    DWORD BytesToCopy;
+
+    BlockSize = YoriLibDigestGetBlockSize(Context->Algorithm);
+    Context->TotalLength += Length;
+
+    //
+    //  Complete any partial block from a previous call.
+    //
+
+    if (Context->BufferedLength > 0) {
+        BytesToCopy = BlockSize - Context->BufferedLength;
+        if (BytesToCopy > Length) {
+            BytesToCopy = Length;
+        }
+        memcpy(&Context->Buffer[Context->BufferedLength], Data, BytesToCopy);
+        Context->BufferedLength += BytesToCopy;
+        Data += BytesToCopy;
+        Length -= BytesToCopy;
+
+        if (Context->BufferedLength < BlockSize) {
+            return;
+        }
+
+        YoriLibDigestProcessBlocks(Context, Context->Buffer, 1);
+        Context->BufferedLength = 0;
+    }
+
+    //
+    //  Process complete blocks directly from the caller's buffer, and keep
+    //  anything left over for the next call.
+    //
+
+    if (Length >= BlockSize) {
+        YoriLibDigestProcessBlocks(Context, Data, Length / BlockSize);
+        Data += Length - (Length % BlockSize);
+        Length = Length % BlockSize;
+    }
+
+    if (Length > 0) {
+        memcpy(Context->Buffer, Data, Length);
+        Context->BufferedLength = Length;
+    }
+}
+
+/**
+ Complete a SHA1 or SHA256 digest by appending padding and the message
+ length, and write the result.
+
+ @param Context Pointer to the digest context.
+
+ @param StateWords The number of words in the state, which is also the
+        number of words in the digest.
+
+ @param Digest Pointer to a buffer to receive the digest.
+ */
+VOID
+YoriLibDigestFinishSha(
+    __inout PYORI_LIB_DIGEST_CONTEXT Context,
+    __in DWORD StateWords,
+    __out_ecount(StateWords * sizeof(DWORD)) PUCHAR Digest
+    )
+{
+    DWORDLONG BitLength;
+    DWORD Index;
+
+    BitLength = Context->TotalLength * 8;
+
+    Context->Buffer[Context->BufferedLength] = 0x80;
+    Context->BufferedLength++;
+    if (Context->BufferedLength > YORI_DIGEST_SHA_BLOCK_SIZE - 8) {
+        ZeroMemory(&Context->Buffer[Context->BufferedLength], YORI_DIGEST_SHA_BLOCK_SIZE - Context->BufferedLength);
+        YoriLibDigestProcessBlocks(Context, Context->Buffer, 1);
+        Context->BufferedLength = 0;
+    }
+
+    ZeroMemory(&Context->Buffer[Context->BufferedLength], YORI_DIGEST_SHA_BLOCK_SIZE - 8 - Context->BufferedLength);
+    for (Index = 0; Index < 8; Index++) {
+        Context->Buffer[YORI_DIGEST_SHA_BLOCK_SIZE - 1 - Index] = (UCHAR)(BitLength >> (Index * 8));
+    }
+    YoriLibDigestProcessBlocks(Context, Context->Buffer, 1);
+    Context->BufferedLength = 0;
+
+    for (Index = 0; Index < StateWords; Index++) {
+        Digest[Index * 4] = (UCHAR)(Context->State.Sha[Index] >> 24);
+        Digest[Index * 4 + 1] = (UCHAR)(Context->State.Sha[Index] >> 16);
+        Digest[Index * 4 + 2] = (UCHAR)(Context->State.Sha[Index] >> 8);
+        Digest[Index * 4 + 3] = (UCHAR)(Context->State.Sha[Index]);
+    }
+}
+
+/**
+ Complete an XXH64 digest and write the result in its canonical big endian
+ form.
+
+ @param Context Pointer to the digest context.
+
+ @param Digest Pointer to a buffer to receive the digest.
+ */
+VOID
+YoriLibDigestFinishXxh64(
+    __inout PYORI_LIB_DIGEST_CONTEXT Context,
+    __out_ecount(8) PUCHAR Digest
+    )
+{
+    DWORDLONG Hash;
+    CONST UCHAR * Data;
+    DWORD Remaining;
+    DWORD Index;
+    PDWORDLONG State;
+
+    State = Context->State.Xxh64;
+    if (Context->TotalLength >= YORI_DIGEST_XXH64_STRIPE_SIZE) {
+        Hash = YORI_DIGEST_ROTL64(State[0], 1) +
+               YORI_DIGEST_ROTL64(State[1], 7) +
+               YORI_DIGEST_ROTL64(State[2], 12) +
+               YORI_DIGEST_ROTL64(State[3], 18);
+        Hash = YoriLibDigestXxh64MergeRound(Hash, State[0]);
+        Hash = YoriLibDigestXxh64MergeRound(Hash, State[1]);
+        Hash = YoriLibDigestXxh64MergeRound(Hash, State[2]);
+        Hash = YoriLibDigestXxh64MergeRound(Hash, State[3]);
+    } else {
+        Hash = YORI_DIGEST_XXH64_PRIME5;
+    }
+
+    Hash = Hash + Context->TotalLength;
+
+    Data = Context->Buffer;
+    Remaining = Context->BufferedLength;
+    while (Remaining >= 8) {
+        Hash = Hash ^ YoriLibDigestXxh64Round(0, YORI_DIGEST_LOAD64LE(Data));
+        Hash = YORI_DIGEST_ROTL64(Hash, 27) * YORI_DIGEST_XXH64_PRIME1 + YORI_DIGEST_XXH64_PRIME4;
+        Data += 8;
+        Remaining -= 8;
+    }
+
+    if (Remaining >= 4) {
+        Hash = Hash ^ ((DWORDLONG)YORI_DIGEST_LOAD32LE(Data) * YORI_DIGEST_XXH64_PRIME1);
+        Hash = YORI_DIGEST_ROTL64(Hash, 23) * YORI_DIGEST_XXH64_PRIME2 + YORI_DIGEST_XXH64_PRIME3;
+        Data += 4;
+        Remaining -= 4;
+    }
+
+    while (Remaining > 0) {
+        Hash = Hash ^ ((DWORDLONG)*Data * YORI_DIGEST_XXH64_PRIME5);
+        Hash = YORI_DIGEST_ROTL64(Hash, 11) * YORI_DIGEST_XXH64_PRIME1;
+        Data++;
+        Remaining--;
+    }
+
+    Hash = Hash ^ (Hash >> 33);
+    Hash = Hash * YORI_DIGEST_XXH64_PRIME2;
+    Hash = Hash ^ (Hash >> 29);
+    Hash = Hash * YORI_DIGEST_XXH64_PRIME3;
+    Hash = Hash ^ (Hash >> 32);
+
+    for (Index = 0; Index < 8; Index++) {
+        Digest[Index] = (UCHAR)(Hash >> ((7 - Index) * 8));
+    }
+}
+
+/**
+ Complete a digest and write the result.  The context cannot be used for
+ further data until it is initialized again.
+
+ @param Context Pointer to the digest context.
+
+ @param Digest Pointer to a buffer to receive the digest.
+
+ @param DigestLength The number of bytes in Digest.  This must be at least
+        the value returned by YoriLibDigestGetLength.
+
+ @return TRUE to indicate success, FALSE if the buffer is too small.
+ */
+__success(return)
+BOOL
+YoriLibDigestFinish(
+    __inout PYORI_LIB_DIGEST_CONTEXT Context,
+    __out_ecount(DigestLength) PUCHAR Digest,
+    __in DWORD DigestLength
+    )
+{
+    if (DigestLength < YoriLibDigestGetLength(Context->Algorithm)) {
+        return FALSE;
+    }
+
+    switch(Context->Algorithm) {
+        case YoriLibDigestSha1:
+            YoriLibDigestFinishSha(Context, 5, Digest);
+            break;
+        case YoriLibDigestSha256:
+            YoriLibDigestFinishSha(Context, 8, Digest);
+            break;
+        case YoriLibDigestXxh64:
+            YoriLibDigestFinishXxh64(Context, Digest);
+            break;
+    }
+
+    return TRUE;
+}
+
+// vim:sw=4:ts=4:et:
@@ -110,6 +110,7 @@ YoriLibLoadNtDllFunctions()
     DllNtDll.pNtQueryInformationProcess = (PNT_QUERY_INFORMATION_PROCESS)GetProcAddress(DllNtDll.hDll, "NtQueryInformationProcess");
     DllNtDll.pNtQueryInformationThread = (PNT_QUERY_INFORMATION_THREAD)GetProcAddress(DllNtDll.hDll, "NtQueryInformationThread");
     DllNtDll.pNtQuerySystemInformation = (PNT_QUERY_SYSTEM_INFORMATION)GetProcAddress(DllNtDll.hDll, "NtQuerySystemInformation");
+    DllNtDll.pNtQueryVolumeInformationFile = (PNT_QUERY_VOLUME_INFORMATION_FILE)GetProcAddress(DllNtDll.hDll, "NtQueryVolumeInformationFile");
     DllNtDll.pRtlGetLastNtStatus = (PRTL_GET_LAST_NT_STATUS)GetProcAddress(DllNtDll.hDll, "RtlGetLastNtStatus");
     return TRUE;
 }
@@ -127,6 +128,7 @@ CONST YORI_DLL_NAME_MAP DllKernel32Symbols[] = {
     {(FARPROC *)&DllKernel32.pAddConsoleAliasW, "AddConsoleAliasW"},
     {(FARPROC *)&DllKernel32.pAssignProcessToJobObject, "AssignProcessToJobObject"},
     {(FARPROC *)&DllKernel32.pCreateHardLinkW, "CreateHardLinkW"},
+    {(FARPROC *)&DllKernel32.pCreateIoCompletionPort, "CreateIoCompletionPort"},
     {(FARPROC *)&DllKernel32.pCreateJobObjectW, "CreateJobObjectW"},
     {(FARPROC *)&DllKernel32.pCreateSymbolicLinkW, "CreateSymbolicLinkW"},
     {(FARPROC *)&DllKernel32.pFindFirstStreamW, "FindFirstStreamW"},
@@ -152,6 +154,8 @@ CONST YORI_DLL_NAME_MAP DllKernel32Symbols[] = {
     {(FARPROC *)&DllKernel32.pGetPrivateProfileSectionNamesW, "GetPrivateProfileSectionNamesW"},
     {(FARPROC *)&DllKernel32.pGetProcessIoCounters, "GetProcessIoCounters"},
     {(FARPROC *)&DllKernel32.pGetProductInfo, "GetProductInfo"},
+    {(FARPROC *)&DllKernel32.pGetQueuedCompletionStatus, "GetQueuedCompletionStatus"},
+    {(FARPROC *)&DllKernel32.pGetSystemTimes, "GetSystemTimes"},
     {(FARPROC *)&DllKernel32.pGetTickCount64, "GetTickCount64"},
     {(FARPROC *)&DllKernel32.pGetVersionExW, "GetVersionExW"},
     {(FARPROC *)&DllKernel32.pGetVolumePathNamesForVolumeNameW, "GetVolumePathNamesForVolumeNameW"},
@@ -161,9 +165,11 @@ CONST YORI_DLL_NAME_MAP DllKernel32Symbols[] = {
     {(FARPROC *)&DllKernel32.pQueryFullProcessImageNameW, "QueryFullProcessImageNameW"},
     {(FARPROC *)&DllKernel32.pQueryInformationJobObject, "QueryInformationJobObject"},
     {(FARPROC *)&DllKernel32.pRegisterApplicationRestart, "RegisterApplicationRestart"},
+    {(FARPROC *)&DllKernel32.pReplaceFileW, "ReplaceFileW"},
     {(FARPROC *)&DllKernel32.pRtlCaptureStackBackTrace, "RtlCaptureStackBackTrace"},
     {(FARPROC *)&DllKernel32.pSetConsoleScreenBufferInfoEx, "SetConsoleScreenBufferInfoEx"},
     {(FARPROC *)&DllKernel32.pSetCurrentConsoleFontEx, "SetCurrentConsoleFontEx"},
+    {(FARPROC *)&DllKernel32.pSetFileInformationByHandle, "SetFileInformationByHandle"},
     {(FARPROC *)&DllKernel32.pSetInformationJobObject, "SetInformationJobObject"},
     {(FARPROC *)&DllKernel32.pWow64DisableWow64FsRedirection, "Wow64DisableWow64FsRedirection"},
     {(FARPROC *)&DllKernel32.pWow64GetThreadContext, "Wow64GetThreadContext"},
@@ -91,6 +91,421 @@ typedef struct _YORILIB_FOREACHFILE_CONTEXT {
 
 } YORILIB_FOREACHFILE_CONTEXT, *PYORILIB_FOREACHFILE_CONTEXT;
 
+/**
+ The maximum number of threads to use when enumerating in parallel.
+ */
+#define YORILIB_FILEENUM_PARALLEL_MAX_WORKERS (32)
+
+/**
+ The number of results which can be buffered when enumerating in parallel
+ while preserving order before workers stop starting new directories.  A
+ directory that has been started is always completed, so this can be
+ exceeded by the contents of the directories in progress.
+ */
+#define YORILIB_FILEENUM_PARALLEL_MAX_BUFFERED (32 * 1024)
+
+/**
+ The types of results that can be buffered for a directory when enumerating
+ in parallel while preserving order.
+ */
+typedef enum _YORILIB_FILEENUM_RECORD_TYPE {
+    YoriLibFileEnumRecordFile = 1,
+    YoriLibFileEnumRecordError = 2,
+    YoriLibFileEnumRecordDirectory = 3
+} YORILIB_FILEENUM_RECORD_TYPE;
+
+/**
+ A directory to enumerate as part of a parallel enumeration.
+ */
+typedef struct _YORILIB_FILEENUM_PARALLEL_ITEM {
+
+    /**
+     The list of items queued to a worker.
+     */
+    YORI_LIST_ENTRY QueueEntry;
+
+    /**
+     The pool that this item is being enumerated by.
+     */
+    struct _YORILIB_FILEENUM_PARALLEL_POOL *Pool;
+
+    /**
+     The worker processing this item, or NULL if it is being processed by
+     the thread which started the enumeration.  Subdirectories found while
+     processing this item are queued to this worker.
+     */
+    struct _YORILIB_FILEENUM_PARALLEL_WORKER *Worker;
+
+    /**
+     The worker whose queue this item was added to.
+     */
+    struct _YORILIB_FILEENUM_PARALLEL_WORKER *QueuedWorker;
+
+    /**
+     TRUE if this item is on the queue of QueuedWorker.  This is protected
+     by that worker's mutex.
+     */
+    BOOL Queued;
+
+    /**
+     The enumeration criteria for this directory.
+     */
+    YORI_STRING FileSpec;
+
+    /**
+     The recursion depth of this directory.
+     */
+    DWORD Depth;
+
+    /**
+     If the enumeration is preserving order, the list of results found in
+     this directory, in the order they should be returned.
+     */
+    YORI_LIST_ENTRY Records;
+
+    /**
+     Set to TRUE once this directory has been completely enumerated and
+     Records will not change further.
+     */
+    volatile LONG Complete;
+
+    /**
+     The result of enumerating this directory.
+     */
+    BOOL Result;
+
+} YORILIB_FILEENUM_PARALLEL_ITEM, *PYORILIB_FILEENUM_PARALLEL_ITEM;
+
+/**
+ A result buffered for a directory when enumerating in parallel while
+ preserving order.
+ */
+typedef struct _YORILIB_FILEENUM_PARALLEL_RECORD {
+
+    /**
+     The list of results within the directory.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The type of this result.
+     */
+    YORILIB_FILEENUM_RECORD_TYPE RecordType;
+
+    /**
+     For a directory record, the subdirectory whose results should be
+     returned at this point.
+     */
+    PYORILIB_FILEENUM_PARALLEL_ITEM ChildItem;
+
+    /**
+     For an error record, the error code to report.
+     */
+    DWORD ErrorCode;
+
+    /**
+     For a file or error record, the path to report.
+     */
+    YORI_STRING FullPath;
+
+    /**
+     For a file record, information about the file.
+     */
+    WIN32_FIND_DATA FileInfo;
+
+} YORILIB_FILEENUM_PARALLEL_RECORD, *PYORILIB_FILEENUM_PARALLEL_RECORD;
+
+/**
+ A thread which enumerates directories as part of a parallel enumeration.
+ Each worker has its own queue of directories.  A worker processes the most
+ recently found directory from its own queue first, and when that is empty,
+ takes the oldest directory from another worker's queue.
+ */
+typedef struct _YORILIB_FILEENUM_PARALLEL_WORKER {
+
+    /**
+     The pool that this worker belongs to.
+     */
+    struct _YORILIB_FILEENUM_PARALLEL_POOL *Pool;
+
+    /**
+     A mutex protecting Queue.
+     */
+    HANDLE Mutex;
+
+    /**
+     The list of directories waiting to be enumerated by this worker.
+     */
+    YORI_LIST_ENTRY Queue;
+
+    /**
+     A handle to the worker thread.
+     */
+    HANDLE hThread;
+
+} YORILIB_FILEENUM_PARALLEL_WORKER, *PYORILIB_FILEENUM_PARALLEL_WORKER;
+
+/**
+ State for a single parallel enumeration.
+ */
+typedef struct _YORILIB_FILEENUM_PARALLEL_POOL {
+
+    /**
+     The flags describing the enumeration.
+     */
+    DWORD MatchFlags;
+
+    /**
+     The callback to invoke for each match.
+     */
+    PYORILIB_FILE_ENUM_FN Callback;
+
+    /**
+     The callback to invoke for each error.
+     */
+    PYORILIB_FILE_ENUM_ERROR_FN ErrorCallback;
+
+    /**
+     The caller's context to pass to callbacks.
+     */
+    PVOID Context;
+
+    /**
+     TRUE if results should be returned on the calling thread in the order
+     a serial enumeration would return them.  FALSE if callbacks are invoked
+     from worker threads as results are found.
+     */
+    BOOLEAN Ordered;
+
+    /**
+     The number of worker threads.
+     */
+    DWORD WorkerCount;
+
+    /**
+     Used to distribute directories queued from the calling thread across
+     workers.
+     */
+    volatile LONG NextWorker;
+
+    /**
+     The number of directories which have been queued but have not finished
+     being enumerated.
+     */
+    volatile LONG Outstanding;
+
+    /**
+     Set to TRUE if the enumeration should stop.  Directories which have not
+     yet been enumerated are skipped.
+     */
+    volatile LONG Abort;
+
+    /**
+     Set to TRUE to indicate worker threads should exit.
+     */
+    volatile LONG Shutdown;
+
+    /**
+     A semaphore released once for each directory queued, and once for each
+     worker on shutdown.
+     */
+    HANDLE WorkAvailable;
+
+    /**
+     A manual reset event signalled when Outstanding reaches zero.
+     */
+    HANDLE AllDone;
+
+    /**
+     An event signalled whenever a directory is completely enumerated, so
+     that the calling thread can return its results if order is being
+     preserved.
+     */
+    HANDLE ItemComplete;
+
+    /**
+     If order is being preserved, the number of results which have been
+     buffered and not yet returned.
+     */
+    volatile LONG BufferedRecords;
+
+    /**
+     A manual reset event signalled when BufferedRecords falls below
+     YORILIB_FILEENUM_PARALLEL_MAX_BUFFERED, or when the enumeration is
+     aborted, so workers waiting to start new directories can proceed.
+     */
+    HANDLE BufferSpaceAvailable;
+
+    /**
+     The worker threads.
+     */
+    YORILIB_FILEENUM_PARALLEL_WORKER Workers[YORILIB_FILEENUM_PARALLEL_MAX_WORKERS];
+
+} YORILIB_FILEENUM_PARALLEL_POOL, *PYORILIB_FILEENUM_PARALLEL_POOL;
+
+/**
+ Queue a subdirectory for enumeration as part of a parallel enumeration.
+ If order is being preserved, a record is added to the parent directory
+ indicating where the subdirectory's results should be returned.
+
+ @param ParentItem The directory being enumerated that contains the
+        subdirectory.
+
+ @param FileSpec The enumeration criteria for the subdirectory.  On
+        success, ownership of this string passes to the queued item and it
+        is reinitialized as empty.
+
+ @param Depth The recursion depth of the subdirectory.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibFileEnumQueueDirectory(
+    __in PYORILIB_FILEENUM_PARALLEL_ITEM ParentItem,
+    __inout PYORI_STRING FileSpec,
+    __in DWORD Depth
+    )
+{
+    PYORILIB_FILEENUM_PARALLEL_POOL Pool = ParentItem->Pool;
+    PYORILIB_FILEENUM_PARALLEL_WORKER Worker;
+    PYORILIB_FILEENUM_PARALLEL_ITEM Item;
+    PYORILIB_FILEENUM_PARALLEL_RECORD Record;
+
+    Item = YoriLibMalloc(sizeof(YORILIB_FILEENUM_PARALLEL_ITEM));
+    if (Item == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Item, sizeof(YORILIB_FILEENUM_PARALLEL_ITEM));
+    Item->Pool = Pool;
+    Item->Depth = Depth;
+    YoriLibInitializeListHead(&Item->Records);
+
+    if (Pool->Ordered) {
+        Record = YoriLibMalloc(sizeof(YORILIB_FILEENUM_PARALLEL_RECORD));
+        if (Record == NULL) {
+            YoriLibFree(Item);
+            return FALSE;
+        }
+        Record->RecordType = YoriLibFileEnumRecordDirectory;
+        Record->ChildItem = Item;
+        Record->ErrorCode = 0;
+        YoriLibInitEmptyString(&Record->FullPath);
+        YoriLibAppendList(&ParentItem->Records, &Record->ListEntry);
+        InterlockedIncrement(&Pool->BufferedRecords);
+    }
+
+    memcpy(&Item->FileSpec, FileSpec, sizeof(YORI_STRING));
+    YoriLibInitEmptyString(FileSpec);
+
+    Worker = ParentItem->Worker;
+    if (Worker == NULL) {
+        Worker = &Pool->Workers[(DWORD)InterlockedIncrement(&Pool->NextWorker) % Pool->WorkerCount];
+    }
+
+    InterlockedIncrement(&Pool->Outstanding);
+    Item->QueuedWorker = Worker;
+    WaitForSingleObject(Worker->Mutex, INFINITE);
+    YoriLibAppendList(&Worker->Queue, &Item->QueueEntry);
+    Item->Queued = TRUE;
+    ReleaseMutex(Worker->Mutex);
+    ReleaseSemaphore(Pool->WorkAvailable, 1, NULL);
+
+    return TRUE;
+}
+
+/**
+ Buffer a result found in a directory as part of a parallel enumeration
+ which is preserving order.
+
+ @param Item The directory being enumerated.
+
+ @param RecordType The type of the result.
+
+ @param FullPath The path to report.
+
+ @param FileInfo For a file result, information about the file.
+
+ @param ErrorCode For an error result, the error code to report.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibFileEnumRecordResult(
+    __in PYORILIB_FILEENUM_PARALLEL_ITEM Item,
+    __in YORILIB_FILEENUM_RECORD_TYPE RecordType,
+    __in PYORI_STRING FullPath,
+    __in_opt PWIN32_FIND_DATA FileInfo,
+    __in DWORD ErrorCode
+    )
+{
+    PYORILIB_FILEENUM_PARALLEL_RECORD Record;
+
+    Record = YoriLibMalloc(sizeof(YORILIB_FILEENUM_PARALLEL_RECORD) + (FullPath->LengthInChars + 1) * sizeof(TCHAR));
+    if (Record == NULL) {
+        return FALSE;
+    }
+
+    Record->RecordType = RecordType;
+    Record->ChildItem = NULL;
+    Record->ErrorCode = ErrorCode;
+    YoriLibInitEmptyString(&Record->FullPath);
+    Record->FullPath.StartOfString = (LPTSTR)(Record + 1);
+    Record->FullPath.LengthInChars = FullPath->LengthInChars;
+    Record->FullPath.LengthAllocated = FullPath->LengthInChars + 1;
+    memcpy(Record->FullPath.StartOfString, FullPath->StartOfString, FullPath->LengthInChars * sizeof(TCHAR));
+    Record->FullPath.StartOfString[FullPath->LengthInChars] = '\0';
+    if (FileInfo != NULL) {
+        memcpy(&Record->FileInfo, FileInfo, sizeof(WIN32_FIND_DATA));
+    }
+
+    YoriLibAppendList(&Item->Records, &Record->ListEntry);
+    InterlockedIncrement(&Item->Pool->BufferedRecords);
+    return TRUE;
+}
+
+/**
+ Free a result buffered as part of a parallel enumeration which is
+ preserving order, and allow workers to start new directories if enough
+ buffered results have been freed.
+
+ @param Pool The parallel enumeration.
+
+ @param Record The result to free.  This must already have been removed
+        from its directory's list of results.
+ */
+VOID
+YoriLibFileEnumFreeRecord(
+    __in PYORILIB_FILEENUM_PARALLEL_POOL Pool,
+    __in PYORILIB_FILEENUM_PARALLEL_RECORD Record
+    )
+{
+    YoriLibFree(Record);
+    if (InterlockedDecrement(&Pool->BufferedRecords) == YORILIB_FILEENUM_PARALLEL_MAX_BUFFERED - 1) {
+        SetEvent(Pool->BufferSpaceAvailable);
+    }
+}
+
+/**
+ Indicate that a parallel enumeration should stop.  Directories which have
+ not yet been enumerated are skipped, and workers waiting for buffered
+ results to be returned are released.
+
+ @param Pool The parallel enumeration.
+ */
+VOID
+YoriLibFileEnumAbort(
+    __in PYORILIB_FILEENUM_PARALLEL_POOL Pool
+    )
+{
+    InterlockedExchange(&Pool->Abort, TRUE);
+    if (Pool->BufferSpaceAvailable != NULL) {
+        SetEvent(Pool->BufferSpaceAvailable);
+    }
+}
+
 /**
  Call a callback for every file matching a specified file pattern.
 
@@ -109,16 +524,24 @@ typedef struct _YORILIB_FOREACHFILE_CONTEXT {
         about failures and wants to silently continue.
 
  @param Context Caller provided context to pass to the callback.
+
+ @param ParallelItem If this directory is being enumerated as part of a
+        parallel enumeration, points to the item describing it.  Any
+        subdirectories are queued rather than enumerated recursively.  If
+        NULL, the enumeration is performed serially on this thread.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
  */
 __success(return)
 BOOL
-YoriLibForEachFileEnum(
+YoriLibForEachFileEnumDirectory(
     __in PYORI_STRING FileSpec,
     __in DWORD MatchFlags,
     __in DWORD Depth,
     __in PYORILIB_FILE_ENUM_FN Callback,
     __in_opt PYORILIB_FILE_ENUM_ERROR_FN ErrorCallback,
-    __in_opt PVOID Context
+    __in_opt PVOID Context,
+    __in_opt PYORILIB_FILEENUM_PARALLEL_ITEM ParallelItem
     )
 {
     HANDLE hFind;
@@ -128,10 +551,21 @@ YoriLibForEachFileEnum(
     BOOLEAN Result;
     BOOLEAN RecursePhase;
     BOOLEAN IsLink;
+    BOOLEAN BufferResults;
     PYORILIB_FOREACHFILE_CONTEXT ForEachContext = NULL;
 
     Result = TRUE;
 
+    //
+    //  If this is part of a parallel enumeration that is preserving order,
+    //  results are buffered for the calling thread to return.
+    //
+
+    BufferResults = FALSE;
+    if (ParallelItem != NULL && ParallelItem->Pool->Ordered) {
+        BufferResults = TRUE;
+    }
+
     //
     //  Allocate heap for state that seems too large to have on the stack
     //  as part of a recursive algorithm
@@ -371,7 +805,11 @@ YoriLibForEachFileEnum(
 
         if (hFind == INVALID_HANDLE_VALUE) {
             if (ErrorCallback != NULL) {
-                if (!ErrorCallback(&ForEachContext->FullPath, GetLastError(), Depth, Context)) {
+                if (BufferResults) {
+                    if (!YoriLibFileEnumRecordResult(ParallelItem, YoriLibFileEnumRecordError, &ForEachContext->FullPath, NULL, GetLastError())) {
+                        Result = FALSE;
+                    }
+                } else if (!ErrorCallback(&ForEachContext->FullPath, GetLastError(), Depth, Context)) {
                     Result = FALSE;
                 }
                 break;
@@ -483,7 +921,12 @@ YoriLibForEachFileEnum(
                         ForEachContext->RecurseCriteria.StartOfString[ForEachContext->RecurseCriteria.LengthInChars] = '\0';
                     }
 
-                    if (!YoriLibForEachFileEnum(&ForEachContext->RecurseCriteria, MatchFlags, Depth + 1, Callback, ErrorCallback, Context)) {
+                    if (ParallelItem != NULL) {
+                        if (!YoriLibFileEnumQueueDirectory(ParallelItem, &ForEachContext->RecurseCriteria, Depth + 1)) {
+                            Result = FALSE;
+                            break;
+                        }
+                    } else if (!YoriLibForEachFileEnumDirectory(&ForEachContext->RecurseCriteria, MatchFlags, Depth + 1, Callback, ErrorCallback, Context, NULL)) {
                         Result = FALSE;
                         break;
                     }
@@ -505,7 +948,12 @@ YoriLibForEachFileEnum(
 
                     ForEachContext->FullPath.LengthInChars = YoriLibSPrintfS(ForEachContext->FullPath.StartOfString, ForEachContext->FullPath.LengthAllocated, _T("%y\\%s"), &ForEachContext->ParentFullPath, ForEachContext->FileInfo.cFileName);
 
-                    if (!Callback(&ForEachContext->FullPath, &ForEachContext->FileInfo, Depth, Context)) {
+                    if (BufferResults) {
+                        if (!YoriLibFileEnumRecordResult(ParallelItem, YoriLibFileEnumRecordFile, &ForEachContext->FullPath, &ForEachContext->FileInfo, 0)) {
+                            Result = FALSE;
+                            break;
+                        }
+                    } else if (!Callback(&ForEachContext->FullPath, &ForEachContext->FileInfo, Depth, Context)) {
                         Result = FALSE;
                         break;
                     }
@@ -538,6 +986,532 @@ YoriLibForEachFileEnum(
     return Result;
 }
 
+/**
+ Free any results buffered for a directory as part of a parallel
+ enumeration, along with any subdirectories it contains.  This must only be
+ called once the directory and all of its subdirectories have finished
+ being enumerated.
+
+ @param Item The directory whose results should be freed.
+ */
+VOID
+YoriLibFileEnumFreeRecords(
+    __in PYORILIB_FILEENUM_PARALLEL_ITEM Item
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORILIB_FILEENUM_PARALLEL_RECORD Record;
+
+    ListEntry = YoriLibGetNextListEntry(&Item->Records, NULL);
+    while (ListEntry != NULL) {
+        Record = CONTAINING_RECORD(ListEntry, YORILIB_FILEENUM_PARALLEL_RECORD, ListEntry);
+        YoriLibRemoveListItem(&Record->ListEntry);
+        if (Record->ChildItem != NULL) {
+            YoriLibFileEnumFreeRecords(Record->ChildItem);
+            YoriLibFreeStringContents(&Record->ChildItem->FileSpec);
+            YoriLibFree(Record->ChildItem);
+        }
+        YoriLibFileEnumFreeRecord(Item->Pool, Record);
+        ListEntry = YoriLibGetNextListEntry(&Item->Records, NULL);
+    }
+}
+
+/**
+ Free a directory queued as part of a parallel enumeration, along with any
+ results buffered for it and any subdirectories it contains.  This must
+ only be called once the directory and all of its subdirectories have
+ finished being enumerated.
+
+ @param Item The directory to free.
+ */
+VOID
+YoriLibFileEnumFreeItem(
+    __in PYORILIB_FILEENUM_PARALLEL_ITEM Item
+    )
+{
+    YoriLibFileEnumFreeRecords(Item);
+    YoriLibFreeStringContents(&Item->FileSpec);
+    YoriLibFree(Item);
+}
+
+/**
+ Enumerate a single directory as part of a parallel enumeration, and
+ indicate that it has been completed.  If the enumeration is not preserving
+ order, the directory is freed once enumerated.
+
+ @param Item The directory to enumerate.
+ */
+VOID
+YoriLibFileEnumProcessItem(
+    __in PYORILIB_FILEENUM_PARALLEL_ITEM Item
+    )
+{
+    PYORILIB_FILEENUM_PARALLEL_POOL Pool = Item->Pool;
+
+    Item->Result = FALSE;
+    if (!Pool->Abort) {
+        Item->Result = YoriLibForEachFileEnumDirectory(&Item->FileSpec,
+                                                       Pool->MatchFlags,
+                                                       Item->Depth,
+                                                       Pool->Callback,
+                                                       Pool->ErrorCallback,
+                                                       Pool->Context,
+                                                       Item);
+    }
+
+    //
+    //  When preserving order, the calling thread decides when to stop based
+    //  on where the failure occurs in the result stream.  Otherwise, stop
+    //  enumerating as soon as anything fails.
+    //
+
+    if (Pool->Ordered) {
+        InterlockedExchange(&Item->Complete, TRUE);
+        SetEvent(Pool->ItemComplete);
+    } else {
+        if (!Item->Result) {
+            YoriLibFileEnumAbort(Pool);
+        }
+        YoriLibFileEnumFreeItem(Item);
+    }
+
+    if (InterlockedDecrement(&Pool->Outstanding) == 0) {
+        SetEvent(Pool->AllDone);
+    }
+}
+
+/**
+ Find a directory to enumerate for a worker.  The worker's own queue is
+ checked first, most recent directory first, so that it proceeds depth
+ first through the tree it has found.  If that is empty, the oldest
+ directory from another worker's queue is taken, since that is likely to
+ be the largest remaining unit of work.
+
+ @param Worker The worker looking for work.
+
+ @return The directory to enumerate, or NULL if no work is available.
+ */
+PYORILIB_FILEENUM_PARALLEL_ITEM
+YoriLibFileEnumGetWork(
+    __in PYORILIB_FILEENUM_PARALLEL_WORKER Worker
+    )
+{
+    PYORILIB_FILEENUM_PARALLEL_POOL Pool = Worker->Pool;
+    PYORILIB_FILEENUM_PARALLEL_WORKER Victim;
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD WorkerIndex;
+    DWORD Offset;
+
+    WaitForSingleObject(Worker->Mutex, INFINITE);
+    ListEntry = YoriLibGetPreviousListEntry(&Worker->Queue, NULL);
+    if (ListEntry != NULL) {
+        YoriLibRemoveListItem(ListEntry);
+        CONTAINING_RECORD(ListEntry, YORILIB_FILEENUM_PARALLEL_ITEM, QueueEntry)->Queued = FALSE;
+    }
+    ReleaseMutex(Worker->Mutex);
+
+    if (ListEntry != NULL) {
+        return CONTAINING_RECORD(ListEntry, YORILIB_FILEENUM_PARALLEL_ITEM, QueueEntry);
+    }
+
+    WorkerIndex = (DWORD)(Worker - Pool->Workers);
+    for (Offset = 1; Offset < Pool->WorkerCount; Offset++) {
+        Victim = &Pool->Workers[(WorkerIndex + Offset) % Pool->WorkerCount];
+        WaitForSingleObject(Victim->Mutex, INFINITE);
+        ListEntry = YoriLibGetNextListEntry(&Victim->Queue, NULL);
+        if (ListEntry != NULL) {
+            YoriLibRemoveListItem(ListEntry);
+            CONTAINING_RECORD(ListEntry, YORILIB_FILEENUM_PARALLEL_ITEM, QueueEntry)->Queued = FALSE;
+        }
+        ReleaseMutex(Victim->Mutex);
+
+        if (ListEntry != NULL) {
+            return CONTAINING_RECORD(ListEntry, YORILIB_FILEENUM_PARALLEL_ITEM, QueueEntry);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ A worker thread which enumerates directories as part of a parallel
+ enumeration until told to exit.
+
+ @param Context Pointer to the worker.
+
+ @return Zero.
+ */
+DWORD WINAPI
+YoriLibFileEnumParallelWorker(
+    __in LPVOID Context
+    )
+{
+    PYORILIB_FILEENUM_PARALLEL_WORKER Worker = (PYORILIB_FILEENUM_PARALLEL_WORKER)Context;
+    PYORILIB_FILEENUM_PARALLEL_POOL Pool = Worker->Pool;
+    PYORILIB_FILEENUM_PARALLEL_ITEM Item;
+
+    while (TRUE) {
+
+        //
+        //  If too many results are waiting to be returned, don't start
+        //  another directory until some have been.  The calling thread
+        //  enumerates any directory it needs that hasn't been started, so
+        //  it never waits for a worker that is waiting here.
+        //
+
+        while (Pool->Ordered &&
+               Pool->BufferedRecords >= YORILIB_FILEENUM_PARALLEL_MAX_BUFFERED &&
+               !Pool->Abort &&
+               !Pool->Shutdown) {
+
+            ResetEvent(Pool->BufferSpaceAvailable);
+            if (Pool->BufferedRecords < YORILIB_FILEENUM_PARALLEL_MAX_BUFFERED ||
+                Pool->Abort ||
+                Pool->Shutdown) {
+
+                break;
+            }
+            WaitForSingleObject(Pool->BufferSpaceAvailable, INFINITE);
+        }
+
+        Item = YoriLibFileEnumGetWork(Worker);
+        if (Item != NULL) {
+            Item->Worker = Worker;
+            YoriLibFileEnumProcessItem(Item);
+            continue;
+        }
+
+        if (Pool->Shutdown) {
+            break;
+        }
+
+        WaitForSingleObject(Pool->WorkAvailable, INFINITE);
+    }
+
+    return 0;
+}
+
+/**
+ Return the buffered results for a directory, and recursively any of its
+ subdirectories, to the caller's callbacks in the order a serial
+ enumeration would return them.  This waits for each directory to finish
+ being enumerated before returning its results.  Results are freed as they
+ are returned.
+
+ @param Pool The parallel enumeration.
+
+ @param Item The directory whose results should be returned.
+
+ @return TRUE to indicate success, FALSE to indicate that enumeration should
+         stop.
+ */
+__success(return)
+BOOL
+YoriLibFileEnumDeliverItem(
+    __in PYORILIB_FILEENUM_PARALLEL_POOL Pool,
+    __in PYORILIB_FILEENUM_PARALLEL_ITEM Item
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORILIB_FILEENUM_PARALLEL_RECORD Record;
+    PYORILIB_FILEENUM_PARALLEL_WORKER Worker;
+    BOOL Claimed;
+    BOOL Result;
+
+    //
+    //  If no worker has started this directory, enumerate it here rather
+    //  than waiting.  Workers may not be starting directories because too
+    //  many results are buffered, and this directory's results must be
+    //  returned before any of those.
+    //
+
+    if (!Item->Complete && Item->QueuedWorker != NULL) {
+        Claimed = FALSE;
+        Worker = Item->QueuedWorker;
+        WaitForSingleObject(Worker->Mutex, INFINITE);
+        if (Item->Queued) {
+            YoriLibRemoveListItem(&Item->QueueEntry);
+            Item->Queued = FALSE;
+            Claimed = TRUE;
+        }
+        ReleaseMutex(Worker->Mutex);
+
+        if (Claimed) {
+            YoriLibFileEnumProcessItem(Item);
+        }
+    }
+
+    while (!Item->Complete) {
+        WaitForSingleObject(Pool->ItemComplete, INFINITE);
+    }
+
+    Result = TRUE;
+    ListEntry = YoriLibGetNextListEntry(&Item->Records, NULL);
+    while (ListEntry != NULL) {
+        Record = CONTAINING_RECORD(ListEntry, YORILIB_FILEENUM_PARALLEL_RECORD, ListEntry);
+
+        if (Record->RecordType == YoriLibFileEnumRecordDirectory) {
+            if (!YoriLibFileEnumDeliverItem(Pool, Record->ChildItem)) {
+                Result = FALSE;
+                break;
+            }
+            YoriLibFileEnumFreeItem(Record->ChildItem);
+            Record->ChildItem = NULL;
+        } else if (Record->RecordType == YoriLibFileEnumRecordError) {
+            if (Pool->ErrorCallback != NULL &&
+                !Pool->ErrorCallback(&Record->FullPath, Record->ErrorCode, Item->Depth, Pool->Context)) {
+
+                Result = FALSE;
+                break;
+            }
+        } else {
+            if (!Pool->Callback(&Record->FullPath, &Record->FileInfo, Item->Depth, Pool->Context)) {
+                Result = FALSE;
+                break;
+            }
+
+            if (YoriLibIsOperationCancelled()) {
+                Result = FALSE;
+                break;
+            }
+        }
+
+        YoriLibRemoveListItem(&Record->ListEntry);
+        YoriLibFileEnumFreeRecord(Pool, Record);
+        ListEntry = YoriLibGetNextListEntry(&Item->Records, NULL);
+    }
+
+    if (Result && !Item->Result) {
+        Result = FALSE;
+    }
+
+    return Result;
+}
+
+/**
+ Call a callback for every file matching a specified file pattern,
+ enumerating subdirectories on a pool of worker threads.  If the pool
+ cannot be created, the enumeration is performed on the calling thread.
+
+ @param FileSpec The pattern to match against.
+
+ @param MatchFlags Specifies the behavior of the match, including whether
+        it should be applied recursively and the recursing behavior.
+
+ @param Depth Indicates the current recursion depth.
+
+ @param Callback The callback to invoke on each match.
+
+ @param ErrorCallback Optionally points to a function to invoke if a
+        directory cannot be enumerated.
+
+ @param Context Caller provided context to pass to the callback.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibForEachFileEnumParallel(
+    __in PYORI_STRING FileSpec,
+    __in DWORD MatchFlags,
+    __in DWORD Depth,
+    __in PYORILIB_FILE_ENUM_FN Callback,
+    __in_opt PYORILIB_FILE_ENUM_ERROR_FN ErrorCallback,
+    __in_opt PVOID Context
+    )
+{
+    PYORILIB_FILEENUM_PARALLEL_POOL Pool;
+    PYORILIB_FILEENUM_PARALLEL_ITEM RootItem;
+    PYORILIB_FILEENUM_PARALLEL_WORKER Worker;
+    SYSTEM_INFO SystemInfo;
+    HANDLE Threads[YORILIB_FILEENUM_PARALLEL_MAX_WORKERS];
+    DWORD MaxWorkers;
+    DWORD Index;
+    DWORD ThreadId;
+    BOOL Result;
+
+    Pool = YoriLibMalloc(sizeof(YORILIB_FILEENUM_PARALLEL_POOL) + sizeof(YORILIB_FILEENUM_PARALLEL_ITEM));
+    if (Pool == NULL) {
+        return YoriLibForEachFileEnumDirectory(FileSpec, MatchFlags, Depth, Callback, ErrorCallback, Context, NULL);
+    }
+
+    ZeroMemory(Pool, sizeof(YORILIB_FILEENUM_PARALLEL_POOL) + sizeof(YORILIB_FILEENUM_PARALLEL_ITEM));
+    RootItem = (PYORILIB_FILEENUM_PARALLEL_ITEM)(Pool + 1);
+
+    Pool->MatchFlags = MatchFlags;
+    Pool->Callback = Callback;
+    Pool->ErrorCallback = ErrorCallback;
+    Pool->Context = Context;
+    if (MatchFlags & YORILIB_FILEENUM_PARALLEL_ORDERED) {
+        Pool->Ordered = TRUE;
+    }
+
+    //
+    //  Enumerating is mostly waiting for the file system, particularly on
+    //  network shares, so use more threads than there are processors.
+    //
+
+    GetSystemInfo(&SystemInfo);
+    MaxWorkers = SystemInfo.dwNumberOfProcessors * 2;
+    if (MaxWorkers < 2) {
+        MaxWorkers = 2;
+    }
+    if (MaxWorkers > YORILIB_FILEENUM_PARALLEL_MAX_WORKERS) {
+        MaxWorkers = YORILIB_FILEENUM_PARALLEL_MAX_WORKERS;
+    }
+
+    Pool->WorkAvailable = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+    Pool->AllDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    Pool->ItemComplete = CreateEvent(NULL, FALSE, FALSE, NULL);
+    Pool->BufferSpaceAvailable = CreateEvent(NULL, TRUE, TRUE, NULL);
+
+    if (Pool->WorkAvailable != NULL &&
+        Pool->AllDone != NULL &&
+        Pool->ItemComplete != NULL &&
+        Pool->BufferSpaceAvailable != NULL) {
+
+        for (Index = 0; Index < MaxWorkers; Index++) {
+            Worker = &Pool->Workers[Pool->WorkerCount];
+            Worker->Pool = Pool;
+            YoriLibInitializeListHead(&Worker->Queue);
+            Worker->Mutex = CreateMutex(NULL, FALSE, NULL);
+            if (Worker->Mutex == NULL) {
+                break;
+            }
+            Worker->hThread = CreateThread(NULL, 0, YoriLibFileEnumParallelWorker, Worker, 0, &ThreadId);
+            if (Worker->hThread == NULL) {
+                CloseHandle(Worker->Mutex);
+                Worker->Mutex = NULL;
+                break;
+            }
+            Threads[Pool->WorkerCount] = Worker->hThread;
+            Pool->WorkerCount++;
+        }
+    }
+
+    //
+    //  If no workers could be started, enumerate on this thread.  Otherwise,
+    //  enumerate the top level directory on this thread, and let the workers
+    //  take any subdirectories found.
+    //
+
+    if (Pool->WorkerCount == 0) {
+        Result = YoriLibForEachFileEnumDirectory(FileSpec, MatchFlags, Depth, Callback, ErrorCallback, Context, NULL);
+    } else {
+        RootItem->Pool = Pool;
+        RootItem->Depth = Depth;
+        YoriLibInitEmptyString(&RootItem->FileSpec);
+        RootItem->FileSpec.StartOfString = FileSpec->StartOfString;
+        RootItem->FileSpec.LengthInChars = FileSpec->LengthInChars;
+        RootItem->FileSpec.LengthAllocated = FileSpec->LengthAllocated;
+        YoriLibInitializeListHead(&RootItem->Records);
+
+        Pool->Outstanding = 1;
+
+        if (Pool->Ordered) {
+            YoriLibFileEnumProcessItem(RootItem);
+            Result = YoriLibFileEnumDeliverItem(Pool, RootItem);
+            if (!Result) {
+                YoriLibFileEnumAbort(Pool);
+            }
+            WaitForSingleObject(Pool->AllDone, INFINITE);
+
+            //
+            //  The root item is part of the pool allocation, so free any
+            //  results that were not returned without freeing the item.
+            //
+
+            YoriLibFileEnumFreeRecords(RootItem);
+        } else {
+
+            //
+            //  Enumerate the root directly rather than via
+            //  YoriLibFileEnumProcessItem, which would free it.
+            //
+
+            Result = YoriLibForEachFileEnumDirectory(FileSpec, MatchFlags, Depth, Callback, ErrorCallback, Context, RootItem);
+            if (!Result) {
+                YoriLibFileEnumAbort(Pool);
+            }
+            if (InterlockedDecrement(&Pool->Outstanding) == 0) {
+                SetEvent(Pool->AllDone);
+            }
+            WaitForSingleObject(Pool->AllDone, INFINITE);
+            if (Pool->Abort) {
+                Result = FALSE;
+            }
+        }
+
+        InterlockedExchange(&Pool->Shutdown, TRUE);
+        SetEvent(Pool->BufferSpaceAvailable);
+        ReleaseSemaphore(Pool->WorkAvailable, Pool->WorkerCount, NULL);
+        WaitForMultipleObjects(Pool->WorkerCount, Threads, TRUE, INFINITE);
+    }
+
+    for (Index = 0; Index < Pool->WorkerCount; Index++) {
+        CloseHandle(Pool->Workers[Index].hThread);
+        CloseHandle(Pool->Workers[Index].Mutex);
+    }
+    if (Pool->WorkAvailable != NULL) {
+        CloseHandle(Pool->WorkAvailable);
+    }
+    if (Pool->AllDone != NULL) {
+        CloseHandle(Pool->AllDone);
+    }
+    if (Pool->ItemComplete != NULL) {
+        CloseHandle(Pool->ItemComplete);
+    }
+    if (Pool->BufferSpaceAvailable != NULL) {
+        CloseHandle(Pool->BufferSpaceAvailable);
+    }
+    YoriLibFree(Pool);
+
+    return Result;
+}
+
+/**
+ Call a callback for every file matching a specified file pattern.  If a
+ parallel enumeration was requested, subdirectories are enumerated on a pool
+ of worker threads.
+
+ @param FileSpec The pattern to match against.
+
+ @param MatchFlags Specifies the behavior of the match, including whether
+        it should be applied recursively and the recursing behavior.
+
+ @param Depth Indicates the current recursion depth.  If this function is
+        reentered, this value is incremented.
+
+ @param Callback The callback to invoke on each match.
+
+ @param ErrorCallback Optionally points to a function to invoke if a
+        directory cannot be enumerated.  If NULL, the caller does not care
+        about failures and wants to silently continue.
+
+ @param Context Caller provided context to pass to the callback.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibForEachFileEnum(
+    __in PYORI_STRING FileSpec,
+    __in DWORD MatchFlags,
+    __in DWORD Depth,
+    __in PYORILIB_FILE_ENUM_FN Callback,
+    __in_opt PYORILIB_FILE_ENUM_ERROR_FN ErrorCallback,
+    __in_opt PVOID Context
+    )
+{
+    if ((MatchFlags & (YORILIB_FILEENUM_PARALLEL | YORILIB_FILEENUM_PARALLEL_ORDERED)) != 0 &&
+        (MatchFlags & (YORILIB_FILEENUM_RECURSE_AFTER_RETURN | YORILIB_FILEENUM_RECURSE_BEFORE_RETURN)) != 0) {
+
+        return YoriLibForEachFileEnumParallel(FileSpec, MatchFlags, Depth, Callback, ErrorCallback, Context);
+    }
+
+    return YoriLibForEachFileEnumDirectory(FileSpec, MatchFlags, Depth, Callback, ErrorCallback, Context, NULL);
+}
+
 /**
  Enumerate the set of possible files matching a user specified pattern.
  This function is responsible for expanding Yori defined sequences, including
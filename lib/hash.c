@@ -28,10 +28,54 @@
 #include "yorilib.h"
 
 
+/**
+ The smallest number of buckets a hash table will be created with.
+ */
+#define YORI_HASH_MINIMUM_BUCKETS (16)
+
+/**
+ The average number of entries per bucket that triggers the table to grow.
+ */
+#define YORI_HASH_MAXIMUM_LOAD (2)
+
+/**
+ Allocate and initialize an array of hash buckets.
+
+ @param NumberBuckets The number of buckets to allocate.  This must be a power
+        of two.
+
+ @return Pointer to the array of buckets, or NULL on allocation failure.
+ */
+PYORI_HASH_BUCKET
+YoriLibAllocateHashBuckets(
+    __in DWORD NumberBuckets
+    )
+{
+    PYORI_HASH_BUCKET Buckets;
+    DWORD BucketIndex;
+
+    if (NumberBuckets > (DWORD)-1 / sizeof(YORI_HASH_BUCKET)) {
+        return NULL;
+    }
+
+    Buckets = YoriLibMalloc(NumberBuckets * sizeof(YORI_HASH_BUCKET));
+    if (Buckets == NULL) {
+        return NULL;
+    }
+
+    for (BucketIndex = 0; BucketIndex < NumberBuckets; BucketIndex++) {
+        YoriLibInitializeListHead(&Buckets[BucketIndex].ListHead);
+    }
+
+    return Buckets;
+}
+
 /**
  Allocate an empty hash table.
 
  @param NumberBuckets The number of buckets to allocate into the hash table.
+        This is a hint for the initial size; it is rounded up to a power of
+        two and the table will grow as entries are inserted.
 
  @return On successful completion, points to the resulting hash table.
          On allocation failure, returns NULL.
@@ -41,22 +85,28 @@ YoriLibAllocateHashTable(
     __in DWORD NumberBuckets
     )
 {
-    DWORD SizeNeeded = sizeof(YORI_HASH_TABLE) + NumberBuckets * sizeof(YORI_HASH_BUCKET);
     PYORI_HASH_TABLE HashTable;
-    DWORD BucketIndex;
+    DWORD ActualBuckets;
 
-    HashTable = YoriLibReferencedMalloc(SizeNeeded);
+    ActualBuckets = YORI_HASH_MINIMUM_BUCKETS;
+    while (ActualBuckets < NumberBuckets && ActualBuckets < 0x10000000) {
+        ActualBuckets = ActualBuckets * 2;
+    }
+
+    HashTable = YoriLibReferencedMalloc(sizeof(YORI_HASH_TABLE));
     if (HashTable == NULL) {
         return NULL;
     }
 
-    HashTable->NumberBuckets = NumberBuckets;
-    HashTable->Buckets = (PYORI_HASH_BUCKET)(HashTable + 1);
-
-    for (BucketIndex = 0; BucketIndex < NumberBuckets; BucketIndex++) {
-        YoriLibInitializeListHead(&HashTable->Buckets[BucketIndex].ListHead);
+    HashTable->Buckets = YoriLibAllocateHashBuckets(ActualBuckets);
+    if (HashTable->Buckets == NULL) {
+        YoriLibDereference(HashTable);
+        return NULL;
     }
 
+    HashTable->NumberBuckets = ActualBuckets;
+    HashTable->NumberEntries = 0;
+
     return HashTable;
 }
 
@@ -74,49 +124,119 @@ YoriLibFreeEmptyHashTable(
 #if DBG
     DWORD BucketIndex;
 
+    ASSERT(HashTable->NumberEntries == 0);
     for (BucketIndex = 0; BucketIndex < HashTable->NumberBuckets; BucketIndex++) {
         ASSERT(YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, NULL) == NULL);
     }
 #endif
 
+    YoriLibFree(HashTable->Buckets);
     YoriLibDereference(HashTable);
 }
 
 /**
- Hash a yori string into a 16 bit hash value.
+ Hash a yori string into a 32 bit hash value.  The hash is case insensitive,
+ consistent with the comparison used to match keys.
 
  @param String The string to generate a hash for.
 
- @return A 16 bit hash value for the string.
+ @return A 32 bit hash value for the string.
  */
-WORD
-YoriLibHashString(
+DWORD
+YoriLibHashStringFull(
     __in PYORI_STRING String
     )
 {
     DWORD Hash;
     DWORD Index;
+    TCHAR Char;
 
     //
-    //  Simple string xor hash
+    //  FNV-1a over each upcased character, processing both bytes of
+    //  the character.
     //
 
-    Hash = 0;
+    Hash = 2166136261;
     for (Index = 0; Index < String->LengthInChars; Index++) {
-        Hash = (Hash << 3) ^ YoriLibUpcaseChar(String->StartOfString[Index]) ^ (Hash >> 29);
+        Char = YoriLibUpcaseChar(String->StartOfString[Index]);
+        Hash = (Hash ^ (Char & 0xFF)) * 16777619;
+        Hash = (Hash ^ ((Char >> 8) & 0xFF)) * 16777619;
     }
 
     //
-    //  Move some high bits into the low bits since the low bits
-    //  will likely be used as a bucket index.  Note we're moving
-    //  bits 16 here and 3 above (ie., not divisible and won't
-    //  cancel out.)
+    //  Since the low bits are used as a bucket index, mix the high bits
+    //  into them.
     //
 
+    Hash = Hash ^ (Hash >> 16);
+    Hash = Hash * 0x85ebca6b;
+    Hash = Hash ^ (Hash >> 13);
+
+    return Hash;
+}
+
+/**
+ Hash a yori string into a 16 bit hash value.
+
+ @param String The string to generate a hash for.
+
+ @return A 16 bit hash value for the string.
+ */
+WORD
+YoriLibHashString(
+    __in PYORI_STRING String
+    )
+{
+    DWORD Hash;
+
+    Hash = YoriLibHashStringFull(String);
     Hash = Hash ^ (Hash >> 16);
     return (WORD)Hash;
 }
 
+/**
+ Attempt to grow a hash table by doubling its number of buckets, moving all
+ existing entries into the new buckets.  Since each entry records its full
+ hash, this does not need to look at any key.  If memory cannot be
+ allocated, the table continues to operate with its existing buckets.
+
+ @param HashTable Pointer to the hash table to grow.
+ */
+VOID
+YoriLibHashGrowTable(
+    __in PYORI_HASH_TABLE HashTable
+    )
+{
+    PYORI_HASH_BUCKET NewBuckets;
+    DWORD NewNumberBuckets;
+    DWORD BucketIndex;
+    PYORI_LIST_ENTRY ListHead;
+    PYORI_HASH_ENTRY HashEntry;
+
+    if (HashTable->NumberBuckets >= 0x10000000) {
+        return;
+    }
+
+    NewNumberBuckets = HashTable->NumberBuckets * 2;
+    NewBuckets = YoriLibAllocateHashBuckets(NewNumberBuckets);
+    if (NewBuckets == NULL) {
+        return;
+    }
+
+    for (BucketIndex = 0; BucketIndex < HashTable->NumberBuckets; BucketIndex++) {
+        ListHead = &HashTable->Buckets[BucketIndex].ListHead;
+        while (!YoriLibIsListEmpty(ListHead)) {
+            HashEntry = CONTAINING_RECORD(ListHead->Next, YORI_HASH_ENTRY, ListEntry);
+            YoriLibRemoveListItem(&HashEntry->ListEntry);
+            YoriLibAppendList(&NewBuckets[HashEntry->Hash & (NewNumberBuckets - 1)].ListHead, &HashEntry->ListEntry);
+        }
+    }
+
+    YoriLibFree(HashTable->Buckets);
+    HashTable->Buckets = NewBuckets;
+    HashTable->NumberBuckets = NewNumberBuckets;
+}
+
 /**
  Insert an object with a string based key into the hash table.
 
@@ -138,11 +258,20 @@ YoriLibHashInsertByKey(
     __out PYORI_HASH_ENTRY HashEntry
     )
 {
-    DWORD BucketIndex = YoriLibHashString(KeyString) % HashTable->NumberBuckets;
+    DWORD BucketIndex;
+
+    if (HashTable->NumberEntries >= HashTable->NumberBuckets * YORI_HASH_MAXIMUM_LOAD) {
+        YoriLibHashGrowTable(HashTable);
+    }
+
+    HashEntry->Hash = YoriLibHashStringFull(KeyString);
+    BucketIndex = HashEntry->Hash & (HashTable->NumberBuckets - 1);
 
     YoriLibCloneString(&HashEntry->Key, KeyString);
     HashEntry->Context = Context;
+    HashEntry->HashTable = HashTable;
     YoriLibInsertList(&HashTable->Buckets[BucketIndex].ListHead, &HashEntry->ListEntry);
+    HashTable->NumberEntries++;
 }
 
 /**
@@ -161,22 +290,69 @@ YoriLibHashLookupByKey(
     __in PYORI_STRING KeyString
     )
 {
-    DWORD BucketIndex = YoriLibHashString(KeyString) % HashTable->NumberBuckets;
+    DWORD Hash;
+    PYORI_LIST_ENTRY ListHead;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_HASH_ENTRY HashEntry;
+
+    Hash = YoriLibHashStringFull(KeyString);
+    ListHead = &HashTable->Buckets[Hash & (HashTable->NumberBuckets - 1)].ListHead;
+
+    ListEntry = YoriLibGetNextListEntry(ListHead, NULL);
+    while (ListEntry != NULL) {
+        HashEntry = CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
+        if (HashEntry->Hash == Hash &&
+            HashEntry->Key.LengthInChars == KeyString->LengthInChars &&
+            YoriLibCompareStringInsensitive(KeyString, &HashEntry->Key) == 0) {
+
+            return HashEntry;
+        }
+        ListEntry = YoriLibGetNextListEntry(ListHead, ListEntry);
+    }
+
+    return NULL;
+}
+
+/**
+ Locate an object within the hash table by a specified key, requiring the
+ key to match exactly including case.  Since keys are hashed without regard
+ to case, a table used this way can contain several entries whose keys
+ differ only by case.
+
+ @param HashTable Pointer to the hash table to search for the object.
+
+ @param KeyString Pointer to the key to identify the object.
+
+ @return Pointer to the entry within the hash table if a match is found.
+         If no match is found, returns NULL.
+ */
+PYORI_HASH_ENTRY
+YoriLibHashLookupByKeyCaseSensitive(
+    __in PYORI_HASH_TABLE HashTable,
+    __in PYORI_STRING KeyString
+    )
+{
+    DWORD Hash;
+    PYORI_LIST_ENTRY ListHead;
     PYORI_LIST_ENTRY ListEntry;
     PYORI_HASH_ENTRY HashEntry;
 
-    HashEntry = NULL;
-    ListEntry = YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, NULL);
+    Hash = YoriLibHashStringFull(KeyString);
+    ListHead = &HashTable->Buckets[Hash & (HashTable->NumberBuckets - 1)].ListHead;
+
+    ListEntry = YoriLibGetNextListEntry(ListHead, NULL);
     while (ListEntry != NULL) {
         HashEntry = CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
-        if (YoriLibCompareStringInsensitive(KeyString, &HashEntry->Key) == 0) {
-            break;
+        if (HashEntry->Hash == Hash &&
+            HashEntry->Key.LengthInChars == KeyString->LengthInChars &&
+            YoriLibCompareString(KeyString, &HashEntry->Key) == 0) {
+
+            return HashEntry;
         }
-        HashEntry = NULL;
-        ListEntry = YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(ListHead, ListEntry);
     }
 
-    return HashEntry;
+    return NULL;
 }
 
 /**
@@ -190,6 +366,9 @@ YoriLibHashRemoveByEntry(
     __in PYORI_HASH_ENTRY HashEntry
     )
 {
+    ASSERT(HashEntry->HashTable->NumberEntries > 0);
+    HashEntry->HashTable->NumberEntries--;
+    HashEntry->HashTable = NULL;
     YoriLibRemoveListItem(&HashEntry->ListEntry);
     YoriLibFreeStringContents(&HashEntry->Key);
 }
@@ -84,4 +84,34 @@ YoriLibLimitJobObjectPriority(
     return DllKernel32.pSetInformationJobObject(hJob, 2, &LimitInfo, sizeof(LimitInfo));
 }
 
+/**
+ Request notifications about processes within a job object to be posted to
+ a completion port.  If this functionality is not supported by the host OS,
+ returns FALSE.
+
+ @param hJob Handle to the job object.
+
+ @param hPort Handle to the completion port.
+
+ @param Key A context value to return with each notification.
+
+ @return TRUE on success, FALSE on failure.
+ */
+BOOL
+YoriLibAssociateJobObjectWithCompletionPort(
+    __in HANDLE hJob,
+    __in HANDLE hPort,
+    __in_opt PVOID Key
+    )
+{
+    YORI_JOB_ASSOCIATE_COMPLETION_PORT PortInfo;
+    if (DllKernel32.pSetInformationJobObject == NULL) {
+        return FALSE;
+    }
+    ZeroMemory(&PortInfo, sizeof(PortInfo));
+    PortInfo.Key = Key;
+    PortInfo.Port = hPort;
+    return DllKernel32.pSetInformationJobObject(hJob, 7, &PortInfo, sizeof(PortInfo));
+}
+
 // vim:sw=4:ts=4:et:
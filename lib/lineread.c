@@ -27,6 +27,18 @@
 #include "yoripch.h"
 #include "yorilib.h"
 
+/**
+ On AMD64 SSE2 is part of the base architecture, so newline scanning and
+ ASCII widening can use it without any runtime check.  Other architectures
+ use the scalar loops.
+ */
+#if defined(_M_AMD64) && defined(_MSC_VER) && (_MSC_VER >= 1400)
+#define YORI_LIB_LINEREAD_SSE2 1
+#include <emmintrin.h>
+#else
+#define YORI_LIB_LINEREAD_SSE2 0
+#endif
+
 /**
  Context to be passed between repeated line read calls to contain data
  that doesn't constitute a whole line but cannot be left in the incoming
@@ -80,6 +92,155 @@ typedef struct _YORI_LIB_LINE_READ_CONTEXT {
 
 } YORI_LIB_LINE_READ_CONTEXT, *PYORI_LIB_LINE_READ_CONTEXT;
 
+/**
+ Find the first carriage return or line feed in a buffer of 8 bit
+ characters.
+
+ @param Buffer Pointer to the buffer to scan.
+
+ @param Length The number of characters in the buffer.
+
+ @return The index of the first CR or LF character, or Length if the buffer
+         does not contain either.
+ */
+DWORD
+YoriLibFindLineBreakA(
+    __in PUCHAR Buffer,
+    __in DWORD Length
+    )
+{
+    DWORD Index;
+#if YORI_LIB_LINEREAD_SSE2
+    __m128i Cr;
+    __m128i Lf;
+    __m128i Chunk;
+#endif
+
+    Index = 0;
+
+#if YORI_LIB_LINEREAD_SSE2
+    Cr = _mm_set1_epi8(0xD);
+    Lf = _mm_set1_epi8(0xA);
+    while (Index + sizeof(__m128i) <= Length) {
+        Chunk = _mm_loadu_si128((__m128i *)&Buffer[Index]);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(Chunk, Cr), _mm_cmpeq_epi8(Chunk, Lf))) != 0) {
+            break;
+        }
+        Index += sizeof(__m128i);
+    }
+#endif
+
+    for (; Index < Length; Index++) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            break;
+        }
+    }
+
+    return Index;
+}
+
+/**
+ Find the first carriage return or line feed in a buffer of 16 bit
+ characters.
+
+ @param Buffer Pointer to the buffer to scan.
+
+ @param Length The number of characters in the buffer.
+
+ @return The index of the first CR or LF character, or Length if the buffer
+         does not contain either.
+ */
+DWORD
+YoriLibFindLineBreakW(
+    __in PWCHAR Buffer,
+    __in DWORD Length
+    )
+{
+    DWORD Index;
+#if YORI_LIB_LINEREAD_SSE2
+    __m128i Cr;
+    __m128i Lf;
+    __m128i Chunk;
+#endif
+
+    Index = 0;
+
+#if YORI_LIB_LINEREAD_SSE2
+    Cr = _mm_set1_epi16(0xD);
+    Lf = _mm_set1_epi16(0xA);
+    while (Index + sizeof(__m128i) / sizeof(WCHAR) <= Length) {
+        Chunk = _mm_loadu_si128((__m128i *)&Buffer[Index]);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(Chunk, Cr), _mm_cmpeq_epi16(Chunk, Lf))) != 0) {
+            break;
+        }
+        Index += sizeof(__m128i) / sizeof(WCHAR);
+    }
+#endif
+
+    for (; Index < Length; Index++) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            break;
+        }
+    }
+
+    return Index;
+}
+
+/**
+ Attempt to convert a buffer of 8 bit characters into UTF16 by widening each
+ character.  This is only valid if every character is 7 bit ASCII, which is
+ checked as the conversion proceeds.
+
+ @param Source Pointer to the 8 bit characters to convert.
+
+ @param Length The number of characters to convert.
+
+ @param Target Pointer to a buffer to be populated with UTF16 characters.
+        This must be at least Length characters long.  On failure, its
+        contents are undefined.
+
+ @return TRUE if every character was 7 bit ASCII and Target has been
+         populated, FALSE if a character outside of this range was found.
+ */
+__success(return)
+BOOL
+YoriLibWidenAsciiRun(
+    __in PUCHAR Source,
+    __in DWORD Length,
+    __out_ecount(Length) PWCHAR Target
+    )
+{
+    DWORD Index;
+#if YORI_LIB_LINEREAD_SSE2
+    __m128i Zero;
+    __m128i Chunk;
+#endif
+
+    Index = 0;
+
+#if YORI_LIB_LINEREAD_SSE2
+    Zero = _mm_setzero_si128();
+    while (Index + sizeof(__m128i) <= Length) {
+        Chunk = _mm_loadu_si128((__m128i *)&Source[Index]);
+        if (_mm_movemask_epi8(Chunk) != 0) {
+            return FALSE;
+        }
+        _mm_storeu_si128((__m128i *)&Target[Index], _mm_unpacklo_epi8(Chunk, Zero));
+        _mm_storeu_si128((__m128i *)&Target[Index + sizeof(__m128i) / 2], _mm_unpackhi_epi8(Chunk, Zero));
+        Index += sizeof(__m128i);
+    }
+#endif
+
+    for (; Index < Length; Index++) {
+        if (Source[Index] >= 0x80) {
+            return FALSE;
+        }
+        Target[Index] = Source[Index];
+    }
+
+    return TRUE;
+}
+
 /**
  Copy the contents of a line into a user specified buffer.  If the buffer
  is not large enough, it is reallocated.  This function performs encoding
@@ -103,6 +264,32 @@ YoriLibCopyLineToUserBufferW(
     )
 {
     DWORD CharsNeeded;
+    DWORD Encoding;
+
+    //
+    //  For encodings where 7 bit characters are ASCII, a line that contains
+    //  only those characters can be widened directly.  Each input byte can
+    //  never produce more than one UTF16 character in these encodings, so
+    //  a buffer of CharsToCopy is sufficient either way.
+    //
+
+    Encoding = YoriLibGetMultibyteInputEncoding();
+    if (CharsToCopy > 0 &&
+        (Encoding == CP_UTF8 || Encoding == CP_ACP || Encoding == CP_OEMCP)) {
+
+        if (CharsToCopy + 1 > UserString->LengthAllocated) {
+            UserString->LengthInChars = 0;
+            if (!YoriLibReallocateString(UserString, CharsToCopy + 1 + 64)) {
+                return FALSE;
+            }
+        }
+
+        if (YoriLibWidenAsciiRun((PUCHAR)SourceBuffer, CharsToCopy, UserString->StartOfString)) {
+            UserString->LengthInChars = CharsToCopy;
+            UserString->StartOfString[UserString->LengthInChars] = '\0';
+            return TRUE;
+        }
+    }
 
     if (CharsToCopy == 0) {
         CharsNeeded = 1;
@@ -302,95 +489,98 @@ YoriLibReadLineToStringEx(
         if (ReadContext->ReadWChars) {
             PWCHAR WideBuffer = (PWCHAR)YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->CurrentBufferOffset);
             CharsRemaining = (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset) / sizeof(WCHAR);
-            for (Count = 0; Count < CharsRemaining; Count++) {
-                if (WideBuffer[Count] == 0xD ||
-                    WideBuffer[Count] == 0xA) {
-
-                    ProcessThisLine = TRUE;
-
-                    CharsToCopy = Count;
-                    if (WideBuffer[Count] == 0xD) {
-                        if ((Count + 1) * sizeof(WCHAR) < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
-                            if (WideBuffer[Count + 1] == 0xA) {
-                                Count++;
-                            }
-                        } else if (ReadContext->CurrentBufferOffset > 0) {
-                            ProcessThisLine = FALSE;
+            Count = 0;
+            while (TRUE) {
+                Count += YoriLibFindLineBreakW(&WideBuffer[Count], CharsRemaining - Count);
+                if (Count >= CharsRemaining) {
+                    break;
+                }
+
+                ProcessThisLine = TRUE;
+
+                CharsToCopy = Count;
+                if (WideBuffer[Count] == 0xD) {
+                    if ((Count + 1) * sizeof(WCHAR) < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
+                        if (WideBuffer[Count + 1] == 0xA) {
+                            Count++;
                         }
+                    } else if (ReadContext->CurrentBufferOffset > 0) {
+                        ProcessThisLine = FALSE;
                     }
+                }
 
-                    Count++;
+                Count++;
 
-                    if (ProcessThisLine) {
+                if (ProcessThisLine) {
 
-                        CharsToSkip = 0;
-                        if (!BomFound && ReadContext->LinesRead == 0) {
-                            CharsToSkip = YoriLibBytesInBom(ReadContext->PreviousBuffer, CharsToCopy * sizeof(WCHAR));
-                            if (CharsToSkip > 0) {
-                                BomFound = TRUE;
-                                CharsToSkip = CharsToSkip / sizeof(WCHAR);
-                                CharsToCopy -= CharsToSkip;
-                            }
-                        }
-                        if (YoriLibCopyLineToUserBufferW(UserString, (LPSTR)&WideBuffer[CharsToSkip], CharsToCopy)) {
-                            ReadContext->CurrentBufferOffset += Count * sizeof(WCHAR);
-                            ReadContext->LinesRead++;
-                            *LineTerminated = TRUE;
-                            return UserString->StartOfString;
-                        } else {
-                            UserString->LengthInChars = 0;
-                            *LineTerminated = FALSE;
-                            ReadContext->Terminated = TRUE;
-                            return NULL;
+                    CharsToSkip = 0;
+                    if (!BomFound && ReadContext->LinesRead == 0) {
+                        CharsToSkip = YoriLibBytesInBom(ReadContext->PreviousBuffer, CharsToCopy * sizeof(WCHAR));
+                        if (CharsToSkip > 0) {
+                            BomFound = TRUE;
+                            CharsToSkip = CharsToSkip / sizeof(WCHAR);
+                            CharsToCopy -= CharsToSkip;
                         }
                     }
+                    if (YoriLibCopyLineToUserBufferW(UserString, (LPSTR)&WideBuffer[CharsToSkip], CharsToCopy)) {
+                        ReadContext->CurrentBufferOffset += Count * sizeof(WCHAR);
+                        ReadContext->LinesRead++;
+                        *LineTerminated = TRUE;
+                        return UserString->StartOfString;
+                    } else {
+                        UserString->LengthInChars = 0;
+                        *LineTerminated = FALSE;
+                        ReadContext->Terminated = TRUE;
+                        return NULL;
+                    }
                 }
             }
         } else {
             PUCHAR Buffer = YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->CurrentBufferOffset);
             CharsRemaining = ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset;
-            for (Count = 0; Count < CharsRemaining; Count++) {
-
-                if (Buffer[Count] == 0xD ||
-                    Buffer[Count] == 0xA) {
+            Count = 0;
+            while (TRUE) {
+                Count += YoriLibFindLineBreakA(&Buffer[Count], CharsRemaining - Count);
+                if (Count >= CharsRemaining) {
+                    break;
+                }
 
-                    ProcessThisLine = TRUE;
+                ProcessThisLine = TRUE;
 
-                    CharsToCopy = Count;
-                    if (Buffer[Count] == 0xD) {
-                        if (Count + 1 < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
-                            if (Buffer[Count + 1] == 0xA) {
-                                Count++;
-                            }
-                        } else if (ReadContext->CurrentBufferOffset > 0) {
-                            ProcessThisLine = FALSE;
+                CharsToCopy = Count;
+                if (Buffer[Count] == 0xD) {
+                    if (Count + 1 < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
+                        if (Buffer[Count + 1] == 0xA) {
+                            Count++;
                         }
+                    } else if (ReadContext->CurrentBufferOffset > 0) {
+                        ProcessThisLine = FALSE;
                     }
+                }
 
-                    Count++;
+                Count++;
 
-                    if (ProcessThisLine) {
+                if (ProcessThisLine) {
 
-                        CharsToSkip = 0;
-                        if (!BomFound && ReadContext->LinesRead == 0) {
-                            CharsToSkip = YoriLibBytesInBom(ReadContext->PreviousBuffer, CharsToCopy);
-                            if (CharsToSkip > 0) {
-                                BomFound = TRUE;
-                                CharsToCopy -= CharsToSkip;
-                            }
-                        }
-                        if (YoriLibCopyLineToUserBufferW(UserString, (LPSTR)&Buffer[CharsToSkip], CharsToCopy)) {
-                            ReadContext->CurrentBufferOffset += Count;
-                            ReadContext->LinesRead++;
-                            *LineTerminated = TRUE;
-                            return UserString->StartOfString;
-                        } else {
-                            UserString->LengthInChars = 0;
-                            *LineTerminated = FALSE;
-                            ReadContext->Terminated = TRUE;
-                            return NULL;
+                    CharsToSkip = 0;
+                    if (!BomFound && ReadContext->LinesRead == 0) {
+                        CharsToSkip = YoriLibBytesInBom(ReadContext->PreviousBuffer, CharsToCopy);
+                        if (CharsToSkip > 0) {
+                            BomFound = TRUE;
+                            CharsToCopy -= CharsToSkip;
                         }
                     }
+                    if (YoriLibCopyLineToUserBufferW(UserString, (LPSTR)&Buffer[CharsToSkip], CharsToCopy)) {
+                        ReadContext->CurrentBufferOffset += Count;
+                        ReadContext->LinesRead++;
+                        *LineTerminated = TRUE;
+                        return UserString->StartOfString;
+                    } else {
+                        UserString->LengthInChars = 0;
+                        *LineTerminated = FALSE;
+                        ReadContext->Terminated = TRUE;
+                        return NULL;
+                    }
                 }
             }
         }
@@ -622,4 +812,532 @@ YoriLibLineReadClose(
     }
 }
 
+/**
+ The number of bytes of a disk file to map at a time when returning line
+ views.  Lines longer than this are returned in pieces.
+ */
+#define YORI_LIB_LINE_VIEW_WINDOW_SIZE (64 * 1024 * 1024)
+
+/**
+ Context describing the state of a line view operation.  For disk files, this
+ describes a window of the file that is mapped into memory; for other
+ handles, this contains a line read context and the most recent line.
+ */
+typedef struct _YORI_LIB_LINE_VIEW_CONTEXT {
+
+    /**
+     The handle to the file being read.
+     */
+    HANDLE FileHandle;
+
+    /**
+     If TRUE, lines are being returned from a mapping of the file.  If FALSE,
+     lines are being read via YoriLibReadLineToStringEx.
+     */
+    BOOLEAN Mapped;
+
+    /**
+     If TRUE, the file contains 16 bit characters.  If FALSE, it contains
+     8 bit characters in the input encoding.
+     */
+    BOOLEAN ReadWChars;
+
+    /**
+     The input encoding at the time the file was opened.
+     */
+    DWORD Encoding;
+
+    /**
+     The section object describing the file, if the file is mapped.
+     */
+    HANDLE MappingHandle;
+
+    /**
+     Pointer to the currently mapped window of the file.
+     */
+    PUCHAR MappedView;
+
+    /**
+     The file offset of the beginning of the currently mapped window.
+     */
+    LONGLONG ViewFileOffset;
+
+    /**
+     The number of bytes in the currently mapped window.
+     */
+    DWORD ViewLength;
+
+    /**
+     The total size of the file, in bytes.
+     */
+    LONGLONG FileSize;
+
+    /**
+     The file offset of the next byte that has not been returned as part of
+     a line.
+     */
+    LONGLONG CurrentOffset;
+
+    /**
+     The granularity that windows of the file must be mapped at.
+     */
+    DWORD AllocationGranularity;
+
+    /**
+     The line read context used when the file is not mapped.
+     */
+    PVOID LineReadContext;
+
+    /**
+     A buffer containing the most recent line when the file is not mapped.
+     */
+    YORI_STRING LineString;
+
+} YORI_LIB_LINE_VIEW_CONTEXT, *PYORI_LIB_LINE_VIEW_CONTEXT;
+
+/**
+ Map a window of a file into memory, starting at the allocation granularity
+ boundary at or before a specified offset.
+
+ @param ViewContext Pointer to the line view context.
+
+ @param Offset The file offset that should be contained in the window.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibLineViewMapWindow(
+    __in PYORI_LIB_LINE_VIEW_CONTEXT ViewContext,
+    __in LONGLONG Offset
+    )
+{
+    LARGE_INTEGER WindowOffset;
+    LONGLONG WindowLength;
+
+    if (ViewContext->MappedView != NULL) {
+        UnmapViewOfFile(ViewContext->MappedView);
+        ViewContext->MappedView = NULL;
+        ViewContext->ViewLength = 0;
+    }
+
+    WindowOffset.QuadPart = Offset - (Offset % ViewContext->AllocationGranularity);
+    WindowLength = ViewContext->FileSize - WindowOffset.QuadPart;
+    if (WindowLength > YORI_LIB_LINE_VIEW_WINDOW_SIZE) {
+        WindowLength = YORI_LIB_LINE_VIEW_WINDOW_SIZE;
+    }
+
+    ViewContext->MappedView = MapViewOfFile(ViewContext->MappingHandle, FILE_MAP_READ, WindowOffset.HighPart, WindowOffset.LowPart, (SIZE_T)WindowLength);
+    if (ViewContext->MappedView == NULL) {
+        return FALSE;
+    }
+
+    ViewContext->ViewFileOffset = WindowOffset.QuadPart;
+    ViewContext->ViewLength = (DWORD)WindowLength;
+    return TRUE;
+}
+
+/**
+ Determine whether a disk file can be mapped into memory to return line
+ views.  If the device containing a mapped file fails, reading from the
+ mapping raises EXCEPTION_IN_PAGE_ERROR rather than returning an error.  The
+ mini CRT does not support structured exception handling, so that exception
+ cannot be caught here.  Files on remote or removable devices, which can
+ fail or disappear while being read, are therefore read with ReadFile, so
+ device failures are returned as errors.
+
+ @param FileHandle The handle to the file.
+
+ @return TRUE if the file is on a local, fixed device and can be mapped,
+         FALSE if it should be read with ReadFile.
+ */
+BOOL
+YoriLibLineViewIsMappable(
+    __in HANDLE FileHandle
+    )
+{
+    IO_STATUS_BLOCK IoStatus;
+    FILE_FS_DEVICE_INFORMATION DeviceInfo;
+    LONG Status;
+
+    YoriLibLoadNtDllFunctions();
+    if (DllNtDll.pNtQueryVolumeInformationFile == NULL) {
+        return FALSE;
+    }
+
+    Status = DllNtDll.pNtQueryVolumeInformationFile(FileHandle, &IoStatus, &DeviceInfo, sizeof(DeviceInfo), FileFsDeviceInformation);
+    if (Status != 0) {
+        return FALSE;
+    }
+
+    if (DeviceInfo.Characteristics & (FILE_REMOTE_DEVICE | FILE_REMOVABLE_MEDIA)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Prepare to return lines from a file as views into the file's contents.  For
+ files on local fixed disks, the file is mapped into memory starting from
+ the current file position, and lines are returned without being copied.
+ For other handles, such as pipes or files on network or removable
+ devices, lines are read with YoriLibReadLineToStringEx and the view refers
+ to the UTF16 form of each line.
+
+ @param FileHandle The handle to the file to read lines from.
+
+ @param Context On successful completion, updated to point to a newly
+        allocated context which should be passed to YoriLibLineViewNext and
+        freed with YoriLibLineViewClose.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibLineViewOpen(
+    __in HANDLE FileHandle,
+    __out PVOID * Context
+    )
+{
+    PYORI_LIB_LINE_VIEW_CONTEXT ViewContext;
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER CurrentOffset;
+    SYSTEM_INFO SystemInfo;
+
+    ViewContext = YoriLibMalloc(sizeof(YORI_LIB_LINE_VIEW_CONTEXT));
+    if (ViewContext == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(ViewContext, sizeof(YORI_LIB_LINE_VIEW_CONTEXT));
+    ViewContext->FileHandle = FileHandle;
+    YoriLibInitEmptyString(&ViewContext->LineString);
+    ViewContext->Encoding = YoriLibGetMultibyteInputEncoding();
+    if (ViewContext->Encoding == CP_UTF16) {
+        ViewContext->ReadWChars = TRUE;
+    }
+
+    //
+    //  Only attempt to map regular files on local fixed devices with content
+    //  beyond the current file position.  Anything else, or any failure
+    //  along the way, falls back to reading lines through the holdover
+    //  buffer.
+    //
+
+    if (GetFileType(FileHandle) == FILE_TYPE_DISK &&
+        YoriLibLineViewIsMappable(FileHandle)) {
+
+        FileSize.LowPart = GetFileSize(FileHandle, (LPDWORD)&FileSize.HighPart);
+        if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+            FileSize.QuadPart = 0;
+        }
+
+        CurrentOffset.HighPart = 0;
+        CurrentOffset.LowPart = SetFilePointer(FileHandle, 0, &CurrentOffset.HighPart, FILE_CURRENT);
+        if (CurrentOffset.LowPart == INVALID_SET_FILE_POINTER && GetLastError() != NO_ERROR) {
+            CurrentOffset.QuadPart = FileSize.QuadPart;
+        }
+
+        if (CurrentOffset.QuadPart < FileSize.QuadPart) {
+            ViewContext->MappingHandle = CreateFileMapping(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (ViewContext->MappingHandle != NULL) {
+                GetSystemInfo(&SystemInfo);
+                ViewContext->AllocationGranularity = SystemInfo.dwAllocationGranularity;
+                ViewContext->FileSize = FileSize.QuadPart;
+                ViewContext->CurrentOffset = CurrentOffset.QuadPart;
+                if (YoriLibLineViewMapWindow(ViewContext, CurrentOffset.QuadPart)) {
+                    ViewContext->Mapped = TRUE;
+                } else {
+                    CloseHandle(ViewContext->MappingHandle);
+                    ViewContext->MappingHandle = NULL;
+                }
+            }
+        }
+    }
+
+    *Context = ViewContext;
+    return TRUE;
+}
+
+/**
+ Return the next line from a file that has been mapped into memory.
+
+ @param ViewContext Pointer to the line view context.
+
+ @param LineView On successful completion, populated with a description of
+        the line.
+
+ @return TRUE if a line was returned, FALSE if the end of the file has been
+         reached or an error occurred.
+ */
+__success(return)
+BOOL
+YoriLibLineViewNextMapped(
+    __in PYORI_LIB_LINE_VIEW_CONTEXT ViewContext,
+    __out PYORI_LIB_LINE_VIEW LineView
+    )
+{
+    PUCHAR LineStart;
+    DWORD BytesRemaining;
+    DWORD CharsRemaining;
+    DWORD CharSize;
+    DWORD LineLength;
+    DWORD TerminatorLength;
+    DWORD BomLength;
+    BOOLEAN Terminated;
+    BOOLEAN AtEndOfFile;
+
+    CharSize = ViewContext->ReadWChars?sizeof(WCHAR):sizeof(CHAR);
+
+    while (TRUE) {
+
+        if (ViewContext->FileSize - ViewContext->CurrentOffset < CharSize) {
+            return FALSE;
+        }
+
+        //
+        //  Make sure the window contains the next character to return.
+        //
+
+        if (ViewContext->CurrentOffset < ViewContext->ViewFileOffset ||
+            ViewContext->CurrentOffset + CharSize > ViewContext->ViewFileOffset + ViewContext->ViewLength) {
+
+            if (!YoriLibLineViewMapWindow(ViewContext, ViewContext->CurrentOffset)) {
+                return FALSE;
+            }
+        }
+
+        LineStart = ViewContext->MappedView + (DWORD)(ViewContext->CurrentOffset - ViewContext->ViewFileOffset);
+        BytesRemaining = ViewContext->ViewLength - (DWORD)(ViewContext->CurrentOffset - ViewContext->ViewFileOffset);
+        CharsRemaining = BytesRemaining / CharSize;
+        AtEndOfFile = (BOOLEAN)(ViewContext->ViewFileOffset + ViewContext->ViewLength >= ViewContext->FileSize);
+
+        if (ViewContext->ReadWChars) {
+            LineLength = YoriLibFindLineBreakW((PWCHAR)LineStart, CharsRemaining);
+        } else {
+            LineLength = YoriLibFindLineBreakA(LineStart, CharsRemaining);
+        }
+
+        //
+        //  If the line or its terminator runs off the end of the window and
+        //  more of the file exists, remap the window starting at this line
+        //  and look again.  If the window already starts at this line, the
+        //  line is longer than a window and is returned in pieces.
+        //
+
+        TerminatorLength = 0;
+        Terminated = FALSE;
+        if (LineLength < CharsRemaining) {
+            Terminated = TRUE;
+            TerminatorLength = 1;
+            if (ViewContext->ReadWChars) {
+                if (((PWCHAR)LineStart)[LineLength] == 0xD) {
+                    if (LineLength + 1 < CharsRemaining) {
+                        if (((PWCHAR)LineStart)[LineLength + 1] == 0xA) {
+                            TerminatorLength = 2;
+                        }
+                    } else if (!AtEndOfFile) {
+                        Terminated = FALSE;
+                    }
+                }
+            } else {
+                if (LineStart[LineLength] == 0xD) {
+                    if (LineLength + 1 < CharsRemaining) {
+                        if (LineStart[LineLength + 1] == 0xA) {
+                            TerminatorLength = 2;
+                        }
+                    } else if (!AtEndOfFile) {
+                        Terminated = FALSE;
+                    }
+                }
+            }
+        }
+
+        if (!Terminated && !AtEndOfFile) {
+            LONGLONG NewWindowOffset;
+            NewWindowOffset = ViewContext->CurrentOffset - (ViewContext->CurrentOffset % ViewContext->AllocationGranularity);
+            if (NewWindowOffset > ViewContext->ViewFileOffset) {
+                if (!YoriLibLineViewMapWindow(ViewContext, ViewContext->CurrentOffset)) {
+                    return FALSE;
+                }
+                continue;
+            }
+            LineLength = CharsRemaining;
+        }
+
+        //
+        //  Skip any byte order mark at the beginning of the file.
+        //
+
+        BomLength = 0;
+        if (ViewContext->CurrentOffset == 0) {
+            BomLength = YoriLibBytesInBom((PCHAR)LineStart, LineLength * CharSize) / CharSize;
+        }
+
+        LineView->StartOfLine = LineStart + BomLength * CharSize;
+        LineView->LengthInChars = LineLength - BomLength;
+        LineView->Encoding = ViewContext->Encoding;
+        LineView->LineTerminated = Terminated;
+
+        ViewContext->CurrentOffset += (LineLength + TerminatorLength) * CharSize;
+        return TRUE;
+    }
+}
+
+/**
+ Return the next line from a file.  The line is not copied; the view refers
+ to data owned by the line view context, and remains valid until the next
+ call to YoriLibLineViewNext or YoriLibLineViewClose.
+
+ @param Context Pointer to a context returned from YoriLibLineViewOpen.
+
+ @param LineView On successful completion, populated with a pointer to the
+        line, its length, and its encoding.  If the encoding is CP_UTF16 the
+        line consists of 16 bit characters, otherwise it consists of 8 bit
+        characters in the specified encoding.
+
+ @return TRUE if a line was returned, FALSE if the end of the file has been
+         reached or an error occurred.
+ */
+__success(return)
+BOOL
+YoriLibLineViewNext(
+    __in PVOID Context,
+    __out PYORI_LIB_LINE_VIEW LineView
+    )
+{
+    PYORI_LIB_LINE_VIEW_CONTEXT ViewContext = (PYORI_LIB_LINE_VIEW_CONTEXT)Context;
+    BOOL LineTerminated;
+    BOOL TimeoutReached;
+
+    if (ViewContext->Mapped) {
+        return YoriLibLineViewNextMapped(ViewContext, LineView);
+    }
+
+    if (!YoriLibReadLineToStringEx(&ViewContext->LineString, &ViewContext->LineReadContext, TRUE, INFINITE, ViewContext->FileHandle, &LineTerminated, &TimeoutReached)) {
+        return FALSE;
+    }
+
+    LineView->StartOfLine = ViewContext->LineString.StartOfString;
+    LineView->LengthInChars = ViewContext->LineString.LengthInChars;
+    LineView->Encoding = CP_UTF16;
+    LineView->LineTerminated = (BOOLEAN)LineTerminated;
+    return TRUE;
+}
+
+/**
+ Convert a line view into a UTF16 Yori string.  If the string is not large
+ enough, it is reallocated.
+
+ @param LineView Pointer to the line view to convert.
+
+ @param UserString Pointer to a string to populate with the line.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibLineViewToString(
+    __in PYORI_LIB_LINE_VIEW LineView,
+    __inout PYORI_STRING UserString
+    )
+{
+    if (LineView->Encoding != CP_UTF16) {
+        return YoriLibCopyLineToUserBufferW(UserString, LineView->StartOfLine, LineView->LengthInChars);
+    }
+
+    if (LineView->LengthInChars + 1 > UserString->LengthAllocated) {
+        UserString->LengthInChars = 0;
+        if (!YoriLibReallocateString(UserString, LineView->LengthInChars + 1 + 64)) {
+            return FALSE;
+        }
+    }
+
+    memcpy(UserString->StartOfString, LineView->StartOfLine, LineView->LengthInChars * sizeof(WCHAR));
+    UserString->LengthInChars = LineView->LengthInChars;
+    UserString->StartOfString[UserString->LengthInChars] = '\0';
+    return TRUE;
+}
+
+/**
+ Return the file offset of the next line that would be returned by
+ YoriLibLineViewNext.  This is only available for files that have been
+ mapped, since other handles cannot return to an earlier position.
+
+ @param Context Pointer to a context returned from YoriLibLineViewOpen.
+
+ @param Offset On successful completion, updated to contain the file offset
+        of the next line.
+
+ @return TRUE to indicate success, FALSE if the view is not seekable.
+ */
+__success(return)
+BOOL
+YoriLibLineViewGetOffset(
+    __in PVOID Context,
+    __out PLONGLONG Offset
+    )
+{
+    PYORI_LIB_LINE_VIEW_CONTEXT ViewContext = (PYORI_LIB_LINE_VIEW_CONTEXT)Context;
+    if (!ViewContext->Mapped) {
+        return FALSE;
+    }
+
+    *Offset = ViewContext->CurrentOffset;
+    return TRUE;
+}
+
+/**
+ Set the file offset of the next line to return from a mapped file.  The
+ offset is expected to have been returned from YoriLibLineViewGetOffset so
+ that it refers to the beginning of a line.
+
+ @param Context Pointer to a context returned from YoriLibLineViewOpen.
+
+ @param Offset The file offset of the next line to return.
+
+ @return TRUE to indicate success, FALSE if the view is not seekable or the
+         offset is beyond the end of the file.
+ */
+__success(return)
+BOOL
+YoriLibLineViewSeek(
+    __in PVOID Context,
+    __in LONGLONG Offset
+    )
+{
+    PYORI_LIB_LINE_VIEW_CONTEXT ViewContext = (PYORI_LIB_LINE_VIEW_CONTEXT)Context;
+    if (!ViewContext->Mapped || Offset < 0 || Offset > ViewContext->FileSize) {
+        return FALSE;
+    }
+
+    ViewContext->CurrentOffset = Offset;
+    return TRUE;
+}
+
+/**
+ Free any context allocated by YoriLibLineViewOpen.
+
+ @param Context Pointer to the context to free.
+ */
+VOID
+YoriLibLineViewClose(
+    __in_opt PVOID Context
+    )
+{
+    PYORI_LIB_LINE_VIEW_CONTEXT ViewContext = (PYORI_LIB_LINE_VIEW_CONTEXT)Context;
+    if (ViewContext != NULL) {
+        if (ViewContext->MappedView != NULL) {
+            UnmapViewOfFile(ViewContext->MappedView);
+        }
+        if (ViewContext->MappingHandle != NULL) {
+            CloseHandle(ViewContext->MappingHandle);
+        }
+        YoriLibLineReadClose(ViewContext->LineReadContext);
+        YoriLibFreeStringContents(&ViewContext->LineString);
+        YoriLibFree(ViewContext);
+    }
+}
+
 // vim:sw=4:ts=4:et:
@@ -27,6 +27,574 @@
 #include "yoripch.h"
 #include "yorilib.h"
 
+/**
+ The maximum number of directories whose contents will be cached.
+ */
+#define YORI_LIB_PATH_CACHE_MAX_DIRECTORIES (64)
+
+/**
+ A file found within a cached directory.
+ */
+typedef struct _YORI_LIB_PATH_CACHE_FILE {
+
+    /**
+     The list of files within the directory.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry for this file within the directory's hash table, keyed by
+     file name.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The name of the file, as it is cased on disk.
+     */
+    YORI_STRING FileName;
+} YORI_LIB_PATH_CACHE_FILE, *PYORI_LIB_PATH_CACHE_FILE;
+
+/**
+ A directory whose contents are cached.
+ */
+typedef struct _YORI_LIB_PATH_CACHE_DIRECTORY {
+
+    /**
+     The list of cached directories.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry for this directory within the hash table of directories,
+     keyed by directory name.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The name of the directory, as it was specified in the search path.
+     This is NULL terminated.
+     */
+    YORI_STRING DirectoryName;
+
+    /**
+     A change notification handle which is signalled if any file is created,
+     deleted or renamed within the directory, indicating the cached contents
+     are no longer valid.  If this is NULL, the directory could not be
+     monitored and its contents are not cached.
+     */
+    HANDLE ChangeNotification;
+
+    /**
+     A hash table of files found within the directory, keyed by file name.
+     */
+    PYORI_HASH_TABLE Files;
+
+    /**
+     The list of files found within the directory.
+     */
+    YORI_LIST_ENTRY FileList;
+} YORI_LIB_PATH_CACHE_DIRECTORY, *PYORI_LIB_PATH_CACHE_DIRECTORY;
+
+/**
+ A cache of the contents of directories that are searched for executables.
+ Each directory is enumerated once and then monitored for changes, so
+ repeated searches through the same path can be answered without probing
+ the file system.
+
+ The cache has no lock, so a process that enables it must ensure that only
+ one thread searches for an executable at a time.  In the shell, searches
+ happen on the main thread and on the suggestion thread, which resolves
+ the command being typed via YoriShResolveCommandToExecutable.  These are
+ serialized because the main thread calls YoriShWaitForSuggestion before
+ tab completion or executing a command.
+ */
+typedef struct _YORI_LIB_PATH_CACHE {
+
+    /**
+     TRUE if the cache has been enabled by the process.  The cache is not
+     synchronized and holds change notifications open for the life of the
+     process, so it is only used by processes that opt in, such as the
+     shell, and which only search from one thread at a time.
+     */
+    BOOL Enabled;
+
+    /**
+     A hash table of cached directories, keyed by directory name.
+     */
+    PYORI_HASH_TABLE Directories;
+
+    /**
+     The list of cached directories.
+     */
+    YORI_LIST_ENTRY DirectoryList;
+
+    /**
+     The number of cached directories.
+     */
+    DWORD DirectoryCount;
+
+    /**
+     The value of the PATH environment variable when the cache was
+     populated.  If this changes, cached directories are discarded, since
+     they are unlikely to be searched again.
+     */
+    YORI_STRING PathSnapshot;
+
+    /**
+     The number of directory lookups that were answered from previously
+     cached directory contents.
+     */
+    DWORD Hits;
+
+    /**
+     The number of directory lookups that required probing the file system,
+     including lookups that enumerated a directory to populate the cache.
+     */
+    DWORD Misses;
+} YORI_LIB_PATH_CACHE, *PYORI_LIB_PATH_CACHE;
+
+/**
+ The global executable lookup cache.
+ */
+YORI_LIB_PATH_CACHE YoriLibPathCache;
+
+/**
+ The result of looking for a file in the executable lookup cache.
+ */
+typedef enum _YORI_LIB_PATH_CACHE_RESULT {
+    YoriLibPathCacheNotCached = 0,
+    YoriLibPathCacheNotFound = 1,
+    YoriLibPathCacheFound = 2
+} YORI_LIB_PATH_CACHE_RESULT;
+
+/**
+ Determine whether a file name can be looked up in the cache.  This
+ requires that it refers to a single component without wildcards.
+
+ @param FileName The file name to check.
+
+ @return TRUE if the file name can be looked up in the cache, FALSE if the
+         file system must be probed.
+ */
+BOOL
+YoriLibPathCacheIsSimpleName(
+    __in PYORI_STRING FileName
+    )
+{
+    DWORD Index;
+    TCHAR Char;
+
+    if (FileName->LengthInChars == 0 || FileName->LengthInChars >= MAX_PATH) {
+        return FALSE;
+    }
+
+    for (Index = 0; Index < FileName->LengthInChars; Index++) {
+        Char = FileName->StartOfString[Index];
+        if (YoriLibIsSep(Char) || Char == ':' || Char == '*' || Char == '?') {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Free all of the files cached for a directory.
+
+ @param Directory The directory whose files should be freed.
+ */
+VOID
+YoriLibPathCacheFreeFiles(
+    __in PYORI_LIB_PATH_CACHE_DIRECTORY Directory
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIB_PATH_CACHE_FILE File;
+
+    ListEntry = YoriLibGetNextListEntry(&Directory->FileList, NULL);
+    while (ListEntry != NULL) {
+        File = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_CACHE_FILE, ListEntry);
+        YoriLibRemoveListItem(&File->ListEntry);
+        YoriLibHashRemoveByEntry(&File->HashEntry);
+        YoriLibFree(File);
+        ListEntry = YoriLibGetNextListEntry(&Directory->FileList, NULL);
+    }
+}
+
+/**
+ Enumerate the contents of a directory into the cache.  The change
+ notification should be armed before calling this function so that any
+ change made during the enumeration is detected.
+
+ @param Directory The directory to enumerate.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibPathCachePopulateDirectory(
+    __in PYORI_LIB_PATH_CACHE_DIRECTORY Directory
+    )
+{
+    YORI_STRING SearchName;
+    HANDLE hFind;
+    WIN32_FIND_DATA FindData;
+    PYORI_LIB_PATH_CACHE_FILE File;
+    DWORD FileNameLength;
+
+    YoriLibPathCacheFreeFiles(Directory);
+
+    if (!YoriLibAllocateString(&SearchName, Directory->DirectoryName.LengthInChars + 3)) {
+        return FALSE;
+    }
+
+    if (Directory->DirectoryName.LengthInChars > 0 &&
+        YoriLibIsSep(Directory->DirectoryName.StartOfString[Directory->DirectoryName.LengthInChars - 1])) {
+
+        SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y*"), &Directory->DirectoryName);
+    } else {
+        SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y\\*"), &Directory->DirectoryName);
+    }
+
+    hFind = FindFirstFile(SearchName.StartOfString, &FindData);
+    YoriLibFreeStringContents(&SearchName);
+
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return (GetLastError() == ERROR_FILE_NOT_FOUND);
+    }
+
+    do {
+        if (_tcscmp(FindData.cFileName, _T(".")) == 0 ||
+            _tcscmp(FindData.cFileName, _T("..")) == 0) {
+
+            continue;
+        }
+
+        FileNameLength = _tcslen(FindData.cFileName);
+        File = YoriLibMalloc(sizeof(YORI_LIB_PATH_CACHE_FILE) + (FileNameLength + 1) * sizeof(TCHAR));
+        if (File == NULL) {
+            FindClose(hFind);
+            YoriLibPathCacheFreeFiles(Directory);
+            return FALSE;
+        }
+
+        YoriLibInitEmptyString(&File->FileName);
+        File->FileName.StartOfString = (LPTSTR)(File + 1);
+        File->FileName.LengthInChars = FileNameLength;
+        File->FileName.LengthAllocated = FileNameLength + 1;
+        memcpy(File->FileName.StartOfString, FindData.cFileName, (FileNameLength + 1) * sizeof(TCHAR));
+
+        YoriLibAppendList(&Directory->FileList, &File->ListEntry);
+        YoriLibHashInsertByKey(Directory->Files, &File->FileName, File, &File->HashEntry);
+
+    } while (FindNextFile(hFind, &FindData));
+
+    FindClose(hFind);
+    return TRUE;
+}
+
+/**
+ Free a cached directory.
+
+ @param Directory The directory to free.
+ */
+VOID
+YoriLibPathCacheFreeDirectory(
+    __in PYORI_LIB_PATH_CACHE_DIRECTORY Directory
+    )
+{
+    YoriLibPathCacheFreeFiles(Directory);
+    if (Directory->Files != NULL) {
+        YoriLibFreeEmptyHashTable(Directory->Files);
+    }
+    if (Directory->ChangeNotification != NULL) {
+        FindCloseChangeNotification(Directory->ChangeNotification);
+    }
+    YoriLibFree(Directory);
+}
+
+/**
+ Discard all cached directories.
+ */
+VOID
+YoriLibPathCacheFlush()
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIB_PATH_CACHE_DIRECTORY Directory;
+
+    if (YoriLibPathCache.Directories == NULL) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&YoriLibPathCache.DirectoryList, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_CACHE_DIRECTORY, ListEntry);
+        YoriLibRemoveListItem(&Directory->ListEntry);
+        YoriLibHashRemoveByEntry(&Directory->HashEntry);
+        YoriLibPathCacheFreeDirectory(Directory);
+        ListEntry = YoriLibGetNextListEntry(&YoriLibPathCache.DirectoryList, NULL);
+    }
+
+    YoriLibPathCache.DirectoryCount = 0;
+}
+
+/**
+ Find a directory in the cache, adding it if it has not been seen before.
+ If the directory has changed since it was cached, its contents are
+ enumerated again.
+
+ @param DirectoryName The name of the directory.
+
+ @param Populated On completion, set to TRUE if the directory contents were
+        enumerated by this call, or FALSE if previously cached contents were
+        used.
+
+ @return Pointer to the cached directory, or NULL if the directory cannot be
+         cached.
+ */
+PYORI_LIB_PATH_CACHE_DIRECTORY
+YoriLibPathCacheGetDirectory(
+    __in PYORI_STRING DirectoryName,
+    __out PBOOL Populated
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_LIB_PATH_CACHE_DIRECTORY Directory;
+
+    *Populated = FALSE;
+
+    //
+    //  Relative paths depend on the current directory, so they cannot be
+    //  cached.
+    //
+
+    if (!YoriLibIsDriveLetterWithColonAndSlash(DirectoryName) &&
+        (DirectoryName->LengthInChars < 2 ||
+         !YoriLibIsSep(DirectoryName->StartOfString[0]) ||
+         !YoriLibIsSep(DirectoryName->StartOfString[1]))) {
+
+        return NULL;
+    }
+
+    if (YoriLibPathCache.Directories == NULL) {
+        YoriLibPathCache.Directories = YoriLibAllocateHashTable(YORI_LIB_PATH_CACHE_MAX_DIRECTORIES);
+        if (YoriLibPathCache.Directories == NULL) {
+            return NULL;
+        }
+        YoriLibInitializeListHead(&YoriLibPathCache.DirectoryList);
+    }
+
+    HashEntry = YoriLibHashLookupByKey(YoriLibPathCache.Directories, DirectoryName);
+    if (HashEntry != NULL) {
+        Directory = HashEntry->Context;
+        if (Directory->ChangeNotification == NULL) {
+            return NULL;
+        }
+
+        //
+        //  If the directory has changed, rearm the notification and then
+        //  enumerate it again.
+        //
+
+        if (WaitForSingleObject(Directory->ChangeNotification, 0) == WAIT_OBJECT_0) {
+            *Populated = TRUE;
+            if (!FindNextChangeNotification(Directory->ChangeNotification) ||
+                !YoriLibPathCachePopulateDirectory(Directory)) {
+
+                YoriLibPathCacheFreeFiles(Directory);
+                FindCloseChangeNotification(Directory->ChangeNotification);
+                Directory->ChangeNotification = NULL;
+                return NULL;
+            }
+        }
+
+        return Directory;
+    }
+
+    if (YoriLibPathCache.DirectoryCount >= YORI_LIB_PATH_CACHE_MAX_DIRECTORIES) {
+        return NULL;
+    }
+
+    Directory = YoriLibMalloc(sizeof(YORI_LIB_PATH_CACHE_DIRECTORY) + (DirectoryName->LengthInChars + 1) * sizeof(TCHAR));
+    if (Directory == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Directory, sizeof(YORI_LIB_PATH_CACHE_DIRECTORY));
+    YoriLibInitializeListHead(&Directory->FileList);
+    Directory->DirectoryName.StartOfString = (LPTSTR)(Directory + 1);
+    Directory->DirectoryName.LengthInChars = DirectoryName->LengthInChars;
+    Directory->DirectoryName.LengthAllocated = DirectoryName->LengthInChars + 1;
+    memcpy(Directory->DirectoryName.StartOfString, DirectoryName->StartOfString, DirectoryName->LengthInChars * sizeof(TCHAR));
+    Directory->DirectoryName.StartOfString[DirectoryName->LengthInChars] = '\0';
+
+    //
+    //  Insert the directory even if it can't be monitored, so that the
+    //  attempt is not repeated for every search.
+    //
+
+    YoriLibAppendList(&YoriLibPathCache.DirectoryList, &Directory->ListEntry);
+    YoriLibHashInsertByKey(YoriLibPathCache.Directories, &Directory->DirectoryName, Directory, &Directory->HashEntry);
+    YoriLibPathCache.DirectoryCount++;
+    *Populated = TRUE;
+
+    Directory->Files = YoriLibAllocateHashTable(256);
+    if (Directory->Files == NULL) {
+        return NULL;
+    }
+
+    Directory->ChangeNotification = FindFirstChangeNotification(Directory->DirectoryName.StartOfString, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME);
+    if (Directory->ChangeNotification == INVALID_HANDLE_VALUE) {
+        Directory->ChangeNotification = NULL;
+        return NULL;
+    }
+
+    if (!YoriLibPathCachePopulateDirectory(Directory)) {
+        FindCloseChangeNotification(Directory->ChangeNotification);
+        Directory->ChangeNotification = NULL;
+        return NULL;
+    }
+
+    return Directory;
+}
+
+/**
+ Look for a file within a directory using the cache.
+
+ @param DirectoryName The directory to search.
+
+ @param FileName The name of the file to look for.  This must satisfy
+        @ref YoriLibPathCacheIsSimpleName .
+
+ @param FoundFileName On successful completion, populated with the name of
+        the file as it is cased on disk.  This buffer must be MAX_PATH
+        characters in size.
+
+ @return YoriLibPathCacheFound if the file exists, YoriLibPathCacheNotFound
+         if it does not, or YoriLibPathCacheNotCached if the directory is not
+         cached and the file system should be probed.
+ */
+YORI_LIB_PATH_CACHE_RESULT
+YoriLibPathCacheLookup(
+    __in PYORI_STRING DirectoryName,
+    __in PYORI_STRING FileName,
+    __out_ecount(MAX_PATH) LPTSTR FoundFileName
+    )
+{
+    PYORI_LIB_PATH_CACHE_DIRECTORY Directory;
+    PYORI_LIB_PATH_CACHE_FILE File;
+    PYORI_HASH_ENTRY HashEntry;
+    BOOL Populated;
+
+    if (!YoriLibPathCache.Enabled) {
+        return YoriLibPathCacheNotCached;
+    }
+
+    Directory = YoriLibPathCacheGetDirectory(DirectoryName, &Populated);
+    if (Directory == NULL) {
+        YoriLibPathCache.Misses++;
+        return YoriLibPathCacheNotCached;
+    }
+
+    if (Populated) {
+        YoriLibPathCache.Misses++;
+    } else {
+        YoriLibPathCache.Hits++;
+    }
+    HashEntry = YoriLibHashLookupByKey(Directory->Files, FileName);
+    if (HashEntry == NULL) {
+        return YoriLibPathCacheNotFound;
+    }
+
+    File = HashEntry->Context;
+    if (File->FileName.LengthInChars >= MAX_PATH) {
+        return YoriLibPathCacheNotCached;
+    }
+
+    memcpy(FoundFileName, File->FileName.StartOfString, (File->FileName.LengthInChars + 1) * sizeof(TCHAR));
+    return YoriLibPathCacheFound;
+}
+
+/**
+ Check whether the PATH has changed since the cache was populated, and if
+ so, discard cached directories.
+
+ @param PathData The current value of the PATH environment variable.
+ */
+VOID
+YoriLibPathCacheCheckPath(
+    __in PYORI_STRING PathData
+    )
+{
+    if (!YoriLibPathCache.Enabled) {
+        return;
+    }
+
+    if (YoriLibCompareString(&YoriLibPathCache.PathSnapshot, PathData) == 0) {
+        return;
+    }
+
+    YoriLibPathCacheFlush();
+    YoriLibFreeStringContents(&YoriLibPathCache.PathSnapshot);
+    if (YoriLibAllocateString(&YoriLibPathCache.PathSnapshot, PathData->LengthInChars + 1)) {
+        memcpy(YoriLibPathCache.PathSnapshot.StartOfString, PathData->StartOfString, PathData->LengthInChars * sizeof(TCHAR));
+        YoriLibPathCache.PathSnapshot.StartOfString[PathData->LengthInChars] = '\0';
+        YoriLibPathCache.PathSnapshot.LengthInChars = PathData->LengthInChars;
+    }
+}
+
+/**
+ Enable the executable lookup cache for this process.  The cache is only
+ used by searches that stop at the first match.  Once it is enabled, the
+ caller must ensure that YoriLibLocateExecutableInPath is not called by
+ more than one thread at a time, since the cache is not synchronized.
+ */
+VOID
+YoriLibPathCacheEnable()
+{
+    YoriLibPathCache.Enabled = TRUE;
+}
+
+/**
+ Return the number of directory lookups that have been answered from the
+ executable lookup cache, and the number that required probing the file
+ system.  Callers can compare these before and after a search to determine
+ whether it was answered from the cache.
+
+ @param Hits On successful completion, updated to the number of lookups
+        answered from the cache.
+
+ @param Misses On successful completion, updated to the number of lookups
+        that required probing the file system.
+
+ @return TRUE if the cache is enabled in this process, FALSE if it is not,
+         in which case no statistics are available.
+ */
+BOOL
+YoriLibPathCacheQueryStatistics(
+    __out PDWORD Hits,
+    __out PDWORD Misses
+    )
+{
+    *Hits = YoriLibPathCache.Hits;
+    *Misses = YoriLibPathCache.Misses;
+    return YoriLibPathCache.Enabled;
+}
+
+/**
+ Free all state associated with the executable lookup cache.
+ */
+VOID
+YoriLibPathCacheCleanup()
+{
+    YoriLibPathCacheFlush();
+    if (YoriLibPathCache.Directories != NULL) {
+        YoriLibFreeEmptyHashTable(YoriLibPathCache.Directories);
+        YoriLibPathCache.Directories = NULL;
+    }
+    YoriLibFreeStringContents(&YoriLibPathCache.PathSnapshot);
+}
+
 /**
  Searches an environment variable with semicolon delimited elements for a file
  name match.
@@ -67,10 +635,14 @@ YoriLibSearchEnv(
     HANDLE hFind;
     WIN32_FIND_DATA FindData;
     LPTSTR fn;
+    BOOL SimpleName;
+    YORI_LIB_PATH_CACHE_RESULT CacheResult;
 
     ASSERT(YoriLibIsStringNullTerminated(FileName));
     ASSERT(YoriLibIsStringNullTerminated(EnvVarData));
 
+    SimpleName = YoriLibPathCacheIsSimpleName(FileName);
+
     //
     //  If we can't possibly do anything, stop.
     //
@@ -136,10 +708,29 @@ YoriLibSearchEnv(
             YoriLibSPrintf(ScratchArea->StartOfString + componentlen + 1, _T("%y"), FileName);
             ScratchArea->LengthInChars = componentlen + 1 + FileName->LengthInChars;
 
-            hFind = FindFirstFile(ScratchArea->StartOfString, &FindData);
+            //
+            //  If only the first match is needed, try to answer from the
+            //  cache of directory contents.
+            //
+
+            CacheResult = YoriLibPathCacheNotCached;
+            if (MatchAllCallback == NULL && SimpleName) {
+                YORI_STRING Directory;
+                YoriLibInitEmptyString(&Directory);
+                Directory.StartOfString = ScratchArea->StartOfString;
+                Directory.LengthInChars = componentlen;
+                CacheResult = YoriLibPathCacheLookup(&Directory, FileName, FindData.cFileName);
+            }
 
-            if (hFind != INVALID_HANDLE_VALUE) {
-                FindClose(hFind);
+            if (CacheResult == YoriLibPathCacheNotCached) {
+                hFind = FindFirstFile(ScratchArea->StartOfString, &FindData);
+                if (hFind != INVALID_HANDLE_VALUE) {
+                    FindClose(hFind);
+                    CacheResult = YoriLibPathCacheFound;
+                }
+            }
+
+            if (CacheResult == YoriLibPathCacheFound) {
                 if (!YoriLibGetFullPathNameReturnAllocation(ScratchArea, FullPath, Out, &fn) || fn == NULL) {
                     Out->LengthInChars = 0;
                     Out->StartOfString[0] = '\0';
@@ -549,6 +1140,48 @@ YoriLibLocateFileExtensionsInOnePath(
         PathExtData[Count].Found = FALSE;
     }
 
+    //
+    //  If only the first exact match is needed, try to answer from the
+    //  cache of directory contents, probing each extension in order.
+    //
+
+    if (MatchAllCallback == NULL &&
+        !PartialMatchOkay &&
+        YoriLibPathCacheIsSimpleName(FileName)) {
+
+        YORI_STRING Candidate;
+        TCHAR CandidateBuffer[MAX_PATH];
+        YORI_LIB_PATH_CACHE_RESULT CacheResult;
+
+        YoriLibInitEmptyString(&Candidate);
+        Candidate.StartOfString = CandidateBuffer;
+        Candidate.LengthAllocated = MAX_PATH;
+        memcpy(CandidateBuffer, FileName->StartOfString, FileName->LengthInChars * sizeof(TCHAR));
+
+        CacheResult = YoriLibPathCacheNotCached;
+        for (Count = 0; Count < PathExtCount; Count++) {
+            if (FileName->LengthInChars + PathExtData[Count].Extension.LengthInChars >= MAX_PATH) {
+                continue;
+            }
+            memcpy(&CandidateBuffer[FileName->LengthInChars],
+                   PathExtData[Count].Extension.StartOfString,
+                   PathExtData[Count].Extension.LengthInChars * sizeof(TCHAR));
+            Candidate.LengthInChars = FileName->LengthInChars + PathExtData[Count].Extension.LengthInChars;
+            CandidateBuffer[Candidate.LengthInChars] = '\0';
+
+            CacheResult = YoriLibPathCacheLookup(SearchPath, &Candidate, FindData.cFileName);
+            if (CacheResult != YoriLibPathCacheNotFound) {
+                break;
+            }
+        }
+
+        if (CacheResult == YoriLibPathCacheFound) {
+            return YoriLibLocateBuildFullName(SearchPath, &FindData, Out, FullPath);
+        } else if (CacheResult == YoriLibPathCacheNotFound || PathExtCount == 0) {
+            return TRUE;
+        }
+    }
+
     //
     //  Search the directory for all files with this prefix.
     //
@@ -1104,7 +1737,16 @@ YoriLibLocateExecutableInPath(
 
     PathData.StartOfString[0] = '\0';
     PathData.LengthInChars = GetEnvironmentVariable(_T("PATH"), PathData.StartOfString, PathData.LengthAllocated);
-    
+
+    //
+    //  Searches for every match don't use the cache, and may be issued from
+    //  threads other than the one that owns it, so leave it untouched.
+    //
+
+    if (MatchAllCallback == NULL) {
+        YoriLibPathCacheCheckPath(&PathData);
+    }
+
     if (SearchPath && SearchPathExt) {
         if (!YoriLibPathLocateUnknownExtensionUnknownLocation(SearchFor, &PathData, MatchAllCallback, MatchAllContext, &FoundPath)) {
             YoriLibFreeStringContents(&FoundPath);
@@ -0,0 +1,301 @@
+/**
+ * @file lib/sort.c
+ *
+ * Yori stable sorting of arrays with precomputed keys
+ *
+ * Copyright (c) 2019 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yoripch.h"
+#include "yorilib.h"
+
+/**
+ The number of elements that are sorted by insertion before runs are
+ merged.
+ */
+#define YORI_LIB_SORT_RUN_LENGTH (16)
+
+/**
+ Compare two sort entries.  Entries are ordered by their precomputed key,
+ and if the keys are identical, by the caller's comparison function.
+
+ @param Left Pointer to the first entry.
+
+ @param Right Pointer to the second entry.
+
+ @param CompareFn Optional pointer to a function to compare entries whose
+        keys are identical.
+
+ @param Context Context to pass to CompareFn.
+
+ @return YORI_LIB_LESS_THAN if the first entry should be ordered before the
+         second, YORI_LIB_GREATER_THAN if the first entry should be ordered
+         after the second, or YORI_LIB_EQUAL if they are equivalent.
+ */
+DWORD
+YoriLibSortCompareEntries(
+    __in PYORI_LIB_SORT_ENTRY Left,
+    __in PYORI_LIB_SORT_ENTRY Right,
+    __in_opt PYORI_LIB_SORT_COMPARE_FN CompareFn,
+    __in_opt PVOID Context
+    )
+{
+    if (Left->Key < Right->Key) {
+        return YORI_LIB_LESS_THAN;
+    } else if (Left->Key > Right->Key) {
+        return YORI_LIB_GREATER_THAN;
+    }
+
+    if (CompareFn == NULL) {
+        return YORI_LIB_EQUAL;
+    }
+
+    return CompareFn(Left->Item, Right->Item, Context);
+}
+
+/**
+ Sort a short range of entries by insertion.
+
+ @param Entries Pointer to the first entry in the range.
+
+ @param Count The number of entries in the range.
+
+ @param CompareFn Optional pointer to a function to compare entries whose
+        keys are identical.
+
+ @param Context Context to pass to CompareFn.
+ */
+VOID
+YoriLibSortInsertionSort(
+    __inout_ecount(Count) PYORI_LIB_SORT_ENTRY Entries,
+    __in DWORD Count,
+    __in_opt PYORI_LIB_SORT_COMPARE_FN CompareFn,
+    __in_opt PVOID Context
+    )
+{
+    DWORD Index;
+    DWORD InsertIndex;
+    YORI_LIB_SORT_ENTRY Entry;
+
+    for (Index = 1; Index < Count; Index++) {
+        if (YoriLibSortCompareEntries(&Entries[Index - 1], &Entries[Index], CompareFn, Context) != YORI_LIB_GREATER_THAN) {
+            continue;
+        }
+
+        Entry = Entries[Index];
+        InsertIndex = Index;
+        while (InsertIndex > 0 &&
+               YoriLibSortCompareEntries(&Entries[InsertIndex - 1], &Entry, CompareFn, Context) == YORI_LIB_GREATER_THAN) {
+
+            Entries[InsertIndex] = Entries[InsertIndex - 1];
+            InsertIndex--;
+        }
+        Entries[InsertIndex] = Entry;
+    }
+}
+
+/**
+ Sort an array of entries.  Entries are ordered by ascending key, and
+ entries with identical keys are ordered by the caller's comparison
+ function.  The sort is stable, so entries that compare as equal remain in
+ the order they were supplied.
+
+ Callers are expected to encode as much of their sort criteria as possible
+ into the key, so that most comparisons are resolved without calling the
+ comparison function.  Descending orders can be expressed by inverting the
+ key.  The key must never order two entries differently to the comparison
+ function.
+
+ @param Entries Pointer to an array of entries to sort.  On successful
+        completion, this array is sorted.
+
+ @param Count The number of entries in the array.
+
+ @param CompareFn Optional pointer to a function to compare entries whose
+        keys are identical.  If not specified, entries with identical keys
+        remain in their original order.
+
+ @param Context Context to pass to CompareFn.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibSortEntries(
+    __inout_ecount(Count) PYORI_LIB_SORT_ENTRY Entries,
+    __in DWORD Count,
+    __in_opt PYORI_LIB_SORT_COMPARE_FN CompareFn,
+    __in_opt PVOID Context
+    )
+{
+    PYORI_LIB_SORT_ENTRY Buffer;
+    PYORI_LIB_SORT_ENTRY Source;
+    PYORI_LIB_SORT_ENTRY Target;
+    PYORI_LIB_SORT_ENTRY Swap;
+    DWORD Width;
+    DWORD Start;
+    DWORD Middle;
+    DWORD End;
+    DWORD LeftIndex;
+    DWORD RightIndex;
+    DWORD TargetIndex;
+
+    //
+    //  Sort short runs by insertion, which is also all that's needed for a
+    //  small array.
+    //
+
+    for (Start = 0; Start < Count; Start += YORI_LIB_SORT_RUN_LENGTH) {
+        End = Count - Start;
+        if (End > YORI_LIB_SORT_RUN_LENGTH) {
+            End = YORI_LIB_SORT_RUN_LENGTH;
+        }
+        YoriLibSortInsertionSort(&Entries[Start], End, CompareFn, Context);
+    }
+
+    if (Count <= YORI_LIB_SORT_RUN_LENGTH) {
+        return TRUE;
+    }
+
+    if (Count > (DWORD)-1 / sizeof(YORI_LIB_SORT_ENTRY)) {
+        return FALSE;
+    }
+
+    Buffer = YoriLibMalloc(Count * sizeof(YORI_LIB_SORT_ENTRY));
+    if (Buffer == NULL) {
+        return FALSE;
+    }
+
+    //
+    //  Merge adjacent runs, doubling their length each pass, alternating
+    //  between the caller's array and the buffer.
+    //
+
+    Source = Entries;
+    Target = Buffer;
+
+    for (Width = YORI_LIB_SORT_RUN_LENGTH; Width < Count; Width = Width * 2) {
+        for (Start = 0; Start < Count; Start = End) {
+            Middle = Count;
+            End = Count;
+            if (Count - Start > Width) {
+                Middle = Start + Width;
+                if (Count - Middle > Width) {
+                    End = Middle + Width;
+                }
+            }
+
+            //
+            //  If the runs are already in order, which is common when the
+            //  input was enumerated in sorted order, just copy them.
+            //
+
+            if (Middle == End ||
+                YoriLibSortCompareEntries(&Source[Middle - 1], &Source[Middle], CompareFn, Context) != YORI_LIB_GREATER_THAN) {
+
+                memcpy(&Target[Start], &Source[Start], (End - Start) * sizeof(YORI_LIB_SORT_ENTRY));
+                continue;
+            }
+
+            LeftIndex = Start;
+            RightIndex = Middle;
+            TargetIndex = Start;
+            while (LeftIndex < Middle && RightIndex < End) {
+                if (YoriLibSortCompareEntries(&Source[LeftIndex], &Source[RightIndex], CompareFn, Context) != YORI_LIB_GREATER_THAN) {
+                    Target[TargetIndex++] = Source[LeftIndex++];
+                } else {
+                    Target[TargetIndex++] = Source[RightIndex++];
+                }
+            }
+
+            if (LeftIndex < Middle) {
+                memcpy(&Target[TargetIndex], &Source[LeftIndex], (Middle - LeftIndex) * sizeof(YORI_LIB_SORT_ENTRY));
+            } else if (RightIndex < End) {
+                memcpy(&Target[TargetIndex], &Source[RightIndex], (End - RightIndex) * sizeof(YORI_LIB_SORT_ENTRY));
+            }
+        }
+
+        Swap = Source;
+        Source = Target;
+        Target = Swap;
+
+        //
+        //  Avoid overflowing the width on very large arrays.
+        //
+
+        if (Width > Count / 2) {
+            break;
+        }
+    }
+
+    if (Source != Entries) {
+        memcpy(Entries, Source, Count * sizeof(YORI_LIB_SORT_ENTRY));
+    }
+
+    YoriLibFree(Buffer);
+    return TRUE;
+}
+
+/**
+ Generate a sort key from the beginning of a string, so that comparing keys
+ orders strings the same way as @ref YoriLibCompareStringInsensitive or
+ _tcsicmp would, except that strings which share a prefix generate the same
+ key.  Strings with identical keys need to be compared in full.
+
+ Both comparisons only fold the 26 base english characters, so the key
+ must fold exactly the same set.  Folding any other character would allow
+ the key to order two strings differently to the full comparison.
+
+ @param String Pointer to the string.
+
+ @return The sort key.
+ */
+ULONGLONG
+YoriLibSortKeyFromStringPrefix(
+    __in PYORI_STRING String
+    )
+{
+    ULONGLONG Key;
+    DWORD Index;
+    DWORD CharsInKey;
+    TCHAR Char;
+
+    CharsInKey = sizeof(ULONGLONG) / sizeof(TCHAR);
+    Key = 0;
+    for (Index = 0; Index < CharsInKey; Index++) {
+        Key = Key << (sizeof(TCHAR) * 8);
+        if (Index < String->LengthInChars) {
+            Char = String->StartOfString[Index];
+            if (Char >= 'a' && Char <= 'z') {
+                Char = (TCHAR)(Char - 'a' + 'A');
+            }
+#ifdef UNICODE
+            Key = Key | (WORD)Char;
+#else
+            Key = Key | (UCHAR)(Char ^ 0x80);
+#endif
+        }
+    }
+
+    return Key;
+}
+
+// vim:sw=4:ts=4:et:
@@ -1032,10 +1032,70 @@ YoriLibCountStringNotContainingChars(
     return len;
 }
 
+/**
+ The number of characters to search multiplied by the number of patterns to
+ search for above which a search compiles the patterns into a matcher rather
+ than comparing each pattern at each offset.
+ */
+#define YORI_LIB_SUBSTRING_MATCHER_THRESHOLD (4096)
+
+/**
+ Search through a string looking for any of a set of substrings by compiling
+ them into a matcher, if the search is large enough for that to be
+ worthwhile.
+
+ @param String The string to search through.
+
+ @param NumberMatches The number of substrings to look for.
+
+ @param MatchArray An array of strings corresponding to the matches to
+        look for.
+
+ @param Insensitive TRUE if the search should be case insensitive.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @param Match On successful completion, updated to point to the entry in
+        MatchArray that was matched, or NULL if no match was found.
+
+ @return TRUE if the search was performed, FALSE if the caller should
+         search without a matcher.
+ */
+__success(return)
+BOOL
+YoriLibFindMatchingSubstringWithMatcher(
+    __in PYORI_STRING String,
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive,
+    __out_opt PDWORD StringOffsetOfMatch,
+    __out PYORI_STRING * Match
+    )
+{
+    PVOID Matcher;
+
+    if (NumberMatches < 2 ||
+        String->LengthInChars < YORI_LIB_SUBSTRING_MATCHER_THRESHOLD / NumberMatches) {
+
+        return FALSE;
+    }
+
+    if (!YoriLibSubstringMatcherCreate(NumberMatches, MatchArray, Insensitive, &Matcher)) {
+        return FALSE;
+    }
+
+    *Match = YoriLibSubstringMatcherFindFirst(Matcher, String, StringOffsetOfMatch);
+    YoriLibSubstringMatcherFree(Matcher);
+    return TRUE;
+}
+
 /**
  Search through a string looking to see if any substrings can be located.
  Returns the first match in offet from the beginning of the string order.
- This routine looks for matches case sensitively.
+ This routine looks for matches case sensitively.  Callers searching for
+ the same substrings repeatedly should consider compiling them once with
+ @ref YoriLibSubstringMatcherCreate .
 
  @param String The string to search through.
 
@@ -1061,6 +1121,11 @@ YoriLibFindFirstMatchingSubstring(
 {
     YORI_STRING RemainingString;
     DWORD CheckCount;
+    PYORI_STRING Match;
+
+    if (YoriLibFindMatchingSubstringWithMatcher(String, NumberMatches, MatchArray, FALSE, StringOffsetOfMatch, &Match)) {
+        return Match;
+    }
 
     YoriLibInitEmptyString(&RemainingString);
     RemainingString.StartOfString = String->StartOfString;
@@ -1115,6 +1180,11 @@ YoriLibFindFirstMatchingSubstringInsensitive(
 {
     YORI_STRING RemainingString;
     DWORD CheckCount;
+    PYORI_STRING Match;
+
+    if (YoriLibFindMatchingSubstringWithMatcher(String, NumberMatches, MatchArray, TRUE, StringOffsetOfMatch, &Match)) {
+        return Match;
+    }
 
     YoriLibInitEmptyString(&RemainingString);
     RemainingString.StartOfString = String->StartOfString;
@@ -0,0 +1,655 @@
+/**
+ * @file lib/strmatch.c
+ *
+ * Yori multiple substring search routines
+ *
+ * Copyright (c) 2019 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yoripch.h"
+#include "yorilib.h"
+
+/**
+ A value indicating no node or no pattern.
+ */
+#define YORI_LIB_SUBSTRING_MATCHER_NONE ((DWORD)-1)
+
+/**
+ The number of characters which can transition directly out of the root
+ node via a lookup table rather than a search.
+ */
+#define YORI_LIB_SUBSTRING_MATCHER_ROOT_CHARS (128)
+
+/**
+ A single state within the matcher.  Each state corresponds to a prefix of
+ one or more patterns.
+ */
+typedef struct _YORI_LIB_SUBSTRING_MATCHER_NODE {
+
+    /**
+     The index of the first transition out of this state in the edge array.
+     Transitions for a state are contiguous and sorted by character.
+     */
+    DWORD FirstEdge;
+
+    /**
+     The number of transitions out of this state.
+     */
+    DWORD EdgeCount;
+
+    /**
+     The state to continue from if the next character has no transition out
+     of this state.  This is the state for the longest proper suffix of this
+     prefix which is also a prefix of some pattern.
+     */
+    DWORD Fail;
+
+    /**
+     The next state along the chain of Fail states which completes a pattern,
+     or zero if no state along the chain does.
+     */
+    DWORD DictLink;
+
+    /**
+     The lowest index in the match array of a pattern which ends at this
+     state, or YORI_LIB_SUBSTRING_MATCHER_NONE if no pattern ends here.
+     */
+    DWORD PatternIndex;
+
+    /**
+     The number of characters in the prefix this state corresponds to.
+     */
+    DWORD Depth;
+} YORI_LIB_SUBSTRING_MATCHER_NODE, *PYORI_LIB_SUBSTRING_MATCHER_NODE;
+
+/**
+ A transition from one state to another on a specific character.
+ */
+typedef struct _YORI_LIB_SUBSTRING_MATCHER_EDGE {
+
+    /**
+     The character that causes this transition.  For insensitive matchers
+     this is in upper case.
+     */
+    TCHAR Char;
+
+    /**
+     The state to move to.
+     */
+    DWORD Next;
+} YORI_LIB_SUBSTRING_MATCHER_EDGE, *PYORI_LIB_SUBSTRING_MATCHER_EDGE;
+
+/**
+ A state used while the matcher is being constructed, before transitions
+ are laid out contiguously.
+ */
+typedef struct _YORI_LIB_SUBSTRING_MATCHER_BUILD_NODE {
+
+    /**
+     The first child of this state, or zero if it has no children.  Children
+     are kept in character order.
+     */
+    DWORD FirstChild;
+
+    /**
+     The next child of this state's parent, or zero if this is the last.
+     */
+    DWORD NextSibling;
+
+    /**
+     The character which transitions from the parent to this state.
+     */
+    TCHAR Char;
+} YORI_LIB_SUBSTRING_MATCHER_BUILD_NODE, *PYORI_LIB_SUBSTRING_MATCHER_BUILD_NODE;
+
+/**
+ A compiled set of patterns that can be searched for in a single pass over
+ a string.  This is an Aho-Corasick automaton, so the cost of a search is
+ proportional to the length of the string being searched plus the number of
+ matches, regardless of the number of patterns.
+ */
+typedef struct _YORI_LIB_SUBSTRING_MATCHER {
+
+    /**
+     The array of patterns the matcher was built from.  This is owned by the
+     caller and must remain valid for the life of the matcher, since searches
+     return pointers into it.
+     */
+    PYORI_STRING MatchArray;
+
+    /**
+     The number of elements in MatchArray.
+     */
+    DWORD NumberMatches;
+
+    /**
+     The number of states in the matcher.
+     */
+    DWORD NodeCount;
+
+    /**
+     The number of characters in the longest pattern.
+     */
+    DWORD MaximumLength;
+
+    /**
+     The lowest index of an empty pattern, or
+     YORI_LIB_SUBSTRING_MATCHER_NONE if there is no empty pattern.  An empty
+     pattern matches at the beginning of any nonempty string.
+     */
+    DWORD EmptyPatternIndex;
+
+    /**
+     TRUE if patterns should be matched without regard to case.
+     */
+    BOOLEAN Insensitive;
+
+    /**
+     The array of states.  State zero is the root.
+     */
+    PYORI_LIB_SUBSTRING_MATCHER_NODE Nodes;
+
+    /**
+     The array of transitions.
+     */
+    PYORI_LIB_SUBSTRING_MATCHER_EDGE Edges;
+
+    /**
+     The state reached from the root for each low character, or zero if the
+     character does not begin any pattern.
+     */
+    DWORD RootTransitions[YORI_LIB_SUBSTRING_MATCHER_ROOT_CHARS];
+
+} YORI_LIB_SUBSTRING_MATCHER, *PYORI_LIB_SUBSTRING_MATCHER;
+
+/**
+ Find the transition out of a state for a specified character.
+
+ @param Matcher Pointer to the matcher.
+
+ @param Node The state to transition from.
+
+ @param Char The character to transition on.
+
+ @return The state to transition to, or YORI_LIB_SUBSTRING_MATCHER_NONE if
+         the state has no transition for the character.
+ */
+DWORD
+YoriLibSubstringMatcherGoto(
+    __in PYORI_LIB_SUBSTRING_MATCHER Matcher,
+    __in DWORD Node,
+    __in TCHAR Char
+    )
+{
+    PYORI_LIB_SUBSTRING_MATCHER_EDGE Edges;
+    DWORD Low;
+    DWORD High;
+    DWORD Mid;
+
+    Edges = &Matcher->Edges[Matcher->Nodes[Node].FirstEdge];
+    Low = 0;
+    High = Matcher->Nodes[Node].EdgeCount;
+
+    while (Low < High) {
+        Mid = Low + (High - Low) / 2;
+        if (Edges[Mid].Char == Char) {
+            return Edges[Mid].Next;
+        } else if (Edges[Mid].Char < Char) {
+            Low = Mid + 1;
+        } else {
+            High = Mid;
+        }
+    }
+
+    return YORI_LIB_SUBSTRING_MATCHER_NONE;
+}
+
+/**
+ Advance the matcher by one character of the string being searched.
+
+ @param Matcher Pointer to the matcher.
+
+ @param Node The current state.
+
+ @param Char The next character of the string, already converted to upper
+        case for insensitive matchers.
+
+ @return The new state.
+ */
+DWORD
+YoriLibSubstringMatcherStep(
+    __in PYORI_LIB_SUBSTRING_MATCHER Matcher,
+    __in DWORD Node,
+    __in TCHAR Char
+    )
+{
+    DWORD Next;
+
+    while (Node != 0) {
+        Next = YoriLibSubstringMatcherGoto(Matcher, Node, Char);
+        if (Next != YORI_LIB_SUBSTRING_MATCHER_NONE) {
+            return Next;
+        }
+        Node = Matcher->Nodes[Node].Fail;
+    }
+
+    if (Char < YORI_LIB_SUBSTRING_MATCHER_ROOT_CHARS) {
+        return Matcher->RootTransitions[Char];
+    }
+
+    Next = YoriLibSubstringMatcherGoto(Matcher, 0, Char);
+    if (Next == YORI_LIB_SUBSTRING_MATCHER_NONE) {
+        return 0;
+    }
+    return Next;
+}
+
+/**
+ Compile a set of patterns into a matcher which can search for all of them
+ in a single pass over a string.  This is worthwhile when the same set of
+ patterns will be searched for repeatedly, or when there are many patterns.
+
+ @param NumberMatches The number of patterns.
+
+ @param MatchArray An array of patterns.  This array is referenced by the
+        matcher and must remain valid until the matcher is freed.
+
+ @param Insensitive TRUE if the patterns should be matched without regard to
+        case, FALSE if they should be matched exactly.
+
+ @param MatcherContext On successful completion, updated to point to an
+        opaque matcher which should be freed with
+        @ref YoriLibSubstringMatcherFree .
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibSubstringMatcherCreate(
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive,
+    __out PVOID * MatcherContext
+    )
+{
+    PYORI_LIB_SUBSTRING_MATCHER Matcher;
+    PYORI_LIB_SUBSTRING_MATCHER_NODE Nodes;
+    PYORI_LIB_SUBSTRING_MATCHER_BUILD_NODE BuildNodes;
+    PDWORD Queue;
+    DWORD TotalChars;
+    DWORD MaxNodes;
+    DWORD MatchIndex;
+    DWORD CharIndex;
+    DWORD Node;
+    DWORD Child;
+    DWORD Previous;
+    DWORD Fail;
+    DWORD Next;
+    DWORD QueueHead;
+    DWORD QueueTail;
+    DWORD EdgeCount;
+    TCHAR Char;
+
+    //
+    //  Each pattern character can create at most one state, plus the root.
+    //
+
+    TotalChars = 0;
+    for (MatchIndex = 0; MatchIndex < NumberMatches; MatchIndex++) {
+        if (MatchArray[MatchIndex].LengthInChars > (DWORD)-1 - TotalChars - 1) {
+            return FALSE;
+        }
+        TotalChars = TotalChars + MatchArray[MatchIndex].LengthInChars;
+    }
+    MaxNodes = TotalChars + 1;
+
+    if (MaxNodes > ((DWORD)-1 - sizeof(YORI_LIB_SUBSTRING_MATCHER)) / (sizeof(YORI_LIB_SUBSTRING_MATCHER_NODE) + sizeof(YORI_LIB_SUBSTRING_MATCHER_EDGE)) ||
+        MaxNodes > (DWORD)-1 / (sizeof(YORI_LIB_SUBSTRING_MATCHER_BUILD_NODE) + sizeof(DWORD))) {
+
+        return FALSE;
+    }
+
+    Matcher = YoriLibMalloc(sizeof(YORI_LIB_SUBSTRING_MATCHER) +
+                            MaxNodes * sizeof(YORI_LIB_SUBSTRING_MATCHER_NODE) +
+                            MaxNodes * sizeof(YORI_LIB_SUBSTRING_MATCHER_EDGE));
+    if (Matcher == NULL) {
+        return FALSE;
+    }
+
+    BuildNodes = YoriLibMalloc(MaxNodes * (sizeof(YORI_LIB_SUBSTRING_MATCHER_BUILD_NODE) + sizeof(DWORD)));
+    if (BuildNodes == NULL) {
+        YoriLibFree(Matcher);
+        return FALSE;
+    }
+    Queue = (PDWORD)(BuildNodes + MaxNodes);
+
+    ZeroMemory(Matcher, sizeof(YORI_LIB_SUBSTRING_MATCHER));
+    Matcher->MatchArray = MatchArray;
+    Matcher->NumberMatches = NumberMatches;
+    Matcher->Insensitive = Insensitive;
+    Matcher->EmptyPatternIndex = YORI_LIB_SUBSTRING_MATCHER_NONE;
+    Matcher->Nodes = (PYORI_LIB_SUBSTRING_MATCHER_NODE)(Matcher + 1);
+    Matcher->Edges = (PYORI_LIB_SUBSTRING_MATCHER_EDGE)(Matcher->Nodes + MaxNodes);
+    Nodes = Matcher->Nodes;
+
+    ZeroMemory(&Nodes[0], sizeof(YORI_LIB_SUBSTRING_MATCHER_NODE));
+    Nodes[0].PatternIndex = YORI_LIB_SUBSTRING_MATCHER_NONE;
+    ZeroMemory(&BuildNodes[0], sizeof(YORI_LIB_SUBSTRING_MATCHER_BUILD_NODE));
+    Matcher->NodeCount = 1;
+
+    //
+    //  Build a trie of all of the patterns.  Earlier patterns take
+    //  precedence over later identical ones.
+    //
+
+    for (MatchIndex = 0; MatchIndex < NumberMatches; MatchIndex++) {
+        if (MatchArray[MatchIndex].LengthInChars == 0) {
+            if (Matcher->EmptyPatternIndex == YORI_LIB_SUBSTRING_MATCHER_NONE) {
+                Matcher->EmptyPatternIndex = MatchIndex;
+            }
+            continue;
+        }
+
+        if (MatchArray[MatchIndex].LengthInChars > Matcher->MaximumLength) {
+            Matcher->MaximumLength = MatchArray[MatchIndex].LengthInChars;
+        }
+
+        Node = 0;
+        for (CharIndex = 0; CharIndex < MatchArray[MatchIndex].LengthInChars; CharIndex++) {
+            Char = MatchArray[MatchIndex].StartOfString[CharIndex];
+            if (Insensitive) {
+                Char = YoriLibUpcaseChar(Char);
+            }
+
+            Previous = 0;
+            Child = BuildNodes[Node].FirstChild;
+            while (Child != 0 && BuildNodes[Child].Char < Char) {
+                Previous = Child;
+                Child = BuildNodes[Child].NextSibling;
+            }
+
+            if (Child == 0 || BuildNodes[Child].Char != Char) {
+                Next = Matcher->NodeCount;
+                Matcher->NodeCount++;
+                BuildNodes[Next].FirstChild = 0;
+                BuildNodes[Next].NextSibling = Child;
+                BuildNodes[Next].Char = Char;
+                if (Previous == 0) {
+                    BuildNodes[Node].FirstChild = Next;
+                } else {
+                    BuildNodes[Previous].NextSibling = Next;
+                }
+                ZeroMemory(&Nodes[Next], sizeof(YORI_LIB_SUBSTRING_MATCHER_NODE));
+                Nodes[Next].PatternIndex = YORI_LIB_SUBSTRING_MATCHER_NONE;
+                Nodes[Next].Depth = CharIndex + 1;
+                Child = Next;
+            }
+
+            Node = Child;
+        }
+
+        if (Nodes[Node].PatternIndex == YORI_LIB_SUBSTRING_MATCHER_NONE) {
+            Nodes[Node].PatternIndex = MatchIndex;
+        }
+    }
+
+    //
+    //  Walk the trie breadth first, laying out each state's transitions
+    //  contiguously and calculating where to continue from on a mismatch.
+    //  A state's Fail state is always shallower, so it has been laid out
+    //  by the time it is needed.
+    //
+
+    EdgeCount = 0;
+    QueueHead = 0;
+    QueueTail = 0;
+    Queue[QueueTail++] = 0;
+
+    while (QueueHead < QueueTail) {
+        Node = Queue[QueueHead++];
+        Nodes[Node].FirstEdge = EdgeCount;
+
+        Child = BuildNodes[Node].FirstChild;
+        while (Child != 0) {
+            Char = BuildNodes[Child].Char;
+            Matcher->Edges[EdgeCount].Char = Char;
+            Matcher->Edges[EdgeCount].Next = Child;
+            EdgeCount++;
+            Nodes[Node].EdgeCount++;
+            Queue[QueueTail++] = Child;
+
+            Fail = 0;
+            if (Node != 0) {
+                Fail = Nodes[Node].Fail;
+                while (TRUE) {
+                    Next = YoriLibSubstringMatcherGoto(Matcher, Fail, Char);
+                    if (Next != YORI_LIB_SUBSTRING_MATCHER_NONE) {
+                        Fail = Next;
+                        break;
+                    }
+                    if (Fail == 0) {
+                        break;
+                    }
+                    Fail = Nodes[Fail].Fail;
+                }
+            }
+
+            Nodes[Child].Fail = Fail;
+            if (Nodes[Fail].PatternIndex != YORI_LIB_SUBSTRING_MATCHER_NONE) {
+                Nodes[Child].DictLink = Fail;
+            } else {
+                Nodes[Child].DictLink = Nodes[Fail].DictLink;
+            }
+
+            Child = BuildNodes[Child].NextSibling;
+        }
+    }
+
+    YoriLibFree(BuildNodes);
+
+    for (CharIndex = 0; CharIndex < YORI_LIB_SUBSTRING_MATCHER_ROOT_CHARS; CharIndex++) {
+        Next = YoriLibSubstringMatcherGoto(Matcher, 0, (TCHAR)CharIndex);
+        if (Next == YORI_LIB_SUBSTRING_MATCHER_NONE) {
+            Next = 0;
+        }
+        Matcher->RootTransitions[CharIndex] = Next;
+    }
+
+    *MatcherContext = Matcher;
+    return TRUE;
+}
+
+/**
+ Free a matcher previously allocated with
+ @ref YoriLibSubstringMatcherCreate .
+
+ @param MatcherContext Pointer to the matcher to free.
+ */
+VOID
+YoriLibSubstringMatcherFree(
+    __in PVOID MatcherContext
+    )
+{
+    YoriLibFree(MatcherContext);
+}
+
+/**
+ Search through a string for the first occurrence of any pattern in a
+ matcher.  This returns the same result as
+ @ref YoriLibFindFirstMatchingSubstring or
+ @ref YoriLibFindFirstMatchingSubstringInsensitive would for the same
+ patterns: the match which begins earliest in the string, and if more than
+ one pattern matches there, the one which is earliest in the match array.
+
+ @param MatcherContext Pointer to the matcher.
+
+ @param String The string to search through.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return If a match is found, returns a pointer to the entry in the match
+         array corresponding to the substring that was matched.  If no match
+         is found, returns NULL.
+ */
+PYORI_STRING
+YoriLibSubstringMatcherFindFirst(
+    __in PVOID MatcherContext,
+    __in PYORI_STRING String,
+    __out_opt PDWORD StringOffsetOfMatch
+    )
+{
+    PYORI_LIB_SUBSTRING_MATCHER Matcher = (PYORI_LIB_SUBSTRING_MATCHER)MatcherContext;
+    PYORI_LIB_SUBSTRING_MATCHER_NODE Nodes = Matcher->Nodes;
+    DWORD BestStart;
+    DWORD BestIndex;
+    DWORD Index;
+    DWORD Node;
+    DWORD Output;
+    DWORD Start;
+    TCHAR Char;
+
+    BestStart = YORI_LIB_SUBSTRING_MATCHER_NONE;
+    BestIndex = YORI_LIB_SUBSTRING_MATCHER_NONE;
+    if (Matcher->EmptyPatternIndex != YORI_LIB_SUBSTRING_MATCHER_NONE &&
+        String->LengthInChars > 0) {
+
+        BestStart = 0;
+        BestIndex = Matcher->EmptyPatternIndex;
+    }
+
+    Node = 0;
+    for (Index = 0; Index < String->LengthInChars; Index++) {
+
+        //
+        //  Once a match has been found, any match which starts earlier must
+        //  end within the length of the longest pattern, so there's no point
+        //  looking further.
+        //
+
+        if (BestStart != YORI_LIB_SUBSTRING_MATCHER_NONE &&
+            Index - BestStart >= Matcher->MaximumLength) {
+
+            break;
+        }
+
+        Char = String->StartOfString[Index];
+        if (Matcher->Insensitive) {
+            Char = YoriLibUpcaseChar(Char);
+        }
+
+        Node = YoriLibSubstringMatcherStep(Matcher, Node, Char);
+
+        Output = Node;
+        if (Nodes[Output].PatternIndex == YORI_LIB_SUBSTRING_MATCHER_NONE) {
+            Output = Nodes[Output].DictLink;
+        }
+
+        while (Output != 0) {
+            Start = Index + 1 - Nodes[Output].Depth;
+            if (BestStart == YORI_LIB_SUBSTRING_MATCHER_NONE ||
+                Start < BestStart ||
+                (Start == BestStart && Nodes[Output].PatternIndex < BestIndex)) {
+
+                BestStart = Start;
+                BestIndex = Nodes[Output].PatternIndex;
+            }
+            Output = Nodes[Output].DictLink;
+        }
+    }
+
+    if (BestIndex == YORI_LIB_SUBSTRING_MATCHER_NONE) {
+        if (StringOffsetOfMatch != NULL) {
+            *StringOffsetOfMatch = 0;
+        }
+        return NULL;
+    }
+
+    if (StringOffsetOfMatch != NULL) {
+        *StringOffsetOfMatch = BestStart;
+    }
+    return &Matcher->MatchArray[BestIndex];
+}
+
+/**
+ Search through a string to determine which patterns in a matcher occur
+ anywhere within it, and return the one which is earliest in the match
+ array.  This is useful where the patterns are ordered by precedence and
+ the location of the match is not important.
+
+ @param MatcherContext Pointer to the matcher.
+
+ @param String The string to search through.
+
+ @return If a match is found, returns a pointer to the entry in the match
+         array corresponding to the earliest pattern that occurs in the
+         string.  If no match is found, returns NULL.
+ */
+PYORI_STRING
+YoriLibSubstringMatcherFindLowestPattern(
+    __in PVOID MatcherContext,
+    __in PYORI_STRING String
+    )
+{
+    PYORI_LIB_SUBSTRING_MATCHER Matcher = (PYORI_LIB_SUBSTRING_MATCHER)MatcherContext;
+    PYORI_LIB_SUBSTRING_MATCHER_NODE Nodes = Matcher->Nodes;
+    DWORD BestIndex;
+    DWORD Index;
+    DWORD Node;
+    DWORD Output;
+    TCHAR Char;
+
+    BestIndex = YORI_LIB_SUBSTRING_MATCHER_NONE;
+    if (String->LengthInChars > 0) {
+        BestIndex = Matcher->EmptyPatternIndex;
+    }
+
+    Node = 0;
+    for (Index = 0; Index < String->LengthInChars && BestIndex != 0; Index++) {
+
+        Char = String->StartOfString[Index];
+        if (Matcher->Insensitive) {
+            Char = YoriLibUpcaseChar(Char);
+        }
+
+        Node = YoriLibSubstringMatcherStep(Matcher, Node, Char);
+
+        Output = Node;
+        if (Nodes[Output].PatternIndex == YORI_LIB_SUBSTRING_MATCHER_NONE) {
+            Output = Nodes[Output].DictLink;
+        }
+
+        while (Output != 0) {
+            if (Nodes[Output].PatternIndex < BestIndex) {
+                BestIndex = Nodes[Output].PatternIndex;
+            }
+            Output = Nodes[Output].DictLink;
+        }
+    }
+
+    if (BestIndex == YORI_LIB_SUBSTRING_MATCHER_NONE) {
+        return NULL;
+    }
+
+    return &Matcher->MatchArray[BestIndex];
+}
+
+// vim:sw=4:ts=4:et:
@@ -804,6 +804,475 @@ YoriLibProcessVtEscapesOnNewStream(
     return Result;
 }
 
+/**
+ A buffer that accumulates output for a handle so that it can be written to
+ the device in large pieces.  The device type and the set of VT callbacks
+ are determined once when the buffer is created.
+ */
+typedef struct _YORI_LIB_OUTPUT_BUFFER {
+
+    /**
+     The handle that output is being buffered for.  NULL if this buffer is
+     not in use.
+     */
+    HANDLE hOutput;
+
+    /**
+     The VT processing flags that the buffer was created with.  Output that
+     requests different processing bypasses the buffer.
+     */
+    DWORD VtFlags;
+
+    /**
+     TRUE if the handle refers to a console, FALSE if it refers to a file,
+     pipe or other device.
+     */
+    BOOL IsConsole;
+
+    /**
+     The number of characters in the buffer which will cause it to be
+     written to the device.
+     */
+    DWORD FlushThreshold;
+
+    /**
+     The callback functions to use when writing the buffer to a console.
+     */
+    YORI_LIB_VT_CALLBACK_FUNCTIONS Callbacks;
+
+    /**
+     Formatted UTF16 text which has not yet been written to the device.
+     */
+    YORI_STRING Text;
+
+    /**
+     A scratch buffer used to remove escapes and expand line endings when
+     writing to a device that is not a console.
+     */
+    YORI_STRING ProcessedText;
+
+    /**
+     A buffer used to hold text in the output encoding when writing to a
+     device that is not a console.
+     */
+    LPSTR EncodedBuffer;
+
+    /**
+     The size of EncodedBuffer, in bytes.
+     */
+    DWORD EncodedBufferLength;
+
+} YORI_LIB_OUTPUT_BUFFER, *PYORI_LIB_OUTPUT_BUFFER;
+
+/**
+ Output buffers for standard output and standard error respectively.
+ */
+YORI_LIB_OUTPUT_BUFFER YoriLibOutputBuffers[2];
+
+/**
+ Select the callback functions to use when outputting to a device.
+
+ @param hOut The device to output to.
+
+ @param Flags Flags indicating the VT processing to perform.
+
+ @param Callbacks On completion, populated with the callback functions to
+        use.
+
+ @return TRUE if the device is a console, FALSE if it is not.
+ */
+BOOL
+YoriLibOutputSelectCallbacks(
+    __in HANDLE hOut,
+    __in DWORD Flags,
+    __out PYORI_LIB_VT_CALLBACK_FUNCTIONS Callbacks
+    )
+{
+    DWORD CurrentMode;
+
+    //
+    //  Check if we're writing to a console supporting color or a file
+    //  that doesn't
+    //
+
+    if (GetConsoleMode(hOut, &CurrentMode)) {
+        if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
+            YoriLibConsoleNoEscapeSetFunctions(Callbacks);
+        } else if ((Flags & YORI_LIB_OUTPUT_PASSTHROUGH_VT) != 0) {
+            YoriLibConsoleIncludeEscapeSetFunctions(Callbacks);
+        } else {
+            YoriLibConsoleSetFunctions(Callbacks);
+        }
+        return TRUE;
+    } else if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
+        YoriLibUtf8TextNoEscapesSetFunctions(Callbacks);
+    } else {
+        YoriLibUtf8TextWithEscapesSetFunctions(Callbacks);
+    }
+    return FALSE;
+}
+
+/**
+ Write the contents of an output buffer to a device which is not a console.
+ Escapes are removed if requested, line endings are converted to Windows
+ form, and the result is converted to the output encoding and written with
+ a single call.
+
+ @param Buffer Pointer to the output buffer.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibOutputBufferWriteToFile(
+    __in PYORI_LIB_OUTPUT_BUFFER Buffer
+    )
+{
+    PYORI_STRING Source;
+    DWORD Index;
+    DWORD DestIndex;
+    DWORD ExtraChars;
+    DWORD BytesNeeded;
+    DWORD BytesWritten;
+    TCHAR Char;
+
+    Source = &Buffer->Text;
+    if ((Buffer->VtFlags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
+        if (!YoriLibStripVtEscapes(&Buffer->Text, &Buffer->ProcessedText)) {
+            return FALSE;
+        }
+        Source = &Buffer->ProcessedText;
+    }
+
+    //
+    //  Count the number of line endings that need to be expanded.  If
+    //  there are any, expand them, which may be done in place if the text
+    //  has already been copied to remove escapes.
+    //
+
+    ExtraChars = 0;
+    for (Index = 0; Index < Source->LengthInChars; Index++) {
+        Char = Source->StartOfString[Index];
+        if (Char == '\r' && Index + 1 < Source->LengthInChars && Source->StartOfString[Index + 1] == '\n') {
+            Index++;
+        } else if (Char == '\r' || Char == '\n') {
+            ExtraChars++;
+        }
+    }
+
+    if (ExtraChars > 0) {
+        if (Source == &Buffer->Text) {
+            if (Buffer->ProcessedText.LengthAllocated < Source->LengthInChars + ExtraChars) {
+                YoriLibFreeStringContents(&Buffer->ProcessedText);
+                if (!YoriLibAllocateString(&Buffer->ProcessedText, Source->LengthInChars + ExtraChars + Buffer->FlushThreshold)) {
+                    return FALSE;
+                }
+            }
+            memcpy(Buffer->ProcessedText.StartOfString, Source->StartOfString, Source->LengthInChars * sizeof(TCHAR));
+            Buffer->ProcessedText.LengthInChars = Source->LengthInChars;
+            Source = &Buffer->ProcessedText;
+        } else if (Source->LengthAllocated < Source->LengthInChars + ExtraChars) {
+            if (!YoriLibReallocateString(Source, Source->LengthInChars + ExtraChars + Buffer->FlushThreshold)) {
+                return FALSE;
+            }
+        }
+
+        //
+        //  Expand from the end so the text can be processed in place.
+        //
+
+        DestIndex = Source->LengthInChars + ExtraChars;
+        Index = Source->LengthInChars;
+        while (Index > 0) {
+            Index--;
+            Char = Source->StartOfString[Index];
+            if (Char == '\n' && Index > 0 && Source->StartOfString[Index - 1] == '\r') {
+                Source->StartOfString[--DestIndex] = '\n';
+                Source->StartOfString[--DestIndex] = '\r';
+                Index--;
+            } else if (Char == '\r' || Char == '\n') {
+                Source->StartOfString[--DestIndex] = '\n';
+                Source->StartOfString[--DestIndex] = '\r';
+            } else {
+                Source->StartOfString[--DestIndex] = Char;
+            }
+        }
+        ASSERT(DestIndex == 0);
+        Source->LengthInChars += ExtraChars;
+    }
+
+    if (Source->LengthInChars == 0) {
+        return TRUE;
+    }
+
+    BytesNeeded = YoriLibGetMultibyteOutputSizeNeeded(Source->StartOfString, Source->LengthInChars);
+    if (BytesNeeded > Buffer->EncodedBufferLength) {
+        if (Buffer->EncodedBuffer != NULL) {
+            YoriLibFree(Buffer->EncodedBuffer);
+            Buffer->EncodedBufferLength = 0;
+        }
+        Buffer->EncodedBuffer = YoriLibMalloc(BytesNeeded);
+        if (Buffer->EncodedBuffer == NULL) {
+            return FALSE;
+        }
+        Buffer->EncodedBufferLength = BytesNeeded;
+    }
+
+    YoriLibMultibyteOutput(Source->StartOfString, Source->LengthInChars, Buffer->EncodedBuffer, BytesNeeded);
+    return WriteFile(Buffer->hOutput, Buffer->EncodedBuffer, BytesNeeded, &BytesWritten, NULL);
+}
+
+/**
+ Write any text accumulated in an output buffer to its device.
+
+ @param Buffer Pointer to the output buffer.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibOutputBufferFlushBuffer(
+    __in PYORI_LIB_OUTPUT_BUFFER Buffer
+    )
+{
+    BOOL Result;
+
+    if (Buffer->Text.LengthInChars == 0) {
+        return TRUE;
+    }
+
+    if (Buffer->IsConsole) {
+        Result = YoriLibProcessVtEscapesOnNewStream(Buffer->Text.StartOfString, Buffer->Text.LengthInChars, Buffer->hOutput, &Buffer->Callbacks);
+    } else {
+        Result = YoriLibOutputBufferWriteToFile(Buffer);
+    }
+
+    Buffer->Text.LengthInChars = 0;
+    return Result;
+}
+
+/**
+ Find the output buffer that should be used for output to a handle.
+
+ @param hOut The handle to output to.
+
+ @param Flags Flags indicating the VT processing to perform.
+
+ @return Pointer to the output buffer, or NULL if output to this handle with
+         these flags is not buffered.
+ */
+PYORI_LIB_OUTPUT_BUFFER
+YoriLibOutputBufferForHandle(
+    __in HANDLE hOut,
+    __in DWORD Flags
+    )
+{
+    DWORD Index;
+    PYORI_LIB_OUTPUT_BUFFER Buffer;
+    PYORI_LIB_OUTPUT_BUFFER FoundBuffer;
+
+    FoundBuffer = NULL;
+    for (Index = 0; Index < sizeof(YoriLibOutputBuffers)/sizeof(YoriLibOutputBuffers[0]); Index++) {
+        Buffer = &YoriLibOutputBuffers[Index];
+        if (Buffer->hOutput == NULL) {
+            continue;
+        }
+
+        //
+        //  If a different handle is being written to and this buffer is
+        //  for a console, write out its contents so that text appears on
+        //  the console in the order it was generated.
+        //
+
+        if (Buffer->hOutput != hOut) {
+            if (Buffer->IsConsole) {
+                YoriLibOutputBufferFlushBuffer(Buffer);
+            }
+            continue;
+        }
+
+        //
+        //  If the caller wants different VT processing to the buffered
+        //  output, write out anything buffered so ordering is preserved and
+        //  let this output go directly to the device.
+        //
+
+        if ((Flags & (YORI_LIB_OUTPUT_STRIP_VT | YORI_LIB_OUTPUT_PASSTHROUGH_VT)) != Buffer->VtFlags) {
+            YoriLibOutputBufferFlushBuffer(Buffer);
+        } else {
+            FoundBuffer = Buffer;
+        }
+    }
+
+    return FoundBuffer;
+}
+
+/**
+ Ensure an output buffer has space for a specified number of characters,
+ writing any existing contents to the device and reallocating the buffer if
+ required.
+
+ @param Buffer Pointer to the output buffer.
+
+ @param CharsNeeded The number of characters that need to be added to the
+        buffer.
+
+ @return TRUE if the buffer has space for the characters, FALSE if it does
+         not.
+ */
+BOOL
+YoriLibOutputBufferReserve(
+    __in PYORI_LIB_OUTPUT_BUFFER Buffer,
+    __in DWORD CharsNeeded
+    )
+{
+    if (Buffer->Text.LengthAllocated - Buffer->Text.LengthInChars >= CharsNeeded) {
+        return TRUE;
+    }
+
+    YoriLibOutputBufferFlushBuffer(Buffer);
+    if (Buffer->Text.LengthAllocated >= CharsNeeded) {
+        return TRUE;
+    }
+
+    YoriLibFreeStringContents(&Buffer->Text);
+    if (!YoriLibAllocateString(&Buffer->Text, CharsNeeded + Buffer->FlushThreshold)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Begin buffering output to standard output or standard error.  Once enabled,
+ output to the handle from YoriLibOutput, YoriLibOutputToDevice and
+ YoriLibOutputString is accumulated and written to the device when the buffer
+ fills, when YoriLibOutputBufferFlush is called, or when buffering is
+ disabled.  Output to the handle which requests different VT processing than
+ Flags is written directly after flushing the buffer.  Callers must disable
+ buffering before returning from their entrypoint, and must not output to a
+ buffered handle from more than one thread.
+
+ @param Flags Flags indicating the stream to buffer and the VT processing to
+        perform.
+
+ @return TRUE to indicate buffering is active, FALSE if it could not be
+         enabled, in which case output is written directly.
+ */
+BOOL
+YoriLibOutputBufferEnable(
+    __in DWORD Flags
+    )
+{
+    PYORI_LIB_OUTPUT_BUFFER Buffer;
+    HANDLE hOut;
+
+    if ((Flags & YORI_LIB_OUTPUT_STDERR) != 0) {
+        Buffer = &YoriLibOutputBuffers[1];
+        hOut = GetStdHandle(STD_ERROR_HANDLE);
+    } else {
+        Buffer = &YoriLibOutputBuffers[0];
+        hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    }
+
+    if (Buffer->hOutput != NULL) {
+        return TRUE;
+    }
+
+    Buffer->IsConsole = YoriLibOutputSelectCallbacks(hOut, Flags, &Buffer->Callbacks);
+    Buffer->VtFlags = Flags & (YORI_LIB_OUTPUT_STRIP_VT | YORI_LIB_OUTPUT_PASSTHROUGH_VT);
+
+    //
+    //  Console output is buffered less aggressively so that the user still
+    //  sees progress.
+    //
+
+    if (Buffer->IsConsole) {
+        Buffer->FlushThreshold = 4 * 1024;
+    } else {
+        Buffer->FlushThreshold = 64 * 1024;
+    }
+
+    YoriLibInitEmptyString(&Buffer->ProcessedText);
+    if (!YoriLibAllocateString(&Buffer->Text, Buffer->FlushThreshold * 2)) {
+        return FALSE;
+    }
+
+    Buffer->hOutput = hOut;
+    return TRUE;
+}
+
+/**
+ Write any buffered output for standard output or standard error to the
+ device.
+
+ @param Flags Flags indicating the stream to flush.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibOutputBufferFlush(
+    __in DWORD Flags
+    )
+{
+    PYORI_LIB_OUTPUT_BUFFER Buffer;
+
+    if ((Flags & YORI_LIB_OUTPUT_STDERR) != 0) {
+        Buffer = &YoriLibOutputBuffers[1];
+    } else {
+        Buffer = &YoriLibOutputBuffers[0];
+    }
+
+    if (Buffer->hOutput == NULL) {
+        return TRUE;
+    }
+
+    return YoriLibOutputBufferFlushBuffer(Buffer);
+}
+
+/**
+ Write any buffered output for standard output or standard error to the
+ device and stop buffering output for it.
+
+ @param Flags Flags indicating the stream to stop buffering.
+ */
+VOID
+YoriLibOutputBufferDisable(
+    __in DWORD Flags
+    )
+{
+    PYORI_LIB_OUTPUT_BUFFER Buffer;
+
+    if ((Flags & YORI_LIB_OUTPUT_STDERR) != 0) {
+        Buffer = &YoriLibOutputBuffers[1];
+    } else {
+        Buffer = &YoriLibOutputBuffers[0];
+    }
+
+    if (Buffer->hOutput == NULL) {
+        return;
+    }
+
+    YoriLibOutputBufferFlushBuffer(Buffer);
+    YoriLibFreeStringContents(&Buffer->Text);
+    YoriLibFreeStringContents(&Buffer->ProcessedText);
+    if (Buffer->EncodedBuffer != NULL) {
+        YoriLibFree(Buffer->EncodedBuffer);
+        Buffer->EncodedBuffer = NULL;
+        Buffer->EncodedBufferLength = 0;
+    }
+    Buffer->hOutput = NULL;
+}
+
+/**
+ Write out and stop buffering any output for all streams.  This is invoked
+ when the process is exiting.
+ */
+VOID
+YoriLibOutputBufferDisableAll()
+{
+    YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
+    YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDERR);
+}
+
 /**
  Output a printf-style formatted string to the specified output stream.
 
@@ -830,28 +1299,43 @@ YoriLibOutputInternal(
     TCHAR stack_buf[64];
     TCHAR * buf;
     YORI_LIB_VT_CALLBACK_FUNCTIONS Callbacks;
-    DWORD CurrentMode;
+    PYORI_LIB_OUTPUT_BUFFER Buffer;
     BOOL Result;
 
     //
-    //  Check if we're writing to a console supporting color or a file
-    //  that doesn't
+    //  If output to this device is buffered, try to format directly into
+    //  the buffer.  Only if that fails is the size needed calculated.
     //
 
-    if (GetConsoleMode(hOut, &CurrentMode)) {
-        if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
-            YoriLibConsoleNoEscapeSetFunctions(&Callbacks);
-        } else if ((Flags & YORI_LIB_OUTPUT_PASSTHROUGH_VT) != 0) {
-            YoriLibConsoleIncludeEscapeSetFunctions(&Callbacks);
-        } else {
-            YoriLibConsoleSetFunctions(&Callbacks);
+    Buffer = YoriLibOutputBufferForHandle(hOut, Flags);
+    if (Buffer != NULL) {
+        len = -1;
+        if (Buffer->Text.LengthAllocated - Buffer->Text.LengthInChars > 1) {
+            len = YoriLibVSPrintf(&Buffer->Text.StartOfString[Buffer->Text.LengthInChars], Buffer->Text.LengthAllocated - Buffer->Text.LengthInChars, szFmt, marker);
         }
-    } else if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
-        YoriLibUtf8TextNoEscapesSetFunctions(&Callbacks);
-    } else {
-        YoriLibUtf8TextWithEscapesSetFunctions(&Callbacks);
+
+        if (len < 0) {
+            marker = savedmarker;
+            len = YoriLibVSPrintfSize(szFmt, marker);
+            if (!YoriLibOutputBufferReserve(Buffer, len)) {
+                return FALSE;
+            }
+            marker = savedmarker;
+            len = YoriLibVSPrintf(&Buffer->Text.StartOfString[Buffer->Text.LengthInChars], Buffer->Text.LengthAllocated - Buffer->Text.LengthInChars, szFmt, marker);
+            if (len < 0) {
+                return FALSE;
+            }
+        }
+
+        Buffer->Text.LengthInChars += len;
+        if (Buffer->Text.LengthInChars >= Buffer->FlushThreshold) {
+            return YoriLibOutputBufferFlushBuffer(Buffer);
+        }
+        return TRUE;
     }
 
+    YoriLibOutputSelectCallbacks(hOut, Flags, &Callbacks);
+
     len = YoriLibVSPrintfSize(szFmt, marker);
 
     if (len>(int)(sizeof(stack_buf)/sizeof(stack_buf[0]))) {
@@ -930,28 +1414,36 @@ YoriLibOutputString(
     )
 {
     YORI_LIB_VT_CALLBACK_FUNCTIONS Callbacks;
-    DWORD CurrentMode;
+    PYORI_LIB_OUTPUT_BUFFER Buffer;
     BOOL Result;
 
     //
-    //  Check if we're writing to a console supporting color or a file
-    //  that doesn't
+    //  If output to this device is buffered, append the string to the
+    //  buffer.  Strings larger than the buffer are written directly once
+    //  the buffer has been flushed.
     //
 
-    if (GetConsoleMode(hOut, &CurrentMode)) {
-        if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
-            YoriLibConsoleNoEscapeSetFunctions(&Callbacks);
-        } else if ((Flags & YORI_LIB_OUTPUT_PASSTHROUGH_VT) != 0) {
-            YoriLibConsoleIncludeEscapeSetFunctions(&Callbacks);
-        } else {
-            YoriLibConsoleSetFunctions(&Callbacks);
+    Buffer = YoriLibOutputBufferForHandle(hOut, Flags);
+    if (Buffer != NULL) {
+        if (String->LengthInChars < Buffer->FlushThreshold) {
+            if (!YoriLibOutputBufferReserve(Buffer, String->LengthInChars)) {
+                return FALSE;
+            }
+            memcpy(&Buffer->Text.StartOfString[Buffer->Text.LengthInChars], String->StartOfString, String->LengthInChars * sizeof(TCHAR));
+            Buffer->Text.LengthInChars += String->LengthInChars;
+            if (Buffer->Text.LengthInChars >= Buffer->FlushThreshold) {
+                return YoriLibOutputBufferFlushBuffer(Buffer);
+            }
+            return TRUE;
+        }
+
+        if (!YoriLibOutputBufferFlushBuffer(Buffer)) {
+            return FALSE;
         }
-    } else if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
-        YoriLibUtf8TextNoEscapesSetFunctions(&Callbacks);
-    } else {
-        YoriLibUtf8TextWithEscapesSetFunctions(&Callbacks);
     }
 
+    YoriLibOutputSelectCallbacks(hOut, Flags, &Callbacks);
+
     Result = YoriLibProcessVtEscapesOnNewStream(String->StartOfString, String->LengthInChars, hOut, &Callbacks);
 
     return Result;
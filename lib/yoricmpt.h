@@ -80,6 +80,12 @@ typedef DWORD_PTR *PDWORD_PTR;
  Definition for pointer size integer for compilers that don't contain it.
  */
 typedef ULONG ULONG_PTR;
+
+/**
+ Definition for a pointer to a pointer size integer for compilers that
+ don't contain it.
+ */
+typedef ULONG_PTR *PULONG_PTR;
 #endif
 #endif
 
@@ -191,6 +197,44 @@ typedef struct _FILE_PROCESS_IDS_USING_FILE_INFORMATION {
 
 } FILE_PROCESS_IDS_USING_FILE_INFORMATION, *PFILE_PROCESS_IDS_USING_FILE_INFORMATION;
 
+/**
+ Definition of the information class to query the device containing a file
+ for compilation environments that don't define it.
+ */
+#define FileFsDeviceInformation (4)
+
+/**
+ A structure that is returned by NtQueryVolumeInformationFile describing
+ the device containing a file.
+ */
+typedef struct _FILE_FS_DEVICE_INFORMATION {
+
+    /**
+     The type of the device.
+     */
+    DWORD DeviceType;
+
+    /**
+     Flags describing the device, such as FILE_REMOTE_DEVICE.
+     */
+    DWORD Characteristics;
+
+} FILE_FS_DEVICE_INFORMATION, *PFILE_FS_DEVICE_INFORMATION;
+
+#ifndef FILE_REMOVABLE_MEDIA
+/**
+ A device characteristic indicating the device has removable media.
+ */
+#define FILE_REMOVABLE_MEDIA 0x00000001
+#endif
+
+#ifndef FILE_REMOTE_DEVICE
+/**
+ A device characteristic indicating the device is accessed over a network.
+ */
+#define FILE_REMOTE_DEVICE   0x00000010
+#endif
+
 /**
  Definition of the information class to query memory usage of a process for
  compilation environments that don't define it.
@@ -2289,6 +2333,32 @@ typedef struct _FILE_STANDARD_INFO {
  The identifier of the request type that returns the above structure.
  */
 #define FileStandardInfo    (0x000000001)
+
+/**
+ A structure describing whether a file should be deleted when its last
+ handle is closed, provided here for when the compilation environment
+ doesn't provide it.
+ */
+typedef struct _FILE_DISPOSITION_INFO {
+
+    /**
+     TRUE if the file should be deleted when its last handle is closed.
+     */
+    BOOLEAN DeleteFile;
+} FILE_DISPOSITION_INFO, *PFILE_DISPOSITION_INFO;
+
+/**
+ The identifier of the request type that sets the above structure.
+ */
+#define FileDispositionInfo (0x000000004)
+#endif
+
+#ifndef REPLACEFILE_IGNORE_MERGE_ERRORS
+/**
+ A flag to ReplaceFile indicating that failure to merge information from
+ the replaced file into the replacement file should not cause failure.
+ */
+#define REPLACEFILE_IGNORE_MERGE_ERRORS 0x00000002
 #endif
 
 #ifndef STORAGE_INFO_FLAGS_ALIGNED_DEVICE
@@ -2839,6 +2909,23 @@ typedef struct _YORI_JOB_ASSOCIATE_COMPLETION_PORT {
     HANDLE Port;
 } YORI_JOB_ASSOCIATE_COMPLETION_PORT, *PYORI_JOB_ASSOCIATE_COMPLETION_PORT;
 
+#ifndef JOB_OBJECT_MSG_EXIT_PROCESS
+/**
+ A definition for the completion port message indicating a process in a job
+ has exited if it is not defined by the current compilation environment.
+ */
+#define JOB_OBJECT_MSG_EXIT_PROCESS (7)
+#endif
+
+#ifndef JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS
+/**
+ A definition for the completion port message indicating a process in a job
+ has exited abnormally if it is not defined by the current compilation
+ environment.
+ */
+#define JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS (8)
+#endif
+
 #ifndef HSHELL_RUDEAPPACTIVATED
 /**
  A definition for HSHELL_RUDEAPPACTIVATED if it is not defined by the current
@@ -4647,6 +4734,18 @@ NT_QUERY_SYSTEM_INFORMATION(DWORD, PVOID, DWORD, PDWORD);
  */
 typedef NT_QUERY_SYSTEM_INFORMATION *PNT_QUERY_SYSTEM_INFORMATION;
 
+/**
+ A prototype for the NtQueryVolumeInformationFile function.
+ */
+typedef
+LONG WINAPI
+NT_QUERY_VOLUME_INFORMATION_FILE(HANDLE, PIO_STATUS_BLOCK, PVOID, DWORD, DWORD);
+
+/**
+ A prototype for a pointer to the NtQueryVolumeInformationFile function.
+ */
+typedef NT_QUERY_VOLUME_INFORMATION_FILE *PNT_QUERY_VOLUME_INFORMATION_FILE;
+
 /**
  A prototype for the RtlGetLastNtStatus function.
  */
@@ -4694,6 +4793,12 @@ typedef struct _YORI_NTDLL_FUNCTIONS {
      */
     PNT_QUERY_SYSTEM_INFORMATION pNtQuerySystemInformation;
 
+    /**
+     If it's available on the current system, a pointer to
+     NtQueryVolumeInformationFile.
+     */
+    PNT_QUERY_VOLUME_INFORMATION_FILE pNtQueryVolumeInformationFile;
+
     /**
      If it's available on the current system, a pointer to
      RtlGetLastNtStatus.
@@ -4741,6 +4846,18 @@ CREATE_HARD_LINKW(LPWSTR, LPWSTR, PVOID);
  */
 typedef CREATE_HARD_LINKW *PCREATE_HARD_LINKW;
 
+/**
+ A prototype for the CreateIoCompletionPort function.
+ */
+typedef
+HANDLE WINAPI
+CREATE_IO_COMPLETION_PORT(HANDLE, HANDLE, ULONG_PTR, DWORD);
+
+/**
+ A prototype for a pointer to the CreateIoCompletionPort function.
+ */
+typedef CREATE_IO_COMPLETION_PORT *PCREATE_IO_COMPLETION_PORT;
+
 /**
  A prototype for the CreateJobObjectW function.
  */
@@ -5041,6 +5158,30 @@ GET_PRODUCT_INFO(DWORD, DWORD, DWORD, DWORD, PDWORD);
  */
 typedef GET_PRODUCT_INFO *PGET_PRODUCT_INFO;
 
+/**
+ A prototype for the GetQueuedCompletionStatus function.
+ */
+typedef
+BOOL WINAPI
+GET_QUEUED_COMPLETION_STATUS(HANDLE, PDWORD, PULONG_PTR, LPOVERLAPPED *, DWORD);
+
+/**
+ A prototype for a pointer to the GetQueuedCompletionStatus function.
+ */
+typedef GET_QUEUED_COMPLETION_STATUS *PGET_QUEUED_COMPLETION_STATUS;
+
+/**
+ A prototype for the GetSystemTimes function.
+ */
+typedef
+BOOL WINAPI
+GET_SYSTEM_TIMES(LPFILETIME, LPFILETIME, LPFILETIME);
+
+/**
+ A prototype for a pointer to the GetSystemTimes function.
+ */
+typedef GET_SYSTEM_TIMES *PGET_SYSTEM_TIMES;
+
 /**
  A prototype for the GetTickCount64 function.
  */
@@ -5137,6 +5278,18 @@ QUERY_INFORMATION_JOB_OBJECT(HANDLE, DWORD, PVOID, DWORD, LPDWORD);
  */
 typedef QUERY_INFORMATION_JOB_OBJECT *PQUERY_INFORMATION_JOB_OBJECT;
 
+/**
+ A prototype for the ReplaceFileW function.
+ */
+typedef
+BOOL WINAPI
+REPLACE_FILEW(LPCWSTR, LPCWSTR, LPCWSTR, DWORD, LPVOID, LPVOID);
+
+/**
+ A prototype for a pointer to the ReplaceFileW function.
+ */
+typedef REPLACE_FILEW *PREPLACE_FILEW;
+
 /**
  A prototype for the RegisterApplicationRestart function.
  */
@@ -5185,6 +5338,18 @@ SET_CURRENT_CONSOLE_FONT_EX(HANDLE, BOOL, PYORI_CONSOLE_FONT_INFOEX);
  */
 typedef SET_CURRENT_CONSOLE_FONT_EX *PSET_CURRENT_CONSOLE_FONT_EX;
 
+/**
+ A prototype for the SetFileInformationByHandle function.
+ */
+typedef
+BOOL WINAPI
+SET_FILE_INFORMATION_BY_HANDLE(HANDLE, DWORD, PVOID, DWORD);
+
+/**
+ A prototype for a pointer to the SetFileInformationByHandle function.
+ */
+typedef SET_FILE_INFORMATION_BY_HANDLE *PSET_FILE_INFORMATION_BY_HANDLE;
+
 /**
  A prototype for the SetInformationJobObject function.
  */
@@ -5259,6 +5424,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PCREATE_HARD_LINKW pCreateHardLinkW;
 
+    /**
+     If it's available on the current system, a pointer to CreateIoCompletionPort.
+     */
+    PCREATE_IO_COMPLETION_PORT pCreateIoCompletionPort;
+
     /**
      If it's available on the current system, a pointer to CreateJobObjectW.
      */
@@ -5384,6 +5554,16 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PGET_PRODUCT_INFO pGetProductInfo;
 
+    /**
+     If it's available on the current system, a pointer to GetQueuedCompletionStatus.
+     */
+    PGET_QUEUED_COMPLETION_STATUS pGetQueuedCompletionStatus;
+
+    /**
+     If it's available on the current system, a pointer to GetSystemTimes.
+     */
+    PGET_SYSTEM_TIMES pGetSystemTimes;
+
     /**
      If it's available on the current system, a pointer to GetTickCount64.
      */
@@ -5429,6 +5609,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PREGISTER_APPLICATION_RESTART pRegisterApplicationRestart;
 
+    /**
+     If it's available on the current system, a pointer to ReplaceFileW.
+     */
+    PREPLACE_FILEW pReplaceFileW;
+
     /**
      If it's available on the current system, a pointer to RtlCaptureStackBackTrace.
      */
@@ -5444,6 +5629,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PSET_CURRENT_CONSOLE_FONT_EX pSetCurrentConsoleFontEx;
 
+    /**
+     If it's available on the current system, a pointer to SetFileInformationByHandle.
+     */
+    PSET_FILE_INFORMATION_BY_HANDLE pSetFileInformationByHandle;
+
     /**
      If it's available on the current system, a pointer to SetInformationJobObject.
      */
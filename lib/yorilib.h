@@ -90,6 +90,18 @@ typedef struct _YORI_HASH_ENTRY {
      table to identify the entry.
      */
     PVOID Context;
+
+    /**
+     The hash table that this entry is currently inserted into.
+     */
+    struct _YORI_HASH_TABLE *HashTable;
+
+    /**
+     The full 32 bit hash of the key.  This is compared before performing
+     any string comparison, and allows the entry to be moved to a new bucket
+     when the table grows without hashing the key again.
+     */
+    DWORD Hash;
 } YORI_HASH_ENTRY, *PYORI_HASH_ENTRY;
 
 /**
@@ -109,12 +121,18 @@ typedef struct _YORI_HASH_BUCKET {
 typedef struct _YORI_HASH_TABLE {
 
     /**
-     The number of buckets in the hash table.
+     The number of buckets in the hash table.  This is always a power of
+     two, so a bucket can be found by masking the hash.
      */
     DWORD NumberBuckets;
 
     /**
-     An array of hash buckets.
+     The number of entries currently inserted into the hash table.
+     */
+    DWORD NumberEntries;
+
+    /**
+     An array of hash buckets.  This is reallocated as the table grows.
      */
     PYORI_HASH_BUCKET Buckets;
 } YORI_HASH_TABLE, *PYORI_HASH_TABLE;
@@ -847,6 +865,104 @@ YoriLibDbgRealAssert(
 #define ASSERT(x)
 #endif
 
+// *** DIGEST.C ***
+
+/**
+ Digest algorithms implemented without relying on operating system support.
+ */
+typedef enum _YORI_LIB_DIGEST_ALGORITHM {
+    YoriLibDigestSha1 = 0,
+    YoriLibDigestSha256,
+    YoriLibDigestXxh64
+} YORI_LIB_DIGEST_ALGORITHM, *PYORI_LIB_DIGEST_ALGORITHM;
+
+/**
+ The largest number of bytes in a digest generated by any algorithm.
+ */
+#define YORI_LIB_DIGEST_MAX_LENGTH (32)
+
+/**
+ State used while generating a digest.  Data can be added to the digest in
+ any number of calls, and the digest is complete when it is finished.
+ */
+typedef struct _YORI_LIB_DIGEST_CONTEXT {
+
+    /**
+     The algorithm being used to generate the digest.
+     */
+    YORI_LIB_DIGEST_ALGORITHM Algorithm;
+
+    /**
+     TRUE if the processor's SHA instruction set extensions should be used.
+     */
+    BOOLEAN UseShaExtensions;
+
+    /**
+     The number of bytes in Buffer which have not yet been processed.
+     */
+    DWORD BufferedLength;
+
+    /**
+     The total number of bytes added to the digest.
+     */
+    DWORDLONG TotalLength;
+
+    /**
+     The intermediate state of the algorithm.
+     */
+    union {
+
+        /**
+         The state of a SHA1 or SHA256 digest.
+         */
+        DWORD Sha[8];
+
+        /**
+         The state of each lane of an XXH64 digest.
+         */
+        DWORDLONG Xxh64[4];
+    } State;
+
+    /**
+     Data which does not yet make up a complete block.
+     */
+    UCHAR Buffer[64];
+
+} YORI_LIB_DIGEST_CONTEXT, *PYORI_LIB_DIGEST_CONTEXT;
+
+DWORD
+YoriLibDigestGetLength(
+    __in YORI_LIB_DIGEST_ALGORITHM Algorithm
+    );
+
+__success(return)
+BOOL
+YoriLibDigestAlgorithmFromString(
+    __in PYORI_STRING Name,
+    __out PYORI_LIB_DIGEST_ALGORITHM Algorithm
+    );
+
+VOID
+YoriLibDigestInitialize(
+    __out PYORI_LIB_DIGEST_CONTEXT Context,
+    __in YORI_LIB_DIGEST_ALGORITHM Algorithm
+    );
+
+VOID
+YoriLibDigestUpdate(
+    __inout PYORI_LIB_DIGEST_CONTEXT Context,
+    __in PVOID Buffer,
+    __in DWORD Length
+    );
+
+__success(return)
+BOOL
+YoriLibDigestFinish(
+    __inout PYORI_LIB_DIGEST_CONTEXT Context,
+    __out_ecount(DigestLength) PUCHAR Digest,
+    __in DWORD DigestLength
+    );
+
 // *** DYLD.C ***
 
 BOOL
@@ -1081,6 +1197,21 @@ typedef YORILIB_FILE_ENUM_FN *PYORILIB_FILE_ENUM_FN;
  */
 #define YORILIB_FILEENUM_DIRECTORY_CONTENTS      0x00000100
 
+/**
+ When recursing, enumerate subdirectories concurrently on a pool of threads.
+ The callbacks may be invoked from several threads at once and results are
+ returned in no particular order, so callbacks must be thread safe.
+ */
+#define YORILIB_FILEENUM_PARALLEL                0x00000200
+
+/**
+ When recursing, enumerate subdirectories concurrently on a pool of threads,
+ but invoke the callbacks on the calling thread in the same order as a
+ serial enumeration.  Results are buffered for each directory until they can
+ be returned.
+ */
+#define YORILIB_FILEENUM_PARALLEL_ORDERED        0x00000400
+
 __success(return)
 BOOL
 YoriLibForEachFile(
@@ -2072,6 +2203,16 @@ YoriLibFreeEmptyHashTable(
     __in PYORI_HASH_TABLE HashTable
     );
 
+DWORD
+YoriLibHashStringFull(
+    __in PYORI_STRING String
+    );
+
+WORD
+YoriLibHashString(
+    __in PYORI_STRING String
+    );
+
 VOID
 YoriLibHashInsertByKey(
     __in PYORI_HASH_TABLE HashTable,
@@ -2086,6 +2227,12 @@ YoriLibHashLookupByKey(
     __in PYORI_STRING KeyString
     );
 
+PYORI_HASH_ENTRY
+YoriLibHashLookupByKeyCaseSensitive(
+    __in PYORI_HASH_TABLE HashTable,
+    __in PYORI_STRING KeyString
+    );
+
 VOID
 YoriLibHashRemoveByEntry(
     __in PYORI_HASH_ENTRY HashEntry
@@ -2220,6 +2367,13 @@ YoriLibLimitJobObjectPriority(
     __in DWORD Priority
     );
 
+BOOL
+YoriLibAssociateJobObjectWithCompletionPort(
+    __in HANDLE hJob,
+    __in HANDLE hPort,
+    __in_opt PVOID Key
+    );
+
 // *** LICENSE.C ***
 
 BOOL
@@ -2258,6 +2412,76 @@ YoriLibLineReadClose(
     __in_opt PVOID Context
     );
 
+/**
+ A description of a line returned from YoriLibLineViewNext.  The line is not
+ copied into this structure; it refers to a buffer owned by the line view
+ context.
+ */
+typedef struct _YORI_LIB_LINE_VIEW {
+
+    /**
+     Pointer to the first character of the line.
+     */
+    PVOID StartOfLine;
+
+    /**
+     The number of characters in the line, excluding any line ending.  These
+     are 16 bit characters if Encoding is CP_UTF16, and 8 bit characters
+     otherwise.
+     */
+    DWORD LengthInChars;
+
+    /**
+     The encoding of the characters in the line.
+     */
+    DWORD Encoding;
+
+    /**
+     TRUE if the line was followed by a line ending, FALSE if it was not.
+     */
+    BOOLEAN LineTerminated;
+} YORI_LIB_LINE_VIEW, *PYORI_LIB_LINE_VIEW;
+
+__success(return)
+BOOL
+YoriLibLineViewOpen(
+    __in HANDLE FileHandle,
+    __out PVOID * Context
+    );
+
+__success(return)
+BOOL
+YoriLibLineViewNext(
+    __in PVOID Context,
+    __out PYORI_LIB_LINE_VIEW LineView
+    );
+
+__success(return)
+BOOL
+YoriLibLineViewToString(
+    __in PYORI_LIB_LINE_VIEW LineView,
+    __inout PYORI_STRING UserString
+    );
+
+__success(return)
+BOOL
+YoriLibLineViewGetOffset(
+    __in PVOID Context,
+    __out PLONGLONG Offset
+    );
+
+__success(return)
+BOOL
+YoriLibLineViewSeek(
+    __in PVOID Context,
+    __in LONGLONG Offset
+    );
+
+VOID
+YoriLibLineViewClose(
+    __in_opt PVOID Context
+    );
+
 // *** LIST.C ***
 
 VOID
@@ -2406,6 +2630,35 @@ YoriLibRecycleBinFile(
     __in PYORI_STRING FilePath
     );
 
+// *** STRMATCH.C ***
+
+__success(return)
+BOOL
+YoriLibSubstringMatcherCreate(
+    __in DWORD NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive,
+    __out PVOID * MatcherContext
+    );
+
+VOID
+YoriLibSubstringMatcherFree(
+    __in PVOID MatcherContext
+    );
+
+PYORI_STRING
+YoriLibSubstringMatcherFindFirst(
+    __in PVOID MatcherContext,
+    __in PYORI_STRING String,
+    __out_opt PDWORD StringOffsetOfMatch
+    );
+
+PYORI_STRING
+YoriLibSubstringMatcherFindLowestPattern(
+    __in PVOID MatcherContext,
+    __in PYORI_STRING String
+    );
+
 // *** STRMENUM.C ***
 
 BOOL
@@ -2557,6 +2810,24 @@ YoriLibProcessVtEscapesOnOpenStream(
     __in PYORI_LIB_VT_CALLBACK_FUNCTIONS Callbacks
     );
 
+BOOL
+YoriLibOutputBufferEnable(
+    __in DWORD Flags
+    );
+
+BOOL
+YoriLibOutputBufferFlush(
+    __in DWORD Flags
+    );
+
+VOID
+YoriLibOutputBufferDisable(
+    __in DWORD Flags
+    );
+
+VOID
+YoriLibOutputBufferDisableAll();
+
 BOOL
 YoriLibOutput(
     __in DWORD Flags,
@@ -2687,6 +2958,18 @@ YoriLibLocateExecutableInPath(
     __out PYORI_STRING PathName
     );
 
+VOID
+YoriLibPathCacheEnable();
+
+BOOL
+YoriLibPathCacheQueryStatistics(
+    __out PDWORD Hits,
+    __out PDWORD Misses
+    );
+
+VOID
+YoriLibPathCacheCleanup();
+
 
 // *** PRINTF.C ***
 
@@ -3080,6 +3363,53 @@ YoriLibSetSelectionColor(
 BOOL
 YoriLibIsYoriQuickEditEnabled();
 
+// *** SORT.C ***
+
+/**
+ A single element to sort.
+ */
+typedef struct _YORI_LIB_SORT_ENTRY {
+
+    /**
+     A key describing the position of the element.  Elements are sorted by
+     ascending key, and elements with identical keys are compared with the
+     caller's comparison function.
+     */
+    ULONGLONG Key;
+
+    /**
+     Pointer to the caller's element.
+     */
+    PVOID Item;
+} YORI_LIB_SORT_ENTRY, *PYORI_LIB_SORT_ENTRY;
+
+/**
+ Prototype for a function to compare two elements whose sort keys are
+ identical.  Returns YORI_LIB_LESS_THAN, YORI_LIB_EQUAL or
+ YORI_LIB_GREATER_THAN.
+ */
+typedef DWORD YORI_LIB_SORT_COMPARE_FN(PVOID Left, PVOID Right, PVOID Context);
+
+/**
+ Pointer to a function to compare two elements whose sort keys are
+ identical.
+ */
+typedef YORI_LIB_SORT_COMPARE_FN *PYORI_LIB_SORT_COMPARE_FN;
+
+__success(return)
+BOOL
+YoriLibSortEntries(
+    __inout_ecount(Count) PYORI_LIB_SORT_ENTRY Entries,
+    __in DWORD Count,
+    __in_opt PYORI_LIB_SORT_COMPARE_FN CompareFn,
+    __in_opt PVOID Context
+    );
+
+ULONGLONG
+YoriLibSortKeyFromStringPrefix(
+    __in PYORI_STRING String
+    );
+
 
 // *** STRING.C ***
 
@@ -117,25 +117,31 @@ LinesProcessStream(
     )
 {
     PVOID LineContext = NULL;
-    YORI_STRING LineString;
-
-    YoriLibInitEmptyString(&LineString);
+    YORI_LIB_LINE_VIEW LineView;
 
     LinesContext->FilesFound++;
     LinesContext->FilesFoundThisArg++;
     LinesContext->FileLinesFound = 0;
 
+    //
+    //  Since only the number of lines is needed, the lines are never
+    //  converted or copied.
+    //
+
+    if (!YoriLibLineViewOpen(hSource, &LineContext)) {
+        return FALSE;
+    }
+
     while (TRUE) {
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibLineViewNext(LineContext, &LineView)) {
             break;
         }
 
         LinesContext->FileLinesFound++;
     }
 
-    YoriLibLineReadClose(LineContext);
-    YoriLibFreeStringContents(&LineString);
+    YoriLibLineViewClose(LineContext);
 
     LinesContext->TotalLinesFound += LinesContext->FileLinesFound;
     return TRUE;
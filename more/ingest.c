@@ -27,186 +27,466 @@
 #include "more.h"
 
 /**
- Process a single opened stream, enumerating through all lines and displaying
- the set requested by the user.
+ Add a page to the end of the line index, growing the index if necessary.
+ This function assumes the caller holds MORE_CONTEXT::PhysicalLineMutex .
 
- @param hSource The opened source stream.
+ @param MoreContext Pointer to the more context.
+
+ @param Page Pointer to the page to add.
 
- @param MoreContext Pointer to context information specifying which lines to
-        display.
- 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
+__success(return)
 BOOL
-MoreProcessStream(
-    __in HANDLE hSource,
-    __in PMORE_CONTEXT MoreContext
+MoreAddPageToIndex(
+    __inout PMORE_CONTEXT MoreContext,
+    __in PMORE_LINE_PAGE Page
     )
 {
-    PVOID LineContext = NULL;
-    YORI_STRING LineString;
-    PMORE_PHYSICAL_LINE NewLine;
-    DWORD TabCount;
-    DWORD CharIndex;
-    DWORD DestIndex;
-    DWORD TabIndex;
+    PMORE_LINE_PAGE *NewPages;
+    DWORD NewPagesAllocated;
+
+    if (MoreContext->PageCount >= MoreContext->PagesAllocated) {
+        NewPagesAllocated = MoreContext->PagesAllocated * 2;
+        if (NewPagesAllocated < 1024) {
+            NewPagesAllocated = 1024;
+        }
+
+        NewPages = YoriLibMalloc(NewPagesAllocated * sizeof(PMORE_LINE_PAGE));
+        if (NewPages == NULL) {
+            return FALSE;
+        }
+
+        if (MoreContext->Pages != NULL) {
+            memcpy(NewPages, MoreContext->Pages, MoreContext->PageCount * sizeof(PMORE_LINE_PAGE));
+            YoriLibFree(MoreContext->Pages);
+        }
+
+        MoreContext->Pages = NewPages;
+        MoreContext->PagesAllocated = NewPagesAllocated;
+    }
+
+    MoreContext->Pages[MoreContext->PageCount] = Page;
+    MoreContext->PageCount++;
+    return TRUE;
+}
+
+/**
+ Make a set of lines in a page available to the viewport thread, adding the
+ page to the line index if it has not been added already, and signal the
+ viewport thread that new lines exist.
+
+ @param MoreContext Pointer to the more context.
+
+ @param Page Pointer to the page containing the lines.
+
+ @param NewLineCount The number of lines following the lines already
+        published in the page to make available.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  On failure,
+         the page remains owned by the caller if it has not previously been
+         published.
+ */
+__success(return)
+BOOL
+MorePublishLines(
+    __inout PMORE_CONTEXT MoreContext,
+    __in PMORE_LINE_PAGE Page,
+    __in DWORD NewLineCount
+    )
+{
+    WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
+    if (Page->LineCount == 0) {
+        if (!MoreAddPageToIndex(MoreContext, Page)) {
+            ReleaseMutex(MoreContext->PhysicalLineMutex);
+            MoreContext->OutOfMemory = TRUE;
+            return FALSE;
+        }
+    }
+    Page->LineCount += NewLineCount;
+    MoreContext->LineCount += NewLineCount;
+    ReleaseMutex(MoreContext->PhysicalLineMutex);
+
+    SetEvent(MoreContext->PhysicalLineAvailableEvent);
+    return TRUE;
+}
+
+/**
+ Allocate a new page for the line index.
+
+ @param MoreContext Pointer to the more context.
+
+ @param Source Pointer to the file that the lines in the page can be read
+        from.  If NULL, the lines are held in memory and the page is
+        allocated with space to refer to them.
+
+ @param Color The color at the beginning of the first line in the page.
+
+ @return Pointer to the page, or NULL on allocation failure.
+ */
+PMORE_LINE_PAGE
+MoreAllocatePage(
+    __in PMORE_CONTEXT MoreContext,
+    __in_opt PMORE_LINE_SOURCE Source,
+    __in WORD Color
+    )
+{
+    PMORE_LINE_PAGE Page;
     DWORD BytesRequired;
-    PUCHAR Buffer = NULL;
-    DWORD BytesRemainingInBuffer = 0;
-    DWORD BufferOffset = 0;
-    DWORD Alignment;
+
+    BytesRequired = sizeof(MORE_LINE_PAGE);
+    if (Source == NULL) {
+        BytesRequired += MORE_LINES_PER_PAGE * sizeof(PMORE_PHYSICAL_LINE);
+    }
+
+    Page = YoriLibMalloc(BytesRequired);
+    if (Page == NULL) {
+        MoreContext->OutOfMemory = TRUE;
+        return NULL;
+    }
+
+    ZeroMemory(Page, sizeof(MORE_LINE_PAGE));
+    Page->Source = Source;
+    Page->FirstLineNumber = MoreContext->LineCount + 1;
+    Page->InitialColor = Color;
+    if (Source == NULL) {
+        Page->Lines = (PMORE_PHYSICAL_LINE *)(Page + 1);
+    }
+
+    return Page;
+}
+
+/**
+ Record a file that lines are being ingested from, so that lines can be
+ read from it again later.
+
+ @param MoreContext Pointer to the more context.
+
+ @param FilePath Pointer to the full path to the file.
+
+ @return Pointer to the source, or NULL on allocation failure.
+ */
+PMORE_LINE_SOURCE
+MoreAllocateSource(
+    __in PMORE_CONTEXT MoreContext,
+    __in PYORI_STRING FilePath
+    )
+{
+    PMORE_LINE_SOURCE Source;
+
+    Source = YoriLibMalloc(sizeof(MORE_LINE_SOURCE) + (FilePath->LengthInChars + 1) * sizeof(TCHAR));
+    if (Source == NULL) {
+        MoreContext->OutOfMemory = TRUE;
+        return NULL;
+    }
+
+    YoriLibInitEmptyString(&Source->FilePath);
+    Source->FilePath.StartOfString = (LPTSTR)(Source + 1);
+    memcpy(Source->FilePath.StartOfString, FilePath->StartOfString, FilePath->LengthInChars * sizeof(TCHAR));
+    Source->FilePath.StartOfString[FilePath->LengthInChars] = '\0';
+    Source->FilePath.LengthInChars = FilePath->LengthInChars;
+    Source->FilePath.LengthAllocated = FilePath->LengthInChars + 1;
+
+    YoriLibAppendList(&MoreContext->SourceList, &Source->SourceList);
+    return Source;
+}
+
+/**
+ Returns TRUE if a line view contains an escape character, indicating the
+ line may change the color of subsequent lines.
+
+ @param LineView Pointer to the line view.
+
+ @return TRUE if the line contains an escape character, FALSE if it does
+         not.
+ */
+BOOL
+MoreLineViewContainsEscape(
+    __in PYORI_LIB_LINE_VIEW LineView
+    )
+{
+    DWORD Index;
+
+    if (LineView->Encoding == CP_UTF16) {
+        PWCHAR Chars = (PWCHAR)LineView->StartOfLine;
+        for (Index = 0; Index < LineView->LengthInChars; Index++) {
+            if (Chars[Index] == 27) {
+                return TRUE;
+            }
+        }
+    } else {
+        PUCHAR Chars = (PUCHAR)LineView->StartOfLine;
+        for (Index = 0; Index < LineView->LengthInChars; Index++) {
+            if (Chars[Index] == 27) {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ Process a file that can be mapped, recording the offset of every
+ MORE_LINES_PER_PAGE lines and the color at that point.  Lines are not held
+ in memory; the viewport thread reads them from the file as they are
+ needed.
+
+ @param LineContext Pointer to the line view context for the file.
+
+ @param MoreContext Pointer to the more context.
+
+ @param Source Pointer to the file being processed.
+ */
+VOID
+MoreIndexStream(
+    __in PVOID LineContext,
+    __in PMORE_CONTEXT MoreContext,
+    __in PMORE_LINE_SOURCE Source
+    )
+{
+    YORI_LIB_LINE_VIEW LineView;
+    YORI_STRING LineString;
+    PMORE_LINE_PAGE Page = NULL;
+    DWORD PendingLines = 0;
+    LONGLONG LineOffset;
     WORD PreviousColor;
 
     YoriLibInitEmptyString(&LineString);
-
-    MoreContext->FilesFound++;
     PreviousColor = MoreContext->InitialColor;
 
     while (TRUE) {
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+        if (!YoriLibLineViewGetOffset(LineContext, &LineOffset) ||
+            !YoriLibLineViewNext(LineContext, &LineView)) {
+
             break;
         }
 
-        //
-        //  Count the number of tabs.  These are replaced at ingestion time, 
-        //  since the width can't change while the program is running and to
-        //  save the complexity of accounting for carryover spaces due to tab
-        //  expansion at end of logical line
-        //
-
-        TabCount = 0;
-        for (CharIndex = 0; CharIndex < LineString.LengthInChars; CharIndex++) {
-            if (LineString.StartOfString[CharIndex] == '\t') {
-                TabCount++;
+        if (Page == NULL) {
+            Page = MoreAllocatePage(MoreContext, Source, PreviousColor);
+            if (Page == NULL) {
+                break;
             }
+            Page->FileOffset = LineOffset;
         }
 
         //
-        //  We need space for the structure, all characters in the source, a NULL,
-        //  and since tabs will be replaced with spaces the number of spaces per
-        //  tab minus one (for the tab character being removed.)
+        //  Only lines containing escapes can change the color, so only
+        //  those lines need to be converted in order to track it.
         //
 
-        BytesRequired = sizeof(MORE_PHYSICAL_LINE) + (LineString.LengthInChars + TabCount * (MoreContext->TabWidth - 1) + 1) * sizeof(TCHAR);
+        if (MoreLineViewContainsEscape(&LineView)) {
+            if (!YoriLibLineViewToString(&LineView, &LineString)) {
+                MoreContext->OutOfMemory = TRUE;
+                break;
+            }
+            MoreUpdateColorFromLine(&LineString, &PreviousColor);
+        }
 
-        //
-        //  If we need a buffer, allocate a buffer that typically has space for
-        //  multiple lines
-        //
+        PendingLines++;
 
-        if (Buffer == NULL || BytesRequired > BytesRemainingInBuffer) {
-            if (Buffer != NULL) {
-                YoriLibDereference(Buffer);
+        if (PendingLines == MORE_LINES_PER_PAGE) {
+            if (!MorePublishLines(MoreContext, Page, PendingLines)) {
+                break;
             }
-            BytesRemainingInBuffer = 64 * 1024;
-            if (BytesRequired > BytesRemainingInBuffer) {
-                BytesRemainingInBuffer = BytesRequired;
+            Page = NULL;
+            PendingLines = 0;
+
+            if (WaitForSingleObject(MoreContext->ShutdownEvent, 0) == WAIT_OBJECT_0) {
+                break;
             }
-            BufferOffset = 0;
+        }
+    }
 
-            Buffer = YoriLibReferencedMalloc(BytesRemainingInBuffer);
-            if (Buffer == NULL) {
-                MoreContext->OutOfMemory = TRUE;
+    //
+    //  Publish the final partial page.  If the page was never added to the
+    //  index, it is still owned here.
+    //
+
+    if (Page != NULL) {
+        if (PendingLines > 0 && !MoreContext->OutOfMemory) {
+            MorePublishLines(MoreContext, Page, PendingLines);
+        }
+        if (Page->LineCount == 0) {
+            YoriLibFree(Page);
+        }
+    }
+
+    YoriLibFreeStringContents(&LineString);
+}
+
+/**
+ Process a stream that cannot be mapped, such as a pipe, copying each line
+ into memory.  Lines are made available to the viewport thread in batches,
+ when a page is full, when lines have been waiting for a period of time, or
+ when a pipe has no more data ready.
+
+ @param hSource The opened source stream.
+
+ @param LineContext Pointer to the line view context for the stream.
+
+ @param MoreContext Pointer to the more context.
+ */
+VOID
+MoreCopyStream(
+    __in HANDLE hSource,
+    __in PVOID LineContext,
+    __in PMORE_CONTEXT MoreContext
+    )
+{
+    YORI_LIB_LINE_VIEW LineView;
+    YORI_STRING LineString;
+    MORE_LINE_BUFFER LineBuffer;
+    PMORE_LINE_PAGE Page = NULL;
+    PMORE_PHYSICAL_LINE NewLine;
+    DWORD PendingLines = 0;
+    DWORD LastPublishTime;
+    DWORD BytesAvailable;
+    DWORD FileType;
+    BOOL Publish;
+    WORD PreviousColor;
+
+    YoriLibInitEmptyString(&LineString);
+    ZeroMemory(&LineBuffer, sizeof(LineBuffer));
+    PreviousColor = MoreContext->InitialColor;
+    FileType = GetFileType(hSource);
+    LastPublishTime = GetTickCount();
+
+    while (TRUE) {
+
+        if (!YoriLibLineViewNext(LineContext, &LineView) ||
+            !YoriLibLineViewToString(&LineView, &LineString)) {
+
+            break;
+        }
+
+        if (Page == NULL) {
+            Page = MoreAllocatePage(MoreContext, NULL, PreviousColor);
+            if (Page == NULL) {
                 break;
             }
         }
 
+        NewLine = MoreCreatePhysicalLine(MoreContext, &LineBuffer, &LineString, Page->FirstLineNumber + Page->LineCount + PendingLines, &PreviousColor);
+        if (NewLine == NULL) {
+            MoreContext->OutOfMemory = TRUE;
+            break;
+        }
+
+        Page->Lines[Page->LineCount + PendingLines] = NewLine;
+        PendingLines++;
+
         //
-        //  Write this line into the current buffer
+        //  Publish lines if the page is full, if lines have been held for
+        //  too long, or if the next read would block waiting for data that
+        //  may not arrive for a while.
         //
 
-        NewLine = (PMORE_PHYSICAL_LINE)YoriLibAddToPointer(Buffer, BufferOffset);
-
-        YoriLibReference(Buffer);
-        NewLine->MemoryToFree = Buffer;
-        NewLine->InitialColor = PreviousColor;
-        NewLine->LineNumber = MoreContext->LineCount + 1;
-        YoriLibReference(Buffer);
-        NewLine->LineContents.MemoryToFree = Buffer;
-        NewLine->LineContents.StartOfString = (LPTSTR)(NewLine + 1);
-
-        for (CharIndex = 0, DestIndex = 0; CharIndex < LineString.LengthInChars; CharIndex++) {
-            //
-            //  If the string is <ESC>[, then treat it as an escape sequence.
-            //  Look for the final letter after any numbers or semicolon.
-            //
-    
-            if (LineString.LengthInChars > CharIndex + 2 &&
-                LineString.StartOfString[CharIndex] == 27 &&
-                LineString.StartOfString[CharIndex + 1] == '[') {
-    
-                YORI_STRING EscapeSubset;
-                DWORD EndOfEscape;
-    
-                YoriLibInitEmptyString(&EscapeSubset);
-                EscapeSubset.StartOfString = &LineString.StartOfString[CharIndex + 2];
-                EscapeSubset.LengthInChars = LineString.LengthInChars - CharIndex - 2;
-                EndOfEscape = YoriLibCountStringContainingChars(&EscapeSubset, _T("0123456789;"));
-    
-                //
-                //  Count everything as consuming the source and needing buffer
-                //  space in the destination but consuming no display cells.  This
-                //  may include the final letter, if we found one.
-                //
-    
-                if (LineString.LengthInChars > CharIndex + 2 + EndOfEscape) {
-                    EscapeSubset.StartOfString -= 2;
-                    EscapeSubset.LengthInChars = EndOfEscape + 3;
-                    YoriLibVtFinalColorFromSequence(PreviousColor, &EscapeSubset, &PreviousColor);
-                }
+        Publish = FALSE;
+        if (Page->LineCount + PendingLines == MORE_LINES_PER_PAGE ||
+            GetTickCount() - LastPublishTime >= MORE_PUBLISH_INTERVAL) {
+
+            Publish = TRUE;
+        } else if (FileType == FILE_TYPE_PIPE) {
+            if (PeekNamedPipe(hSource, NULL, 0, NULL, &BytesAvailable, NULL) &&
+                BytesAvailable == 0) {
+
+                Publish = TRUE;
             }
-            if (LineString.StartOfString[CharIndex] == '\t') {
-                for (TabIndex = 0; TabIndex < MoreContext->TabWidth; TabIndex++) {
-                    NewLine->LineContents.StartOfString[DestIndex] = ' ';
-                    DestIndex++;
-                }
-            } else {
-                NewLine->LineContents.StartOfString[DestIndex] = LineString.StartOfString[CharIndex];
-                DestIndex++;
+        } else if (FileType != FILE_TYPE_DISK) {
+            Publish = TRUE;
+        }
+
+        if (Publish) {
+            if (!MorePublishLines(MoreContext, Page, PendingLines)) {
+                break;
+            }
+            PendingLines = 0;
+            LastPublishTime = GetTickCount();
+            if (Page->LineCount == MORE_LINES_PER_PAGE) {
+                Page = NULL;
+            }
+
+            if (WaitForSingleObject(MoreContext->ShutdownEvent, 0) == WAIT_OBJECT_0) {
+                break;
             }
         }
-        NewLine->LineContents.StartOfString[DestIndex] = '\0';
-        NewLine->LineContents.LengthInChars = DestIndex;
-        NewLine->LineContents.LengthAllocated = DestIndex + 1;
+    }
 
-        BufferOffset += BytesRequired;
-        BytesRemainingInBuffer -= BytesRequired;
+    //
+    //  Publish any remaining lines.  Free any lines that could not be
+    //  published, and the page itself if it was never added to the index.
+    //
 
-        //
-        //  Align the buffer to 8 bytes.  There's no length checking because
-        //  the allocation is assumed to be aligned to 8 bytes.
-        //
+    if (Page != NULL) {
+        if (PendingLines > 0 &&
+            !MoreContext->OutOfMemory &&
+            MorePublishLines(MoreContext, Page, PendingLines)) {
 
-        Alignment = BufferOffset % 8;
-        if (Alignment > 0) {
-            Alignment = 8 - Alignment;
-            BufferOffset += Alignment;
-            BytesRemainingInBuffer -= Alignment;
+            PendingLines = 0;
         }
 
-        //
-        //  Insert the new line into the list
-        //
+        while (PendingLines > 0) {
+            PendingLines--;
+            MoreFreePhysicalLine(Page->Lines[Page->LineCount + PendingLines]);
+        }
+
+        if (Page->LineCount == 0) {
+            YoriLibFree(Page);
+        }
+    }
+
+    MoreReleaseLineBuffer(&LineBuffer);
+    YoriLibFreeStringContents(&LineString);
+}
 
-        WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
-        MoreContext->LineCount++;
-        YoriLibAppendList(&MoreContext->PhysicalLineList, &NewLine->LineList);
-        ReleaseMutex(MoreContext->PhysicalLineMutex);
+/**
+ Process a single opened stream, enumerating through all lines and recording
+ them for display.  Files which can be mapped are indexed so their lines can
+ be read back on demand; other streams are copied into memory.
 
-        SetEvent(MoreContext->PhysicalLineAvailableEvent);
+ @param hSource The opened source stream.
 
-        if (WaitForSingleObject(MoreContext->ShutdownEvent, 0) == WAIT_OBJECT_0) {
-            break;
-        }
+ @param MoreContext Pointer to context information specifying which lines to
+        display.
+
+ @param FilePath Optionally points to the full path to the file that was
+        opened.  If not specified, the stream cannot be reopened, so all
+        lines are copied into memory.
+ 
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+MoreProcessStream(
+    __in HANDLE hSource,
+    __in PMORE_CONTEXT MoreContext,
+    __in_opt PYORI_STRING FilePath
+    )
+{
+    PVOID LineContext = NULL;
+    PMORE_LINE_SOURCE Source;
+    LONGLONG Offset;
+
+    MoreContext->FilesFound++;
+
+    if (!YoriLibLineViewOpen(hSource, &LineContext)) {
+        MoreContext->OutOfMemory = TRUE;
+        return FALSE;
     }
 
-    if (Buffer != NULL) {
-        YoriLibDereference(Buffer);
+    if (FilePath != NULL && YoriLibLineViewGetOffset(LineContext, &Offset)) {
+        Source = MoreAllocateSource(MoreContext, FilePath);
+        if (Source == NULL) {
+            YoriLibLineViewClose(LineContext);
+            return FALSE;
+        }
+        MoreIndexStream(LineContext, MoreContext, Source);
+    } else {
+        MoreCopyStream(hSource, LineContext, MoreContext);
     }
 
-    YoriLibLineReadClose(LineContext);
-    YoriLibFreeStringContents(&LineString);
+    YoriLibLineViewClose(LineContext);
 
     return TRUE;
 }
@@ -262,7 +542,7 @@ MoreFileFoundCallback(
             return TRUE;
         }
 
-        MoreProcessStream(FileHandle, MoreContext);
+        MoreProcessStream(FileHandle, MoreContext, FilePath);
 
         CloseHandle(FileHandle);
     }
@@ -302,7 +582,7 @@ MoreIngestThread(
             return 0;
         }
 
-        MoreProcessStream(GetStdHandle(STD_INPUT_HANDLE), MoreContext);
+        MoreProcessStream(GetStdHandle(STD_INPUT_HANDLE), MoreContext, NULL);
     } else {
         MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_DIRECTORY_CONTENTS;
         if (MoreContext->Recursive) {
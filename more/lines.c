@@ -0,0 +1,629 @@
+/**
+ * @file more/lines.c
+ *
+ * Yori shell more index of physical lines and cache of lines read from files
+ *
+ * Copyright (c) 2019 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "more.h"
+
+/**
+ Update a color attribute to reflect any escape sequences contained in a
+ line.
+
+ @param LineString Pointer to the line to scan for escape sequences.
+
+ @param Color On input, the color at the beginning of the line.  On output,
+        updated to contain the color at the end of the line.
+ */
+VOID
+MoreUpdateColorFromLine(
+    __in PYORI_STRING LineString,
+    __inout PWORD Color
+    )
+{
+    YORI_STRING EscapeSubset;
+    DWORD CharIndex;
+    DWORD EndOfEscape;
+
+    for (CharIndex = 0; CharIndex + 2 < LineString->LengthInChars; CharIndex++) {
+
+        //
+        //  If the string is <ESC>[, then treat it as an escape sequence.
+        //  Look for the final letter after any numbers or semicolon.
+        //
+
+        if (LineString->StartOfString[CharIndex] == 27 &&
+            LineString->StartOfString[CharIndex + 1] == '[') {
+
+            YoriLibInitEmptyString(&EscapeSubset);
+            EscapeSubset.StartOfString = &LineString->StartOfString[CharIndex + 2];
+            EscapeSubset.LengthInChars = LineString->LengthInChars - CharIndex - 2;
+            EndOfEscape = YoriLibCountStringContainingChars(&EscapeSubset, _T("0123456789;"));
+
+            if (LineString->LengthInChars > CharIndex + 2 + EndOfEscape) {
+                EscapeSubset.StartOfString -= 2;
+                EscapeSubset.LengthInChars = EndOfEscape + 3;
+                YoriLibVtFinalColorFromSequence(*Color, &EscapeSubset, Color);
+            }
+        }
+    }
+}
+
+/**
+ Release the reference held on a line buffer by the code populating it.  Any
+ physical lines within the buffer remain valid until they are freed.
+
+ @param LineBuffer Pointer to the line buffer.
+ */
+VOID
+MoreReleaseLineBuffer(
+    __inout PMORE_LINE_BUFFER LineBuffer
+    )
+{
+    if (LineBuffer->Buffer != NULL) {
+        YoriLibDereference(LineBuffer->Buffer);
+        LineBuffer->Buffer = NULL;
+    }
+    LineBuffer->BytesRemaining = 0;
+    LineBuffer->Offset = 0;
+}
+
+/**
+ Construct a physical line from a line of input, expanding tabs and recording
+ the color at the start of the line.
+
+ @param MoreContext Pointer to the more context.
+
+ @param LineBuffer Pointer to the line buffer to construct the line in.  If
+        the buffer has insufficient space, a new one is allocated.
+
+ @param LineString Pointer to the line of input.
+
+ @param LineNumber The line number of the new physical line.
+
+ @param Color On input, the color at the beginning of the line.  On output,
+        updated to contain the color at the end of the line.
+
+ @return Pointer to the physical line, or NULL on allocation failure.  The
+         line should be freed with @ref MoreFreePhysicalLine .
+ */
+PMORE_PHYSICAL_LINE
+MoreCreatePhysicalLine(
+    __in PMORE_CONTEXT MoreContext,
+    __inout PMORE_LINE_BUFFER LineBuffer,
+    __in PYORI_STRING LineString,
+    __in DWORDLONG LineNumber,
+    __inout PWORD Color
+    )
+{
+    PMORE_PHYSICAL_LINE NewLine;
+    DWORD TabCount;
+    DWORD CharIndex;
+    DWORD DestIndex;
+    DWORD TabIndex;
+    DWORD BytesRequired;
+    DWORD Alignment;
+
+    //
+    //  Count the number of tabs.  These are replaced at ingestion time, 
+    //  since the width can't change while the program is running and to
+    //  save the complexity of accounting for carryover spaces due to tab
+    //  expansion at end of logical line
+    //
+
+    TabCount = 0;
+    for (CharIndex = 0; CharIndex < LineString->LengthInChars; CharIndex++) {
+        if (LineString->StartOfString[CharIndex] == '\t') {
+            TabCount++;
+        }
+    }
+
+    //
+    //  We need space for the structure, all characters in the source, a NULL,
+    //  and since tabs will be replaced with spaces the number of spaces per
+    //  tab minus one (for the tab character being removed.)
+    //
+
+    BytesRequired = sizeof(MORE_PHYSICAL_LINE) + (LineString->LengthInChars + TabCount * (MoreContext->TabWidth - 1) + 1) * sizeof(TCHAR);
+
+    //
+    //  If we need a buffer, allocate a buffer that typically has space for
+    //  multiple lines
+    //
+
+    if (LineBuffer->Buffer == NULL || BytesRequired > LineBuffer->BytesRemaining) {
+        MoreReleaseLineBuffer(LineBuffer);
+        LineBuffer->BytesRemaining = 64 * 1024;
+        if (BytesRequired > LineBuffer->BytesRemaining) {
+            LineBuffer->BytesRemaining = BytesRequired;
+        }
+
+        LineBuffer->Buffer = YoriLibReferencedMalloc(LineBuffer->BytesRemaining);
+        if (LineBuffer->Buffer == NULL) {
+            LineBuffer->BytesRemaining = 0;
+            return NULL;
+        }
+    }
+
+    //
+    //  Write this line into the current buffer
+    //
+
+    NewLine = (PMORE_PHYSICAL_LINE)YoriLibAddToPointer(LineBuffer->Buffer, LineBuffer->Offset);
+
+    YoriLibReference(LineBuffer->Buffer);
+    NewLine->MemoryToFree = LineBuffer->Buffer;
+    NewLine->InitialColor = *Color;
+    NewLine->LineNumber = LineNumber;
+    YoriLibReference(LineBuffer->Buffer);
+    NewLine->LineContents.MemoryToFree = LineBuffer->Buffer;
+    NewLine->LineContents.StartOfString = (LPTSTR)(NewLine + 1);
+
+    for (CharIndex = 0, DestIndex = 0; CharIndex < LineString->LengthInChars; CharIndex++) {
+        if (LineString->StartOfString[CharIndex] == '\t') {
+            for (TabIndex = 0; TabIndex < MoreContext->TabWidth; TabIndex++) {
+                NewLine->LineContents.StartOfString[DestIndex] = ' ';
+                DestIndex++;
+            }
+        } else {
+            NewLine->LineContents.StartOfString[DestIndex] = LineString->StartOfString[CharIndex];
+            DestIndex++;
+        }
+    }
+    NewLine->LineContents.StartOfString[DestIndex] = '\0';
+    NewLine->LineContents.LengthInChars = DestIndex;
+    NewLine->LineContents.LengthAllocated = DestIndex + 1;
+
+    MoreUpdateColorFromLine(LineString, Color);
+
+    LineBuffer->Offset += BytesRequired;
+    LineBuffer->BytesRemaining -= BytesRequired;
+
+    //
+    //  Align the buffer to 8 bytes.  There's no length checking because
+    //  the allocation is assumed to be aligned to 8 bytes.
+    //
+
+    Alignment = LineBuffer->Offset % 8;
+    if (Alignment > 0) {
+        Alignment = 8 - Alignment;
+        LineBuffer->Offset += Alignment;
+        LineBuffer->BytesRemaining -= Alignment;
+    }
+
+    return NewLine;
+}
+
+/**
+ Free a physical line constructed with @ref MoreCreatePhysicalLine .
+
+ @param PhysicalLine Pointer to the physical line to free.
+ */
+VOID
+MoreFreePhysicalLine(
+    __in PMORE_PHYSICAL_LINE PhysicalLine
+    )
+{
+    PVOID MemoryToFree;
+
+    MemoryToFree = PhysicalLine->MemoryToFree;
+    YoriLibFreeStringContents(&PhysicalLine->LineContents);
+    YoriLibDereference(MemoryToFree);
+}
+
+/**
+ Free the physical lines held in memory for a page.  For pages read from a
+ file, the array of lines is also freed, since it can be recreated by
+ reading the file again.
+
+ @param Page Pointer to the page whose lines should be freed.
+ */
+VOID
+MoreFreePageLines(
+    __in PMORE_LINE_PAGE Page
+    )
+{
+    DWORD Index;
+
+    if (Page->Lines == NULL) {
+        return;
+    }
+
+    for (Index = 0; Index < Page->LineCount; Index++) {
+        MoreFreePhysicalLine(Page->Lines[Index]);
+    }
+
+    if (Page->Source != NULL) {
+        YoriLibFree(Page->Lines);
+        Page->Lines = NULL;
+    }
+}
+
+/**
+ Close any file that the viewport thread has opened to read lines from.
+
+ @param MoreContext Pointer to the more context.
+ */
+VOID
+MoreCloseViewSource(
+    __inout PMORE_CONTEXT MoreContext
+    )
+{
+    if (MoreContext->ViewLineContext != NULL) {
+        YoriLibLineViewClose(MoreContext->ViewLineContext);
+        MoreContext->ViewLineContext = NULL;
+    }
+
+    if (MoreContext->ViewFileHandle != NULL) {
+        CloseHandle(MoreContext->ViewFileHandle);
+        MoreContext->ViewFileHandle = NULL;
+    }
+
+    MoreContext->ViewSource = NULL;
+}
+
+/**
+ Read the lines described by a page from its file and add the page to the
+ page cache.  If the file no longer contains the lines that were ingested,
+ the remaining lines in the page are populated as empty lines.
+
+ @param MoreContext Pointer to the more context.
+
+ @param Page Pointer to the page to read.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+MoreLoadPage(
+    __inout PMORE_CONTEXT MoreContext,
+    __in PMORE_LINE_PAGE Page
+    )
+{
+    PMORE_PHYSICAL_LINE *Lines;
+    MORE_LINE_BUFFER LineBuffer;
+    YORI_LIB_LINE_VIEW LineView;
+    YORI_STRING LineString;
+    HANDLE FileHandle;
+    BOOL FileValid;
+    DWORD Index;
+    WORD Color;
+
+    ASSERT(Page->Source != NULL && Page->Lines == NULL);
+
+    //
+    //  Only one file is kept open at a time.  If the page refers to a
+    //  different file, close the current one and open the new one.
+    //
+
+    if (MoreContext->ViewSource != Page->Source) {
+        MoreCloseViewSource(MoreContext);
+
+        FileHandle = CreateFile(Page->Source->FilePath.StartOfString,
+                                GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL,
+                                OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_BACKUP_SEMANTICS,
+                                NULL);
+
+        if (FileHandle != NULL && FileHandle != INVALID_HANDLE_VALUE) {
+            if (YoriLibLineViewOpen(FileHandle, &MoreContext->ViewLineContext)) {
+                MoreContext->ViewFileHandle = FileHandle;
+            } else {
+                CloseHandle(FileHandle);
+            }
+        }
+        MoreContext->ViewSource = Page->Source;
+    }
+
+    Lines = YoriLibMalloc(Page->LineCount * sizeof(PMORE_PHYSICAL_LINE));
+    if (Lines == NULL) {
+        MoreContext->OutOfMemory = TRUE;
+        return FALSE;
+    }
+
+    FileValid = FALSE;
+    if (MoreContext->ViewLineContext != NULL &&
+        YoriLibLineViewSeek(MoreContext->ViewLineContext, Page->FileOffset)) {
+
+        FileValid = TRUE;
+    }
+
+    YoriLibInitEmptyString(&LineString);
+    ZeroMemory(&LineBuffer, sizeof(LineBuffer));
+    Color = Page->InitialColor;
+
+    for (Index = 0; Index < Page->LineCount; Index++) {
+        if (FileValid) {
+            if (!YoriLibLineViewNext(MoreContext->ViewLineContext, &LineView) ||
+                !YoriLibLineViewToString(&LineView, &LineString)) {
+
+                FileValid = FALSE;
+            }
+        }
+
+        if (!FileValid) {
+            LineString.LengthInChars = 0;
+        }
+
+        Lines[Index] = MoreCreatePhysicalLine(MoreContext, &LineBuffer, &LineString, Page->FirstLineNumber + Index, &Color);
+        if (Lines[Index] == NULL) {
+            break;
+        }
+    }
+
+    MoreReleaseLineBuffer(&LineBuffer);
+    YoriLibFreeStringContents(&LineString);
+
+    if (Index < Page->LineCount) {
+        while (Index > 0) {
+            Index--;
+            MoreFreePhysicalLine(Lines[Index]);
+        }
+        YoriLibFree(Lines);
+        MoreContext->OutOfMemory = TRUE;
+        return FALSE;
+    }
+
+    Page->Lines = Lines;
+    YoriLibInsertList(&MoreContext->PageCacheList, &Page->CacheList);
+    MoreContext->CachedPageCount++;
+    return TRUE;
+}
+
+/**
+ Find the page containing a specified line number.  This function assumes
+ the caller holds MORE_CONTEXT::PhysicalLineMutex .
+
+ @param MoreContext Pointer to the more context.
+
+ @param LineNumber The line number to find.
+
+ @return Pointer to the page containing the line, or NULL if the line has
+         not been ingested.
+ */
+PMORE_LINE_PAGE
+MoreFindPageForLine(
+    __in PMORE_CONTEXT MoreContext,
+    __in DWORDLONG LineNumber
+    )
+{
+    PMORE_LINE_PAGE Page;
+    DWORD Low;
+    DWORD High;
+    DWORD Mid;
+
+    //
+    //  Find the first page that starts after the line, so the line is in
+    //  the page before it.
+    //
+
+    Low = 0;
+    High = MoreContext->PageCount;
+    while (Low < High) {
+        Mid = Low + (High - Low) / 2;
+        if (MoreContext->Pages[Mid]->FirstLineNumber <= LineNumber) {
+            Low = Mid + 1;
+        } else {
+            High = Mid;
+        }
+    }
+
+    if (Low == 0) {
+        return NULL;
+    }
+
+    Page = MoreContext->Pages[Low - 1];
+    if (LineNumber >= Page->FirstLineNumber + Page->LineCount) {
+        return NULL;
+    }
+
+    return Page;
+}
+
+/**
+ Return the physical line with a specified line number, reading it from its
+ file if it is not currently held in memory.  This is only called from the
+ viewport thread.
+
+ @param MoreContext Pointer to the more context.
+
+ @param LineNumber The line number to return.
+
+ @return Pointer to the physical line, or NULL if the line has not been
+         ingested or could not be read.
+ */
+PMORE_PHYSICAL_LINE
+MoreGetPhysicalLineByNumber(
+    __inout PMORE_CONTEXT MoreContext,
+    __in DWORDLONG LineNumber
+    )
+{
+    PMORE_LINE_PAGE Page;
+
+    WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
+    Page = MoreFindPageForLine(MoreContext, LineNumber);
+    ReleaseMutex(MoreContext->PhysicalLineMutex);
+
+    if (Page == NULL) {
+        return NULL;
+    }
+
+    if (Page->Source != NULL) {
+        if (Page->Lines == NULL) {
+            if (!MoreLoadPage(MoreContext, Page)) {
+                return NULL;
+            }
+        } else {
+            YoriLibRemoveListItem(&Page->CacheList);
+            YoriLibInsertList(&MoreContext->PageCacheList, &Page->CacheList);
+        }
+    }
+
+    return Page->Lines[LineNumber - Page->FirstLineNumber];
+}
+
+/**
+ Return the physical line following a specified physical line.
+
+ @param MoreContext Pointer to the more context.
+
+ @param PhysicalLine Pointer to the current physical line.  If NULL, the
+        first physical line is returned.
+
+ @return Pointer to the next physical line, or NULL if no further lines
+         have been ingested.
+ */
+PMORE_PHYSICAL_LINE
+MoreGetNextPhysicalLine(
+    __inout PMORE_CONTEXT MoreContext,
+    __in_opt PMORE_PHYSICAL_LINE PhysicalLine
+    )
+{
+    if (PhysicalLine == NULL) {
+        return MoreGetPhysicalLineByNumber(MoreContext, 1);
+    }
+    return MoreGetPhysicalLineByNumber(MoreContext, PhysicalLine->LineNumber + 1);
+}
+
+/**
+ Return the physical line preceding a specified physical line.
+
+ @param MoreContext Pointer to the more context.
+
+ @param PhysicalLine Pointer to the current physical line.
+
+ @return Pointer to the previous physical line, or NULL if the current line
+         is the first line.
+ */
+PMORE_PHYSICAL_LINE
+MoreGetPreviousPhysicalLine(
+    __inout PMORE_CONTEXT MoreContext,
+    __in PMORE_PHYSICAL_LINE PhysicalLine
+    )
+{
+    if (PhysicalLine->LineNumber <= 1) {
+        return NULL;
+    }
+    return MoreGetPhysicalLineByNumber(MoreContext, PhysicalLine->LineNumber - 1);
+}
+
+/**
+ Discard the least recently used pages read from files until the page cache
+ is within its limit.  Pages containing lines that are currently displayed
+ are never discarded, since the display refers to those lines.  This should
+ only be called when no other physical lines are referenced by the viewport
+ thread.
+
+ @param MoreContext Pointer to the more context.
+
+ @param LineNumberToKeep Optionally specifies a line number whose page should
+        not be discarded.  Zero indicates no additional line is required.
+ */
+VOID
+MoreTrimPageCache(
+    __inout PMORE_CONTEXT MoreContext,
+    __in DWORDLONG LineNumberToKeep
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMORE_LINE_PAGE Page;
+    DWORDLONG FirstDisplayedLine;
+    DWORDLONG LastDisplayedLine;
+    DWORDLONG LastLineInPage;
+
+    FirstDisplayedLine = 0;
+    LastDisplayedLine = 0;
+    if (MoreContext->LinesInViewport > 0) {
+        FirstDisplayedLine = MoreContext->DisplayViewportLines[0].PhysicalLine->LineNumber;
+        LastDisplayedLine = MoreContext->DisplayViewportLines[MoreContext->LinesInViewport - 1].PhysicalLine->LineNumber;
+    }
+
+    ListEntry = YoriLibGetPreviousListEntry(&MoreContext->PageCacheList, NULL);
+    while (MoreContext->CachedPageCount > MORE_MAX_CACHED_PAGES && ListEntry != NULL) {
+        Page = CONTAINING_RECORD(ListEntry, MORE_LINE_PAGE, CacheList);
+        ListEntry = YoriLibGetPreviousListEntry(&MoreContext->PageCacheList, ListEntry);
+
+        LastLineInPage = Page->FirstLineNumber + Page->LineCount - 1;
+        if (MoreContext->LinesInViewport > 0 &&
+            Page->FirstLineNumber <= LastDisplayedLine &&
+            LastLineInPage >= FirstDisplayedLine) {
+
+            continue;
+        }
+
+        if (Page->FirstLineNumber <= LineNumberToKeep &&
+            LastLineInPage >= LineNumberToKeep) {
+
+            continue;
+        }
+
+        YoriLibRemoveListItem(&Page->CacheList);
+        MoreFreePageLines(Page);
+        MoreContext->CachedPageCount--;
+    }
+}
+
+/**
+ Free all pages in the line index, along with any lines they contain and any
+ record of the files they were read from.  This is called after the ingest
+ thread has terminated.
+
+ @param MoreContext Pointer to the more context.
+ */
+VOID
+MoreFreeLineIndex(
+    __inout PMORE_CONTEXT MoreContext
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMORE_LINE_SOURCE Source;
+    DWORD Index;
+
+    for (Index = 0; Index < MoreContext->PageCount; Index++) {
+        MoreFreePageLines(MoreContext->Pages[Index]);
+        YoriLibFree(MoreContext->Pages[Index]);
+    }
+
+    if (MoreContext->Pages != NULL) {
+        YoriLibFree(MoreContext->Pages);
+        MoreContext->Pages = NULL;
+    }
+    MoreContext->PageCount = 0;
+    MoreContext->PagesAllocated = 0;
+    YoriLibInitializeListHead(&MoreContext->PageCacheList);
+    MoreContext->CachedPageCount = 0;
+
+    MoreCloseViewSource(MoreContext);
+
+    ListEntry = YoriLibGetNextListEntry(&MoreContext->SourceList, NULL);
+    while (ListEntry != NULL) {
+        Source = CONTAINING_RECORD(ListEntry, MORE_LINE_SOURCE, SourceList);
+        YoriLibRemoveListItem(ListEntry);
+        YoriLibFree(Source);
+        ListEntry = YoriLibGetNextListEntry(&MoreContext->SourceList, NULL);
+    }
+}
+
+// vim:sw=4:ts=4:et:
@@ -33,12 +33,6 @@
  */
 typedef struct _MORE_PHYSICAL_LINE {
 
-    /**
-     A list of physical lines.  Paired with MORE_CONTEXT::PhysicalLineList
-     and synchronized with MORE_CONTEXT::PhysicalLineMutex .
-     */
-    YORI_LIST_ENTRY LineList;
-
     /**
      Pointer to the referenced allocation that contains this physical line.
      */
@@ -51,7 +45,7 @@ typedef struct _MORE_PHYSICAL_LINE {
 
     /**
      The number of this physical line within the input stream.  The first
-     line is zero.
+     line is one.
      */
     DWORDLONG LineNumber;
 
@@ -61,6 +55,117 @@ typedef struct _MORE_PHYSICAL_LINE {
     YORI_STRING LineContents;
 } MORE_PHYSICAL_LINE, *PMORE_PHYSICAL_LINE;
 
+/**
+ The number of physical lines described by each page of the line index.
+ */
+#define MORE_LINES_PER_PAGE 256
+
+/**
+ The number of pages of lines read back from files that can be held in
+ memory at once.  Pages beyond this are discarded, least recently used
+ first, and are read from the file again if they are needed.
+ */
+#define MORE_MAX_CACHED_PAGES 64
+
+/**
+ The maximum time, in milliseconds, that lines read from a pipe are held
+ before being made available to the viewport.
+ */
+#define MORE_PUBLISH_INTERVAL 100
+
+/**
+ A file that physical lines were ingested from.  This is retained so that
+ lines which are not held in memory can be read again from the file.
+ */
+typedef struct _MORE_LINE_SOURCE {
+
+    /**
+     The list of sources.  Paired with MORE_CONTEXT::SourceList .
+     */
+    YORI_LIST_ENTRY SourceList;
+
+    /**
+     The full path to the file.  The string is allocated as part of this
+     structure.
+     */
+    YORI_STRING FilePath;
+} MORE_LINE_SOURCE, *PMORE_LINE_SOURCE;
+
+/**
+ A buffer which is being populated with physical lines.  Each buffer is a
+ referenced allocation which typically contains many lines.
+ */
+typedef struct _MORE_LINE_BUFFER {
+
+    /**
+     Pointer to the referenced allocation, or NULL if no buffer has been
+     allocated yet.
+     */
+    PUCHAR Buffer;
+
+    /**
+     The number of bytes in Buffer that have not been used.
+     */
+    DWORD BytesRemaining;
+
+    /**
+     The offset within Buffer of the first unused byte.
+     */
+    DWORD Offset;
+} MORE_LINE_BUFFER, *PMORE_LINE_BUFFER;
+
+/**
+ A page of the line index, describing a consecutive range of physical lines.
+ Lines from pipes are held in memory for the lifetime of the program.  Lines
+ from files are described by the offset of the first line in the file and
+ the color at that point, and are only held in memory while the page is in
+ the page cache.
+ */
+typedef struct _MORE_LINE_PAGE {
+
+    /**
+     The list of pages whose lines are currently held in memory, in order of
+     most recent use.  Paired with MORE_CONTEXT::PageCacheList .  This is
+     only used for pages with a Source.
+     */
+    YORI_LIST_ENTRY CacheList;
+
+    /**
+     The file containing the lines in this page, or NULL if the lines are
+     held in memory for the lifetime of the page.
+     */
+    PMORE_LINE_SOURCE Source;
+
+    /**
+     The offset within Source of the first line in this page.
+     */
+    LONGLONG FileOffset;
+
+    /**
+     The line number of the first line in this page.
+     */
+    DWORDLONG FirstLineNumber;
+
+    /**
+     The number of lines in this page which have been made available to
+     the viewport.  Synchronized with MORE_CONTEXT::PhysicalLineMutex .
+     */
+    DWORD LineCount;
+
+    /**
+     The color attribute at the beginning of the first line in this page.
+     */
+    WORD InitialColor;
+
+    /**
+     An array of pointers to the physical lines in this page.  For pages
+     without a Source this is always present and has space for
+     MORE_LINES_PER_PAGE lines.  For pages with a Source this is only present
+     while the page is in the page cache.
+     */
+    PMORE_PHYSICAL_LINE *Lines;
+} MORE_LINE_PAGE, *PMORE_LINE_PAGE;
+
 /**
  A logical line, meaning a line rendered for display on the console.
  */
@@ -121,19 +226,31 @@ typedef struct _MORE_LOGICAL_LINE {
 typedef struct _MORE_CONTEXT {
 
     /**
-     A linked list of physical lines.
+     An array of pointers to pages describing all physical lines, in line
+     number order.
+     */
+    PMORE_LINE_PAGE *Pages;
+
+    /**
+     The number of elements in the Pages array that are populated.
+     */
+    DWORD PageCount;
+
+    /**
+     The number of elements allocated in the Pages array.
      */
-    YORI_LIST_ENTRY PhysicalLineList;
+    DWORD PagesAllocated;
 
     /**
-     Synchronization around PhysicalLineList.
+     Synchronization around Pages, PageCount, and the line count of each
+     page.
      */
     HANDLE PhysicalLineMutex;
 
     /**
-     An event that is signalled when new lines are added to the
-     PhysicalLineList in case the viewport thread wants to update display
-     when lines are added.
+     An event that is signalled when new lines are added to the Pages array
+     in case the viewport thread wants to update display when lines are
+     added.
      */
     HANDLE PhysicalLineAvailableEvent;
 
@@ -161,16 +278,48 @@ typedef struct _MORE_CONTEXT {
      */
     YORILIB_SELECTION Selection;
 
+    /**
+     A list of pages read back from files whose lines are currently held in
+     memory, most recently used first.  This is only accessed by the
+     viewport thread.
+     */
+    YORI_LIST_ENTRY PageCacheList;
+
+    /**
+     The number of pages in PageCacheList.
+     */
+    DWORD CachedPageCount;
+
+    /**
+     A list of files that physical lines were ingested from.
+     */
+    YORI_LIST_ENTRY SourceList;
+
+    /**
+     The source that is currently opened by the viewport thread in order to
+     read lines back from a file.
+     */
+    PMORE_LINE_SOURCE ViewSource;
+
+    /**
+     A handle to the file described by ViewSource.
+     */
+    HANDLE ViewFileHandle;
+
+    /**
+     A line view context for the file described by ViewSource.
+     */
+    PVOID ViewLineContext;
+
     /**
      An array of size ViewportHeight of lines currently displayed.  Note these
-     refer to the strings in the PhysicalLineList.
+     refer to the strings in physical lines.
      */
     PMORE_LOGICAL_LINE DisplayViewportLines;
 
     /**
      An array of size ViewportHeight of lines that are being constructed to
-     display in future.  Note these refer to the strings in the
-     PhysicalLineList.
+     display in future.  Note these refer to the strings in physical lines.
      */
     PMORE_LOGICAL_LINE StagingViewportLines;
 
@@ -329,6 +478,60 @@ MoreIngestThread(
     __in LPVOID Context
     );
 
+VOID
+MoreUpdateColorFromLine(
+    __in PYORI_STRING LineString,
+    __inout PWORD Color
+    );
+
+PMORE_PHYSICAL_LINE
+MoreCreatePhysicalLine(
+    __in PMORE_CONTEXT MoreContext,
+    __inout PMORE_LINE_BUFFER LineBuffer,
+    __in PYORI_STRING LineString,
+    __in DWORDLONG LineNumber,
+    __inout PWORD Color
+    );
+
+VOID
+MoreReleaseLineBuffer(
+    __inout PMORE_LINE_BUFFER LineBuffer
+    );
+
+VOID
+MoreFreePhysicalLine(
+    __in PMORE_PHYSICAL_LINE PhysicalLine
+    );
+
+PMORE_PHYSICAL_LINE
+MoreGetPhysicalLineByNumber(
+    __inout PMORE_CONTEXT MoreContext,
+    __in DWORDLONG LineNumber
+    );
+
+PMORE_PHYSICAL_LINE
+MoreGetNextPhysicalLine(
+    __inout PMORE_CONTEXT MoreContext,
+    __in_opt PMORE_PHYSICAL_LINE PhysicalLine
+    );
+
+PMORE_PHYSICAL_LINE
+MoreGetPreviousPhysicalLine(
+    __inout PMORE_CONTEXT MoreContext,
+    __in PMORE_PHYSICAL_LINE PhysicalLine
+    );
+
+VOID
+MoreTrimPageCache(
+    __inout PMORE_CONTEXT MoreContext,
+    __in DWORDLONG LineNumberToKeep
+    );
+
+VOID
+MoreFreeLineIndex(
+    __inout PMORE_CONTEXT MoreContext
+    );
+
 BOOL
 MoreViewportDisplay(
     __inout PMORE_CONTEXT MoreContext
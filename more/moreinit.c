@@ -150,7 +150,8 @@ MoreInitContext(
     MoreContext->SuspendPagination = SuspendPagination;
     MoreContext->TabWidth = 4;
 
-    YoriLibInitializeListHead(&MoreContext->PhysicalLineList);
+    YoriLibInitializeListHead(&MoreContext->PageCacheList);
+    YoriLibInitializeListHead(&MoreContext->SourceList);
     MoreContext->PhysicalLineMutex = CreateMutex(NULL, FALSE, NULL);
     if (MoreContext->PhysicalLineMutex == NULL) {
         return FALSE;
@@ -253,8 +254,6 @@ MoreGracefulExit(
     __inout PMORE_CONTEXT MoreContext
     )
 {
-    PYORI_LIST_ENTRY ListEntry;
-    PMORE_PHYSICAL_LINE PhysicalLine;
     DWORD Index;
 
     SetEvent(MoreContext->ShutdownEvent);
@@ -262,14 +261,7 @@ MoreGracefulExit(
     for (Index = 0; Index < MoreContext->ViewportHeight; Index++) {
         YoriLibFreeStringContents(&MoreContext->DisplayViewportLines[Index].Line);
     }
-    ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, NULL);
-    while (ListEntry != NULL) {
-        PhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
-        YoriLibRemoveListItem(ListEntry);
-        YoriLibFreeStringContents(&PhysicalLine->LineContents);
-        YoriLibDereference(PhysicalLine->MemoryToFree);
-        ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, NULL);
-    }
+    MoreFreeLineIndex(MoreContext);
 
     MoreCleanupContext(MoreContext);
 }
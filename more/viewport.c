@@ -693,15 +693,13 @@ MoreGetPreviousLogicalLines(
 
     while(Result && LinesRemaining > 0) {
         PMORE_PHYSICAL_LINE PreviousPhysicalLine;
-        PYORI_LIST_ENTRY ListEntry;
         DWORD LogicalLineCount;
 
-        ListEntry = YoriLibGetPreviousListEntry(&MoreContext->PhysicalLineList, &CurrentInputLine->PhysicalLine->LineList);
-        if (ListEntry == NULL) {
+        PreviousPhysicalLine = MoreGetPreviousPhysicalLine(MoreContext, CurrentInputLine->PhysicalLine);
+        if (PreviousPhysicalLine == NULL) {
             break;
         }
 
-        PreviousPhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
         LogicalLineCount = MoreCountLogicalLinesOnPhysicalLine(MoreContext, PreviousPhysicalLine);
 
         if (LogicalLineCount > LinesRemaining) {
@@ -823,20 +821,18 @@ MoreGetNextLogicalLines(
 
     while(Result && LinesRemaining > 0) {
         PMORE_PHYSICAL_LINE NextPhysicalLine;
-        PYORI_LIST_ENTRY ListEntry;
 
         if (CurrentInputLine != NULL) {
             ASSERT(CurrentInputLine->PhysicalLine != NULL);
-            ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, &CurrentInputLine->PhysicalLine->LineList);
+            NextPhysicalLine = MoreGetNextPhysicalLine(MoreContext, CurrentInputLine->PhysicalLine);
         } else {
-            ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, NULL);
+            NextPhysicalLine = MoreGetNextPhysicalLine(MoreContext, NULL);
         }
-        if (ListEntry == NULL) {
+        if (NextPhysicalLine == NULL) {
 
             break;
         }
 
-        NextPhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
         LogicalLineCount = MoreCountLogicalLinesOnPhysicalLine(MoreContext, NextPhysicalLine);
 
         LineIndexToCopy = 0;
@@ -887,31 +883,32 @@ MoreFindNextLineWithSearchMatch(
     )
 {
     PMORE_PHYSICAL_LINE SearchLine;
-    PYORI_LIST_ENTRY ListEntry;
     DWORD MatchOffset;
 
     if (PreviousMatchLine == NULL) {
         SearchLine = NULL;
-        ListEntry = NULL;
     } else {
         SearchLine = PreviousMatchLine->PhysicalLine;
-        ListEntry = &SearchLine->LineList;
     }
 
-    WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
-
     while (TRUE) {
-        ListEntry = YoriLibGetNextListEntry(&MoreContext->PhysicalLineList, ListEntry);
-        if (ListEntry == NULL) {
-            ReleaseMutex(MoreContext->PhysicalLineMutex);
+        SearchLine = MoreGetNextPhysicalLine(MoreContext, SearchLine);
+        if (SearchLine == NULL) {
             return NULL;
         }
 
-        SearchLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
         if (YoriLibFindFirstMatchingSubstringInsensitive(&SearchLine->LineContents, 1, &MoreContext->SearchString, &MatchOffset)) {
-            ReleaseMutex(MoreContext->PhysicalLineMutex);
             return SearchLine;
         }
+
+        //
+        //  Searching may read many pages from files.  Discard pages that
+        //  have been searched, keeping the current one.
+        //
+
+        if ((SearchLine->LineNumber % MORE_LINES_PER_PAGE) == 0) {
+            MoreTrimPageCache(MoreContext, SearchLine->LineNumber);
+        }
     }
 }
 
@@ -964,8 +961,6 @@ MoreDrawStatusLine(
     DWORDLONG FirstViewportLine;
     DWORDLONG LastViewportLine;
     DWORDLONG TotalLines;
-    PYORI_LIST_ENTRY ListEntry;
-    PMORE_PHYSICAL_LINE LastPhysicalLine;
     BOOL PageFull;
     BOOL ThreadActive;
     LPTSTR StringToDisplay;
@@ -986,9 +981,7 @@ MoreDrawStatusLine(
     LastViewportLine = MoreContext->DisplayViewportLines[MoreContext->LinesInViewport - 1].PhysicalLine->LineNumber;
 
     WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
-    ListEntry = YoriLibGetPreviousListEntry(&MoreContext->PhysicalLineList, NULL);
-    LastPhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
-    TotalLines = LastPhysicalLine->LineNumber;
+    TotalLines = MoreContext->LineCount;
     MoreContext->TotalLinesInViewportStatus = TotalLines;
     ReleaseMutex(MoreContext->PhysicalLineMutex);
 
@@ -2072,8 +2065,6 @@ MoreAreMoreLinesAvailable(
 {
     DWORDLONG LastViewportLineNumber;
     DWORDLONG LastPhysicalLineNumber;
-    PYORI_LIST_ENTRY ListEntry;
-    PMORE_PHYSICAL_LINE LastPhysicalLine;
     PMORE_LOGICAL_LINE LastViewportLine;
 
     //
@@ -2106,9 +2097,7 @@ MoreAreMoreLinesAvailable(
     LastViewportLineNumber = LastViewportLine->PhysicalLine->LineNumber;
 
     WaitForSingleObject(MoreContext->PhysicalLineMutex, INFINITE);
-    ListEntry = YoriLibGetPreviousListEntry(&MoreContext->PhysicalLineList, NULL);
-    LastPhysicalLine = CONTAINING_RECORD(ListEntry, MORE_PHYSICAL_LINE, LineList);
-    LastPhysicalLineNumber = LastPhysicalLine->LineNumber;
+    LastPhysicalLineNumber = MoreContext->LineCount;
     ReleaseMutex(MoreContext->PhysicalLineMutex);
 
     if (LastPhysicalLineNumber > LastViewportLineNumber) {
@@ -2904,6 +2893,13 @@ MoreViewportDisplay(
 
     while(TRUE) {
 
+        //
+        //  Discard any pages read back from files beyond the cache limit.
+        //  Nothing outside the display refers to physical lines here.
+        //
+
+        MoreTrimPageCache(MoreContext, 0);
+
         //
         //  If the viewport is full, we don't care about new lines being
         //  ingested.
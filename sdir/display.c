@@ -188,6 +188,12 @@ SdirWriteStringWithAttribute (
 
     if (Opts->OutputHasAutoLineWrap) {
 
+        //
+        //  The cursor position is only correct once any buffered output
+        //  has reached the console.
+        //
+
+        YoriLibOutputBufferFlush(YORI_LIB_OUTPUT_STDOUT);
         GetConsoleScreenBufferInfo(hConsole, &ScreenInfo);
 
         while (str[TCharsInBuffer] != '\0') {
@@ -414,6 +420,7 @@ SdirPressAnyKey ()
     DWORD NumRead;
 
     SdirWriteString(_T("Press any key to continue..."));
+    YoriLibOutputBufferFlush(YORI_LIB_OUTPUT_STDOUT);
 
     //
     //  Loop throwing away events until we get a key pressed
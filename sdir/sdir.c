@@ -43,7 +43,7 @@ PYORI_FILE_INFO SdirDirCollection;
 
 /**
  Pointer to an array of pointers to directory entries.  These pointers
- are maintained sorted based on the user's sort criteria so that files
+ are sorted based on the user's sort criteria before display so that files
  can be displayed in order from this indirection.
  */
 PYORI_FILE_INFO * SdirDirSorted;
@@ -213,8 +213,6 @@ SdirAddToCollection (
     ) 
 {
     PYORI_FILE_INFO CurrentEntry;
-    DWORD i, j;
-    DWORD CompareResult = 0;
 
     if (SdirDirCollectionCurrent >= SdirAllocatedDirents) {
         if (SdirDirCollectionCurrent < UINT_MAX) {
@@ -246,45 +244,11 @@ SdirAddToCollection (
     }
 
     //
-    //  Now that our internal entry is fully poulated, insert it into the
-    //  correct sorted position.  As an optimization, check if we just need
-    //  to insert at the end (for file name sort on NTFS, this is the
-    //  common case.)
+    //  Now that our internal entry is fully poulated, add it to the end.
+    //  The collection is sorted once all entries have been found, in
+    //  SdirSortCollection.
     //
 
-    if (SdirDirCollectionCurrent > 1 &&
-        Opts->Sort[0].CompareFn(SdirDirSorted[SdirDirCollectionCurrent - 2], CurrentEntry) == Opts->Sort[0].CompareInverseCondition) {
-
-        SdirDirSorted[SdirDirCollectionCurrent - 1] = CurrentEntry;
-        return TRUE;
-    }
-
-    //
-    //  Currently sorting is done very inefficiently by a selection sort
-    //  type algorithm.  Generally this doesn't run due to the optimization
-    //  above.  When a different sort order is requested, performance could
-    //  be improved by using a better algorithm here.
-    //
-
-    for (i = 0; i < SdirDirCollectionCurrent - 1; i++) {
-
-        for (j = 0; j < Opts->CurrentSort; j++) {
-            CompareResult = Opts->Sort[j].CompareFn(SdirDirSorted[i], CurrentEntry);
-
-            if (CompareResult == Opts->Sort[j].CompareBreakCondition ||
-                CompareResult == Opts->Sort[j].CompareInverseCondition) {
-                break;
-            }
-        }
-
-        if (CompareResult == Opts->Sort[j].CompareBreakCondition) {
-            for (j = SdirDirCollectionCurrent - 1; j > i; j--) {
-                SdirDirSorted[j] = SdirDirSorted[j - 1];
-            }
-            SdirDirSorted[i] = CurrentEntry;
-            return TRUE;
-        }
-    }
     SdirDirSorted[SdirDirCollectionCurrent - 1] = CurrentEntry;
     return TRUE;
 }
@@ -882,6 +846,172 @@ SdirFeatureColor(
 }
 
 
+/**
+ Compare two directory entries according to all of the sort criteria
+ specified by the user.
+
+ @param Left Pointer to the first directory entry.
+
+ @param Right Pointer to the second directory entry.
+
+ @param Context Unused.
+
+ @return YORI_LIB_LESS_THAN if the first entry should be displayed before the
+         second, YORI_LIB_GREATER_THAN if the first entry should be displayed
+         after the second, or YORI_LIB_EQUAL if the sort criteria do not
+         distinguish them.
+ */
+DWORD
+SdirSortCompareEntries(
+    __in PVOID Left,
+    __in PVOID Right,
+    __in PVOID Context
+    )
+{
+    DWORD Index;
+    DWORD CompareResult;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    for (Index = 0; Index < Opts->CurrentSort; Index++) {
+        CompareResult = Opts->Sort[Index].CompareFn((PYORI_FILE_INFO)Left, (PYORI_FILE_INFO)Right);
+        if (CompareResult == Opts->Sort[Index].CompareBreakCondition) {
+            return YORI_LIB_GREATER_THAN;
+        } else if (CompareResult == Opts->Sort[Index].CompareInverseCondition) {
+            return YORI_LIB_LESS_THAN;
+        }
+    }
+
+    return YORI_LIB_EQUAL;
+}
+
+/**
+ Pack the date components of a timestamp into a sort key.
+
+ @param Time Pointer to the timestamp.
+
+ @return The sort key.
+ */
+ULONGLONG
+SdirSortKeyFromDate(
+    __in LPSYSTEMTIME Time
+    )
+{
+    return ((ULONGLONG)Time->wYear << 32) | ((ULONGLONG)Time->wMonth << 16) | Time->wDay;
+}
+
+/**
+ Pack the time components of a timestamp into a sort key.
+
+ @param Time Pointer to the timestamp.
+
+ @return The sort key.
+ */
+ULONGLONG
+SdirSortKeyFromTime(
+    __in LPSYSTEMTIME Time
+    )
+{
+    return ((ULONGLONG)Time->wHour << 48) | ((ULONGLONG)Time->wMinute << 32) | ((ULONGLONG)Time->wSecond << 16) | Time->wMilliseconds;
+}
+
+/**
+ Generate a sort key for a directory entry from the first sort criteria
+ specified by the user, so that most comparisons can be resolved without
+ calling the comparison functions.  Criteria which cannot be expressed as
+ a key generate a constant key, and are resolved entirely by comparison.
+
+ @param Entry Pointer to the directory entry.
+
+ @return The sort key.
+ */
+ULONGLONG
+SdirSortKeyFromEntry(
+    __in PYORI_FILE_INFO Entry
+    )
+{
+    SDIR_COMPARE_FN CompareFn;
+    YORI_STRING FileName;
+    ULONGLONG Key;
+
+    CompareFn = Opts->Sort[0].CompareFn;
+
+    if (CompareFn == YoriLibCompareFileName) {
+        YoriLibInitEmptyString(&FileName);
+        FileName.StartOfString = Entry->FileName;
+        FileName.LengthInChars = Entry->FileNameLengthInChars;
+        Key = YoriLibSortKeyFromStringPrefix(&FileName);
+    } else if (CompareFn == YoriLibCompareFileSize) {
+        Key = (ULONGLONG)Entry->FileSize.QuadPart;
+    } else if (CompareFn == YoriLibCompareAllocationSize) {
+        Key = (ULONGLONG)Entry->AllocationSize.QuadPart;
+    } else if (CompareFn == YoriLibCompareCompressedFileSize) {
+        Key = (ULONGLONG)Entry->CompressedFileSize.QuadPart;
+    } else if (CompareFn == YoriLibCompareWriteDate) {
+        Key = SdirSortKeyFromDate(&Entry->WriteTime);
+    } else if (CompareFn == YoriLibCompareWriteTime) {
+        Key = SdirSortKeyFromTime(&Entry->WriteTime);
+    } else if (CompareFn == YoriLibCompareCreateDate) {
+        Key = SdirSortKeyFromDate(&Entry->CreateTime);
+    } else if (CompareFn == YoriLibCompareCreateTime) {
+        Key = SdirSortKeyFromTime(&Entry->CreateTime);
+    } else if (CompareFn == YoriLibCompareAccessDate) {
+        Key = SdirSortKeyFromDate(&Entry->AccessTime);
+    } else if (CompareFn == YoriLibCompareAccessTime) {
+        Key = SdirSortKeyFromTime(&Entry->AccessTime);
+    } else {
+        return 0;
+    }
+
+    if (Opts->Sort[0].CompareBreakCondition == YORI_LIB_LESS_THAN) {
+        Key = ~Key;
+    }
+
+    return Key;
+}
+
+/**
+ Sort the collected directory entries according to the sort criteria
+ specified by the user.  Entries are collected unsorted during enumeration
+ and sorted once before they are displayed.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SdirSortCollection()
+{
+    PYORI_LIB_SORT_ENTRY SortEntries;
+    DWORD Index;
+
+    if (SdirDirCollectionCurrent < 2) {
+        return TRUE;
+    }
+
+    SortEntries = YoriLibMalloc(SdirDirCollectionCurrent * sizeof(YORI_LIB_SORT_ENTRY));
+    if (SortEntries == NULL) {
+        SdirDisplayError(GetLastError(), _T("YoriLibMalloc"));
+        return FALSE;
+    }
+
+    for (Index = 0; Index < SdirDirCollectionCurrent; Index++) {
+        SortEntries[Index].Item = SdirDirSorted[Index];
+        SortEntries[Index].Key = SdirSortKeyFromEntry(SdirDirSorted[Index]);
+    }
+
+    if (!YoriLibSortEntries(SortEntries, SdirDirCollectionCurrent, SdirSortCompareEntries, NULL)) {
+        YoriLibFree(SortEntries);
+        SdirDisplayError(ERROR_NOT_ENOUGH_MEMORY, _T("YoriLibSortEntries"));
+        return FALSE;
+    }
+
+    for (Index = 0; Index < SdirDirCollectionCurrent; Index++) {
+        SdirDirSorted[Index] = SortEntries[Index].Item;
+    }
+
+    YoriLibFree(SortEntries);
+    return TRUE;
+}
+
 /**
  Display the loaded set of files.
 
@@ -910,6 +1040,10 @@ SdirDisplayCollection()
     }
 #endif
 
+    if (!SdirSortCollection()) {
+        return FALSE;
+    }
+
     //
     //  If we're allowed to shorten names to make the display more
     //  legible, we won't allow a longest name greater than twice
@@ -1621,6 +1755,8 @@ ENTRYPOINT(
         goto restore_and_exit;
     }
 
+    YoriLibOutputBufferEnable(YORI_LIB_OUTPUT_STDOUT);
+
     if (Opts->Recursive) {
         if (!SdirEnumerateAndDisplayRecursive(ArgC, ArgV)) {
             goto restore_and_exit;
@@ -1645,6 +1781,7 @@ restore_and_exit:
     if (Opts != NULL) {
         SdirSetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), Opts->PreviousAttributes);
     }
+    YoriLibOutputBufferDisable(YORI_LIB_OUTPUT_STDOUT);
     SdirAppCleanup();
 
     return 0;
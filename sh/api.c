@@ -126,7 +126,7 @@ YoriApiClearHistoryStrings(
     )
 {
     YoriShClearAllHistory();
-    return TRUE;
+    return YoriShTruncateHistoryFile();
 }
 
 /**
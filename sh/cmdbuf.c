@@ -26,6 +26,50 @@
 
 #include "yori.h"
 
+/**
+ The size of each chunk of buffered output, in bytes.
+ */
+#define YORI_SH_PROCESS_BUFFER_CHUNK_SIZE (64 * 1024)
+
+/**
+ The default number of megabytes of output from a single stream to hold in
+ memory before older output is written to a temporary file.  This can be
+ changed by setting YORIBUFFERLIMIT.
+ */
+#define YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT 64
+
+/**
+ A single chunk of buffered output.  Chunks are kept in memory until the
+ number of chunks in memory exceeds a limit, after which the oldest chunks
+ are written to a temporary file and their memory is freed.
+ */
+typedef struct _YORI_SH_PROCESS_BUFFER_CHUNK {
+
+    /**
+     The link into the list of chunks for the stream.  Paired with
+     YORI_SH_PROCESS_BUFFER::ChunkList .
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The offset within the temporary file of this chunk's data, if the
+     chunk has been written to the temporary file.
+     */
+    DWORDLONG SpillFileOffset;
+
+    /**
+     The number of bytes populated with data in this chunk.
+     */
+    DWORD BytesPopulated;
+
+    /**
+     The data in this chunk, or NULL if the chunk has been written to the
+     temporary file.  When present this has space for
+     YORI_SH_PROCESS_BUFFER_CHUNK_SIZE bytes.
+     */
+    PUCHAR Data;
+
+} YORI_SH_PROCESS_BUFFER_CHUNK, *PYORI_SH_PROCESS_BUFFER_CHUNK;
 
 /**
  A buffer for a single data stream.  A process may have a different buffered
@@ -34,14 +78,43 @@
 typedef struct _YORI_SH_PROCESS_BUFFER {
 
     /**
-     The number of bytes currently allocated to this buffer.
+     A list of chunks containing the data, in order.  Data is only ever
+     added to the final chunk.
+     */
+    YORI_LIST_ENTRY ChunkList;
+
+    /**
+     The oldest chunk whose data is still in memory.  All chunks before this
+     one have been written to the temporary file.
      */
-    DWORD BytesAllocated;
+    PYORI_SH_PROCESS_BUFFER_CHUNK OldestChunkInMemory;
+
+    /**
+     The number of chunks whose data is currently in memory.
+     */
+    DWORD ChunksInMemory;
+
+    /**
+     The number of chunks that can be held in memory before older chunks
+     are written to the temporary file.
+     */
+    DWORD MaximumChunksInMemory;
 
     /**
      The number of bytes populated with data in this buffer.
      */
-    DWORD BytesPopulated;
+    DWORDLONG BytesPopulated;
+
+    /**
+     A handle to a temporary file containing older chunks, or NULL if no
+     chunks have been written to a file.
+     */
+    HANDLE hSpillFile;
+
+    /**
+     The number of bytes written to the temporary file.
+     */
+    DWORDLONG BytesSpilled;
 
     /**
      A handle to the buffer processing thread.
@@ -65,14 +138,14 @@ typedef struct _YORI_SH_PROCESS_BUFFER {
     HANDLE hMirror;
 
     /**
-     The number of bytes which have been sent to hMirror.
+     The chunk containing the next data to send to hMirror.
      */
-    DWORD BytesSent;
+    PYORI_SH_PROCESS_BUFFER_CHUNK MirrorChunk;
 
     /**
-     The data buffer.
+     The offset within MirrorChunk of the next data to send to hMirror.
      */
-    PCHAR Buffer;
+    DWORD MirrorChunkOffset;
 
 } YORI_SH_PROCESS_BUFFER, *PYORI_SH_PROCESS_BUFFER;
 
@@ -137,8 +210,22 @@ YoriShFreeProcessBuffer(
     __in PYORI_SH_PROCESS_BUFFER ThisBuffer
     )
 {
-    if (ThisBuffer->Buffer != NULL) {
-        YoriLibFree(ThisBuffer->Buffer);
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+
+    if (ThisBuffer->ChunkList.Next != NULL) {
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, NULL);
+        while (ListEntry != NULL) {
+            Chunk = CONTAINING_RECORD(ListEntry, YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, ListEntry);
+            if (Chunk->Data != NULL) {
+                YoriLibFree(Chunk->Data);
+            }
+            YoriLibFree(Chunk);
+        }
+    }
+    if (ThisBuffer->hSpillFile != NULL) {
+        CloseHandle(ThisBuffer->hSpillFile);
     }
     if (ThisBuffer->hMirror != NULL) {
         CloseHandle(ThisBuffer->hMirror);
@@ -170,6 +257,426 @@ YoriShFreeProcessBuffers(
     YoriLibFree(ThisBuffer);
 }
 
+/**
+ Allocate a new, empty chunk of buffered output.
+
+ @return Pointer to the chunk, or NULL on allocation failure.
+ */
+PYORI_SH_PROCESS_BUFFER_CHUNK
+YoriShAllocateProcessBufferChunk()
+{
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+
+    Chunk = YoriLibMalloc(sizeof(YORI_SH_PROCESS_BUFFER_CHUNK));
+    if (Chunk == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Chunk, sizeof(YORI_SH_PROCESS_BUFFER_CHUNK));
+    Chunk->Data = YoriLibMalloc(YORI_SH_PROCESS_BUFFER_CHUNK_SIZE);
+    if (Chunk->Data == NULL) {
+        YoriLibFree(Chunk);
+        return NULL;
+    }
+
+    return Chunk;
+}
+
+/**
+ Return a pointer to the data in a chunk.  If the chunk is in memory, this
+ refers to the chunk directly.  If the chunk has been written to the
+ temporary file, it is read into a caller supplied buffer, which is
+ allocated on first use.  The caller is expected to hold the buffer's mutex.
+
+ @param ThisBuffer Pointer to the buffer containing the chunk.
+
+ @param Chunk Pointer to the chunk.
+
+ @param SpillBuffer Pointer to a buffer to read chunks from the temporary
+        file into.  If this points to NULL, a buffer is allocated, and the
+        caller is expected to free it with YoriLibFree.
+
+ @return Pointer to the data, or NULL on failure.
+ */
+PUCHAR
+YoriShGetProcessBufferChunkData(
+    __in PYORI_SH_PROCESS_BUFFER ThisBuffer,
+    __in PYORI_SH_PROCESS_BUFFER_CHUNK Chunk,
+    __inout PUCHAR * SpillBuffer
+    )
+{
+    LARGE_INTEGER FileOffset;
+    DWORD BytesRead;
+
+    if (Chunk->Data != NULL) {
+        return Chunk->Data;
+    }
+
+    if (*SpillBuffer == NULL) {
+        *SpillBuffer = YoriLibMalloc(YORI_SH_PROCESS_BUFFER_CHUNK_SIZE);
+        if (*SpillBuffer == NULL) {
+            return NULL;
+        }
+    }
+
+    FileOffset.QuadPart = Chunk->SpillFileOffset;
+    if (SetFilePointer(ThisBuffer->hSpillFile, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+        GetLastError() != NO_ERROR) {
+
+        return NULL;
+    }
+
+    if (!ReadFile(ThisBuffer->hSpillFile, *SpillBuffer, Chunk->BytesPopulated, &BytesRead, NULL) ||
+        BytesRead != Chunk->BytesPopulated) {
+
+        return NULL;
+    }
+
+    return *SpillBuffer;
+}
+
+/**
+ Create a temporary file to hold older chunks of output.  The file is
+ deleted when its handle is closed.
+
+ @return Handle to the temporary file, or NULL on failure.
+ */
+HANDLE
+YoriShCreateProcessBufferSpillFile()
+{
+    YORI_STRING TempPath;
+    TCHAR TempFileName[MAX_PATH];
+    HANDLE hFile;
+
+    TempPath.LengthAllocated = GetTempPath(0, NULL);
+    if (!YoriLibAllocateString(&TempPath, TempPath.LengthAllocated)) {
+        return NULL;
+    }
+    TempPath.LengthInChars = GetTempPath(TempPath.LengthAllocated, TempPath.StartOfString);
+    if (TempPath.LengthInChars == 0 || TempPath.LengthInChars >= TempPath.LengthAllocated) {
+        YoriLibFreeStringContents(&TempPath);
+        return NULL;
+    }
+
+    if (GetTempFileName(TempPath.StartOfString, _T("ysh"), 0, TempFileName) == 0) {
+        YoriLibFreeStringContents(&TempPath);
+        return NULL;
+    }
+    YoriLibFreeStringContents(&TempPath);
+
+    hFile = CreateFile(TempFileName,
+                       GENERIC_READ | GENERIC_WRITE,
+                       0,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+                       NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        DeleteFile(TempFileName);
+        return NULL;
+    }
+
+    return hFile;
+}
+
+/**
+ Write the oldest chunks held in memory to the temporary file until the
+ number of chunks in memory is within the limit.  The final chunk, which is
+ being populated, is never written.  The caller is expected to hold the
+ buffer's mutex.
+
+ @param ThisBuffer Pointer to the buffer.
+ */
+VOID
+YoriShSpillProcessBuffer(
+    __in PYORI_SH_PROCESS_BUFFER ThisBuffer
+    )
+{
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+    PYORI_LIST_ENTRY ListEntry;
+    LARGE_INTEGER FileOffset;
+    DWORD BytesWritten;
+
+    while (ThisBuffer->ChunksInMemory > ThisBuffer->MaximumChunksInMemory) {
+
+        Chunk = ThisBuffer->OldestChunkInMemory;
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, &Chunk->ListEntry);
+        if (ListEntry == NULL) {
+            break;
+        }
+
+        //
+        //  If no temporary file can be used, keep everything in memory
+        //  rather than discarding output.
+        //
+
+        if (ThisBuffer->hSpillFile == NULL) {
+            ThisBuffer->hSpillFile = YoriShCreateProcessBufferSpillFile();
+            if (ThisBuffer->hSpillFile == NULL) {
+                ThisBuffer->MaximumChunksInMemory = (DWORD)-1;
+                break;
+            }
+        }
+
+        FileOffset.QuadPart = ThisBuffer->BytesSpilled;
+        if (SetFilePointer(ThisBuffer->hSpillFile, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+            GetLastError() != NO_ERROR) {
+
+            ThisBuffer->MaximumChunksInMemory = (DWORD)-1;
+            break;
+        }
+
+        if (!WriteFile(ThisBuffer->hSpillFile, Chunk->Data, Chunk->BytesPopulated, &BytesWritten, NULL) ||
+            BytesWritten != Chunk->BytesPopulated) {
+
+            ThisBuffer->MaximumChunksInMemory = (DWORD)-1;
+            break;
+        }
+
+        Chunk->SpillFileOffset = ThisBuffer->BytesSpilled;
+        ThisBuffer->BytesSpilled += Chunk->BytesPopulated;
+        YoriLibFree(Chunk->Data);
+        Chunk->Data = NULL;
+        ThisBuffer->ChunksInMemory--;
+        ThisBuffer->OldestChunkInMemory = CONTAINING_RECORD(ListEntry, YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+    }
+}
+
+/**
+ Find the end of the last complete character within a chunk of data in the
+ multibyte input encoding, so the data can be split at that point without
+ splitting a character.  The data is assumed to begin at a character
+ boundary.
+
+ @param Data Pointer to the data.
+
+ @param Length The number of bytes of data.
+
+ @return The number of bytes up to the end of the last complete character.
+ */
+DWORD
+YoriShFindProcessBufferCharBoundary(
+    __in_bcount(Length) PUCHAR Data,
+    __in DWORD Length
+    )
+{
+    DWORD Encoding;
+    DWORD Index;
+    DWORD CharStart;
+    DWORD CharLength;
+    WCHAR Char;
+
+    Encoding = YoriLibGetMultibyteInputEncoding();
+
+    if (Encoding == CP_UTF16) {
+
+        //
+        //  Drop any odd byte, and don't separate a high surrogate from the
+        //  low surrogate that follows it.
+        //
+
+        Index = Length & ~1;
+        if (Index >= sizeof(WCHAR)) {
+            Char = *(PWCHAR)(Data + Index - sizeof(WCHAR));
+            if (Char >= 0xD800 && Char <= 0xDBFF) {
+                Index -= sizeof(WCHAR);
+            }
+        }
+        return Index;
+    }
+
+    if (Encoding == CP_UTF8) {
+
+        //
+        //  Find the lead byte of the final character by skipping up to
+        //  three continuation bytes, and check whether all of the bytes it
+        //  requires are present.
+        //
+
+        CharStart = Length;
+        for (Index = 0; Index < 4 && CharStart > 0; Index++) {
+            CharStart--;
+            if ((Data[CharStart] & 0xC0) != 0x80) {
+                break;
+            }
+        }
+
+        if ((Data[CharStart] & 0xE0) == 0xC0) {
+            CharLength = 2;
+        } else if ((Data[CharStart] & 0xF0) == 0xE0) {
+            CharLength = 3;
+        } else if ((Data[CharStart] & 0xF8) == 0xF0) {
+            CharLength = 4;
+        } else {
+            return Length;
+        }
+
+        if (CharStart + CharLength > Length) {
+            return CharStart;
+        }
+        return Length;
+    }
+
+    //
+    //  In a double byte code page, a trail byte can have the same value as
+    //  a lead byte, so the characters need to be walked from the start.
+    //
+
+    CharStart = 0;
+    Index = 0;
+    while (Index < Length) {
+        CharStart = Index;
+        if (IsDBCSLeadByteEx(Encoding, Data[Index])) {
+            Index += 2;
+        } else {
+            Index++;
+        }
+    }
+
+    if (Index > Length) {
+        return CharStart;
+    }
+    return Length;
+}
+
+/**
+ Complete the final chunk of a buffer, which has been filled, and add a new
+ chunk to receive further data.  If the chunk ends partway through a line,
+ the partial line is moved to the new chunk so that each chunk can be
+ converted to text without splitting a character.  If the chunk contains
+ no complete line, only a partial character at its end is moved.  The caller is expected
+ to hold the buffer's mutex.
+
+ @param ThisBuffer Pointer to the buffer.
+
+ @param Chunk Pointer to the final chunk, which is full.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShCompleteProcessBufferChunk(
+    __in PYORI_SH_PROCESS_BUFFER ThisBuffer,
+    __in PYORI_SH_PROCESS_BUFFER_CHUNK Chunk
+    )
+{
+    PYORI_SH_PROCESS_BUFFER_CHUNK NewChunk;
+    DWORD LineEnd;
+    DWORD BytesToMove;
+
+    NewChunk = YoriShAllocateProcessBufferChunk();
+    if (NewChunk == NULL) {
+        return FALSE;
+    }
+
+    //
+    //  Find the end of the last complete line.  For UTF16 this needs to
+    //  be a complete character, not just a byte.
+    //
+
+    if (YoriLibGetMultibyteInputEncoding() == CP_UTF16) {
+        for (LineEnd = Chunk->BytesPopulated & ~1; LineEnd >= sizeof(WCHAR); LineEnd -= sizeof(WCHAR)) {
+            if (*(PWCHAR)(Chunk->Data + LineEnd - sizeof(WCHAR)) == '\n') {
+                break;
+            }
+        }
+        if (LineEnd < sizeof(WCHAR)) {
+            LineEnd = 0;
+        }
+    } else {
+        for (LineEnd = Chunk->BytesPopulated; LineEnd > 0; LineEnd--) {
+            if (Chunk->Data[LineEnd - 1] == '\n') {
+                break;
+            }
+        }
+    }
+
+    //
+    //  If the chunk contains no line break, it still needs to be split
+    //  between characters.
+    //
+
+    if (LineEnd == 0) {
+        LineEnd = YoriShFindProcessBufferCharBoundary(Chunk->Data, Chunk->BytesPopulated);
+    }
+
+    if (LineEnd > 0 && LineEnd < Chunk->BytesPopulated) {
+        BytesToMove = Chunk->BytesPopulated - LineEnd;
+        memcpy(NewChunk->Data, Chunk->Data + LineEnd, BytesToMove);
+        NewChunk->BytesPopulated = BytesToMove;
+        Chunk->BytesPopulated = LineEnd;
+
+        if (ThisBuffer->MirrorChunk == Chunk && ThisBuffer->MirrorChunkOffset > LineEnd) {
+            ThisBuffer->MirrorChunk = NewChunk;
+            ThisBuffer->MirrorChunkOffset -= LineEnd;
+        }
+    }
+
+    YoriLibAppendList(&ThisBuffer->ChunkList, &NewChunk->ListEntry);
+    ThisBuffer->ChunksInMemory++;
+
+    return TRUE;
+}
+
+/**
+ Send any data that has not yet been sent to the mirror handle.  The caller
+ is expected to hold the buffer's mutex.
+
+ @param ThisBuffer Pointer to the buffer.
+
+ @param SpillBuffer Pointer to a buffer to read chunks from the temporary
+        file into.  If this points to NULL, a buffer is allocated, and the
+        caller is expected to free it with YoriLibFree.
+
+ @return TRUE to indicate success, FALSE if data could not be sent.
+ */
+__success(return)
+BOOL
+YoriShSendProcessBufferToMirror(
+    __in PYORI_SH_PROCESS_BUFFER ThisBuffer,
+    __inout PUCHAR * SpillBuffer
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PUCHAR Data;
+    DWORD BytesWritten;
+
+    while (ThisBuffer->MirrorChunk != NULL) {
+
+        if (ThisBuffer->MirrorChunkOffset < ThisBuffer->MirrorChunk->BytesPopulated) {
+            Data = YoriShGetProcessBufferChunkData(ThisBuffer, ThisBuffer->MirrorChunk, SpillBuffer);
+            if (Data == NULL) {
+                return FALSE;
+            }
+
+            if (!WriteFile(ThisBuffer->hMirror,
+                           Data + ThisBuffer->MirrorChunkOffset,
+                           ThisBuffer->MirrorChunk->BytesPopulated - ThisBuffer->MirrorChunkOffset,
+                           &BytesWritten,
+                           NULL) ||
+                BytesWritten == 0) {
+
+                return FALSE;
+            }
+
+            ThisBuffer->MirrorChunkOffset += BytesWritten;
+            ASSERT(ThisBuffer->MirrorChunkOffset <= ThisBuffer->MirrorChunk->BytesPopulated);
+            continue;
+        }
+
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, &ThisBuffer->MirrorChunk->ListEntry);
+        if (ListEntry == NULL) {
+            break;
+        }
+
+        ThisBuffer->MirrorChunk = CONTAINING_RECORD(ListEntry, YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+        ThisBuffer->MirrorChunkOffset = 0;
+    }
+
+    return TRUE;
+}
+
 /**
  Code running on a dedicated thread for the duration of an outstanding process
  to populate data into its pipe.
@@ -184,35 +691,46 @@ YoriShCmdBufferPumpToNextProcess(
     )
 {
     PYORI_SH_PROCESS_BUFFER ThisBuffer = (PYORI_SH_PROCESS_BUFFER)Param;
-    DWORD BytesSent = 0;
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+    PYORI_LIST_ENTRY ListEntry;
+    PUCHAR SpillBuffer = NULL;
+    PUCHAR Data;
+    DWORD ChunkOffset = 0;
     DWORD BytesWritten;
-    DWORD BytesToWrite;
 
-    while (TRUE) {
+    AcquireMutex(ThisBuffer->Mutex);
+    ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, NULL);
+    ReleaseMutex(ThisBuffer->Mutex);
 
-        BytesToWrite = 4096;
-        AcquireMutex(ThisBuffer->Mutex);
-        if (BytesSent + BytesToWrite > ThisBuffer->BytesPopulated) {
-            BytesToWrite = ThisBuffer->BytesPopulated - BytesSent;
-        }
+    while (ListEntry != NULL) {
 
-        if (WriteFile(ThisBuffer->hSource,
-                      YoriLibAddToPointer(ThisBuffer->Buffer, BytesSent),
-                      BytesToWrite,
-                      &BytesWritten,
-                      NULL)) {
+        AcquireMutex(ThisBuffer->Mutex);
+        Chunk = CONTAINING_RECORD(ListEntry, YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+
+        if (ChunkOffset < Chunk->BytesPopulated) {
+            Data = YoriShGetProcessBufferChunkData(ThisBuffer, Chunk, &SpillBuffer);
+            if (Data == NULL ||
+                !WriteFile(ThisBuffer->hSource,
+                           Data + ChunkOffset,
+                           Chunk->BytesPopulated - ChunkOffset,
+                           &BytesWritten,
+                           NULL) ||
+                BytesWritten == 0) {
+
+                ReleaseMutex(ThisBuffer->Mutex);
+                break;
+            }
 
-            BytesSent += BytesWritten;
+            ChunkOffset += BytesWritten;
         } else {
-            ReleaseMutex(ThisBuffer->Mutex);
-            break;
+            ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, ListEntry);
+            ChunkOffset = 0;
         }
         ReleaseMutex(ThisBuffer->Mutex);
+    }
 
-        ASSERT(BytesSent <= ThisBuffer->BytesPopulated);
-        if (BytesSent >= ThisBuffer->BytesPopulated) {
-            break;
-        }
+    if (SpillBuffer != NULL) {
+        YoriLibFree(SpillBuffer);
     }
 
     CloseHandle(ThisBuffer->hSource);
@@ -236,14 +754,25 @@ YoriShCmdBufferPump(
     )
 {
     PYORI_SH_PROCESS_BUFFER ThisBuffer = (PYORI_SH_PROCESS_BUFFER)Param;
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+    PUCHAR SpillBuffer = NULL;
     DWORD BytesRead;
     HANDLE hTemp;
 
     while (ThisBuffer->hSource != NULL) {
 
+        //
+        //  Data is only added to the final chunk, and chunks are only
+        //  added by this thread, so the final chunk can be populated
+        //  without holding the lock.  Readers only look at the populated
+        //  portion.
+        //
+
+        Chunk = CONTAINING_RECORD(YoriLibGetPreviousListEntry(&ThisBuffer->ChunkList, NULL), YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+
         if (ReadFile(ThisBuffer->hSource,
-                     YoriLibAddToPointer(ThisBuffer->Buffer, ThisBuffer->BytesPopulated),
-                     ThisBuffer->BytesAllocated - ThisBuffer->BytesPopulated,
+                     YoriLibAddToPointer(Chunk->Data, Chunk->BytesPopulated),
+                     YORI_SH_PROCESS_BUFFER_CHUNK_SIZE - Chunk->BytesPopulated,
                      &BytesRead,
                      NULL)) {
 
@@ -253,27 +782,14 @@ YoriShCmdBufferPump(
                 break;
             }
 
+            Chunk->BytesPopulated += BytesRead;
             ThisBuffer->BytesPopulated += BytesRead;
-            ASSERT(ThisBuffer->BytesPopulated <= ThisBuffer->BytesAllocated);
-            if (ThisBuffer->BytesPopulated >= ThisBuffer->BytesAllocated) {
-                DWORD NewBytesAllocated;
-                PCHAR NewBuffer;
-
-                if (ThisBuffer->BytesAllocated >= ((DWORD)-1) / 4) {
+            ASSERT(Chunk->BytesPopulated <= YORI_SH_PROCESS_BUFFER_CHUNK_SIZE);
+            if (Chunk->BytesPopulated >= YORI_SH_PROCESS_BUFFER_CHUNK_SIZE) {
+                if (!YoriShCompleteProcessBufferChunk(ThisBuffer, Chunk)) {
                     break;
                 }
-
-                NewBytesAllocated = ThisBuffer->BytesAllocated * 4;
-
-                NewBuffer = YoriLibMalloc(NewBytesAllocated);
-                if (NewBuffer == NULL) {
-                    break;
-                }
-
-                memcpy(NewBuffer, ThisBuffer->Buffer, ThisBuffer->BytesAllocated);
-                YoriLibFree(ThisBuffer->Buffer);
-                ThisBuffer->Buffer = NewBuffer;
-                ThisBuffer->BytesAllocated = NewBytesAllocated;
+                YoriShSpillProcessBuffer(ThisBuffer);
             }
         } else {
             DWORD LastError = GetLastError();
@@ -294,32 +810,13 @@ YoriShCmdBufferPump(
         }
 
         if (ThisBuffer->hMirror != NULL) {
-            while (ThisBuffer->BytesSent < ThisBuffer->BytesPopulated) {
-                DWORD BytesToWrite;
-                DWORD BytesWritten;
-                BytesToWrite = 4096;
-                if (ThisBuffer->BytesSent + BytesToWrite > ThisBuffer->BytesPopulated) {
-                    BytesToWrite = ThisBuffer->BytesPopulated - ThisBuffer->BytesSent;
-                }
-
-                if (WriteFile(ThisBuffer->hMirror,
-                              YoriLibAddToPointer(ThisBuffer->Buffer, ThisBuffer->BytesSent),
-                              BytesToWrite,
-                              &BytesWritten,
-                              NULL)) {
-        
-                    ThisBuffer->BytesSent += BytesWritten;
-                } else {
-                    hTemp = ThisBuffer->hMirror;
-                    ThisBuffer->hMirror = NULL;
-                    CloseHandle(hTemp);
-                    ThisBuffer->BytesSent = 0;
-                    break;
-                }
-
-                ASSERT(ThisBuffer->BytesSent <= ThisBuffer->BytesPopulated);
+            if (!YoriShSendProcessBufferToMirror(ThisBuffer, &SpillBuffer)) {
+                hTemp = ThisBuffer->hMirror;
+                ThisBuffer->hMirror = NULL;
+                CloseHandle(hTemp);
+                ThisBuffer->MirrorChunk = NULL;
+                ThisBuffer->MirrorChunkOffset = 0;
             }
-
         }
         ReleaseMutex(ThisBuffer->Mutex);
     }
@@ -338,9 +835,65 @@ YoriShCmdBufferPump(
 
     ReleaseMutex(ThisBuffer->Mutex);
 
+    if (SpillBuffer != NULL) {
+        YoriLibFree(SpillBuffer);
+    }
+
     return 0;
 }
 
+/**
+ Determine the number of chunks of output from a single stream to hold in
+ memory before older chunks are written to a temporary file.  This is
+ YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT megabytes unless the user has set
+ YORIBUFFERLIMIT to a different number of megabytes.
+
+ @return The number of chunks to hold in memory.
+ */
+DWORD
+YoriShGetProcessBufferChunkLimit()
+{
+    YORI_STRING LimitString;
+    DWORD EnvVarLength;
+    DWORD CharsConsumed;
+    LONGLONG Limit;
+
+    Limit = YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT;
+
+    EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIBUFFERLIMIT"), NULL, 0, NULL);
+    if (EnvVarLength != 0) {
+        if (YoriLibAllocateString(&LimitString, EnvVarLength)) {
+            LimitString.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIBUFFERLIMIT"), LimitString.StartOfString, LimitString.LengthAllocated, NULL);
+            if (LimitString.LengthInChars > 0 &&
+                LimitString.LengthInChars < LimitString.LengthAllocated &&
+                YoriLibStringToNumber(&LimitString, TRUE, &Limit, &CharsConsumed) &&
+                CharsConsumed > 0) {
+
+                if (Limit < 0) {
+                    Limit = 0;
+                } else if (Limit > 1024 * 1024) {
+                    Limit = 1024 * 1024;
+                }
+            } else {
+                Limit = YORI_SH_PROCESS_BUFFER_DEFAULT_LIMIT;
+            }
+            YoriLibFreeStringContents(&LimitString);
+        }
+    }
+
+    Limit = Limit * 1024 * 1024 / YORI_SH_PROCESS_BUFFER_CHUNK_SIZE;
+
+    //
+    //  The chunk being populated is always in memory.
+    //
+
+    if (Limit < 1) {
+        Limit = 1;
+    }
+
+    return (DWORD)Limit;
+}
+
 /**
  Allocate and initialize a buffer for a single input stream.
 
@@ -354,12 +907,20 @@ YoriShAllocateSingleProcessBuffer(
     __out PYORI_SH_PROCESS_BUFFER Buffer
     )
 {
-    Buffer->BytesAllocated = 1024;
-    Buffer->Buffer = YoriLibMalloc(Buffer->BytesAllocated);
-    if (Buffer->Buffer == NULL) {
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+
+    YoriLibInitializeListHead(&Buffer->ChunkList);
+    Buffer->MaximumChunksInMemory = YoriShGetProcessBufferChunkLimit();
+
+    Chunk = YoriShAllocateProcessBufferChunk();
+    if (Chunk == NULL) {
         return FALSE;
     }
 
+    YoriLibAppendList(&Buffer->ChunkList, &Chunk->ListEntry);
+    Buffer->OldestChunkInMemory = Chunk;
+    Buffer->ChunksInMemory = 1;
+
     Buffer->Mutex = CreateMutex(NULL, FALSE, NULL);
     if (Buffer->Mutex == NULL) {
         return FALSE;
@@ -616,31 +1177,74 @@ YoriShGetProcessBuffer(
     __out PYORI_STRING String
     )
 {
+    PYORI_SH_PROCESS_BUFFER_CHUNK Chunk;
+    PYORI_LIST_ENTRY ListEntry;
+    PUCHAR SpillBuffer = NULL;
+    PUCHAR Data;
     DWORD LengthNeeded;
+    BOOL Result;
 
-    if (ThisBuffer->Buffer == NULL) {
+    if (ThisBuffer->Mutex == NULL) {
         return FALSE;
     }
 
     AcquireMutex(ThisBuffer->Mutex);
 
-    LengthNeeded = YoriLibGetMultibyteInputSizeNeeded(ThisBuffer->Buffer, ThisBuffer->BytesPopulated);
-    if (LengthNeeded == 0 && ThisBuffer->BytesPopulated == 0) {
+    if (ThisBuffer->BytesPopulated == 0) {
         ReleaseMutex(ThisBuffer->Mutex);
         YoriLibInitEmptyString(String);
         return TRUE;
     }
 
-    if (!YoriLibAllocateString(String, LengthNeeded)) {
+    //
+    //  Each byte of input generates at most one character, so allocate
+    //  for the number of bytes and convert each chunk in place.  Chunks
+    //  end on line boundaries so no character spans two chunks.
+    //
+
+    if (ThisBuffer->BytesPopulated >= (DWORD)-1 ||
+        !YoriLibAllocateString(String, (DWORD)ThisBuffer->BytesPopulated + 1)) {
+
         ReleaseMutex(ThisBuffer->Mutex);
         return FALSE;
     }
 
-    YoriLibMultibyteInput(ThisBuffer->Buffer, ThisBuffer->BytesPopulated, String->StartOfString, String->LengthAllocated);
-    String->LengthInChars = LengthNeeded;
+    Result = TRUE;
+    ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, NULL);
+    while (ListEntry != NULL) {
+        Chunk = CONTAINING_RECORD(ListEntry, YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, ListEntry);
+
+        if (Chunk->BytesPopulated == 0) {
+            continue;
+        }
+
+        Data = YoriShGetProcessBufferChunkData(ThisBuffer, Chunk, &SpillBuffer);
+        if (Data == NULL) {
+            Result = FALSE;
+            break;
+        }
+
+        LengthNeeded = YoriLibGetMultibyteInputSizeNeeded((LPCSTR)Data, Chunk->BytesPopulated);
+        if (LengthNeeded > String->LengthAllocated - String->LengthInChars) {
+            Result = FALSE;
+            break;
+        }
+
+        YoriLibMultibyteInput((LPCSTR)Data, Chunk->BytesPopulated, &String->StartOfString[String->LengthInChars], String->LengthAllocated - String->LengthInChars);
+        String->LengthInChars += LengthNeeded;
+    }
     ReleaseMutex(ThisBuffer->Mutex);
 
-    return TRUE;
+    if (SpillBuffer != NULL) {
+        YoriLibFree(SpillBuffer);
+    }
+
+    if (!Result) {
+        YoriLibFreeStringContents(String);
+    }
+
+    return Result;
 }
     
 
@@ -869,7 +1473,7 @@ YoriShPipeProcessBuffers(
     //
 
     if (hPipeOutput != NULL) {
-        if (ThisBufferNonOpaque->OutputBuffer.Buffer != NULL) {
+        if (ThisBufferNonOpaque->OutputBuffer.Mutex != NULL) {
             HaveOutput = TRUE;
         } else {
             return FALSE;
@@ -877,7 +1481,7 @@ YoriShPipeProcessBuffers(
     }
 
     if (hPipeErrors != NULL) {
-        if (ThisBufferNonOpaque->ErrorBuffer.Buffer != NULL) {
+        if (ThisBufferNonOpaque->ErrorBuffer.Mutex != NULL) {
             HaveErrors = TRUE;
         } else {
             return FALSE;
@@ -927,12 +1531,16 @@ YoriShPipeProcessBuffers(
 
     if (HaveOutput) {
         ThisBufferNonOpaque->OutputBuffer.hMirror = hPipeOutput;
-        ASSERT(ThisBufferNonOpaque->OutputBuffer.BytesSent == 0);
+        ASSERT(ThisBufferNonOpaque->OutputBuffer.MirrorChunk == NULL);
+        ThisBufferNonOpaque->OutputBuffer.MirrorChunk = CONTAINING_RECORD(YoriLibGetNextListEntry(&ThisBufferNonOpaque->OutputBuffer.ChunkList, NULL), YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+        ThisBufferNonOpaque->OutputBuffer.MirrorChunkOffset = 0;
     }
 
     if (HaveErrors) {
         ThisBufferNonOpaque->ErrorBuffer.hMirror = hPipeErrors;
-        ASSERT(ThisBufferNonOpaque->ErrorBuffer.BytesSent == 0);
+        ASSERT(ThisBufferNonOpaque->ErrorBuffer.MirrorChunk == NULL);
+        ThisBufferNonOpaque->ErrorBuffer.MirrorChunk = CONTAINING_RECORD(YoriLibGetNextListEntry(&ThisBufferNonOpaque->ErrorBuffer.ChunkList, NULL), YORI_SH_PROCESS_BUFFER_CHUNK, ListEntry);
+        ThisBufferNonOpaque->ErrorBuffer.MirrorChunkOffset = 0;
     }
 
     if (HaveOutput) {
@@ -250,7 +250,8 @@ YoriShFindFinalSlashIfSpecified(
  @param Context Pointer to the tab complete context to populate with the new
         match.
 
- @return TRUE to indicate success, FALSE to indicate failure.
+ @return TRUE to indicate success, FALSE to indicate failure or that the
+         search should stop because the matches are no longer needed.
  */
 __success(return)
 BOOL
@@ -265,6 +266,12 @@ YoriShAddExecutableToTabList(
     YORI_STRING PathToReturn;
     YORI_STRING StringToFinalSlash;
 
+    if (ExecTabContext->TabContext->CancelRequested != NULL &&
+        *ExecTabContext->TabContext->CancelRequested) {
+
+        return FALSE;
+    }
+
     YoriLibInitEmptyString(&PathToReturn);
     YoriLibInitEmptyString(&StringToFinalSlash);
 
@@ -324,6 +331,48 @@ YoriShAddExecutableToTabList(
 }
 
 
+/**
+ Determine whether an executable search is for a name beginning with a
+ simple prefix, which can be answered from the index of executables in the
+ PATH.  This requires that the only wildcard is a trailing '*', and that the
+ prefix contains no path or extension.
+
+ @param SearchString The string to search for.
+
+ @param CompareLength The number of characters before the first '*'.
+
+ @return TRUE if the search is for a simple prefix, FALSE if not.
+ */
+BOOL
+YoriShIsExecutablePrefixSearch(
+    __in PYORI_STRING SearchString,
+    __in DWORD CompareLength
+    )
+{
+    DWORD Index;
+    TCHAR Char;
+
+    if (CompareLength + 1 != SearchString->LengthInChars) {
+        return FALSE;
+    }
+
+    for (Index = 0; Index < CompareLength; Index++) {
+        Char = SearchString->StartOfString[Index];
+        if (YoriLibIsSep(Char) ||
+            Char == ':' ||
+            Char == '.' ||
+            Char == '?' ||
+            Char == '<' ||
+            Char == '>' ||
+            Char == '"') {
+
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
 /**
  Populates the list of matches for an executable tab completion.  This
  function searches the path for matching binaries in execution order
@@ -447,15 +496,51 @@ YoriShPerformExecutableTabCompletion(
 
     //
     //  Secondly, search for the object in the PATH, resuming after the
-    //  previous search
+    //  previous search.  If the search is for a simple prefix, look in the
+    //  current directory and then consult the index of executables in the
+    //  PATH, which avoids enumerating every directory in the PATH.  If the
+    //  index isn't available yet, search the PATH directly.
     //
 
     YoriLibInitEmptyString(&FoundExecutable);
-    Result = YoriLibLocateExecutableInPath(&SearchString,
-                                           YoriShAddExecutableToTabList,
-                                           &ExecTabContext,
-                                           &FoundExecutable);
-    ASSERT(FoundExecutable.StartOfString == NULL);
+    if (YoriShIsExecutablePrefixSearch(&SearchString, CompareLength)) {
+        YORI_STRING Prefix;
+        YORI_STRING CurrentDirectorySearch;
+
+        YoriLibInitEmptyString(&Prefix);
+        Prefix.StartOfString = SearchString.StartOfString;
+        Prefix.LengthInChars = CompareLength;
+
+        if (YoriLibAllocateString(&CurrentDirectorySearch, SearchString.LengthInChars + 3)) {
+            CurrentDirectorySearch.LengthInChars = YoriLibSPrintf(CurrentDirectorySearch.StartOfString, _T(".\\%y"), &SearchString);
+            Result = YoriLibLocateExecutableInPath(&CurrentDirectorySearch,
+                                                   YoriShAddExecutableToTabList,
+                                                   &ExecTabContext,
+                                                   &FoundExecutable);
+            ASSERT(FoundExecutable.StartOfString == NULL);
+            YoriLibFreeStringContents(&CurrentDirectorySearch);
+
+            //
+            //  If the index can't answer, search the PATH directly.  This
+            //  searches the current directory again, but any match found
+            //  there is already in the list and is discarded as a duplicate.
+            //
+
+            if (!YoriShExecTrieFindMatches(&Prefix, YoriShAddExecutableToTabList, &ExecTabContext)) {
+                Result = YoriLibLocateExecutableInPath(&SearchString,
+                                                       YoriShAddExecutableToTabList,
+                                                       &ExecTabContext,
+                                                       &FoundExecutable);
+                ASSERT(FoundExecutable.StartOfString == NULL);
+            }
+        }
+    } else {
+        Result = YoriLibLocateExecutableInPath(&SearchString,
+                                               YoriShAddExecutableToTabList,
+                                               &ExecTabContext,
+                                               &FoundExecutable);
+        ASSERT(FoundExecutable.StartOfString == NULL);
+    }
 
     //
     //  Thirdly, search the table of builtins.
@@ -561,6 +646,13 @@ typedef struct _YORI_SH_FILE_COMPLETE_CONTEXT {
      */
     BOOL AbortMatching;
 
+    /**
+     Points to a value which becomes nonzero if the user has pressed a key
+     while matching is in progress, indicating the results will not be used
+     and enumeration should stop as soon as possible.
+     */
+    volatile LONG *CancelRequested;
+
 } YORI_SH_FILE_COMPLETE_CONTEXT, *PYORI_SH_FILE_COMPLETE_CONTEXT;
 
 /**
@@ -722,6 +814,10 @@ YoriShFileTabCompletionCallback(
 
     UNREFERENCED_PARAMETER(Depth);
 
+    if (*FileCompleteContext->CancelRequested) {
+        return FALSE;
+    }
+
     if (FileCompleteContext->ExpandFullPath) {
 
         //
@@ -900,6 +996,10 @@ YoriShFileTabCompletionErrorCallback(
     UNREFERENCED_PARAMETER(FilePath);
     UNREFERENCED_PARAMETER(Depth);
 
+    if (*FileCompleteContext->CancelRequested) {
+        return FALSE;
+    }
+
     if (ErrorCode == ERROR_BAD_NET_NAME ||
         ErrorCode == ERROR_NETNAME_DELETED ||
         ErrorCode == ERROR_NETWORK_ACCESS_DENIED ||
@@ -912,6 +1012,628 @@ YoriShFileTabCompletionErrorCallback(
     return TRUE;
 }
 
+/**
+ The maximum number of directory listings to retain for tab completion.
+ */
+#define YORI_SH_COMPLETE_DIR_CACHE_MAX_ENTRIES 8
+
+/**
+ The number of milliseconds that a directory listing can be reused for tab
+ completion before it is discarded and the directory enumerated again.
+ */
+#define YORI_SH_COMPLETE_DIR_CACHE_LIFETIME 5000
+
+/**
+ A single file within a cached directory listing.  Names are stored in the
+ owning listing's name buffer, so this records offsets rather than pointers.
+ */
+typedef struct _YORI_SH_COMPLETE_CACHED_FILE {
+
+    /**
+     The attributes of the file.
+     */
+    DWORD FileAttributes;
+
+    /**
+     The offset in characters of the long file name within the name buffer.
+     */
+    DWORD LongNameOffset;
+
+    /**
+     The length in characters of the long file name.
+     */
+    DWORD LongNameLength;
+
+    /**
+     The offset in characters of the short file name within the name buffer.
+     */
+    DWORD ShortNameOffset;
+
+    /**
+     The length in characters of the short file name, which may be zero if
+     the file has no short name.
+     */
+    DWORD ShortNameLength;
+} YORI_SH_COMPLETE_CACHED_FILE, *PYORI_SH_COMPLETE_CACHED_FILE;
+
+/**
+ A listing of a single directory that was captured for tab completion and
+ can be reused by a later tab completion or suggestion within the same
+ directory.
+ */
+typedef struct _YORI_SH_COMPLETE_DIR_CACHE_ENTRY {
+
+    /**
+     The list of cached directories, in most recently used order.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The fully qualified path to the directory, without a trailing
+     seperator.
+     */
+    YORI_STRING DirectoryPath;
+
+    /**
+     The tick count when the directory was enumerated.
+     */
+    DWORD TickCaptured;
+
+    /**
+     The last write time of the directory when it was enumerated.  Creating,
+     deleting or renaming a file within the directory updates this, which
+     indicates the listing is stale.
+     */
+    FILETIME LastWriteTime;
+
+    /**
+     The number of files within the Files array.
+     */
+    DWORD FileCount;
+
+    /**
+     The number of elements allocated in the Files array.
+     */
+    DWORD FilesAllocated;
+
+    /**
+     An array of files found in the directory.
+     */
+    PYORI_SH_COMPLETE_CACHED_FILE Files;
+
+    /**
+     A buffer containing the names of all of the files in the directory.
+     */
+    YORI_STRING Names;
+} YORI_SH_COMPLETE_DIR_CACHE_ENTRY, *PYORI_SH_COMPLETE_DIR_CACHE_ENTRY;
+
+/**
+ A list of directory listings retained for tab completion, in most recently
+ used order.
+ */
+YORI_LIST_ENTRY YoriShCompleteDirCacheList;
+
+/**
+ The number of entries in YoriShCompleteDirCacheList.
+ */
+DWORD YoriShCompleteDirCacheCount;
+
+/**
+ Free a cached directory listing.  The entry is expected to have been removed
+ from the list of cached directories.
+
+ @param Entry Pointer to the cached directory listing to free.
+ */
+VOID
+YoriShFreeCompleteDirCacheEntry(
+    __in PYORI_SH_COMPLETE_DIR_CACHE_ENTRY Entry
+    )
+{
+    YoriLibFreeStringContents(&Entry->DirectoryPath);
+    YoriLibFreeStringContents(&Entry->Names);
+    if (Entry->Files != NULL) {
+        YoriLibFree(Entry->Files);
+    }
+    YoriLibFree(Entry);
+}
+
+/**
+ Discard all directory listings retained for tab completion.
+ */
+VOID
+YoriShFreeDirectoryCompletionCache()
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_COMPLETE_DIR_CACHE_ENTRY Entry;
+
+    if (YoriShCompleteDirCacheList.Next == NULL) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&YoriShCompleteDirCacheList, NULL);
+    while (ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, YORI_SH_COMPLETE_DIR_CACHE_ENTRY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&YoriShCompleteDirCacheList, ListEntry);
+        YoriLibRemoveListItem(&Entry->ListEntry);
+        YoriShFreeCompleteDirCacheEntry(Entry);
+    }
+
+    YoriShCompleteDirCacheCount = 0;
+}
+
+/**
+ Query the last write time of a directory, which is used to determine whether
+ a cached listing of the directory is still current.
+
+ @param DirectoryPath Pointer to the fully qualified path to the directory,
+        without a trailing seperator.
+
+ @param LastWriteTime On successful completion, updated to contain the last
+        write time of the directory.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShQueryCompleteDirWriteTime(
+    __in PYORI_STRING DirectoryPath,
+    __out PFILETIME LastWriteTime
+    )
+{
+    YORI_STRING RootPath;
+    LPTSTR PathToOpen;
+    HANDLE hDir;
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+    BOOL Result;
+
+    //
+    //  A drive letter without a trailing seperator refers to the volume
+    //  rather than its root directory, so add the seperator back.
+    //
+
+    YoriLibInitEmptyString(&RootPath);
+    PathToOpen = DirectoryPath->StartOfString;
+    if (DirectoryPath->LengthInChars > 0 &&
+        DirectoryPath->StartOfString[DirectoryPath->LengthInChars - 1] == ':') {
+
+        if (!YoriLibAllocateString(&RootPath, DirectoryPath->LengthInChars + 2)) {
+            return FALSE;
+        }
+        RootPath.LengthInChars = YoriLibSPrintf(RootPath.StartOfString, _T("%y\\"), DirectoryPath);
+        PathToOpen = RootPath.StartOfString;
+    }
+
+    hDir = CreateFile(PathToOpen,
+                      FILE_READ_ATTRIBUTES,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                      NULL,
+                      OPEN_EXISTING,
+                      FILE_FLAG_BACKUP_SEMANTICS,
+                      NULL);
+
+    YoriLibFreeStringContents(&RootPath);
+
+    if (hDir == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    Result = FALSE;
+    if (GetFileInformationByHandle(hDir, &FileInfo) &&
+        (FileInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+
+        LastWriteTime->dwLowDateTime = FileInfo.ftLastWriteTime.dwLowDateTime;
+        LastWriteTime->dwHighDateTime = FileInfo.ftLastWriteTime.dwHighDateTime;
+        Result = TRUE;
+    }
+
+    CloseHandle(hDir);
+    return Result;
+}
+
+/**
+ Add a file found by directory enumeration to a cached directory listing.
+
+ @param Entry Pointer to the cached directory listing to add the file to.
+
+ @param FindData Pointer to the information returned by directory
+        enumeration describing the file.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShAddFileToCompleteDirCacheEntry(
+    __inout PYORI_SH_COMPLETE_DIR_CACHE_ENTRY Entry,
+    __in PWIN32_FIND_DATA FindData
+    )
+{
+    PYORI_SH_COMPLETE_CACHED_FILE NewFiles;
+    PYORI_SH_COMPLETE_CACHED_FILE File;
+    DWORD NewAllocated;
+    DWORD LongNameLength;
+    DWORD ShortNameLength;
+
+    if (Entry->FileCount == Entry->FilesAllocated) {
+        NewAllocated = Entry->FilesAllocated * 2;
+        if (NewAllocated == 0) {
+            NewAllocated = 256;
+        }
+        NewFiles = YoriLibMalloc(NewAllocated * sizeof(YORI_SH_COMPLETE_CACHED_FILE));
+        if (NewFiles == NULL) {
+            return FALSE;
+        }
+        if (Entry->Files != NULL) {
+            memcpy(NewFiles, Entry->Files, Entry->FileCount * sizeof(YORI_SH_COMPLETE_CACHED_FILE));
+            YoriLibFree(Entry->Files);
+        }
+        Entry->Files = NewFiles;
+        Entry->FilesAllocated = NewAllocated;
+    }
+
+    LongNameLength = _tcslen(FindData->cFileName);
+    ShortNameLength = _tcslen(FindData->cAlternateFileName);
+
+    if (Entry->Names.LengthInChars + LongNameLength + ShortNameLength > Entry->Names.LengthAllocated) {
+        NewAllocated = Entry->Names.LengthAllocated * 2;
+        if (NewAllocated < Entry->Names.LengthInChars + LongNameLength + ShortNameLength) {
+            NewAllocated = Entry->Names.LengthInChars + LongNameLength + ShortNameLength + 16 * 1024;
+        }
+        if (!YoriLibReallocateString(&Entry->Names, NewAllocated)) {
+            return FALSE;
+        }
+    }
+
+    File = &Entry->Files[Entry->FileCount];
+    File->FileAttributes = FindData->dwFileAttributes;
+
+    File->LongNameOffset = Entry->Names.LengthInChars;
+    File->LongNameLength = LongNameLength;
+    memcpy(&Entry->Names.StartOfString[Entry->Names.LengthInChars], FindData->cFileName, LongNameLength * sizeof(TCHAR));
+    Entry->Names.LengthInChars += LongNameLength;
+
+    File->ShortNameOffset = Entry->Names.LengthInChars;
+    File->ShortNameLength = ShortNameLength;
+    memcpy(&Entry->Names.StartOfString[Entry->Names.LengthInChars], FindData->cAlternateFileName, ShortNameLength * sizeof(TCHAR));
+    Entry->Names.LengthInChars += ShortNameLength;
+
+    Entry->FileCount++;
+    return TRUE;
+}
+
+/**
+ Enumerate a directory and capture the result as a directory listing that
+ can be reused by later tab completion operations.
+
+ @param DirectoryPath Pointer to the fully qualified path to the directory,
+        without a trailing seperator.
+
+ @param LastWriteTime Pointer to the last write time of the directory, which
+        is recorded in the listing to detect later changes.
+
+ @param CancelRequested Points to a value which becomes nonzero if the
+        enumeration should be abandoned.
+
+ @return Pointer to the newly allocated directory listing, or NULL on
+         failure or if the enumeration was cancelled.
+ */
+PYORI_SH_COMPLETE_DIR_CACHE_ENTRY
+YoriShCaptureCompleteDirCacheEntry(
+    __in PYORI_STRING DirectoryPath,
+    __in PFILETIME LastWriteTime,
+    __in volatile LONG *CancelRequested
+    )
+{
+    PYORI_SH_COMPLETE_DIR_CACHE_ENTRY Entry;
+    WIN32_FIND_DATA FindData;
+    HANDLE hFind;
+    BOOL Result;
+
+    Entry = YoriLibMalloc(sizeof(YORI_SH_COMPLETE_DIR_CACHE_ENTRY));
+    if (Entry == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Entry, sizeof(YORI_SH_COMPLETE_DIR_CACHE_ENTRY));
+    YoriLibInitEmptyString(&Entry->DirectoryPath);
+    YoriLibInitEmptyString(&Entry->Names);
+    Entry->LastWriteTime.dwLowDateTime = LastWriteTime->dwLowDateTime;
+    Entry->LastWriteTime.dwHighDateTime = LastWriteTime->dwHighDateTime;
+
+    //
+    //  Build the search criteria in the same allocation as the directory
+    //  name, then truncate it back to the directory name.
+    //
+
+    if (!YoriLibAllocateString(&Entry->DirectoryPath, DirectoryPath->LengthInChars + 3)) {
+        YoriShFreeCompleteDirCacheEntry(Entry);
+        return NULL;
+    }
+
+    YoriLibSPrintf(Entry->DirectoryPath.StartOfString, _T("%y\\*"), DirectoryPath);
+
+    hFind = FindFirstFile(Entry->DirectoryPath.StartOfString, &FindData);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        YoriShFreeCompleteDirCacheEntry(Entry);
+        return NULL;
+    }
+
+    Entry->DirectoryPath.LengthInChars = DirectoryPath->LengthInChars;
+    Entry->DirectoryPath.StartOfString[Entry->DirectoryPath.LengthInChars] = '\0';
+
+    Result = TRUE;
+    do {
+        if (*CancelRequested) {
+            Result = FALSE;
+            break;
+        }
+
+        if (_tcscmp(FindData.cFileName, _T(".")) != 0 &&
+            _tcscmp(FindData.cFileName, _T("..")) != 0) {
+
+            if (!YoriShAddFileToCompleteDirCacheEntry(Entry, &FindData)) {
+                Result = FALSE;
+                break;
+            }
+        }
+    } while (FindNextFile(hFind, &FindData));
+
+    if (Result && GetLastError() != ERROR_NO_MORE_FILES) {
+        Result = FALSE;
+    }
+
+    FindClose(hFind);
+
+    if (!Result) {
+        YoriShFreeCompleteDirCacheEntry(Entry);
+        return NULL;
+    }
+
+    return Entry;
+}
+
+/**
+ Find a current listing for a directory, enumerating the directory if no
+ listing exists or the existing listing is stale.  The returned listing is
+ moved to the front of the list of cached directories, and if the number of
+ cached directories exceeds the limit, the least recently used listing is
+ discarded.
+
+ @param DirectoryPath Pointer to the fully qualified path to the directory,
+        without a trailing seperator.
+
+ @param CancelRequested Points to a value which becomes nonzero if the
+        enumeration should be abandoned.
+
+ @return Pointer to the directory listing, or NULL if the directory could
+         not be enumerated.  The listing remains owned by the cache.
+ */
+PYORI_SH_COMPLETE_DIR_CACHE_ENTRY
+YoriShLookupCompleteDirCacheEntry(
+    __in PYORI_STRING DirectoryPath,
+    __in volatile LONG *CancelRequested
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_COMPLETE_DIR_CACHE_ENTRY Entry;
+    FILETIME LastWriteTime;
+    DWORD Now;
+
+    if (YoriShCompleteDirCacheList.Next == NULL) {
+        YoriLibInitializeListHead(&YoriShCompleteDirCacheList);
+    }
+
+    if (!YoriShQueryCompleteDirWriteTime(DirectoryPath, &LastWriteTime)) {
+        return NULL;
+    }
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    Now = GetTickCount();
+
+    ListEntry = YoriLibGetNextListEntry(&YoriShCompleteDirCacheList, NULL);
+    while (ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, YORI_SH_COMPLETE_DIR_CACHE_ENTRY, ListEntry);
+        if (YoriLibCompareStringInsensitive(&Entry->DirectoryPath, DirectoryPath) == 0) {
+            YoriLibRemoveListItem(&Entry->ListEntry);
+            YoriShCompleteDirCacheCount--;
+
+            if (Now - Entry->TickCaptured < YORI_SH_COMPLETE_DIR_CACHE_LIFETIME &&
+                Entry->LastWriteTime.dwLowDateTime == LastWriteTime.dwLowDateTime &&
+                Entry->LastWriteTime.dwHighDateTime == LastWriteTime.dwHighDateTime) {
+
+                YoriLibInsertList(&YoriShCompleteDirCacheList, &Entry->ListEntry);
+                YoriShCompleteDirCacheCount++;
+                return Entry;
+            }
+
+            YoriShFreeCompleteDirCacheEntry(Entry);
+            break;
+        }
+        ListEntry = YoriLibGetNextListEntry(&YoriShCompleteDirCacheList, ListEntry);
+    }
+
+    Entry = YoriShCaptureCompleteDirCacheEntry(DirectoryPath, &LastWriteTime, CancelRequested);
+    if (Entry == NULL) {
+        return NULL;
+    }
+
+    Entry->TickCaptured = Now;
+    YoriLibInsertList(&YoriShCompleteDirCacheList, &Entry->ListEntry);
+    YoriShCompleteDirCacheCount++;
+
+    while (YoriShCompleteDirCacheCount > YORI_SH_COMPLETE_DIR_CACHE_MAX_ENTRIES) {
+        ListEntry = YoriLibGetPreviousListEntry(&YoriShCompleteDirCacheList, NULL);
+        ASSERT(ListEntry != NULL && ListEntry != &Entry->ListEntry);
+        YoriLibRemoveListItem(ListEntry);
+        YoriShFreeCompleteDirCacheEntry(CONTAINING_RECORD(ListEntry, YORI_SH_COMPLETE_DIR_CACHE_ENTRY, ListEntry));
+        YoriShCompleteDirCacheCount--;
+    }
+
+    return Entry;
+}
+
+/**
+ Enumerate files matching a tab completion search string and invoke the file
+ tab completion callback for each.  Where the search string refers to a
+ single directory with a simple wildcard, matches are found from a cached
+ listing of the directory so that repeated tab completions and suggestions
+ do not need to enumerate it again.  Anything more complex, including
+ streams, {} and [] operators, and wildcards within directory components,
+ is handled by a regular enumeration.
+
+ @param SearchString The string to search for.
+
+ @param MatchFlags The flags to match against when enumerating streams.
+
+ @param EnumContext Pointer to a context structure used when enumerating
+        files and streams for the purpose of tab completion.
+
+ @return TRUE to indicate success, FALSE to indicate failure or that
+         enumeration was terminated by the callback.
+ */
+BOOL
+YoriShForEachFileForCompletion(
+    __in PYORI_STRING SearchString,
+    __in DWORD MatchFlags,
+    __in PYORI_SH_FILE_COMPLETE_CONTEXT EnumContext
+    )
+{
+    PYORI_SH_COMPLETE_DIR_CACHE_ENTRY Entry;
+    PYORI_SH_COMPLETE_CACHED_FILE File;
+    YORI_STRING DirectoryPart;
+    YORI_STRING FullDirectory;
+    YORI_STRING FileSpec;
+    YORI_STRING LongName;
+    YORI_STRING ShortName;
+    YORI_STRING FullPath;
+    WIN32_FIND_DATA FindData;
+    DWORD CharsToFinalSlash;
+    DWORD Index;
+    TCHAR Char;
+    BOOL UseCache;
+    BOOL Result;
+
+    CharsToFinalSlash = YoriShFindFinalSlashIfSpecified(SearchString);
+
+    YoriLibInitEmptyString(&FileSpec);
+    FileSpec.StartOfString = &SearchString->StartOfString[CharsToFinalSlash];
+    FileSpec.LengthInChars = SearchString->LengthInChars - CharsToFinalSlash;
+
+    UseCache = TRUE;
+    if (FileSpec.LengthInChars == 0) {
+        UseCache = FALSE;
+    }
+
+    //
+    //  A leading ~ without a seperator may refer to a special directory,
+    //  which the regular enumeration knows how to expand.
+    //
+
+    if (CharsToFinalSlash == 0 && FileSpec.StartOfString[0] == '~') {
+        UseCache = FALSE;
+    }
+
+    for (Index = 0; UseCache && Index < SearchString->LengthInChars; Index++) {
+        Char = SearchString->StartOfString[Index];
+        if (Char == '{' || Char == '[') {
+            UseCache = FALSE;
+        } else if (Index < CharsToFinalSlash) {
+            if (Char == '*' || Char == '?') {
+                UseCache = FALSE;
+            }
+        } else if (Char == ':' || Char == '<' || Char == '>' || Char == '"') {
+            UseCache = FALSE;
+        }
+    }
+
+    Entry = NULL;
+    if (UseCache) {
+        YoriLibInitEmptyString(&DirectoryPart);
+        if (CharsToFinalSlash == 0) {
+            YoriLibConstantString(&DirectoryPart, _T("."));
+        } else {
+            DirectoryPart.StartOfString = SearchString->StartOfString;
+            DirectoryPart.LengthInChars = CharsToFinalSlash;
+        }
+
+        YoriLibInitEmptyString(&FullDirectory);
+        if (YoriLibUserStringToSingleFilePath(&DirectoryPart, TRUE, &FullDirectory)) {
+            while (FullDirectory.LengthInChars > 0 &&
+                   YoriLibIsSep(FullDirectory.StartOfString[FullDirectory.LengthInChars - 1])) {
+
+                FullDirectory.LengthInChars--;
+            }
+            FullDirectory.StartOfString[FullDirectory.LengthInChars] = '\0';
+
+            Entry = YoriShLookupCompleteDirCacheEntry(&FullDirectory, EnumContext->CancelRequested);
+            YoriLibFreeStringContents(&FullDirectory);
+        }
+    }
+
+    if (*EnumContext->CancelRequested) {
+        return FALSE;
+    }
+
+    if (Entry == NULL) {
+        return YoriLibForEachStream(SearchString, MatchFlags, 0, YoriShFileTabCompletionCallback, YoriShFileTabCompletionErrorCallback, EnumContext);
+    }
+
+    if (!YoriLibAllocateString(&FullPath, Entry->DirectoryPath.LengthInChars + 1 + MAX_PATH + 1)) {
+        return FALSE;
+    }
+
+    ZeroMemory(&FindData, sizeof(FindData));
+    YoriLibInitEmptyString(&LongName);
+    YoriLibInitEmptyString(&ShortName);
+    Result = TRUE;
+
+    for (Index = 0; Index < Entry->FileCount; Index++) {
+        File = &Entry->Files[Index];
+
+        if ((File->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+            if ((MatchFlags & YORILIB_FILEENUM_RETURN_DIRECTORIES) == 0) {
+                continue;
+            }
+        } else if ((MatchFlags & YORILIB_FILEENUM_RETURN_FILES) == 0) {
+            continue;
+        }
+
+        LongName.StartOfString = &Entry->Names.StartOfString[File->LongNameOffset];
+        LongName.LengthInChars = File->LongNameLength;
+        ShortName.StartOfString = &Entry->Names.StartOfString[File->ShortNameOffset];
+        ShortName.LengthInChars = File->ShortNameLength;
+
+        if (!YoriLibDoesFileMatchExpression(&LongName, &FileSpec) &&
+            (ShortName.LengthInChars == 0 || !YoriLibDoesFileMatchExpression(&ShortName, &FileSpec))) {
+
+            continue;
+        }
+
+        //
+        //  Present the entry to the callback the same way directory
+        //  enumeration would.
+        //
+
+        FindData.dwFileAttributes = File->FileAttributes;
+        memcpy(FindData.cFileName, LongName.StartOfString, LongName.LengthInChars * sizeof(TCHAR));
+        FindData.cFileName[LongName.LengthInChars] = '\0';
+        memcpy(FindData.cAlternateFileName, ShortName.StartOfString, ShortName.LengthInChars * sizeof(TCHAR));
+        FindData.cAlternateFileName[ShortName.LengthInChars] = '\0';
+
+        FullPath.LengthInChars = YoriLibSPrintfS(FullPath.StartOfString, FullPath.LengthAllocated, _T("%y\\%y"), &Entry->DirectoryPath, &LongName);
+
+        if (!YoriShFileTabCompletionCallback(&FullPath, &FindData, 0, EnumContext)) {
+            Result = FALSE;
+            break;
+        }
+    }
+
+    YoriLibFreeStringContents(&FullPath);
+    return Result;
+}
+
 /**
  A structure describing a string which when encountered in a string used for
  file tab completion may indicate the existence of a file.
@@ -995,7 +1717,7 @@ YoriShFindMatchingStreamsForStringOrCursorPosition(
     //
 
     EnumContext->SearchString = SearchString->StartOfString;
-    if (!YoriLibForEachStream(SearchString, MatchFlags, 0, YoriShFileTabCompletionCallback, YoriShFileTabCompletionErrorCallback, EnumContext)) {
+    if (!YoriShForEachFileForCompletion(SearchString, MatchFlags, EnumContext)) {
         return;
     }
 
@@ -1047,8 +1769,8 @@ YoriShFindMatchingStreamsForStringOrCursorPosition(
         FileMidpointSearchString.LengthInChars = Index + 1;
 
         EnumContext->SearchString = FileMidpointSearchString.StartOfString;
-        YoriLibForEachStream(&FileMidpointSearchString, MatchFlags, 0, YoriShFileTabCompletionCallback, YoriShFileTabCompletionErrorCallback, EnumContext);
-        if (EnumContext->AbortMatching) {
+        YoriShForEachFileForCompletion(&FileMidpointSearchString, MatchFlags, EnumContext);
+        if (EnumContext->AbortMatching || *EnumContext->CancelRequested) {
             YoriLibFreeStringContents(&FileMidpointSearchString);
             EnumContext->SearchString = SearchString->StartOfString;
             return;
@@ -1091,7 +1813,7 @@ YoriShFindMatchingStreamsForStringOrCursorPosition(
         EnumContext->CharsToFinalSlash = YoriShFindFinalSlashIfSpecified(&FileMidpointSearchString);
         EnumContext->SearchString = FileMidpointSearchString.StartOfString;
 
-        YoriLibForEachStream(&FileMidpointSearchString, YORILIB_FILEENUM_RETURN_DIRECTORIES, 0, YoriShFileTabCompletionCallback, YoriShFileTabCompletionErrorCallback, EnumContext);
+        YoriShForEachFileForCompletion(&FileMidpointSearchString, YORILIB_FILEENUM_RETURN_DIRECTORIES, EnumContext);
 
         YoriLibInitEmptyString(&EnumContext->Suffix);
         YoriLibFreeStringContents(&FileMidpointSearchString);
@@ -1100,38 +1822,59 @@ YoriShFindMatchingStreamsForStringOrCursorPosition(
 }
 
 /**
- Populates the list of matches for a file based tab completion.  This
- function searches the path for matching files in lexicographic order
- and populates the list with the result.
+ A request to populate the list of matches for a file based tab completion,
+ which may be processed by a background thread.
+ */
+typedef struct _YORI_SH_FILE_COMPLETE_REQUEST {
 
- @param TabContext Pointer to the tab completion context.  This provides
-        the search criteria and has its match list populated with results
-        on success.
+    /**
+     The tab completion context to populate with any matches.
+     */
+    PYORI_SH_TAB_COMPLETE_CONTEXT TabContext;
 
- @param ExpandFullPath Specifies if full path expansion should be performed.
+    /**
+     Specifies if full path expansion should be performed.
+     */
+    BOOL ExpandFullPath;
 
- @param IncludeDirectories TRUE if directories should be included in results,
-        FALSE if they should be ommitted.
+    /**
+     TRUE if directories should be included in results.
+     */
+    BOOL IncludeDirectories;
 
- @param IncludeFiles TRUE if files should be included in results, FALSE if
-        they should be ommitted (used for directory only results.)
+    /**
+     TRUE if files should be included in results.
+     */
+    BOOL IncludeFiles;
 
- @param KeepCompletionsSorted TRUE to keep the list of completion options
-        sorted.  This is generally useful for file completion, and matches
-        what CMD does.  It's FALSE if file completions are being added after
-        executable completion, so the goal is to preserve the executable
-        completion items first.
+    /**
+     TRUE to keep the list of completion options sorted.
+     */
+    BOOL KeepCompletionsSorted;
 
+    /**
+     Set to nonzero by the input thread if a key is pressed while matching
+     is in progress.  The background thread stops as soon as it observes
+     this, and any matches found so far are discarded.
+     */
+    volatile LONG CancelRequested;
+
+} YORI_SH_FILE_COMPLETE_REQUEST, *PYORI_SH_FILE_COMPLETE_REQUEST;
+
+/**
+ Populates the list of matches for a file based tab completion.  This
+ function searches the path for matching files in lexicographic order
+ and populates the list with the result.
+
+ @param Request Pointer to the request describing the tab completion context
+        to populate and the types of matches to find.
  */
 VOID
-YoriShPerformFileTabCompletion(
-    __inout PYORI_SH_TAB_COMPLETE_CONTEXT TabContext,
-    __in BOOL ExpandFullPath,
-    __in BOOL IncludeDirectories,
-    __in BOOL IncludeFiles,
-    __in BOOL KeepCompletionsSorted
+YoriShFindFileTabCompletionMatches(
+    __inout PYORI_SH_FILE_COMPLETE_REQUEST Request
     )
 {
+    PYORI_SH_TAB_COMPLETE_CONTEXT TabContext = Request->TabContext;
     YORI_SH_FILE_COMPLETE_CONTEXT EnumContext;
     YORI_STRING SearchString;
     DWORD PrefixLen;
@@ -1163,23 +1906,27 @@ YoriShPerformFileTabCompletion(
 
     YoriLibInitEmptyString(&EnumContext.Prefix);
     YoriLibInitEmptyString(&EnumContext.Suffix);
-    EnumContext.KeepCompletionsSorted = KeepCompletionsSorted;
+    EnumContext.KeepCompletionsSorted = Request->KeepCompletionsSorted;
 
-    EnumContext.ExpandFullPath = ExpandFullPath;
+    EnumContext.ExpandFullPath = Request->ExpandFullPath;
     EnumContext.CharsToFinalSlash = YoriShFindFinalSlashIfSpecified(&SearchString);
     EnumContext.SearchString = SearchString.StartOfString;
     EnumContext.TabContext = TabContext;
     EnumContext.FilesFound = 0;
     EnumContext.AbortMatching = FALSE;
+    EnumContext.CancelRequested = &Request->CancelRequested;
+    if (TabContext->CancelRequested != NULL) {
+        EnumContext.CancelRequested = TabContext->CancelRequested;
+    }
 
     //
     //  Set flags indicating what to find
     //
 
-    if (IncludeFiles) {
+    if (Request->IncludeFiles) {
         MatchFlags |= YORILIB_FILEENUM_RETURN_FILES;
     }
-    if (IncludeDirectories) {
+    if (Request->IncludeDirectories) {
         MatchFlags |= YORILIB_FILEENUM_RETURN_DIRECTORIES;
     }
 
@@ -1222,7 +1969,10 @@ YoriShPerformFileTabCompletion(
     //  file name but it's prefixed with some other string.
     //
 
-    if (EnumContext.FilesFound == 0 && !EnumContext.AbortMatching) {
+    if (EnumContext.FilesFound == 0 &&
+        !EnumContext.AbortMatching &&
+        !*EnumContext.CancelRequested) {
+
         DWORD MatchCount = sizeof(YoriShTabHeuristicMatches)/sizeof(YoriShTabHeuristicMatches[0]);
         DWORD MismatchCount = sizeof(YoriShTabHeuristicMismatches)/sizeof(YoriShTabHeuristicMismatches[0]);
         DWORD AllocCount;
@@ -1302,39 +2052,239 @@ YoriShPerformFileTabCompletion(
         //  If the file would begin beyond the end of the string, stop.
         //
 
-        if (YoriShTabHeuristicMatches[Index].CharsToSkip > 0 &&
-            StringOffsetOfMatch + (DWORD)YoriShTabHeuristicMatches[Index].CharsToSkip >= SearchString.LengthInChars) {
+        if (YoriShTabHeuristicMatches[Index].CharsToSkip > 0 &&
+            StringOffsetOfMatch + (DWORD)YoriShTabHeuristicMatches[Index].CharsToSkip >= SearchString.LengthInChars) {
+
+            YoriLibFree(MatchArray);
+            YoriLibFreeStringContents(&SearchString);
+            return;
+        }
+
+        //
+        //  Seperate the string between the file portion (that we're looking
+        //  for) and a prefix to append to any match.
+        //
+
+        EnumContext.Prefix.StartOfString = SearchString.StartOfString;
+        EnumContext.Prefix.LengthInChars = StringOffsetOfMatch + YoriShTabHeuristicMatches[Index].CharsToSkip;
+
+        SearchString.StartOfString += EnumContext.Prefix.LengthInChars;
+        SearchString.LengthInChars -= EnumContext.Prefix.LengthInChars;
+
+        EnumContext.CharsToFinalSlash = YoriShFindFinalSlashIfSpecified(&SearchString);
+        EnumContext.SearchString = SearchString.StartOfString;
+        if (SearchStringOffset > EnumContext.Prefix.LengthInChars) {
+            SearchStringOffset -= EnumContext.Prefix.LengthInChars;
+        } else {
+            SearchStringOffset = 0;
+        }
+
+        YoriShFindMatchingStreamsForStringOrCursorPosition(TabContext, &SearchString, MatchFlags, SearchStringOffset, &EnumContext);
+
+        YoriLibFree(MatchArray);
+    }
+    YoriLibFreeStringContents(&SearchString);
+    return;
+}
+
+/**
+ The entrypoint for a background thread which populates the list of matches
+ for a file based tab completion.
+
+ @param Context Pointer to the file tab completion request.
+
+ @return Thread exit code, which is always zero.
+ */
+DWORD WINAPI
+YoriShFileTabCompletionWorker(
+    __in LPVOID Context
+    )
+{
+    YoriShFindFileTabCompletionMatches((PYORI_SH_FILE_COMPLETE_REQUEST)Context);
+    return 0;
+}
+
+/**
+ Check whether the console input queue contains a key press which should
+ interrupt a tab completion in progress.  Events other than key presses, as
+ well as presses of modifier keys on their own, are not considered.  The
+ input is not removed from the queue, so it is processed by the regular
+ input loop once tab completion returns.
+
+ @param InputHandle Handle to the console input.
+
+ @return TRUE if a key press is waiting to be processed, FALSE if not.
+ */
+BOOL
+YoriShIsKeyPressPending(
+    __in HANDLE InputHandle
+    )
+{
+    INPUT_RECORD InputRecords[16];
+    PKEY_EVENT_RECORD KeyEvent;
+    DWORD RecordsRead;
+    DWORD Index;
+
+    if (!PeekConsoleInput(InputHandle, InputRecords, sizeof(InputRecords)/sizeof(InputRecords[0]), &RecordsRead)) {
+        return FALSE;
+    }
+
+    for (Index = 0; Index < RecordsRead; Index++) {
+        if (InputRecords[Index].EventType != KEY_EVENT) {
+            continue;
+        }
+
+        KeyEvent = &InputRecords[Index].Event.KeyEvent;
+        if (!KeyEvent->bKeyDown) {
+            continue;
+        }
+
+        if (KeyEvent->wVirtualKeyCode == VK_SHIFT ||
+            KeyEvent->wVirtualKeyCode == VK_CONTROL ||
+            KeyEvent->wVirtualKeyCode == VK_MENU) {
+
+            continue;
+        }
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ Populates the list of matches for a file based tab completion.  This
+ function searches the path for matching files in lexicographic order
+ and populates the list with the result.
+
+ When input is arriving from a console, the search is performed on a
+ background thread so that the input thread can observe key presses.  If
+ the user presses a key before the search completes, the search is
+ abandoned and the matches found so far are discarded, so that the key can
+ be processed without waiting for a slow directory enumeration.  The tab
+ context is marked such that a later tab completion will search again.
+
+ If the tab context is already being populated on a background thread, the
+ search is performed on that thread, and is abandoned when that thread's
+ request is cancelled.
+
+ @param TabContext Pointer to the tab completion context.  This provides
+        the search criteria and has its match list populated with results
+        on success.
+
+ @param ExpandFullPath Specifies if full path expansion should be performed.
+
+ @param IncludeDirectories TRUE if directories should be included in results,
+        FALSE if they should be ommitted.
+
+ @param IncludeFiles TRUE if files should be included in results, FALSE if
+        they should be ommitted (used for directory only results.)
+
+ @param KeepCompletionsSorted TRUE to keep the list of completion options
+        sorted.  This is generally useful for file completion, and matches
+        what CMD does.  It's FALSE if file completions are being added after
+        executable completion, so the goal is to preserve the executable
+        completion items first.
+
+ */
+VOID
+YoriShPerformFileTabCompletion(
+    __inout PYORI_SH_TAB_COMPLETE_CONTEXT TabContext,
+    __in BOOL ExpandFullPath,
+    __in BOOL IncludeDirectories,
+    __in BOOL IncludeFiles,
+    __in BOOL KeepCompletionsSorted
+    )
+{
+    YORI_SH_FILE_COMPLETE_REQUEST Request;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_TAB_COMPLETE_MATCH Match;
+    HANDLE WaitHandles[2];
+    HANDLE hThread;
+    DWORD ThreadId;
+    DWORD ConsoleMode;
+    DWORD Err;
+
+    Request.TabContext = TabContext;
+    Request.ExpandFullPath = ExpandFullPath;
+    Request.IncludeDirectories = IncludeDirectories;
+    Request.IncludeFiles = IncludeFiles;
+    Request.KeepCompletionsSorted = KeepCompletionsSorted;
+    Request.CancelRequested = FALSE;
+
+    //
+    //  If this is already a background thread, the caller is responsible
+    //  for watching for input.
+    //
+
+    if (TabContext->CancelRequested != NULL) {
+        YoriShFindFileTabCompletionMatches(&Request);
+        return;
+    }
 
-            YoriLibFree(MatchArray);
-            YoriLibFreeStringContents(&SearchString);
-            return;
-        }
+    //
+    //  If input is not from a console there's no way for the search to be
+    //  interrupted, so just perform it on this thread.
+    //
 
-        //
-        //  Seperate the string between the file portion (that we're looking
-        //  for) and a prefix to append to any match.
-        //
+    WaitHandles[1] = GetStdHandle(STD_INPUT_HANDLE);
+    if (!GetConsoleMode(WaitHandles[1], &ConsoleMode)) {
+        YoriShFindFileTabCompletionMatches(&Request);
+        return;
+    }
 
-        EnumContext.Prefix.StartOfString = SearchString.StartOfString;
-        EnumContext.Prefix.LengthInChars = StringOffsetOfMatch + YoriShTabHeuristicMatches[Index].CharsToSkip;
+    hThread = CreateThread(NULL, 0, YoriShFileTabCompletionWorker, &Request, 0, &ThreadId);
+    if (hThread == NULL) {
+        YoriShFindFileTabCompletionMatches(&Request);
+        return;
+    }
 
-        SearchString.StartOfString += EnumContext.Prefix.LengthInChars;
-        SearchString.LengthInChars -= EnumContext.Prefix.LengthInChars;
+    //
+    //  Wait for either the search to complete or input to arrive.  Input
+    //  which is not a key press, such as mouse movement or focus changes,
+    //  stays in the queue and keeps the console handle signalled, so when
+    //  only that type of input is present, poll for the search to complete.
+    //
 
-        EnumContext.CharsToFinalSlash = YoriShFindFinalSlashIfSpecified(&SearchString);
-        EnumContext.SearchString = SearchString.StartOfString;
-        if (SearchStringOffset > EnumContext.Prefix.LengthInChars) {
-            SearchStringOffset -= EnumContext.Prefix.LengthInChars;
+    WaitHandles[0] = hThread;
+    while (TRUE) {
+        Err = WaitForMultipleObjects(2, WaitHandles, FALSE, INFINITE);
+        if (Err == WAIT_OBJECT_0) {
+            break;
+        }
+
+        if (Err == WAIT_OBJECT_0 + 1) {
+            if (YoriShIsKeyPressPending(WaitHandles[1])) {
+                InterlockedExchange(&Request.CancelRequested, TRUE);
+                WaitForSingleObject(hThread, INFINITE);
+                break;
+            }
+            if (WaitForSingleObject(hThread, 50) == WAIT_OBJECT_0) {
+                break;
+            }
         } else {
-            SearchStringOffset = 0;
+            WaitForSingleObject(hThread, INFINITE);
+            break;
         }
+    }
 
-        YoriShFindMatchingStreamsForStringOrCursorPosition(TabContext, &SearchString, MatchFlags, SearchStringOffset, &EnumContext);
+    CloseHandle(hThread);
 
-        YoriLibFree(MatchArray);
+    //
+    //  If the search was abandoned, the matches are incomplete and should
+    //  not be displayed.  Discard them and indicate the next tab needs to
+    //  search again.
+    //
+
+    if (Request.CancelRequested) {
+        ListEntry = YoriLibGetNextListEntry(&TabContext->MatchList, NULL);
+        while (ListEntry != NULL) {
+            Match = CONTAINING_RECORD(ListEntry, YORI_SH_TAB_COMPLETE_MATCH, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&TabContext->MatchList, ListEntry);
+            YoriShRemoveMatchFromTabContext(TabContext, Match);
+        }
+        TabContext->PotentialNonPrefixMatch = TRUE;
     }
-    YoriLibFreeStringContents(&SearchString);
-    return;
 }
 
 /**
@@ -1633,6 +2583,19 @@ YoriShResolveTabCompletionActionForExecutable(
         return TRUE;
     }
 
+    //
+    //  The script runs as a child process attached to the console, which
+    //  can't happen on a background thread while the input thread is using
+    //  the console.  Indicate that the matches need to be populated on the
+    //  input thread.
+    //
+
+    if (TabContext->CancelRequested != NULL) {
+        YoriLibFreeStringContents(&FoundCompletionScript);
+        TabContext->ForegroundRequired = TRUE;
+        return FALSE;
+    }
+
     //
     //  If there is one, create an expression and invoke the script.
     //
@@ -2287,6 +3250,13 @@ YoriShTabCompletion(
     YORI_STRING SuffixAfterBackquoteSubstring;
     BOOLEAN ListAll;
 
+    //
+    //  Any suggestion being generated in the background is now unwanted,
+    //  and must finish before the file and executable caches are used here.
+    //
+
+    YoriShWaitForSuggestion(Buffer);
+
     if (Buffer->String.LengthInChars == 0) {
         return FALSE;
     }
@@ -2607,12 +3577,15 @@ YoriShTrimSuggestionList(
 }
 
 /**
- Perform suggestion completion processing.
+ Generate a suggestion for the input in an input buffer.  This is performed
+ on a background thread against a private copy of the input, unless the
+ background thread indicates that it cannot be.
 
- @param Buffer Pointer to the current input context.
+ @param Buffer Pointer to the input buffer to populate with matches and a
+        suggestion.
  */
 VOID
-YoriShCompleteSuggestion(
+YoriShGenerateSuggestion(
     __inout PYORI_SH_INPUT_BUFFER Buffer
     )
 {
@@ -2729,4 +3702,429 @@ YoriShCompleteSuggestion(
     YoriShFreeCmdContext(&CmdContext);
 }
 
+/**
+ The number of recently completed suggestions whose latency is retained.
+ */
+#define YORI_SH_SUGGESTION_LATENCY_SAMPLES (128)
+
+/**
+ Statistics describing how long suggestions take to generate, used to tune
+ the delay and budget applied to suggestions.
+ */
+typedef struct _YORI_SH_SUGGESTION_LATENCY {
+
+    /**
+     The time in milliseconds taken by recently completed suggestions.  This
+     is a circular buffer, where the most recent sample is at the index
+     before Completed.
+     */
+    DWORD Samples[YORI_SH_SUGGESTION_LATENCY_SAMPLES];
+
+    /**
+     The number of suggestions which have completed.
+     */
+    DWORD Completed;
+
+    /**
+     The number of suggestions abandoned because input arrived before they
+     completed.
+     */
+    DWORD Cancelled;
+
+    /**
+     The number of suggestions abandoned because they did not complete within
+     the suggestion budget.
+     */
+    DWORD Expired;
+} YORI_SH_SUGGESTION_LATENCY, *PYORI_SH_SUGGESTION_LATENCY;
+
+/**
+ Latency statistics for suggestions generated in this process.
+ */
+YORI_SH_SUGGESTION_LATENCY YoriShSuggestionLatency;
+
+/**
+ Record the time taken to generate a suggestion which completed.
+
+ @param Latency The time taken, in milliseconds.
+ */
+VOID
+YoriShRecordSuggestionLatency(
+    __in DWORD Latency
+    )
+{
+    YoriShSuggestionLatency.Samples[YoriShSuggestionLatency.Completed % YORI_SH_SUGGESTION_LATENCY_SAMPLES] = Latency;
+    YoriShSuggestionLatency.Completed++;
+}
+
+/**
+ Format the suggestion latency statistics into a string.  This includes the
+ number of suggestions which completed or were abandoned, and percentiles of
+ the time taken by recently completed suggestions.
+
+ @param Variable Optionally points to a buffer to populate with the string.
+        If not specified, the length of the string is returned.
+
+ @param Size The length of the Variable buffer, in characters.
+
+ @return The number of characters copied (without NULL), or if Variable is
+         not specified, the number of characters needed (including NULL.)
+ */
+DWORD
+YoriShFormatSuggestionLatency(
+    __out_ecount_opt(Size) LPTSTR Variable,
+    __in DWORD Size
+    )
+{
+    DWORD Sorted[YORI_SH_SUGGESTION_LATENCY_SAMPLES];
+    DWORD SampleCount;
+    DWORD Index;
+    DWORD InsertIndex;
+    DWORD Value;
+    DWORD Length;
+    DWORD Percentile50 = 0;
+    DWORD Percentile90 = 0;
+    DWORD Percentile99 = 0;
+    DWORD Maximum = 0;
+    TCHAR LengthBuffer[160];
+    BOOL ReturnLength = FALSE;
+
+    SampleCount = YoriShSuggestionLatency.Completed;
+    if (SampleCount > YORI_SH_SUGGESTION_LATENCY_SAMPLES) {
+        SampleCount = YORI_SH_SUGGESTION_LATENCY_SAMPLES;
+    }
+
+    //
+    //  Insertion sort the samples.  There aren't many of them and this is
+    //  only used when somebody asks.
+    //
+
+    for (Index = 0; Index < SampleCount; Index++) {
+        Value = YoriShSuggestionLatency.Samples[Index];
+        for (InsertIndex = Index; InsertIndex > 0 && Sorted[InsertIndex - 1] > Value; InsertIndex--) {
+            Sorted[InsertIndex] = Sorted[InsertIndex - 1];
+        }
+        Sorted[InsertIndex] = Value;
+    }
+
+    if (SampleCount > 0) {
+        Percentile50 = Sorted[(SampleCount - 1) * 50 / 100];
+        Percentile90 = Sorted[(SampleCount - 1) * 90 / 100];
+        Percentile99 = Sorted[(SampleCount - 1) * 99 / 100];
+        Maximum = Sorted[SampleCount - 1];
+    }
+
+    if (Variable == NULL) {
+        Variable = LengthBuffer;
+        Size = sizeof(LengthBuffer)/sizeof(LengthBuffer[0]);
+        ReturnLength = TRUE;
+    }
+
+    Length = YoriLibSPrintfS(Variable,
+                             Size,
+                             _T("completed=%i cancelled=%i expired=%i p50=%ims p90=%ims p99=%ims max=%ims"),
+                             YoriShSuggestionLatency.Completed,
+                             YoriShSuggestionLatency.Cancelled,
+                             YoriShSuggestionLatency.Expired,
+                             Percentile50,
+                             Percentile90,
+                             Percentile99,
+                             Maximum);
+
+    if (ReturnLength) {
+        Length++;
+    }
+
+    return Length;
+}
+
+/**
+ Free a suggestion request, including any matches and suggestion that were
+ not moved to the input buffer.  The background thread is expected to have
+ terminated.
+
+ @param Request Pointer to the request to free.
+ */
+VOID
+YoriShFreeSuggestionRequest(
+    __in PYORI_SH_SUGGESTION_REQUEST Request
+    )
+{
+    YoriLibFreeStringContents(&Request->WorkBuffer.SuggestionString);
+    YoriShClearTabCompletionMatches(&Request->WorkBuffer);
+    YoriLibFreeStringContents(&Request->WorkBuffer.String);
+    CloseHandle(Request->hThread);
+    YoriLibFree(Request);
+}
+
+/**
+ The entrypoint for a background thread which generates a suggestion.
+
+ @param Context Pointer to the suggestion request.
+
+ @return Thread exit code, which is always zero.
+ */
+DWORD WINAPI
+YoriShSuggestionWorker(
+    __in LPVOID Context
+    )
+{
+    PYORI_SH_SUGGESTION_REQUEST Request = (PYORI_SH_SUGGESTION_REQUEST)Context;
+
+    YoriShGenerateSuggestion(&Request->WorkBuffer);
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    Request->TickCompleted = GetTickCount();
+    return 0;
+}
+
+/**
+ Begin generating a suggestion for the current input on a background thread.
+ The input thread is expected to wait for the thread to complete, while
+ continuing to process input, and call @ref YoriShCompleteSuggestion to
+ display the result.
+
+ @param Buffer Pointer to the current input context.
+
+ @return TRUE to indicate a suggestion is being generated, FALSE if one is
+         not, either because no suggestion is possible or due to failure.
+ */
+BOOL
+YoriShStartSuggestion(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    PYORI_SH_SUGGESTION_REQUEST Request;
+    DWORD ThreadId;
+
+    ASSERT(Buffer->SuggestionRequest == NULL);
+
+    if (Buffer->String.LengthInChars == 0) {
+        return FALSE;
+    }
+    if (Buffer->TabContext.MatchList.Next != NULL) {
+        return FALSE;
+    }
+
+    Request = YoriLibMalloc(sizeof(YORI_SH_SUGGESTION_REQUEST));
+    if (Request == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Request, sizeof(YORI_SH_SUGGESTION_REQUEST));
+
+    //
+    //  Take a copy of the input, since the input thread will keep changing
+    //  the buffer while the suggestion is generated.
+    //
+
+    if (!YoriLibAllocateString(&Request->WorkBuffer.String, Buffer->String.LengthInChars + 1)) {
+        YoriLibFree(Request);
+        return FALSE;
+    }
+
+    memcpy(Request->WorkBuffer.String.StartOfString, Buffer->String.StartOfString, Buffer->String.LengthInChars * sizeof(TCHAR));
+    Request->WorkBuffer.String.LengthInChars = Buffer->String.LengthInChars;
+    Request->WorkBuffer.String.StartOfString[Request->WorkBuffer.String.LengthInChars] = '\0';
+    Request->WorkBuffer.CurrentOffset = Buffer->CurrentOffset;
+    Request->WorkBuffer.TabContext.SearchType = Buffer->TabContext.SearchType;
+    Request->WorkBuffer.TabContext.CancelRequested = &Request->CancelRequested;
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    Request->TickStarted = GetTickCount();
+
+    Request->hThread = CreateThread(NULL, 0, YoriShSuggestionWorker, Request, 0, &ThreadId);
+    if (Request->hThread == NULL) {
+        YoriLibFreeStringContents(&Request->WorkBuffer.String);
+        YoriLibFree(Request);
+        return FALSE;
+    }
+
+    Buffer->SuggestionRequest = Request;
+    return TRUE;
+}
+
+/**
+ Indicate that a suggestion being generated in the background is no longer
+ needed.  This does not wait for the background thread to stop; the request
+ is freed when it does, via @ref YoriShCompleteSuggestion .
+
+ @param Buffer Pointer to the current input context.
+ */
+VOID
+YoriShCancelSuggestion(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    if (Buffer->SuggestionRequest != NULL) {
+        InterlockedExchange(&Buffer->SuggestionRequest->CancelRequested, TRUE);
+    }
+}
+
+/**
+ Return the amount of time the input thread should wait for a suggestion
+ being generated in the background.  If the suggestion has exhausted its
+ budget, it is cancelled, and the input thread should wait for the
+ background thread to observe this.
+
+ @param Buffer Pointer to the current input context.
+
+ @return The number of milliseconds to wait, or INFINITE.
+ */
+DWORD
+YoriShGetSuggestionWaitTime(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    PYORI_SH_SUGGESTION_REQUEST Request = Buffer->SuggestionRequest;
+    DWORD Elapsed;
+
+    ASSERT(Request != NULL);
+
+    if (Request->CancelRequested || YoriShGlobal.SuggestionBudget == 0) {
+        return INFINITE;
+    }
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    Elapsed = GetTickCount() - Request->TickStarted;
+
+    if (Elapsed >= YoriShGlobal.SuggestionBudget) {
+        Request->BudgetExpired = TRUE;
+        YoriShCancelSuggestion(Buffer);
+        return INFINITE;
+    }
+
+    return YoriShGlobal.SuggestionBudget - Elapsed;
+}
+
+/**
+ Collect the result of a suggestion generated in the background, waiting for
+ the background thread to finish if it has not already.  If the request was
+ not cancelled and the input has not changed since the request was made,
+ the matches and suggestion are moved into the input buffer.
+
+ @param Buffer Pointer to the current input context.
+
+ @return TRUE to indicate that suggestion processing for the current input
+         is complete, FALSE if the request was for older input or was
+         abandoned.
+ */
+BOOL
+YoriShCompleteSuggestion(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    PYORI_SH_SUGGESTION_REQUEST Request = Buffer->SuggestionRequest;
+    PYORI_SH_INPUT_BUFFER WorkBuffer;
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD Latency;
+
+    if (Request == NULL) {
+        return FALSE;
+    }
+
+    Buffer->SuggestionRequest = NULL;
+    WaitForSingleObject(Request->hThread, INFINITE);
+    WorkBuffer = &Request->WorkBuffer;
+
+    if (Request->BudgetExpired) {
+        YoriShSuggestionLatency.Expired++;
+        YoriShFreeSuggestionRequest(Request);
+        return FALSE;
+    }
+
+    if (Request->CancelRequested) {
+        YoriShSuggestionLatency.Cancelled++;
+        YoriShFreeSuggestionRequest(Request);
+        return FALSE;
+    }
+
+    Latency = Request->TickCompleted - Request->TickStarted;
+
+    if (YoriLibCompareString(&WorkBuffer->String, &Buffer->String) != 0 ||
+        WorkBuffer->CurrentOffset != Buffer->CurrentOffset ||
+        Buffer->TabContext.MatchList.Next != NULL ||
+        Buffer->SuggestionString.LengthInChars > 0) {
+
+        YoriShRecordSuggestionLatency(Latency);
+        YoriShFreeSuggestionRequest(Request);
+        return FALSE;
+    }
+
+    if (WorkBuffer->TabContext.ForegroundRequired) {
+
+        //
+        //  The background thread found that a completion script needs to
+        //  run, so generate the suggestion here instead.
+        //
+
+        YoriShConfigureConsoleForTabComplete(Buffer);
+        YoriShGenerateSuggestion(Buffer);
+        YoriShConfigureConsoleForInput(Buffer);
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+        Latency = GetTickCount() - Request->TickStarted;
+
+    } else if (WorkBuffer->TabContext.MatchList.Next != NULL) {
+
+        //
+        //  Move the matches into the input buffer so they can be refined
+        //  as more characters are entered.  Each entry points back to the
+        //  list head, so entries are moved individually.
+        //
+
+        memcpy(&Buffer->TabContext, &WorkBuffer->TabContext, sizeof(YORI_SH_TAB_COMPLETE_CONTEXT));
+        Buffer->TabContext.CancelRequested = NULL;
+        YoriLibInitializeListHead(&Buffer->TabContext.MatchList);
+
+        ListEntry = YoriLibGetNextListEntry(&WorkBuffer->TabContext.MatchList, NULL);
+        while (ListEntry != NULL) {
+            YoriLibRemoveListItem(ListEntry);
+            YoriLibAppendList(&Buffer->TabContext.MatchList, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&WorkBuffer->TabContext.MatchList, NULL);
+        }
+        ZeroMemory(&WorkBuffer->TabContext, sizeof(YORI_SH_TAB_COMPLETE_CONTEXT));
+
+        memcpy(&Buffer->SuggestionString, &WorkBuffer->SuggestionString, sizeof(YORI_STRING));
+        YoriLibInitEmptyString(&WorkBuffer->SuggestionString);
+    }
+
+    YoriShRecordSuggestionLatency(Latency);
+    YoriShFreeSuggestionRequest(Request);
+    return TRUE;
+}
+
+/**
+ Abandon any suggestion being generated in the background and wait for the
+ background thread to stop.  This is required before performing any other
+ operation which uses the same state, such as tab completion or executing
+ a command.
+
+ @param Buffer Pointer to the current input context.
+ */
+VOID
+YoriShWaitForSuggestion(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    if (Buffer->SuggestionRequest == NULL) {
+        return;
+    }
+
+    YoriShCancelSuggestion(Buffer);
+    YoriShCompleteSuggestion(Buffer);
+}
+
 // vim:sw=4:ts=4:et:
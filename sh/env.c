@@ -100,6 +100,8 @@ YoriShGetEnvironmentVariableWithoutSubstitution(
             Length = YoriLibSPrintfS(NumString, sizeof(NumString)/sizeof(NumString[0]), _T("0x%x"), GetCurrentProcessId());
             Length++;
         }
+    } else if (tcsicmp(Name, _T("YORISUGGESTIONLATENCY")) == 0) {
+        Length = YoriShFormatSuggestionLatency(Variable, Size);
     } else {
         Length = GetEnvironmentVariable(Name, Variable, Size);
     }
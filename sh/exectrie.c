@@ -0,0 +1,1071 @@
+/**
+ * @file sh/exectrie.c
+ *
+ * Yori shell index of executable names found in the path
+ *
+ * Copyright (c) 2019 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yori.h"
+
+/**
+ The number of bytes to allocate at a time for trie nodes and file names.
+ */
+#define YORI_SH_EXEC_TRIE_CHUNK_SIZE (64 * 1024)
+
+/**
+ The extensions to treat as executable if PATHEXT is not defined.  This
+ matches the default used by path resolution in YoriLib.
+ */
+#define YORI_SH_EXEC_TRIE_DEFAULT_PATHEXT _T(".com;.exe;.bat;.cmd")
+
+/**
+ The number of milliseconds after which a trie is rebuilt if it contains a
+ directory that doesn't exist and can't be monitored for creation.
+ */
+#define YORI_SH_EXEC_TRIE_RECHECK_INTERVAL (30 * 1000)
+
+/**
+ A block of memory from which trie nodes and file names are allocated.  The
+ trie is only ever discarded as a whole, so individual allocations are never
+ freed.
+ */
+typedef struct _YORI_SH_EXEC_TRIE_CHUNK {
+
+    /**
+     The next chunk allocated for the trie.
+     */
+    struct _YORI_SH_EXEC_TRIE_CHUNK *Next;
+
+    /**
+     The number of bytes in use within this chunk, including this header.
+     */
+    DWORD BytesUsed;
+
+    /**
+     The number of bytes allocated for this chunk, including this header.
+     */
+    DWORD BytesAllocated;
+} YORI_SH_EXEC_TRIE_CHUNK, *PYORI_SH_EXEC_TRIE_CHUNK;
+
+/**
+ An executable file found in a directory in the path.
+ */
+typedef struct _YORI_SH_EXEC_TRIE_FILE {
+
+    /**
+     The next file with the same name, found in a later directory.
+     */
+    struct _YORI_SH_EXEC_TRIE_FILE *Next;
+
+    /**
+     The index of the directory within the path that contains this file.
+     */
+    DWORD DirectoryIndex;
+
+    /**
+     The name of the file, as it is cased on disk.
+     */
+    YORI_STRING FileName;
+} YORI_SH_EXEC_TRIE_FILE, *PYORI_SH_EXEC_TRIE_FILE;
+
+/**
+ A node within the trie, corresponding to a single character of a file name.
+ */
+typedef struct _YORI_SH_EXEC_TRIE_NODE {
+
+    /**
+     The first node describing the following character.  Children are kept
+     sorted by character.
+     */
+    struct _YORI_SH_EXEC_TRIE_NODE *Child;
+
+    /**
+     The next node describing an alternate character at the same position.
+     */
+    struct _YORI_SH_EXEC_TRIE_NODE *Sibling;
+
+    /**
+     The files whose name ends at this node, in path order.
+     */
+    PYORI_SH_EXEC_TRIE_FILE Files;
+
+    /**
+     The upper case form of the character described by this node.
+     */
+    TCHAR Char;
+} YORI_SH_EXEC_TRIE_NODE, *PYORI_SH_EXEC_TRIE_NODE;
+
+/**
+ An index of the executable files found in every directory of a particular
+ PATH, keyed by file name.
+ */
+typedef struct _YORI_SH_EXEC_TRIE {
+
+    /**
+     The value of the PATH environment variable that the trie describes.
+     */
+    YORI_STRING PathSnapshot;
+
+    /**
+     The value of the PATHEXT environment variable that the trie describes.
+     */
+    YORI_STRING PathExtSnapshot;
+
+    /**
+     The number of directories in the path.
+     */
+    DWORD DirectoryCount;
+
+    /**
+     An array of directories in the path.  These refer to PathSnapshot.
+     */
+    PYORI_STRING Directories;
+
+    /**
+     An array of change notification handles, one per directory, which are
+     signalled when a file is created, deleted or renamed in the directory.
+     If the directory does not exist, the handle monitors its nearest
+     existing parent, so it is signalled when the directory may have been
+     created.
+     */
+    PHANDLE ChangeNotifications;
+
+    /**
+     The number of executable extensions.
+     */
+    DWORD ExtensionCount;
+
+    /**
+     An array of executable extensions.  These refer to PathExtSnapshot.
+     */
+    PYORI_STRING Extensions;
+
+    /**
+     FALSE if the trie cannot answer queries for this path, because a
+     directory is relative to the current directory or cannot be monitored
+     for changes.  The trie is retained so that it is not repeatedly
+     rebuilt, and callers must search the path directly.
+     */
+    BOOL Usable;
+
+    /**
+     TRUE if a directory in the path doesn't exist and no parent of it could
+     be monitored, so the trie can't observe the directory being created.
+     The trie is considered stale once YORI_SH_EXEC_TRIE_RECHECK_INTERVAL
+     has elapsed since it was created.
+     */
+    BOOL RecheckRequired;
+
+    /**
+     The tick count when the trie was created.
+     */
+    DWORD CreateTime;
+
+    /**
+     Set to nonzero to request that a background build stop early.
+     */
+    volatile LONG Abort;
+
+    /**
+     The root of the trie, which corresponds to an empty name.
+     */
+    YORI_SH_EXEC_TRIE_NODE Root;
+
+    /**
+     The chunks of memory used to hold trie nodes and file names.  The first
+     chunk is the one currently being allocated from.
+     */
+    PYORI_SH_EXEC_TRIE_CHUNK Chunks;
+} YORI_SH_EXEC_TRIE, *PYORI_SH_EXEC_TRIE;
+
+/**
+ The state of the executable name index.
+ */
+typedef struct _YORI_SH_EXEC_TRIE_STATE {
+
+    /**
+     The most recently built trie, or NULL if none has been built or the
+     previous one became stale.  This is only accessed by the input thread.
+     */
+    PYORI_SH_EXEC_TRIE Current;
+
+    /**
+     A trie being built by a background thread.  The input thread must not
+     access this until BuildThread has terminated.
+     */
+    PYORI_SH_EXEC_TRIE Building;
+
+    /**
+     A handle to the background thread building a trie, or NULL if no build
+     is in progress.
+     */
+    HANDLE BuildThread;
+} YORI_SH_EXEC_TRIE_STATE, *PYORI_SH_EXEC_TRIE_STATE;
+
+/**
+ The global executable name index.
+ */
+YORI_SH_EXEC_TRIE_STATE YoriShExecTrie;
+
+/**
+ Allocate memory from a trie.  This memory is freed when the trie is freed.
+
+ @param Trie Pointer to the trie.
+
+ @param Bytes The number of bytes to allocate.
+
+ @return Pointer to the allocated memory, or NULL on failure.
+ */
+PVOID
+YoriShExecTrieAllocate(
+    __inout PYORI_SH_EXEC_TRIE Trie,
+    __in DWORD Bytes
+    )
+{
+    PYORI_SH_EXEC_TRIE_CHUNK Chunk;
+    DWORD ChunkSize;
+    PVOID Alloc;
+
+    Bytes = (DWORD)((Bytes + sizeof(PVOID) - 1) & ~(sizeof(PVOID) - 1));
+
+    Chunk = Trie->Chunks;
+    if (Chunk == NULL || Chunk->BytesUsed + Bytes > Chunk->BytesAllocated) {
+        ChunkSize = YORI_SH_EXEC_TRIE_CHUNK_SIZE;
+        if (ChunkSize < sizeof(YORI_SH_EXEC_TRIE_CHUNK) + Bytes) {
+            ChunkSize = (DWORD)sizeof(YORI_SH_EXEC_TRIE_CHUNK) + Bytes;
+        }
+        Chunk = YoriLibMalloc(ChunkSize);
+        if (Chunk == NULL) {
+            return NULL;
+        }
+        Chunk->Next = Trie->Chunks;
+        Chunk->BytesUsed = (DWORD)((sizeof(YORI_SH_EXEC_TRIE_CHUNK) + sizeof(PVOID) - 1) & ~(sizeof(PVOID) - 1));
+        Chunk->BytesAllocated = ChunkSize;
+        Trie->Chunks = Chunk;
+    }
+
+    Alloc = YoriLibAddToPointer(Chunk, Chunk->BytesUsed);
+    Chunk->BytesUsed += Bytes;
+    return Alloc;
+}
+
+/**
+ Free a trie and all of its contents.
+
+ @param Trie Pointer to the trie to free.
+ */
+VOID
+YoriShExecTrieFree(
+    __in PYORI_SH_EXEC_TRIE Trie
+    )
+{
+    PYORI_SH_EXEC_TRIE_CHUNK Chunk;
+    DWORD Index;
+
+    if (Trie->ChangeNotifications != NULL) {
+        for (Index = 0; Index < Trie->DirectoryCount; Index++) {
+            if (Trie->ChangeNotifications[Index] != NULL) {
+                FindCloseChangeNotification(Trie->ChangeNotifications[Index]);
+            }
+        }
+        YoriLibFree(Trie->ChangeNotifications);
+    }
+
+    if (Trie->Directories != NULL) {
+        YoriLibFree(Trie->Directories);
+    }
+
+    if (Trie->Extensions != NULL) {
+        YoriLibFree(Trie->Extensions);
+    }
+
+    while (Trie->Chunks != NULL) {
+        Chunk = Trie->Chunks;
+        Trie->Chunks = Chunk->Next;
+        YoriLibFree(Chunk);
+    }
+
+    YoriLibFreeStringContents(&Trie->PathSnapshot);
+    YoriLibFreeStringContents(&Trie->PathExtSnapshot);
+    YoriLibFree(Trie);
+}
+
+/**
+ Split a semicolon delimited string into an array of its nonempty elements.
+ The elements refer to the original string.
+
+ @param String Pointer to the string to split.
+
+ @param ElementCount On successful completion, updated to contain the number
+        of elements found.
+
+ @return Pointer to an array of elements, or NULL on failure.  The caller
+         should free this with @ref YoriLibFree .
+ */
+PYORI_STRING
+YoriShExecTrieSplitList(
+    __in PYORI_STRING String,
+    __out PDWORD ElementCount
+    )
+{
+    PYORI_STRING Elements;
+    DWORD Count;
+    DWORD Index;
+    DWORD Start;
+
+    Count = 0;
+    for (Index = 0; Index < String->LengthInChars; Index++) {
+        if (String->StartOfString[Index] == ';') {
+            Count++;
+        }
+    }
+    Count++;
+
+    Elements = YoriLibMalloc(Count * sizeof(YORI_STRING));
+    if (Elements == NULL) {
+        return NULL;
+    }
+
+    Count = 0;
+    Start = 0;
+    for (Index = 0; Index <= String->LengthInChars; Index++) {
+        if (Index == String->LengthInChars || String->StartOfString[Index] == ';') {
+            if (Index > Start) {
+                YoriLibInitEmptyString(&Elements[Count]);
+                Elements[Count].StartOfString = &String->StartOfString[Start];
+                Elements[Count].LengthInChars = Index - Start;
+                Count++;
+            }
+            Start = Index + 1;
+        }
+    }
+
+    *ElementCount = Count;
+    return Elements;
+}
+
+/**
+ Allocate a new, empty trie describing the current values of the PATH and
+ PATHEXT environment variables.
+
+ @return Pointer to the new trie, or NULL on failure.
+ */
+PYORI_SH_EXEC_TRIE
+YoriShExecTrieCreate()
+{
+    PYORI_SH_EXEC_TRIE Trie;
+
+    Trie = YoriLibMalloc(sizeof(YORI_SH_EXEC_TRIE));
+    if (Trie == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Trie, sizeof(YORI_SH_EXEC_TRIE));
+    YoriLibInitEmptyString(&Trie->PathSnapshot);
+    YoriLibInitEmptyString(&Trie->PathExtSnapshot);
+    Trie->Usable = TRUE;
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+    Trie->CreateTime = GetTickCount();
+
+    if (!YoriLibAllocateAndGetEnvironmentVariable(_T("PATH"), &Trie->PathSnapshot) ||
+        !YoriLibAllocateAndGetEnvironmentVariable(_T("PATHEXT"), &Trie->PathExtSnapshot)) {
+
+        YoriShExecTrieFree(Trie);
+        return NULL;
+    }
+
+    Trie->Directories = YoriShExecTrieSplitList(&Trie->PathSnapshot, &Trie->DirectoryCount);
+    if (Trie->Directories == NULL) {
+        YoriShExecTrieFree(Trie);
+        return NULL;
+    }
+
+    if (Trie->PathExtSnapshot.LengthInChars > 0) {
+        Trie->Extensions = YoriShExecTrieSplitList(&Trie->PathExtSnapshot, &Trie->ExtensionCount);
+    } else {
+        YORI_STRING DefaultPathExt;
+        YoriLibConstantString(&DefaultPathExt, YORI_SH_EXEC_TRIE_DEFAULT_PATHEXT);
+        Trie->Extensions = YoriShExecTrieSplitList(&DefaultPathExt, &Trie->ExtensionCount);
+    }
+
+    if (Trie->Extensions == NULL) {
+        YoriShExecTrieFree(Trie);
+        return NULL;
+    }
+
+    if (Trie->DirectoryCount > 0) {
+        Trie->ChangeNotifications = YoriLibMalloc(Trie->DirectoryCount * sizeof(HANDLE));
+        if (Trie->ChangeNotifications == NULL) {
+            YoriShExecTrieFree(Trie);
+            return NULL;
+        }
+        ZeroMemory(Trie->ChangeNotifications, Trie->DirectoryCount * sizeof(HANDLE));
+    }
+
+    return Trie;
+}
+
+/**
+ Determine whether a file name has one of the extensions in PATHEXT.
+
+ @param Trie Pointer to the trie describing the executable extensions.
+
+ @param FileName Pointer to the file name.
+
+ @return TRUE if the file is executable, FALSE if it is not.
+ */
+BOOL
+YoriShExecTrieIsExecutable(
+    __in PYORI_SH_EXEC_TRIE Trie,
+    __in PYORI_STRING FileName
+    )
+{
+    YORI_STRING FileExtension;
+    DWORD Index;
+
+    YoriLibInitEmptyString(&FileExtension);
+    for (Index = 0; Index < Trie->ExtensionCount; Index++) {
+        if (FileName->LengthInChars > Trie->Extensions[Index].LengthInChars) {
+            FileExtension.StartOfString = &FileName->StartOfString[FileName->LengthInChars - Trie->Extensions[Index].LengthInChars];
+            FileExtension.LengthInChars = Trie->Extensions[Index].LengthInChars;
+            if (YoriLibCompareStringInsensitive(&FileExtension, &Trie->Extensions[Index]) == 0) {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ Add a file to the trie.
+
+ @param Trie Pointer to the trie.
+
+ @param FileName Pointer to the name of the file.
+
+ @param DirectoryIndex The index of the directory within the path that
+        contains the file.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShExecTrieInsert(
+    __inout PYORI_SH_EXEC_TRIE Trie,
+    __in PYORI_STRING FileName,
+    __in DWORD DirectoryIndex
+    )
+{
+    PYORI_SH_EXEC_TRIE_NODE Node;
+    PYORI_SH_EXEC_TRIE_NODE *Link;
+    PYORI_SH_EXEC_TRIE_NODE NewNode;
+    PYORI_SH_EXEC_TRIE_FILE File;
+    PYORI_SH_EXEC_TRIE_FILE *FileLink;
+    DWORD Index;
+    TCHAR Char;
+
+    Node = &Trie->Root;
+    for (Index = 0; Index < FileName->LengthInChars; Index++) {
+        Char = YoriLibUpcaseChar(FileName->StartOfString[Index]);
+
+        //
+        //  Find the child for this character, or the point where it should
+        //  be inserted to keep children sorted.
+        //
+
+        Link = &Node->Child;
+        while (*Link != NULL && (*Link)->Char < Char) {
+            Link = &(*Link)->Sibling;
+        }
+
+        if (*Link == NULL || (*Link)->Char != Char) {
+            NewNode = YoriShExecTrieAllocate(Trie, sizeof(YORI_SH_EXEC_TRIE_NODE));
+            if (NewNode == NULL) {
+                return FALSE;
+            }
+            NewNode->Child = NULL;
+            NewNode->Files = NULL;
+            NewNode->Char = Char;
+            NewNode->Sibling = *Link;
+            *Link = NewNode;
+        }
+
+        Node = *Link;
+    }
+
+    //
+    //  Directories are enumerated in path order, so appending to the list
+    //  keeps files with the same name in the order they would be found.
+    //
+
+    FileLink = &Node->Files;
+    while (*FileLink != NULL) {
+        FileLink = &(*FileLink)->Next;
+    }
+
+    File = YoriShExecTrieAllocate(Trie, sizeof(YORI_SH_EXEC_TRIE_FILE) + (FileName->LengthInChars + 1) * sizeof(TCHAR));
+    if (File == NULL) {
+        return FALSE;
+    }
+
+    File->Next = NULL;
+    File->DirectoryIndex = DirectoryIndex;
+    YoriLibInitEmptyString(&File->FileName);
+    File->FileName.StartOfString = (LPTSTR)(File + 1);
+    File->FileName.LengthInChars = FileName->LengthInChars;
+    File->FileName.LengthAllocated = FileName->LengthInChars + 1;
+    memcpy(File->FileName.StartOfString, FileName->StartOfString, FileName->LengthInChars * sizeof(TCHAR));
+    File->FileName.StartOfString[FileName->LengthInChars] = '\0';
+
+    *FileLink = File;
+    return TRUE;
+}
+
+/**
+ Remove the final component from a directory name, so that it refers to the
+ parent directory.  The root of a drive has no parent.
+
+ @param DirectoryName Pointer to the directory name, which is NULL
+        terminated.  On successful completion, this is updated to refer to
+        its parent, and remains NULL terminated.
+
+ @return TRUE if the name now refers to the parent directory, FALSE if it
+         has no parent.
+ */
+__success(return)
+BOOL
+YoriShExecTrieTruncateToParent(
+    __inout PYORI_STRING DirectoryName
+    )
+{
+    DWORD Index;
+
+    Index = DirectoryName->LengthInChars;
+    while (Index > 0 && YoriLibIsSep(DirectoryName->StartOfString[Index - 1])) {
+        Index--;
+    }
+
+    while (Index > 0 && !YoriLibIsSep(DirectoryName->StartOfString[Index - 1])) {
+        Index--;
+    }
+
+    //
+    //  Index now refers to the character after the final separator.
+    //  Keep the separator if it's the root of a drive, and stop if there
+    //  is nothing left to monitor.
+    //
+
+    if (Index <= 1) {
+        return FALSE;
+    }
+
+    if (Index == 3 && DirectoryName->StartOfString[1] == ':') {
+        if (DirectoryName->LengthInChars <= 3) {
+            return FALSE;
+        }
+    } else {
+        Index--;
+        while (Index > 0 && YoriLibIsSep(DirectoryName->StartOfString[Index - 1])) {
+            Index--;
+        }
+        if (Index == 0) {
+            return FALSE;
+        }
+    }
+
+    DirectoryName->LengthInChars = Index;
+    DirectoryName->StartOfString[Index] = '\0';
+    return TRUE;
+}
+
+/**
+ Arm a change notification for a directory in the path and add each
+ executable file within it to the trie.
+
+ @param Trie Pointer to the trie.
+
+ @param DirectoryIndex The index of the directory within the path.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  Failure
+         implies the trie is not usable.
+ */
+__success(return)
+BOOL
+YoriShExecTrieAddDirectory(
+    __inout PYORI_SH_EXEC_TRIE Trie,
+    __in DWORD DirectoryIndex
+    )
+{
+    PYORI_STRING Directory;
+    YORI_STRING SearchName;
+    YORI_STRING FileName;
+    WIN32_FIND_DATA FindData;
+    HANDLE hFind;
+    HANDLE hNotify;
+    DWORD Err;
+    BOOL WatchingParent;
+
+    Directory = &Trie->Directories[DirectoryIndex];
+
+    //
+    //  Relative paths depend on the current directory, so the trie cannot
+    //  answer queries for them.
+    //
+
+    if (!YoriLibIsDriveLetterWithColonAndSlash(Directory) &&
+        (Directory->LengthInChars < 2 ||
+         !YoriLibIsSep(Directory->StartOfString[0]) ||
+         !YoriLibIsSep(Directory->StartOfString[1]))) {
+
+        return FALSE;
+    }
+
+    if (!YoriLibAllocateString(&SearchName, Directory->LengthInChars + 3)) {
+        return FALSE;
+    }
+
+    //
+    //  Arm the notification before enumerating so that any change made
+    //  during the enumeration is detected.  If the directory doesn't exist,
+    //  it contributes nothing, but its nearest existing parent is monitored
+    //  so the trie becomes stale if the directory is created.  If no parent
+    //  exists, the trie is rebuilt periodically instead.  If an existing
+    //  directory can't be monitored, the trie can't tell when it becomes
+    //  stale.
+    //
+
+    while (TRUE) {
+        SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y"), Directory);
+        WatchingParent = FALSE;
+
+        while (TRUE) {
+            hNotify = FindFirstChangeNotification(SearchName.StartOfString, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME);
+            if (hNotify != INVALID_HANDLE_VALUE) {
+                break;
+            }
+
+            Err = GetLastError();
+            if (Err != ERROR_FILE_NOT_FOUND && Err != ERROR_PATH_NOT_FOUND) {
+                if (!WatchingParent) {
+                    YoriLibFreeStringContents(&SearchName);
+                    return FALSE;
+                }
+                break;
+            }
+
+            if (!YoriShExecTrieTruncateToParent(&SearchName)) {
+                break;
+            }
+            WatchingParent = TRUE;
+        }
+
+        if (hNotify == INVALID_HANDLE_VALUE) {
+            YoriLibFreeStringContents(&SearchName);
+            Trie->RecheckRequired = TRUE;
+            return TRUE;
+        }
+
+        //
+        //  If the directory was created before its parent was monitored,
+        //  the notification will never observe it, so start again.
+        //
+
+        if (WatchingParent) {
+            SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y"), Directory);
+            if (GetFileAttributes(SearchName.StartOfString) != INVALID_FILE_ATTRIBUTES) {
+                FindCloseChangeNotification(hNotify);
+                continue;
+            }
+        }
+        break;
+    }
+
+    Trie->ChangeNotifications[DirectoryIndex] = hNotify;
+
+    if (WatchingParent) {
+        YoriLibFreeStringContents(&SearchName);
+        return TRUE;
+    }
+
+    if (YoriLibIsSep(Directory->StartOfString[Directory->LengthInChars - 1])) {
+        SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y*"), Directory);
+    } else {
+        SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y\\*"), Directory);
+    }
+
+    hFind = FindFirstFile(SearchName.StartOfString, &FindData);
+    YoriLibFreeStringContents(&SearchName);
+
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return (GetLastError() == ERROR_FILE_NOT_FOUND);
+    }
+
+    do {
+        if (Trie->Abort) {
+            FindClose(hFind);
+            return FALSE;
+        }
+
+        if ((FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+            YoriLibConstantString(&FileName, FindData.cFileName);
+            if (YoriShExecTrieIsExecutable(Trie, &FileName)) {
+                if (!YoriShExecTrieInsert(Trie, &FileName, DirectoryIndex)) {
+                    FindClose(hFind);
+                    return FALSE;
+                }
+            }
+        }
+    } while (FindNextFile(hFind, &FindData));
+
+    FindClose(hFind);
+    return TRUE;
+}
+
+/**
+ The entrypoint for a background thread which populates a trie with the
+ executable files in each directory of the path.
+
+ @param Context Pointer to the trie to populate.
+
+ @return Thread exit code, which is always zero.
+ */
+DWORD WINAPI
+YoriShExecTrieBuildWorker(
+    __in LPVOID Context
+    )
+{
+    PYORI_SH_EXEC_TRIE Trie = (PYORI_SH_EXEC_TRIE)Context;
+    DWORD Index;
+
+    for (Index = 0; Index < Trie->DirectoryCount; Index++) {
+        if (!YoriShExecTrieAddDirectory(Trie, Index)) {
+            Trie->Usable = FALSE;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ Determine whether a trie still describes the executables that would be
+ found in the path.
+
+ @param Trie Pointer to the trie.
+
+ @return TRUE if the trie is current, FALSE if it is stale.
+ */
+BOOL
+YoriShExecTrieIsCurrent(
+    __in PYORI_SH_EXEC_TRIE Trie
+    )
+{
+    YORI_STRING Value;
+    DWORD Index;
+    BOOL Current;
+    DWORD Now;
+
+    YoriLibInitEmptyString(&Value);
+    if (!YoriLibAllocateAndGetEnvironmentVariable(_T("PATH"), &Value)) {
+        return FALSE;
+    }
+    Current = (YoriLibCompareString(&Value, &Trie->PathSnapshot) == 0);
+    YoriLibFreeStringContents(&Value);
+    if (!Current) {
+        return FALSE;
+    }
+
+    if (!YoriLibAllocateAndGetEnvironmentVariable(_T("PATHEXT"), &Value)) {
+        return FALSE;
+    }
+    Current = (YoriLibCompareString(&Value, &Trie->PathExtSnapshot) == 0);
+    YoriLibFreeStringContents(&Value);
+    if (!Current) {
+        return FALSE;
+    }
+
+    if (Trie->RecheckRequired) {
+#if defined(_MSC_VER) && (_MSC_VER >= 1700)
+#pragma warning(suppress: 28159) // Deprecated GetTickCount; overflows are
+                                 // deterministic
+#endif
+        Now = GetTickCount();
+        if (Now - Trie->CreateTime >= YORI_SH_EXEC_TRIE_RECHECK_INTERVAL) {
+            return FALSE;
+        }
+    }
+
+    if (Trie->Usable) {
+        for (Index = 0; Index < Trie->DirectoryCount; Index++) {
+            if (Trie->ChangeNotifications[Index] != NULL &&
+                WaitForSingleObject(Trie->ChangeNotifications[Index], 0) != WAIT_TIMEOUT) {
+
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Collect the files whose name ends at or below a node of the trie.  Files are
+ collected in name order.
+
+ @param Node Pointer to the node to collect files from.
+
+ @param Files Pointer to an array to populate with files.  If NULL, files are
+        only counted.
+
+ @param FileCount On input, the number of files collected so far.  On output,
+        updated to include the files below this node.
+ */
+VOID
+YoriShExecTrieCollectFiles(
+    __in PYORI_SH_EXEC_TRIE_NODE Node,
+    __out_opt PYORI_SH_EXEC_TRIE_FILE *Files,
+    __inout PDWORD FileCount
+    )
+{
+    PYORI_SH_EXEC_TRIE_FILE File;
+    PYORI_SH_EXEC_TRIE_NODE Child;
+
+    for (File = Node->Files; File != NULL; File = File->Next) {
+        if (Files != NULL) {
+            Files[*FileCount] = File;
+        }
+        (*FileCount)++;
+    }
+
+    for (Child = Node->Child; Child != NULL; Child = Child->Sibling) {
+        YoriShExecTrieCollectFiles(Child, Files, FileCount);
+    }
+}
+
+/**
+ Report a file found in the trie to a caller's callback, in the same form
+ as path resolution reports it.
+
+ @param Trie Pointer to the trie.
+
+ @param File Pointer to the file to report.
+
+ @param MatchCallback The callback to invoke.
+
+ @param MatchContext Context to pass to the callback.
+
+ @return The result of the callback, or FALSE on allocation failure.
+ */
+BOOL
+YoriShExecTrieReportFile(
+    __in PYORI_SH_EXEC_TRIE Trie,
+    __in PYORI_SH_EXEC_TRIE_FILE File,
+    __in PYORI_LIB_PATH_MATCH_FN MatchCallback,
+    __in PVOID MatchContext
+    )
+{
+    PYORI_STRING Directory;
+    YORI_STRING RelativePath;
+    YORI_STRING FullPath;
+    BOOL Result;
+
+    Directory = &Trie->Directories[File->DirectoryIndex];
+    if (!YoriLibAllocateString(&RelativePath, Directory->LengthInChars + 1 + File->FileName.LengthInChars + 1)) {
+        return FALSE;
+    }
+
+    if (YoriLibIsSep(Directory->StartOfString[Directory->LengthInChars - 1])) {
+        RelativePath.LengthInChars = YoriLibSPrintf(RelativePath.StartOfString, _T("%y%y"), Directory, &File->FileName);
+    } else {
+        RelativePath.LengthInChars = YoriLibSPrintf(RelativePath.StartOfString, _T("%y\\%y"), Directory, &File->FileName);
+    }
+
+    YoriLibInitEmptyString(&FullPath);
+    if (!YoriLibGetFullPathNameReturnAllocation(&RelativePath, FALSE, &FullPath, NULL)) {
+        YoriLibFreeStringContents(&RelativePath);
+        return FALSE;
+    }
+    YoriLibFreeStringContents(&RelativePath);
+
+    Result = MatchCallback(&FullPath, MatchContext);
+    YoriLibFreeStringContents(&FullPath);
+    return Result;
+}
+
+/**
+ Find every executable in the path whose name begins with a prefix, and
+ invoke a callback for each.  Matches are reported in path order, and in
+ name order within each directory.  The current directory is not searched.
+
+ The index is built on a background thread the first time it is needed, and
+ rebuilt whenever PATH or PATHEXT change or a file is created, deleted or
+ renamed in a directory in the path.  While the index is unavailable, this
+ function returns FALSE and the caller is expected to search the path
+ directly.
+
+ @param Prefix Pointer to the prefix to search for.  This should not contain
+        wildcards or path seperators.
+
+ @param MatchCallback The callback to invoke for each match.
+
+ @param MatchContext Context to pass to the callback.
+
+ @return TRUE if the index was used to answer the query, including if no
+         matches were found.  FALSE if the index is not available.
+ */
+__success(return)
+BOOL
+YoriShExecTrieFindMatches(
+    __in PYORI_STRING Prefix,
+    __in PYORI_LIB_PATH_MATCH_FN MatchCallback,
+    __in PVOID MatchContext
+    )
+{
+    PYORI_SH_EXEC_TRIE Trie;
+    PYORI_SH_EXEC_TRIE_NODE Node;
+    PYORI_SH_EXEC_TRIE_FILE *Files;
+    DWORD FileCount;
+    DWORD DirectoryIndex;
+    DWORD Index;
+    DWORD ThreadId;
+    TCHAR Char;
+
+    //
+    //  If a background build has finished, it supersedes any previous trie.
+    //
+
+    if (YoriShExecTrie.BuildThread != NULL &&
+        WaitForSingleObject(YoriShExecTrie.BuildThread, 0) == WAIT_OBJECT_0) {
+
+        CloseHandle(YoriShExecTrie.BuildThread);
+        YoriShExecTrie.BuildThread = NULL;
+        if (YoriShExecTrie.Current != NULL) {
+            YoriShExecTrieFree(YoriShExecTrie.Current);
+        }
+        YoriShExecTrie.Current = YoriShExecTrie.Building;
+        YoriShExecTrie.Building = NULL;
+    }
+
+    if (YoriShExecTrie.Current != NULL &&
+        !YoriShExecTrieIsCurrent(YoriShExecTrie.Current)) {
+
+        YoriShExecTrieFree(YoriShExecTrie.Current);
+        YoriShExecTrie.Current = NULL;
+    }
+
+    if (YoriShExecTrie.Current == NULL) {
+        if (YoriShExecTrie.BuildThread == NULL) {
+            YoriShExecTrie.Building = YoriShExecTrieCreate();
+            if (YoriShExecTrie.Building != NULL) {
+                YoriShExecTrie.BuildThread = CreateThread(NULL, 0, YoriShExecTrieBuildWorker, YoriShExecTrie.Building, 0, &ThreadId);
+                if (YoriShExecTrie.BuildThread == NULL) {
+                    YoriShExecTrieFree(YoriShExecTrie.Building);
+                    YoriShExecTrie.Building = NULL;
+                }
+            }
+        }
+        return FALSE;
+    }
+
+    Trie = YoriShExecTrie.Current;
+    if (!Trie->Usable) {
+        return FALSE;
+    }
+
+    //
+    //  Walk down the trie one character at a time.
+    //
+
+    Node = &Trie->Root;
+    for (Index = 0; Index < Prefix->LengthInChars; Index++) {
+        Char = YoriLibUpcaseChar(Prefix->StartOfString[Index]);
+        Node = Node->Child;
+        while (Node != NULL && Node->Char < Char) {
+            Node = Node->Sibling;
+        }
+        if (Node == NULL || Node->Char != Char) {
+            return TRUE;
+        }
+    }
+
+    FileCount = 0;
+    YoriShExecTrieCollectFiles(Node, NULL, &FileCount);
+    if (FileCount == 0) {
+        return TRUE;
+    }
+
+    Files = YoriLibMalloc(FileCount * sizeof(PYORI_SH_EXEC_TRIE_FILE));
+    if (Files == NULL) {
+        return FALSE;
+    }
+
+    FileCount = 0;
+    YoriShExecTrieCollectFiles(Node, Files, &FileCount);
+
+    //
+    //  Files are collected in name order.  Report them in path order, since
+    //  that is the order in which they would be found when executed.
+    //
+
+    for (DirectoryIndex = 0; DirectoryIndex < Trie->DirectoryCount; DirectoryIndex++) {
+        for (Index = 0; Index < FileCount; Index++) {
+            if (Files[Index]->DirectoryIndex == DirectoryIndex) {
+                if (!YoriShExecTrieReportFile(Trie, Files[Index], MatchCallback, MatchContext)) {
+                    YoriLibFree(Files);
+                    return TRUE;
+                }
+            }
+        }
+    }
+
+    YoriLibFree(Files);
+    return TRUE;
+}
+
+/**
+ Free all state associated with the executable name index, waiting for any
+ background build to stop.
+ */
+VOID
+YoriShExecTrieCleanup()
+{
+    if (YoriShExecTrie.BuildThread != NULL) {
+        InterlockedExchange(&YoriShExecTrie.Building->Abort, TRUE);
+        WaitForSingleObject(YoriShExecTrie.BuildThread, INFINITE);
+        CloseHandle(YoriShExecTrie.BuildThread);
+        YoriShExecTrie.BuildThread = NULL;
+        YoriShExecTrieFree(YoriShExecTrie.Building);
+        YoriShExecTrie.Building = NULL;
+    }
+
+    if (YoriShExecTrie.Current != NULL) {
+        YoriShExecTrieFree(YoriShExecTrie.Current);
+        YoriShExecTrie.Current = NULL;
+    }
+}
+
+// vim:sw=4:ts=4:et:
@@ -48,6 +48,527 @@ HANDLE YoriShHistoryLock;
  */
 BOOL YoriShHistoryInitialized;
 
+/**
+ Set to TRUE if a command has been removed from history.  Since the history
+ file may still contain the command, it is rewritten from the history buffer
+ when the shell exits rather than being compacted.
+ */
+BOOL YoriShHistoryFileRewriteRequired;
+
+/**
+ The number of commands of recency that each repeated use of a command is
+ worth when ranking history search results.
+ */
+#define YORI_SH_HISTORY_FREQUENCY_WEIGHT (8)
+
+/**
+ The maximum number of repeated uses that contribute to the rank of a
+ command.  This prevents a command that was used heavily long ago from
+ outranking everything that has been used recently.
+ */
+#define YORI_SH_HISTORY_FREQUENCY_CAP (64)
+
+/**
+ The maximum number of ranked results that a history search can step
+ through.
+ */
+#define YORI_SH_HISTORY_SEARCH_MAX_RESULTS (64)
+
+/**
+ The number of characters in each substring recorded in the history index.
+ */
+#define YORI_SH_HISTORY_TRIGRAM_LENGTH (3)
+
+/**
+ The number of removed commands that can accumulate before the index is
+ compacted, regardless of how many commands remain.
+ */
+#define YORI_SH_HISTORY_MINIMUM_STALE_SLOTS (64)
+
+/**
+ A distinct command within history.  Repeated executions of the same command
+ share a single one of these, which records how often and how recently the
+ command was used.
+ */
+typedef struct _YORI_SH_HISTORY_COMMAND {
+
+    /**
+     The entry for this command within the hash table of distinct commands,
+     keyed by the text of the command.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The text of this command.  Every history entry referring to the
+     command has exactly this text.
+     */
+    YORI_STRING CmdLine;
+
+    /**
+     The index of this command within YoriShHistoryCommands.  Entries in
+     the trigram index refer to commands by this index.
+     */
+    DWORD Slot;
+
+    /**
+     The number of history entries that refer to this command.
+     */
+    DWORD UseCount;
+
+    /**
+     The sequence number of the most recent history entry that refers to
+     this command.
+     */
+    DWORD LastSequence;
+} YORI_SH_HISTORY_COMMAND, *PYORI_SH_HISTORY_COMMAND;
+
+/**
+ A three character substring which occurs in one or more commands, and the
+ set of commands that contain it.
+ */
+typedef struct _YORI_SH_HISTORY_TRIGRAM {
+
+    /**
+     The links for this trigram within YoriShHistoryTrigramList.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry for this trigram within YoriShHistoryTrigramHash.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The characters of the trigram.  The hash entry key refers to these.
+     */
+    TCHAR Chars[YORI_SH_HISTORY_TRIGRAM_LENGTH];
+
+    /**
+     The number of elements populated in Slots.
+     */
+    DWORD SlotCount;
+
+    /**
+     The number of elements allocated in Slots.
+     */
+    DWORD SlotsAllocated;
+
+    /**
+     An array of command slots containing this trigram.  Since slots are
+     assigned in increasing order, this array is sorted from the oldest
+     command to the newest.  It may refer to slots whose command has since
+     been removed, which are skipped when searching and discarded when the
+     index is compacted.
+     */
+    PDWORD Slots;
+} YORI_SH_HISTORY_TRIGRAM, *PYORI_SH_HISTORY_TRIGRAM;
+
+/**
+ A hash table of distinct commands in history, keyed by command text.
+ */
+PYORI_HASH_TABLE YoriShHistoryCommandHash;
+
+/**
+ An array of distinct commands in history, indexed by slot.  Elements are
+ NULL if the command has been removed from history.
+ */
+PYORI_SH_HISTORY_COMMAND *YoriShHistoryCommands;
+
+/**
+ The number of slots in YoriShHistoryCommands which have been assigned.
+ */
+DWORD YoriShHistoryCommandSlotsUsed;
+
+/**
+ The number of slots allocated in YoriShHistoryCommands.
+ */
+DWORD YoriShHistoryCommandSlotsAllocated;
+
+/**
+ The number of slots in YoriShHistoryCommands which refer to a command.
+ */
+DWORD YoriShHistoryCommandsLive;
+
+/**
+ A hash table of trigrams found in history commands.
+ */
+PYORI_HASH_TABLE YoriShHistoryTrigramHash;
+
+/**
+ A list of trigrams found in history commands.
+ */
+YORI_LIST_ENTRY YoriShHistoryTrigramList;
+
+/**
+ Set to TRUE if the trigram index describes every command in history.  If
+ memory could not be allocated to maintain it, this is FALSE and searches
+ inspect every command.
+ */
+BOOL YoriShHistoryTrigramsValid;
+
+/**
+ The sequence number to assign to the next history entry.
+ */
+DWORD YoriShHistorySequence;
+
+/**
+ Free the trigram index.  Searches will inspect every command until the
+ index is rebuilt.
+ */
+VOID
+YoriShHistoryFreeTrigrams()
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_HISTORY_TRIGRAM Trigram;
+
+    YoriShHistoryTrigramsValid = FALSE;
+
+    if (YoriShHistoryTrigramList.Next != NULL) {
+        ListEntry = YoriLibGetNextListEntry(&YoriShHistoryTrigramList, NULL);
+        while (ListEntry != NULL) {
+            Trigram = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_TRIGRAM, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&YoriShHistoryTrigramList, ListEntry);
+            YoriLibRemoveListItem(&Trigram->ListEntry);
+            YoriLibHashRemoveByEntry(&Trigram->HashEntry);
+            if (Trigram->Slots != NULL) {
+                YoriLibFree(Trigram->Slots);
+            }
+            YoriLibFree(Trigram);
+        }
+    }
+
+    if (YoriShHistoryTrigramHash != NULL) {
+        YoriLibFreeEmptyHashTable(YoriShHistoryTrigramHash);
+        YoriShHistoryTrigramHash = NULL;
+    }
+}
+
+/**
+ Record each trigram in a command within the trigram index.
+
+ @param Command Pointer to the command to index.
+
+ @return TRUE to indicate success, FALSE to indicate allocation failure.
+ */
+__success(return)
+BOOL
+YoriShHistoryIndexTrigrams(
+    __in PYORI_SH_HISTORY_COMMAND Command
+    )
+{
+    YORI_STRING Key;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_SH_HISTORY_TRIGRAM Trigram;
+    PDWORD NewSlots;
+    DWORD NewSlotsAllocated;
+    DWORD Index;
+
+    YoriLibInitEmptyString(&Key);
+
+    for (Index = 0; Index + YORI_SH_HISTORY_TRIGRAM_LENGTH <= Command->CmdLine.LengthInChars; Index++) {
+        Key.StartOfString = &Command->CmdLine.StartOfString[Index];
+        Key.LengthInChars = YORI_SH_HISTORY_TRIGRAM_LENGTH;
+
+        HashEntry = YoriLibHashLookupByKey(YoriShHistoryTrigramHash, &Key);
+        if (HashEntry != NULL) {
+            Trigram = HashEntry->Context;
+        } else {
+            Trigram = YoriLibMalloc(sizeof(YORI_SH_HISTORY_TRIGRAM));
+            if (Trigram == NULL) {
+                return FALSE;
+            }
+
+            memcpy(Trigram->Chars, Key.StartOfString, sizeof(Trigram->Chars));
+            Trigram->SlotCount = 0;
+            Trigram->SlotsAllocated = 0;
+            Trigram->Slots = NULL;
+
+            Key.StartOfString = Trigram->Chars;
+            YoriLibHashInsertByKey(YoriShHistoryTrigramHash, &Key, Trigram, &Trigram->HashEntry);
+            YoriLibAppendList(&YoriShHistoryTrigramList, &Trigram->ListEntry);
+        }
+
+        //
+        //  If the command contains the same trigram more than once, it has
+        //  already been added, and since it is the newest slot, it is last.
+        //
+
+        if (Trigram->SlotCount > 0 &&
+            Trigram->Slots[Trigram->SlotCount - 1] == Command->Slot) {
+
+            continue;
+        }
+
+        if (Trigram->SlotCount == Trigram->SlotsAllocated) {
+            NewSlotsAllocated = Trigram->SlotsAllocated * 2;
+            if (NewSlotsAllocated == 0) {
+                NewSlotsAllocated = 4;
+            }
+
+            NewSlots = YoriLibMalloc(NewSlotsAllocated * sizeof(DWORD));
+            if (NewSlots == NULL) {
+                return FALSE;
+            }
+
+            if (Trigram->Slots != NULL) {
+                memcpy(NewSlots, Trigram->Slots, Trigram->SlotCount * sizeof(DWORD));
+                YoriLibFree(Trigram->Slots);
+            }
+
+            Trigram->Slots = NewSlots;
+            Trigram->SlotsAllocated = NewSlotsAllocated;
+        }
+
+        Trigram->Slots[Trigram->SlotCount] = Command->Slot;
+        Trigram->SlotCount++;
+    }
+
+    return TRUE;
+}
+
+/**
+ Compact the array of distinct commands so that no slots refer to removed
+ commands, and rebuild the trigram index over the remaining commands.
+
+ @return TRUE if the trigram index was rebuilt, FALSE if it could not be
+         allocated.
+ */
+__success(return)
+BOOL
+YoriShHistoryRebuildIndex()
+{
+    PYORI_SH_HISTORY_COMMAND Command;
+    DWORD Index;
+    DWORD NewSlot;
+
+    YoriShHistoryFreeTrigrams();
+
+    NewSlot = 0;
+    for (Index = 0; Index < YoriShHistoryCommandSlotsUsed; Index++) {
+        Command = YoriShHistoryCommands[Index];
+        if (Command != NULL) {
+            Command->Slot = NewSlot;
+            YoriShHistoryCommands[NewSlot] = Command;
+            NewSlot++;
+        }
+    }
+    YoriShHistoryCommandSlotsUsed = NewSlot;
+
+    YoriShHistoryTrigramHash = YoriLibAllocateHashTable(4096);
+    if (YoriShHistoryTrigramHash == NULL) {
+        return FALSE;
+    }
+
+    YoriLibInitializeListHead(&YoriShHistoryTrigramList);
+    YoriShHistoryTrigramsValid = TRUE;
+
+    for (Index = 0; Index < YoriShHistoryCommandSlotsUsed; Index++) {
+        if (!YoriShHistoryIndexTrigrams(YoriShHistoryCommands[Index])) {
+            YoriShHistoryFreeTrigrams();
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Free all distinct commands and the index over them.  This is used when
+ all history entries are being removed.
+ */
+VOID
+YoriShHistoryFreeIndex()
+{
+    PYORI_SH_HISTORY_COMMAND Command;
+    DWORD Index;
+
+    YoriShHistoryFreeTrigrams();
+
+    for (Index = 0; Index < YoriShHistoryCommandSlotsUsed; Index++) {
+        Command = YoriShHistoryCommands[Index];
+        if (Command != NULL) {
+            YoriLibHashRemoveByEntry(&Command->HashEntry);
+            YoriLibFreeStringContents(&Command->CmdLine);
+            YoriLibFree(Command);
+        }
+    }
+
+    if (YoriShHistoryCommands != NULL) {
+        YoriLibFree(YoriShHistoryCommands);
+        YoriShHistoryCommands = NULL;
+    }
+
+    if (YoriShHistoryCommandHash != NULL) {
+        YoriLibFreeEmptyHashTable(YoriShHistoryCommandHash);
+        YoriShHistoryCommandHash = NULL;
+    }
+
+    YoriShHistoryCommandSlotsUsed = 0;
+    YoriShHistoryCommandSlotsAllocated = 0;
+    YoriShHistoryCommandsLive = 0;
+}
+
+/**
+ Add a new history entry to the index.  If the entry refers to a command
+ that has been seen before, the existing command is updated; otherwise a
+ new command is allocated and its trigrams are indexed.
+
+ @param HistoryEntry Pointer to the history entry to add.  On successful
+        completion, this entry is assigned a sequence number and refers to
+        its command.
+
+ @return TRUE to indicate success, FALSE to indicate allocation failure.
+ */
+__success(return)
+BOOL
+YoriShHistoryIndexAddEntry(
+    __inout PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_SH_HISTORY_COMMAND Command;
+    PYORI_SH_HISTORY_COMMAND *NewCommands;
+    DWORD NewSlotsAllocated;
+
+    if (YoriShHistoryCommandHash == NULL) {
+        YoriShHistoryCommandHash = YoriLibAllocateHashTable(1024);
+        if (YoriShHistoryCommandHash == NULL) {
+            return FALSE;
+        }
+        YoriShHistoryRebuildIndex();
+    }
+
+    //
+    //  Commands that differ only by case are distinct commands, since the
+    //  programs they invoke may treat their arguments differently.
+    //
+
+    HashEntry = YoriLibHashLookupByKeyCaseSensitive(YoriShHistoryCommandHash, &HistoryEntry->CmdLine);
+    if (HashEntry != NULL) {
+        Command = HashEntry->Context;
+        Command->UseCount++;
+        Command->LastSequence = YoriShHistorySequence;
+        HistoryEntry->Sequence = YoriShHistorySequence;
+        HistoryEntry->Command = Command;
+        YoriShHistorySequence++;
+        return TRUE;
+    }
+
+    if (YoriShHistoryCommandSlotsUsed == YoriShHistoryCommandSlotsAllocated) {
+        NewSlotsAllocated = YoriShHistoryCommandSlotsAllocated * 2;
+        if (NewSlotsAllocated == 0) {
+            NewSlotsAllocated = 256;
+        }
+
+        NewCommands = YoriLibMalloc(NewSlotsAllocated * sizeof(PYORI_SH_HISTORY_COMMAND));
+        if (NewCommands == NULL) {
+            return FALSE;
+        }
+
+        if (YoriShHistoryCommands != NULL) {
+            memcpy(NewCommands, YoriShHistoryCommands, YoriShHistoryCommandSlotsUsed * sizeof(PYORI_SH_HISTORY_COMMAND));
+            YoriLibFree(YoriShHistoryCommands);
+        }
+
+        YoriShHistoryCommands = NewCommands;
+        YoriShHistoryCommandSlotsAllocated = NewSlotsAllocated;
+    }
+
+    Command = YoriLibMalloc(sizeof(YORI_SH_HISTORY_COMMAND));
+    if (Command == NULL) {
+        return FALSE;
+    }
+
+    YoriLibCloneString(&Command->CmdLine, &HistoryEntry->CmdLine);
+    Command->Slot = YoriShHistoryCommandSlotsUsed;
+    Command->UseCount = 1;
+    Command->LastSequence = YoriShHistorySequence;
+    YoriLibHashInsertByKey(YoriShHistoryCommandHash, &Command->CmdLine, Command, &Command->HashEntry);
+
+    YoriShHistoryCommands[Command->Slot] = Command;
+    YoriShHistoryCommandSlotsUsed++;
+    YoriShHistoryCommandsLive++;
+
+    HistoryEntry->Sequence = YoriShHistorySequence;
+    HistoryEntry->Command = Command;
+    YoriShHistorySequence++;
+
+    if (YoriShHistoryTrigramsValid && !YoriShHistoryIndexTrigrams(Command)) {
+        YoriShHistoryFreeTrigrams();
+    }
+
+    return TRUE;
+}
+
+/**
+ Remove a history entry from the index.  The entry must already have been
+ removed from the history list.  If this was the last entry referring to
+ its command, the command is removed, and once enough commands have been
+ removed the index is compacted.
+
+ @param HistoryEntry Pointer to the history entry being removed.
+ */
+VOID
+YoriShHistoryIndexRemoveEntry(
+    __inout PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    PYORI_SH_HISTORY_COMMAND Command;
+    PYORI_SH_HISTORY_ENTRY OtherEntry;
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD StaleSlots;
+
+    Command = HistoryEntry->Command;
+    if (Command == NULL) {
+        return;
+    }
+
+    HistoryEntry->Command = NULL;
+    Command->UseCount--;
+
+    if (Command->UseCount > 0) {
+
+        //
+        //  If the most recent use of the command is being removed, find
+        //  the next most recent one.  History is normally trimmed from
+        //  the oldest end so this is only needed when the user deletes
+        //  an entry explicitly.
+        //
+
+        if (Command->LastSequence == HistoryEntry->Sequence) {
+            ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, NULL);
+            while (ListEntry != NULL) {
+                OtherEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
+                if (OtherEntry->Command == Command) {
+                    Command->LastSequence = OtherEntry->Sequence;
+                    break;
+                }
+                ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+            }
+        }
+        return;
+    }
+
+    YoriLibHashRemoveByEntry(&Command->HashEntry);
+    YoriShHistoryCommands[Command->Slot] = NULL;
+    YoriShHistoryCommandsLive--;
+    YoriLibFreeStringContents(&Command->CmdLine);
+    YoriLibFree(Command);
+
+    //
+    //  Trigrams still refer to the removed slot.  Rather than searching
+    //  for and removing those now, leave them in place until they make up
+    //  over half of the index, then rebuild it.
+    //
+
+    StaleSlots = YoriShHistoryCommandSlotsUsed - YoriShHistoryCommandsLive;
+    if (StaleSlots >= YORI_SH_HISTORY_MINIMUM_STALE_SLOTS &&
+        StaleSlots > YoriShHistoryCommandsLive) {
+
+        YoriShHistoryRebuildIndex();
+    }
+}
+
 /**
  Add an entered command into the command history buffer.
 
@@ -82,6 +603,13 @@ YoriShAddToHistory(
 
         YoriLibCloneString(&NewHistoryEntry->CmdLine, NewCmd);
 
+        if (!YoriShHistoryIndexAddEntry(NewHistoryEntry)) {
+            YoriLibFreeStringContents(&NewHistoryEntry->CmdLine);
+            YoriLibFree(NewHistoryEntry);
+            ReleaseMutex(YoriShHistoryLock);
+            return FALSE;
+        }
+
         if (YoriShGlobal.CommandHistory.Next == NULL) {
             YoriLibInitializeListHead(&YoriShGlobal.CommandHistory);
         }
@@ -95,6 +623,7 @@ YoriShAddToHistory(
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
             OldHistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
             YoriLibRemoveListItem(ListEntry);
+            YoriShHistoryIndexRemoveEntry(OldHistoryEntry);
             YoriLibFreeStringContents(&OldHistoryEntry->CmdLine);
             YoriLibFree(OldHistoryEntry);
             YoriShCommandHistoryCount--;
@@ -117,9 +646,11 @@ YoriShRemoveOneHistoryEntry(
 {
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
         YoriLibRemoveListItem(&HistoryEntry->ListEntry);
+        YoriShHistoryIndexRemoveEntry(HistoryEntry);
         YoriLibFreeStringContents(&HistoryEntry->CmdLine);
         YoriLibFree(HistoryEntry);
         YoriShCommandHistoryCount--;
+        YoriShHistoryFileRewriteRequired = TRUE;
         ReleaseMutex(YoriShHistoryLock);
     }
 }
@@ -143,10 +674,166 @@ YoriShClearAllHistory()
             YoriLibFree(HistoryEntry);
             YoriShCommandHistoryCount--;
         }
+        YoriShHistoryFreeIndex();
         ReleaseMutex(YoriShHistoryLock);
     }
 }
 
+/**
+ Search history for commands containing a specified string.  Matching
+ commands are ranked by how recently and how frequently they were used,
+ and the caller specifies which of these to return.  Repeated executions
+ of the same command are only counted once.
+
+ @param SearchString Pointer to the string to search for.  Matching is
+        case insensitive.
+
+ @param MatchIndex Specifies which match to return, where zero is the
+        highest ranked match.
+
+ @param Match On successful completion, updated to refer to the matching
+        command.  The caller should free this with
+        @ref YoriLibFreeStringContents .
+
+ @param StringOffsetOfMatch Optionally points to a location to receive the
+        offset within the matching command where SearchString was found.
+
+ @return TRUE to indicate a match was found, FALSE if it was not.
+ */
+__success(return)
+BOOL
+YoriShSearchHistory(
+    __in PYORI_STRING SearchString,
+    __in DWORD MatchIndex,
+    __out PYORI_STRING Match,
+    __out_opt PDWORD StringOffsetOfMatch
+    )
+{
+    PYORI_SH_HISTORY_COMMAND Results[YORI_SH_HISTORY_SEARCH_MAX_RESULTS];
+    DWORD ResultScores[YORI_SH_HISTORY_SEARCH_MAX_RESULTS];
+    DWORD ResultOffsets[YORI_SH_HISTORY_SEARCH_MAX_RESULTS];
+    DWORD ResultCount;
+    DWORD ResultsNeeded;
+    PYORI_SH_HISTORY_COMMAND Command;
+    PYORI_SH_HISTORY_TRIGRAM Trigram;
+    PYORI_HASH_ENTRY HashEntry;
+    YORI_STRING Key;
+    PDWORD Candidates;
+    DWORD CandidateCount;
+    DWORD Index;
+    DWORD Insert;
+    DWORD Score;
+    DWORD ExtraUses;
+    DWORD Offset;
+    BOOL Found;
+
+    if (SearchString->LengthInChars == 0 ||
+        MatchIndex >= YORI_SH_HISTORY_SEARCH_MAX_RESULTS) {
+
+        return FALSE;
+    }
+
+    if (WaitForSingleObject(YoriShHistoryLock, 0) != WAIT_OBJECT_0) {
+        return FALSE;
+    }
+
+    //
+    //  Any command containing the search string must contain each of its
+    //  trigrams, so only the commands containing the rarest trigram need
+    //  to be inspected.  If the search string is too short or the index
+    //  is not available, inspect every command.
+    //
+
+    Candidates = NULL;
+    CandidateCount = YoriShHistoryCommandSlotsUsed;
+
+    if (YoriShHistoryTrigramsValid &&
+        SearchString->LengthInChars >= YORI_SH_HISTORY_TRIGRAM_LENGTH) {
+
+        YoriLibInitEmptyString(&Key);
+        for (Index = 0; Index + YORI_SH_HISTORY_TRIGRAM_LENGTH <= SearchString->LengthInChars; Index++) {
+            Key.StartOfString = &SearchString->StartOfString[Index];
+            Key.LengthInChars = YORI_SH_HISTORY_TRIGRAM_LENGTH;
+            HashEntry = YoriLibHashLookupByKey(YoriShHistoryTrigramHash, &Key);
+            if (HashEntry == NULL) {
+                CandidateCount = 0;
+                break;
+            }
+
+            Trigram = HashEntry->Context;
+            if (Candidates == NULL || Trigram->SlotCount < CandidateCount) {
+                Candidates = Trigram->Slots;
+                CandidateCount = Trigram->SlotCount;
+            }
+        }
+    }
+
+    //
+    //  Walk candidates from newest to oldest, keeping the highest ranked
+    //  matches sorted by score.  The score is computed before the more
+    //  expensive substring comparison so that commands which could not
+    //  displace an existing result are skipped cheaply.
+    //
+
+    ResultCount = 0;
+    ResultsNeeded = MatchIndex + 1;
+    Index = CandidateCount;
+    while (Index > 0) {
+        Index--;
+        if (Candidates != NULL) {
+            Command = YoriShHistoryCommands[Candidates[Index]];
+        } else {
+            Command = YoriShHistoryCommands[Index];
+        }
+
+        if (Command == NULL) {
+            continue;
+        }
+
+        ExtraUses = Command->UseCount - 1;
+        if (ExtraUses > YORI_SH_HISTORY_FREQUENCY_CAP) {
+            ExtraUses = YORI_SH_HISTORY_FREQUENCY_CAP;
+        }
+        Score = Command->LastSequence + ExtraUses * YORI_SH_HISTORY_FREQUENCY_WEIGHT;
+
+        if (ResultCount == ResultsNeeded && Score <= ResultScores[ResultCount - 1]) {
+            continue;
+        }
+
+        if (!YoriLibFindFirstMatchingSubstringInsensitive(&Command->CmdLine, 1, SearchString, &Offset)) {
+            continue;
+        }
+
+        if (ResultCount < ResultsNeeded) {
+            ResultCount++;
+        }
+
+        Insert = ResultCount - 1;
+        while (Insert > 0 && ResultScores[Insert - 1] < Score) {
+            Results[Insert] = Results[Insert - 1];
+            ResultScores[Insert] = ResultScores[Insert - 1];
+            ResultOffsets[Insert] = ResultOffsets[Insert - 1];
+            Insert--;
+        }
+
+        Results[Insert] = Command;
+        ResultScores[Insert] = Score;
+        ResultOffsets[Insert] = Offset;
+    }
+
+    Found = FALSE;
+    if (ResultCount == ResultsNeeded) {
+        YoriLibCloneString(Match, &Results[MatchIndex]->CmdLine);
+        if (StringOffsetOfMatch != NULL) {
+            *StringOffsetOfMatch = ResultOffsets[MatchIndex];
+        }
+        Found = TRUE;
+    }
+
+    ReleaseMutex(YoriShHistoryLock);
+    return Found;
+}
+
 /**
  Configure the maximum amount of history to retain if the user has requested
  this behavior by setting YORIHISTSIZE.
@@ -212,155 +899,658 @@ YoriShInitHistory()
 }
 
 /**
- Load history from a file if the user has requested this behavior by
- setting YORIHISTFILE.  Configure the maximum amount of history to retain
- if the user has requested this behavior by setting YORIHISTSIZE.
+ The number of bytes per line assumed when estimating how far from the end
+ of the history file the most recent lines begin.
+ */
+#define YORI_SH_HISTORY_ESTIMATED_LINE_SIZE (256)
 
- @return TRUE to indicate success, FALSE to indicate failure.
+/**
+ The number of times to attempt to open the history file if another shell
+ has it open exclusively.
+ */
+#define YORI_SH_HISTORY_OPEN_ATTEMPTS (20)
+
+/**
+ The number of milliseconds to wait between attempts to open the history
+ file.
+ */
+#define YORI_SH_HISTORY_OPEN_RETRY_DELAY (50)
+
+/**
+ Resolve the history file that the user has requested by configuring the
+ YORIHISTFILE environment variable to a full path.
+
+ @param FilePath On successful completion, updated to contain the full path
+        to the history file.  The caller should free this with
+        @ref YoriLibFreeStringContents .
+
+ @return TRUE if a history file is configured and its path was resolved,
+         FALSE if no history file is configured or the path could not be
+         resolved.
  */
 __success(return)
 BOOL
-YoriShLoadHistoryFromFile()
+YoriShGetHistoryFilePath(
+    __out PYORI_STRING FilePath
+    )
 {
     DWORD EnvVarLength;
     YORI_STRING UserHistFileName;
-    YORI_STRING FilePath;
+
+    EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
+    if (EnvVarLength == 0) {
+        return FALSE;
+    }
+
+    if (!YoriLibAllocateString(&UserHistFileName, EnvVarLength)) {
+        return FALSE;
+    }
+
+    UserHistFileName.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), UserHistFileName.StartOfString, UserHistFileName.LengthAllocated, NULL);
+
+    if (UserHistFileName.LengthInChars == 0 || UserHistFileName.LengthInChars >= UserHistFileName.LengthAllocated) {
+        YoriLibFreeStringContents(&UserHistFileName);
+        return FALSE;
+    }
+
+    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, FilePath)) {
+        YoriLibFreeStringContents(&UserHistFileName);
+        return FALSE;
+    }
+
+    YoriLibFreeStringContents(&UserHistFileName);
+    return TRUE;
+}
+
+/**
+ Open the history file.  Because a shell compacting the history file opens
+ it exclusively for a brief period, a sharing violation is retried for a
+ short time before failing.
+
+ @param FilePath Pointer to the full path to the history file.
+
+ @param DesiredAccess The access to request to the file.
+
+ @param ShareMode The access to allow other shells to the file.
+
+ @param CreationDisposition Specifies whether the file should be created if
+        it does not exist.
+
+ @return A handle to the opened file, or INVALID_HANDLE_VALUE on failure.
+         On failure, the error is available from GetLastError.
+ */
+HANDLE
+YoriShOpenHistoryFile(
+    __in PYORI_STRING FilePath,
+    __in DWORD DesiredAccess,
+    __in DWORD ShareMode,
+    __in DWORD CreationDisposition
+    )
+{
     HANDLE FileHandle;
-    PVOID LineContext = NULL;
-    YORI_STRING LineString;
+    DWORD Attempt;
 
-    if (YoriShHistoryInitialized) {
+    FileHandle = INVALID_HANDLE_VALUE;
+    for (Attempt = 0; Attempt < YORI_SH_HISTORY_OPEN_ATTEMPTS; Attempt++) {
+        if (Attempt > 0) {
+            Sleep(YORI_SH_HISTORY_OPEN_RETRY_DELAY);
+        }
+
+        FileHandle = CreateFile(FilePath->StartOfString,
+                                DesiredAccess,
+                                ShareMode,
+                                NULL,
+                                CreationDisposition,
+                                FILE_ATTRIBUTE_NORMAL,
+                                NULL);
+
+        if (FileHandle != INVALID_HANDLE_VALUE ||
+            GetLastError() != ERROR_SHARING_VIOLATION) {
+
+            break;
+        }
+    }
+
+    return FileHandle;
+}
+
+/**
+ Write a single command to the history file as one CRLF terminated line.
+ The line is written with a single write so that when the file is opened
+ for append, lines from concurrent shells are never interleaved.
+
+ @param FileHandle Handle to the history file.
+
+ @param CmdLine Pointer to the command to write.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShWriteHistoryLine(
+    __in HANDLE FileHandle,
+    __in PYORI_STRING CmdLine
+    )
+{
+    YORI_STRING Line;
+    LPSTR Buffer;
+    DWORD BytesNeeded;
+    DWORD BytesWritten;
+    BOOL Result;
+
+    if (!YoriLibAllocateString(&Line, CmdLine->LengthInChars + 2)) {
+        return FALSE;
+    }
+
+    memcpy(Line.StartOfString, CmdLine->StartOfString, CmdLine->LengthInChars * sizeof(TCHAR));
+    Line.StartOfString[CmdLine->LengthInChars] = '\r';
+    Line.StartOfString[CmdLine->LengthInChars + 1] = '\n';
+    Line.LengthInChars = CmdLine->LengthInChars + 2;
+
+    BytesNeeded = YoriLibGetMultibyteOutputSizeNeeded(Line.StartOfString, Line.LengthInChars);
+    Buffer = YoriLibMalloc(BytesNeeded);
+    if (Buffer == NULL) {
+        YoriLibFreeStringContents(&Line);
+        return FALSE;
+    }
+
+    YoriLibMultibyteOutput(Line.StartOfString, Line.LengthInChars, Buffer, BytesNeeded);
+    Result = WriteFile(FileHandle, Buffer, BytesNeeded, &BytesWritten, NULL);
+
+    YoriLibFree(Buffer);
+    YoriLibFreeStringContents(&Line);
+    return Result;
+}
+
+/**
+ Free an array of lines returned from @ref YoriShReadHistoryFileTail .
+
+ @param Lines Pointer to the array of lines.
+
+ @param LineCount The number of lines in the array.
+ */
+VOID
+YoriShFreeHistoryFileLines(
+    __in_opt PYORI_STRING Lines,
+    __in DWORD LineCount
+    )
+{
+    DWORD Index;
+
+    if (Lines == NULL) {
+        return;
+    }
+
+    for (Index = 0; Index < LineCount; Index++) {
+        YoriLibFreeStringContents(&Lines[Index]);
+    }
+
+    YoriLibFree(Lines);
+}
+
+/**
+ Read the final lines from the history file.  Rather than reading the whole
+ file, this starts from an estimate of where the final lines begin, and
+ only moves further back if that estimate did not include enough lines, so
+ only the end of the file is mapped and parsed.
+
+ @param FileHandle Handle to the history file.
+
+ @param MaximumLines The number of lines to return from the end of the
+        file.
+
+ @param Lines On successful completion, updated to point to an array of
+        lines, oldest first.  This may be NULL if there are no lines.  The
+        caller should free this with @ref YoriShFreeHistoryFileLines .
+
+ @param LineCount On successful completion, updated to contain the number
+        of lines in Lines.
+
+ @param TailOffset On successful completion, updated to contain the file
+        offset of the first line returned.  This is zero if the offset could
+        not be determined.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShReadHistoryFileTail(
+    __in HANDLE FileHandle,
+    __in DWORD MaximumLines,
+    __out PYORI_STRING *Lines,
+    __out PDWORD LineCount,
+    __out PLONGLONG TailOffset
+    )
+{
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER WindowOffset;
+    LONG OffsetHigh;
+    LONGLONG WindowSize;
+    PVOID LineContext;
+    YORI_LIB_LINE_VIEW LineView;
+    PYORI_STRING LineArray;
+    DWORD LinesFound;
+    DWORD LinesToSkip;
+    DWORD LinesToReturn;
+    DWORD Index;
+
+    *Lines = NULL;
+    *LineCount = 0;
+    *TailOffset = 0;
+
+    if (MaximumLines == 0) {
         return TRUE;
     }
 
-    YoriShInitHistory();
+    FileSize.LowPart = GetFileSize(FileHandle, (LPDWORD)&FileSize.HighPart);
+    if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        return FALSE;
+    }
 
     //
-    //  Check if there's a file to load saved history from.
+    //  Count the lines from the estimated starting point.  If reading began
+    //  partway through the file the first line may be incomplete, so more
+    //  than MaximumLines are needed to stop.  Otherwise move the starting
+    //  point back, until the whole file is being read.
     //
 
-    EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
-    if (EnvVarLength == 0) {
+    WindowSize = (LONGLONG)MaximumLines * YORI_SH_HISTORY_ESTIMATED_LINE_SIZE;
+    while (TRUE) {
+        if (WindowSize >= FileSize.QuadPart) {
+            WindowOffset.QuadPart = 0;
+        } else {
+            WindowOffset.QuadPart = FileSize.QuadPart - WindowSize;
+        }
+
+        OffsetHigh = WindowOffset.HighPart;
+        SetFilePointer(FileHandle, WindowOffset.LowPart, &OffsetHigh, FILE_BEGIN);
+        if (!YoriLibLineViewOpen(FileHandle, &LineContext)) {
+            return FALSE;
+        }
+
+        LinesFound = 0;
+        while (YoriLibLineViewNext(LineContext, &LineView)) {
+            LinesFound++;
+        }
+        YoriLibLineViewClose(LineContext);
+
+        if (WindowOffset.QuadPart == 0 || LinesFound > MaximumLines) {
+            break;
+        }
+
+        WindowSize = WindowSize * 4;
+    }
+
+    LinesToSkip = 0;
+    if (LinesFound > MaximumLines) {
+        LinesToSkip = LinesFound - MaximumLines;
+    }
+    LinesToReturn = LinesFound - LinesToSkip;
+
+    if (LinesToReturn == 0) {
         return TRUE;
     }
 
-    if (!YoriLibAllocateString(&UserHistFileName, EnvVarLength)) {
+    LineArray = YoriLibMalloc(LinesToReturn * sizeof(YORI_STRING));
+    if (LineArray == NULL) {
         return FALSE;
     }
 
-    UserHistFileName.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), UserHistFileName.StartOfString, UserHistFileName.LengthAllocated, NULL);
+    //
+    //  Return to the starting point, skip the lines that are not needed,
+    //  and capture the remainder.  If another shell appended lines in the
+    //  meantime, they are ignored.
+    //
 
-    if (UserHistFileName.LengthInChars == 0 || UserHistFileName.LengthInChars >= UserHistFileName.LengthAllocated) {
-        YoriLibFreeStringContents(&UserHistFileName);
+    OffsetHigh = WindowOffset.HighPart;
+    SetFilePointer(FileHandle, WindowOffset.LowPart, &OffsetHigh, FILE_BEGIN);
+    if (!YoriLibLineViewOpen(FileHandle, &LineContext)) {
+        YoriLibFree(LineArray);
         return FALSE;
     }
 
-    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, &FilePath)) {
-        YoriLibFreeStringContents(&UserHistFileName);
+    for (Index = 0; Index < LinesToSkip; Index++) {
+        if (!YoriLibLineViewNext(LineContext, &LineView)) {
+            break;
+        }
+    }
+
+    if (!YoriLibLineViewGetOffset(LineContext, TailOffset)) {
+        *TailOffset = 0;
+    }
+
+    for (Index = 0; Index < LinesToReturn; Index++) {
+        YoriLibInitEmptyString(&LineArray[Index]);
+        if (!YoriLibLineViewNext(LineContext, &LineView) ||
+            !YoriLibLineViewToString(&LineView, &LineArray[Index])) {
+
+            break;
+        }
+    }
+    YoriLibLineViewClose(LineContext);
+
+    *Lines = LineArray;
+    *LineCount = Index;
+    return TRUE;
+}
+
+/**
+ Rewrite the history file to contain only the lines that would be loaded
+ by a new shell, without duplicates, if the file has grown large enough
+ that most of it is no longer loaded.  Where a command appears more than
+ once, its most recent occurrence is kept.  The file must have been opened
+ for exclusive access, so other shells wait for this to complete before
+ reading or appending.
+
+ @param FileHandle Handle to the history file, opened for read and write
+        access.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShCompactHistoryFile(
+    __in HANDLE FileHandle
+    )
+{
+    PYORI_STRING Lines;
+    DWORD LineCount;
+    LONGLONG TailOffset;
+    LARGE_INTEGER FileSize;
+    PYORI_HASH_TABLE HashTable;
+    PYORI_HASH_ENTRY HashEntries;
+    DWORD Index;
+    BOOL Result;
+
+    if (!YoriShReadHistoryFileTail(FileHandle, YoriShCommandHistoryMax, &Lines, &LineCount, &TailOffset)) {
         return FALSE;
     }
 
-    YoriLibFreeStringContents(&UserHistFileName);
+    FileSize.LowPart = GetFileSize(FileHandle, (LPDWORD)&FileSize.HighPart);
+    if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        YoriShFreeHistoryFileLines(Lines, LineCount);
+        return FALSE;
+    }
+
+    //
+    //  Only compact once the part of the file that is no longer loaded is
+    //  larger than the part that is.
+    //
 
-    FileHandle = CreateFile(FilePath.StartOfString,
-                            GENERIC_READ,
-                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-                            NULL,
-                            OPEN_EXISTING,
-                            FILE_ATTRIBUTE_NORMAL,
-                            NULL);
+    if (LineCount == 0 || TailOffset <= FileSize.QuadPart - TailOffset) {
+        YoriShFreeHistoryFileLines(Lines, LineCount);
+        return TRUE;
+    }
+
+    HashTable = YoriLibAllocateHashTable(LineCount);
+    if (HashTable == NULL) {
+        YoriShFreeHistoryFileLines(Lines, LineCount);
+        return FALSE;
+    }
 
-    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
+    HashEntries = YoriLibMalloc(LineCount * sizeof(YORI_HASH_ENTRY));
+    if (HashEntries == NULL) {
+        YoriLibFreeEmptyHashTable(HashTable);
+        YoriShFreeHistoryFileLines(Lines, LineCount);
+        return FALSE;
+    }
+    ZeroMemory(HashEntries, LineCount * sizeof(YORI_HASH_ENTRY));
+
+    //
+    //  Walk from newest to oldest so the most recent occurrence of each
+    //  command is the one retained.  Older duplicates are emptied, and
+    //  empty lines are not written.  Lines that differ only by case are
+    //  different commands and are both retained.
+    //
+
+    Index = LineCount;
+    while (Index > 0) {
+        Index--;
+        if (Lines[Index].LengthInChars == 0) {
+            continue;
+        }
+
+        if (YoriLibHashLookupByKeyCaseSensitive(HashTable, &Lines[Index]) != NULL) {
+            YoriLibFreeStringContents(&Lines[Index]);
+            continue;
+        }
+
+        YoriLibHashInsertByKey(HashTable, &Lines[Index], NULL, &HashEntries[Index]);
+    }
+
+    SetFilePointer(FileHandle, 0, NULL, FILE_BEGIN);
+    Result = TRUE;
+    for (Index = 0; Index < LineCount; Index++) {
+        if (Lines[Index].LengthInChars > 0) {
+            if (!YoriShWriteHistoryLine(FileHandle, &Lines[Index])) {
+                Result = FALSE;
+                break;
+            }
+        }
+    }
+
+    if (Result) {
+        SetEndOfFile(FileHandle);
+    }
+
+    for (Index = 0; Index < LineCount; Index++) {
+        if (HashEntries[Index].HashTable != NULL) {
+            YoriLibHashRemoveByEntry(&HashEntries[Index]);
+        }
+    }
+
+    YoriLibFree(HashEntries);
+    YoriLibFreeEmptyHashTable(HashTable);
+    YoriShFreeHistoryFileLines(Lines, LineCount);
+    return Result;
+}
+
+/**
+ Load history from a file if the user has requested this behavior by
+ setting YORIHISTFILE.  Configure the maximum amount of history to retain
+ if the user has requested this behavior by setting YORIHISTSIZE.  Only
+ the final YORIHISTSIZE lines of the file are read.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShLoadHistoryFromFile()
+{
+    YORI_STRING FilePath;
+    HANDLE FileHandle;
+    PYORI_STRING Lines;
+    DWORD LineCount;
+    LONGLONG TailOffset;
+    DWORD Index;
+
+    if (YoriShHistoryInitialized) {
+        return TRUE;
+    }
+
+    YoriShInitHistory();
+
+    //
+    //  Check if there's a file to load saved history from.
+    //
+
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
+        return TRUE;
+    }
+
+    FileHandle = YoriShOpenHistoryFile(&FilePath,
+                                       GENERIC_READ,
+                                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                       OPEN_EXISTING);
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
         DWORD LastError = GetLastError();
         if (LastError != ERROR_FILE_NOT_FOUND) {
             LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
             YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
             YoriLibFreeWinErrorText(ErrText);
-            YoriLibFreeStringContents(&FilePath);
         }
+        YoriLibFreeStringContents(&FilePath);
         return FALSE;
     }
 
     YoriLibFreeStringContents(&FilePath);
 
-    YoriLibInitEmptyString(&LineString);
-
-    while (TRUE) {
+    if (!YoriShReadHistoryFileTail(FileHandle, YoriShCommandHistoryMax, &Lines, &LineCount, &TailOffset)) {
+        CloseHandle(FileHandle);
+        return FALSE;
+    }
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, FileHandle)) {
-            break;
-        }
+    CloseHandle(FileHandle);
 
-        //
-        //  If we fail to add to history, stop.  If it is added to history,
-        //  that string is now owned by the history buffer, so reinitialize
-        //  between lines.  The free below is really just a dereference.
-        //
+    //
+    //  If we fail to add to history, stop.  Lines added to history are
+    //  referenced by the history buffer, so the free below is really just
+    //  a dereference.
+    //
 
-        if (!YoriShAddToHistory(&LineString)) {
+    for (Index = 0; Index < LineCount; Index++) {
+        if (!YoriShAddToHistory(&Lines[Index])) {
             break;
         }
-
-        YoriLibFreeStringContents(&LineString);
-        YoriLibInitEmptyString(&LineString);
     }
 
-    YoriLibLineReadClose(LineContext);
-    YoriLibFreeStringContents(&LineString);
-    CloseHandle(FileHandle);
+    YoriShFreeHistoryFileLines(Lines, LineCount);
     return TRUE;
 }
 
 /**
- Write the current command history buffer to a file, if the user has requested
- this behavior by configuring the YORIHISTFILE environment variable.
+ Append a newly executed command to the history file, if the user has
+ requested this behavior by configuring the YORIHISTFILE environment
+ variable.  Each command is written as it is executed so that concurrent
+ shells each contribute their commands rather than overwriting the file
+ when they exit.
+
+ @param NewCmd Pointer to the command to append.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 __success(return)
 BOOL
-YoriShSaveHistoryToFile()
+YoriShAppendHistoryToFile(
+    __in PYORI_STRING NewCmd
+    )
 {
-    DWORD FileNameLength;
-    YORI_STRING UserHistFileName;
     YORI_STRING FilePath;
     HANDLE FileHandle;
-    PYORI_LIST_ENTRY ListEntry;
-    PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    BOOL Result;
 
-    FileNameLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
-    if (FileNameLength == 0) {
+    if (NewCmd->LengthInChars == 0) {
         return TRUE;
     }
 
-    if (!YoriLibAllocateString(&UserHistFileName, FileNameLength)) {
-        return FALSE;
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
+        return TRUE;
     }
 
-    UserHistFileName.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), UserHistFileName.StartOfString, UserHistFileName.LengthAllocated, NULL);
+    FileHandle = YoriShOpenHistoryFile(&FilePath,
+                                       FILE_APPEND_DATA | SYNCHRONIZE,
+                                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                       OPEN_ALWAYS);
 
-    if (UserHistFileName.LengthInChars == 0 || UserHistFileName.LengthInChars >= UserHistFileName.LengthAllocated) {
-        YoriLibFreeStringContents(&UserHistFileName);
+    YoriLibFreeStringContents(&FilePath);
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
         return FALSE;
     }
 
-    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, &FilePath)) {
-        YoriLibFreeStringContents(&UserHistFileName);
+    Result = YoriShWriteHistoryLine(FileHandle, NewCmd);
+    CloseHandle(FileHandle);
+    return Result;
+}
+
+/**
+ Discard the contents of the history file, if the user has requested
+ history be saved by configuring the YORIHISTFILE environment variable.
+ This is used when history is cleared, so that cleared commands are not
+ loaded by later shells.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShTruncateHistoryFile()
+{
+    YORI_STRING FilePath;
+    HANDLE FileHandle;
+    DWORD LastError;
+
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
+        return TRUE;
+    }
+
+    FileHandle = YoriShOpenHistoryFile(&FilePath,
+                                       GENERIC_WRITE,
+                                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                       TRUNCATE_EXISTING);
+
+    LastError = GetLastError();
+    YoriLibFreeStringContents(&FilePath);
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        if (LastError == ERROR_FILE_NOT_FOUND) {
+            return TRUE;
+        }
         return FALSE;
     }
 
-    YoriLibFreeStringContents(&UserHistFileName);
+    CloseHandle(FileHandle);
+    return TRUE;
+}
 
-    FileHandle = CreateFile(FilePath.StartOfString,
-                            GENERIC_WRITE,
-                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-                            NULL,
-                            CREATE_ALWAYS,
-                            FILE_ATTRIBUTE_NORMAL,
-                            NULL);
+/**
+ Finalize the history file when the shell is exiting, if the user has
+ requested this behavior by configuring the YORIHISTFILE environment
+ variable.  Since commands are appended as they are executed, an existing
+ file is only compacted if it has grown large enough.  If the file does not
+ exist, or commands have been removed from history, it is rewritten to
+ contain the current command history buffer.
 
-    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
-        DWORD LastError = GetLastError();
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShSaveHistoryToFile()
+{
+    YORI_STRING FilePath;
+    HANDLE FileHandle;
+    DWORD LastError;
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    BOOL Written;
+    BOOL Result;
+
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
+        return TRUE;
+    }
+
+    FileHandle = YoriShOpenHistoryFile(&FilePath,
+                                       GENERIC_READ | GENERIC_WRITE,
+                                       0,
+                                       OPEN_ALWAYS);
+
+    LastError = GetLastError();
+
+    //
+    //  If other shells are still using the file, compaction can wait
+    //  until a later shell exits.  Removed commands can't wait, so that
+    //  failure is reported.
+    //
+
+    if (FileHandle == INVALID_HANDLE_VALUE &&
+        LastError == ERROR_SHARING_VIOLATION &&
+        !YoriShHistoryFileRewriteRequired) {
+
+        YoriLibFreeStringContents(&FilePath);
+        return TRUE;
+    }
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
         LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
         YoriLibFreeWinErrorText(ErrText);
@@ -370,24 +1560,45 @@ YoriShSaveHistoryToFile()
 
     YoriLibFreeStringContents(&FilePath);
 
+    if (LastError == ERROR_ALREADY_EXISTS && !YoriShHistoryFileRewriteRequired) {
+        Result = YoriShCompactHistoryFile(FileHandle);
+        CloseHandle(FileHandle);
+        return Result;
+    }
+
     //
     //  Search the list of history.
     //
 
+    Result = TRUE;
+    Written = FALSE;
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
+        Written = TRUE;
         ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
         while (ListEntry != NULL) {
             HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
 
-            YoriLibOutputToDevice(FileHandle, 0, _T("%y\n"), &HistoryEntry->CmdLine);
+            if (!YoriShWriteHistoryLine(FileHandle, &HistoryEntry->CmdLine)) {
+                Result = FALSE;
+                break;
+            }
 
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
         }
         ReleaseMutex(YoriShHistoryLock);
     }
 
+    //
+    //  The file was opened without truncating it, so discard anything
+    //  beyond the history that was just written.
+    //
+
+    if (Result && Written) {
+        SetEndOfFile(FileHandle);
+    }
+
     CloseHandle(FileHandle);
-    return TRUE;
+    return Result;
 }
 
 /**
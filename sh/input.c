@@ -635,11 +635,13 @@ YoriShTerminateInput(
     __inout PYORI_SH_INPUT_BUFFER Buffer
     )
 {
+    YoriShWaitForSuggestion(Buffer);
     if (Buffer->SuggestionString.LengthInChars > 0) {
         Buffer->SuggestionDirty = TRUE;
     }
     YoriLibFreeStringContents(&Buffer->SuggestionString);
     YoriLibFreeStringContents(&Buffer->SearchString);
+    YoriLibFreeStringContents(&Buffer->PreSearchString);
     SetConsoleCtrlHandler(YoriShAppCloseCtrlHandler, FALSE);
     YoriShDisplayAfterKeyPress(Buffer);
     YoriShPostKeyPress(Buffer);
@@ -707,13 +709,87 @@ YoriShClearInput(
 {
     YoriLibFreeStringContents(&Buffer->SuggestionString);
     YoriLibFreeStringContents(&Buffer->SearchString);
+    YoriLibFreeStringContents(&Buffer->PreSearchString);
     YoriShClearTabCompletionMatches(Buffer);
     Buffer->String.LengthInChars = 0;
     Buffer->CurrentOffset = 0;
     Buffer->SearchMode = FALSE;
+    Buffer->SearchHistory = FALSE;
     YoriShClearInputSelections(Buffer);
 }
 
+/**
+ Replace the contents of the input buffer with a specified string without
+ leaving search mode.  This is used when searching history to display the
+ current match or to restore the input when the search is cancelled.
+
+ @param Buffer Pointer to the input buffer to update.
+
+ @param String Pointer to the string to display in the input buffer.
+ */
+VOID
+YoriShReplaceInputDuringSearch(
+    __inout PYORI_SH_INPUT_BUFFER Buffer,
+    __in PYORI_STRING String
+    )
+{
+    if (!YoriShEnsureStringHasEnoughCharacters(&Buffer->String, String->LengthInChars)) {
+        return;
+    }
+
+    YoriLibFreeStringContents(&Buffer->SuggestionString);
+    YoriShClearTabCompletionMatches(Buffer);
+    YoriShClearInputSelections(Buffer);
+
+    memcpy(Buffer->String.StartOfString, String->StartOfString, String->LengthInChars * sizeof(TCHAR));
+    Buffer->String.LengthInChars = String->LengthInChars;
+    Buffer->CurrentOffset = String->LengthInChars;
+    Buffer->DirtyBeginOffset = 0;
+    Buffer->DirtyLength = String->LengthInChars;
+    Buffer->SuggestionDirty = TRUE;
+}
+
+/**
+ Based on the search text entered so far, find the ranked match within
+ history selected by the user, display it in the input buffer, and set the
+ current offset to the matching text.  If there is no such match, the
+ previous match remains displayed.
+
+ @param Buffer Pointer to the input buffer to update.
+ */
+VOID
+YoriShUpdateInputWithHistorySearchResult(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    YORI_STRING Match;
+    DWORD StringOffsetOfMatch;
+
+    if (Buffer->SearchString.LengthInChars == 0) {
+        Buffer->SearchHistoryMatchIndex = 0;
+        YoriShReplaceInputDuringSearch(Buffer, &Buffer->PreSearchString);
+        Buffer->CurrentOffset = Buffer->PreSearchOffset;
+        return;
+    }
+
+    //
+    //  If the user has asked for the next match and there isn't one, stay
+    //  on the last match that was found.
+    //
+
+    YoriLibInitEmptyString(&Match);
+    while (!YoriShSearchHistory(&Buffer->SearchString, Buffer->SearchHistoryMatchIndex, &Match, &StringOffsetOfMatch)) {
+        if (Buffer->SearchHistoryMatchIndex == 0) {
+            return;
+        }
+        Buffer->SearchHistoryMatchIndex--;
+    }
+
+    YoriShReplaceInputDuringSearch(Buffer, &Match);
+    Buffer->CurrentOffset = StringOffsetOfMatch + Buffer->SearchString.LengthInChars;
+    YoriLibFreeStringContents(&Match);
+}
+
 /**
  Based on the search text entered so far, find the first match within the
  main string and set the current offset to it.
@@ -727,6 +803,11 @@ YoriShUpdateSelectionWithSearchResult(
 {
     DWORD StringOffsetOfMatch;
 
+    if (Buffer->SearchHistory) {
+        YoriShUpdateInputWithHistorySearchResult(Buffer);
+        return;
+    }
+
     //
     //  MSFIX Would like to do something with selection for this, but that
     //  implies having a selection that follows text around lines rather
@@ -879,6 +960,7 @@ YoriShBackspace(
         }
 
         Buffer->SearchString.LengthInChars -= CountToUse;
+        Buffer->SearchHistoryMatchIndex = 0;
 
         YoriShUpdateSelectionWithSearchResult(Buffer);
         return;
@@ -1045,6 +1127,7 @@ YoriShAddYoriStringToInput(
 
         memcpy(&Buffer->SearchString.StartOfString[Buffer->SearchString.LengthInChars], String->StartOfString, String->LengthInChars * sizeof(TCHAR));
         Buffer->SearchString.LengthInChars += String->LengthInChars;
+        Buffer->SearchHistoryMatchIndex = 0;
 
         YoriShUpdateSelectionWithSearchResult(Buffer);
 
@@ -1435,11 +1518,13 @@ YoriShConfigureInputSettings(
     if (YoriShGlobal.InputParamsGeneration != YoriShGlobal.EnvironmentGeneration) {
 
         //
-        //  Default to suggesting in 400ms after seeing 2 chars in an arg.
+        //  Default to suggesting in 400ms after seeing 2 chars in an arg,
+        //  and abandoning any suggestion that takes longer than 1s.
         //
 
         YoriShGlobal.DelayBeforeSuggesting = 400;
         YoriShGlobal.MinimumCharsInArgBeforeSuggesting = 2;
+        YoriShGlobal.SuggestionBudget = 1000;
         YoriShGlobal.YoriQuickEdit = FALSE;
         YoriShGlobal.MouseoverEnabled = TRUE;
         YoriShGlobal.CompletionTrailingSlash = FALSE;
@@ -1486,6 +1571,26 @@ YoriShConfigureInputSettings(
             }
         }
 
+        //
+        //  Check the environment to see if the user wants to override the
+        //  time a suggestion may take to generate.  Note a value of zero
+        //  removes the limit.
+        //
+
+        EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORISUGGESTIONBUDGET"), NULL, 0, NULL);
+        if (EnvVarLength > 0) {
+            if (EnvVarLength > EnvVar.LengthAllocated) {
+                YoriLibFreeStringContents(&EnvVar);
+                YoriLibAllocateString(&EnvVar, EnvVarLength);
+            }
+            if (EnvVarLength <= EnvVar.LengthAllocated) {
+                EnvVar.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORISUGGESTIONBUDGET"), EnvVar.StartOfString, EnvVar.LengthAllocated, NULL);
+                if (YoriLibStringToNumber(&EnvVar, TRUE, &llTemp, &CharsConsumed) && CharsConsumed > 0) {
+                    YoriShGlobal.SuggestionBudget = (ULONG)llTemp;
+                }
+            }
+        }
+
         //
         //  Check the environment to see if the user wants to use Yori's mouse
         //  input support at the prompt and console QuickEdit when running
@@ -1845,7 +1950,9 @@ YoriShProcessEnhancedKeyDown(
     } else if (KeyCode == VK_RETURN) {
         if (Buffer->SearchMode) {
             Buffer->SearchMode = FALSE;
+            Buffer->SearchHistory = FALSE;
             YoriLibFreeStringContents(&Buffer->SearchString);
+            YoriLibFreeStringContents(&Buffer->PreSearchString);
         } else {
             if (!YoriLibCopySelectionIfPresent(&Buffer->Selection)) {
                 *TerminateInput = TRUE;
@@ -1926,7 +2033,9 @@ YoriShProcessKeyDown(
         if (Char == '\r') {
             if (Buffer->SearchMode) {
                 Buffer->SearchMode = FALSE;
+                Buffer->SearchHistory = FALSE;
                 YoriLibFreeStringContents(&Buffer->SearchString);
+                YoriLibFreeStringContents(&Buffer->PreSearchString);
             } else {
                 if (!YoriLibCopySelectionIfPresent(&Buffer->Selection)) {
                     *TerminateInput = TRUE;
@@ -1936,6 +2045,11 @@ YoriShProcessKeyDown(
             }
         } else if (Char == 27) {
             if (Buffer->SearchMode) {
+                if (Buffer->SearchHistory) {
+                    YoriShReplaceInputDuringSearch(Buffer, &Buffer->PreSearchString);
+                    YoriLibFreeStringContents(&Buffer->PreSearchString);
+                    Buffer->SearchHistory = FALSE;
+                }
                 Buffer->SearchMode = FALSE;
                 Buffer->CurrentOffset = Buffer->PreSearchOffset;
                 YoriLibFreeStringContents(&Buffer->SearchString);
@@ -1997,6 +2111,20 @@ YoriShProcessKeyDown(
             Buffer->CurrentOffset = Buffer->String.LengthInChars;
         } else if (KeyCode == 'L') {
             YoriShClearScreen(Buffer);
+        } else if (KeyCode == 'R') {
+            if (!Buffer->SearchMode) {
+                if (YoriLibAllocateString(&Buffer->PreSearchString, Buffer->String.LengthInChars + 1)) {
+                    memcpy(Buffer->PreSearchString.StartOfString, Buffer->String.StartOfString, Buffer->String.LengthInChars * sizeof(TCHAR));
+                    Buffer->PreSearchString.LengthInChars = Buffer->String.LengthInChars;
+                    Buffer->SearchMode = TRUE;
+                    Buffer->SearchHistory = TRUE;
+                    Buffer->SearchHistoryMatchIndex = 0;
+                    Buffer->PreSearchOffset = Buffer->CurrentOffset;
+                }
+            } else if (Buffer->SearchHistory) {
+                Buffer->SearchHistoryMatchIndex++;
+                YoriShUpdateSelectionWithSearchResult(Buffer);
+            }
         } else if (KeyCode == 'V') {
             YORI_STRING ClipboardData;
             YoriLibInitEmptyString(&ClipboardData);
@@ -2005,8 +2133,10 @@ YoriShProcessKeyDown(
                 YoriLibFreeStringContents(&ClipboardData);
             }
         } else if (KeyCode == 0xBF) { // Aka VK_OEM_2, / or ? on US keyboards
-            Buffer->SearchMode = TRUE;
-            Buffer->PreSearchOffset = Buffer->CurrentOffset;
+            if (!Buffer->SearchHistory) {
+                Buffer->SearchMode = TRUE;
+                Buffer->PreSearchOffset = Buffer->CurrentOffset;
+            }
         } else if (KeyCode == VK_TAB) {
             YoriShConfigureConsoleForTabComplete(Buffer);
             ListAll = YoriShTabCompletion(Buffer, YORI_SH_TAB_COMPLETE_FULL_PATH);
@@ -2684,6 +2814,7 @@ YoriShGetExpressionFromConsole(
     DWORD err;
     INPUT_RECORD InputRecords[20];
     PINPUT_RECORD InputRecord;
+    HANDLE WaitHandles[2];
     BOOL ReDisplayRequired;
     BOOL TerminateInput;
     BOOL RestartStateSaved = FALSE;
@@ -2733,6 +2864,15 @@ YoriShGetExpressionFromConsole(
             if (InputRecord->EventType == KEY_EVENT) {
 
                 if (InputRecord->Event.KeyEvent.bKeyDown) {
+
+                    //
+                    //  Any suggestion being generated is for the input as
+                    //  it was before this key, so stop working on it.
+                    //
+
+                    if (Buffer.SuggestionRequest != NULL) {
+                        YoriShCancelSuggestion(&Buffer);
+                    }
                     ReDisplayRequired |= YoriShProcessKeyDown(&Buffer, InputRecord, &TerminateInput);
                 } else {
                     ReDisplayRequired |= YoriShProcessKeyUp(&Buffer, InputRecord, &TerminateInput);
@@ -2789,6 +2929,7 @@ YoriShGetExpressionFromConsole(
                 ReadConsoleInput(InputHandle, InputRecords, CurrentRecordIndex + 1, &ActuallyRead);
                 if (Buffer.String.LengthInChars > 0) {
                     YoriShAddToHistory(&Buffer.String);
+                    YoriShAppendHistoryToFile(&Buffer.String);
                 }
                 memcpy(Expression, &Buffer.String, sizeof(YORI_STRING));
                 return TRUE;
@@ -2835,6 +2976,31 @@ YoriShGetExpressionFromConsole(
                 if (err == WAIT_TIMEOUT) {
                     YoriLibPeriodicScrollForSelection(&Buffer.Selection);
                 }
+            } else if (Buffer.SuggestionRequest != NULL) {
+
+                //
+                //  A suggestion is being generated in the background.  Keep
+                //  processing input while waiting for it, and display it if
+                //  it is still relevant when it completes.  If it's taking
+                //  too long, the wait time is used to abandon it.
+                //
+
+                WaitHandles[0] = InputHandle;
+                WaitHandles[1] = Buffer.SuggestionRequest->hThread;
+                err = WaitForMultipleObjects(2, WaitHandles, FALSE, YoriShGetSuggestionWaitTime(&Buffer));
+                if (err == WAIT_OBJECT_0) {
+                    break;
+                }
+                if (err == WAIT_OBJECT_0 + 1) {
+                    if (YoriShCompleteSuggestion(&Buffer)) {
+                        SuggestionPopulated = TRUE;
+                        Buffer.SuggestionDirty = TRUE;
+                        if (Buffer.SuggestionString.LengthInChars > 0) {
+                            YoriShDisplayAfterKeyPress(&Buffer);
+                        }
+                    }
+                    err = WAIT_TIMEOUT;
+                }
             } else if (!SuggestionPopulated) {
                 err = WaitForSingleObject(InputHandle, YoriShGlobal.DelayBeforeSuggesting);
                 if (err == WAIT_OBJECT_0) {
@@ -2842,14 +3008,8 @@ YoriShGetExpressionFromConsole(
                 }
                 if (err == WAIT_TIMEOUT) {
                     ASSERT(!SuggestionPopulated);
-                    YoriShConfigureConsoleForTabComplete(&Buffer);
-                    YoriShCompleteSuggestion(&Buffer);
-                    YoriShConfigureConsoleForInput(&Buffer);
+                    YoriShStartSuggestion(&Buffer);
                     SuggestionPopulated = TRUE;
-                    Buffer.SuggestionDirty = TRUE;
-                    if (Buffer.SuggestionString.LengthInChars > 0) {
-                        YoriShDisplayAfterKeyPress(&Buffer);
-                    }
                 }
             } else if (!RestartStateSaved) {
                 err = WaitForSingleObject(InputHandle, 30 * 1000);
@@ -137,6 +137,16 @@ YoriShInit()
 
     YoriLibEnableBackupPrivilege();
 
+    //
+    //  The shell resolves executables repeatedly, so cache the contents of
+    //  directories in PATH.  The cache is not synchronized; it is used by
+    //  the main thread and the suggestion thread, which is safe because
+    //  YoriShWaitForSuggestion stops the suggestion thread before the main
+    //  thread searches for executables.
+    //
+
+    YoriLibPathCacheEnable();
+
     //
     //  Translate the constant builtin function mapping into dynamic function
     //  mappings.
@@ -689,9 +699,12 @@ ymain (
     YoriShScanJobsReportCompletion(TRUE);
     YoriShClearAllHistory();
     YoriShClearAllAliases();
+    YoriShExecTrieCleanup();
+    YoriLibPathCacheCleanup();
     YoriShBuiltinUnregisterAll();
     YoriShDiscardSavedRestartState(NULL);
     YoriShCleanupInputContext();
+    YoriShFreeDirectoryCompletionCache();
     YoriLibFreeStringContents(&YoriShGlobal.PreCmdVariable);
     YoriLibFreeStringContents(&YoriShGlobal.PostCmdVariable);
     YoriLibFreeStringContents(&YoriShGlobal.PromptVariable);
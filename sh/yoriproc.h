@@ -264,11 +264,40 @@ YoriShTrimSuggestionList(
     __in PYORI_STRING NewString
     );
 
+BOOL
+YoriShStartSuggestion(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    );
+
 VOID
+YoriShCancelSuggestion(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    );
+
+DWORD
+YoriShGetSuggestionWaitTime(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    );
+
+BOOL
 YoriShCompleteSuggestion(
     __inout PYORI_SH_INPUT_BUFFER Buffer
     );
 
+VOID
+YoriShWaitForSuggestion(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    );
+
+DWORD
+YoriShFormatSuggestionLatency(
+    __out_ecount_opt(Size) LPTSTR Variable,
+    __in DWORD Size
+    );
+
+VOID
+YoriShFreeDirectoryCompletionCache();
+
 // *** ENV.C ***
 
 BOOL
@@ -369,6 +398,19 @@ YoriShExecuteExpression(
     __in PYORI_STRING Expression
     );
 
+// *** EXECTRIE.C ***
+
+__success(return)
+BOOL
+YoriShExecTrieFindMatches(
+    __in PYORI_STRING Prefix,
+    __in PYORI_LIB_PATH_MATCH_FN MatchCallback,
+    __in PVOID MatchContext
+    );
+
+VOID
+YoriShExecTrieCleanup();
+
 // *** HISTORY.C ***
 
 __success(return)
@@ -403,6 +445,16 @@ __success(return)
 BOOL
 YoriShSaveHistoryToFile();
 
+__success(return)
+BOOL
+YoriShAppendHistoryToFile(
+    __in PYORI_STRING NewCmd
+    );
+
+__success(return)
+BOOL
+YoriShTruncateHistoryFile();
+
 __success(return)
 BOOL
 YoriShGetHistoryStrings(
@@ -410,8 +462,29 @@ YoriShGetHistoryStrings(
     __inout PYORI_STRING HistoryStrings
     );
 
+__success(return)
+BOOL
+YoriShSearchHistory(
+    __in PYORI_STRING SearchString,
+    __in DWORD MatchIndex,
+    __out PYORI_STRING Match,
+    __out_opt PDWORD StringOffsetOfMatch
+    );
+
 // *** INPUT.C ***
 
+__success(return)
+BOOL
+YoriShConfigureConsoleForTabComplete(
+    __in PYORI_SH_INPUT_BUFFER Buffer
+    );
+
+__success(return)
+BOOL
+YoriShConfigureConsoleForInput(
+    __in PYORI_SH_INPUT_BUFFER Buffer
+    );
+
 __success(return)
 BOOL
 YoriShEnsureStringHasEnoughCharacters(
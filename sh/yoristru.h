@@ -431,6 +431,19 @@ typedef struct _YORI_SH_HISTORY_ENTRY {
      The command that was executed by the user.
      */
     YORI_STRING CmdLine;
+
+    /**
+     A number which increases with each entry added to history, used to
+     rank how recently a command was used.
+     */
+    DWORD Sequence;
+
+    /**
+     The distinct command within the history index that this entry
+     refers to.  Repeated executions of the same command refer to the
+     same distinct command.
+     */
+    struct _YORI_SH_HISTORY_COMMAND *Command;
 } YORI_SH_HISTORY_ENTRY, *PYORI_SH_HISTORY_ENTRY;
 
 /**
@@ -519,6 +532,13 @@ typedef struct _YORI_SH_TAB_COMPLETE_CONTEXT {
      */
     BOOLEAN PotentialNonPrefixMatch;
 
+    /**
+     TRUE if matches were being populated on a background thread and a step
+     was encountered which can only be performed on the input thread, such
+     as running a completion script.  The matches are incomplete.
+     */
+    BOOLEAN ForegroundRequired;
+
     /**
      A list of matches that apply to the criteria that was searched.
      */
@@ -549,6 +569,13 @@ typedef struct _YORI_SH_TAB_COMPLETE_CONTEXT {
      */
     DWORD SearchStringOffset;
 
+    /**
+     If matches are being populated on a background thread, points to a
+     value which becomes nonzero if the matches are no longer needed.  NULL
+     if matches are being populated on the input thread.
+     */
+    volatile LONG *CancelRequested;
+
 } YORI_SH_TAB_COMPLETE_CONTEXT, *PYORI_SH_TAB_COMPLETE_CONTEXT;
 
 /**
@@ -684,6 +711,12 @@ typedef struct _YORI_SH_INPUT_BUFFER {
      */
     YORI_STRING SuggestionString;
 
+    /**
+     Pointer to a suggestion which is being generated on a background
+     thread, or NULL if no suggestion is being generated.
+     */
+    struct _YORI_SH_SUGGESTION_REQUEST *SuggestionRequest;
+
     /**
      If TRUE, the search buffer is the active buffer where keystrokes and
      backspace keys should be delivered to.  If FALSE, keystrokes are
@@ -702,8 +735,70 @@ typedef struct _YORI_SH_INPUT_BUFFER {
      */
     YORI_STRING SearchString;
 
+    /**
+     If TRUE, the search string is being used to search history rather than
+     the buffer itself.  Only meaningful if SearchMode is TRUE.
+     */
+    BOOL SearchHistory;
+
+    /**
+     When searching history, the rank of the match currently displayed,
+     where zero is the highest ranked match.
+     */
+    DWORD SearchHistoryMatchIndex;
+
+    /**
+     When searching history, a copy of the input as it was when the search
+     started.  This is restored if the search is cancelled.
+     */
+    YORI_STRING PreSearchString;
+
 } YORI_SH_INPUT_BUFFER, *PYORI_SH_INPUT_BUFFER;
 
+/**
+ A request to generate a suggestion on a background thread.
+ */
+typedef struct _YORI_SH_SUGGESTION_REQUEST {
+
+    /**
+     A private input buffer used by the background thread.  This contains
+     a copy of the input string and cursor position at the time the request
+     was made, and receives the tab completion matches and suggestion.
+     */
+    YORI_SH_INPUT_BUFFER WorkBuffer;
+
+    /**
+     Handle to the thread generating the suggestion.  This is signalled when
+     the request has finished.
+     */
+    HANDLE hThread;
+
+    /**
+     The tick count when the request was made.
+     */
+    DWORD TickStarted;
+
+    /**
+     The tick count when the background thread finished generating the
+     suggestion.
+     */
+    DWORD TickCompleted;
+
+    /**
+     Set to TRUE if the request was abandoned because it did not complete
+     within the suggestion budget.
+     */
+    BOOL BudgetExpired;
+
+    /**
+     Set to nonzero by the input thread if the result of the request is no
+     longer needed, because input has arrived or the budget has expired.
+     The background thread stops as soon as it observes this.
+     */
+    volatile LONG CancelRequested;
+
+} YORI_SH_SUGGESTION_REQUEST, *PYORI_SH_SUGGESTION_REQUEST;
+
 /**
  A structure defining a mapping between a command name and a function to
  execute.  This is used to populate builtin commands.
@@ -866,6 +961,12 @@ typedef struct _YORI_SH_GLOBALS {
      */
     DWORD MinimumCharsInArgBeforeSuggesting;
 
+    /**
+     The number of ms that a suggestion may spend being generated before
+     it is abandoned.  Zero indicates no limit.
+     */
+    DWORD SuggestionBudget;
+
     /**
      The generation of the environment last time input parameters were
      refreshed.
@@ -163,13 +163,19 @@ SplitProcessStream(
 
     if (SplitContext->LinesMode) {
         PVOID LineContext = NULL;
+        YORI_LIB_LINE_VIEW LineView;
         YORI_STRING LineString;
         LONGLONG LineNumber;
+        DWORD BytesWritten;
 
         LineNumber = 0;
         YoriLibInitEmptyString(&LineString);
+        if (!YoriLibLineViewOpen(hSource, &LineContext)) {
+            return FALSE;
+        }
+
         while (TRUE) {
-            if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
+            if (!YoriLibLineViewNext(LineContext, &LineView)) {
                 break;
             }
 
@@ -183,18 +189,44 @@ SplitProcessStream(
             if (hDestFile == NULL) {
                 hDestFile = SplitOpenTargetForCurrentPart(SplitContext);
                 if (hDestFile == NULL) {
-                    YoriLibLineReadClose(LineContext);
+                    YoriLibLineViewClose(LineContext);
                     YoriLibFreeStringContents(&LineString);
                     return FALSE;
                 }
                 SplitContext->CurrentPartNumber++;
             }
 
-            YoriLibOutputToDevice(hDestFile, 0, _T("%y\n"), &LineString);
+            //
+            //  If the line is already in the output encoding, write it
+            //  directly from the source without converting it.  The line
+            //  is terminated with CRLF, matching converted output.
+            //
+
+            if (LineView.Encoding != CP_UTF16 &&
+                LineView.Encoding == YoriLibGetMultibyteOutputEncoding()) {
+
+                if (!WriteFile(hDestFile, LineView.StartOfLine, LineView.LengthInChars, &BytesWritten, NULL) ||
+                    !WriteFile(hDestFile, "\r\n", 2, &BytesWritten, NULL)) {
+
+                    DWORD LastError = GetLastError();
+                    LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+                    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("split: write failed: %s"), ErrText);
+                    YoriLibFreeWinErrorText(ErrText);
+                    CloseHandle(hDestFile);
+                    YoriLibLineViewClose(LineContext);
+                    YoriLibFreeStringContents(&LineString);
+                    return FALSE;
+                }
+            } else {
+                if (!YoriLibLineViewToString(&LineView, &LineString)) {
+                    break;
+                }
+                YoriLibOutputToDevice(hDestFile, 0, _T("%y\n"), &LineString);
+            }
             LineNumber++;
         }
 
-        YoriLibLineReadClose(LineContext);
+        YoriLibLineViewClose(LineContext);
         YoriLibFreeStringContents(&LineString);
     } else {
         PVOID Buffer;
@@ -36,7 +36,10 @@ CHAR strSpongeHelpText[] =
         "Read input into memory and output once all input is read,\n"
         "  allowing the output to modify the source stream.\n"
         "\n"
-        "SPONGE [-license] [file]\n"
+        "SPONGE [-license] [-m size] [file]\n"
+        "\n"
+        "   -m             The amount of input to hold in memory before using a\n"
+        "                    temporary file, default 64Mb\n"
         ;
 
 /**
@@ -53,6 +56,17 @@ SpongeHelp()
     return TRUE;
 }
 
+/**
+ The default number of bytes of input to hold in memory before input is
+ written to a temporary file.
+ */
+#define SPONGE_DEFAULT_MEMORY_LIMIT (64 * 1024 * 1024)
+
+/**
+ The largest number of bytes of input that can be held in memory.
+ */
+#define SPONGE_MAXIMUM_MEMORY_LIMIT (1024 * 1024 * 1024)
+
 /**
  A buffer for a single data stream.
  */
@@ -68,11 +82,37 @@ typedef struct _SPONGE_BUFFER {
      */
     DWORD BytesPopulated;
 
+    /**
+     The number of bytes that this buffer can grow to.  Once this is
+     reached, all input is written to a temporary file, and the buffer is
+     used to collect input into large writes.
+     */
+    DWORD MaximumBytesAllocated;
+
     /**
      A handle to a pipe which is the source of data for this buffer.
      */
     HANDLE hSource;
 
+    /**
+     A handle to a temporary file containing all input, or NULL if the
+     input has not exceeded MaximumBytesAllocated.
+     */
+    HANDLE hSpill;
+
+    /**
+     The name of the temporary file, if it was created alongside the target
+     so that it can replace the target once input is complete.  If the
+     temporary file was created in the temporary directory, this is empty.
+     */
+    YORI_STRING SpillFileName;
+
+    /**
+     TRUE if the temporary file alongside the target will be deleted when
+     its handle is closed, including if the process is terminated.
+     */
+    BOOL SpillDeleteOnClose;
+
     /**
      The data buffer.
      */
@@ -81,15 +121,188 @@ typedef struct _SPONGE_BUFFER {
 } SPONGE_BUFFER, *PSPONGE_BUFFER;
 
 /**
- Populate data from stdin into an in memory buffer.
+ Write a block of data to a handle, retrying until all of it has been
+ written.
+
+ @param hTarget Handle to write to.
+
+ @param Buffer Pointer to the data to write.
+
+ @param Length The number of bytes to write.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SpongeWriteBlock(
+    __in HANDLE hTarget,
+    __in PVOID Buffer,
+    __in DWORD Length
+    )
+{
+    DWORD BytesSent;
+    DWORD BytesWritten;
+
+    BytesSent = 0;
+    while (BytesSent < Length) {
+        if (!WriteFile(hTarget,
+                       YoriLibAddToPointer(Buffer, BytesSent),
+                       Length - BytesSent,
+                       &BytesWritten,
+                       NULL) ||
+            BytesWritten == 0) {
+
+            return FALSE;
+        }
+
+        BytesSent += BytesWritten;
+    }
+
+    return TRUE;
+}
+
+/**
+ Change whether the temporary file alongside the target is deleted when its
+ handle is closed.  This requires SetFileInformationByHandle, so on older
+ systems the file is only deleted by SpongeFreeBuffer.
+
+ @param ThisBuffer Pointer to the buffer whose temporary file should be
+        updated.
+
+ @param DeleteOnClose TRUE if the file should be deleted when its handle is
+        closed, FALSE if it should be retained.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SpongeSetSpillFileDisposition(
+    __inout PSPONGE_BUFFER ThisBuffer,
+    __in BOOL DeleteOnClose
+    )
+{
+    FILE_DISPOSITION_INFO DispositionInfo;
+
+    if (ThisBuffer->SpillDeleteOnClose == DeleteOnClose) {
+        return TRUE;
+    }
+
+    if (DllKernel32.pSetFileInformationByHandle == NULL) {
+        return FALSE;
+    }
+
+    DispositionInfo.DeleteFile = (BOOLEAN)DeleteOnClose;
+    if (!DllKernel32.pSetFileInformationByHandle(ThisBuffer->hSpill, FileDispositionInfo, &DispositionInfo, sizeof(DispositionInfo))) {
+        return FALSE;
+    }
+
+    ThisBuffer->SpillDeleteOnClose = DeleteOnClose;
+    return TRUE;
+}
+
+/**
+ Create a temporary file to hold input.  If a target file is specified, the
+ temporary file is created in the same directory so it can replace the
+ target once complete, and is marked to be deleted when closed until then.
+ Otherwise, or if that fails, the temporary file is created in the
+ temporary directory and deleted when closed.
+
+ @param ThisBuffer Pointer to the buffer to create a temporary file for.
+
+ @param TargetFileName Optionally points to the full path of the file that
+        will receive the output.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SpongeCreateSpillFile(
+    __inout PSPONGE_BUFFER ThisBuffer,
+    __in_opt PYORI_STRING TargetFileName
+    )
+{
+    YORI_STRING TempPath;
+    LPTSTR FinalSlash;
+
+    if (!YoriLibAllocateString(&ThisBuffer->SpillFileName, MAX_PATH)) {
+        return FALSE;
+    }
+
+    if (TargetFileName != NULL && TargetFileName->LengthInChars > 0) {
+        YoriLibInitEmptyString(&TempPath);
+        if (YoriLibAllocateString(&TempPath, TargetFileName->LengthInChars + 1)) {
+            memcpy(TempPath.StartOfString, TargetFileName->StartOfString, TargetFileName->LengthInChars * sizeof(TCHAR));
+            TempPath.StartOfString[TargetFileName->LengthInChars] = '\0';
+            TempPath.LengthInChars = TargetFileName->LengthInChars;
+            FinalSlash = YoriLibFindRightMostCharacter(&TempPath, '\\');
+            if (FinalSlash != NULL) {
+                *FinalSlash = '\0';
+                if (GetTempFileName(TempPath.StartOfString, _T("spg"), 0, ThisBuffer->SpillFileName.StartOfString) != 0) {
+                    ThisBuffer->hSpill = CreateFile(ThisBuffer->SpillFileName.StartOfString,
+                                                    GENERIC_READ | GENERIC_WRITE | DELETE,
+                                                    0,
+                                                    NULL,
+                                                    CREATE_ALWAYS,
+                                                    FILE_FLAG_SEQUENTIAL_SCAN,
+                                                    NULL);
+                    if (ThisBuffer->hSpill != INVALID_HANDLE_VALUE) {
+                        ThisBuffer->SpillFileName.LengthInChars = _tcslen(ThisBuffer->SpillFileName.StartOfString);
+                        YoriLibLoadKernel32Functions();
+                        SpongeSetSpillFileDisposition(ThisBuffer, TRUE);
+                        YoriLibFreeStringContents(&TempPath);
+                        return TRUE;
+                    }
+                    ThisBuffer->hSpill = NULL;
+                    DeleteFile(ThisBuffer->SpillFileName.StartOfString);
+                }
+            }
+            YoriLibFreeStringContents(&TempPath);
+        }
+    }
+
+    TempPath.LengthAllocated = GetTempPath(0, NULL);
+    if (!YoriLibAllocateString(&TempPath, TempPath.LengthAllocated)) {
+        return FALSE;
+    }
+    TempPath.LengthInChars = GetTempPath(TempPath.LengthAllocated, TempPath.StartOfString);
+
+    if (GetTempFileName(TempPath.StartOfString, _T("spg"), 0, ThisBuffer->SpillFileName.StartOfString) == 0) {
+        YoriLibFreeStringContents(&TempPath);
+        return FALSE;
+    }
+    YoriLibFreeStringContents(&TempPath);
+
+    ThisBuffer->hSpill = CreateFile(ThisBuffer->SpillFileName.StartOfString,
+                                    GENERIC_READ | GENERIC_WRITE,
+                                    0,
+                                    NULL,
+                                    CREATE_ALWAYS,
+                                    FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE | FILE_FLAG_SEQUENTIAL_SCAN,
+                                    NULL);
+
+    if (ThisBuffer->hSpill == INVALID_HANDLE_VALUE) {
+        ThisBuffer->hSpill = NULL;
+        DeleteFile(ThisBuffer->SpillFileName.StartOfString);
+        return FALSE;
+    }
+
+    ThisBuffer->SpillFileName.LengthInChars = 0;
+    return TRUE;
+}
+
+/**
+ Populate data from stdin into an in memory buffer.  Once the buffer reaches
+ its maximum size, the buffer contents and all further input are written to
+ a temporary file.
 
  @param ThisBuffer A pointer to the process buffer set.
 
+ @param TargetFileName Optionally points to the full path of the file that
+        will receive the output.
+
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 BOOL
 SpongeBufferPump(
-    __in PSPONGE_BUFFER ThisBuffer
+    __in PSPONGE_BUFFER ThisBuffer,
+    __in_opt PYORI_STRING TargetFileName
     )
 {
     DWORD BytesRead;
@@ -114,11 +327,33 @@ SpongeBufferPump(
                 DWORD NewBytesAllocated;
                 PCHAR NewBuffer;
 
-                if (ThisBuffer->BytesAllocated >= ((DWORD)-1) / 4) {
-                    break;
+                //
+                //  If the buffer can't grow, write it to the temporary file,
+                //  creating one if needed, and start filling it again.
+                //
+
+                if (ThisBuffer->BytesAllocated >= ThisBuffer->MaximumBytesAllocated) {
+                    if (ThisBuffer->hSpill == NULL) {
+                        if (!SpongeCreateSpillFile(ThisBuffer, TargetFileName)) {
+                            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("sponge: could not create temporary file\n"));
+                            break;
+                        }
+                    }
+
+                    if (!SpongeWriteBlock(ThisBuffer->hSpill, ThisBuffer->Buffer, ThisBuffer->BytesPopulated)) {
+                        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("sponge: could not write to temporary file\n"));
+                        break;
+                    }
+
+                    ThisBuffer->BytesPopulated = 0;
+                    continue;
                 }
 
-                NewBytesAllocated = ThisBuffer->BytesAllocated * 4;
+                if (ThisBuffer->BytesAllocated >= ThisBuffer->MaximumBytesAllocated / 4) {
+                    NewBytesAllocated = ThisBuffer->MaximumBytesAllocated;
+                } else {
+                    NewBytesAllocated = ThisBuffer->BytesAllocated * 4;
+                }
 
                 NewBuffer = YoriLibMalloc(NewBytesAllocated);
                 if (NewBuffer == NULL) {
@@ -136,11 +371,26 @@ SpongeBufferPump(
         }
     }
 
+    //
+    //  If input is being written to a temporary file, write anything that
+    //  remains in memory so the file contains all of the input.
+    //
+
+    if (Result && ThisBuffer->hSpill != NULL && ThisBuffer->BytesPopulated > 0) {
+        if (!SpongeWriteBlock(ThisBuffer->hSpill, ThisBuffer->Buffer, ThisBuffer->BytesPopulated)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("sponge: could not write to temporary file\n"));
+            Result = FALSE;
+        }
+        ThisBuffer->BytesPopulated = 0;
+    }
+
     return Result;
 }
 
 /**
- Output the collected buffer to a stream.
+ Output the collected buffer to a stream.  If input was written to a
+ temporary file, the file is read back and written to the stream in blocks
+ the size of the buffer.
 
  @param ThisBuffer Pointer to the buffer to output.
 
@@ -154,35 +404,133 @@ SpongeBufferForward(
     __in HANDLE hTarget
     )
 {
-    DWORD BytesSent;
-    BOOL Result;
+    DWORD BytesRead;
 
-    BytesSent = 0;
-    Result = TRUE;
-
-    while (BytesSent < ThisBuffer->BytesPopulated) {
-        DWORD BytesToWrite;
-        DWORD BytesWritten;
-        BytesToWrite = 4096;
-        if (BytesSent + BytesToWrite > ThisBuffer->BytesPopulated) {
-            BytesToWrite = ThisBuffer->BytesPopulated - BytesSent;
+    if (ThisBuffer->hSpill == NULL) {
+        return SpongeWriteBlock(hTarget, ThisBuffer->Buffer, ThisBuffer->BytesPopulated);
+    }
+
+    if (SetFilePointer(ThisBuffer->hSpill, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER) {
+        return FALSE;
+    }
+
+    while (TRUE) {
+        if (!ReadFile(ThisBuffer->hSpill, ThisBuffer->Buffer, ThisBuffer->BytesAllocated, &BytesRead, NULL)) {
+            return FALSE;
         }
 
-        if (WriteFile(hTarget,
-                      YoriLibAddToPointer(ThisBuffer->Buffer, BytesSent),
-                      BytesToWrite,
-                      &BytesWritten,
-                      NULL)) {
+        if (BytesRead == 0) {
+            break;
+        }
 
-            BytesSent += BytesWritten;
-        } else {
-            Result = FALSE;
+        if (!SpongeWriteBlock(hTarget, ThisBuffer->Buffer, BytesRead)) {
+            return FALSE;
         }
+    }
 
-        ASSERT(BytesSent <= ThisBuffer->BytesPopulated);
+    return TRUE;
+}
+
+/**
+ If input was written to a temporary file alongside the target, close the
+ temporary file and make it the target.  An existing target is replaced
+ with ReplaceFile so that its security, attributes and streams are retained.
+ If this is not possible, for example because the system does not support
+ ReplaceFile, the caller writes the contents of the temporary file into the
+ target instead.
+
+ @param ThisBuffer Pointer to the buffer.
+
+ @param TargetFileName Pointer to the full path of the target file.
+
+ @param Renamed On successful completion, set to TRUE if the temporary file
+        has become the target, or FALSE if the output should be written to
+        the target.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  On failure
+         the temporary file is retained and the target is not modified.
+ */
+BOOL
+SpongeRenameSpillFile(
+    __inout PSPONGE_BUFFER ThisBuffer,
+    __in PYORI_STRING TargetFileName,
+    __out PBOOL Renamed
+    )
+{
+    BOOL TargetExists;
+
+    *Renamed = FALSE;
+
+    if (ThisBuffer->hSpill == NULL || ThisBuffer->SpillFileName.LengthInChars == 0) {
+        return TRUE;
     }
 
-    return Result;
+    TargetExists = FALSE;
+    if (GetFileAttributes(TargetFileName->StartOfString) != INVALID_FILE_ATTRIBUTES) {
+        TargetExists = TRUE;
+        if (DllKernel32.pReplaceFileW == NULL) {
+            return TRUE;
+        }
+    }
+
+    //
+    //  The temporary file needs to survive its handle being closed.  If
+    //  that can't be arranged, leave it open so its contents can be written
+    //  to the target.
+    //
+
+    if (!SpongeSetSpillFileDisposition(ThisBuffer, FALSE)) {
+        return TRUE;
+    }
+
+    CloseHandle(ThisBuffer->hSpill);
+    ThisBuffer->hSpill = NULL;
+
+    if (TargetExists) {
+        if (DllKernel32.pReplaceFileW(TargetFileName->StartOfString,
+                                      ThisBuffer->SpillFileName.StartOfString,
+                                      NULL,
+                                      REPLACEFILE_IGNORE_MERGE_ERRORS,
+                                      NULL,
+                                      NULL)) {
+            ThisBuffer->SpillFileName.LengthInChars = 0;
+            *Renamed = TRUE;
+            return TRUE;
+        }
+    } else if (MoveFileEx(ThisBuffer->SpillFileName.StartOfString, TargetFileName->StartOfString, 0)) {
+        ThisBuffer->SpillFileName.LengthInChars = 0;
+        *Renamed = TRUE;
+        return TRUE;
+    }
+
+    //
+    //  If the rename failed, for example because the temporary file is on
+    //  a different volume to the target, reopen the temporary file so its
+    //  contents can be written to the target instead.  It is deleted once
+    //  that is done.
+    //
+
+    ThisBuffer->hSpill = CreateFile(ThisBuffer->SpillFileName.StartOfString,
+                                    GENERIC_READ | DELETE,
+                                    0,
+                                    NULL,
+                                    OPEN_EXISTING,
+                                    FILE_FLAG_SEQUENTIAL_SCAN,
+                                    NULL);
+    if (ThisBuffer->hSpill == INVALID_HANDLE_VALUE) {
+        ThisBuffer->hSpill = NULL;
+
+        //
+        //  The input only exists in the temporary file, so keep it.
+        //
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("sponge: could not rename or reopen temporary file, input retained in %y\n"), &ThisBuffer->SpillFileName);
+        ThisBuffer->SpillFileName.LengthInChars = 0;
+        return FALSE;
+    }
+
+    SpongeSetSpillFileDisposition(ThisBuffer, TRUE);
+    return TRUE;
 }
 
 /**
@@ -190,14 +538,24 @@ SpongeBufferForward(
 
  @param Buffer Pointer to the buffer to allocate structures for.
 
+ @param MaximumBytesAllocated The number of bytes of input to hold in memory
+        before writing input to a temporary file.
+
  @return TRUE if the buffer is successfully initialized, FALSE if it is not.
  */
 BOOL
 SpongeAllocateBuffer(
-    __out PSPONGE_BUFFER Buffer
+    __out PSPONGE_BUFFER Buffer,
+    __in DWORD MaximumBytesAllocated
     )
 {
     Buffer->BytesAllocated = 1024;
+    if (Buffer->BytesAllocated > MaximumBytesAllocated) {
+        MaximumBytesAllocated = Buffer->BytesAllocated;
+    }
+    Buffer->MaximumBytesAllocated = MaximumBytesAllocated;
+    YoriLibInitEmptyString(&Buffer->SpillFileName);
+    Buffer->SpillDeleteOnClose = FALSE;
     Buffer->Buffer = YoriLibMalloc(Buffer->BytesAllocated);
     if (Buffer->Buffer == NULL) {
         return FALSE;
@@ -219,9 +577,17 @@ SpongeFreeBuffer(
     if (ThisBuffer->Buffer != NULL) {
         YoriLibFree(ThisBuffer->Buffer);
     }
+    if (ThisBuffer->hSpill != NULL) {
+        CloseHandle(ThisBuffer->hSpill);
+    }
+    if (ThisBuffer->SpillFileName.LengthInChars > 0) {
+        DeleteFile(ThisBuffer->SpillFileName.StartOfString);
+    }
+    YoriLibFreeStringContents(&ThisBuffer->SpillFileName);
 }
 
 
+
 #ifdef YORI_BUILTIN
 /**
  The main entrypoint for the sponge builtin command.
@@ -256,8 +622,13 @@ ENTRYPOINT(
     SPONGE_BUFFER SpongeBuffer;
     YORI_STRING FullFilePath;
     HANDLE hTarget;
+    DWORD MaximumBytesInMemory;
+    LARGE_INTEGER FileSize;
+    BOOL Renamed;
+    BOOL Result;
 
     ZeroMemory(&SpongeBuffer, sizeof(SpongeBuffer));
+    MaximumBytesInMemory = SPONGE_DEFAULT_MEMORY_LIMIT;
 
     for (i = 1; i < ArgC; i++) {
 
@@ -271,6 +642,17 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("license")) == 0) {
                 YoriLibDisplayMitLicense(_T("2019"));
                 return EXIT_SUCCESS;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("m")) == 0) {
+                if (i + 1 < ArgC) {
+                    FileSize = YoriLibStringToFileSize(&ArgV[i + 1]);
+                    if (FileSize.HighPart != 0 || FileSize.LowPart > SPONGE_MAXIMUM_MEMORY_LIMIT) {
+                        MaximumBytesInMemory = SPONGE_MAXIMUM_MEMORY_LIMIT;
+                    } else {
+                        MaximumBytesInMemory = FileSize.LowPart;
+                    }
+                    ArgumentUnderstood = TRUE;
+                    i++;
+                }
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("-")) == 0) {
                 ArgumentUnderstood = TRUE;
                 StartArg = i + 1;
@@ -296,7 +678,7 @@ ENTRYPOINT(
         return EXIT_FAILURE;
     }
 
-    if (!SpongeAllocateBuffer(&SpongeBuffer)) {
+    if (!SpongeAllocateBuffer(&SpongeBuffer, MaximumBytesInMemory)) {
         return EXIT_FAILURE;
     }
     SpongeBuffer.hSource = GetStdHandle(STD_INPUT_HANDLE);
@@ -311,18 +693,36 @@ ENTRYPOINT(
         }
     }
 
-    if (!SpongeBufferPump(&SpongeBuffer)) {
+    if (!SpongeBufferPump(&SpongeBuffer, &FullFilePath)) {
         SpongeFreeBuffer(&SpongeBuffer);
+        YoriLibFreeStringContents(&FullFilePath);
         return EXIT_FAILURE;
     }
 
+    //
+    //  If input was written to a temporary file next to the target, make it
+    //  the target.  Otherwise write the input to the target.
+    //
+
     if (FullFilePath.LengthInChars > 0) {
+        if (!SpongeRenameSpillFile(&SpongeBuffer, &FullFilePath, &Renamed)) {
+            SpongeFreeBuffer(&SpongeBuffer);
+            YoriLibFreeStringContents(&FullFilePath);
+            return EXIT_FAILURE;
+        }
+
+        if (Renamed) {
+            SpongeFreeBuffer(&SpongeBuffer);
+            YoriLibFreeStringContents(&FullFilePath);
+            return EXIT_SUCCESS;
+        }
+
         hTarget = CreateFile(FullFilePath.StartOfString,
                              GENERIC_WRITE,
                              FILE_SHARE_READ | FILE_SHARE_DELETE,
                              NULL,
                              CREATE_ALWAYS,
-                             0,
+                             FILE_FLAG_SEQUENTIAL_SCAN,
                              NULL);
         if (hTarget == INVALID_HANDLE_VALUE) {
             DWORD LastError = GetLastError();
@@ -335,7 +735,21 @@ ENTRYPOINT(
         }
     }
 
-    SpongeBufferForward(&SpongeBuffer, hTarget);
+    Result = SpongeBufferForward(&SpongeBuffer, hTarget);
+    if (!Result) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("sponge: write failed\n"));
+
+        //
+        //  If the input is in a temporary file next to the target, keep it,
+        //  since the target may now be incomplete.
+        //
+
+        if (SpongeBuffer.SpillFileName.LengthInChars > 0 &&
+            SpongeSetSpillFileDisposition(&SpongeBuffer, FALSE)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("sponge: input retained in %y\n"), &SpongeBuffer.SpillFileName);
+            SpongeBuffer.SpillFileName.LengthInChars = 0;
+        }
+    }
 
     if (FullFilePath.LengthInChars > 0) {
         CloseHandle(hTarget);
@@ -344,6 +758,10 @@ ENTRYPOINT(
 
     SpongeFreeBuffer(&SpongeBuffer);
 
+    if (!Result) {
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
 
@@ -140,6 +140,7 @@ TailProcessStream(
     DWORDLONG StartLine = 0;
     DWORDLONG CurrentLine;
     PYORI_STRING LineString;
+    YORI_LIB_LINE_VIEW LineView;
     BOOL LineTerminated;
     BOOL TimeoutReached;
     DWORD SeekToEndOffset = 0;
@@ -169,10 +170,31 @@ TailProcessStream(
         }
         TailContext->LinesFound = 0;
 
+        //
+        //  If the stream will not be monitored for more data, read lines
+        //  as views so that disk files can be mapped rather than copied
+        //  through a holdover buffer.
+        //
+
+        if (!TailContext->WaitForMore) {
+            if (!YoriLibLineViewOpen(hSource, &LineContext)) {
+                return FALSE;
+            }
+        }
+
         while (TRUE) {
 
-            if (!YoriLibReadLineToStringEx(&TailContext->LinesArray[TailContext->LinesFound % TailContext->LinesToDisplay], &LineContext, !TailContext->WaitForMore, INFINITE, hSource, &LineTerminated, &TimeoutReached)) {
-                break;
+            LineString = &TailContext->LinesArray[TailContext->LinesFound % TailContext->LinesToDisplay];
+            if (TailContext->WaitForMore) {
+                if (!YoriLibReadLineToStringEx(LineString, &LineContext, FALSE, INFINITE, hSource, &LineTerminated, &TimeoutReached)) {
+                    break;
+                }
+            } else {
+                if (!YoriLibLineViewNext(LineContext, &LineView) ||
+                    !YoriLibLineViewToString(&LineView, LineString)) {
+
+                    break;
+                }
             }
 
             TailContext->LinesFound++;
@@ -200,7 +222,11 @@ TailProcessStream(
                 SeekToEndOffset = 0;
                 SetFilePointer(hSource, 0, NULL, FILE_BEGIN);
             }
-            YoriLibLineReadClose(LineContext);
+            if (TailContext->WaitForMore) {
+                YoriLibLineReadClose(LineContext);
+            } else {
+                YoriLibLineViewClose(LineContext);
+            }
             LineContext = NULL;
             continue;
         } else {
@@ -226,9 +252,11 @@ TailProcessStream(
             }
             YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%y\n"), &TailContext->LinesArray[0]);
         }
+        YoriLibLineReadClose(LineContext);
+    } else {
+        YoriLibLineViewClose(LineContext);
     }
 
-    YoriLibLineReadClose(LineContext);
     return TRUE;
 }
 
@@ -38,6 +38,13 @@ PYORI_STRING SearchFor = NULL;
  */
 LPTSTR SearchVar = _T("PATH");
 
+/**
+ If TRUE, report how many directories were searched using the executable
+ lookup cache.  The cache belongs to the shell, so this is only meaningful
+ when running as a shell builtin.
+ */
+BOOL DisplayCacheStatistics = FALSE;
+
 /**
  Usage text for this application.
  */
@@ -47,8 +54,9 @@ CHAR strWhichUsageText[] =
      "Searches a semicolon delimited environment variable for a file.  When\n"
      "searching PATH, also applies PATHEXT executable extension matching.\n"
      "\n"
-     "WHICH [-license] [-p <variable>] <file>\n"
+     "WHICH [-license] [-c] [-p <variable>] <file>\n"
      "\n"
+     "   -c     Report how many directories were answered from the shell's lookup cache\n"
      "   -p var Indicates the environment variable to search.  If not specified, use PATH\n"
      "\n"
      " If PATHEXT not defined, defaults to .COM, .EXE, .BAT and .CMD\n"
@@ -87,6 +95,8 @@ WhichParseArgs(
     DWORD i;
     YORI_STRING Arg;
 
+    DisplayCacheStatistics = FALSE;
+
     for (i = 1; i < ArgC; i++) {
         if (YoriLibIsCommandLineOption(&ArgV[i], &Arg)) {
             BOOL Parsed = FALSE;
@@ -94,6 +104,9 @@ WhichParseArgs(
             if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("license")) == 0) {
                 YoriLibDisplayMitLicense(_T("2014-2018"));
                 return EXIT_SUCCESS;
+            } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("c")) == 0) {
+                DisplayCacheStatistics = TRUE;
+                Parsed = TRUE;
             } else if (YoriLibCompareStringWithLiteralInsensitive(&Arg, _T("p")) == 0 &&
                        ArgC > i + 1) {
 
@@ -148,6 +161,11 @@ ENTRYPOINT(
 {
     YORI_STRING FoundPath;
     BOOL Result = FALSE;
+    DWORD CacheHits;
+    DWORD CacheMisses;
+    DWORD NewCacheHits;
+    DWORD NewCacheMisses;
+    BOOL CacheEnabled;
 
     if (!WhichParseArgs(ArgC, ArgV)) {
         return EXIT_FAILURE;
@@ -170,7 +188,16 @@ ENTRYPOINT(
     YoriLibInitEmptyString(&FoundPath);
 
     if (_tcsicmp(SearchVar, _T("PATH")) == 0) {
+        CacheEnabled = YoriLibPathCacheQueryStatistics(&CacheHits, &CacheMisses);
         Result = YoriLibLocateExecutableInPath(SearchFor, NULL, NULL, &FoundPath);
+        if (DisplayCacheStatistics) {
+            if (CacheEnabled) {
+                YoriLibPathCacheQueryStatistics(&NewCacheHits, &NewCacheMisses);
+                YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("Directories from cache: %i, directories probed: %i\n"), NewCacheHits - CacheHits, NewCacheMisses - CacheMisses);
+            } else {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("which: lookup cache statistics are only available when running as a shell builtin\n"));
+            }
+        }
     } else {
         DWORD VarLength;
         YORI_STRING SearchVarData;